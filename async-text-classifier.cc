@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "async-text-classifier.h"
+
+#include <memory>
+#include <utility>
+
+namespace libtextclassifier2 {
+namespace {
+
+// Returns a callback that fulfills 'promise', and can be copied into a
+// std::function, unlike the promise itself.
+template <typename T>
+std::function<void(T)> FulfillPromise(
+    std::shared_ptr<std::promise<T>> promise) {
+  return [promise](T result) { promise->set_value(std::move(result)); };
+}
+
+}  // namespace
+
+AsyncTextClassifier::AsyncTextClassifier(
+    const TextClassifier* classifier,
+    const AsyncTextClassifierOptions& async_options)
+    : classifier_(classifier), pool_(async_options.num_threads) {}
+
+void AsyncTextClassifier::SuggestSelectionAsync(
+    const std::string& context, CodepointSpan click_indices,
+    const SelectionOptions& options, std::function<void(CodepointSpan)> done) {
+  const TextClassifier* classifier = classifier_;
+  pool_.Schedule([classifier, context, click_indices, options, done]() {
+    done(classifier->SuggestSelection(context, click_indices, options));
+  });
+}
+
+void AsyncTextClassifier::ClassifyTextAsync(
+    const std::string& context, CodepointSpan selection_indices,
+    const ClassificationOptions& options,
+    std::function<void(std::vector<ClassificationResult>)> done) {
+  const TextClassifier* classifier = classifier_;
+  pool_.Schedule([classifier, context, selection_indices, options, done]() {
+    done(classifier->ClassifyText(context, selection_indices, options));
+  });
+}
+
+void AsyncTextClassifier::AnnotateAsync(
+    const std::string& context, const AnnotationOptions& options,
+    std::function<void(std::vector<AnnotatedSpan>)> done) {
+  const TextClassifier* classifier = classifier_;
+  pool_.Schedule([classifier, context, options, done]() {
+    done(classifier->Annotate(context, options));
+  });
+}
+
+std::future<CodepointSpan> AsyncTextClassifier::SuggestSelectionAsync(
+    const std::string& context, CodepointSpan click_indices,
+    const SelectionOptions& options) {
+  auto promise = std::make_shared<std::promise<CodepointSpan>>();
+  std::future<CodepointSpan> result = promise->get_future();
+  SuggestSelectionAsync(context, click_indices, options,
+                        FulfillPromise(std::move(promise)));
+  return result;
+}
+
+std::future<std::vector<ClassificationResult>>
+AsyncTextClassifier::ClassifyTextAsync(const std::string& context,
+                                       CodepointSpan selection_indices,
+                                       const ClassificationOptions& options) {
+  auto promise =
+      std::make_shared<std::promise<std::vector<ClassificationResult>>>();
+  std::future<std::vector<ClassificationResult>> result =
+      promise->get_future();
+  ClassifyTextAsync(context, selection_indices, options,
+                    FulfillPromise(std::move(promise)));
+  return result;
+}
+
+std::future<std::vector<AnnotatedSpan>> AsyncTextClassifier::AnnotateAsync(
+    const std::string& context, const AnnotationOptions& options) {
+  auto promise = std::make_shared<std::promise<std::vector<AnnotatedSpan>>>();
+  std::future<std::vector<AnnotatedSpan>> result = promise->get_future();
+  AnnotateAsync(context, options, FulfillPromise(std::move(promise)));
+  return result;
+}
+
+}  // namespace libtextclassifier2
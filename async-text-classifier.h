@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Non-blocking variants of the TextClassifier calls, for callers that run an
+// event loop and must not block it.
+
+#ifndef LIBTEXTCLASSIFIER_ASYNC_TEXT_CLASSIFIER_H_
+#define LIBTEXTCLASSIFIER_ASYNC_TEXT_CLASSIFIER_H_
+
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "text-classifier.h"
+#include "types.h"
+#include "util/base/macros.h"
+#include "util/thread/thread-pool.h"
+
+namespace libtextclassifier2 {
+
+struct AsyncTextClassifierOptions {
+  // Number of threads that run the calls. The selection and classification
+  // interpreters are pooled by the classifier, so each thread keeps reusing
+  // one of its own once there are as many as threads.
+  int num_threads = 2;
+};
+
+// Runs the calls of a TextClassifier on a thread pool of its own, and hands
+// the results to a callback or a future. The calls are independent, so while
+// one of them runs the models, the next one is already tokenizing and
+// extracting features on another thread. The results are the same as those
+// of the blocking calls.
+// The options are copied, but what they point to, e.g. the latency stats or
+// the cancellation token, has to outlive the call.
+class AsyncTextClassifier {
+ public:
+  // Does not take ownership of 'classifier', which must outlive this object.
+  AsyncTextClassifier(const TextClassifier* classifier,
+                      const AsyncTextClassifierOptions& async_options =
+                          AsyncTextClassifierOptions());
+
+  // Waits for the calls in flight to finish.
+  ~AsyncTextClassifier() = default;
+
+  // Same as TextClassifier::SuggestSelection(), ClassifyText() and
+  // Annotate(), but returning right away. The callback runs on a thread of
+  // the pool, and must not block waiting for other calls of this object.
+  void SuggestSelectionAsync(const std::string& context,
+                             CodepointSpan click_indices,
+                             const SelectionOptions& options,
+                             std::function<void(CodepointSpan)> done);
+  void ClassifyTextAsync(
+      const std::string& context, CodepointSpan selection_indices,
+      const ClassificationOptions& options,
+      std::function<void(std::vector<ClassificationResult>)> done);
+  void AnnotateAsync(const std::string& context,
+                     const AnnotationOptions& options,
+                     std::function<void(std::vector<AnnotatedSpan>)> done);
+
+  // Same as above, with the results in a future.
+  std::future<CodepointSpan> SuggestSelectionAsync(
+      const std::string& context, CodepointSpan click_indices,
+      const SelectionOptions& options = SelectionOptions::Default());
+  std::future<std::vector<ClassificationResult>> ClassifyTextAsync(
+      const std::string& context, CodepointSpan selection_indices,
+      const ClassificationOptions& options = ClassificationOptions::Default());
+  std::future<std::vector<AnnotatedSpan>> AnnotateAsync(
+      const std::string& context,
+      const AnnotationOptions& options = AnnotationOptions::Default());
+
+ private:
+  const TextClassifier* const classifier_;
+  ThreadPool pool_;
+
+  TC_DISALLOW_COPY_AND_ASSIGN(AsyncTextClassifier);
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_ASYNC_TEXT_CLASSIFIER_H_
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "async-text-classifier.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+std::string GetModelPath() { return LIBTEXTCLASSIFIER_TEST_DATA_DIR; }
+
+class AsyncTextClassifierTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    classifier_ =
+        TextClassifier::FromPath(GetModelPath() + "test_model.fb", &unilib_);
+    ASSERT_TRUE(classifier_);
+  }
+
+  const UniLib unilib_;
+  std::unique_ptr<TextClassifier> classifier_;
+};
+
+TEST_F(AsyncTextClassifierTest, FuturesMatchBlockingCalls) {
+  const std::string text = "call me at (800) 123-456 today";
+  AsyncTextClassifier async_classifier(classifier_.get());
+
+  std::future<CodepointSpan> selection =
+      async_classifier.SuggestSelectionAsync(text, {11, 16});
+  std::future<std::vector<ClassificationResult>> classification =
+      async_classifier.ClassifyTextAsync(text, {11, 24});
+  std::future<std::vector<AnnotatedSpan>> annotations =
+      async_classifier.AnnotateAsync(text);
+
+  EXPECT_EQ(selection.get(), classifier_->SuggestSelection(text, {11, 16}));
+  const std::vector<ClassificationResult> expected_classification =
+      classifier_->ClassifyText(text, {11, 24});
+  const std::vector<ClassificationResult> result_classification =
+      classification.get();
+  ASSERT_EQ(result_classification.size(), expected_classification.size());
+  for (int i = 0; i < expected_classification.size(); ++i) {
+    EXPECT_EQ(result_classification[i].collection,
+              expected_classification[i].collection);
+  }
+  const std::vector<AnnotatedSpan> expected_annotations =
+      classifier_->Annotate(text);
+  const std::vector<AnnotatedSpan> result_annotations = annotations.get();
+  ASSERT_EQ(result_annotations.size(), expected_annotations.size());
+  for (int i = 0; i < expected_annotations.size(); ++i) {
+    EXPECT_EQ(result_annotations[i].span, expected_annotations[i].span);
+  }
+}
+
+TEST_F(AsyncTextClassifierTest, RunsCallbacksOfConcurrentCalls) {
+  const std::string text = "my phone number is 853 225 3556";
+  const int num_annotations = classifier_->Annotate(text).size();
+  ASSERT_GT(num_annotations, 0);
+
+  std::mutex mutex;
+  std::condition_variable done;
+  int num_pending = 20;
+  std::vector<int> sizes;
+  {
+    AsyncTextClassifierOptions async_options;
+    async_options.num_threads = 4;
+    AsyncTextClassifier async_classifier(classifier_.get(), async_options);
+    for (int i = 0; i < 20; ++i) {
+      async_classifier.AnnotateAsync(
+          text, AnnotationOptions::Default(),
+          [&](std::vector<AnnotatedSpan> annotations) {
+            std::lock_guard<std::mutex> lock(mutex);
+            sizes.push_back(annotations.size());
+            if (--num_pending == 0) {
+              done.notify_one();
+            }
+          });
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&num_pending]() { return num_pending == 0; });
+  }
+  EXPECT_THAT(sizes, testing::Each(num_annotations));
+  EXPECT_EQ(sizes.size(), 20);
+}
+
+TEST_F(AsyncTextClassifierTest, DestructorFinishesPendingCalls) {
+  std::vector<std::future<std::vector<AnnotatedSpan>>> results;
+  {
+    AsyncTextClassifierOptions async_options;
+    async_options.num_threads = 1;
+    AsyncTextClassifier async_classifier(classifier_.get(), async_options);
+    for (int i = 0; i < 5; ++i) {
+      results.push_back(
+          async_classifier.AnnotateAsync("my phone number is 853 225 3556"));
+    }
+  }
+  for (std::future<std::vector<AnnotatedSpan>>& result : results) {
+    ASSERT_EQ(result.wait_for(std::chrono::seconds(0)),
+              std::future_status::ready);
+    EXPECT_FALSE(result.get().empty());
+  }
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
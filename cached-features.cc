@@ -16,6 +16,9 @@
 
 #include "cached-features.h"
 
+#include <algorithm>
+
+#include "quantization.h"
 #include "tensor-view.h"
 #include "util/base/logging.h"
 
@@ -60,7 +63,8 @@ std::unique_ptr<CachedFeatures> CachedFeatures::Create(
     const TokenSpan& extraction_span,
     std::unique_ptr<std::vector<float>> features,
     std::unique_ptr<std::vector<float>> padding_features,
-    const FeatureProcessorOptions* options, int feature_vector_size) {
+    const FeatureProcessorOptions* options, int feature_vector_size,
+    VectorPool<float>* buffer_pool, bool half_precision) {
   const int min_feature_version =
       options->bounds_sensitive_features() &&
               options->bounds_sensitive_features()->enabled()
@@ -75,99 +79,213 @@ std::unique_ptr<CachedFeatures> CachedFeatures::Create(
   cached_features->extraction_span_ = extraction_span;
   cached_features->features_ = std::move(features);
   cached_features->padding_features_ = std::move(padding_features);
+  cached_features->num_features_per_token_ =
+      cached_features->padding_features_->size();
   cached_features->options_ = options;
+  cached_features->buffer_pool_ = buffer_pool;
 
   cached_features->output_features_size_ =
       CalculateOutputFeaturesSize(options, feature_vector_size);
 
+  if (min_feature_version == 1) {
+    // The padded copy would take more memory than the half precision saves,
+    // so the click contexts are then assembled on every write.
+    if (!half_precision) {
+      cached_features->BuildPaddedFeatures();
+    }
+  } else if (options->bounds_sensitive_features()->include_inside_bag()) {
+    cached_features->BuildBagPrefixSums();
+  }
+  if (half_precision) {
+    cached_features->StoreInHalfPrecision();
+  }
+
   return cached_features;
 }
 
+CachedFeatures::~CachedFeatures() {
+  if (buffer_pool_ != nullptr) {
+    buffer_pool_->Release(std::move(features_));
+    buffer_pool_->Release(std::move(padding_features_));
+    buffer_pool_->Release(std::move(padded_features_));
+  }
+}
+
+void CachedFeatures::BuildPaddedFeatures() {
+  const int context_size = options_->context_size();
+  if (buffer_pool_ != nullptr) {
+    padded_features_ = buffer_pool_->Acquire();
+  } else {
+    padded_features_.reset(new std::vector<float>());
+  }
+  padded_features_->resize(features_->size() +
+                           2 * context_size * NumFeaturesPerToken());
+  float* output = padded_features_->data();
+  for (int i = 0; i < context_size; ++i) {
+    output = WritePaddingFeatures(output);
+  }
+  output = std::copy(features_->begin(), features_->end(), output);
+  for (int i = 0; i < context_size; ++i) {
+    output = WritePaddingFeatures(output);
+  }
+}
+
+void CachedFeatures::StoreInHalfPrecision() {
+  half_features_.resize(features_->size());
+  FloatsToBfloat16(features_->data(), features_->size(), half_features_.data());
+  if (buffer_pool_ != nullptr) {
+    buffer_pool_->Release(std::move(features_));
+  }
+  features_.reset();
+}
+
+void CachedFeatures::BuildBagPrefixSums() {
+  const int num_features = NumFeaturesPerToken();
+  const int num_tokens =
+      num_features > 0 ? features_->size() / num_features : 0;
+  bag_prefix_sums_.assign((num_tokens + 1) * num_features, 0.0);
+  const float* token_features = features_->data();
+  double* sums = bag_prefix_sums_.data();
+  for (int i = 0; i < num_tokens; ++i) {
+    for (int j = 0; j < num_features; ++j) {
+      sums[num_features + j] = sums[j] + token_features[j];
+    }
+    token_features += num_features;
+    sums += num_features;
+  }
+}
+
+const float* CachedFeatures::ClickContextFeaturesView(int click_pos) const {
+  click_pos -= extraction_span_.first;
+  if (padded_features_ == nullptr || click_pos < 0 ||
+      click_pos >= TokenSpanSize(extraction_span_)) {
+    return nullptr;
+  }
+
+  // With context_size padding tokens in front, the context of the click starts
+  // at the click's own index in the padded matrix.
+  return padded_features_->data() + click_pos * NumFeaturesPerToken();
+}
+
 void CachedFeatures::AppendClickContextFeaturesForClick(
     int click_pos, std::vector<float>* output_features) const {
+  const int offset = output_features->size();
+  output_features->resize(offset + OutputFeaturesSize());
+  WriteClickContextFeaturesForClick(click_pos,
+                                    output_features->data() + offset);
+}
+
+void CachedFeatures::WriteClickContextFeaturesForClick(int click_pos,
+                                                       float* output) const {
+  const float* view = ClickContextFeaturesView(click_pos);
+  if (view != nullptr) {
+    std::copy(view, view + OutputFeaturesSize(), output);
+    return;
+  }
+
   click_pos -= extraction_span_.first;
 
-  AppendFeaturesInternal(
+  WriteFeaturesInternal(
       /*intended_span=*/ExpandTokenSpan(SingleTokenSpan(click_pos),
                                         options_->context_size(),
                                         options_->context_size()),
-      /*read_mask_span=*/{0, TokenSpanSize(extraction_span_)}, output_features);
+      /*read_mask_span=*/{0, TokenSpanSize(extraction_span_)}, output);
 }
 
 void CachedFeatures::AppendBoundsSensitiveFeaturesForSpan(
     TokenSpan selected_span, std::vector<float>* output_features) const {
+  const int offset = output_features->size();
+  output_features->resize(offset + OutputFeaturesSize());
+  WriteBoundsSensitiveFeaturesForSpan(selected_span,
+                                      output_features->data() + offset);
+}
+
+void CachedFeatures::WriteBoundsSensitiveFeaturesForSpan(
+    TokenSpan selected_span, float* output) const {
   const FeatureProcessorOptions_::BoundsSensitiveFeatures* config =
       options_->bounds_sensitive_features();
 
   selected_span.first -= extraction_span_.first;
   selected_span.second -= extraction_span_.first;
 
-  // Append the features for tokens around the left bound. Masks out tokens
+  // Write the features for tokens around the left bound. Masks out tokens
   // after the right bound, so that if num_tokens_inside_left goes past it,
   // padding tokens will be used.
-  AppendFeaturesInternal(
+  output = WriteFeaturesInternal(
       /*intended_span=*/{selected_span.first - config->num_tokens_before(),
                          selected_span.first +
                              config->num_tokens_inside_left()},
-      /*read_mask_span=*/{0, selected_span.second}, output_features);
+      /*read_mask_span=*/{0, selected_span.second}, output);
 
-  // Append the features for tokens around the right bound. Masks out tokens
+  // Write the features for tokens around the right bound. Masks out tokens
   // before the left bound, so that if num_tokens_inside_right goes past it,
   // padding tokens will be used.
-  AppendFeaturesInternal(
+  output = WriteFeaturesInternal(
       /*intended_span=*/{selected_span.second -
                              config->num_tokens_inside_right(),
                          selected_span.second + config->num_tokens_after()},
       /*read_mask_span=*/{selected_span.first, TokenSpanSize(extraction_span_)},
-      output_features);
+      output);
 
   if (config->include_inside_bag()) {
-    AppendBagFeatures(selected_span, output_features);
+    output = WriteBagFeatures(selected_span, output);
   }
 
   if (config->include_inside_length()) {
-    output_features->push_back(
-        static_cast<float>(TokenSpanSize(selected_span)));
+    *output++ = static_cast<float>(TokenSpanSize(selected_span));
   }
 }
 
-void CachedFeatures::AppendFeaturesInternal(
-    const TokenSpan& intended_span, const TokenSpan& read_mask_span,
-    std::vector<float>* output_features) const {
-  const TokenSpan copy_span =
-      IntersectTokenSpans(intended_span, read_mask_span);
-  for (int i = intended_span.first; i < copy_span.first; ++i) {
-    AppendPaddingFeatures(output_features);
-  }
-  output_features->insert(
-      output_features->end(),
-      features_->begin() + copy_span.first * NumFeaturesPerToken(),
-      features_->begin() + copy_span.second * NumFeaturesPerToken());
-  for (int i = copy_span.second; i < intended_span.second; ++i) {
-    AppendPaddingFeatures(output_features);
+float* CachedFeatures::WriteFeaturesInternal(const TokenSpan& intended_span,
+                                             const TokenSpan& read_mask_span,
+                                             float* output) const {
+  // Clamp the copied span into the intended one, so that exactly
+  // TokenSpanSize(intended_span) tokens are written even if the spans do not
+  // overlap.
+  const int copy_begin =
+      std::min(std::max(intended_span.first, read_mask_span.first),
+               intended_span.second);
+  const int copy_end = std::max(
+      copy_begin, std::min(intended_span.second, read_mask_span.second));
+  for (int i = intended_span.first; i < copy_begin; ++i) {
+    output = WritePaddingFeatures(output);
+  }
+  const int num_features = NumFeaturesPerToken();
+  const int num_copied = (copy_end - copy_begin) * num_features;
+  if (features_ != nullptr) {
+    output = std::copy_n(features_->begin() + copy_begin * num_features,
+                         num_copied, output);
+  } else {
+    Bfloat16ToFloats(half_features_.data() + copy_begin * num_features,
+                     num_copied, output);
+    output += num_copied;
   }
+  for (int i = copy_end; i < intended_span.second; ++i) {
+    output = WritePaddingFeatures(output);
+  }
+  return output;
 }
 
-void CachedFeatures::AppendPaddingFeatures(
-    std::vector<float>* output_features) const {
-  output_features->insert(output_features->end(), padding_features_->begin(),
-                          padding_features_->end());
+float* CachedFeatures::WritePaddingFeatures(float* output) const {
+  return std::copy(padding_features_->begin(), padding_features_->end(),
+                   output);
 }
 
-void CachedFeatures::AppendBagFeatures(
-    const TokenSpan& bag_span, std::vector<float>* output_features) const {
-  const int offset = output_features->size();
-  output_features->resize(output_features->size() + NumFeaturesPerToken());
-  for (int i = bag_span.first; i < bag_span.second; ++i) {
-    for (int j = 0; j < NumFeaturesPerToken(); ++j) {
-      (*output_features)[offset + j] +=
-          (*features_)[i * NumFeaturesPerToken() + j] / TokenSpanSize(bag_span);
-    }
+float* CachedFeatures::WriteBagFeatures(const TokenSpan& bag_span,
+                                        float* output) const {
+  const int num_features = NumFeaturesPerToken();
+  const int bag_size = TokenSpanSize(bag_span);
+  if (bag_size <= 0) {
+    return std::fill_n(output, num_features, 0.0f);
   }
-}
 
-int CachedFeatures::NumFeaturesPerToken() const {
-  return padding_features_->size();
+  const double scale = 1.0 / bag_size;
+  const double* begin_sums = &bag_prefix_sums_[bag_span.first * num_features];
+  const double* end_sums = &bag_prefix_sums_[bag_span.second * num_features];
+  for (int j = 0; j < num_features; ++j) {
+    output[j] = static_cast<float>((end_sums[j] - begin_sums[j]) * scale);
+  }
+  return output + num_features;
 }
 
 }  // namespace libtextclassifier2
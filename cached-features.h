@@ -23,6 +23,7 @@
 #include "model-executor.h"
 #include "model_generated.h"
 #include "types.h"
+#include "util/memory/vector-pool.h"
 
 namespace libtextclassifier2 {
 
@@ -30,52 +31,98 @@ namespace libtextclassifier2 {
 // Assumes that features for each Token are independent.
 class CachedFeatures {
  public:
+  // If 'buffer_pool' is given, the feature vectors are handed back to it when
+  // the object is destroyed, so that they can be reused for the next context.
+  // If 'half_precision' is true, the token features are kept in bfloat16,
+  // which takes half the memory of the floats, and widened back when they
+  // are written out; the float vector is handed back right away. That changes
+  // the features by up to 2^-9 relative. Meant for long extraction spans.
   static std::unique_ptr<CachedFeatures> Create(
       const TokenSpan& extraction_span,
       std::unique_ptr<std::vector<float>> features,
       std::unique_ptr<std::vector<float>> padding_features,
-      const FeatureProcessorOptions* options, int feature_vector_size);
+      const FeatureProcessorOptions* options, int feature_vector_size,
+      VectorPool<float>* buffer_pool = nullptr, bool half_precision = false);
+
+  ~CachedFeatures();
 
   // Appends the click context features for the given click position to
   // 'output_features'.
   void AppendClickContextFeaturesForClick(
       int click_pos, std::vector<float>* output_features) const;
 
+  // Same as above, but writes the OutputFeaturesSize() features to 'output'
+  // (e.g. straight into an input tensor of the model).
+  void WriteClickContextFeaturesForClick(int click_pos, float* output) const;
+
+  // Returns a view of the OutputFeaturesSize() click context features for the
+  // given click position, without copying them. Returns nullptr if the model
+  // does not use click context features, the features are kept in half
+  // precision or the click is outside of the extraction span. The view is
+  // valid for the lifetime of this object.
+  const float* ClickContextFeaturesView(int click_pos) const;
+
   // Appends the bounds-sensitive features for the given token span to
   // 'output_features'.
   void AppendBoundsSensitiveFeaturesForSpan(
       TokenSpan selected_span, std::vector<float>* output_features) const;
 
+  // Same as above, but writes the OutputFeaturesSize() features to 'output'.
+  void WriteBoundsSensitiveFeaturesForSpan(TokenSpan selected_span,
+                                           float* output) const;
+
   // Returns number of features that 'AppendFeaturesForSpan' appends.
   int OutputFeaturesSize() const { return output_features_size_; }
 
  private:
   CachedFeatures() {}
 
-  // Appends token features to the output. The intended_span specifies which
-  // tokens' features should be used in principle. The read_mask_span restricts
-  // which tokens are actually read. For tokens outside of the read_mask_span,
-  // padding tokens are used instead.
-  void AppendFeaturesInternal(const TokenSpan& intended_span,
-                              const TokenSpan& read_mask_span,
-                              std::vector<float>* output_features) const;
+  // Writes token features to the output and returns the end of the written
+  // range. The intended_span specifies which tokens' features should be used in
+  // principle. The read_mask_span restricts which tokens are actually read. For
+  // tokens outside of the read_mask_span, padding tokens are used instead.
+  float* WriteFeaturesInternal(const TokenSpan& intended_span,
+                               const TokenSpan& read_mask_span,
+                               float* output) const;
 
-  // Appends features of one padding token to the output.
-  void AppendPaddingFeatures(std::vector<float>* output_features) const;
+  // Writes features of one padding token to the output.
+  float* WritePaddingFeatures(float* output) const;
 
-  // Appends the features of tokens from the given span to the output. The
-  // features are averaged so that the appended features have the size
+  // Writes the features of tokens from the given span to the output. The
+  // features are averaged so that the written features have the size
   // corresponding to one token.
-  void AppendBagFeatures(const TokenSpan& bag_span,
-                         std::vector<float>* output_features) const;
+  float* WriteBagFeatures(const TokenSpan& bag_span, float* output) const;
+
+  int NumFeaturesPerToken() const { return num_features_per_token_; }
+
+  // Fills bag_prefix_sums_ with the running sums of the token features, so
+  // that the bag of any span is one subtraction per feature.
+  void BuildBagPrefixSums();
+
+  // Fills padded_features_ with the token features surrounded by context_size
+  // padding tokens on both sides, so that the click context of any token in
+  // the extraction span is a contiguous range.
+  void BuildPaddedFeatures();
 
-  int NumFeaturesPerToken() const;
+  // Moves the token features from features_ to half_features_.
+  void StoreInHalfPrecision();
 
   TokenSpan extraction_span_;
   const FeatureProcessorOptions* options_;
   int output_features_size_;
+  int num_features_per_token_;
+  // The token features, either in features_ or, in half precision, in
+  // half_features_, with the other one null or empty.
   std::unique_ptr<std::vector<float>> features_;
+  std::vector<uint16> half_features_;
   std::unique_ptr<std::vector<float>> padding_features_;
+  // Only used for click context features, see BuildPaddedFeatures().
+  std::unique_ptr<std::vector<float>> padded_features_;
+  // Only used for the inside bag of bounds-sensitive features. Row i holds the
+  // sums of the features of tokens [0, i); kept in double so that subtracting
+  // two large sums does not lose the precision of a short span.
+  std::vector<double> bag_prefix_sums_;
+  VectorPool<float>* buffer_pool_ = nullptr;
 };
 
 }  // namespace libtextclassifier2
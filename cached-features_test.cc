@@ -16,6 +16,9 @@
 
 #include "cached-features.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include "model-executor.h"
 #include "tensor-view.h"
 
@@ -93,6 +96,53 @@ TEST(CachedFeaturesTest, ClickContext) {
   EXPECT_THAT(GetCachedClickContextFeatures(*cached_features, 7),
               ElementsAreFloat({33.0, -33.0, 0.3, 44.0, -44.0, 0.4, 55.0, -55.0,
                                 0.5, 66.0, -66.0, 0.6, 77.0, -77.0, 0.7}));
+
+  // Near the bounds of the extraction span, the context contains padding.
+  EXPECT_THAT(GetCachedClickContextFeatures(*cached_features, 3),
+              ElementsAreFloat({112233.0, -112233.0, 321.0, 112233.0, -112233.0,
+                                321.0, 11.0, -11.0, 0.1, 22.0, -22.0, 0.2, 33.0,
+                                -33.0, 0.3}));
+
+  // The views point into one padded matrix, so consecutive clicks are one
+  // token apart.
+  const float* view = cached_features->ClickContextFeaturesView(6);
+  ASSERT_NE(view, nullptr);
+  EXPECT_EQ(cached_features->ClickContextFeaturesView(7), view + 3);
+  EXPECT_THAT(std::vector<float>(
+                  view, view + cached_features->OutputFeaturesSize()),
+              ElementsAreFloat(GetCachedClickContextFeatures(*cached_features,
+                                                             6)));
+  EXPECT_EQ(cached_features->ClickContextFeaturesView(2), nullptr);
+  EXPECT_EQ(cached_features->ClickContextFeaturesView(10), nullptr);
+}
+
+TEST(CachedFeaturesTest, ReleasesBuffersToPool) {
+  FeatureProcessorOptionsT options;
+  options.context_size = 2;
+  options.feature_version = 1;
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(CreateFeatureProcessorOptions(builder, &options));
+  flatbuffers::DetachedBuffer options_fb = builder.Release();
+
+  VectorPool<float> pool(/*max_pooled_vectors=*/2);
+  std::unique_ptr<std::vector<float>> features = MakeFeatures(9);
+  const float* features_data = features->data();
+  std::unique_ptr<std::vector<float>> padding_features(
+      new std::vector<float>{112233.0, -112233.0, 321.0});
+
+  std::unique_ptr<CachedFeatures> cached_features = CachedFeatures::Create(
+      {3, 10}, std::move(features), std::move(padding_features),
+      flatbuffers::GetRoot<FeatureProcessorOptions>(options_fb.data()),
+      /*feature_vector_size=*/3, &pool);
+  ASSERT_TRUE(cached_features);
+  cached_features.reset();
+
+  // The buffers come back empty, but with their memory still allocated.
+  std::unique_ptr<std::vector<float>> reused_padding = pool.Acquire();
+  std::unique_ptr<std::vector<float>> reused_features = pool.Acquire();
+  EXPECT_TRUE(reused_features->empty());
+  EXPECT_TRUE(reused_padding->empty());
+  EXPECT_EQ(reused_features->data(), features_data);
 }
 
 TEST(CachedFeaturesTest, BoundsSensitive) {
@@ -151,6 +201,125 @@ TEST(CachedFeaturesTest, BoundsSensitive) {
                         112233.0, -112233.0, 321.0, 44.0,     -44.0,     0.4,
                         55.0,     -55.0,     0.5,   66.0,     -66.0,     0.6,
                         44.0,     -44.0,     0.4,   1.0}));
+
+  // Writing into a raw buffer gives the same features as appending.
+  std::vector<float> written(cached_features->OutputFeaturesSize(), -1.0);
+  cached_features->WriteBoundsSensitiveFeaturesForSpan({5, 8}, written.data());
+  EXPECT_THAT(written, ElementsAreFloat(GetCachedBoundsSensitiveFeatures(
+                           *cached_features, {5, 8})));
+}
+
+TEST(CachedFeaturesTest, BoundsSensitiveBagMatchesAverage) {
+  std::unique_ptr<FeatureProcessorOptions_::BoundsSensitiveFeaturesT> config(
+      new FeatureProcessorOptions_::BoundsSensitiveFeaturesT());
+  config->enabled = true;
+  config->include_inside_bag = true;
+  FeatureProcessorOptionsT options;
+  options.bounds_sensitive_features = std::move(config);
+  options.feature_version = 2;
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(CreateFeatureProcessorOptions(builder, &options));
+  flatbuffers::DetachedBuffer options_fb = builder.Release();
+
+  const int num_tokens = 50;
+  std::unique_ptr<std::vector<float>> features = MakeFeatures(num_tokens);
+  const std::vector<float> expected_features = *features;
+  std::unique_ptr<std::vector<float>> padding_features(
+      new std::vector<float>{112233.0, -112233.0, 321.0});
+
+  const std::unique_ptr<CachedFeatures> cached_features =
+      CachedFeatures::Create(
+          {0, num_tokens}, std::move(features), std::move(padding_features),
+          flatbuffers::GetRoot<FeatureProcessorOptions>(options_fb.data()),
+          /*feature_vector_size=*/3);
+  ASSERT_TRUE(cached_features);
+  ASSERT_EQ(cached_features->OutputFeaturesSize(), 3);
+
+  for (int first = 0; first < num_tokens; ++first) {
+    for (int second = first + 1; second <= num_tokens; ++second) {
+      std::vector<float> expected(3, 0.0f);
+      for (int i = first; i < second; ++i) {
+        for (int j = 0; j < 3; ++j) {
+          expected[j] += expected_features[i * 3 + j] / (second - first);
+        }
+      }
+      const std::vector<float> bag =
+          GetCachedBoundsSensitiveFeatures(*cached_features, {first, second});
+      ASSERT_EQ(bag.size(), 3);
+      for (int j = 0; j < 3; ++j) {
+        EXPECT_NEAR(bag[j], expected[j], 1e-4 * std::abs(expected[j]))
+            << "span {" << first << ", " << second << "}";
+      }
+    }
+  }
+}
+
+TEST(CachedFeaturesTest, HalfPrecisionStaysCloseToFloats) {
+  std::unique_ptr<FeatureProcessorOptions_::BoundsSensitiveFeaturesT> config(
+      new FeatureProcessorOptions_::BoundsSensitiveFeaturesT());
+  config->enabled = true;
+  config->num_tokens_before = 2;
+  config->num_tokens_inside_left = 2;
+  config->num_tokens_inside_right = 2;
+  config->num_tokens_after = 2;
+  config->include_inside_bag = true;
+  config->include_inside_length = true;
+  FeatureProcessorOptionsT bounds_sensitive_options;
+  bounds_sensitive_options.bounds_sensitive_features = std::move(config);
+  bounds_sensitive_options.feature_version = 2;
+  FeatureProcessorOptionsT click_context_options;
+  click_context_options.context_size = 2;
+  click_context_options.feature_version = 1;
+
+  for (const FeatureProcessorOptionsT* options :
+       {&bounds_sensitive_options, &click_context_options}) {
+    flatbuffers::FlatBufferBuilder builder;
+    builder.Finish(CreateFeatureProcessorOptions(builder, options));
+    flatbuffers::DetachedBuffer options_fb = builder.Release();
+    const FeatureProcessorOptions* options_flatbuffer =
+        flatbuffers::GetRoot<FeatureProcessorOptions>(options_fb.data());
+
+    VectorPool<float> pool(/*max_pooled_vectors=*/2);
+    std::unique_ptr<std::vector<float>> half_features = MakeFeatures(9);
+    const float* half_features_data = half_features->data();
+    const std::unique_ptr<CachedFeatures> expected_features =
+        CachedFeatures::Create(
+            {3, 12}, MakeFeatures(9),
+            std::unique_ptr<std::vector<float>>(
+                new std::vector<float>{112233.0, -112233.0, 321.0}),
+            options_flatbuffer, /*feature_vector_size=*/3);
+    const std::unique_ptr<CachedFeatures> cached_features =
+        CachedFeatures::Create(
+            {3, 12}, std::move(half_features),
+            std::unique_ptr<std::vector<float>>(
+                new std::vector<float>{112233.0, -112233.0, 321.0}),
+            options_flatbuffer, /*feature_vector_size=*/3, &pool,
+            /*half_precision=*/true);
+    ASSERT_TRUE(expected_features);
+    ASSERT_TRUE(cached_features);
+
+    // The float features are handed back as soon as they're converted.
+    EXPECT_EQ(pool.Acquire()->data(), half_features_data);
+    EXPECT_EQ(cached_features->ClickContextFeaturesView(6), nullptr);
+
+    for (int token = 3; token < 12; ++token) {
+      std::vector<float> expected;
+      std::vector<float> result;
+      if (options == &click_context_options) {
+        expected = GetCachedClickContextFeatures(*expected_features, token);
+        result = GetCachedClickContextFeatures(*cached_features, token);
+      } else {
+        const TokenSpan span = {token, std::min(token + 3, 12)};
+        expected = GetCachedBoundsSensitiveFeatures(*expected_features, span);
+        result = GetCachedBoundsSensitiveFeatures(*cached_features, span);
+      }
+      ASSERT_EQ(result.size(), expected.size());
+      for (int i = 0; i < expected.size(); ++i) {
+        EXPECT_NEAR(result[i], expected[i], std::abs(expected[i]) / 256)
+            << "token " << token << ", feature " << i;
+      }
+    }
+  }
 }
 
 }  // namespace
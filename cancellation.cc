@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cancellation.h"
+
+namespace libtextclassifier2 {
+
+CallInterruption::CallInterruption(int64 timeout_ms,
+                                   const CancellationToken* token)
+    : has_deadline_(timeout_ms > 0), token_(token), status_(CALL_COMPLETED) {
+  if (has_deadline_) {
+    deadline_ = std::chrono::steady_clock::now() +
+                std::chrono::milliseconds(timeout_ms);
+  }
+}
+
+bool CallInterruption::ShouldStop() const {
+  if (status_.load(std::memory_order_relaxed) != CALL_COMPLETED) {
+    return true;
+  }
+  int status = CALL_COMPLETED;
+  if (token_ != nullptr && token_->IsCancelled()) {
+    status = CALL_CANCELLED;
+  } else if (has_deadline_ && std::chrono::steady_clock::now() >= deadline_) {
+    status = CALL_DEADLINE_EXCEEDED;
+  } else {
+    return false;
+  }
+
+  // Keep the first reason if another thread stopped at the same time.
+  int expected = CALL_COMPLETED;
+  status_.compare_exchange_strong(expected, status, std::memory_order_relaxed);
+  return true;
+}
+
+}  // namespace libtextclassifier2
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBTEXTCLASSIFIER_CANCELLATION_H_
+#define LIBTEXTCLASSIFIER_CANCELLATION_H_
+
+#include <atomic>
+#include <chrono>
+
+#include "util/base/integral_types.h"
+
+namespace libtextclassifier2 {
+
+// Lets a caller stop its calls that are in flight, e.g. from a UI thread when
+// the text they annotate is gone. Pass it in the options of the calls.
+// Thread-safe.
+class CancellationToken {
+ public:
+  CancellationToken() : cancelled_(false) {}
+
+  void Cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+
+  bool IsCancelled() const {
+    return cancelled_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<bool> cancelled_;
+};
+
+// How a call that can be stopped ended.
+enum CallStatus {
+  CALL_COMPLETED = 0,
+  CALL_DEADLINE_EXCEEDED,
+  CALL_CANCELLED,
+};
+
+// The deadline and the cancellation token of a call, checked between the
+// stages of the call. Thread-safe, so that the annotators that run in parallel
+// can check it.
+class CallInterruption {
+ public:
+  // If 'timeout_ms' is positive, the call is stopped when that many
+  // milliseconds have passed since the construction. 'token' can be null, and
+  // is not owned.
+  CallInterruption(int64 timeout_ms, const CancellationToken* token);
+
+  // Returns whether the call should stop. Once it returned true, it keeps
+  // returning true, with the same status.
+  bool ShouldStop() const;
+
+  CallStatus status() const {
+    return static_cast<CallStatus>(status_.load(std::memory_order_relaxed));
+  }
+
+ private:
+  const bool has_deadline_;
+  std::chrono::steady_clock::time_point deadline_;
+  const CancellationToken* const token_;
+  mutable std::atomic<int> status_;
+};
+
+// Returns whether the call of 'interruption' should stop. It can be null, for
+// the calls that can't be stopped.
+inline bool ShouldStop(const CallInterruption* interruption) {
+  return interruption != nullptr && interruption->ShouldStop();
+}
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_CANCELLATION_H_
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cancellation.h"
+
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+TEST(CallInterruptionTest, NeverStopsWithoutDeadlineOrToken) {
+  CallInterruption interruption(/*timeout_ms=*/0, /*token=*/nullptr);
+  EXPECT_FALSE(interruption.ShouldStop());
+  EXPECT_EQ(interruption.status(), CALL_COMPLETED);
+  EXPECT_FALSE(ShouldStop(/*interruption=*/nullptr));
+}
+
+TEST(CallInterruptionTest, StopsWhenCancelled) {
+  CancellationToken token;
+  CallInterruption interruption(/*timeout_ms=*/0, &token);
+  EXPECT_FALSE(interruption.ShouldStop());
+
+  token.Cancel();
+  EXPECT_TRUE(interruption.ShouldStop());
+  EXPECT_EQ(interruption.status(), CALL_CANCELLED);
+}
+
+TEST(CallInterruptionTest, StopsAfterDeadline) {
+  CancellationToken token;
+  CallInterruption interruption(/*timeout_ms=*/1, &token);
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  EXPECT_TRUE(interruption.ShouldStop());
+  EXPECT_EQ(interruption.status(), CALL_DEADLINE_EXCEEDED);
+
+  // The first reason is kept.
+  token.Cancel();
+  EXPECT_TRUE(interruption.ShouldStop());
+  EXPECT_EQ(interruption.status(), CALL_DEADLINE_EXCEEDED);
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "classifier-registry.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "util/base/logging.h"
+
+namespace libtextclassifier2 {
+
+ClassifierRegistry* ClassifierRegistry::Instance() {
+  static ClassifierRegistry* registry = new ClassifierRegistry();
+  return registry;
+}
+
+std::shared_ptr<const TextClassifier> ClassifierRegistry::FromFileDescriptor(
+    int fd, int offset, int size) {
+  return GetOrLoad(fd, offset, size);
+}
+
+std::shared_ptr<const TextClassifier> ClassifierRegistry::FromFileDescriptor(
+    int fd) {
+  return GetOrLoad(fd, /*offset=*/0, /*size=*/-1);
+}
+
+std::shared_ptr<const TextClassifier> ClassifierRegistry::FromPath(
+    const std::string& path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    TC_LOG(ERROR) << "Error opening " << path;
+    return nullptr;
+  }
+  std::shared_ptr<const TextClassifier> classifier =
+      GetOrLoad(fd, /*offset=*/0, /*size=*/-1);
+  close(fd);
+  return classifier;
+}
+
+std::shared_ptr<const TextClassifier> ClassifierRegistry::GetOrLoad(
+    int fd, int offset, int size) {
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    TC_LOG(ERROR) << "Unable to stat model fd.";
+    return nullptr;
+  }
+  if (size < 0) {
+    size = file_stat.st_size;
+  }
+  const ModelKey key(file_stat.st_dev, file_stat.st_ino,
+                     file_stat.st_mtime, offset, size);
+
+  // Loading under the lock makes concurrent requests for the same model wait
+  // for the first one, instead of loading it several times.
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = classifiers_.find(key);
+  if (it != classifiers_.end()) {
+    std::shared_ptr<const TextClassifier> classifier = it->second.lock();
+    if (classifier != nullptr) {
+      return classifier;
+    }
+  }
+
+  std::shared_ptr<const TextClassifier> classifier(
+      TextClassifier::FromFileDescriptor(fd, offset, size).release());
+  if (classifier == nullptr) {
+    return nullptr;
+  }
+
+  // Drop the entries of the models that are no longer used by anyone.
+  for (auto entry_it = classifiers_.begin(); entry_it != classifiers_.end();) {
+    if (entry_it->second.expired()) {
+      entry_it = classifiers_.erase(entry_it);
+    } else {
+      ++entry_it;
+    }
+  }
+  classifiers_[key] = classifier;
+  return classifier;
+}
+
+}  // namespace libtextclassifier2
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Process-wide sharing of TextClassifier instances between the handles that
+// load the same model file.
+
+#ifndef LIBTEXTCLASSIFIER_CLASSIFIER_REGISTRY_H_
+#define LIBTEXTCLASSIFIER_CLASSIFIER_REGISTRY_H_
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+#include "text-classifier.h"
+#include "util/base/integral_types.h"
+#include "util/base/macros.h"
+
+namespace libtextclassifier2 {
+
+// Hands out the same TextClassifier to everyone loading the same model, for as
+// long as any of them holds on to it. Models are identified by the device,
+// inode and modification time of their file and the segment of it they occupy.
+// The classifiers are immutable after loading, and all mutable scratch state
+// (e.g. the TFLite interpreters) is acquired per call, so they can be used
+// through several handles at once.
+// Thread-safe.
+class ClassifierRegistry {
+ public:
+  // Returns the process-wide registry.
+  static ClassifierRegistry* Instance();
+
+  // Returns the classifier for the model in the given segment of the file, or
+  // nullptr if it can't be loaded.
+  std::shared_ptr<const TextClassifier> FromFileDescriptor(int fd, int offset,
+                                                           int size);
+
+  // Same as above, for the whole file.
+  std::shared_ptr<const TextClassifier> FromFileDescriptor(int fd);
+
+  // Same as above, for the file at the given path.
+  std::shared_ptr<const TextClassifier> FromPath(const std::string& path);
+
+ private:
+  // Device, inode, modification time, offset and size of the model.
+  using ModelKey = std::tuple<uint64, uint64, int64, int64, int64>;
+
+  ClassifierRegistry() {}
+
+  // Gets or loads the classifier. A negative 'size' stands for the whole file.
+  std::shared_ptr<const TextClassifier> GetOrLoad(int fd, int offset, int size);
+
+  std::mutex mutex_;
+  std::map<ModelKey, std::weak_ptr<const TextClassifier>> classifiers_;
+
+  TC_DISALLOW_COPY_AND_ASSIGN(ClassifierRegistry);
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_CLASSIFIER_REGISTRY_H_
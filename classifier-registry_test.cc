@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "classifier-registry.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+std::string GetModelPath() {
+  return LIBTEXTCLASSIFIER_TEST_DATA_DIR;
+}
+
+TEST(ClassifierRegistryTest, SharesClassifiersForTheSameModel) {
+  ClassifierRegistry* registry = ClassifierRegistry::Instance();
+  std::shared_ptr<const TextClassifier> classifier =
+      registry->FromPath(GetModelPath() + "test_model.fb");
+  ASSERT_TRUE(classifier);
+
+  const int fd = open((GetModelPath() + "test_model.fb").c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(registry->FromFileDescriptor(fd), classifier);
+  close(fd);
+
+  std::shared_ptr<const TextClassifier> other_classifier =
+      registry->FromPath(GetModelPath() + "test_model_cc.fb");
+  ASSERT_TRUE(other_classifier);
+  EXPECT_NE(other_classifier, classifier);
+}
+
+TEST(ClassifierRegistryTest, ReloadsReleasedClassifiers) {
+  ClassifierRegistry* registry = ClassifierRegistry::Instance();
+  std::weak_ptr<const TextClassifier> released_classifier =
+      registry->FromPath(GetModelPath() + "test_model.fb");
+  EXPECT_TRUE(released_classifier.expired());
+
+  EXPECT_TRUE(registry->FromPath(GetModelPath() + "test_model.fb"));
+}
+
+TEST(ClassifierRegistryTest, FailsForMissingModels) {
+  EXPECT_FALSE(ClassifierRegistry::Instance()->FromPath(
+      GetModelPath() + "no_such_model.fb"));
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
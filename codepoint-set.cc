@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "codepoint-set.h"
+
+#include <algorithm>
+
+#include "util/memory/memory-usage.h"
+
+namespace libtextclassifier2 {
+
+const int CodepointSet::kNumBmpCodepoints;
+const int CodepointSet::kBlockSize;
+const int CodepointSet::kLeafWords;
+const int CodepointSet::kEmptyLeaf;
+const int CodepointSet::kFullLeaf;
+
+CodepointSet::CodepointSet() : empty_(true) {
+  std::fill(bmp_blocks_, bmp_blocks_ + kNumBmpCodepoints / kBlockSize,
+            kEmptyLeaf);
+  leaves_.assign(kLeafWords, 0);
+  leaves_.resize(2 * kLeafWords, ~static_cast<uint64>(0));
+}
+
+void CodepointSet::AddRange(int32 start, int32 end) {
+  start = std::max(start, 0);
+  if (start >= end) {
+    return;
+  }
+  empty_ = false;
+
+  // The part in the BMP, block by block.
+  const int32 bmp_end = std::min(end, kNumBmpCodepoints);
+  for (int32 block_start = start; block_start < bmp_end;) {
+    const int32 block_end =
+        std::min(bmp_end, (block_start / kBlockSize + 1) * kBlockSize);
+    AddBlockRange(block_start, block_end);
+    block_start = block_end;
+  }
+  if (end <= kNumBmpCodepoints) {
+    return;
+  }
+
+  // The part above it, merged with the overlapping or adjacent ranges.
+  std::pair<int32, int32> range(std::max(start, kNumBmpCodepoints), end);
+  std::vector<std::pair<int32, int32>> merged_ranges;
+  merged_ranges.reserve(astral_ranges_.size() + 1);
+  for (const std::pair<int32, int32>& astral_range : astral_ranges_) {
+    if (astral_range.second < range.first ||
+        astral_range.first > range.second) {
+      merged_ranges.push_back(astral_range);
+    } else {
+      range.first = std::min(range.first, astral_range.first);
+      range.second = std::max(range.second, astral_range.second);
+    }
+  }
+  merged_ranges.insert(
+      std::lower_bound(merged_ranges.begin(), merged_ranges.end(), range),
+      range);
+  astral_ranges_ = std::move(merged_ranges);
+}
+
+void CodepointSet::AddBlockRange(int32 start, int32 end) {
+  uint16* block = &bmp_blocks_[start / kBlockSize];
+  if (*block == kFullLeaf) {
+    return;
+  }
+  if (end - start == kBlockSize) {
+    *block = kFullLeaf;
+    return;
+  }
+  if (*block == kEmptyLeaf) {
+    *block = leaves_.size() / kLeafWords;
+    leaves_.resize(leaves_.size() + kLeafWords, 0);
+  }
+  uint64* leaf = &leaves_[*block * kLeafWords];
+  for (int32 codepoint = start; codepoint < end; ++codepoint) {
+    leaf[(codepoint % kBlockSize) >> 6] |= static_cast<uint64>(1)
+                                           << (codepoint & 63);
+  }
+}
+
+bool CodepointSet::ContainsAstral(int32 codepoint) const {
+  // The first range that ends after the codepoint.
+  const auto it = std::upper_bound(
+      astral_ranges_.begin(), astral_ranges_.end(), codepoint,
+      [](int32 codepoint, const std::pair<int32, int32>& range) {
+        return codepoint < range.second;
+      });
+  return it != astral_ranges_.end() && it->first <= codepoint;
+}
+
+int64 CodepointSet::EstimateHeapBytes() const {
+  return VectorHeapBytes(leaves_) + VectorHeapBytes(astral_ranges_);
+}
+
+}  // namespace libtextclassifier2
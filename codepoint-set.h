@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LIBTEXTCLASSIFIER_CODEPOINT_SET_H_
+#define LIBTEXTCLASSIFIER_CODEPOINT_SET_H_
+
+#include <utility>
+#include <vector>
+
+#include "util/base/integral_types.h"
+
+namespace libtextclassifier2 {
+
+// A set of codepoints built from ranges, with constant-time membership checks
+// for the Basic Multilingual Plane. The BMP is stored as a two-level bitmap:
+// 256 blocks of 256 codepoints each point to a 256-bit leaf, and the blocks
+// that are entirely in or out of the set share one leaf. The codepoints above
+// the BMP, which are rare in text, are kept as sorted disjoint ranges.
+class CodepointSet {
+ public:
+  CodepointSet();
+
+  // Adds the codepoints of [start, end) to the set.
+  void AddRange(int32 start, int32 end);
+
+  void Add(int32 codepoint) { AddRange(codepoint, codepoint + 1); }
+
+  bool Contains(int32 codepoint) const {
+    if (codepoint >= 0 && codepoint < kNumBmpCodepoints) {
+      const uint64* leaf = &leaves_[bmp_blocks_[codepoint >> 8] * kLeafWords];
+      return (leaf[(codepoint & 0xFF) >> 6] >> (codepoint & 63)) & 1;
+    }
+    return ContainsAstral(codepoint);
+  }
+
+  bool empty() const { return empty_; }
+
+  // Returns an estimate of the heap memory held, in bytes.
+  int64 EstimateHeapBytes() const;
+
+ private:
+  static const int kNumBmpCodepoints = 0x10000;
+  static const int kBlockSize = 256;
+  static const int kLeafWords = kBlockSize / 64;
+
+  // The leaves shared by the blocks with none or all of their codepoints.
+  static const int kEmptyLeaf = 0;
+  static const int kFullLeaf = 1;
+
+  // Adds [start, end), which lies in a single block, to the set.
+  void AddBlockRange(int32 start, int32 end);
+
+  bool ContainsAstral(int32 codepoint) const;
+
+  bool empty_;
+
+  // The leaf index of each block of the BMP.
+  uint16 bmp_blocks_[kNumBmpCodepoints / kBlockSize];
+
+  // The leaves, kLeafWords words each.
+  std::vector<uint64> leaves_;
+
+  // Sorted, disjoint and non-adjacent [start, end) ranges above the BMP.
+  std::vector<std::pair<int32, int32>> astral_ranges_;
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_CODEPOINT_SET_H_
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "codepoint-set.h"
+
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+TEST(CodepointSetTest, Empty) {
+  const CodepointSet set;
+  EXPECT_TRUE(set.empty());
+  EXPECT_FALSE(set.Contains(0));
+  EXPECT_FALSE(set.Contains('a'));
+  EXPECT_FALSE(set.Contains(0x1F60B));
+  EXPECT_FALSE(set.Contains(-1));
+}
+
+TEST(CodepointSetTest, Ranges) {
+  CodepointSet set;
+  set.AddRange(0, 128);
+  set.AddRange(10000, 10001);
+  set.AddRange(0x1F600, 0x1F650);
+  set.Add(0x1F650);
+  set.Add(0x2028);
+  EXPECT_FALSE(set.empty());
+
+  EXPECT_FALSE(set.Contains(-1));
+  EXPECT_TRUE(set.Contains(0));
+  EXPECT_TRUE(set.Contains(127));
+  EXPECT_FALSE(set.Contains(128));
+  EXPECT_FALSE(set.Contains(9999));
+  EXPECT_TRUE(set.Contains(10000));
+  EXPECT_FALSE(set.Contains(10001));
+  EXPECT_TRUE(set.Contains(0x2028));
+  EXPECT_FALSE(set.Contains(0x2029));
+  EXPECT_FALSE(set.Contains(0x1F5FF));
+  EXPECT_TRUE(set.Contains(0x1F600));
+  EXPECT_TRUE(set.Contains(0x1F650));
+  EXPECT_FALSE(set.Contains(0x1F651));
+  EXPECT_FALSE(set.Contains(0x10FFFF));
+}
+
+TEST(CodepointSetTest, AgreesWithRangeUnion) {
+  const std::vector<std::pair<int32, int32>> ranges = {
+      {0x30, 0x3A},      {0x41, 0x5B},      {0x100, 0x300},
+      {0x250, 0x260},    {0xFF00, 0x10010}, {0x10005, 0x10020},
+      {0x10030, 0x10040}, {0x10020, 0x10030}, {0x20000, 0x20001},
+      {-5, 3},           {7, 7}};
+  CodepointSet set;
+  std::set<int32> expected;
+  for (const std::pair<int32, int32>& range : ranges) {
+    set.AddRange(range.first, range.second);
+    for (int32 codepoint = std::max(range.first, 0); codepoint < range.second;
+         ++codepoint) {
+      expected.insert(codepoint);
+    }
+  }
+  for (int32 codepoint = 0; codepoint < 0x20010; ++codepoint) {
+    EXPECT_EQ(set.Contains(codepoint), expected.count(codepoint) > 0)
+        << codepoint;
+  }
+}
+
+TEST(CodepointSetTest, EstimateHeapBytes) {
+  CodepointSet set;
+  const int64 empty_bytes = set.EstimateHeapBytes();
+
+  // Full blocks share a leaf, partial ones get their own.
+  set.AddRange(0, 0x1000);
+  const int64 full_blocks_bytes = set.EstimateHeapBytes();
+  EXPECT_GE(full_blocks_bytes, empty_bytes);
+
+  for (int32 codepoint = 0x1000; codepoint < 0x8000; codepoint += 0x100) {
+    set.Add(codepoint);
+  }
+  EXPECT_GT(set.EstimateHeapBytes(), full_blocks_bytes + 0x70 * 32);
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
@@ -17,9 +17,56 @@
 #include "datetime/extractor.h"
 
 #include "util/base/logging.h"
+#include "util/memory/memory-usage.h"
 
 namespace libtextclassifier2 {
 
+constexpr int DatetimeWordCache::kMaxCachedWords;
+
+std::string DatetimeWordCache::Key(int locale_id, Mapping mapping,
+                                   const UnicodeText& word) {
+  std::string key = std::to_string(locale_id);
+  key.push_back(':');
+  key.append(std::to_string(mapping));
+  key.push_back(':');
+  key.append(word.data(), word.size_bytes());
+  return key;
+}
+
+bool DatetimeWordCache::Lookup(int locale_id, Mapping mapping,
+                               const UnicodeText& word, bool* found,
+                               int* value) const {
+  const std::string key = Key(locale_id, mapping, word);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = values_.find(key);
+  if (it == values_.end()) {
+    return false;
+  }
+  *found = it->second.first;
+  *value = it->second.second;
+  return true;
+}
+
+void DatetimeWordCache::Insert(int locale_id, Mapping mapping,
+                               const UnicodeText& word, bool found,
+                               int value) {
+  std::string key = Key(locale_id, mapping, word);
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (values_.size() >= kMaxCachedWords) {
+    values_.clear();
+  }
+  values_[std::move(key)] = {found, value};
+}
+
+int64 DatetimeWordCache::EstimateHeapBytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  int64 result = HashTableHeapBytes(values_);
+  for (const auto& entry : values_) {
+    result += StringHeapBytes(entry.first);
+  }
+  return result;
+}
+
 bool DatetimeExtractor::Extract(DateParseData* result,
                                 CodepointSpan* result_span) const {
   result->field_set_mask = 0;
@@ -169,8 +216,12 @@ bool DatetimeExtractor::ExtractType(const UnicodeText& input,
     return false;
   }
 
+  const UniLib::RegexPattern* regex_pattern = rules_[rule_id]->Get();
+  if (regex_pattern == nullptr) {
+    return false;
+  }
   std::unique_ptr<UniLib::RegexMatcher> matcher =
-      rules_[rule_id]->Matcher(input);
+      regex_pattern->Matcher(input);
   if (!matcher) {
     return false;
   }
@@ -181,6 +232,17 @@ bool DatetimeExtractor::ExtractType(const UnicodeText& input,
   }
 
   if (match_result != nullptr) {
+    // The matcher's UTF-8 offsets are those of the input, so the result can
+    // point into the input instead of into the matcher, which goes away.
+    const int start = matcher->StartUTF8(/*group_idx=*/0, &status);
+    const int end = status == UniLib::RegexMatcher::kNoError
+                        ? matcher->EndUTF8(/*group_idx=*/0, &status)
+                        : -1;
+    if (status == UniLib::RegexMatcher::kNoError) {
+      *match_result = UTF8ToUnicodeText(input.data() + start, end - start,
+                                        /*do_copy=*/false);
+      return true;
+    }
     *match_result = matcher->Group(&status);
     if (status != UniLib::RegexMatcher::kNoError) {
       return false;
@@ -192,7 +254,7 @@ bool DatetimeExtractor::ExtractType(const UnicodeText& input,
 bool DatetimeExtractor::GroupTextFromMatch(int group_id,
                                            UnicodeText* result) const {
   int status;
-  *result = matcher_.Group(group_id, &status);
+  *result = matcher_.GroupView(group_id, &status);
   if (status != UniLib::RegexMatcher::kNoError) {
     return false;
   }
@@ -222,20 +284,60 @@ bool DatetimeExtractor::UpdateMatchSpan(int group_id,
 
 template <typename T>
 bool DatetimeExtractor::MapInput(
-    const UnicodeText& input,
+    const UnicodeText& input, DatetimeWordCache::Mapping mapping_id,
     const std::vector<std::pair<DatetimeExtractorType, T>>& mapping,
     T* result) const {
+  bool found;
+  int value;
+  if (word_cache_ != nullptr &&
+      word_cache_->Lookup(locale_id_, mapping_id, input, &found, &value)) {
+    if (found) {
+      *result = static_cast<T>(value);
+    }
+    return found;
+  }
+
+  found = false;
   for (const auto& type_value_pair : mapping) {
     if (ExtractType(input, type_value_pair.first)) {
       *result = type_value_pair.second;
-      return true;
+      found = true;
+      break;
     }
   }
-  return false;
+  if (word_cache_ != nullptr) {
+    word_cache_->Insert(locale_id_, mapping_id, input, found,
+                        found ? static_cast<int>(*result) : 0);
+  }
+  return found;
 }
 
 bool DatetimeExtractor::ParseWrittenNumber(const UnicodeText& input,
                                            int* parsed_number) const {
+  bool found;
+  int value;
+  if (word_cache_ != nullptr &&
+      word_cache_->Lookup(locale_id_, DatetimeWordCache::MAPPING_WRITTEN_NUMBER,
+                          input, &found, &value)) {
+    if (found) {
+      *parsed_number = value;
+    }
+    return found;
+  }
+
+  found = MapWrittenNumber(input, &value);
+  if (found) {
+    *parsed_number = value;
+  }
+  if (word_cache_ != nullptr) {
+    word_cache_->Insert(locale_id_, DatetimeWordCache::MAPPING_WRITTEN_NUMBER,
+                        input, found, found ? value : 0);
+  }
+  return found;
+}
+
+bool DatetimeExtractor::MapWrittenNumber(const UnicodeText& input,
+                                         int* parsed_number) const {
   std::vector<std::pair<int, int>> found_numbers;
   for (const auto& type_value_pair :
        std::vector<std::pair<DatetimeExtractorType, int>>{
@@ -275,8 +377,12 @@ bool DatetimeExtractor::ParseWrittenNumber(const UnicodeText& input,
       return false;
     }
 
+    const UniLib::RegexPattern* regex_pattern = rules_[rule_id]->Get();
+    if (regex_pattern == nullptr) {
+      return false;
+    }
     std::unique_ptr<UniLib::RegexMatcher> matcher =
-        rules_[rule_id]->Matcher(input);
+        regex_pattern->Matcher(input);
     if (!matcher) {
       return false;
     }
@@ -353,7 +459,7 @@ bool DatetimeExtractor::ParseMonth(const UnicodeText& input,
     return true;
   }
 
-  if (MapInput(input,
+  if (MapInput(input, DatetimeWordCache::MAPPING_MONTH,
                {
                    {DatetimeExtractorType_JANUARY, 1},
                    {DatetimeExtractorType_FEBRUARY, 2},
@@ -377,7 +483,7 @@ bool DatetimeExtractor::ParseMonth(const UnicodeText& input,
 
 bool DatetimeExtractor::ParseAMPM(const UnicodeText& input,
                                   int* parsed_ampm) const {
-  return MapInput(input,
+  return MapInput(input, DatetimeWordCache::MAPPING_AMPM,
                   {
                       {DatetimeExtractorType_AM, DateParseData::AMPM::AM},
                       {DatetimeExtractorType_PM, DateParseData::AMPM::PM},
@@ -399,7 +505,7 @@ bool DatetimeExtractor::ParseRelationDistance(const UnicodeText& input,
 bool DatetimeExtractor::ParseRelation(
     const UnicodeText& input, DateParseData::Relation* parsed_relation) const {
   return MapInput(
-      input,
+      input, DatetimeWordCache::MAPPING_RELATION,
       {
           {DatetimeExtractorType_NOW, DateParseData::Relation::NOW},
           {DatetimeExtractorType_YESTERDAY, DateParseData::Relation::YESTERDAY},
@@ -418,7 +524,7 @@ bool DatetimeExtractor::ParseRelationType(
     const UnicodeText& input,
     DateParseData::RelationType* parsed_relation_type) const {
   return MapInput(
-      input,
+      input, DatetimeWordCache::MAPPING_RELATION_TYPE,
       {
           {DatetimeExtractorType_MONDAY, DateParseData::MONDAY},
           {DatetimeExtractorType_TUESDAY, DateParseData::TUESDAY},
@@ -437,7 +543,7 @@ bool DatetimeExtractor::ParseRelationType(
 
 bool DatetimeExtractor::ParseTimeUnit(const UnicodeText& input,
                                       int* parsed_time_unit) const {
-  return MapInput(input,
+  return MapInput(input, DatetimeWordCache::MAPPING_TIME_UNIT,
                   {
                       {DatetimeExtractorType_DAYS, DateParseData::DAYS},
                       {DatetimeExtractorType_WEEKS, DateParseData::WEEKS},
@@ -453,7 +559,7 @@ bool DatetimeExtractor::ParseTimeUnit(const UnicodeText& input,
 bool DatetimeExtractor::ParseWeekday(const UnicodeText& input,
                                      int* parsed_weekday) const {
   return MapInput(
-      input,
+      input, DatetimeWordCache::MAPPING_WEEKDAY,
       {
           {DatetimeExtractorType_MONDAY, DateParseData::MONDAY},
           {DatetimeExtractorType_TUESDAY, DateParseData::TUESDAY},
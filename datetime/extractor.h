@@ -17,6 +17,7 @@
 #ifndef LIBTEXTCLASSIFIER_DATETIME_EXTRACTOR_H_
 #define LIBTEXTCLASSIFIER_DATETIME_EXTRACTOR_H_
 
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -26,12 +27,14 @@
 #include "util/strings/stringpiece.h"
 #include "util/utf8/unicodetext.h"
 #include "util/utf8/unilib.h"
+#include "zlib-utils.h"
 
 namespace libtextclassifier2 {
 
 struct CompiledRule {
-  // The compiled regular expression.
-  std::unique_ptr<const UniLib::RegexPattern> compiled_regex;
+  // The compiled regular expression, which rules with the same pattern share.
+  // Owned by the parser.
+  const LazyRegexPattern* compiled_regex;
 
   // The uncompiled pattern and information about the pattern groups.
   const DatetimeModelPattern_::Regex* regex;
@@ -40,6 +43,45 @@ struct CompiledRule {
   const DatetimeModelPattern* pattern;
 };
 
+// Memoizes the values that the extractor rules map matched words to, e.g.
+// "March" to 3. The same few words come up again and again, and mapping them
+// otherwise takes running the extractor rules one by one on them.
+// Thread-safe.
+class DatetimeWordCache {
+ public:
+  // The mappings of words to values, which are memoized separately.
+  enum Mapping {
+    MAPPING_WRITTEN_NUMBER = 0,
+    MAPPING_MONTH = 1,
+    MAPPING_AMPM = 2,
+    MAPPING_RELATION = 3,
+    MAPPING_RELATION_TYPE = 4,
+    MAPPING_TIME_UNIT = 5,
+    MAPPING_WEEKDAY = 6,
+  };
+
+  // Returns true if 'word' was mapped for the locale before. Then 'found' is
+  // whether the mapping succeeded, and 'value' the value it mapped to.
+  bool Lookup(int locale_id, Mapping mapping, const UnicodeText& word,
+              bool* found, int* value) const;
+
+  void Insert(int locale_id, Mapping mapping, const UnicodeText& word,
+              bool found, int value);
+
+  // Returns an estimate of the heap memory held, in bytes.
+  int64 EstimateHeapBytes() const;
+
+ private:
+  // The maximum number of words to keep, above which everything is dropped.
+  static constexpr int kMaxCachedWords = 1024;
+
+  static std::string Key(int locale_id, Mapping mapping,
+                         const UnicodeText& word);
+
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, std::pair<bool, int>> values_;
+};
+
 // A helper class for DatetimeParser that extracts structured data
 // (DateParseDate) from the current match of the passed RegexMatcher.
 class DatetimeExtractor {
@@ -47,17 +89,18 @@ class DatetimeExtractor {
   DatetimeExtractor(
       const CompiledRule& rule, const UniLib::RegexMatcher& matcher,
       int locale_id, const UniLib& unilib,
-      const std::vector<std::unique_ptr<const UniLib::RegexPattern>>&
-          extractor_rules,
+      const std::vector<const LazyRegexPattern*>& extractor_rules,
       const std::unordered_map<DatetimeExtractorType,
                                std::unordered_map<int, int>>&
-          type_and_locale_to_extractor_rule)
+          type_and_locale_to_extractor_rule,
+      DatetimeWordCache* word_cache = nullptr)
       : rule_(rule),
         matcher_(matcher),
         locale_id_(locale_id),
         unilib_(unilib),
         rules_(extractor_rules),
-        type_and_locale_to_rule_(type_and_locale_to_extractor_rule) {}
+        type_and_locale_to_rule_(type_and_locale_to_extractor_rule),
+        word_cache_(word_cache) {}
   bool Extract(DateParseData* result, CodepointSpan* result_span) const;
 
  private:
@@ -65,11 +108,13 @@ class DatetimeExtractor {
 
   // Returns true if the rule for given extractor matched. If it matched,
   // match_result will contain the first group of the rule (if match_result not
-  // nullptr).
+  // nullptr), pointing into 'input' when possible.
   bool ExtractType(const UnicodeText& input,
                    DatetimeExtractorType extractor_type,
                    UnicodeText* match_result = nullptr) const;
 
+  // Gets the text of the group of the current match of matcher_, pointing into
+  // the input of the matcher when possible.
   bool GroupTextFromMatch(int group_id, UnicodeText* result) const;
 
   // Updates the span to include the current match for the given group.
@@ -77,11 +122,16 @@ class DatetimeExtractor {
 
   // Returns true if any of the extractors from 'mapping' matched. If it did,
   // will fill 'result' with the associated value from 'mapping'.
+  // 'mapping_id' identifies 'mapping' in the word cache.
   template <typename T>
   bool MapInput(const UnicodeText& input,
+                DatetimeWordCache::Mapping mapping_id,
                 const std::vector<std::pair<DatetimeExtractorType, T>>& mapping,
                 T* result) const;
 
+  // Maps the written number in 'input' to its value, without the cache.
+  bool MapWrittenNumber(const UnicodeText& input, int* parsed_number) const;
+
   bool ParseDigits(const UnicodeText& input, int* parsed_digits) const;
   bool ParseWrittenNumber(const UnicodeText& input, int* parsed_number) const;
   bool ParseYear(const UnicodeText& input, int* parsed_year) const;
@@ -101,9 +151,10 @@ class DatetimeExtractor {
   const UniLib::RegexMatcher& matcher_;
   int locale_id_;
   const UniLib& unilib_;
-  const std::vector<std::unique_ptr<const UniLib::RegexPattern>>& rules_;
+  const std::vector<const LazyRegexPattern*>& rules_;
   const std::unordered_map<DatetimeExtractorType, std::unordered_map<int, int>>&
       type_and_locale_to_rule_;
+  DatetimeWordCache* word_cache_;
 };
 
 }  // namespace libtextclassifier2
@@ -16,20 +16,21 @@
 
 #include "datetime/parser.h"
 
-#include <set>
+#include <iterator>
 #include <unordered_set>
 
 #include "datetime/extractor.h"
 #include "util/calendar/calendar.h"
 #include "util/i18n/locale.h"
+#include "util/memory/memory-usage.h"
 #include "util/strings/split.h"
 
 namespace libtextclassifier2 {
 std::unique_ptr<DatetimeParser> DatetimeParser::Instance(
     const DatetimeModel* model, const UniLib& unilib,
-    ZlibDecompressor* decompressor) {
-  std::unique_ptr<DatetimeParser> result(
-      new DatetimeParser(model, unilib, decompressor));
+    ZlibDecompressor* decompressor, bool compile_lazily, Executor* executor) {
+  std::unique_ptr<DatetimeParser> result(new DatetimeParser(
+      model, unilib, decompressor, compile_lazily, executor));
   if (!result->initialized_) {
     result.reset();
   }
@@ -37,7 +38,8 @@ std::unique_ptr<DatetimeParser> DatetimeParser::Instance(
 }
 
 DatetimeParser::DatetimeParser(const DatetimeModel* model, const UniLib& unilib,
-                               ZlibDecompressor* decompressor)
+                               ZlibDecompressor* decompressor,
+                               bool compile_lazily, Executor* executor)
     : unilib_(unilib) {
   initialized_ = false;
 
@@ -45,19 +47,83 @@ DatetimeParser::DatetimeParser(const DatetimeModel* model, const UniLib& unilib,
     return;
   }
 
+  regex_limits_.time_limit = model->regex_time_limit();
+  regex_limits_.stack_limit_bytes = model->regex_stack_limit();
+
+  // All the rules and then the extractors, in the order of the model, which is
+  // also the order in which legacy compressed patterns have to be
+  // decompressed.
+  std::vector<std::pair<const flatbuffers::String*, const CompressedBuffer*>>
+      rule_patterns;
   if (model->patterns() != nullptr) {
     for (const DatetimeModelPattern* pattern : *model->patterns()) {
       if (pattern->regexes()) {
         for (const DatetimeModelPattern_::Regex* regex : *pattern->regexes()) {
-          std::unique_ptr<UniLib::RegexPattern> regex_pattern =
-              UncompressMakeRegexPattern(unilib, regex->pattern(),
-                                         regex->compressed_pattern(),
-                                         decompressor);
-          if (!regex_pattern) {
-            TC_LOG(ERROR) << "Couldn't create rule pattern.";
-            return;
-          }
-          rules_.push_back({std::move(regex_pattern), regex, pattern});
+          rule_patterns.push_back(
+              {regex->pattern(), regex->compressed_pattern()});
+        }
+      }
+    }
+  }
+  if (model->extractors() != nullptr) {
+    for (const DatetimeModelExtractor* extractor : *model->extractors()) {
+      rule_patterns.push_back(
+          {extractor->pattern(), extractor->compressed_pattern()});
+    }
+  }
+
+  // Many locales have the same rules, e.g. for the numeric dates and the
+  // times, so each distinct pattern is compiled once and shared by its rules.
+  std::vector<int> pattern_ids(rule_patterns.size());
+  std::vector<std::pair<const flatbuffers::String*, const CompressedBuffer*>>
+      unique_patterns;
+  {
+    std::unordered_map<std::string, int> pattern_id_by_key;
+    std::string key;
+    for (int i = 0; i < rule_patterns.size(); ++i) {
+      if (SharedPatternKey(rule_patterns[i].first, rule_patterns[i].second,
+                           &key)) {
+        const auto inserted =
+            pattern_id_by_key.emplace(key, unique_patterns.size());
+        if (!inserted.second) {
+          pattern_ids[i] = inserted.first->second;
+          continue;
+        }
+      }
+      pattern_ids[i] = unique_patterns.size();
+      unique_patterns.push_back(rule_patterns[i]);
+    }
+  }
+
+  std::vector<std::unique_ptr<UniLib::RegexPattern>> compiled_patterns;
+  if (!compile_lazily &&
+      !UncompressMakeRegexPatterns(unilib, unique_patterns, decompressor,
+                                   executor, regex_limits_,
+                                   &compiled_patterns)) {
+    TC_LOG(ERROR) << "Couldn't create rule pattern.";
+    return;
+  }
+  for (int i = 0; i < unique_patterns.size(); ++i) {
+    if (compile_lazily) {
+      patterns_.emplace_back(new LazyRegexPattern(unilib,
+                                                  unique_patterns[i].first,
+                                                  unique_patterns[i].second,
+                                                  regex_limits_));
+    } else {
+      patterns_.emplace_back(
+          new LazyRegexPattern(unilib, std::move(compiled_patterns[i])));
+    }
+  }
+  int rule_pattern_index = 0;
+  auto make_rule_pattern = [&]() {
+    return patterns_[pattern_ids[rule_pattern_index++]].get();
+  };
+
+  if (model->patterns() != nullptr) {
+    for (const DatetimeModelPattern* pattern : *model->patterns()) {
+      if (pattern->regexes()) {
+        for (const DatetimeModelPattern_::Regex* regex : *pattern->regexes()) {
+          rules_.push_back({make_rule_pattern(), regex, pattern});
           if (pattern->locales()) {
             for (int locale : *pattern->locales()) {
               locale_to_rules_[locale].push_back(rules_.size() - 1);
@@ -70,15 +136,7 @@ DatetimeParser::DatetimeParser(const DatetimeModel* model, const UniLib& unilib,
 
   if (model->extractors() != nullptr) {
     for (const DatetimeModelExtractor* extractor : *model->extractors()) {
-      std::unique_ptr<UniLib::RegexPattern> regex_pattern =
-          UncompressMakeRegexPattern(unilib, extractor->pattern(),
-                                     extractor->compressed_pattern(),
-                                     decompressor);
-      if (!regex_pattern) {
-        TC_LOG(ERROR) << "Couldn't create extractor pattern";
-        return;
-      }
-      extractor_rules_.push_back(std::move(regex_pattern));
+      extractor_rules_.push_back(make_rule_pattern());
 
       if (extractor->locales()) {
         for (int locale : *extractor->locales()) {
@@ -102,6 +160,7 @@ DatetimeParser::DatetimeParser(const DatetimeModel* model, const UniLib& unilib,
   }
 
   use_extractors_for_locating_ = model->use_extractors_for_locating();
+  use_rule_prefilter_ = model->use_rule_prefilter();
 
   initialized_ = true;
 }
@@ -116,12 +175,53 @@ bool DatetimeParser::Parse(
                anchor_start_end, results);
 }
 
-bool DatetimeParser::FindSpansUsingLocales(
-    const std::vector<int>& locale_ids, const UnicodeText& input,
-    const int64 reference_time_ms_utc, const std::string& reference_timezone,
-    ModeFlag mode, bool anchor_start_end, const std::string& reference_locale,
-    std::unordered_set<int>* executed_rules,
-    std::vector<DatetimeParseResultSpan>* found_spans) const {
+constexpr int DatetimeParser::kMaxCachedLocaleRules;
+
+std::shared_ptr<const DatetimeParser::LocaleRules>
+DatetimeParser::GetLocaleRules(const std::string& locales,
+                               ModeFlag mode) const {
+  if (frozen_) {
+    // The memoized rules don't change anymore, so they are read without the
+    // lock. The returned pointer does not share their ownership, so that the
+    // reference count, which the forked processes share, is not written.
+    const auto mode_it = locale_rules_cache_.find(mode);
+    if (mode_it != locale_rules_cache_.end()) {
+      const auto it = mode_it->second.find(locales);
+      if (it != mode_it->second.end()) {
+        return std::shared_ptr<const LocaleRules>(
+            std::shared_ptr<const LocaleRules>(), it->second.get());
+      }
+    }
+    return ComputeLocaleRules(locales, mode);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(locale_rules_mutex_);
+    const auto& mode_cache = locale_rules_cache_[mode];
+    auto it = mode_cache.find(locales);
+    if (it != mode_cache.end()) {
+      return it->second;
+    }
+  }
+
+  std::shared_ptr<const LocaleRules> locale_rules =
+      ComputeLocaleRules(locales, mode);
+  std::lock_guard<std::mutex> lock(locale_rules_mutex_);
+  auto& mode_cache = locale_rules_cache_[mode];
+  if (mode_cache.size() >= kMaxCachedLocaleRules) {
+    mode_cache.clear();
+  }
+  mode_cache[locales] = locale_rules;
+  return locale_rules;
+}
+
+std::shared_ptr<const DatetimeParser::LocaleRules>
+DatetimeParser::ComputeLocaleRules(const std::string& locales,
+                                   ModeFlag mode) const {
+  std::shared_ptr<LocaleRules> locale_rules(new LocaleRules());
+  const std::vector<int> locale_ids =
+      ParseAndExpandLocales(locales, &locale_rules->reference_locale);
+  std::unordered_set<int> added_rules;
   for (const int locale_id : locale_ids) {
     auto rules_it = locale_to_rules_.find(locale_id);
     if (rules_it == locale_to_rules_.end()) {
@@ -129,23 +229,233 @@ bool DatetimeParser::FindSpansUsingLocales(
     }
 
     for (const int rule_id : rules_it->second) {
-      // Skip rules that were already executed in previous locales.
-      if (executed_rules->find(rule_id) != executed_rules->end()) {
+      if (!(rules_[rule_id].pattern->enabled_modes() & mode)) {
         continue;
       }
 
-      if (!(rules_[rule_id].pattern->enabled_modes() & mode)) {
-        continue;
+      // Skip rules that were already added for previous locales.
+      if (added_rules.insert(rule_id).second) {
+        locale_rules->rules.push_back({rule_id, locale_id});
       }
+    }
+  }
+  if (use_rule_prefilter_ && locale_rules->rules.size() > 1) {
+    locale_rules->prefilter = CreateRulePrefilter(locale_rules->rules);
+  }
+
+  std::unordered_map<const LazyRegexPattern*, int> group_by_pattern;
+  std::vector<std::vector<int>> pattern_groups;
+  for (int i = 0; i < locale_rules->rules.size(); ++i) {
+    const LazyRegexPattern* pattern =
+        rules_[locale_rules->rules[i].first].compiled_regex;
+    const auto inserted =
+        group_by_pattern.emplace(pattern, pattern_groups.size());
+    if (inserted.second) {
+      pattern_groups.emplace_back();
+    }
+    pattern_groups[inserted.first->second].push_back(i);
+  }
+  if (pattern_groups.size() < locale_rules->rules.size()) {
+    locale_rules->pattern_groups = std::move(pattern_groups);
+  }
+  return locale_rules;
+}
 
-      executed_rules->insert(rule_id);
+void DatetimeParser::SetRuleProfile(RuleProfile* profile) {
+  rule_profile_ = profile;
+  if (profile == nullptr) {
+    return;
+  }
+  std::unique_ptr<ZlibDecompressor> decompressor = ZlibDecompressor::Instance();
+  std::string pattern;
+  for (int i = 0; i < rules_.size(); ++i) {
+    const DatetimeModelPattern_::Regex* regex = rules_[i].regex;
+    if (UncompressPatternText(regex->pattern(), regex->compressed_pattern(),
+                              decompressor.get(), &pattern)) {
+      profile->SetRuleName(RuleProfile::DATETIME, i, pattern);
+    }
+  }
+}
 
-      if (!ParseWithRule(rules_[rule_id], input, reference_time_ms_utc,
-                         reference_timezone, reference_locale, locale_id,
-                         anchor_start_end, found_spans)) {
+int64 DatetimeParser::EstimateHeapBytes() const {
+  int64 result = VectorHeapBytes(patterns_) + VectorHeapBytes(rules_) +
+                 VectorHeapBytes(extractor_rules_) +
+                 HashTableHeapBytes(locale_to_rules_) +
+                 HashTableHeapBytes(type_and_locale_to_extractor_rule_) +
+                 HashTableHeapBytes(locale_string_to_id_) +
+                 VectorHeapBytes(default_locale_ids_) +
+                 word_cache_.EstimateHeapBytes();
+  for (const std::unique_ptr<const LazyRegexPattern>& pattern : patterns_) {
+    result += sizeof(LazyRegexPattern) + pattern->EstimateHeapBytes();
+  }
+  for (const auto& locale_rules : locale_to_rules_) {
+    result += VectorHeapBytes(locale_rules.second);
+  }
+  for (const auto& type_rules : type_and_locale_to_extractor_rule_) {
+    result += HashTableHeapBytes(type_rules.second);
+  }
+  for (const auto& locale_id : locale_string_to_id_) {
+    result += StringHeapBytes(locale_id.first);
+  }
+
+  std::lock_guard<std::mutex> lock(locale_rules_mutex_);
+  result += HashTableHeapBytes(locale_rules_cache_);
+  for (const auto& mode_cache : locale_rules_cache_) {
+    result += HashTableHeapBytes(mode_cache.second);
+    for (const auto& entry : mode_cache.second) {
+      const LocaleRules& locale_rules = *entry.second;
+      result += StringHeapBytes(entry.first) + sizeof(LocaleRules) +
+                StringHeapBytes(locale_rules.reference_locale) +
+                VectorHeapBytes(locale_rules.rules) +
+                VectorHeapBytes(locale_rules.pattern_groups);
+      for (const std::vector<int>& group : locale_rules.pattern_groups) {
+        result += VectorHeapBytes(group);
+      }
+      if (locale_rules.prefilter != nullptr) {
+        result += sizeof(UniLib::RegexPattern) +
+                  locale_rules.prefilter->EstimateHeapBytes();
+      }
+    }
+  }
+  return result;
+}
+
+bool DatetimeParser::Freeze(const std::vector<std::string>& locales) {
+  bool success = true;
+  for (const std::unique_ptr<const LazyRegexPattern>& rule_pattern :
+       patterns_) {
+    const UniLib::RegexPattern* pattern = rule_pattern->Get();
+    if (pattern == nullptr) {
+      success = false;
+      continue;
+    }
+    pattern->ClearMatcherPool();
+  }
+
+  // The memoized rules are all kept, whatever their number.
+  std::lock_guard<std::mutex> lock(locale_rules_mutex_);
+  for (const ModeFlag mode :
+       {ModeFlag_ANNOTATION, ModeFlag_CLASSIFICATION, ModeFlag_SELECTION}) {
+    auto& mode_cache = locale_rules_cache_[mode];
+    for (const std::string& locale : locales) {
+      if (mode_cache.find(locale) == mode_cache.end()) {
+        mode_cache[locale] = ComputeLocaleRules(locale, mode);
+      }
+    }
+    for (const auto& locale_and_rules : mode_cache) {
+      if (locale_and_rules.second->prefilter != nullptr) {
+        locale_and_rules.second->prefilter->ClearMatcherPool();
+      }
+    }
+  }
+  frozen_ = true;
+  return success;
+}
+
+std::unique_ptr<UniLib::RegexPattern> DatetimeParser::CreateRulePrefilter(
+    const std::vector<std::pair<int, int>>& rules) const {
+  std::unique_ptr<ZlibDecompressor> decompressor = ZlibDecompressor::Instance();
+  std::string combined_pattern;
+  std::string pattern;
+  // Rules that share a pattern need it only once in the alternation.
+  std::unordered_set<const LazyRegexPattern*> added_patterns;
+  for (const std::pair<int, int>& rule_and_locale : rules) {
+    if (!added_patterns.insert(rules_[rule_and_locale.first].compiled_regex)
+             .second) {
+      continue;
+    }
+    const DatetimeModelPattern_::Regex* regex =
+        rules_[rule_and_locale.first].regex;
+    if (!UncompressPatternText(regex->pattern(), regex->compressed_pattern(),
+                               decompressor.get(), &pattern)) {
+      TC_LOG(ERROR) << "Couldn't get rule pattern for the prefilter.";
+      return nullptr;
+    }
+
+    // Backreferences would refer to the wrong groups once the patterns are
+    // concatenated.
+    for (int i = 0; i + 1 < pattern.size(); ++i) {
+      if (pattern[i] == '\\') {
+        const char next = pattern[i + 1];
+        if ((next >= '1' && next <= '9') || next == 'k') {
+          return nullptr;
+        }
+        // Skip the escaped character.
+        ++i;
+      }
+    }
+
+    if (!combined_pattern.empty()) {
+      combined_pattern.push_back('|');
+    }
+    combined_pattern.append("(?:");
+    combined_pattern.append(pattern);
+    combined_pattern.push_back(')');
+  }
+
+  // Patterns that don't combine (e.g. because of duplicate group names) just
+  // run without the prefilter.
+  return unilib_.CreateRegexPattern(
+      UTF8ToUnicodeText(combined_pattern, /*do_copy=*/false), regex_limits_);
+}
+
+bool DatetimeParser::FindSpansUsingLocales(
+    const LocaleRules& locale_rules, const UnicodeText& input,
+    bool anchor_start_end, const CallInterruption* interruption,
+    std::vector<ParsedDatetimeSpan>* found_spans) const {
+  if (locale_rules.rules.empty()) {
+    return true;
+  }
+
+  // Convert the input for the regex engine only once for all the rules.
+  const std::unique_ptr<UniLib::UTF16Text> input_utf16 =
+      unilib_.CreateUTF16Text(input);
+
+  // Most inputs contain no datetime at all, so find that out with a single
+  // scan over the input instead of one per rule.
+  if (locale_rules.prefilter != nullptr) {
+    const UniLib::RegexPattern::ScopedMatcher matcher =
+        locale_rules.prefilter->AcquireMatcher(*input_utf16);
+    int status = UniLib::RegexMatcher::kNoError;
+    const bool matched = anchor_start_end ? matcher->Matches(&status)
+                                          : matcher->Find(&status);
+    if (!matched && status == UniLib::RegexMatcher::kNoError) {
+      return true;
+    }
+  }
+
+  if (locale_rules.pattern_groups.empty()) {
+    for (const std::pair<int, int>& rule_and_locale : locale_rules.rules) {
+      if (ShouldStop(interruption)) {
+        break;
+      }
+      if (!ParseWithRule(rule_and_locale.first, *input_utf16,
+                         rule_and_locale.second, anchor_start_end,
+                         found_spans)) {
         return false;
       }
     }
+    return true;
+  }
+
+  // The results are collected per rule and then appended in the order of the
+  // rules, as if each rule had run its pattern, since the order breaks the
+  // ties between conflicting spans.
+  std::vector<std::vector<ParsedDatetimeSpan>> rule_results(
+      locale_rules.rules.size());
+  for (const std::vector<int>& group : locale_rules.pattern_groups) {
+    if (ShouldStop(interruption)) {
+      break;
+    }
+    if (!ParseWithPatternGroup(locale_rules, group, *input_utf16,
+                               anchor_start_end, &rule_results)) {
+      return false;
+    }
+  }
+  for (std::vector<ParsedDatetimeSpan>& results : rule_results) {
+    found_spans->insert(found_spans->end(),
+                        std::make_move_iterator(results.begin()),
+                        std::make_move_iterator(results.end()));
   }
   return true;
 }
@@ -155,62 +465,128 @@ bool DatetimeParser::Parse(
     const std::string& reference_timezone, const std::string& locales,
     ModeFlag mode, bool anchor_start_end,
     std::vector<DatetimeParseResultSpan>* results) const {
-  std::vector<DatetimeParseResultSpan> found_spans;
-  std::unordered_set<int> executed_rules;
-  std::string reference_locale;
-  const std::vector<int> requested_locales =
-      ParseAndExpandLocales(locales, &reference_locale);
-  if (!FindSpansUsingLocales(requested_locales, input, reference_time_ms_utc,
-                             reference_timezone, mode, anchor_start_end,
-                             reference_locale, &executed_rules, &found_spans)) {
+  std::vector<ParsedDatetimeSpan> parsed_spans;
+  if (!FindDatetimes(input, locales, mode, anchor_start_end, &parsed_spans)) {
     return false;
   }
+  results->reserve(results->size() + parsed_spans.size());
+  for (const ParsedDatetimeSpan& parsed_span : parsed_spans) {
+    results->emplace_back();
+    if (!Interpret(parsed_span, reference_time_ms_utc, reference_timezone,
+                   locales, &results->back())) {
+      return false;
+    }
+  }
+  return true;
+}
 
-  std::vector<std::pair<DatetimeParseResultSpan, int>> indexed_found_spans;
-  int counter = 0;
-  for (const auto& found_span : found_spans) {
-    indexed_found_spans.push_back({found_span, counter});
-    counter++;
+bool DatetimeParser::FindDatetimes(
+    const UnicodeText& input, const std::string& locales, ModeFlag mode,
+    bool anchor_start_end, std::vector<ParsedDatetimeSpan>* results,
+    const CallInterruption* interruption) const {
+  std::vector<ParsedDatetimeSpan> found_spans;
+  const std::shared_ptr<const LocaleRules> locale_rules =
+      GetLocaleRules(locales, mode);
+  if (!FindSpansUsingLocales(*locale_rules, input, anchor_start_end,
+                             interruption, &found_spans)) {
+    return false;
   }
 
   // Resolve conflicts by always picking the longer span and breaking ties by
-  // selecting the earlier entry in the list for a given locale.
-  std::sort(indexed_found_spans.begin(), indexed_found_spans.end(),
-            [](const std::pair<DatetimeParseResultSpan, int>& a,
-               const std::pair<DatetimeParseResultSpan, int>& b) {
-              if ((a.first.span.second - a.first.span.first) !=
-                  (b.first.span.second - b.first.span.first)) {
-                return (a.first.span.second - a.first.span.first) >
-                       (b.first.span.second - b.first.span.first);
-              } else {
-                return a.second < b.second;
-              }
-            });
-
-  found_spans.clear();
-  for (auto& span_index_pair : indexed_found_spans) {
-    found_spans.push_back(span_index_pair.first);
-  }
-
-  std::set<int, std::function<bool(int, int)>> chosen_indices_set(
-      [&found_spans](int a, int b) {
-        return found_spans[a].span.first < found_spans[b].span.first;
-      });
-  for (int i = 0; i < found_spans.size(); ++i) {
-    if (!DoesCandidateConflict(i, found_spans, chosen_indices_set)) {
-      chosen_indices_set.insert(i);
-      results->push_back(found_spans[i]);
+  // selecting the earlier entry in the list for a given locale. Only the
+  // indices are sorted, so that the results aren't copied around.
+  std::vector<int> order(found_spans.size());
+  for (int i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&found_spans](int a, int b) {
+    const int a_length = found_spans[a].span.second - found_spans[a].span.first;
+    const int b_length = found_spans[b].span.second - found_spans[b].span.first;
+    if (a_length != b_length) {
+      return a_length > b_length;
+    }
+    return a < b;
+  });
+
+  NonOverlappingSpans chosen_spans(/*expected_size=*/found_spans.size());
+  for (const int i : order) {
+    if (chosen_spans.AddIfNoConflict(found_spans[i].span, i)) {
+      results->push_back(std::move(found_spans[i]));
     }
   }
 
   return true;
 }
 
+bool DatetimeParser::Interpret(const ParsedDatetimeSpan& parsed_span,
+                               int64 reference_time_ms_utc,
+                               const std::string& reference_timezone,
+                               const std::string& locales,
+                               DatetimeParseResultSpan* result) const {
+  // The reference locale is the first of the locales, as in
+  // ParseAndExpandLocales().
+  const std::string reference_locale = locales.substr(0, locales.find(','));
+  result->span = parsed_span.span;
+  result->data.granularity = parsed_span.granularity;
+  result->target_classification_score =
+      parsed_span.target_classification_score;
+  result->priority_score = parsed_span.priority_score;
+  return calendar_lib_.InterpretParseData(
+      parsed_span.parse_data, reference_time_ms_utc, reference_timezone,
+      reference_locale, parsed_span.granularity, &result->data.time_ms_utc);
+}
+
+namespace {
+
+DatetimeGranularity GetGranularity(const DateParseData& data) {
+  DatetimeGranularity granularity = DatetimeGranularity::GRANULARITY_YEAR;
+  if ((data.field_set_mask & DateParseData::YEAR_FIELD) ||
+      (data.field_set_mask & DateParseData::RELATION_TYPE_FIELD &&
+       (data.relation_type == DateParseData::RelationType::YEAR))) {
+    granularity = DatetimeGranularity::GRANULARITY_YEAR;
+  }
+  if ((data.field_set_mask & DateParseData::MONTH_FIELD) ||
+      (data.field_set_mask & DateParseData::RELATION_TYPE_FIELD &&
+       (data.relation_type == DateParseData::RelationType::MONTH))) {
+    granularity = DatetimeGranularity::GRANULARITY_MONTH;
+  }
+  if (data.field_set_mask & DateParseData::RELATION_TYPE_FIELD &&
+      (data.relation_type == DateParseData::RelationType::WEEK)) {
+    granularity = DatetimeGranularity::GRANULARITY_WEEK;
+  }
+  if (data.field_set_mask & DateParseData::DAY_FIELD ||
+      (data.field_set_mask & DateParseData::RELATION_FIELD &&
+       (data.relation == DateParseData::Relation::NOW ||
+        data.relation == DateParseData::Relation::TOMORROW ||
+        data.relation == DateParseData::Relation::YESTERDAY)) ||
+      (data.field_set_mask & DateParseData::RELATION_TYPE_FIELD &&
+       (data.relation_type == DateParseData::RelationType::MONDAY ||
+        data.relation_type == DateParseData::RelationType::TUESDAY ||
+        data.relation_type == DateParseData::RelationType::WEDNESDAY ||
+        data.relation_type == DateParseData::RelationType::THURSDAY ||
+        data.relation_type == DateParseData::RelationType::FRIDAY ||
+        data.relation_type == DateParseData::RelationType::SATURDAY ||
+        data.relation_type == DateParseData::RelationType::SUNDAY ||
+        data.relation_type == DateParseData::RelationType::DAY))) {
+    granularity = DatetimeGranularity::GRANULARITY_DAY;
+  }
+  if (data.field_set_mask & DateParseData::HOUR_FIELD) {
+    granularity = DatetimeGranularity::GRANULARITY_HOUR;
+  }
+  if (data.field_set_mask & DateParseData::MINUTE_FIELD) {
+    granularity = DatetimeGranularity::GRANULARITY_MINUTE;
+  }
+  if (data.field_set_mask & DateParseData::SECOND_FIELD) {
+    granularity = DatetimeGranularity::GRANULARITY_SECOND;
+  }
+  return granularity;
+}
+
+}  // namespace
+
 bool DatetimeParser::HandleParseMatch(
     const CompiledRule& rule, const UniLib::RegexMatcher& matcher,
-    int64 reference_time_ms_utc, const std::string& reference_timezone,
-    const std::string& reference_locale, int locale_id,
-    std::vector<DatetimeParseResultSpan>* result) const {
+    int locale_id, std::vector<ParsedDatetimeSpan>* result) const {
   int status = UniLib::RegexMatcher::kNoError;
   const int start = matcher.Start(&status);
   if (status != UniLib::RegexMatcher::kNoError) {
@@ -222,12 +598,12 @@ bool DatetimeParser::HandleParseMatch(
     return false;
   }
 
-  DatetimeParseResultSpan parse_result;
-  if (!ExtractDatetime(rule, matcher, reference_time_ms_utc, reference_timezone,
-                       reference_locale, locale_id, &(parse_result.data),
+  ParsedDatetimeSpan parse_result;
+  if (!ExtractDatetime(rule, matcher, locale_id, &parse_result.parse_data,
                        &parse_result.span)) {
     return false;
   }
+  parse_result.granularity = GetGranularity(parse_result.parse_data);
   if (!use_extractors_for_locating_) {
     parse_result.span = {start, end};
   }
@@ -242,26 +618,77 @@ bool DatetimeParser::HandleParseMatch(
 }
 
 bool DatetimeParser::ParseWithRule(
-    const CompiledRule& rule, const UnicodeText& input,
-    const int64 reference_time_ms_utc, const std::string& reference_timezone,
-    const std::string& reference_locale, const int locale_id,
-    bool anchor_start_end, std::vector<DatetimeParseResultSpan>* result) const {
-  std::unique_ptr<UniLib::RegexMatcher> matcher =
-      rule.compiled_regex->Matcher(input);
+    int rule_id, const UniLib::UTF16Text& input, const int locale_id,
+    bool anchor_start_end, std::vector<ParsedDatetimeSpan>* result) const {
+  const CompiledRule& rule = rules_[rule_id];
+  ScopedRuleTimer timer(rule_profile_, RuleProfile::DATETIME, rule_id);
+  const UniLib::RegexPattern* regex_pattern = rule.compiled_regex->Get();
+  if (regex_pattern == nullptr) {
+    TC_LOG(ERROR) << "Couldn't compile rule pattern.";
+    return false;
+  }
+  const UniLib::RegexPattern::ScopedMatcher matcher =
+      regex_pattern->AcquireMatcher(input);
   int status = UniLib::RegexMatcher::kNoError;
   if (anchor_start_end) {
     if (matcher->Matches(&status) && status == UniLib::RegexMatcher::kNoError) {
-      if (!HandleParseMatch(rule, *matcher, reference_time_ms_utc,
-                            reference_timezone, reference_locale, locale_id,
-                            result)) {
+      timer.AddMatch();
+      if (!HandleParseMatch(rule, *matcher, locale_id, result)) {
         return false;
       }
     }
   } else {
     while (matcher->Find(&status) && status == UniLib::RegexMatcher::kNoError) {
-      if (!HandleParseMatch(rule, *matcher, reference_time_ms_utc,
-                            reference_timezone, reference_locale, locale_id,
-                            result)) {
+      timer.AddMatch();
+      if (!HandleParseMatch(rule, *matcher, locale_id, result)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool DatetimeParser::ParseWithPatternGroup(
+    const LocaleRules& locale_rules, const std::vector<int>& group,
+    const UniLib::UTF16Text& input, bool anchor_start_end,
+    std::vector<std::vector<ParsedDatetimeSpan>>* rule_results) const {
+  if (group.size() == 1) {
+    const std::pair<int, int>& rule_and_locale = locale_rules.rules[group[0]];
+    return ParseWithRule(rule_and_locale.first, input,
+                         rule_and_locale.second, anchor_start_end,
+                         &(*rule_results)[group[0]]);
+  }
+
+  ScopedRuleTimer timer(rule_profile_, RuleProfile::DATETIME,
+                        locale_rules.rules[group[0]].first);
+  const UniLib::RegexPattern* regex_pattern =
+      rules_[locale_rules.rules[group[0]].first].compiled_regex->Get();
+  if (regex_pattern == nullptr) {
+    TC_LOG(ERROR) << "Couldn't compile rule pattern.";
+    return false;
+  }
+  const UniLib::RegexPattern::ScopedMatcher matcher =
+      regex_pattern->AcquireMatcher(input);
+  auto handle_match = [&]() {
+    for (const int i : group) {
+      const std::pair<int, int>& rule_and_locale = locale_rules.rules[i];
+      if (!HandleParseMatch(rules_[rule_and_locale.first], *matcher,
+                            rule_and_locale.second, &(*rule_results)[i])) {
+        return false;
+      }
+    }
+    return true;
+  };
+  int status = UniLib::RegexMatcher::kNoError;
+  if (anchor_start_end) {
+    if (matcher->Matches(&status) && status == UniLib::RegexMatcher::kNoError) {
+      timer.AddMatch();
+      return handle_match();
+    }
+  } else {
+    while (matcher->Find(&status) && status == UniLib::RegexMatcher::kNoError) {
+      timer.AddMatch();
+      if (!handle_match()) {
         return false;
       }
     }
@@ -328,78 +755,15 @@ std::vector<int> DatetimeParser::ParseAndExpandLocales(
   return result;
 }
 
-namespace {
-
-DatetimeGranularity GetGranularity(const DateParseData& data) {
-  DatetimeGranularity granularity = DatetimeGranularity::GRANULARITY_YEAR;
-  if ((data.field_set_mask & DateParseData::YEAR_FIELD) ||
-      (data.field_set_mask & DateParseData::RELATION_TYPE_FIELD &&
-       (data.relation_type == DateParseData::RelationType::YEAR))) {
-    granularity = DatetimeGranularity::GRANULARITY_YEAR;
-  }
-  if ((data.field_set_mask & DateParseData::MONTH_FIELD) ||
-      (data.field_set_mask & DateParseData::RELATION_TYPE_FIELD &&
-       (data.relation_type == DateParseData::RelationType::MONTH))) {
-    granularity = DatetimeGranularity::GRANULARITY_MONTH;
-  }
-  if (data.field_set_mask & DateParseData::RELATION_TYPE_FIELD &&
-      (data.relation_type == DateParseData::RelationType::WEEK)) {
-    granularity = DatetimeGranularity::GRANULARITY_WEEK;
-  }
-  if (data.field_set_mask & DateParseData::DAY_FIELD ||
-      (data.field_set_mask & DateParseData::RELATION_FIELD &&
-       (data.relation == DateParseData::Relation::NOW ||
-        data.relation == DateParseData::Relation::TOMORROW ||
-        data.relation == DateParseData::Relation::YESTERDAY)) ||
-      (data.field_set_mask & DateParseData::RELATION_TYPE_FIELD &&
-       (data.relation_type == DateParseData::RelationType::MONDAY ||
-        data.relation_type == DateParseData::RelationType::TUESDAY ||
-        data.relation_type == DateParseData::RelationType::WEDNESDAY ||
-        data.relation_type == DateParseData::RelationType::THURSDAY ||
-        data.relation_type == DateParseData::RelationType::FRIDAY ||
-        data.relation_type == DateParseData::RelationType::SATURDAY ||
-        data.relation_type == DateParseData::RelationType::SUNDAY ||
-        data.relation_type == DateParseData::RelationType::DAY))) {
-    granularity = DatetimeGranularity::GRANULARITY_DAY;
-  }
-  if (data.field_set_mask & DateParseData::HOUR_FIELD) {
-    granularity = DatetimeGranularity::GRANULARITY_HOUR;
-  }
-  if (data.field_set_mask & DateParseData::MINUTE_FIELD) {
-    granularity = DatetimeGranularity::GRANULARITY_MINUTE;
-  }
-  if (data.field_set_mask & DateParseData::SECOND_FIELD) {
-    granularity = DatetimeGranularity::GRANULARITY_SECOND;
-  }
-  return granularity;
-}
-
-}  // namespace
-
 bool DatetimeParser::ExtractDatetime(const CompiledRule& rule,
                                      const UniLib::RegexMatcher& matcher,
-                                     const int64 reference_time_ms_utc,
-                                     const std::string& reference_timezone,
-                                     const std::string& reference_locale,
-                                     int locale_id, DatetimeParseResult* result,
+                                     int locale_id, DateParseData* result,
                                      CodepointSpan* result_span) const {
-  DateParseData parse;
   DatetimeExtractor extractor(rule, matcher, locale_id, unilib_,
                               extractor_rules_,
-                              type_and_locale_to_extractor_rule_);
-  if (!extractor.Extract(&parse, result_span)) {
-    return false;
-  }
-
-  result->granularity = GetGranularity(parse);
-
-  if (!calendar_lib_.InterpretParseData(
-          parse, reference_time_ms_utc, reference_timezone, reference_locale,
-          result->granularity, &(result->time_ms_utc))) {
-    return false;
-  }
-
-  return true;
+                              type_and_locale_to_extractor_rule_,
+                              frozen_ ? nullptr : &word_cache_);
+  return extractor.Extract(result, result_span);
 }
 
 }  // namespace libtextclassifier2
@@ -18,28 +18,47 @@
 #define LIBTEXTCLASSIFIER_DATETIME_PARSER_H_
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "cancellation.h"
 #include "datetime/extractor.h"
 #include "model_generated.h"
+#include "rule-profile.h"
 #include "types.h"
 #include "util/base/integral_types.h"
 #include "util/calendar/calendar.h"
+#include "util/thread/executor.h"
 #include "util/utf8/unilib.h"
 #include "zlib-utils.h"
 
 namespace libtextclassifier2 {
 
+// A datetime expression found in the input, with the fields parsed from it but
+// without the absolute time, which is computed by DatetimeParser::Interpret().
+struct ParsedDatetimeSpan {
+  CodepointSpan span;
+  DateParseData parse_data;
+  DatetimeGranularity granularity;
+  float target_classification_score;
+  float priority_score;
+};
+
 // Parses datetime expressions in the input and resolves them to actual absolute
 // time.
 class DatetimeParser {
  public:
+  // If 'compile_lazily' is true, the rules are decompressed and compiled when
+  // they are first needed for a locale, instead of here. Otherwise, if
+  // 'executor' is set, they are compiled here in parallel on it.
   static std::unique_ptr<DatetimeParser> Instance(
       const DatetimeModel* model, const UniLib& unilib,
-      ZlibDecompressor* decompressor);
+      ZlibDecompressor* decompressor, bool compile_lazily = false,
+      Executor* executor = nullptr);
 
   // Parses the dates in 'input' and fills result. Makes sure that the results
   // do not overlap.
@@ -56,60 +75,154 @@ class DatetimeParser {
              ModeFlag mode, bool anchor_start_end,
              std::vector<DatetimeParseResultSpan>* results) const;
 
+  // Finds the same datetime expressions as Parse(), but does not resolve them
+  // to absolute time, which needs calendar arithmetic. Callers that drop some
+  // of the results can call Interpret() only for the ones they keep.
+  // If 'interruption' is set, the rules are not run once it says to stop, and
+  // the results are then the ones found until then.
+  bool FindDatetimes(const UnicodeText& input, const std::string& locales,
+                     ModeFlag mode, bool anchor_start_end,
+                     std::vector<ParsedDatetimeSpan>* results,
+                     const CallInterruption* interruption = nullptr) const;
+
+  // Resolves a result of FindDatetimes() to absolute time. 'locales' are the
+  // ones that FindDatetimes() was called with.
+  bool Interpret(const ParsedDatetimeSpan& parsed_span,
+                 int64 reference_time_ms_utc,
+                 const std::string& reference_timezone,
+                 const std::string& locales,
+                 DatetimeParseResultSpan* result) const;
+
+  // Completes the lazy initialization before the process is forked, e.g. by a
+  // zygote, so that the forked processes keep sharing the memory of the
+  // parser: compiles all the rules, memoizes the rules of the given locale
+  // spec strings for all modes and drops the pooled matchers. After it, the
+  // memoized rules are only read, the rules of other locale strings are
+  // computed on every call and the extracted words are not memoized. Returns
+  // false if a rule could not be compiled.
+  // NOTE: Must not be called concurrently with other calls.
+  bool Freeze(const std::vector<std::string>& locales);
+
+  // Returns an estimate of the heap memory held by the rules, the compiled
+  // patterns and the memoized state, in bytes.
+  // Thread-safe.
+  int64 EstimateHeapBytes() const;
+
+  // Records the runs of the rules in 'profile', and names the rules there
+  // after their patterns. Null disables the profiling. Not owned.
+  // NOTE: Must not be called concurrently with other calls.
+  void SetRuleProfile(RuleProfile* profile);
+
  protected:
   DatetimeParser(const DatetimeModel* model, const UniLib& unilib,
-                 ZlibDecompressor* decompressor);
+                 ZlibDecompressor* decompressor, bool compile_lazily,
+                 Executor* executor);
+
+  // The rules to run for a locale spec string and mode.
+  struct LocaleRules {
+    std::string reference_locale;
+
+    // Pairs of rule id and the locale id to run it for, in the order in which
+    // the rules are to run. Every rule is present at most once.
+    std::vector<std::pair<int, int>> rules;
+
+    // Alternation of all the rules, which matches iff any of them matches.
+    // Null if the prefilter is disabled or the rules can't be combined.
+    std::unique_ptr<UniLib::RegexPattern> prefilter;
+
+    // If some of the rules share their pattern, the indices into 'rules',
+    // grouped by pattern in the order of their first rule, so that each
+    // pattern runs once per input. Empty if every rule has its own pattern.
+    std::vector<std::vector<int>> pattern_groups;
+  };
 
   // Returns a list of locale ids for given locale spec string (comma-separated
   // locale names). Assigns the first parsed locale to reference_locale.
   std::vector<int> ParseAndExpandLocales(const std::string& locales,
                                          std::string* reference_locale) const;
 
-  // Helper function that finds datetime spans, only using the rules associated
-  // with the given locales.
+  // Returns the rules enabled for 'mode' in the given locale spec string.
+  // The results are memoized, as callers use only a few locale strings.
+  std::shared_ptr<const LocaleRules> GetLocaleRules(const std::string& locales,
+                                                    ModeFlag mode) const;
+
+  // Computes the rules for GetLocaleRules().
+  // NOTE: This is also where the prefilter for the rules is compiled.
+  std::shared_ptr<const LocaleRules> ComputeLocaleRules(
+      const std::string& locales, ModeFlag mode) const;
+
+  // Combines the given rules into a single alternation. Returns nullptr if
+  // the rules can't be combined.
+  std::unique_ptr<UniLib::RegexPattern> CreateRulePrefilter(
+      const std::vector<std::pair<int, int>>& rules) const;
+
+  // Helper function that finds datetime spans, only using the given rules.
   bool FindSpansUsingLocales(
-      const std::vector<int>& locale_ids, const UnicodeText& input,
-      const int64 reference_time_ms_utc, const std::string& reference_timezone,
-      ModeFlag mode, bool anchor_start_end, const std::string& reference_locale,
-      std::unordered_set<int>* executed_rules,
-      std::vector<DatetimeParseResultSpan>* found_spans) const;
-
-  bool ParseWithRule(const CompiledRule& rule, const UnicodeText& input,
-                     int64 reference_time_ms_utc,
-                     const std::string& reference_timezone,
-                     const std::string& reference_locale, const int locale_id,
-                     bool anchor_start_end,
-                     std::vector<DatetimeParseResultSpan>* result) const;
-
-  // Converts the current match in 'matcher' into DatetimeParseResult.
+      const LocaleRules& locale_rules, const UnicodeText& input,
+      bool anchor_start_end, const CallInterruption* interruption,
+      std::vector<ParsedDatetimeSpan>* found_spans) const;
+
+  // Runs the rule at index 'rule_id' of rules_.
+  bool ParseWithRule(int rule_id, const UniLib::UTF16Text& input,
+                     const int locale_id, bool anchor_start_end,
+                     std::vector<ParsedDatetimeSpan>* result) const;
+
+  // Runs the pattern shared by a group of 'pattern_groups' once, and handles
+  // each match with every rule of the group. The results of the rule at index
+  // i of locale_rules.rules are appended to (*rule_results)[i].
+  bool ParseWithPatternGroup(
+      const LocaleRules& locale_rules, const std::vector<int>& group,
+      const UniLib::UTF16Text& input, bool anchor_start_end,
+      std::vector<std::vector<ParsedDatetimeSpan>>* rule_results) const;
+
+  // Extracts the datetime fields from the current match in 'matcher'.
   bool ExtractDatetime(const CompiledRule& rule,
-                       const UniLib::RegexMatcher& matcher,
-                       int64 reference_time_ms_utc,
-                       const std::string& reference_timezone,
-                       const std::string& reference_locale, int locale_id,
-                       DatetimeParseResult* result,
+                       const UniLib::RegexMatcher& matcher, int locale_id,
+                       DateParseData* result,
                        CodepointSpan* result_span) const;
 
   // Parse and extract information from current match in 'matcher'.
   bool HandleParseMatch(const CompiledRule& rule,
-                        const UniLib::RegexMatcher& matcher,
-                        int64 reference_time_ms_utc,
-                        const std::string& reference_timezone,
-                        const std::string& reference_locale, int locale_id,
-                        std::vector<DatetimeParseResultSpan>* result) const;
+                        const UniLib::RegexMatcher& matcher, int locale_id,
+                        std::vector<ParsedDatetimeSpan>* result) const;
 
  private:
   bool initialized_;
   const UniLib& unilib_;
+  // The distinct patterns of the rules and the extractors.
+  std::vector<std::unique_ptr<const LazyRegexPattern>> patterns_;
   std::vector<CompiledRule> rules_;
   std::unordered_map<int, std::vector<int>> locale_to_rules_;
-  std::vector<std::unique_ptr<const UniLib::RegexPattern>> extractor_rules_;
+  std::vector<const LazyRegexPattern*> extractor_rules_;
   std::unordered_map<DatetimeExtractorType, std::unordered_map<int, int>>
       type_and_locale_to_extractor_rule_;
   std::unordered_map<std::string, int> locale_string_to_id_;
   std::vector<int> default_locale_ids_;
   CalendarLib calendar_lib_;
   bool use_extractors_for_locating_;
+  bool use_rule_prefilter_;
+
+  // The work limits of the matches of the rules, the extractors and the
+  // prefilters.
+  RegexWorkLimits regex_limits_;
+
+  // The maximum number of locale strings to keep the rules for, per mode.
+  static constexpr int kMaxCachedLocaleRules = 16;
+
+  // Memoized results of GetLocaleRules, by mode and locale spec string.
+  mutable std::mutex locale_rules_mutex_;
+  mutable std::unordered_map<
+      int, std::unordered_map<std::string, std::shared_ptr<const LocaleRules>>>
+      locale_rules_cache_;
+
+  // Memoized values of the words matched by the extractor rules.
+  mutable DatetimeWordCache word_cache_;
+
+  // Whether Freeze() was called, after which the memoized state is not
+  // written anymore.
+  bool frozen_ = false;
+
+  RuleProfile* rule_profile_ = nullptr;
 };
 
 }  // namespace libtextclassifier2
@@ -254,6 +254,42 @@ TEST_F(ParserTest, ParseWithAnchor) {
                           /*anchor_start_end=*/true));
 }
 
+TEST_F(ParserTest, ParseRepeatedWords) {
+  // The second time around, the words are mapped from the word cache.
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_TRUE(
+        ParsesCorrectly("{January 1, 1988}", 567990000000, GRANULARITY_DAY));
+    EXPECT_TRUE(
+        ParsesCorrectly("{three days ago}", -262800000, GRANULARITY_DAY));
+    EXPECT_TRUE(ParsesCorrectlyGerman("{Januar 1 2018}", 1514761200000,
+                                      GRANULARITY_DAY));
+  }
+}
+
+TEST_F(ParserTest, FindDatetimesThenInterpret) {
+  const UnicodeText text = UTF8ToUnicodeText(
+      "on January 1, 1988 or three days ago at 11:25", /*do_copy=*/false);
+  std::vector<DatetimeParseResultSpan> expected;
+  ASSERT_TRUE(parser_->Parse(text, /*reference_time_ms_utc=*/0,
+                             "Europe/Zurich", "en-US", ModeFlag_ANNOTATION,
+                             /*anchor_start_end=*/false, &expected));
+  ASSERT_FALSE(expected.empty());
+
+  std::vector<ParsedDatetimeSpan> parsed_spans;
+  ASSERT_TRUE(parser_->FindDatetimes(text, "en-US", ModeFlag_ANNOTATION,
+                                     /*anchor_start_end=*/false,
+                                     &parsed_spans));
+  std::vector<DatetimeParseResultSpan> results(parsed_spans.size());
+  for (int i = 0; i < parsed_spans.size(); ++i) {
+    EXPECT_EQ(parsed_spans[i].span, expected[i].span);
+    EXPECT_EQ(parsed_spans[i].granularity, expected[i].data.granularity);
+    ASSERT_TRUE(parser_->Interpret(parsed_spans[i],
+                                   /*reference_time_ms_utc=*/0,
+                                   "Europe/Zurich", "en-US", &results[i]));
+  }
+  EXPECT_THAT(results, ElementsAreArray(expected));
+}
+
 TEST_F(ParserTest, ParseGerman) {
   EXPECT_TRUE(
       ParsesCorrectlyGerman("{Januar 1 2018}", 1514761200000, GRANULARITY_DAY));
@@ -368,6 +404,7 @@ TEST_F(ParserTest, ParseUnknownLanguage) {
 class ParserLocaleTest : public testing::Test {
  public:
   void SetUp() override;
+  void CreateParser(bool use_rule_prefilter);
   bool HasResult(const std::string& input, const std::string& locales);
 
  protected:
@@ -387,8 +424,13 @@ void AddPattern(const std::string& regex, int locale,
 }
 
 void ParserLocaleTest::SetUp() {
+  CreateParser(/*use_rule_prefilter=*/false);
+}
+
+void ParserLocaleTest::CreateParser(bool use_rule_prefilter) {
   DatetimeModelT model;
   model.use_extractors_for_locating = false;
+  model.use_rule_prefilter = use_rule_prefilter;
   model.locales.clear();
   model.locales.push_back("en-US");
   model.locales.push_back("en-CH");
@@ -407,6 +449,7 @@ void ParserLocaleTest::SetUp() {
   AddPattern(/*regex=*/"all-CH", /*locale=*/5, &model.patterns);
   AddPattern(/*regex=*/"default", /*locale=*/6, &model.patterns);
 
+  builder_.Clear();
   builder_.Finish(DatetimeModel::Pack(builder_, &model));
   const DatetimeModel* model_fb =
       flatbuffers::GetRoot<DatetimeModel>(builder_.GetBufferPointer());
@@ -453,5 +496,86 @@ TEST_F(ParserLocaleTest, SwissEnglish) {
   EXPECT_TRUE(HasResult("default", /*locales=*/"en-CH"));
 }
 
+TEST_F(ParserLocaleTest, ManyLocaleStrings) {
+  // More distinct locale strings than are memoized, so that the rules for
+  // some of them have to be recomputed.
+  for (int i = 0; i < 3; ++i) {
+    for (const std::string& locales :
+         {"en-US", "en-CH", "de-CH", "de-DE", "zh-Hant", "zh-Hant-TW",
+          "zh-Hant-SG", "en-GB", "fr-CH", "it-CH", "en-US,en-CH", "en-CH,en-US",
+          "de-CH,en-US", "en", "zh", "fr", "it", "es", "pt"}) {
+      EXPECT_TRUE(HasResult("default", locales));
+    }
+    EXPECT_TRUE(HasResult("en-US", /*locales=*/"en-US"));
+    EXPECT_FALSE(HasResult("en-US", /*locales=*/"en-CH"));
+    EXPECT_TRUE(HasResult("all-CH", /*locales=*/"fr-CH"));
+  }
+}
+
+TEST_F(ParserLocaleTest, WithRulePrefilter) {
+  CreateParser(/*use_rule_prefilter=*/true);
+  EXPECT_TRUE(HasResult("en-US", /*locales=*/"en-US"));
+  EXPECT_FALSE(HasResult("en-US", /*locales=*/"en-CH"));
+  EXPECT_TRUE(HasResult("all-CH", /*locales=*/"de-CH"));
+  EXPECT_TRUE(HasResult("en-all", /*locales=*/"en-CH"));
+  EXPECT_TRUE(HasResult("default", /*locales=*/"en-CH"));
+  EXPECT_FALSE(HasResult("no date here", /*locales=*/"en-CH"));
+}
+
+TEST(ParserSharedPatternTest, SameResultsAsSeparatePatterns) {
+  UniLib unilib;
+  DatetimeModelT model;
+  model.use_extractors_for_locating = false;
+  model.locales.push_back("en-US");
+  model.locales.push_back("en-CH");
+  model.locales.push_back("*-CH");
+  // The rules tell apart by their score. The "shared" ones have the same
+  // pattern, which runs only once for all of them.
+  AddPattern(/*regex=*/"shared", /*locale=*/0, &model.patterns);
+  model.patterns.back()->target_classification_score = 0.1;
+  AddPattern(/*regex=*/"shared", /*locale=*/1, &model.patterns);
+  model.patterns.back()->target_classification_score = 0.2;
+  AddPattern(/*regex=*/"other", /*locale=*/1, &model.patterns);
+  model.patterns.back()->target_classification_score = 0.5;
+  AddPattern(/*regex=*/"shared", /*locale=*/2, &model.patterns);
+  model.patterns.back()->target_classification_score = 0.3;
+
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(DatetimeModel::Pack(builder, &model));
+  std::unique_ptr<DatetimeParser> parser = DatetimeParser::Instance(
+      flatbuffers::GetRoot<DatetimeModel>(builder.GetBufferPointer()), unilib,
+      /*decompressor=*/nullptr);
+  ASSERT_TRUE(parser);
+
+  // The rules of en-CH and *-CH both match, and the earlier one wins, as it
+  // would if each ran its own pattern.
+  std::vector<DatetimeParseResultSpan> results;
+  ASSERT_TRUE(parser->Parse("shared and other", /*reference_time_ms_utc=*/0,
+                            /*reference_timezone=*/"", /*locales=*/"en-CH",
+                            ModeFlag_ANNOTATION, /*anchor_start_end=*/false,
+                            &results));
+  ASSERT_EQ(results.size(), 2);
+  EXPECT_EQ(results[0].span, CodepointSpan(0, 6));
+  EXPECT_FLOAT_EQ(results[0].target_classification_score, 0.2);
+  EXPECT_EQ(results[1].span, CodepointSpan(11, 16));
+  EXPECT_FLOAT_EQ(results[1].target_classification_score, 0.5);
+
+  results.clear();
+  ASSERT_TRUE(parser->Parse("shared", /*reference_time_ms_utc=*/0,
+                            /*reference_timezone=*/"", /*locales=*/"de-CH",
+                            ModeFlag_ANNOTATION, /*anchor_start_end=*/true,
+                            &results));
+  ASSERT_EQ(results.size(), 1);
+  EXPECT_FLOAT_EQ(results[0].target_classification_score, 0.3);
+
+  results.clear();
+  ASSERT_TRUE(parser->Parse("shared", /*reference_time_ms_utc=*/0,
+                            /*reference_timezone=*/"", /*locales=*/"en-US",
+                            ModeFlag_ANNOTATION, /*anchor_start_end=*/false,
+                            &results));
+  ASSERT_EQ(results.size(), 1);
+  EXPECT_FLOAT_EQ(results[0].target_classification_score, 0.1);
+}
+
 }  // namespace
 }  // namespace libtextclassifier2
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "dynamic-batcher.h"
+
+#include <chrono>
+
+#include "util/base/logging.h"
+
+namespace libtextclassifier2 {
+
+bool DynamicBatcher::ComputeLogits(const TensorView<float>& features,
+                                   std::vector<float>* logits) const {
+  if (features.dims() != 2) {
+    TC_LOG(ERROR) << "Expected two-dimensional features.";
+    return false;
+  }
+  Request request;
+  request.features = &features;
+  request.logits = logits;
+  const int num_rows = features.dim(0);
+  const int features_size = features.dim(1);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::shared_ptr<Batch> batch = open_batch_;
+  const bool starts_batch =
+      batch == nullptr || batch->features_size != features_size ||
+      batch->num_rows + num_rows > options_.max_batch_size;
+  if (starts_batch) {
+    if (batch != nullptr) {
+      // Let the current batch run now, as it cannot take this request.
+      batch->full = true;
+      changed_.notify_all();
+    }
+    batch = std::make_shared<Batch>();
+    batch->features_size = features_size;
+    open_batch_ = batch;
+  }
+  batch->requests.push_back(&request);
+  batch->num_rows += num_rows;
+  if (batch->num_rows >= options_.max_batch_size) {
+    batch->full = true;
+    changed_.notify_all();
+  }
+
+  if (!starts_batch) {
+    changed_.wait(lock, [&request]() { return request.done; });
+    return request.success;
+  }
+
+  changed_.wait_for(lock, std::chrono::microseconds(options_.max_delay_us),
+                    [&batch]() { return batch->full; });
+  if (open_batch_ == batch) {
+    open_batch_ = nullptr;
+  }
+  ++num_batches_;
+
+  // No more requests join the batch once it is closed, so it is run without
+  // the lock, while the next batch fills up.
+  lock.unlock();
+  const bool success = RunBatch(*batch);
+  lock.lock();
+  for (Request* batch_request : batch->requests) {
+    batch_request->done = true;
+    batch_request->success = success;
+  }
+  changed_.notify_all();
+  return success;
+}
+
+bool DynamicBatcher::RunBatch(const Batch& batch) const {
+  // A request that runs on its own needs no copies.
+  if (batch.requests.size() == 1) {
+    return compute_(*batch.requests[0]->features, batch.requests[0]->logits);
+  }
+
+  std::vector<float> features;
+  features.reserve(batch.num_rows * batch.features_size);
+  for (const Request* request : batch.requests) {
+    features.insert(features.end(), request->features->data(),
+                    request->features->data() + request->features->size());
+  }
+  std::vector<float> logits;
+  if (!compute_(TensorView<float>(features.data(),
+                                  {batch.num_rows, batch.features_size}),
+                &logits)) {
+    return false;
+  }
+  if (logits.size() % batch.num_rows != 0) {
+    TC_LOG(ERROR) << "Mismatching logits.";
+    return false;
+  }
+
+  // Hand out the rows of the logits in the order of the features.
+  const int logits_size = logits.size() / batch.num_rows;
+  auto row = logits.begin();
+  for (Request* request : batch.requests) {
+    const int request_size = request->features->dim(0) * logits_size;
+    request->logits->assign(row, row + request_size);
+    row += request_size;
+  }
+  return true;
+}
+
+int DynamicBatcher::num_batches() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_batches_;
+}
+
+}  // namespace libtextclassifier2
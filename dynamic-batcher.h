@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Batching of model inferences across concurrent calls.
+
+#ifndef LIBTEXTCLASSIFIER_DYNAMIC_BATCHER_H_
+#define LIBTEXTCLASSIFIER_DYNAMIC_BATCHER_H_
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "tensor-view.h"
+
+namespace libtextclassifier2 {
+
+struct DynamicBatcherOptions {
+  // Maximum number of feature rows that are run in one inference. Requests
+  // with more rows run on their own.
+  int max_batch_size = 32;
+
+  // How long, in microseconds, the first request of a batch waits for other
+  // requests to join it before the batch is run.
+  int max_delay_us = 500;
+};
+
+// Collects the feature rows of concurrent ComputeLogits() calls into batches
+// and runs each batch in one inference, the way model servers do dynamic
+// batching. This keeps the model at full batch width when many threads run
+// one small inference each, at the cost of up to max_delay_us of latency.
+// There is no thread of its own: the first caller of a batch waits for the
+// others, runs the batch and hands the logits out.
+// Thread-safe.
+class DynamicBatcher {
+ public:
+  // Computes the logits of features of shape [num_rows, features_size] into
+  // 'logits', as num_rows rows of the same size. Returns false on failure.
+  // Called by one thread at a time.
+  typedef std::function<bool(const TensorView<float>& features,
+                             std::vector<float>* logits)>
+      ComputeFunction;
+
+  DynamicBatcher(ComputeFunction compute,
+                 const DynamicBatcherOptions& options = DynamicBatcherOptions())
+      : compute_(std::move(compute)), options_(options) {}
+
+  // Computes the logits of the rows of the two-dimensional 'features', as
+  // compute() does, but together with the rows of concurrent calls. Blocks
+  // until they are computed.
+  bool ComputeLogits(const TensorView<float>& features,
+                     std::vector<float>* logits) const;
+
+  // Returns the number of inferences run so far.
+  int num_batches() const;
+
+ private:
+  struct Request {
+    const TensorView<float>* features;
+    std::vector<float>* logits;
+    bool done = false;
+    bool success = false;
+  };
+
+  struct Batch {
+    std::vector<Request*> requests;
+    int features_size = 0;
+    int num_rows = 0;
+
+    // Set when no further requests fit, so that the batch runs right away.
+    bool full = false;
+  };
+
+  // Runs the requests of a closed batch in one inference.
+  bool RunBatch(const Batch& batch) const;
+
+  const ComputeFunction compute_;
+  const DynamicBatcherOptions options_;
+
+  // Guards all of the fields below, and the requests of the batches until they
+  // are done.
+  mutable std::mutex mutex_;
+  mutable std::condition_variable changed_;
+
+  // The batch that new requests join, or nullptr if there is none.
+  mutable std::shared_ptr<Batch> open_batch_;
+
+  mutable int num_batches_ = 0;
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_DYNAMIC_BATCHER_H_
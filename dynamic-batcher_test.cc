@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "dynamic-batcher.h"
+
+#include <atomic>
+#include <thread>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+using testing::ElementsAre;
+
+// Computes the sum of each row, twice.
+bool ComputeRowSums(const TensorView<float>& features,
+                    std::vector<float>* logits) {
+  logits->clear();
+  for (int i = 0; i < features.dim(0); ++i) {
+    float sum = 0.0;
+    for (int j = 0; j < features.dim(1); ++j) {
+      sum += features.data()[i * features.dim(1) + j];
+    }
+    logits->push_back(sum);
+    logits->push_back(2 * sum);
+  }
+  return true;
+}
+
+TEST(DynamicBatcherTest, ComputesAloneWithoutConcurrentCalls) {
+  DynamicBatcherOptions options;
+  options.max_delay_us = 0;
+  DynamicBatcher batcher(ComputeRowSums, options);
+
+  const std::vector<float> features = {1.0, 2.0, 3.0, 4.0};
+  std::vector<float> logits;
+  ASSERT_TRUE(batcher.ComputeLogits(TensorView<float>(features.data(), {2, 2}),
+                                    &logits));
+  EXPECT_THAT(logits, ElementsAre(3.0, 6.0, 7.0, 14.0));
+  EXPECT_EQ(batcher.num_batches(), 1);
+}
+
+TEST(DynamicBatcherTest, BatchesConcurrentCalls) {
+  std::atomic<int> max_rows(0);
+  DynamicBatcherOptions options;
+  options.max_batch_size = 8;
+  options.max_delay_us = 100000;
+  DynamicBatcher batcher(
+      [&max_rows](const TensorView<float>& features,
+                  std::vector<float>* logits) {
+        if (features.dim(0) > max_rows) {
+          max_rows = features.dim(0);
+        }
+        return ComputeRowSums(features, logits);
+      },
+      options);
+
+  const int kNumThreads = 16;
+  std::vector<std::thread> threads;
+  std::vector<char> correct(kNumThreads, false);
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.emplace_back([&batcher, &correct, i]() {
+      const std::vector<float> features = {static_cast<float>(i), 1.0};
+      std::vector<float> logits;
+      correct[i] =
+          batcher.ComputeLogits(TensorView<float>(features.data(), {1, 2}),
+                                &logits) &&
+          logits == std::vector<float>({i + 1.0f, 2 * (i + 1.0f)});
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_THAT(correct, testing::Each(true));
+  EXPECT_LT(batcher.num_batches(), kNumThreads);
+  EXPECT_GT(max_rows, 1);
+  EXPECT_LE(max_rows, options.max_batch_size);
+}
+
+TEST(DynamicBatcherTest, FailsAllRequestsOfFailedBatch) {
+  DynamicBatcher batcher(
+      [](const TensorView<float>& features, std::vector<float>* logits) {
+        return false;
+      });
+  const std::vector<float> features = {1.0};
+  std::vector<float> logits;
+  EXPECT_FALSE(batcher.ComputeLogits(
+      TensorView<float>(features.data(), {1, 1}), &logits));
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "embedding-cache.h"
+
+#include <algorithm>
+
+#include "util/base/integral_types.h"
+#include "util/base/logging.h"
+
+namespace libtextclassifier2 {
+namespace {
+inline uint32 HashSpan(CodepointSpan span) {
+  // Multiplicative hashing of both indices, with the high bits folded down as
+  // the result is masked to the (power-of-two) table size.
+  const uint32 h = static_cast<uint32>(span.first) * 0x9E3779B1u ^
+                   static_cast<uint32>(span.second) * 0x85EBCA77u;
+  return h ^ (h >> 15);
+}
+}  // namespace
+
+const int EmbeddingCache::kEmptySlot;
+
+int EmbeddingCache::FindSlot(CodepointSpan span) const {
+  const int mask = slots_.size() - 1;
+  int slot = HashSpan(span) & mask;
+  while (slots_[slot] != kEmptySlot && keys_[slots_[slot]] != span) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+const float* EmbeddingCache::Find(CodepointSpan span) const {
+  if (keys_.empty()) {
+    return nullptr;
+  }
+  const int entry = slots_[FindSlot(span)];
+  if (entry == kEmptySlot) {
+    return nullptr;
+  }
+  return arena_.data() + entry * embedding_size_;
+}
+
+void EmbeddingCache::Insert(CodepointSpan span, const float* embedding,
+                            int embedding_size) {
+  if (keys_.empty()) {
+    embedding_size_ = embedding_size;
+  }
+  TC_DCHECK_EQ(embedding_size, embedding_size_);
+
+  // Keep the load factor at most 1/2.
+  if (2 * (keys_.size() + 1) > slots_.size()) {
+    Grow();
+  }
+
+  const int slot = FindSlot(span);
+  int entry = slots_[slot];
+  if (entry == kEmptySlot) {
+    entry = keys_.size();
+    slots_[slot] = entry;
+    keys_.push_back(span);
+    arena_.resize(arena_.size() + embedding_size_);
+  }
+  std::copy(embedding, embedding + embedding_size_,
+            arena_.begin() + entry * embedding_size_);
+}
+
+void EmbeddingCache::Clear() {
+  std::fill(slots_.begin(), slots_.end(), kEmptySlot);
+  keys_.clear();
+  arena_.clear();
+  embedding_size_ = 0;
+}
+
+void EmbeddingCache::Grow() {
+  slots_.assign(std::max<int>(16, 2 * slots_.size()), kEmptySlot);
+  for (int entry = 0; entry < keys_.size(); ++entry) {
+    slots_[FindSlot(keys_[entry])] = entry;
+  }
+}
+
+}  // namespace libtextclassifier2
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBTEXTCLASSIFIER_EMBEDDING_CACHE_H_
+#define LIBTEXTCLASSIFIER_EMBEDDING_CACHE_H_
+
+#include <vector>
+
+#include "types.h"
+
+namespace libtextclassifier2 {
+
+// A cache mapping codepoint spans to embedded token features, implemented as
+// an open-addressing hash table with linear probing. All embeddings are stored
+// in one contiguous float arena, so inserting does not allocate per entry, and
+// Clear() keeps the allocated memory for reuse.
+// All stored embeddings must have the same size, which is fixed by the first
+// Insert() after construction or Clear().
+class EmbeddingCache {
+ public:
+  EmbeddingCache() {}
+
+  // Returns the cached embedding for the span, or nullptr if there is none.
+  // The pointer is valid until the next call to Insert() or Clear().
+  const float* Find(CodepointSpan span) const;
+
+  // Stores a copy of the embedding for the span, replacing the previous one if
+  // there was any.
+  void Insert(CodepointSpan span, const float* embedding, int embedding_size);
+
+  // Removes all the entries without releasing the memory.
+  void Clear();
+
+  // Returns the number of cached embeddings.
+  int size() const { return keys_.size(); }
+
+  bool empty() const { return keys_.empty(); }
+
+  // Returns the size of the stored embeddings, or 0 if the cache is empty.
+  int embedding_size() const { return embedding_size_; }
+
+ private:
+  static const int kEmptySlot = -1;
+
+  // Returns the slot for the span: either the one holding it, or the empty
+  // slot where it would be inserted.
+  int FindSlot(CodepointSpan span) const;
+
+  // Doubles the number of slots and re-inserts the entries.
+  void Grow();
+
+  int embedding_size_ = 0;
+
+  // Entry indices into keys_ (and blocks of arena_), or kEmptySlot. The size
+  // is always a power of two.
+  std::vector<int> slots_;
+
+  std::vector<CodepointSpan> keys_;
+  std::vector<float> arena_;
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_EMBEDDING_CACHE_H_
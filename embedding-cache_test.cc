@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "embedding-cache.h"
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+using testing::ElementsAreArray;
+
+std::vector<float> Lookup(const EmbeddingCache& cache, CodepointSpan span) {
+  const float* embedding = cache.Find(span);
+  if (embedding == nullptr) {
+    return {};
+  }
+  return std::vector<float>(embedding, embedding + cache.embedding_size());
+}
+
+TEST(EmbeddingCacheTest, InsertAndFind) {
+  EmbeddingCache cache;
+  EXPECT_TRUE(cache.empty());
+  EXPECT_EQ(cache.Find({0, 3}), nullptr);
+
+  const std::vector<float> a = {1.0, 2.0};
+  const std::vector<float> b = {3.0, 4.0};
+  cache.Insert({0, 3}, a.data(), a.size());
+  cache.Insert({kInvalidIndex, kInvalidIndex}, b.data(), b.size());
+
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_EQ(cache.embedding_size(), 2);
+  EXPECT_THAT(Lookup(cache, {0, 3}), ElementsAreArray(a));
+  EXPECT_THAT(Lookup(cache, {kInvalidIndex, kInvalidIndex}),
+              ElementsAreArray(b));
+  EXPECT_EQ(cache.Find({3, 0}), nullptr);
+
+  // Re-inserting replaces the embedding.
+  cache.Insert({0, 3}, b.data(), b.size());
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_THAT(Lookup(cache, {0, 3}), ElementsAreArray(b));
+}
+
+TEST(EmbeddingCacheTest, ManyEntries) {
+  EmbeddingCache cache;
+  for (int i = 0; i < 1000; ++i) {
+    const float value = i;
+    cache.Insert({i, i + 1}, &value, 1);
+  }
+  EXPECT_EQ(cache.size(), 1000);
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_THAT(Lookup(cache, {i, i + 1}), ElementsAreArray({1.0f * i}));
+  }
+  EXPECT_EQ(cache.Find({1000, 1001}), nullptr);
+}
+
+TEST(EmbeddingCacheTest, Clear) {
+  EmbeddingCache cache;
+  const std::vector<float> a = {1.0, 2.0, 3.0};
+  cache.Insert({0, 3}, a.data(), a.size());
+  cache.Clear();
+  EXPECT_TRUE(cache.empty());
+  EXPECT_EQ(cache.Find({0, 3}), nullptr);
+
+  // After clearing, a different embedding size can be used.
+  const float b = 5.0;
+  cache.Insert({0, 3}, &b, 1);
+  EXPECT_THAT(Lookup(cache, {0, 3}), ElementsAreArray({5.0f}));
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
@@ -16,11 +16,13 @@
 
 #include "feature-processor.h"
 
+#include <algorithm>
 #include <iterator>
 #include <set>
 #include <vector>
 
 #include "util/base/logging.h"
+#include "util/memory/memory-usage.h"
 #include "util/strings/utf8.h"
 #include "util/utf8/unicodetext.h"
 
@@ -182,6 +184,22 @@ std::vector<Token> FeatureProcessor::Tokenize(const std::string& text) const {
 
 std::vector<Token> FeatureProcessor::Tokenize(
     const UnicodeText& text_unicode) const {
+  return Tokenize(text_unicode, /*locales=*/"");
+}
+
+namespace {
+// Returns the first of the comma-separated locales, or "en" if there is none.
+std::string BreakIteratorLocale(const std::string& locales) {
+  const std::string::size_type end = locales.find(',');
+  std::string locale = locales.substr(0, end);
+  locale.erase(0, locale.find_first_not_of(' '));
+  locale.erase(locale.find_last_not_of(' ') + 1);
+  return locale.empty() ? "en" : locale;
+}
+}  // namespace
+
+std::vector<Token> FeatureProcessor::Tokenize(
+    const UnicodeText& text_unicode, const std::string& locales) const {
   if (options_->tokenization_type() ==
       FeatureProcessorOptions_::TokenizationType_INTERNAL_TOKENIZER) {
     return tokenizer_.Tokenize(text_unicode);
@@ -190,7 +208,7 @@ std::vector<Token> FeatureProcessor::Tokenize(
              options_->tokenization_type() ==
                  FeatureProcessorOptions_::TokenizationType_MIXED) {
     std::vector<Token> result;
-    if (!ICUTokenize(text_unicode, &result)) {
+    if (!ICUTokenize(text_unicode, BreakIteratorLocale(locales), &result)) {
       return {};
     }
     if (options_->tokenization_type() ==
@@ -205,6 +223,19 @@ std::vector<Token> FeatureProcessor::Tokenize(
   }
 }
 
+void FeatureProcessor::Tokenize(const UnicodeText& text_unicode,
+                                const std::string& locales,
+                                TokenSequence* result) const {
+  if (options_->tokenization_type() ==
+      FeatureProcessorOptions_::TokenizationType_INTERNAL_TOKENIZER) {
+    tokenizer_.Tokenize(text_unicode, result);
+    return;
+  }
+  for (const Token& token : Tokenize(text_unicode, locales)) {
+    result->Add(token.value, token.start, token.end);
+  }
+}
+
 bool FeatureProcessor::LabelToSpan(
     const int label, const VectorSpan<Token>& tokens,
     std::pair<CodepointIndex, CodepointIndex>* span) const {
@@ -331,12 +362,13 @@ bool FeatureProcessor::SpanToLabel(
 }
 
 int FeatureProcessor::TokenSpanToLabel(const TokenSpan& span) const {
-  auto it = selection_to_label_.find(span);
-  if (it != selection_to_label_.end()) {
-    return it->second;
-  } else {
+  const int max_selection_span = options_->max_selection_span();
+  if (span.first < 0 || span.first > max_selection_span || span.second < 0 ||
+      span.second > max_selection_span) {
     return kInvalidLabel;
   }
+  return selection_to_label_[span.first * (max_selection_span + 1) +
+                             span.second];
 }
 
 TokenSpan CodepointSpanToTokenSpan(const std::vector<Token>& selectable_tokens,
@@ -484,28 +516,86 @@ bool FeatureProcessor::SelectionLabelSpans(
 void FeatureProcessor::PrepareCodepointRanges(
     const std::vector<const FeatureProcessorOptions_::CodepointRange*>&
         codepoint_ranges,
-    std::vector<CodepointRange>* prepared_codepoint_ranges) {
-  prepared_codepoint_ranges->clear();
-  prepared_codepoint_ranges->reserve(codepoint_ranges.size());
+    CodepointSet* prepared_codepoint_ranges) {
   for (const FeatureProcessorOptions_::CodepointRange* range :
        codepoint_ranges) {
-    prepared_codepoint_ranges->push_back(
-        CodepointRange(range->start(), range->end()));
+    prepared_codepoint_ranges->AddRange(range->start(), range->end());
   }
-
-  std::sort(prepared_codepoint_ranges->begin(),
-            prepared_codepoint_ranges->end(),
-            [](const CodepointRange& a, const CodepointRange& b) {
-              return a.start < b.start;
-            });
 }
 
 void FeatureProcessor::PrepareIgnoredSpanBoundaryCodepoints() {
   if (options_->ignored_span_boundary_codepoints() != nullptr) {
     for (const int codepoint : *options_->ignored_span_boundary_codepoints()) {
-      ignored_span_boundary_codepoints_.insert(codepoint);
+      ignored_span_boundary_codepoints_.Add(codepoint);
+    }
+  }
+}
+
+void FeatureProcessor::PrepareDiscardedCodepoints() {
+  if (options_->tokenization_codepoint_config() != nullptr) {
+    for (const TokenizationCodepointRange* range :
+         *options_->tokenization_codepoint_config()) {
+      if (range->role() & TokenizationCodepointRange_::Role_DISCARD_CODEPOINT) {
+        discarded_codepoints_.AddRange(range->start(), range->end());
+      }
     }
   }
+  // Whitespace is only dropped as whole tokens, but counting it all as dropped
+  // keeps HasTooFewSupportedCodepoints() on the safe side.
+  discards_whitespace_ =
+      (options_->tokenization_type() ==
+           FeatureProcessorOptions_::TokenizationType_ICU ||
+       options_->tokenization_type() ==
+           FeatureProcessorOptions_::TokenizationType_MIXED) &&
+      !options_->icu_preserve_whitespace_tokens();
+}
+
+void FeatureProcessor::PreparePrecomputedEmbeddings() {
+  const FeatureProcessorOptions_::PrecomputedEmbeddings* table =
+      options_->precomputed_embeddings();
+  if (table == nullptr || table->tokens() == nullptr ||
+      table->embeddings() == nullptr || table->tokens()->size() == 0) {
+    return;
+  }
+  if (table->embeddings()->size() !=
+      table->tokens()->size() * options_->embedding_size()) {
+    TC_LOG(ERROR) << "Precomputed embeddings do not match the embedding size.";
+    return;
+  }
+  for (int i = 1; i < table->tokens()->size(); ++i) {
+    if (!((*table->tokens())[i - 1]->str() < (*table->tokens())[i]->str())) {
+      TC_LOG(ERROR) << "Precomputed embedding tokens are not sorted.";
+      return;
+    }
+  }
+  precomputed_embeddings_ = table;
+}
+
+const float* FeatureProcessor::FindPrecomputedEmbedding(
+    const std::string& token_value) const {
+  if (precomputed_embeddings_ == nullptr) {
+    return nullptr;
+  }
+  const flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>>&
+      tokens = *precomputed_embeddings_->tokens();
+  int begin = 0;
+  int end = tokens.size();
+  while (begin < end) {
+    const int middle = begin + (end - begin) / 2;
+    const flatbuffers::String* token = tokens[middle];
+    const int comparison =
+        token_value.compare(0, std::string::npos, token->c_str(),
+                            token->size());
+    if (comparison == 0) {
+      return precomputed_embeddings_->embeddings()->data() +
+             middle * options_->embedding_size();
+    } else if (comparison < 0) {
+      end = middle;
+    } else {
+      begin = middle + 1;
+    }
+  }
+  return nullptr;
 }
 
 int FeatureProcessor::CountIgnoredSpanBoundaryCodepoints(
@@ -534,8 +624,7 @@ int FeatureProcessor::CountIgnoredSpanBoundaryCodepoints(
 
   // Move until we encounter a non-ignored character.
   int num_ignored = 0;
-  while (ignored_span_boundary_codepoints_.find(*it) !=
-         ignored_span_boundary_codepoints_.end()) {
+  while (ignored_span_boundary_codepoints_.Contains(*it)) {
     ++num_ignored;
 
     if (it == it_last) {
@@ -595,11 +684,19 @@ CodepointSpan FeatureProcessor::StripBoundaryCodepoints(
   if (context_unicode.empty() || !ValidNonEmptySpan(span)) {
     return span;
   }
+  return StripBoundaryCodepoints(UnicodeTextIndex(context_unicode), span);
+}
 
-  UnicodeText::const_iterator span_begin = context_unicode.begin();
-  std::advance(span_begin, span.first);
-  UnicodeText::const_iterator span_end = context_unicode.begin();
-  std::advance(span_end, span.second);
+CodepointSpan FeatureProcessor::StripBoundaryCodepoints(
+    const UnicodeTextIndex& context_index, CodepointSpan span) const {
+  if (context_index.text().empty() || !ValidNonEmptySpan(span)) {
+    return span;
+  }
+
+  const UnicodeText::const_iterator span_begin =
+      context_index.IteratorAt(span.first);
+  const UnicodeText::const_iterator span_end =
+      context_index.IteratorAt(span.second);
 
   const int start_offset = CountIgnoredSpanBoundaryCodepoints(
       span_begin, span_end, /*count_from_beginning=*/true);
@@ -630,65 +727,60 @@ float FeatureProcessor::SupportedCodepointsRatio(
   return static_cast<float>(num_supported) / static_cast<float>(num_total);
 }
 
-bool FeatureProcessor::IsCodepointInRanges(
-    int codepoint, const std::vector<CodepointRange>& codepoint_ranges) const {
-  auto it = std::lower_bound(codepoint_ranges.begin(), codepoint_ranges.end(),
-                             codepoint,
-                             [](const CodepointRange& range, int codepoint) {
-                               // This function compares range with the
-                               // codepoint for the purpose of finding the first
-                               // greater or equal range. Because of the use of
-                               // std::lower_bound it needs to return true when
-                               // range < codepoint; the first time it will
-                               // return false the lower bound is found and
-                               // returned.
-                               //
-                               // It might seem weird that the condition is
-                               // range.end <= codepoint here but when codepoint
-                               // == range.end it means it's actually just
-                               // outside of the range, thus the range is less
-                               // than the codepoint.
-                               return range.end <= codepoint;
-                             });
-  if (it != codepoint_ranges.end() && it->start <= codepoint &&
-      it->end > codepoint) {
-    return true;
-  } else {
-    return false;
-  }
-}
-
 int FeatureProcessor::CollectionToLabel(const std::string& collection) const {
-  const auto it = collection_to_label_.find(collection);
-  if (it == collection_to_label_.end()) {
+  const auto it = std::lower_bound(
+      collection_to_label_.begin(), collection_to_label_.end(), collection,
+      [](const std::pair<std::string, int>& entry,
+         const std::string& collection) { return entry.first < collection; });
+  if (it == collection_to_label_.end() || it->first != collection) {
     return options_->default_collection();
   } else {
     return it->second;
   }
 }
 
-std::string FeatureProcessor::LabelToCollection(int label) const {
-  if (label >= 0 && label < collection_to_label_.size()) {
-    return (*options_->collections())[label]->str();
+const std::string& FeatureProcessor::LabelToCollection(int label) const {
+  if (label >= 0 && label < collections_.size()) {
+    return collections_[label];
   } else {
-    return GetDefaultCollection();
+    return default_collection_;
   }
 }
 
 void FeatureProcessor::MakeLabelMaps() {
   if (options_->collections() != nullptr) {
     for (int i = 0; i < options_->collections()->size(); ++i) {
-      collection_to_label_[(*options_->collections())[i]->str()] = i;
+      collections_.push_back((*options_->collections())[i]->str());
+      collection_to_label_.push_back({collections_.back(), i});
     }
+    // For duplicate names the last label wins.
+    std::sort(collection_to_label_.begin(), collection_to_label_.end());
+    int num_unique = 0;
+    for (int i = 0; i < collection_to_label_.size(); ++i) {
+      if (i + 1 < collection_to_label_.size() &&
+          collection_to_label_[i + 1].first == collection_to_label_[i].first) {
+        continue;
+      }
+      collection_to_label_[num_unique++] = collection_to_label_[i];
+    }
+    collection_to_label_.resize(num_unique);
+  }
+  const int default_label = options_->default_collection();
+  if (default_label >= 0 && default_label < collections_.size()) {
+    default_collection_ = collections_[default_label];
   }
 
+  const int max_selection_span = options_->max_selection_span();
+  const int num_span_sides = max_selection_span + 1;
+  selection_to_label_.assign(num_span_sides * num_span_sides, kInvalidLabel);
   int selection_label_id = 0;
-  for (int l = 0; l < (options_->max_selection_span() + 1); ++l) {
-    for (int r = 0; r < (options_->max_selection_span() + 1); ++r) {
+  for (int l = 0; l < (max_selection_span + 1); ++l) {
+    for (int r = 0; r < (max_selection_span + 1); ++r) {
       if (!options_->selection_reduced_output_space() ||
-          r + l <= options_->max_selection_span()) {
+          r + l <= max_selection_span) {
         TokenSpan token_span{l, r};
-        selection_to_label_[token_span] = selection_label_id;
+        selection_to_label_[l * (max_selection_span + 1) + r] =
+            selection_label_id;
         label_to_selection_.push_back(token_span);
         ++selection_label_id;
       }
@@ -721,16 +813,20 @@ void FeatureProcessor::RetokenizeAndFindClick(
     StripTokensFromOtherLines(context_unicode, input_span, tokens);
   }
 
-  int local_click_pos;
-  if (click_pos == nullptr) {
-    click_pos = &local_click_pos;
+  if (click_pos != nullptr) {
+    *click_pos = FindClick(input_span, *tokens);
   }
-  *click_pos = FindCenterToken(input_span, *tokens);
-  if (*click_pos == kInvalidIndex) {
+}
+
+int FeatureProcessor::FindClick(CodepointSpan input_span,
+                                const std::vector<Token>& tokens) const {
+  const int click_pos = FindCenterToken(input_span, tokens);
+  if (click_pos == kInvalidIndex) {
     // If the default click method failed, let's try to do sub-token matching
     // before we fail.
-    *click_pos = internal::CenterTokenFromClick(input_span, *tokens);
+    return internal::CenterTokenFromClick(input_span, tokens);
   }
+  return click_pos;
 }
 
 namespace internal {
@@ -785,25 +881,150 @@ bool FeatureProcessor::HasEnoughSupportedCodepoints(
   return true;
 }
 
+bool FeatureProcessor::HasTooFewSupportedCodepoints(
+    const std::string& text) const {
+  return HasTooFewSupportedCodepoints(
+      UTF8ToUnicodeText(text, /*do_copy=*/false));
+}
+
+bool FeatureProcessor::HasTooFewSupportedCodepoints(
+    const UnicodeText& text) const {
+  const float min_ratio = options_->min_supported_codepoint_ratio();
+  if (min_ratio <= 0) {
+    return false;
+  }
+
+  // The tokens have at most the supported codepoints of the text, and at
+  // least its unsupported ones that are never dropped. Dropping supported
+  // codepoints can only lower the ratio, so this bounds it from above.
+  int num_supported = 0;
+  int num_kept_unsupported = 0;
+  for (const char32 codepoint : text) {
+    if (IsCodepointInRanges(codepoint, supported_codepoint_ranges_)) {
+      ++num_supported;
+    } else if (!discarded_codepoints_.Contains(codepoint) &&
+               !(discards_whitespace_ && unilib_->IsWhitespace(codepoint))) {
+      ++num_kept_unsupported;
+    }
+  }
+  const int num_total = num_supported + num_kept_unsupported;
+  return num_total > 0 &&
+         static_cast<float>(num_supported) / static_cast<float>(num_total) <
+             min_ratio;
+}
+
 bool FeatureProcessor::ExtractFeatures(
     const std::vector<Token>& tokens, TokenSpan token_span,
     CodepointSpan selection_span_for_feature,
     const EmbeddingExecutor* embedding_executor,
     EmbeddingCache* embedding_cache, int feature_vector_size,
-    std::unique_ptr<CachedFeatures>* cached_features) const {
-  std::unique_ptr<std::vector<float>> features(new std::vector<float>());
+    std::unique_ptr<CachedFeatures>* cached_features, bool half_precision,
+    Executor* executor) const {
+  std::unique_ptr<std::vector<float>> features =
+      feature_buffer_pool_->Acquire();
+  if (executor != nullptr && embedding_cache == nullptr &&
+      TokenSpanSize(token_span) >= 2 * kMinTokensPerFeatureTask) {
+    if (!ExtractTokenFeaturesInParallel(
+            tokens, token_span, selection_span_for_feature, embedding_executor,
+            feature_vector_size, executor, features.get())) {
+      return false;
+    }
+  } else {
+    features->reserve(feature_vector_size * TokenSpanSize(token_span));
+    for (int i = token_span.first; i < token_span.second; ++i) {
+      if (!AppendTokenFeaturesWithCache(tokens[i], selection_span_for_feature,
+                                        embedding_executor, embedding_cache,
+                                        features.get())) {
+        TC_LOG(ERROR) << "Could not get token features.";
+        return false;
+      }
+    }
+  }
+  return CreateCachedFeatures(token_span, selection_span_for_feature,
+                              embedding_executor, embedding_cache,
+                              feature_vector_size, std::move(features),
+                              half_precision, cached_features);
+}
+
+bool FeatureProcessor::ExtractFeatures(
+    const TokenSequenceView& tokens, TokenSpan token_span,
+    CodepointSpan selection_span_for_feature,
+    const EmbeddingExecutor* embedding_executor,
+    EmbeddingCache* embedding_cache, int feature_vector_size,
+    std::unique_ptr<CachedFeatures>* cached_features,
+    bool half_precision) const {
+  std::unique_ptr<std::vector<float>> features =
+      feature_buffer_pool_->Acquire();
   features->reserve(feature_vector_size * TokenSpanSize(token_span));
+  Token token;
   for (int i = token_span.first; i < token_span.second; ++i) {
-    if (!AppendTokenFeaturesWithCache(tokens[i], selection_span_for_feature,
+    tokens.GetToken(i, &token);
+    if (!AppendTokenFeaturesWithCache(token, selection_span_for_feature,
                                       embedding_executor, embedding_cache,
                                       features.get())) {
       TC_LOG(ERROR) << "Could not get token features.";
       return false;
     }
   }
+  return CreateCachedFeatures(token_span, selection_span_for_feature,
+                              embedding_executor, embedding_cache,
+                              feature_vector_size, std::move(features),
+                              half_precision, cached_features);
+}
 
-  std::unique_ptr<std::vector<float>> padding_features(
-      new std::vector<float>());
+bool FeatureProcessor::ExtractTokenFeaturesInParallel(
+    const std::vector<Token>& tokens, TokenSpan token_span,
+    CodepointSpan selection_span_for_feature,
+    const EmbeddingExecutor* embedding_executor, int feature_vector_size,
+    Executor* executor, std::vector<float>* features) const {
+  const int num_tokens = TokenSpanSize(token_span);
+  int num_tasks = num_tokens / kMinTokensPerFeatureTask;
+  if (num_tasks > kMaxFeatureTasks) {
+    num_tasks = kMaxFeatureTasks;
+  }
+  features->resize(num_tokens * feature_vector_size);
+
+  // Each task extracts the features of a token into its own buffer, and then
+  // copies them to the row of the token, which no other task writes.
+  std::vector<char> succeeded(num_tasks, true);
+  RunInParallel(executor, num_tasks, [&](int task) {
+    const int begin = token_span.first + num_tokens * task / num_tasks;
+    const int end = token_span.first + num_tokens * (task + 1) / num_tasks;
+    const VectorPool<float>::ScopedVector token_features =
+        feature_buffer_pool_->AcquireScoped();
+    token_features->reserve(feature_vector_size);
+    for (int i = begin; i < end; ++i) {
+      token_features->clear();
+      if (!AppendTokenFeaturesWithCache(tokens[i], selection_span_for_feature,
+                                        embedding_executor,
+                                        /*embedding_cache=*/nullptr,
+                                        token_features.get()) ||
+          token_features->size() != feature_vector_size) {
+        succeeded[task] = false;
+        return;
+      }
+      std::copy(token_features->begin(), token_features->end(),
+                features->data() +
+                    (i - token_span.first) * feature_vector_size);
+    }
+  });
+  for (const char task_succeeded : succeeded) {
+    if (!task_succeeded) {
+      TC_LOG(ERROR) << "Could not get token features.";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool FeatureProcessor::CreateCachedFeatures(
+    TokenSpan token_span, CodepointSpan selection_span_for_feature,
+    const EmbeddingExecutor* embedding_executor,
+    EmbeddingCache* embedding_cache, int feature_vector_size,
+    std::unique_ptr<std::vector<float>> features, bool half_precision,
+    std::unique_ptr<CachedFeatures>* cached_features) const {
+  std::unique_ptr<std::vector<float>> padding_features =
+      feature_buffer_pool_->Acquire();
   padding_features->reserve(feature_vector_size);
   if (!AppendTokenFeaturesWithCache(Token(), selection_span_for_feature,
                                     embedding_executor, embedding_cache,
@@ -812,9 +1033,9 @@ bool FeatureProcessor::ExtractFeatures(
     return false;
   }
 
-  *cached_features = CachedFeatures::Create(token_span, std::move(features),
-                                            std::move(padding_features),
-                                            options_, feature_vector_size);
+  *cached_features = CachedFeatures::Create(
+      token_span, std::move(features), std::move(padding_features), options_,
+      feature_vector_size, feature_buffer_pool_.get(), half_precision);
   if (!*cached_features) {
     TC_LOG(ERROR) << "Cound not create cached features.";
     return false;
@@ -824,9 +1045,10 @@ bool FeatureProcessor::ExtractFeatures(
 }
 
 bool FeatureProcessor::ICUTokenize(const UnicodeText& context_unicode,
+                                   const std::string& locale,
                                    std::vector<Token>* result) const {
   std::unique_ptr<UniLib::BreakIterator> break_iterator =
-      unilib_->CreateBreakIterator(context_unicode);
+      unilib_->CreateBreakIterator(context_unicode, locale);
   if (!break_iterator) {
     return false;
   }
@@ -930,54 +1152,105 @@ void FeatureProcessor::TokenizeSubstring(const UnicodeText& unicode_text,
   }
 }
 
+bool FeatureProcessor::EmbedToken(const Token& token,
+                                  const EmbeddingExecutor* embedding_executor,
+                                  float* embedding) const {
+  // Extract the sparse features, into a stack buffer unless the token has
+  // unusually many of them.
+  const int max_sparse_features =
+      feature_extractor_.MaxCharactergramFeatures(token);
+  int stack_sparse_features[kMaxStackSparseFeatures];
+  std::vector<int> heap_sparse_features;
+  int* sparse_features = stack_sparse_features;
+  if (max_sparse_features > kMaxStackSparseFeatures) {
+    heap_sparse_features.resize(max_sparse_features);
+    sparse_features = heap_sparse_features.data();
+  }
+  const int num_sparse_features =
+      feature_extractor_.ExtractCharactergramFeatures(token, sparse_features,
+                                                      max_sparse_features);
+
+  const int embedding_size = EmbeddingSize();
+  std::fill(embedding, embedding + embedding_size, 0.0f);
+  return embedding_executor->AddEmbedding(
+      TensorView<int>(sparse_features, {num_sparse_features}),
+      /*dest=*/embedding,
+      /*dest_size=*/embedding_size);
+}
+
 bool FeatureProcessor::AppendTokenFeaturesWithCache(
     const Token& token, CodepointSpan selection_span_for_feature,
     const EmbeddingExecutor* embedding_executor,
     EmbeddingCache* embedding_cache,
     std::vector<float>* output_features) const {
+  const bool is_in_span = token.IsContainedInSpan(selection_span_for_feature);
+
+  // The cross-call cache holds the complete features of the token, so on a hit
+  // no feature extraction or embedding is needed.
+  const bool use_token_feature_cache = token_feature_cache_->IsEnabled();
+  if (use_token_feature_cache &&
+      token_feature_cache_->Lookup(token, is_in_span, output_features)) {
+    return true;
+  }
+
+  // Frequent tokens can have their embedding stored in the model.
+  const float* precomputed_embedding =
+      token.is_padding ? nullptr : FindPrecomputedEmbedding(token.value);
+  if (precomputed_embedding != nullptr) {
+    const int embedding_size = EmbeddingSize();
+    const int dense_features_count = DenseFeaturesCount();
+    output_features->resize(output_features->size() + embedding_size +
+                            dense_features_count);
+    float* embedding_output = output_features->data() +
+                              output_features->size() - embedding_size -
+                              dense_features_count;
+    std::copy(precomputed_embedding, precomputed_embedding + embedding_size,
+              embedding_output);
+    feature_extractor_.ExtractDenseFeatures(token, is_in_span,
+                                            embedding_output + embedding_size);
+    if (use_token_feature_cache) {
+      token_feature_cache_->Insert(
+          token, is_in_span,
+          output_features->data() + output_features->size() -
+              token_feature_cache_->features_size());
+    }
+    return true;
+  }
+
   // Look for the embedded features for the token in the cache, if there is one.
   if (embedding_cache) {
-    const auto it = embedding_cache->find({token.start, token.end});
-    if (it != embedding_cache->end()) {
-      // The embedded features were found in the cache, extract only the dense
-      // features.
-      std::vector<float> dense_features;
-      if (!feature_extractor_.Extract(
-              token, token.IsContainedInSpan(selection_span_for_feature),
-              /*sparse_features=*/nullptr, &dense_features)) {
-        TC_LOG(ERROR) << "Could not extract token's dense features.";
-        return false;
+    const float* cached_embedding =
+        embedding_cache->Find({token.start, token.end});
+    if (cached_embedding != nullptr) {
+      // The embedded features were found in the cache, append them and
+      // extract only the dense features, in place after them.
+      output_features->insert(output_features->end(), cached_embedding,
+                              cached_embedding + EmbeddingSize());
+      const int dense_features_count = DenseFeaturesCount();
+      output_features->resize(output_features->size() + dense_features_count);
+      feature_extractor_.ExtractDenseFeatures(
+          token, is_in_span,
+          output_features->data() + output_features->size() -
+              dense_features_count);
+      if (use_token_feature_cache) {
+        token_feature_cache_->Insert(
+            token, is_in_span,
+            output_features->data() + output_features->size() -
+                token_feature_cache_->features_size());
       }
-
-      // Append both embedded and dense features to the output and return.
-      output_features->insert(output_features->end(), it->second.begin(),
-                              it->second.end());
-      output_features->insert(output_features->end(), dense_features.begin(),
-                              dense_features.end());
       return true;
     }
   }
 
-  // Extract the sparse and dense features.
-  std::vector<int> sparse_features;
-  std::vector<float> dense_features;
-  if (!feature_extractor_.Extract(
-          token, token.IsContainedInSpan(selection_span_for_feature),
-          &sparse_features, &dense_features)) {
-    TC_LOG(ERROR) << "Could not extract token's features.";
-    return false;
-  }
-
-  // Embed the sparse features, appending them directly to the output.
+  // The row of the token in the output holds the embedded sparse features
+  // followed by the dense features, both written to it directly.
   const int embedding_size = GetOptions()->embedding_size();
-  output_features->resize(output_features->size() + embedding_size);
-  float* output_features_end =
-      output_features->data() + output_features->size();
-  if (!embedding_executor->AddEmbedding(
-          TensorView<int>(sparse_features.data(),
-                          {static_cast<int>(sparse_features.size())}),
-          /*dest=*/output_features_end - embedding_size,
-          /*dest_size=*/embedding_size)) {
+  const int dense_features_count = DenseFeaturesCount();
+  output_features->resize(output_features->size() + embedding_size +
+                          dense_features_count);
+  float* embedding_output = output_features->data() + output_features->size() -
+                            embedding_size - dense_features_count;
+  if (!EmbedToken(token, embedding_executor, embedding_output)) {
     TC_LOG(ERROR) << "Cound not embed token's sparse features.";
     return false;
   }
@@ -985,14 +1258,39 @@ bool FeatureProcessor::AppendTokenFeaturesWithCache(
   // If there is a cache, the embedded features for the token were not in it,
   // so insert them.
   if (embedding_cache) {
-    (*embedding_cache)[{token.start, token.end}] = std::vector<float>(
-        output_features_end - embedding_size, output_features_end);
+    embedding_cache->Insert({token.start, token.end}, embedding_output,
+                            embedding_size);
   }
 
-  // Append the dense features to the output.
-  output_features->insert(output_features->end(), dense_features.begin(),
-                          dense_features.end());
+  feature_extractor_.ExtractDenseFeatures(token, is_in_span,
+                                          embedding_output + embedding_size);
+
+  if (use_token_feature_cache) {
+    token_feature_cache_->Insert(
+        token, is_in_span,
+        output_features->data() + output_features->size() -
+            token_feature_cache_->features_size());
+  }
   return true;
 }
 
+int64 FeatureProcessor::EstimateHeapBytes() const {
+  int64 result = feature_extractor_.EstimateHeapBytes() +
+                 supported_codepoint_ranges_.EstimateHeapBytes() +
+                 internal_tokenizer_codepoint_ranges_.EstimateHeapBytes() +
+                 ignored_span_boundary_codepoints_.EstimateHeapBytes() +
+                 VectorHeapBytes(selection_to_label_) +
+                 VectorHeapBytes(label_to_selection_) +
+                 StringsHeapBytes(collections_) +
+                 VectorHeapBytes(collection_to_label_) +
+                 StringHeapBytes(default_collection_);
+  for (const std::pair<std::string, int>& collection : collection_to_label_) {
+    result += StringHeapBytes(collection.first);
+  }
+  if (token_feature_cache_ != nullptr) {
+    result += token_feature_cache_->EstimateHeapBytes();
+  }
+  return result;
+}
+
 }  // namespace libtextclassifier2
@@ -19,19 +19,23 @@
 #ifndef LIBTEXTCLASSIFIER_FEATURE_PROCESSOR_H_
 #define LIBTEXTCLASSIFIER_FEATURE_PROCESSOR_H_
 
-#include <map>
 #include <memory>
-#include <set>
 #include <string>
 #include <vector>
 
 #include "cached-features.h"
+#include "codepoint-set.h"
+#include "embedding-cache.h"
 #include "model_generated.h"
+#include "token-feature-cache.h"
 #include "token-feature-extractor.h"
+#include "token-sequence.h"
 #include "tokenizer.h"
 #include "types.h"
 #include "util/base/integral_types.h"
 #include "util/base/logging.h"
+#include "util/memory/vector-pool.h"
+#include "util/thread/executor.h"
 #include "util/utf8/unicodetext.h"
 #include "util/utf8/unilib.h"
 
@@ -91,7 +95,7 @@ class FeatureProcessor {
   // same context (the same codepoint spans corresponding to the same tokens),
   // as an optimization. Note that the tokenizations do not have to be
   // identical.
-  typedef std::map<CodepointSpan, std::vector<float>> EmbeddingCache;
+  typedef ::libtextclassifier2::EmbeddingCache EmbeddingCache;
 
   // If unilib is nullptr, will create and own an instance of a UniLib,
   // otherwise will use what's passed in.
@@ -107,7 +111,12 @@ class FeatureProcessor {
                 ? Tokenizer({options->tokenization_codepoint_config()->begin(),
                              options->tokenization_codepoint_config()->end()},
                             options->tokenize_on_script_change())
-                : Tokenizer({}, /*split_on_script_change=*/false)) {
+                : Tokenizer({}, /*split_on_script_change=*/false)),
+        token_feature_cache_(new TokenFeatureCache(
+            options->embedding_size() +
+            feature_extractor_.DenseFeaturesCount())),
+        feature_buffer_pool_(
+            new VectorPool<float>(kMaxPooledFeatureBuffers)) {
     MakeLabelMaps();
     if (options->supported_codepoint_ranges() != nullptr) {
       PrepareCodepointRanges({options->supported_codepoint_ranges()->begin(),
@@ -121,6 +130,8 @@ class FeatureProcessor {
           &internal_tokenizer_codepoint_ranges_);
     }
     PrepareIgnoredSpanBoundaryCodepoints();
+    PrepareDiscardedCodepoints();
+    PreparePrecomputedEmbeddings();
   }
 
   // Tokenizes the input string using the selected tokenization method.
@@ -129,17 +140,28 @@ class FeatureProcessor {
   // Same as above but takes UnicodeText.
   std::vector<Token> Tokenize(const UnicodeText& text_unicode) const;
 
+  // Same as above, but the ICU tokenization follows the rules of the first of
+  // the given comma-separated locales (BCP 47 tags) instead of those of "en".
+  std::vector<Token> Tokenize(const UnicodeText& text_unicode,
+                              const std::string& locales) const;
+
+  // Same as above, but appends the tokens to a TokenSequence. With the
+  // internal tokenizer, the values are stored without allocating per token.
+  void Tokenize(const UnicodeText& text_unicode, const std::string& locales,
+                TokenSequence* result) const;
+
   // Converts a label into a token span.
   bool LabelToTokenSpan(int label, TokenSpan* token_span) const;
 
   // Gets the total number of selection labels.
   int GetSelectionLabelCount() const { return label_to_selection_.size(); }
 
-  // Gets the string value for given collection label.
-  std::string LabelToCollection(int label) const;
+  // Gets the string value for given collection label. The names are interned
+  // once, so the returned reference stays valid as long as the processor.
+  const std::string& LabelToCollection(int label) const;
 
   // Gets the total number of collections of the model.
-  int NumCollections() const { return collection_to_label_.size(); }
+  int NumCollections() const { return collections_.size(); }
 
   // Gets the name of the default collection.
   std::string GetDefaultCollection() const;
@@ -159,18 +181,49 @@ class FeatureProcessor {
                               bool only_use_line_with_click,
                               std::vector<Token>* tokens, int* click_pos) const;
 
+  // Finds the click position of 'input_span' in 'tokens' the same way as
+  // RetokenizeAndFindClick, but for tokens that need no retokenization.
+  int FindClick(CodepointSpan input_span,
+                const std::vector<Token>& tokens) const;
+
   // Returns true if the token span has enough supported codepoints (as defined
   // in the model config) or not and model should not run.
   bool HasEnoughSupportedCodepoints(const std::vector<Token>& tokens,
                                     TokenSpan token_span) const;
 
+  // Returns true if HasEnoughSupportedCodepoints() would fail on all the tokens
+  // of the text, however it gets tokenized: even if the tokenization dropped
+  // every unsupported codepoint that it can drop. Decides with one scan of the
+  // UTF-8, without tokenizing or allocating, so that text in unsupported
+  // scripts can be skipped before the tokenization.
+  bool HasTooFewSupportedCodepoints(const std::string& text) const;
+
+  // Same as above but takes UnicodeText.
+  bool HasTooFewSupportedCodepoints(const UnicodeText& text) const;
+
   // Extracts features as a CachedFeatures object that can be used for repeated
-  // inference over token spans in the given context.
+  // inference over token spans in the given context. If 'half_precision' is
+  // true, the CachedFeatures keep them in bfloat16, see CachedFeatures::Create.
+  // If 'executor' is set and there is no 'embedding_cache', which is not
+  // thread-safe, long spans are split into chunks of tokens whose features
+  // are extracted in parallel on it, each into its own rows. The features are
+  // the same either way.
   bool ExtractFeatures(const std::vector<Token>& tokens, TokenSpan token_span,
                        CodepointSpan selection_span_for_feature,
                        const EmbeddingExecutor* embedding_executor,
                        EmbeddingCache* embedding_cache, int feature_vector_size,
-                       std::unique_ptr<CachedFeatures>* cached_features) const;
+                       std::unique_ptr<CachedFeatures>* cached_features,
+                       bool half_precision = false,
+                       Executor* executor = nullptr) const;
+
+  // Same as above, but for a view of a TokenSequence. The tokens are extracted
+  // one after another into the same Token, without copying the view.
+  bool ExtractFeatures(const TokenSequenceView& tokens, TokenSpan token_span,
+                       CodepointSpan selection_span_for_feature,
+                       const EmbeddingExecutor* embedding_executor,
+                       EmbeddingCache* embedding_cache, int feature_vector_size,
+                       std::unique_ptr<CachedFeatures>* cached_features,
+                       bool half_precision = false) const;
 
   // Fills selection_label_spans with CodepointSpans that correspond to the
   // selection labels. The CodepointSpans are based on the codepoint ranges of
@@ -185,6 +238,29 @@ class FeatureProcessor {
 
   int EmbeddingSize() const { return options_->embedding_size(); }
 
+  // Writes the EmbeddingSize() values of the embedding of the charactergram
+  // features of the token to 'embedding'. Does not use the precomputed
+  // embeddings of the model, so that they can be computed with it.
+  bool EmbedToken(const Token& token,
+                  const EmbeddingExecutor* embedding_executor,
+                  float* embedding) const;
+
+  // Returns the precomputed embedding of the token value from the model, or
+  // nullptr if it has none.
+  const float* FindPrecomputedEmbedding(const std::string& token_value) const;
+
+  // Returns the pool of float buffers that back the CachedFeatures created by
+  // ExtractFeatures(), and that can be used for other scratch feature vectors.
+  VectorPool<float>* GetFeatureBufferPool() const {
+    return feature_buffer_pool_.get();
+  }
+
+  // Returns the cross-call cache of token features used by ExtractFeatures().
+  // It is disabled by default; enable it with TokenFeatureCache::Reset().
+  TokenFeatureCache* GetTokenFeatureCache() const {
+    return token_feature_cache_.get();
+  }
+
   // Splits context to several segments.
   std::vector<UnicodeTextRange> SplitContext(
       const UnicodeText& context_unicode) const;
@@ -199,16 +275,19 @@ class FeatureProcessor {
   CodepointSpan StripBoundaryCodepoints(const UnicodeText& context_unicode,
                                         CodepointSpan span) const;
 
- protected:
-  // Represents a codepoint range [start, end).
-  struct CodepointRange {
-    int32 start;
-    int32 end;
+  // Same as above but takes an index of the context, for callers stripping
+  // many spans of the same context.
+  CodepointSpan StripBoundaryCodepoints(const UnicodeTextIndex& context_index,
+                                        CodepointSpan span) const;
 
-    CodepointRange(int32 arg_start, int32 arg_end)
-        : start(arg_start), end(arg_end) {}
-  };
+  // Returns an estimate of the heap memory held, in bytes, without the
+  // tokenizer, which EstimateTokenizerHeapBytes() reports.
+  int64 EstimateHeapBytes() const;
+  int64 EstimateTokenizerHeapBytes() const {
+    return tokenizer_.EstimateHeapBytes();
+  }
 
+ protected:
   // Returns the class id corresponding to the given string collection
   // identifier. There is a catch-all class id that the function returns for
   // unknown collections.
@@ -239,20 +318,27 @@ class FeatureProcessor {
   void PrepareCodepointRanges(
       const std::vector<const FeatureProcessorOptions_::CodepointRange*>&
           codepoint_ranges,
-      std::vector<CodepointRange>* prepared_codepoint_ranges);
+      CodepointSet* prepared_codepoint_ranges);
 
   // Returns the ratio of supported codepoints to total number of codepoints in
   // the given token span.
   float SupportedCodepointsRatio(const TokenSpan& token_span,
                                  const std::vector<Token>& tokens) const;
 
-  // Returns true if given codepoint is covered by the given sorted vector of
-  // codepoint ranges.
-  bool IsCodepointInRanges(
-      int codepoint, const std::vector<CodepointRange>& codepoint_ranges) const;
+  // Returns true if given codepoint is covered by the given codepoint ranges.
+  bool IsCodepointInRanges(int codepoint,
+                           const CodepointSet& codepoint_ranges) const {
+    return codepoint_ranges.Contains(codepoint);
+  }
 
   void PrepareIgnoredSpanBoundaryCodepoints();
 
+  // Fills discarded_codepoints_ and discards_whitespace_.
+  void PrepareDiscardedCodepoints();
+
+  // Sets precomputed_embeddings_ if the model has a valid table of them.
+  void PreparePrecomputedEmbeddings();
+
   // Counts the number of span boundary codepoints. If count_from_beginning is
   // True, the counting will start at the span_start iterator (inclusive) and at
   // maximum end at span_end (exclusive). If count_from_beginning is True, the
@@ -268,8 +354,10 @@ class FeatureProcessor {
   int FindCenterToken(CodepointSpan span,
                       const std::vector<Token>& tokens) const;
 
-  // Tokenizes the input text using ICU tokenizer.
+  // Tokenizes the input text using ICU tokenizer, with the rules of the given
+  // ICU locale.
   bool ICUTokenize(const UnicodeText& context_unicode,
+                   const std::string& locale,
                    std::vector<Token>* result) const;
 
   // Takes the result of ICU tokenization and retokenizes stretches of tokens
@@ -302,6 +390,24 @@ class FeatureProcessor {
                                     EmbeddingCache* embedding_cache,
                                     std::vector<float>* output_features) const;
 
+  // Fills 'features' with the features of the tokens in 'token_span', one row
+  // of 'feature_vector_size' floats per token, extracted on 'executor' in
+  // chunks of at least kMinTokensPerFeatureTask tokens.
+  bool ExtractTokenFeaturesInParallel(
+      const std::vector<Token>& tokens, TokenSpan token_span,
+      CodepointSpan selection_span_for_feature,
+      const EmbeddingExecutor* embedding_executor, int feature_vector_size,
+      Executor* executor, std::vector<float>* features) const;
+
+  // Finishes ExtractFeatures(): adds the features of the padding token to the
+  // extracted 'features' of the tokens in 'token_span'.
+  bool CreateCachedFeatures(
+      TokenSpan token_span, CodepointSpan selection_span_for_feature,
+      const EmbeddingExecutor* embedding_executor,
+      EmbeddingCache* embedding_cache, int feature_vector_size,
+      std::unique_ptr<std::vector<float>> features, bool half_precision,
+      std::unique_ptr<CachedFeatures>* cached_features) const;
+
  private:
   std::unique_ptr<UniLib> owned_unilib_;
   const UniLib* unilib_;
@@ -310,30 +416,61 @@ class FeatureProcessor {
   const TokenFeatureExtractor feature_extractor_;
 
   // Codepoint ranges that define what codepoints are supported by the model.
-  // NOTE: Must be sorted.
-  std::vector<CodepointRange> supported_codepoint_ranges_;
+  CodepointSet supported_codepoint_ranges_;
 
   // Codepoint ranges that define which tokens (consisting of which codepoints)
   // should be re-tokenized with the internal tokenizer in the mixed
   // tokenization mode.
-  // NOTE: Must be sorted.
-  std::vector<CodepointRange> internal_tokenizer_codepoint_ranges_;
+  CodepointSet internal_tokenizer_codepoint_ranges_;
 
  private:
   // Set of codepoints that will be stripped from beginning and end of
   // predicted spans.
-  std::set<int32> ignored_span_boundary_codepoints_;
+  CodepointSet ignored_span_boundary_codepoints_;
+
+  // The codepoints that the internal tokenizer drops, and whether the ICU
+  // tokenization drops whitespace.
+  CodepointSet discarded_codepoints_;
+  bool discards_whitespace_ = false;
 
   const FeatureProcessorOptions* const options_;
 
-  // Mapping between token selection spans and labels ids.
-  std::map<TokenSpan, int> selection_to_label_;
+  // The embeddings of frequent tokens from the model, or nullptr.
+  const FeatureProcessorOptions_::PrecomputedEmbeddings*
+      precomputed_embeddings_ = nullptr;
+
+  // Mapping between token selection spans and labels ids. The label of the
+  // span {l, r} is at l * (max_selection_span + 1) + r, or kInvalidLabel.
+  std::vector<int> selection_to_label_;
   std::vector<TokenSpan> label_to_selection_;
 
-  // Mapping between collections and labels.
-  std::map<std::string, int> collection_to_label_;
+  // The collection names by label, and the labels sorted by collection name.
+  std::vector<std::string> collections_;
+  std::vector<std::pair<std::string, int>> collection_to_label_;
+
+  // The name of the default collection, or an empty string if it is invalid.
+  std::string default_collection_;
 
   Tokenizer tokenizer_;
+
+  // Cache of token features shared by all calls. Owned by the processor, but
+  // internally synchronized, so it can be used from const methods.
+  std::unique_ptr<TokenFeatureCache> token_feature_cache_;
+
+  // Maximum number of idle buffers kept in feature_buffer_pool_.
+  static const int kMaxPooledFeatureBuffers = 16;
+
+  // Number of sparse features of a token that are extracted into a stack
+  // buffer; tokens with more use a heap one.
+  static const int kMaxStackSparseFeatures = 256;
+
+  // Spans shorter than two chunks of this many tokens are not worth splitting
+  // across threads, and no more than kMaxFeatureTasks chunks are made.
+  static const int kMinTokensPerFeatureTask = 128;
+  static const int kMaxFeatureTasks = 64;
+
+  // Reusable feature buffers, internally synchronized like the cache above.
+  std::unique_ptr<VectorPool<float>> feature_buffer_pool_;
 };
 
 }  // namespace libtextclassifier2
@@ -18,6 +18,8 @@
 
 #include "model-executor.h"
 #include "tensor-view.h"
+#include "util/strings/numbers.h"
+#include "util/thread/thread-pool.h"
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -619,6 +621,50 @@ TEST(FeatureProcessorTest, SupportedCodepointsRatio) {
       tokens, /*token_span=*/{0, 3}));
 }
 
+TEST(FeatureProcessorTest, HasTooFewSupportedCodepoints) {
+  CREATE_UNILIB_FOR_TESTING;
+  FeatureProcessorOptionsT options;
+  options.tokenization_codepoint_config.emplace_back(
+      new TokenizationCodepointRangeT());
+  auto& config = options.tokenization_codepoint_config.back();
+  config->start = 32;
+  config->end = 33;
+  config->role = TokenizationCodepointRange_::Role_WHITESPACE_SEPARATOR;
+  options.supported_codepoint_ranges.emplace_back(
+      new FeatureProcessorOptions_::CodepointRangeT());
+  options.supported_codepoint_ranges.back()->start = 0;
+  options.supported_codepoint_ranges.back()->end = 128;
+
+  // Without a minimum ratio, nothing is rejected.
+  flatbuffers::DetachedBuffer options_fb = PackFeatureProcessorOptions(options);
+  TestingFeatureProcessor feature_processor(
+      flatbuffers::GetRoot<FeatureProcessorOptions>(options_fb.data()),
+      &unilib);
+  EXPECT_FALSE(feature_processor.HasTooFewSupportedCodepoints("ěěě řřř"));
+
+  options.min_supported_codepoint_ratio = 0.5;
+  flatbuffers::DetachedBuffer options2_fb =
+      PackFeatureProcessorOptions(options);
+  TestingFeatureProcessor feature_processor2(
+      flatbuffers::GetRoot<FeatureProcessorOptions>(options2_fb.data()),
+      &unilib);
+  EXPECT_TRUE(feature_processor2.HasTooFewSupportedCodepoints("ěěě řřř ěěě"));
+  EXPECT_TRUE(feature_processor2.HasTooFewSupportedCodepoints("ěěě řřř eee"));
+  EXPECT_FALSE(feature_processor2.HasTooFewSupportedCodepoints("aaa bbb ěěě"));
+  EXPECT_FALSE(feature_processor2.HasTooFewSupportedCodepoints(""));
+
+  // It never rejects a text whose tokens have enough supported codepoints.
+  for (const std::string& text :
+       {"aaa bbb ěěě", "ěě aaaa", "a ě a ě a", "ě", "a", "ě    aaa"}) {
+    const std::vector<Token> tokens = feature_processor2.Tokenize(text);
+    if (feature_processor2.HasEnoughSupportedCodepoints(
+            tokens, /*token_span=*/{0, tokens.size()})) {
+      EXPECT_FALSE(feature_processor2.HasTooFewSupportedCodepoints(text))
+          << text;
+    }
+  }
+}
+
 TEST(FeatureProcessorTest, InSpanFeature) {
   FeatureProcessorOptionsT options;
   options.context_size = 2;
@@ -656,6 +702,102 @@ TEST(FeatureProcessorTest, InSpanFeature) {
   EXPECT_THAT(features[24], FloatEq(0.0));
 }
 
+TEST(FeatureProcessorTest, ExtractFeaturesFromTokenSequence) {
+  FeatureProcessorOptionsT options;
+  options.context_size = 2;
+  options.max_selection_span = 2;
+  options.snap_label_span_boundaries_to_containing_tokens = false;
+  options.feature_version = 2;
+  options.embedding_size = 4;
+  options.extract_selection_mask_feature = true;
+
+  flatbuffers::DetachedBuffer options_fb = PackFeatureProcessorOptions(options);
+  CREATE_UNILIB_FOR_TESTING;
+  TestingFeatureProcessor feature_processor(
+      flatbuffers::GetRoot<FeatureProcessorOptions>(options_fb.data()),
+      &unilib);
+
+  FakeEmbeddingExecutor embedding_executor;
+
+  const std::vector<Token> tokens = {Token(), Token("aaa", 0, 3),
+                                     Token("bbb", 4, 7), Token("ccc", 8, 11),
+                                     Token()};
+  const TokenSequence sequence(
+      std::vector<Token>(tokens.begin() + 1, tokens.end() - 1));
+  const TokenSequenceView view(&sequence, -1, 4);
+
+  std::unique_ptr<CachedFeatures> cached_features;
+  EXPECT_TRUE(feature_processor.ExtractFeatures(
+      tokens, /*token_span=*/{0, 5},
+      /*selection_span_for_feature=*/{4, 11}, &embedding_executor,
+      /*embedding_cache=*/nullptr, /*feature_vector_size=*/5,
+      &cached_features));
+  std::vector<float> features;
+  cached_features->AppendClickContextFeaturesForClick(2, &features);
+
+  std::unique_ptr<CachedFeatures> sequence_cached_features;
+  EXPECT_TRUE(feature_processor.ExtractFeatures(
+      view, /*token_span=*/{0, 5},
+      /*selection_span_for_feature=*/{4, 11}, &embedding_executor,
+      /*embedding_cache=*/nullptr, /*feature_vector_size=*/5,
+      &sequence_cached_features));
+  std::vector<float> sequence_features;
+  sequence_cached_features->AppendClickContextFeaturesForClick(
+      2, &sequence_features);
+
+  ASSERT_EQ(features.size(), 25);
+  EXPECT_THAT(sequence_features, ElementsAreFloat(features));
+}
+
+TEST(FeatureProcessorTest, ExtractFeaturesInParallel) {
+  FeatureProcessorOptionsT options;
+  options.context_size = 2;
+  options.max_selection_span = 2;
+  options.snap_label_span_boundaries_to_containing_tokens = false;
+  options.feature_version = 2;
+  options.embedding_size = 4;
+  options.extract_selection_mask_feature = true;
+
+  flatbuffers::DetachedBuffer options_fb = PackFeatureProcessorOptions(options);
+  CREATE_UNILIB_FOR_TESTING;
+  TestingFeatureProcessor feature_processor(
+      flatbuffers::GetRoot<FeatureProcessorOptions>(options_fb.data()),
+      &unilib);
+
+  FakeEmbeddingExecutor embedding_executor;
+
+  std::vector<Token> tokens;
+  for (int i = 0; i < 1000; ++i) {
+    const std::string value = "t" + IntToString(i);
+    tokens.push_back(Token(value, 10 * i, 10 * i + value.size()));
+  }
+
+  std::unique_ptr<CachedFeatures> cached_features;
+  EXPECT_TRUE(feature_processor.ExtractFeatures(
+      tokens, /*token_span=*/{0, tokens.size()},
+      /*selection_span_for_feature=*/{4000, 6000}, &embedding_executor,
+      /*embedding_cache=*/nullptr, /*feature_vector_size=*/5,
+      &cached_features));
+
+  ThreadPool pool(/*num_threads=*/4);
+  std::unique_ptr<CachedFeatures> parallel_cached_features;
+  EXPECT_TRUE(feature_processor.ExtractFeatures(
+      tokens, /*token_span=*/{0, tokens.size()},
+      /*selection_span_for_feature=*/{4000, 6000}, &embedding_executor,
+      /*embedding_cache=*/nullptr, /*feature_vector_size=*/5,
+      &parallel_cached_features, /*half_precision=*/false, &pool));
+
+  for (const int click : {0, 1, 399, 400, 650, 998, 999}) {
+    std::vector<float> features;
+    cached_features->AppendClickContextFeaturesForClick(click, &features);
+    std::vector<float> parallel_features;
+    parallel_cached_features->AppendClickContextFeaturesForClick(
+        click, &parallel_features);
+    ASSERT_EQ(features.size(), 25);
+    EXPECT_THAT(parallel_features, ElementsAreFloat(features)) << click;
+  }
+}
+
 TEST(FeatureProcessorTest, EmbeddingCache) {
   FeatureProcessorOptionsT options;
   options.context_size = 2;
@@ -690,11 +832,11 @@ TEST(FeatureProcessorTest, EmbeddingCache) {
   const std::vector<float> cached_padding_features = {10.0, -10.0, 10.0, -10.0};
   const std::vector<float> cached_features1 = {1.0, 2.0, 3.0, 4.0};
   const std::vector<float> cached_features2 = {5.0, 6.0, 7.0, 8.0};
-  FeatureProcessor::EmbeddingCache embedding_cache = {
-      {{kInvalidIndex, kInvalidIndex}, cached_padding_features},
-      {{4, 7}, cached_features1},
-      {{12, 15}, cached_features2},
-  };
+  FeatureProcessor::EmbeddingCache embedding_cache;
+  embedding_cache.Insert({kInvalidIndex, kInvalidIndex},
+                         cached_padding_features.data(), 4);
+  embedding_cache.Insert({4, 7}, cached_features1.data(), 4);
+  embedding_cache.Insert({12, 15}, cached_features2.data(), 4);
 
   EXPECT_TRUE(feature_processor.ExtractFeatures(
       tokens, /*token_span=*/{0, 6},
@@ -713,17 +855,22 @@ TEST(FeatureProcessorTest, EmbeddingCache) {
   EXPECT_THAT(Subvector(features, 36, 40),
               ElementsAreFloat(cached_padding_features));
   // Check that the real embeddings were cached.
+  const auto cached_embedding = [&embedding_cache](CodepointSpan span) {
+    const float* embedding = embedding_cache.Find(span);
+    return embedding != nullptr ? std::vector<float>(embedding, embedding + 4)
+                                : std::vector<float>();
+  };
   EXPECT_EQ(embedding_cache.size(), 7);
   EXPECT_THAT(Subvector(features, 4, 8),
-              ElementsAreFloat(embedding_cache.at({0, 3})));
+              ElementsAreFloat(cached_embedding({0, 3})));
   EXPECT_THAT(Subvector(features, 12, 16),
-              ElementsAreFloat(embedding_cache.at({8, 11})));
+              ElementsAreFloat(cached_embedding({8, 11})));
   EXPECT_THAT(Subvector(features, 20, 24),
-              ElementsAreFloat(embedding_cache.at({8, 11})));
+              ElementsAreFloat(cached_embedding({8, 11})));
   EXPECT_THAT(Subvector(features, 28, 32),
-              ElementsAreFloat(embedding_cache.at({16, 19})));
+              ElementsAreFloat(cached_embedding({16, 19})));
   EXPECT_THAT(Subvector(features, 32, 36),
-              ElementsAreFloat(embedding_cache.at({20, 23})));
+              ElementsAreFloat(cached_embedding({20, 23})));
 }
 
 TEST(FeatureProcessorTest, StripUnusedTokensWithNoRelativeClick) {
@@ -892,6 +1039,23 @@ TEST(FeatureProcessorTest, ICUTokenize) {
 }
 #endif
 
+#ifdef LIBTEXTCLASSIFIER_TEST_ICU
+TEST(FeatureProcessorTest, ICUTokenizeWithLocales) {
+  FeatureProcessorOptionsT options;
+  options.tokenization_type = FeatureProcessorOptions_::TokenizationType_ICU;
+
+  flatbuffers::DetachedBuffer options_fb = PackFeatureProcessorOptions(options);
+  TestingFeatureProcessor feature_processor(
+      flatbuffers::GetRoot<FeatureProcessorOptions>(options_fb.data()));
+  const UnicodeText text =
+      UTF8ToUnicodeText("พระบาทสมเด็จพระปรมิ", /*do_copy=*/false);
+  const std::vector<Token> tokens = feature_processor.Tokenize(text);
+  EXPECT_EQ(tokens.size(), 5);
+  EXPECT_EQ(feature_processor.Tokenize(text, "th-TH, en-US"), tokens);
+  EXPECT_EQ(feature_processor.Tokenize(text, ""), tokens);
+}
+#endif
+
 #ifdef LIBTEXTCLASSIFIER_TEST_ICU
 TEST(FeatureProcessorTest, ICUTokenizeWithWhitespaces) {
   FeatureProcessorOptionsT options;
@@ -0,0 +1,449 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "feed-forward-network.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "util/base/logging.h"
+
+namespace libtextclassifier2 {
+
+namespace internal {
+namespace {
+
+// Number of output units computed together, so that every input value that is
+// loaded is used for this many weights.
+const int kUnitsPerTile = 4;
+
+// Computes kRows consecutive rows of the fully connected layer. Processing
+// several rows together reuses each loaded weight for all of them.
+template <int kRows>
+void FullyConnectedRows(const float* input, int input_size,
+                        const float* weights, const float* bias, int num_units,
+                        float* output) {
+  int unit = 0;
+  for (; unit + kUnitsPerTile <= num_units; unit += kUnitsPerTile) {
+    float sums[kRows][kUnitsPerTile] = {};
+    const float* unit_weights = weights + unit * input_size;
+    for (int i = 0; i < input_size; ++i) {
+      const float w0 = unit_weights[i];
+      const float w1 = unit_weights[input_size + i];
+      const float w2 = unit_weights[2 * input_size + i];
+      const float w3 = unit_weights[3 * input_size + i];
+      for (int r = 0; r < kRows; ++r) {
+        const float x = input[r * input_size + i];
+        sums[r][0] += x * w0;
+        sums[r][1] += x * w1;
+        sums[r][2] += x * w2;
+        sums[r][3] += x * w3;
+      }
+    }
+    for (int r = 0; r < kRows; ++r) {
+      for (int u = 0; u < kUnitsPerTile; ++u) {
+        output[r * num_units + unit + u] =
+            sums[r][u] + (bias != nullptr ? bias[unit + u] : 0.0f);
+      }
+    }
+  }
+  for (; unit < num_units; ++unit) {
+    float sums[kRows] = {};
+    const float* unit_weights = weights + unit * input_size;
+    for (int i = 0; i < input_size; ++i) {
+      for (int r = 0; r < kRows; ++r) {
+        sums[r] += input[r * input_size + i] * unit_weights[i];
+      }
+    }
+    for (int r = 0; r < kRows; ++r) {
+      output[r * num_units + unit] =
+          sums[r] + (bias != nullptr ? bias[unit] : 0.0f);
+    }
+  }
+}
+
+}  // namespace
+
+void FullyConnected(const float* input, int batch_size, int input_size,
+                    const float* weights, const float* bias, int num_units,
+                    float* output) {
+  const int kRowsPerTile = 2;
+  int row = 0;
+  for (; row + kRowsPerTile <= batch_size; row += kRowsPerTile) {
+    FullyConnectedRows<kRowsPerTile>(input + row * input_size, input_size,
+                                     weights, bias, num_units,
+                                     output + row * num_units);
+  }
+  for (; row < batch_size; ++row) {
+    FullyConnectedRows<1>(input + row * input_size, input_size, weights, bias,
+                          num_units, output + row * num_units);
+  }
+}
+void QuantizedFullyConnected(const float* input, int batch_size,
+                             int input_size, const uint8* weights,
+                             float weights_scale, int weights_zero_point,
+                             const float* bias, int num_units,
+                             int8* quantized_input, float* output) {
+  for (int row = 0; row < batch_size; ++row) {
+    const float* row_input = input + row * input_size;
+    float* row_output = output + row * num_units;
+
+    // Symmetric quantization of the row to [-127, 127].
+    float max_abs = 0.0f;
+    for (int i = 0; i < input_size; ++i) {
+      max_abs = std::max(max_abs, std::fabs(row_input[i]));
+    }
+    if (max_abs == 0.0f) {
+      for (int unit = 0; unit < num_units; ++unit) {
+        row_output[unit] = bias != nullptr ? bias[unit] : 0.0f;
+      }
+      continue;
+    }
+    const float input_scale = max_abs / 127.0f;
+    const float inverse_input_scale = 127.0f / max_abs;
+    int32 input_sum = 0;
+    for (int i = 0; i < input_size; ++i) {
+      quantized_input[i] =
+          static_cast<int8>(std::round(row_input[i] * inverse_input_scale));
+      input_sum += quantized_input[i];
+    }
+
+    // sum(q * (w - zero_point)) = sum(q * w) - zero_point * sum(q).
+    const float output_scale = input_scale * weights_scale;
+    for (int unit = 0; unit < num_units; ++unit) {
+      const uint8* unit_weights = weights + unit * input_size;
+      int32 dot = 0;
+      for (int i = 0; i < input_size; ++i) {
+        dot += static_cast<int32>(quantized_input[i]) * unit_weights[i];
+      }
+      dot -= weights_zero_point * input_sum;
+      row_output[unit] = dot * output_scale +
+                         (bias != nullptr ? bias[unit] : 0.0f);
+    }
+  }
+}
+}  // namespace internal
+
+namespace {
+
+int NumElements(const TfLiteTensor& tensor) {
+  if (tensor.dims == nullptr) {
+    return 0;
+  }
+  int num_elements = 1;
+  for (int i = 0; i < tensor.dims->size; ++i) {
+    num_elements *= tensor.dims->data[i];
+  }
+  return num_elements;
+}
+
+// Returns the tensor with the given index if it is a float tensor, otherwise
+// nullptr.
+const tflite::Tensor* GetFloatTensor(const tflite::SubGraph* subgraph,
+                                     int index) {
+  if (index < 0 || index >= subgraph->tensors()->size()) {
+    return nullptr;
+  }
+  const tflite::Tensor* tensor = (*subgraph->tensors())[index];
+  if (tensor->type() != tflite::TensorType_FLOAT32) {
+    return nullptr;
+  }
+  return tensor;
+}
+
+// Returns the constant data of the tensor in the model, or nullptr if it has
+// none or it is not 'num_bytes' long.
+const uint8* GetConstantData(const tflite::Model* model,
+                             const tflite::Tensor* tensor, int num_bytes) {
+  if (model->buffers() == nullptr ||
+      tensor->buffer() >= model->buffers()->size()) {
+    return nullptr;
+  }
+  const tflite::Buffer* buffer = (*model->buffers())[tensor->buffer()];
+  if (buffer == nullptr || buffer->data() == nullptr ||
+      buffer->data()->size() != num_bytes) {
+    return nullptr;
+  }
+  return buffer->data()->data();
+}
+
+}  // namespace
+
+std::unique_ptr<const FeedForwardNetwork> FeedForwardNetwork::FromModel(
+    const tflite::Model* model) {
+  if (model->subgraphs() == nullptr || model->subgraphs()->size() != 1 ||
+      model->operator_codes() == nullptr) {
+    return nullptr;
+  }
+  const tflite::SubGraph* subgraph = (*model->subgraphs())[0];
+  if (subgraph->operators() == nullptr || subgraph->tensors() == nullptr ||
+      subgraph->operators()->size() == 0) {
+    return nullptr;
+  }
+
+  std::unique_ptr<FeedForwardNetwork> network(new FeedForwardNetwork());
+  for (const tflite::Operator* op : *subgraph->operators()) {
+    if (op->opcode_index() >= model->operator_codes()->size() ||
+        op->inputs() == nullptr || op->outputs() == nullptr ||
+        op->outputs()->size() != 1) {
+      return nullptr;
+    }
+    const tflite::BuiltinOperator builtin_code =
+        (*model->operator_codes())[op->opcode_index()]->builtin_code();
+
+    Layer layer;
+    layer.output_tensor = (*op->outputs())[0];
+    layer.weights_tensor = -1;
+    layer.bias_tensor = -1;
+    layer.input_size = 0;
+    layer.num_units = 0;
+    layer.quantized_weights = false;
+    layer.weights_scale = 1.0f;
+    layer.weights_zero_point = 0;
+    layer.weights_data = nullptr;
+    layer.bias_data = nullptr;
+    if (builtin_code == tflite::BuiltinOperator_FULLY_CONNECTED) {
+      if (op->inputs()->size() != 3) {
+        return nullptr;
+      }
+      layer.input_tensor = (*op->inputs())[0];
+      layer.weights_tensor = (*op->inputs())[1];
+      layer.bias_tensor = (*op->inputs())[2];
+      if (layer.weights_tensor < 0 ||
+          layer.weights_tensor >= subgraph->tensors()->size()) {
+        return nullptr;
+      }
+      const tflite::Tensor* weights =
+          (*subgraph->tensors())[layer.weights_tensor];
+      if (weights->shape() == nullptr || weights->shape()->size() != 2) {
+        return nullptr;
+      }
+      if (weights->type() == tflite::TensorType_UINT8) {
+        const tflite::QuantizationParameters* quantization =
+            weights->quantization();
+        if (quantization == nullptr || quantization->scale() == nullptr ||
+            quantization->scale()->size() != 1 ||
+            quantization->zero_point() == nullptr ||
+            quantization->zero_point()->size() != 1) {
+          return nullptr;
+        }
+        layer.quantized_weights = true;
+        layer.weights_scale = (*quantization->scale())[0];
+        layer.weights_zero_point = (*quantization->zero_point())[0];
+      } else if (weights->type() != tflite::TensorType_FLOAT32) {
+        return nullptr;
+      }
+      layer.num_units = (*weights->shape())[0];
+      layer.input_size = (*weights->shape())[1];
+      layer.weights_data = GetConstantData(
+          model, weights,
+          layer.num_units * layer.input_size *
+              (layer.quantized_weights ? sizeof(uint8) : sizeof(float)));
+      if (layer.quantized_weights) {
+        network->max_quantized_input_size_ =
+            std::max(network->max_quantized_input_size_, layer.input_size);
+      }
+      if (layer.bias_tensor != -1) {
+        const tflite::Tensor* bias =
+            GetFloatTensor(subgraph, layer.bias_tensor);
+        if (bias == nullptr || bias->shape() == nullptr ||
+            bias->shape()->size() != 1 ||
+            (*bias->shape())[0] != layer.num_units) {
+          return nullptr;
+        }
+        layer.bias_data = reinterpret_cast<const float*>(
+            GetConstantData(model, bias, layer.num_units * sizeof(float)));
+      }
+
+      const tflite::FullyConnectedOptions* options =
+          op->builtin_options_as_FullyConnectedOptions();
+      const tflite::ActivationFunctionType activation =
+          options != nullptr ? options->fused_activation_function()
+                             : tflite::ActivationFunctionType_NONE;
+      if (activation == tflite::ActivationFunctionType_NONE) {
+        layer.activation = Activation::NONE;
+      } else if (activation == tflite::ActivationFunctionType_RELU) {
+        layer.activation = Activation::RELU;
+      } else if (activation == tflite::ActivationFunctionType_RELU6) {
+        layer.activation = Activation::RELU6;
+      } else {
+        return nullptr;
+      }
+    } else if (builtin_code == tflite::BuiltinOperator_RELU ||
+               builtin_code == tflite::BuiltinOperator_RELU6) {
+      if (op->inputs()->size() != 1) {
+        return nullptr;
+      }
+      layer.input_tensor = (*op->inputs())[0];
+      layer.activation = builtin_code == tflite::BuiltinOperator_RELU
+                             ? Activation::RELU
+                             : Activation::RELU6;
+    } else {
+      TC_VLOG(1) << "Unsupported op for the feed-forward network: "
+                 << tflite::EnumNameBuiltinOperator(builtin_code);
+      return nullptr;
+    }
+
+    if (GetFloatTensor(subgraph, layer.input_tensor) == nullptr ||
+        GetFloatTensor(subgraph, layer.output_tensor) == nullptr) {
+      return nullptr;
+    }
+    network->layers_.push_back(layer);
+  }
+
+  network->PrepareRunOnBuffers(subgraph);
+  return std::move(network);
+}
+
+void FeedForwardNetwork::PrepareRunOnBuffers(const tflite::SubGraph* subgraph) {
+  runs_on_buffers_ = false;
+  if (subgraph->inputs() == nullptr || subgraph->inputs()->size() == 0 ||
+      subgraph->outputs() == nullptr || subgraph->outputs()->size() != 1 ||
+      layers_.empty() || layers_[0].weights_tensor == -1 ||
+      layers_[0].input_tensor != (*subgraph->inputs())[0] ||
+      layers_.back().output_tensor != (*subgraph->outputs())[0]) {
+    return;
+  }
+  int size = layers_[0].input_size;
+  int max_layer_size = 0;
+  for (int i = 0; i < layers_.size(); ++i) {
+    const Layer& layer = layers_[i];
+    if (i > 0 && layer.input_tensor != layers_[i - 1].output_tensor) {
+      return;
+    }
+    if (layer.weights_tensor != -1) {
+      if (layer.input_size != size || layer.weights_data == nullptr ||
+          (layer.bias_tensor != -1 && layer.bias_data == nullptr)) {
+        return;
+      }
+      size = layer.num_units;
+      max_layer_size = std::max(max_layer_size, size);
+    }
+  }
+  runs_on_buffers_ = true;
+  input_size_ = layers_[0].input_size;
+  output_size_ = size;
+  max_layer_size_ = max_layer_size;
+}
+
+int FeedForwardNetwork::ScratchSize(int batch_size) const {
+  // The input and two buffers that the layers alternate between, followed by
+  // the quantized input row.
+  return batch_size * (input_size_ + 2 * max_layer_size_) +
+         (max_quantized_input_size_ + sizeof(float) - 1) / sizeof(float);
+}
+
+const float* FeedForwardNetwork::RunOnBuffers(int batch_size,
+                                              float* scratch) const {
+  float* buffers[2] = {scratch + batch_size * input_size_,
+                       scratch + batch_size * (input_size_ + max_layer_size_)};
+  int8* quantized_input = reinterpret_cast<int8*>(
+      scratch + batch_size * (input_size_ + 2 * max_layer_size_));
+  float* values = scratch;
+  int size = input_size_;
+  int next_buffer = 0;
+  for (const Layer& layer : layers_) {
+    if (layer.weights_tensor != -1) {
+      float* output = buffers[next_buffer];
+      next_buffer = 1 - next_buffer;
+      if (layer.quantized_weights) {
+        internal::QuantizedFullyConnected(
+            values, batch_size, layer.input_size,
+            static_cast<const uint8*>(layer.weights_data), layer.weights_scale,
+            layer.weights_zero_point, layer.bias_data, layer.num_units,
+            quantized_input, output);
+      } else {
+        internal::FullyConnected(
+            values, batch_size, layer.input_size,
+            static_cast<const float*>(layer.weights_data), layer.bias_data,
+            layer.num_units, output);
+      }
+      values = output;
+      size = layer.num_units;
+    }
+    ApplyActivation(layer.activation, batch_size * size, values);
+  }
+  return values;
+}
+
+void FeedForwardNetwork::ApplyActivation(Activation activation, int size,
+                                         float* values) {
+  if (activation == Activation::RELU) {
+    for (int i = 0; i < size; ++i) {
+      values[i] = std::max(values[i], 0.0f);
+    }
+  } else if (activation == Activation::RELU6) {
+    for (int i = 0; i < size; ++i) {
+      values[i] = std::min(std::max(values[i], 0.0f), 6.0f);
+    }
+  }
+}
+
+bool FeedForwardNetwork::Run(tflite::Interpreter* interpreter) const {
+  std::vector<int8> quantized_input(max_quantized_input_size_);
+  for (const Layer& layer : layers_) {
+    const TfLiteTensor* input = interpreter->tensor(layer.input_tensor);
+    TfLiteTensor* output = interpreter->tensor(layer.output_tensor);
+    if (input == nullptr || output == nullptr || input->data.f == nullptr ||
+        output->data.f == nullptr) {
+      return false;
+    }
+    const int num_inputs = NumElements(*input);
+    const int num_outputs = NumElements(*output);
+
+    if (layer.weights_tensor != -1) {
+      if (layer.input_size <= 0 || num_inputs % layer.input_size != 0) {
+        return false;
+      }
+      const int batch_size = num_inputs / layer.input_size;
+      if (num_outputs != batch_size * layer.num_units) {
+        return false;
+      }
+      const TfLiteTensor* weights = interpreter->tensor(layer.weights_tensor);
+      const TfLiteTensor* bias = layer.bias_tensor != -1
+                                     ? interpreter->tensor(layer.bias_tensor)
+                                     : nullptr;
+      if (weights == nullptr || weights->data.raw == nullptr ||
+          (bias != nullptr && bias->data.f == nullptr)) {
+        return false;
+      }
+      const float* bias_data = bias != nullptr ? bias->data.f : nullptr;
+      if (layer.quantized_weights) {
+        internal::QuantizedFullyConnected(
+            input->data.f, batch_size, layer.input_size, weights->data.uint8,
+            layer.weights_scale, layer.weights_zero_point, bias_data,
+            layer.num_units, quantized_input.data(), output->data.f);
+      } else {
+        internal::FullyConnected(input->data.f, batch_size, layer.input_size,
+                                 weights->data.f, bias_data, layer.num_units,
+                                 output->data.f);
+      }
+    } else {
+      if (num_outputs != num_inputs) {
+        return false;
+      }
+      if (output->data.f != input->data.f) {
+        std::copy(input->data.f, input->data.f + num_inputs, output->data.f);
+      }
+    }
+
+    ApplyActivation(layer.activation, num_outputs, output->data.f);
+  }
+  return true;
+}
+
+}  // namespace libtextclassifier2
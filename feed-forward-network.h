@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Runs small feed-forward TFLite models without the TFLite interpreter's op
+// dispatch.
+
+#ifndef LIBTEXTCLASSIFIER_FEED_FORWARD_NETWORK_H_
+#define LIBTEXTCLASSIFIER_FEED_FORWARD_NETWORK_H_
+
+#include <memory>
+#include <vector>
+
+#include "util/base/integral_types.h"
+#include "tensorflow/contrib/lite/interpreter.h"
+#include "tensorflow/contrib/lite/model.h"
+
+namespace libtextclassifier2 {
+
+namespace internal {
+// Computes output = input * weights^T + bias for a batch of 'batch_size' rows,
+// with row-major 'input' of batch_size x input_size, 'weights' of
+// num_units x input_size (the TFLite FULLY_CONNECTED layout) and 'output' of
+// batch_size x num_units. 'bias' may be nullptr.
+void FullyConnected(const float* input, int batch_size, int input_size,
+                    const float* weights, const float* bias, int num_units,
+                    float* output);
+
+// Same as above, but for quantized weights with the real value
+// weights_scale * (weights[i] - weights_zero_point). Each input row is
+// quantized to int8 on the fly into 'quantized_input' (of input_size values),
+// so that the dot products run on integers.
+void QuantizedFullyConnected(const float* input, int batch_size,
+                             int input_size, const uint8* weights,
+                             float weights_scale, int weights_zero_point,
+                             const float* bias, int num_units,
+                             int8* quantized_input, float* output);
+}  // namespace internal
+
+// A model made only of FULLY_CONNECTED layers and RELU activations, which is
+// what the selection and classification models are. The weights of the layers
+// may be float or uint8-quantized; all other tensors are float. Instead of
+// Invoke(), the layers are computed directly on the tensors of an interpreter
+// of the same model, so the interpreter just serves as the storage that its
+// AllocateTensors() planned.
+class FeedForwardNetwork {
+ public:
+  // Returns nullptr if the model has ops or tensor types that are not
+  // supported, in which case the model should be run by the interpreter.
+  static std::unique_ptr<const FeedForwardNetwork> FromModel(
+      const tflite::Model* model);
+
+  // Computes the outputs of the model from its inputs, for an interpreter of
+  // the model whose tensors are allocated. Returns false if the tensors do
+  // not have the expected shapes; the interpreter then has to be invoked.
+  bool Run(tflite::Interpreter* interpreter) const;
+
+  // Whether RunOnBuffers() can compute the model: its layers form a chain from
+  // the first input of the model to its output, starting with a fully
+  // connected layer, and all their weights are constant buffers of the model.
+  bool runs_on_buffers() const { return runs_on_buffers_; }
+
+  // The number of values per row of the input and the output.
+  int input_size() const { return input_size_; }
+  int output_size() const { return output_size_; }
+
+  // Number of floats of scratch memory that RunOnBuffers() needs for a batch,
+  // including the input.
+  int ScratchSize(int batch_size) const;
+
+  // Computes the outputs of the model without an interpreter, for the
+  // batch_size x input_size() input at the start of 'scratch', which has
+  // ScratchSize(batch_size) floats. The weights are read from the buffers of
+  // the model, which has to outlive the network. Returns the batch_size x
+  // output_size() outputs, which are somewhere in 'scratch'.
+  const float* RunOnBuffers(int batch_size, float* scratch) const;
+
+ private:
+  enum class Activation { NONE, RELU, RELU6 };
+
+  struct Layer {
+    int input_tensor;
+    int output_tensor;
+
+    // Only for fully connected layers, otherwise -1. The bias is optional.
+    int weights_tensor;
+    int bias_tensor;
+    int input_size;
+    int num_units;
+
+    // Whether the weights are uint8, with the given quantization parameters.
+    bool quantized_weights;
+    float weights_scale;
+    int weights_zero_point;
+
+    // The constant weights (uint8 or float) and bias in the model, or nullptr
+    // if they are not constant.
+    const void* weights_data;
+    const float* bias_data;
+
+    Activation activation;
+  };
+
+  FeedForwardNetwork() {}
+
+  static void ApplyActivation(Activation activation, int size, float* values);
+
+  // Checks the conditions of runs_on_buffers() and sets the sizes for
+  // RunOnBuffers().
+  void PrepareRunOnBuffers(const tflite::SubGraph* subgraph);
+
+  std::vector<Layer> layers_;
+
+  // The largest input size of a layer with quantized weights, i.e. the size of
+  // the buffer for the quantized input rows.
+  int max_quantized_input_size_ = 0;
+
+  bool runs_on_buffers_ = false;
+  int input_size_ = 0;
+  int output_size_ = 0;
+  // The largest output size of a fully connected layer.
+  int max_layer_size_ = 0;
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_FEED_FORWARD_NETWORK_H_
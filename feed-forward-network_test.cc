@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "feed-forward-network.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+std::vector<float> NaiveFullyConnected(const std::vector<float>& input,
+                                       int batch_size, int input_size,
+                                       const std::vector<float>& weights,
+                                       const std::vector<float>& bias,
+                                       int num_units) {
+  std::vector<float> output(batch_size * num_units);
+  for (int b = 0; b < batch_size; ++b) {
+    for (int u = 0; u < num_units; ++u) {
+      float sum = bias.empty() ? 0.0f : bias[u];
+      for (int i = 0; i < input_size; ++i) {
+        sum += input[b * input_size + i] * weights[u * input_size + i];
+      }
+      output[b * num_units + u] = sum;
+    }
+  }
+  return output;
+}
+
+TEST(FeedForwardNetworkTest, FullyConnectedMatchesNaive) {
+  // Integer values keep the sums exact regardless of the summation order.
+  for (int batch_size = 1; batch_size <= 5; ++batch_size) {
+    for (int input_size = 1; input_size <= 7; ++input_size) {
+      for (int num_units = 1; num_units <= 9; ++num_units) {
+        std::vector<float> input(batch_size * input_size);
+        for (int i = 0; i < input.size(); ++i) {
+          input[i] = (i * 7) % 5 - 2;
+        }
+        std::vector<float> weights(num_units * input_size);
+        for (int i = 0; i < weights.size(); ++i) {
+          weights[i] = (i * 3) % 7 - 3;
+        }
+        std::vector<float> bias;
+        if (num_units % 2 == 1) {
+          for (int i = 0; i < num_units; ++i) {
+            bias.push_back(i - 1);
+          }
+        }
+
+        std::vector<float> output(batch_size * num_units, -1.0f);
+        internal::FullyConnected(input.data(), batch_size, input_size,
+                                 weights.data(),
+                                 bias.empty() ? nullptr : bias.data(),
+                                 num_units, output.data());
+        EXPECT_EQ(output,
+                  NaiveFullyConnected(input, batch_size, input_size, weights,
+                                      bias, num_units))
+            << batch_size << "x" << input_size << " -> " << num_units;
+      }
+    }
+  }
+}
+
+TEST(FeedForwardNetworkTest, QuantizedFullyConnectedMatchesFloat) {
+  const int batch_size = 3;
+  const int input_size = 40;
+  const int num_units = 6;
+  const float weights_scale = 0.02f;
+  const int weights_zero_point = 128;
+
+  std::vector<float> input(batch_size * input_size);
+  for (int i = 0; i < input.size(); ++i) {
+    input[i] = ((i * 37) % 101 - 50) / 25.0f;
+  }
+  std::vector<uint8> quantized_weights(num_units * input_size);
+  std::vector<float> weights(num_units * input_size);
+  for (int i = 0; i < weights.size(); ++i) {
+    quantized_weights[i] = (i * 53) % 256;
+    weights[i] = weights_scale * (quantized_weights[i] - weights_zero_point);
+  }
+  const std::vector<float> bias = {0.5f, -1.0f, 0.0f, 2.0f, 0.25f, -0.75f};
+
+  std::vector<float> expected(batch_size * num_units);
+  internal::FullyConnected(input.data(), batch_size, input_size,
+                           weights.data(), bias.data(), num_units,
+                           expected.data());
+  std::vector<int8> quantized_input(input_size);
+  std::vector<float> output(batch_size * num_units);
+  internal::QuantizedFullyConnected(input.data(), batch_size, input_size,
+                                    quantized_weights.data(), weights_scale,
+                                    weights_zero_point, bias.data(), num_units,
+                                    quantized_input.data(), output.data());
+
+  // The input quantization error is at most half a step of max|x| / 127 per
+  // value, bounded here by the sum of the absolute weights.
+  for (int row = 0; row < batch_size; ++row) {
+    float max_abs = 0.0f;
+    for (int i = 0; i < input_size; ++i) {
+      max_abs = std::max(max_abs, std::fabs(input[row * input_size + i]));
+    }
+    for (int unit = 0; unit < num_units; ++unit) {
+      float abs_weights_sum = 0.0f;
+      for (int i = 0; i < input_size; ++i) {
+        abs_weights_sum += std::fabs(weights[unit * input_size + i]);
+      }
+      EXPECT_NEAR(output[row * num_units + unit],
+                  expected[row * num_units + unit],
+                  0.5f * max_abs / 127.0f * abs_weights_sum + 1e-4f);
+    }
+  }
+}
+
+TEST(FeedForwardNetworkTest, QuantizedFullyConnectedZeroInput) {
+  const std::vector<float> input(4, 0.0f);
+  const std::vector<uint8> weights(8, 200);
+  const std::vector<float> bias = {1.5f, -2.0f};
+  std::vector<int8> quantized_input(4);
+  std::vector<float> output(2);
+  internal::QuantizedFullyConnected(input.data(), /*batch_size=*/1,
+                                    /*input_size=*/4, weights.data(),
+                                    /*weights_scale=*/0.1f,
+                                    /*weights_zero_point=*/128, bias.data(),
+                                    /*num_units=*/2, quantized_input.data(),
+                                    output.data());
+  EXPECT_EQ(output, bias);
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
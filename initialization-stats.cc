@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "initialization-stats.h"
+
+#include "util/strings/numbers.h"
+
+namespace libtextclassifier2 {
+
+void InitializationStats::Clear() {
+  for (int i = 0; i < NUM_PHASES; ++i) {
+    total_us_[i].store(0, std::memory_order_relaxed);
+    counts_[i].store(0, std::memory_order_relaxed);
+  }
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    counters_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+std::string InitializationStats::ToString() const {
+  std::string report;
+  for (int i = 0; i < NUM_PHASES; ++i) {
+    const Phase phase = static_cast<Phase>(i);
+    if (Count(phase) == 0) {
+      continue;
+    }
+    report.append(PhaseName(phase));
+    report.append(": ");
+    report.append(IntToString(TotalMicros(phase)));
+    report.append(" us");
+    if (Count(phase) > 1) {
+      report.append(" (");
+      report.append(IntToString(Count(phase)));
+      report.append(" runs)");
+    }
+    report.append("\n");
+  }
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    const Counter counter = static_cast<Counter>(i);
+    if (Value(counter) == 0) {
+      continue;
+    }
+    report.append(CounterName(counter));
+    report.append(": ");
+    report.append(IntToString(Value(counter)));
+    report.append("\n");
+  }
+  return report;
+}
+
+const char* InitializationStats::PhaseName(Phase phase) {
+  switch (phase) {
+    case VERIFICATION:
+      return "verification";
+    case INITIALIZATION:
+      return "initialization";
+    case SELECTION_EXECUTOR:
+      return "selection_executor";
+    case CLASSIFICATION_EXECUTOR:
+      return "classification_executor";
+    case EMBEDDING_EXECUTOR:
+      return "embedding_executor";
+    case FEATURE_PROCESSORS:
+      return "feature_processors";
+    case REGEX_MODEL:
+      return "regex_model";
+    case DATETIME_PARSER:
+      return "datetime_parser";
+    case NUM_PHASES:
+      break;
+  }
+  return "unknown";
+}
+
+const char* InitializationStats::CounterName(Counter counter) {
+  switch (counter) {
+    case REGEX_PATTERNS_COMPILED:
+      return "regex_patterns_compiled";
+    case DATETIME_PATTERNS_COMPILED:
+      return "datetime_patterns_compiled";
+    case PATTERNS_DEFERRED:
+      return "patterns_deferred";
+    case PATTERNS_DECOMPRESSED:
+      return "patterns_decompressed";
+    case BYTES_DECOMPRESSED:
+      return "bytes_decompressed";
+    case NUM_COUNTERS:
+      break;
+  }
+  return "unknown";
+}
+
+}  // namespace libtextclassifier2
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LIBTEXTCLASSIFIER_INITIALIZATION_STATS_H_
+#define LIBTEXTCLASSIFIER_INITIALIZATION_STATS_H_
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include "util/base/integral_types.h"
+
+namespace libtextclassifier2 {
+
+// Collects where the loading of a TextClassifier spends its time, and how much
+// pattern work it does. To fill an instance, pass it in the
+// ModelExecutionOptions of the factory. Thread-safe, as the parts of the model
+// are built in parallel if there is an initialization executor, in which case
+// the phases add up to more than their enclosing INITIALIZATION phase.
+class InitializationStats {
+ public:
+  enum Phase {
+    // The flatbuffer verification of the model, if asked for.
+    VERIFICATION = 0,
+    // Everything after the verification. Includes all the phases below.
+    INITIALIZATION,
+    SELECTION_EXECUTOR,
+    CLASSIFICATION_EXECUTOR,
+    EMBEDDING_EXECUTOR,
+    // The label maps, codepoint ranges and tokenizers of both processors.
+    FEATURE_PROCESSORS,
+    REGEX_MODEL,
+    DATETIME_PARSER,
+    NUM_PHASES
+  };
+
+  enum Counter {
+    // Patterns compiled while loading. Lazily compiled ones are not counted.
+    REGEX_PATTERNS_COMPILED = 0,
+    DATETIME_PATTERNS_COMPILED,
+    // Patterns left to be compiled on first use.
+    PATTERNS_DEFERRED,
+    // Compressed patterns inflated while loading, and their inflated size.
+    PATTERNS_DECOMPRESSED,
+    BYTES_DECOMPRESSED,
+    NUM_COUNTERS
+  };
+
+  InitializationStats() { Clear(); }
+
+  // Adds a run of the phase that took 'duration_us' microseconds.
+  void Record(Phase phase, int64 duration_us) {
+    total_us_[phase].fetch_add(duration_us, std::memory_order_relaxed);
+    counts_[phase].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void Increment(Counter counter, int64 value = 1) {
+    counters_[counter].fetch_add(value, std::memory_order_relaxed);
+  }
+
+  // Returns the total time spent in the phase, in microseconds.
+  int64 TotalMicros(Phase phase) const {
+    return total_us_[phase].load(std::memory_order_relaxed);
+  }
+
+  // Returns how many times the phase ran, e.g. 2 for FEATURE_PROCESSORS if
+  // the model has both processors.
+  int64 Count(Phase phase) const {
+    return counts_[phase].load(std::memory_order_relaxed);
+  }
+
+  int64 Value(Counter counter) const {
+    return counters_[counter].load(std::memory_order_relaxed);
+  }
+
+  void Clear();
+
+  // Returns a report with one "name: value" line per phase that ran and per
+  // non-zero counter, for logging and the benchmarks.
+  std::string ToString() const;
+
+  // Returns a name for the phase or the counter, for exporting the stats.
+  static const char* PhaseName(Phase phase);
+  static const char* CounterName(Counter counter);
+
+ private:
+  std::atomic<int64> total_us_[NUM_PHASES];
+  std::atomic<int64> counts_[NUM_PHASES];
+  std::atomic<int64> counters_[NUM_COUNTERS];
+};
+
+// Records the time from its construction to its destruction as a run of the
+// given phase. Does nothing, not even reading the clock, if 'stats' is null.
+class ScopedInitializationTimer {
+ public:
+  ScopedInitializationTimer(InitializationStats* stats,
+                            InitializationStats::Phase phase)
+      : stats_(stats), phase_(phase) {
+    if (stats_ != nullptr) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~ScopedInitializationTimer() {
+    if (stats_ != nullptr) {
+      stats_->Record(phase_,
+                     std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - start_)
+                         .count());
+    }
+  }
+
+ private:
+  InitializationStats* const stats_;
+  const InitializationStats::Phase phase_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_INITIALIZATION_STATS_H_
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "initialization-stats.h"
+
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+TEST(InitializationStatsTest, RecordsPhasesAndCounters) {
+  InitializationStats stats;
+  stats.Record(InitializationStats::FEATURE_PROCESSORS, 10);
+  stats.Record(InitializationStats::FEATURE_PROCESSORS, 5);
+  stats.Increment(InitializationStats::REGEX_PATTERNS_COMPILED);
+  stats.Increment(InitializationStats::BYTES_DECOMPRESSED, 300);
+
+  EXPECT_EQ(stats.TotalMicros(InitializationStats::FEATURE_PROCESSORS), 15);
+  EXPECT_EQ(stats.Count(InitializationStats::FEATURE_PROCESSORS), 2);
+  EXPECT_EQ(stats.Count(InitializationStats::VERIFICATION), 0);
+  EXPECT_EQ(stats.Value(InitializationStats::REGEX_PATTERNS_COMPILED), 1);
+  EXPECT_EQ(stats.Value(InitializationStats::BYTES_DECOMPRESSED), 300);
+
+  stats.Clear();
+  EXPECT_EQ(stats.Count(InitializationStats::FEATURE_PROCESSORS), 0);
+  EXPECT_EQ(stats.Value(InitializationStats::BYTES_DECOMPRESSED), 0);
+}
+
+TEST(InitializationStatsTest, ScopedTimerRecordsOnce) {
+  InitializationStats stats;
+  {
+    ScopedInitializationTimer timer(&stats, InitializationStats::REGEX_MODEL);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  EXPECT_EQ(stats.Count(InitializationStats::REGEX_MODEL), 1);
+  EXPECT_GE(stats.TotalMicros(InitializationStats::REGEX_MODEL), 2000);
+
+  // Without stats, the timer does nothing.
+  ScopedInitializationTimer timer(/*stats=*/nullptr,
+                                  InitializationStats::REGEX_MODEL);
+}
+
+TEST(InitializationStatsTest, ReportsWhatRan) {
+  InitializationStats stats;
+  stats.Record(InitializationStats::VERIFICATION, 12);
+  stats.Record(InitializationStats::FEATURE_PROCESSORS, 3);
+  stats.Record(InitializationStats::FEATURE_PROCESSORS, 4);
+  stats.Increment(InitializationStats::PATTERNS_DEFERRED, 7);
+
+  EXPECT_EQ(stats.ToString(),
+            "verification: 12 us\n"
+            "feature_processors: 7 us (2 runs)\n"
+            "patterns_deferred: 7\n");
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
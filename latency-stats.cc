@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "latency-stats.h"
+
+namespace libtextclassifier2 {
+
+void LatencyStats::Clear() {
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    total_us_[i].store(0, std::memory_order_relaxed);
+    counts_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+const char* LatencyStats::StageName(Stage stage) {
+  switch (stage) {
+    case TOKENIZATION:
+      return "tokenization";
+    case FEATURE_EXTRACTION:
+      return "feature_extraction";
+    case EMBEDDING:
+      return "embedding";
+    case SELECTION_INFERENCE:
+      return "selection_inference";
+    case CLASSIFICATION_INFERENCE:
+      return "classification_inference";
+    case REGEX:
+      return "regex";
+    case DATETIME:
+      return "datetime";
+    case CONFLICT_RESOLUTION:
+      return "conflict_resolution";
+    case NUM_STAGES:
+      break;
+  }
+  return "unknown";
+}
+
+}  // namespace libtextclassifier2
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LIBTEXTCLASSIFIER_LATENCY_STATS_H_
+#define LIBTEXTCLASSIFIER_LATENCY_STATS_H_
+
+#include <atomic>
+#include <chrono>
+
+#include "util/base/integral_types.h"
+
+namespace libtextclassifier2 {
+
+// Collects the wall time spent in the stages of TextClassifier calls, and how
+// many times each stage ran. To fill an instance, pass it in the options of
+// the calls. Thread-safe, so that one instance can collect the stats of
+// concurrent calls, and of the annotators that run in parallel.
+class LatencyStats {
+ public:
+  enum Stage {
+    TOKENIZATION = 0,
+    // Includes EMBEDDING.
+    FEATURE_EXTRACTION,
+    EMBEDDING,
+    SELECTION_INFERENCE,
+    CLASSIFICATION_INFERENCE,
+    REGEX,
+    DATETIME,
+    // Includes the classification inference it runs.
+    CONFLICT_RESOLUTION,
+    NUM_STAGES
+  };
+
+  LatencyStats() { Clear(); }
+
+  // Adds a run of the stage that took 'duration_us' microseconds.
+  void Record(Stage stage, int64 duration_us) {
+    total_us_[stage].fetch_add(duration_us, std::memory_order_relaxed);
+    counts_[stage].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Returns the total time spent in the stage, in microseconds.
+  int64 TotalMicros(Stage stage) const {
+    return total_us_[stage].load(std::memory_order_relaxed);
+  }
+
+  // Returns how many times the stage ran.
+  int64 Count(Stage stage) const {
+    return counts_[stage].load(std::memory_order_relaxed);
+  }
+
+  void Clear();
+
+  // Returns a name for the stage, for exporting the stats.
+  static const char* StageName(Stage stage);
+
+ private:
+  std::atomic<int64> total_us_[NUM_STAGES];
+  std::atomic<int64> counts_[NUM_STAGES];
+};
+
+// Records the time from its construction to its destruction as a run of the
+// given stage. Does nothing, not even reading the clock, if 'stats' is null.
+class ScopedLatencyTimer {
+ public:
+  ScopedLatencyTimer(LatencyStats* stats, LatencyStats::Stage stage)
+      : stats_(stats), stage_(stage) {
+    if (stats_ != nullptr) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~ScopedLatencyTimer() {
+    if (stats_ != nullptr) {
+      stats_->Record(stage_,
+                     std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - start_)
+                         .count());
+    }
+  }
+
+ private:
+  LatencyStats* const stats_;
+  const LatencyStats::Stage stage_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_LATENCY_STATS_H_
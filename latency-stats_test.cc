@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "latency-stats.h"
+
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+TEST(LatencyStatsTest, RecordsStages) {
+  LatencyStats stats;
+  stats.Record(LatencyStats::REGEX, 10);
+  stats.Record(LatencyStats::REGEX, 5);
+  stats.Record(LatencyStats::DATETIME, 7);
+
+  EXPECT_EQ(stats.TotalMicros(LatencyStats::REGEX), 15);
+  EXPECT_EQ(stats.Count(LatencyStats::REGEX), 2);
+  EXPECT_EQ(stats.TotalMicros(LatencyStats::DATETIME), 7);
+  EXPECT_EQ(stats.Count(LatencyStats::DATETIME), 1);
+  EXPECT_EQ(stats.Count(LatencyStats::TOKENIZATION), 0);
+
+  stats.Clear();
+  EXPECT_EQ(stats.TotalMicros(LatencyStats::REGEX), 0);
+  EXPECT_EQ(stats.Count(LatencyStats::REGEX), 0);
+}
+
+TEST(LatencyStatsTest, ScopedTimerRecordsOnce) {
+  LatencyStats stats;
+  {
+    ScopedLatencyTimer timer(&stats, LatencyStats::TOKENIZATION);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  EXPECT_EQ(stats.Count(LatencyStats::TOKENIZATION), 1);
+  EXPECT_GE(stats.TotalMicros(LatencyStats::TOKENIZATION), 2000);
+
+  // Without stats, the timer does nothing.
+  ScopedLatencyTimer timer(/*stats=*/nullptr, LatencyStats::TOKENIZATION);
+}
+
+TEST(LatencyStatsTest, StageNames) {
+  EXPECT_STREQ(LatencyStats::StageName(LatencyStats::TOKENIZATION),
+               "tokenization");
+  EXPECT_STREQ(LatencyStats::StageName(LatencyStats::CONFLICT_RESOLUTION),
+               "conflict_resolution");
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
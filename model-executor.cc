@@ -32,21 +32,165 @@ bool FromModelSpec(const tflite::Model* model_spec,
 }
 }  // namespace internal
 
+namespace {
+bool TensorHasShape(const TfLiteTensor& tensor, const std::vector<int>& shape) {
+  if (tensor.dims == nullptr || tensor.dims->size != shape.size()) {
+    return false;
+  }
+  for (int i = 0; i < shape.size(); ++i) {
+    if (tensor.dims->data[i] != shape[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The tensor memory that the interpreter holds outside of the model buffer.
+// Tensors of the arena can share memory, so this is an upper bound for them.
+int64 InterpreterHeapBytes(tflite::Interpreter* interpreter) {
+  int64 result = 0;
+  for (int i = 0; i < interpreter->tensors_size(); ++i) {
+    const TfLiteTensor* tensor = interpreter->tensor(i);
+    if (tensor != nullptr && tensor->allocation_type != kTfLiteMmapRo &&
+        tensor->data.raw != nullptr) {
+      result += tensor->bytes;
+    }
+  }
+  return result;
+}
+}  // namespace
+
+ScratchArena* ScratchArena::ForCurrentThread() {
+  static thread_local ScratchArena arena;
+  return &arena;
+}
+
+float* ScratchArena::Prepare(const void* owner, int batch_size, int size) {
+  if (buffer_.size() < size) {
+    buffer_.resize(size);
+  }
+  owner_ = owner;
+  batch_size_ = batch_size;
+  return buffer_.data();
+}
+
+float* ScratchArena::Take(const void* owner, int* batch_size) {
+  if (owner_ != owner || owner == nullptr) {
+    return nullptr;
+  }
+  owner_ = nullptr;
+  *batch_size = batch_size_;
+  return buffer_.data();
+}
+
 std::unique_ptr<tflite::Interpreter> ModelExecutor::CreateInterpreter() const {
   std::unique_ptr<tflite::Interpreter> interpreter;
   tflite::InterpreterBuilder(*model_, builtins_)(&interpreter);
+  if (!interpreter) {
+    return nullptr;
+  }
+  if (options_.num_threads != -1) {
+    interpreter->SetNumThreads(options_.num_threads);
+  }
+  if (options_.use_nnapi) {
+    interpreter->UseNNAPI(true);
+  }
   return interpreter;
 }
 
+std::unique_ptr<tflite::Interpreter> ModelExecutor::AcquireInterpreter()
+    const {
+  {
+    std::lock_guard<std::mutex> lock(interpreter_pool_mutex_);
+    if (!interpreter_pool_.empty()) {
+      std::unique_ptr<tflite::Interpreter> interpreter =
+          std::move(interpreter_pool_.back());
+      interpreter_pool_.pop_back();
+      return interpreter;
+    }
+  }
+  // Build outside of the lock, so that other threads are not blocked on the
+  // relatively expensive interpreter construction.
+  return CreateInterpreter();
+}
+
+TensorView<float> ModelExecutor::ComputeLogits(
+    const TensorView<float>& features, tflite::Interpreter* interpreter) const {
+  float* features_data = PrepareFeaturesInput(features.shape(), interpreter);
+  if (features_data == nullptr) {
+    return TensorView<float>::Invalid();
+  }
+  features.copy_to(features_data, features.size());
+  return ComputeLogitsFromInput(interpreter);
+}
+
+float* ModelExecutor::PrepareFeaturesInput(
+    const std::vector<int>& shape, tflite::Interpreter* interpreter) const {
+  if (!uses_scratch_arena()) {
+    return PrepareFeaturesInputHelper(kInputIndexFeatures, shape, interpreter);
+  }
+  if (shape.size() != 2 || shape[1] != network_->input_size()) {
+    TC_LOG(ERROR) << "Unexpected shape of the features.";
+    return nullptr;
+  }
+  return ScratchArena::ForCurrentThread()->Prepare(
+      this, shape[0], network_->ScratchSize(shape[0]));
+}
+
+TensorView<float> ModelExecutor::ComputeLogitsFromInput(
+    tflite::Interpreter* interpreter) const {
+  if (uses_scratch_arena()) {
+    int batch_size;
+    float* scratch = ScratchArena::ForCurrentThread()->Take(this, &batch_size);
+    if (scratch == nullptr) {
+      TC_LOG(ERROR) << "No input prepared on this thread.";
+      return TensorView<float>::Invalid();
+    }
+    return TensorView<float>(network_->RunOnBuffers(batch_size, scratch),
+                             {batch_size, network_->output_size()});
+  }
+  if (network_ != nullptr && interpreter != nullptr &&
+      network_->Run(interpreter)) {
+    return GetLogitsHelper(kOutputIndexLogits, interpreter);
+  }
+  return InvokeAndGetLogitsHelper(kOutputIndexLogits, interpreter);
+}
+
+void ModelExecutor::ReleaseInterpreter(
+    std::unique_ptr<tflite::Interpreter> interpreter) const {
+  if (!interpreter) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(interpreter_pool_mutex_);
+  if (interpreter_pool_.size() < options_.max_pooled_interpreters) {
+    interpreter_pool_.push_back(std::move(interpreter));
+  }
+}
+
+void ModelExecutor::ClearInterpreterPool() const {
+  std::lock_guard<std::mutex> lock(interpreter_pool_mutex_);
+  interpreter_pool_.clear();
+}
+
+int64 ModelExecutor::EstimatePooledInterpreterBytes() const {
+  std::lock_guard<std::mutex> lock(interpreter_pool_mutex_);
+  int64 result = 0;
+  for (const std::unique_ptr<tflite::Interpreter>& interpreter :
+       interpreter_pool_) {
+    result += InterpreterHeapBytes(interpreter.get());
+  }
+  return result;
+}
+
 std::unique_ptr<TFLiteEmbeddingExecutor> TFLiteEmbeddingExecutor::Instance(
     const flatbuffers::Vector<uint8_t>* model_spec_buffer, int embedding_size,
-    int quantization_bits) {
+    int quantization_bits, bool verify_model) {
   const tflite::Model* model_spec =
       flatbuffers::GetRoot<tflite::Model>(model_spec_buffer->data());
   flatbuffers::Verifier verifier(model_spec_buffer->data(),
                                  model_spec_buffer->Length());
   std::unique_ptr<const tflite::FlatBufferModel> model;
-  if (!model_spec->Verify(verifier) ||
+  if ((verify_model && !model_spec->Verify(verifier)) ||
       !internal::FromModelSpec(model_spec, &model)) {
     TC_LOG(ERROR) << "Could not load TFLite model.";
     return nullptr;
@@ -95,10 +239,16 @@ TFLiteEmbeddingExecutor::TFLiteEmbeddingExecutor(
       num_buckets_(num_buckets),
       bytes_per_embedding_(bytes_per_embedding),
       output_embedding_size_(output_embedding_size),
+      dequantize_add_many_(
+          SelectDequantizeAddMany(quantization_bits, output_embedding_size)),
       scales_(scales),
       embeddings_(embeddings),
       interpreter_(std::move(interpreter)) {}
 
+int64 TFLiteEmbeddingExecutor::EstimateHeapBytes() const {
+  return InterpreterHeapBytes(interpreter_.get());
+}
+
 bool TFLiteEmbeddingExecutor::AddEmbedding(
     const TensorView<int>& sparse_features, float* dest, int dest_size) const {
   if (dest_size != output_embedding_size_) {
@@ -108,46 +258,73 @@ bool TFLiteEmbeddingExecutor::AddEmbedding(
   }
   const int num_sparse_features = sparse_features.size();
   for (int i = 0; i < num_sparse_features; ++i) {
-    const int bucket_id = sparse_features.data()[i];
-    if (bucket_id >= num_buckets_) {
-      return false;
-    }
-
-    if (!DequantizeAdd(scales_->data.f, embeddings_->data.uint8,
-                       bytes_per_embedding_, num_sparse_features,
-                       quantization_bits_, bucket_id, dest, dest_size)) {
+    if (sparse_features.data()[i] >= num_buckets_) {
       return false;
     }
   }
-  return true;
+
+  return dequantize_add_many_(scales_->data.f, embeddings_->data.uint8,
+                              bytes_per_embedding_, num_sparse_features,
+                              quantization_bits_, sparse_features.data(),
+                              num_sparse_features, dest, dest_size);
 }
 
 TensorView<float> ComputeLogitsHelper(const int input_index_features,
                                       const int output_index_logits,
                                       const TensorView<float>& features,
                                       tflite::Interpreter* interpreter) {
-  if (!interpreter) {
+  float* features_data = PrepareFeaturesInputHelper(
+      input_index_features, features.shape(), interpreter);
+  if (features_data == nullptr) {
     return TensorView<float>::Invalid();
   }
-  interpreter->ResizeInputTensor(input_index_features, features.shape());
+  features.copy_to(features_data, features.size());
+  return InvokeAndGetLogitsHelper(output_index_logits, interpreter);
+}
+
+float* PrepareFeaturesInputHelper(const int input_index_features,
+                                  const std::vector<int>& shape,
+                                  tflite::Interpreter* interpreter) {
+  if (!interpreter) {
+    return nullptr;
+  }
+  TfLiteTensor* features_tensor =
+      interpreter->tensor(interpreter->inputs()[input_index_features]);
+
+  // Interpreters are reused across calls, mostly with the same few shapes. If
+  // the tensors are already allocated for this shape, re-planning the arena
+  // would give the same result, so it is skipped.
+  if (features_tensor->data.f != nullptr &&
+      TensorHasShape(*features_tensor, shape)) {
+    return features_tensor->data.f;
+  }
+
+  interpreter->ResizeInputTensor(input_index_features, shape);
   if (interpreter->AllocateTensors() != kTfLiteOk) {
     TC_VLOG(1) << "Allocation failed.";
-    return TensorView<float>::Invalid();
+    return nullptr;
   }
 
-  TfLiteTensor* features_tensor =
+  // The allocation may have moved the tensor data.
+  features_tensor =
       interpreter->tensor(interpreter->inputs()[input_index_features]);
-  int size = 1;
-  for (int i = 0; i < features_tensor->dims->size; ++i) {
-    size *= features_tensor->dims->data[i];
-  }
-  features.copy_to(features_tensor->data.f, size);
+  return features_tensor->data.f;
+}
 
+TensorView<float> InvokeAndGetLogitsHelper(const int output_index_logits,
+                                           tflite::Interpreter* interpreter) {
+  if (!interpreter) {
+    return TensorView<float>::Invalid();
+  }
   if (interpreter->Invoke() != kTfLiteOk) {
     TC_VLOG(1) << "Interpreter failed.";
     return TensorView<float>::Invalid();
   }
+  return GetLogitsHelper(output_index_logits, interpreter);
+}
 
+TensorView<float> GetLogitsHelper(const int output_index_logits,
+                                  tflite::Interpreter* interpreter) {
   TfLiteTensor* logits_tensor =
       interpreter->tensor(interpreter->outputs()[output_index_logits]);
 
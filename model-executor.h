@@ -20,7 +20,11 @@
 #define LIBTEXTCLASSIFIER_MODEL_EXECUTOR_H_
 
 #include <memory>
+#include <mutex>
+#include <vector>
 
+#include "feed-forward-network.h"
+#include "quantization.h"
 #include "tensor-view.h"
 #include "types.h"
 #include "util/base/logging.h"
@@ -42,11 +46,83 @@ TensorView<float> ComputeLogitsHelper(const int input_index_features,
                                       const TensorView<float>& features,
                                       tflite::Interpreter* interpreter);
 
+// A helper function that resizes the features tensor with the given index to
+// 'shape', allocates the tensors and returns the features tensor data, so that
+// the caller can fill it in place. If the tensors are already allocated for
+// 'shape', the resize and allocation are skipped. Returns nullptr on failure.
+float* PrepareFeaturesInputHelper(const int input_index_features,
+                                  const std::vector<int>& shape,
+                                  tflite::Interpreter* interpreter);
+
+// A helper function that runs the interpreter on the already filled-in input
+// and returns the logits tensor with the given index.
+TensorView<float> InvokeAndGetLogitsHelper(const int output_index_logits,
+                                           tflite::Interpreter* interpreter);
+
+// Options for how a ModelExecutor creates and keeps its interpreters.
+struct ModelExecutorOptions {
+  // Number of threads the kernels of an interpreter may use, or -1 to leave it
+  // to TFLite. Only worth raising for models that run large batches.
+  int num_threads = -1;
+
+  // If true, the interpreters are asked to run the model through NNAPI, which
+  // falls back to the CPU kernels on devices without an accelerator.
+  bool use_nnapi = false;
+
+  // Maximum number of idle interpreters kept around for reuse.
+  int max_pooled_interpreters = 4;
+
+  // If true and the model is a plain feed-forward network, the logits are
+  // computed by FeedForwardNetwork instead of invoking the interpreter. Not
+  // used together with NNAPI.
+  bool use_feed_forward_network = true;
+
+  // If true and the logits are computed by FeedForwardNetwork, the features,
+  // the activations and the logits are kept in the ScratchArena of the calling
+  // thread instead of in the tensors of the interpreter, which then never
+  // allocates them. The logits are then only valid until the thread prepares
+  // the next input of any executor.
+  bool use_scratch_arena = true;
+};
+
+// Scratch memory for the feed-forward network runs of a thread: the input
+// features, the activations and the logits. A thread runs one model at a
+// time, so the selection and classification executors share it, and it only
+// grows to the larger of their needs, instead of every pooled interpreter
+// holding an arena of its own.
+// Not thread-safe; every thread uses its own, from ForCurrentThread().
+class ScratchArena {
+ public:
+  static ScratchArena* ForCurrentThread();
+
+  // Returns 'size' floats for a run of a batch of 'batch_size' by 'owner',
+  // which replaces the run prepared before.
+  float* Prepare(const void* owner, int batch_size, int size);
+
+  // Returns the memory of the run prepared by 'owner' and sets 'batch_size',
+  // or returns nullptr if the last run was prepared by another owner or was
+  // taken already.
+  float* Take(const void* owner, int* batch_size);
+
+  int64 capacity_bytes() const { return buffer_.capacity() * sizeof(float); }
+
+ private:
+  std::vector<float> buffer_;
+  const void* owner_ = nullptr;
+  int batch_size_ = 0;
+};
+
+// A helper function that returns the logits tensor with the given index of an
+// interpreter whose outputs are computed.
+TensorView<float> GetLogitsHelper(const int output_index_logits,
+                                  tflite::Interpreter* interpreter);
+
 // Executor for the text selection prediction and classification models.
 class ModelExecutor {
  public:
   static std::unique_ptr<const ModelExecutor> Instance(
-      const flatbuffers::Vector<uint8_t>* model_spec_buffer) {
+      const flatbuffers::Vector<uint8_t>* model_spec_buffer,
+      const ModelExecutorOptions& options = ModelExecutorOptions()) {
     const tflite::Model* model =
         flatbuffers::GetRoot<tflite::Model>(model_spec_buffer->data());
     flatbuffers::Verifier verifier(model_spec_buffer->data(),
@@ -54,37 +130,95 @@ class ModelExecutor {
     if (!model->Verify(verifier)) {
       return nullptr;
     }
-    return Instance(model);
+    return Instance(model, options);
   }
 
   static std::unique_ptr<const ModelExecutor> Instance(
-      const tflite::Model* model_spec) {
+      const tflite::Model* model_spec,
+      const ModelExecutorOptions& options = ModelExecutorOptions()) {
     std::unique_ptr<const tflite::FlatBufferModel> model;
     if (!internal::FromModelSpec(model_spec, &model)) {
       return nullptr;
     }
-    return std::unique_ptr<ModelExecutor>(new ModelExecutor(std::move(model)));
+    std::unique_ptr<const FeedForwardNetwork> network;
+    if (options.use_feed_forward_network && !options.use_nnapi) {
+      network = FeedForwardNetwork::FromModel(model_spec);
+    }
+    return std::unique_ptr<ModelExecutor>(new ModelExecutor(
+        std::move(model), std::move(network), options));
   }
 
   // Creates an Interpreter for the model that serves as a scratch-pad for the
-  // inference. The Interpreter is NOT thread-safe.
+  // inference, set up according to the options of the executor. The
+  // Interpreter is NOT thread-safe.
   std::unique_ptr<tflite::Interpreter> CreateInterpreter() const;
 
+  // Takes an idle interpreter from the pool, or creates a new one if the pool
+  // is empty. The interpreter must only be used by one thread at a time and
+  // should be handed back with ReleaseInterpreter() when done.
+  // Thread-safe.
+  std::unique_ptr<tflite::Interpreter> AcquireInterpreter() const;
+
+  // Returns an interpreter obtained from AcquireInterpreter() to the pool. If
+  // the pool already holds max_pooled_interpreters idle interpreters, the
+  // interpreter is destroyed instead.
+  // Thread-safe.
+  void ReleaseInterpreter(std::unique_ptr<tflite::Interpreter> interpreter)
+      const;
+
+  // Destroys the idle interpreters in the pool.
+  // Thread-safe.
+  void ClearInterpreterPool() const;
+
+  // Returns an estimate of the tensor memory held by the idle interpreters in
+  // the pool, in bytes. Interpreters in use are not counted.
+  // Thread-safe.
+  int64 EstimatePooledInterpreterBytes() const;
+
   TensorView<float> ComputeLogits(const TensorView<float>& features,
-                                  tflite::Interpreter* interpreter) const {
-    return ComputeLogitsHelper(kInputIndexFeatures, kOutputIndexLogits,
-                               features, interpreter);
+                                  tflite::Interpreter* interpreter) const;
+
+  // Two-step alternative to ComputeLogits() that avoids copying the features:
+  // PrepareFeaturesInput() returns the input tensor of the given shape to be
+  // filled in, and ComputeLogitsFromInput() runs the inference on it.
+  // With the scratch arena, the input is in the arena of the calling thread,
+  // and ComputeLogitsFromInput() has to follow on the same thread.
+  float* PrepareFeaturesInput(const std::vector<int>& shape,
+                              tflite::Interpreter* interpreter) const;
+
+  TensorView<float> ComputeLogitsFromInput(
+      tflite::Interpreter* interpreter) const;
+
+  // Returns whether the logits are computed by a FeedForwardNetwork rather
+  // than by invoking the interpreter.
+  bool uses_feed_forward_network() const { return network_ != nullptr; }
+
+  // Returns whether the inputs and outputs are kept in the ScratchArena.
+  bool uses_scratch_arena() const {
+    return network_ != nullptr && options_.use_scratch_arena &&
+           network_->runs_on_buffers();
   }
 
  protected:
-  explicit ModelExecutor(std::unique_ptr<const tflite::FlatBufferModel> model)
-      : model_(std::move(model)) {}
+  ModelExecutor(std::unique_ptr<const tflite::FlatBufferModel> model,
+                std::unique_ptr<const FeedForwardNetwork> network,
+                const ModelExecutorOptions& options)
+      : model_(std::move(model)),
+        network_(std::move(network)),
+        options_(options) {}
 
   static const int kInputIndexFeatures = 0;
   static const int kOutputIndexLogits = 0;
 
   std::unique_ptr<const tflite::FlatBufferModel> model_;
   tflite::ops::builtin::BuiltinOpResolver builtins_;
+  // The model as a feed-forward network, or nullptr if it is not one.
+  std::unique_ptr<const FeedForwardNetwork> network_;
+  const ModelExecutorOptions options_;
+
+  // Idle interpreters ready for reuse, guarded by interpreter_pool_mutex_.
+  mutable std::mutex interpreter_pool_mutex_;
+  mutable std::vector<std::unique_ptr<tflite::Interpreter>> interpreter_pool_;
 };
 
 // Executor for embedding sparse features into a dense vector.
@@ -99,17 +233,24 @@ class EmbeddingExecutor {
 
   // Returns true when the model is ready to be used, false otherwise.
   virtual bool IsReady() const { return true; }
+
+  // Returns an estimate of the heap memory held, in bytes, without the model
+  // buffer.
+  virtual int64 EstimateHeapBytes() const { return 0; }
 };
 
 class TFLiteEmbeddingExecutor : public EmbeddingExecutor {
  public:
+  // If 'verify_model' is false, the model is trusted to be well-formed.
   static std::unique_ptr<TFLiteEmbeddingExecutor> Instance(
       const flatbuffers::Vector<uint8_t>* model_spec_buffer, int embedding_size,
-      int quantization_bits);
+      int quantization_bits, bool verify_model = true);
 
   bool AddEmbedding(const TensorView<int>& sparse_features, float* dest,
                     int dest_size) const override;
 
+  int64 EstimateHeapBytes() const override;
+
  protected:
   explicit TFLiteEmbeddingExecutor(
       std::unique_ptr<const tflite::FlatBufferModel> model,
@@ -124,6 +265,9 @@ class TFLiteEmbeddingExecutor : public EmbeddingExecutor {
   int num_buckets_ = -1;
   int bytes_per_embedding_ = -1;
   int output_embedding_size_ = -1;
+  // DequantizeAddMany(), or a version of it compiled for the quantization bits
+  // and embedding size of the model.
+  DequantizeAddManyFunction dequantize_add_many_ = nullptr;
   const TfLiteTensor* scales_ = nullptr;
   const TfLiteTensor* embeddings_ = nullptr;
 
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "model-router.h"
+
+#include "util/base/logging.h"
+#include "util/memory/mmap.h"
+#include "util/strings/split.h"
+
+namespace libtextclassifier2 {
+
+std::unique_ptr<ModelRouter> ModelRouter::FromPaths(
+    const std::vector<std::string>& paths, const UniLib* unilib,
+    const ModelRouterOptions& options) {
+  std::vector<ModelEntry> models;
+  for (const std::string& path : paths) {
+    // Only the metadata is read, and the mapping is dropped right away, so
+    // the models cost nothing until they are loaded.
+    ScopedMmap mmap(path);
+    if (!mmap.handle().ok()) {
+      TC_LOG(ERROR) << "Could not map model: " << path;
+      continue;
+    }
+    const Model* model =
+        ViewModelMetadata(mmap.handle().start(), mmap.handle().num_bytes());
+    if (model == nullptr || model->locales() == nullptr) {
+      TC_LOG(ERROR) << "Could not read the locales of model: " << path;
+      continue;
+    }
+
+    ModelEntry entry;
+    entry.path = path;
+    for (const StringPiece locale_tag :
+         strings::Split(model->locales()->str(), ',')) {
+      if (locale_tag.ToString() == "*") {
+        entry.matches_all_locales = true;
+        continue;
+      }
+      const Locale locale = Locale::FromBCP47(locale_tag.ToString());
+      if (locale.IsValid()) {
+        entry.locales.push_back(locale);
+      }
+    }
+    models.push_back(std::move(entry));
+  }
+  if (models.empty()) {
+    return nullptr;
+  }
+  return std::unique_ptr<ModelRouter>(
+      new ModelRouter(std::move(models), unilib, options));
+}
+
+int ModelRouter::FindModel(const std::string& locales) const {
+  for (const StringPiece locale_tag : strings::Split(locales, ',')) {
+    const Locale locale = Locale::FromBCP47(locale_tag.ToString());
+    if (!locale.IsValid()) {
+      continue;
+    }
+
+    // A model with the script of the locale beats one without any script,
+    // e.g. "zh-Hant" goes to a "zh-Hant" model rather than a "zh" one.
+    int best_model = -1;
+    int best_score = 0;
+    for (int i = 0; i < models_.size(); ++i) {
+      for (const Locale& model_locale : models_[i].locales) {
+        if (model_locale.Language() != locale.Language()) {
+          continue;
+        }
+        int score = 0;
+        if (model_locale.Script().empty()) {
+          score = 1;
+        } else if (model_locale.Script() == locale.Script()) {
+          score = 2;
+        }
+        if (score > best_score) {
+          best_model = i;
+          best_score = score;
+        }
+      }
+    }
+    if (best_model >= 0) {
+      return best_model;
+    }
+  }
+
+  for (int i = 0; i < models_.size(); ++i) {
+    if (models_[i].matches_all_locales) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+std::shared_ptr<const TextClassifier> ModelRouter::Get(
+    const std::string& locales) {
+  const int model_index = FindModel(locales);
+  if (model_index < 0) {
+    return nullptr;
+  }
+  ModelEntry* model = &models_[model_index];
+
+  // Loading under the lock makes concurrent calls for the same model wait for
+  // the first one, instead of loading it several times.
+  std::lock_guard<std::mutex> lock(mutex_);
+  model->last_use = ++num_uses_;
+  if (model->classifier != nullptr) {
+    return model->classifier;
+  }
+
+  if (options_.max_loaded_models > 0) {
+    int num_loaded = 0;
+    for (const ModelEntry& entry : models_) {
+      if (entry.classifier != nullptr) {
+        ++num_loaded;
+      }
+    }
+    if (num_loaded >= options_.max_loaded_models) {
+      EvictOneModel();
+    }
+  }
+
+  model->classifier.reset(
+      TextClassifier::FromPath(model->path, unilib_, options_.verify_model,
+                               options_.execution_options)
+          .release());
+  if (model->classifier == nullptr) {
+    TC_LOG(ERROR) << "Could not load model: " << model->path;
+  }
+  return model->classifier;
+}
+
+void ModelRouter::EvictOneModel() {
+  ModelEntry* least_recently_used = nullptr;
+  for (ModelEntry& entry : models_) {
+    // Models that callers still hold would not be freed anyway.
+    if (entry.classifier == nullptr || entry.classifier.use_count() > 1) {
+      continue;
+    }
+    if (least_recently_used == nullptr ||
+        entry.last_use < least_recently_used->last_use) {
+      least_recently_used = &entry;
+    }
+  }
+  if (least_recently_used != nullptr) {
+    least_recently_used->classifier.reset();
+  }
+}
+
+void ModelRouter::TrimMemory() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (ModelEntry& entry : models_) {
+    if (entry.classifier != nullptr && entry.classifier.use_count() == 1) {
+      entry.classifier.reset();
+    }
+  }
+}
+
+int ModelRouter::num_loaded_models() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  int num_loaded = 0;
+  for (const ModelEntry& entry : models_) {
+    if (entry.classifier != nullptr) {
+      ++num_loaded;
+    }
+  }
+  return num_loaded;
+}
+
+}  // namespace libtextclassifier2
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Routes calls to the model of their language, out of a set of per-language
+// models that are only loaded when they are first needed.
+
+#ifndef LIBTEXTCLASSIFIER_MODEL_ROUTER_H_
+#define LIBTEXTCLASSIFIER_MODEL_ROUTER_H_
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "text-classifier.h"
+#include "util/base/integral_types.h"
+#include "util/base/macros.h"
+#include "util/i18n/locale.h"
+#include "util/utf8/unilib.h"
+
+namespace libtextclassifier2 {
+
+struct ModelRouterOptions {
+  // The maximum number of models kept loaded. Loading another one unloads the
+  // least recently used of the ones that no caller holds. Zero means no limit.
+  int max_loaded_models = 0;
+
+  // For loading the models.
+  bool verify_model = true;
+  ModelExecutionOptions execution_options;
+};
+
+// Indexes the models by the 'locales' in their metadata, without loading them,
+// and loads a model when a call for one of its locales first comes. A model
+// matches a locale if it has one with the same language, and the same script,
+// or no script at all; a model for "*" takes the locales that no other model
+// matches.
+// Thread-safe.
+class ModelRouter {
+ public:
+  // Models whose metadata can't be read are skipped. Returns nullptr if none
+  // of them can. 'unilib' has to outlive the router.
+  static std::unique_ptr<ModelRouter> FromPaths(
+      const std::vector<std::string>& paths, const UniLib* unilib = nullptr,
+      const ModelRouterOptions& options = ModelRouterOptions());
+
+  // Returns the classifier for the first of the comma-separated BCP 47
+  // 'locales' that a model matches, loading it if needed, or nullptr if no
+  // model matches or the model can't be loaded. The classifier stays valid for
+  // as long as the caller holds it, even if the router unloads it.
+  std::shared_ptr<const TextClassifier> Get(const std::string& locales);
+
+  // Unloads the models that no caller holds, e.g. when the process is asked to
+  // free memory. They are loaded again when needed.
+  void TrimMemory();
+
+  int num_models() const { return models_.size(); }
+  int num_loaded_models() const;
+
+ private:
+  struct ModelEntry {
+    std::string path;
+    std::vector<Locale> locales;
+    bool matches_all_locales = false;
+
+    // Guarded by mutex_.
+    std::shared_ptr<const TextClassifier> classifier;
+    int64 last_use = 0;
+  };
+
+  ModelRouter(std::vector<ModelEntry> models, const UniLib* unilib,
+              const ModelRouterOptions& options)
+      : models_(std::move(models)), unilib_(unilib), options_(options) {}
+
+  // Returns the index of the model for 'locales', or -1.
+  int FindModel(const std::string& locales) const;
+
+  // Unloads the least recently used model that no caller holds, if any.
+  // Requires mutex_.
+  void EvictOneModel();
+
+  // Immutable apart from the loaded classifiers.
+  std::vector<ModelEntry> models_;
+  const UniLib* unilib_;
+  const ModelRouterOptions options_;
+
+  mutable std::mutex mutex_;
+  int64 num_uses_ = 0;
+
+  TC_DISALLOW_COPY_AND_ASSIGN(ModelRouter);
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_MODEL_ROUTER_H_
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "model-router.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+std::string GetModelPath() {
+  return LIBTEXTCLASSIFIER_TEST_DATA_DIR;
+}
+
+TEST(ModelRouterTest, LoadsModelsOnFirstUse) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<ModelRouter> router =
+      ModelRouter::FromPaths({GetModelPath() + "test_model.fb",
+                              GetModelPath() + "no_such_model.fb"},
+                             &unilib);
+  ASSERT_TRUE(router);
+  EXPECT_EQ(router->num_models(), 1);
+  EXPECT_EQ(router->num_loaded_models(), 0);
+
+  // The test model is for "en".
+  std::shared_ptr<const TextClassifier> classifier = router->Get("de,en-US");
+  ASSERT_TRUE(classifier);
+  EXPECT_EQ(router->num_loaded_models(), 1);
+  EXPECT_EQ(router->Get("en"), classifier);
+
+  EXPECT_TRUE(router->Get("de") == nullptr);
+  EXPECT_TRUE(router->Get("") == nullptr);
+}
+
+TEST(ModelRouterTest, TrimMemoryUnloadsUnusedModels) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<ModelRouter> router =
+      ModelRouter::FromPaths({GetModelPath() + "test_model.fb"}, &unilib);
+  ASSERT_TRUE(router);
+
+  std::shared_ptr<const TextClassifier> classifier = router->Get("en");
+  ASSERT_TRUE(classifier);
+
+  // Held by a caller, so it stays.
+  router->TrimMemory();
+  EXPECT_EQ(router->num_loaded_models(), 1);
+  EXPECT_EQ(router->Get("en"), classifier);
+
+  classifier.reset();
+  router->TrimMemory();
+  EXPECT_EQ(router->num_loaded_models(), 0);
+  EXPECT_TRUE(router->Get("en"));
+  EXPECT_EQ(router->num_loaded_models(), 1);
+}
+
+TEST(ModelRouterTest, FailsWithoutModels) {
+  EXPECT_TRUE(ModelRouter::FromPaths({GetModelPath() + "no_such_model.fb"}) ==
+              nullptr);
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
@@ -92,6 +92,9 @@ struct BoundsSensitiveFeaturesT;
 struct AlternativeCollectionMapEntry;
 struct AlternativeCollectionMapEntryT;
 
+struct PrecomputedEmbeddings;
+struct PrecomputedEmbeddingsT;
+
 }  // namespace FeatureProcessorOptions_
 
 struct FeatureProcessorOptions;
@@ -573,8 +576,10 @@ struct CompressedBufferT : public flatbuffers::NativeTable {
   typedef CompressedBuffer TableType;
   std::vector<uint8_t> buffer;
   int32_t uncompressed_size;
+  bool self_contained;
   CompressedBufferT()
-      : uncompressed_size(0) {
+      : uncompressed_size(0),
+        self_contained(false) {
   }
 };
 
@@ -582,7 +587,8 @@ struct CompressedBuffer FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
   typedef CompressedBufferT NativeTableType;
   enum {
     VT_BUFFER = 4,
-    VT_UNCOMPRESSED_SIZE = 6
+    VT_UNCOMPRESSED_SIZE = 6,
+    VT_SELF_CONTAINED = 8
   };
   const flatbuffers::Vector<uint8_t> *buffer() const {
     return GetPointer<const flatbuffers::Vector<uint8_t> *>(VT_BUFFER);
@@ -590,11 +596,15 @@ struct CompressedBuffer FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
   int32_t uncompressed_size() const {
     return GetField<int32_t>(VT_UNCOMPRESSED_SIZE, 0);
   }
+  bool self_contained() const {
+    return GetField<uint8_t>(VT_SELF_CONTAINED, 0) != 0;
+  }
   bool Verify(flatbuffers::Verifier &verifier) const {
     return VerifyTableStart(verifier) &&
            VerifyOffset(verifier, VT_BUFFER) &&
            verifier.Verify(buffer()) &&
            VerifyField<int32_t>(verifier, VT_UNCOMPRESSED_SIZE) &&
+           VerifyField<uint8_t>(verifier, VT_SELF_CONTAINED) &&
            verifier.EndTable();
   }
   CompressedBufferT *UnPack(const flatbuffers::resolver_function_t *_resolver = nullptr) const;
@@ -611,6 +621,9 @@ struct CompressedBufferBuilder {
   void add_uncompressed_size(int32_t uncompressed_size) {
     fbb_.AddElement<int32_t>(CompressedBuffer::VT_UNCOMPRESSED_SIZE, uncompressed_size, 0);
   }
+  void add_self_contained(bool self_contained) {
+    fbb_.AddElement<uint8_t>(CompressedBuffer::VT_SELF_CONTAINED, static_cast<uint8_t>(self_contained), 0);
+  }
   explicit CompressedBufferBuilder(flatbuffers::FlatBufferBuilder &_fbb)
         : fbb_(_fbb) {
     start_ = fbb_.StartTable();
@@ -626,21 +639,25 @@ struct CompressedBufferBuilder {
 inline flatbuffers::Offset<CompressedBuffer> CreateCompressedBuffer(
     flatbuffers::FlatBufferBuilder &_fbb,
     flatbuffers::Offset<flatbuffers::Vector<uint8_t>> buffer = 0,
-    int32_t uncompressed_size = 0) {
+    int32_t uncompressed_size = 0,
+    bool self_contained = false) {
   CompressedBufferBuilder builder_(_fbb);
   builder_.add_uncompressed_size(uncompressed_size);
   builder_.add_buffer(buffer);
+  builder_.add_self_contained(self_contained);
   return builder_.Finish();
 }
 
 inline flatbuffers::Offset<CompressedBuffer> CreateCompressedBufferDirect(
     flatbuffers::FlatBufferBuilder &_fbb,
     const std::vector<uint8_t> *buffer = nullptr,
-    int32_t uncompressed_size = 0) {
+    int32_t uncompressed_size = 0,
+    bool self_contained = false) {
   return libtextclassifier2::CreateCompressedBuffer(
       _fbb,
       buffer ? _fbb.CreateVector<uint8_t>(*buffer) : 0,
-      uncompressed_size);
+      uncompressed_size,
+      self_contained);
 }
 
 flatbuffers::Offset<CompressedBuffer> CreateCompressedBuffer(flatbuffers::FlatBufferBuilder &_fbb, const CompressedBufferT *_o, const flatbuffers::rehasher_function_t *_rehasher = nullptr);
@@ -651,11 +668,17 @@ struct SelectionModelOptionsT : public flatbuffers::NativeTable {
   int32_t symmetry_context_size;
   int32_t batch_size;
   bool always_classify_suggested_selection;
+  bool pruned_bounds_sensitive_search;
+  float pruning_min_score;
+  int32_t pruning_patience;
   SelectionModelOptionsT()
       : strip_unpaired_brackets(true),
         symmetry_context_size(0),
         batch_size(1024),
-        always_classify_suggested_selection(false) {
+        always_classify_suggested_selection(false),
+        pruned_bounds_sensitive_search(false),
+        pruning_min_score(0.0f),
+        pruning_patience(2) {
   }
 };
 
@@ -665,7 +688,10 @@ struct SelectionModelOptions FLATBUFFERS_FINAL_CLASS : private flatbuffers::Tabl
     VT_STRIP_UNPAIRED_BRACKETS = 4,
     VT_SYMMETRY_CONTEXT_SIZE = 6,
     VT_BATCH_SIZE = 8,
-    VT_ALWAYS_CLASSIFY_SUGGESTED_SELECTION = 10
+    VT_ALWAYS_CLASSIFY_SUGGESTED_SELECTION = 10,
+    VT_PRUNED_BOUNDS_SENSITIVE_SEARCH = 12,
+    VT_PRUNING_MIN_SCORE = 14,
+    VT_PRUNING_PATIENCE = 16
   };
   bool strip_unpaired_brackets() const {
     return GetField<uint8_t>(VT_STRIP_UNPAIRED_BRACKETS, 1) != 0;
@@ -679,12 +705,24 @@ struct SelectionModelOptions FLATBUFFERS_FINAL_CLASS : private flatbuffers::Tabl
   bool always_classify_suggested_selection() const {
     return GetField<uint8_t>(VT_ALWAYS_CLASSIFY_SUGGESTED_SELECTION, 0) != 0;
   }
+  bool pruned_bounds_sensitive_search() const {
+    return GetField<uint8_t>(VT_PRUNED_BOUNDS_SENSITIVE_SEARCH, 0) != 0;
+  }
+  float pruning_min_score() const {
+    return GetField<float>(VT_PRUNING_MIN_SCORE, 0.0f);
+  }
+  int32_t pruning_patience() const {
+    return GetField<int32_t>(VT_PRUNING_PATIENCE, 2);
+  }
   bool Verify(flatbuffers::Verifier &verifier) const {
     return VerifyTableStart(verifier) &&
            VerifyField<uint8_t>(verifier, VT_STRIP_UNPAIRED_BRACKETS) &&
            VerifyField<int32_t>(verifier, VT_SYMMETRY_CONTEXT_SIZE) &&
            VerifyField<int32_t>(verifier, VT_BATCH_SIZE) &&
            VerifyField<uint8_t>(verifier, VT_ALWAYS_CLASSIFY_SUGGESTED_SELECTION) &&
+           VerifyField<uint8_t>(verifier, VT_PRUNED_BOUNDS_SENSITIVE_SEARCH) &&
+           VerifyField<float>(verifier, VT_PRUNING_MIN_SCORE) &&
+           VerifyField<int32_t>(verifier, VT_PRUNING_PATIENCE) &&
            verifier.EndTable();
   }
   SelectionModelOptionsT *UnPack(const flatbuffers::resolver_function_t *_resolver = nullptr) const;
@@ -707,6 +745,15 @@ struct SelectionModelOptionsBuilder {
   void add_always_classify_suggested_selection(bool always_classify_suggested_selection) {
     fbb_.AddElement<uint8_t>(SelectionModelOptions::VT_ALWAYS_CLASSIFY_SUGGESTED_SELECTION, static_cast<uint8_t>(always_classify_suggested_selection), 0);
   }
+  void add_pruned_bounds_sensitive_search(bool pruned_bounds_sensitive_search) {
+    fbb_.AddElement<uint8_t>(SelectionModelOptions::VT_PRUNED_BOUNDS_SENSITIVE_SEARCH, static_cast<uint8_t>(pruned_bounds_sensitive_search), 0);
+  }
+  void add_pruning_min_score(float pruning_min_score) {
+    fbb_.AddElement<float>(SelectionModelOptions::VT_PRUNING_MIN_SCORE, pruning_min_score, 0.0f);
+  }
+  void add_pruning_patience(int32_t pruning_patience) {
+    fbb_.AddElement<int32_t>(SelectionModelOptions::VT_PRUNING_PATIENCE, pruning_patience, 2);
+  }
   explicit SelectionModelOptionsBuilder(flatbuffers::FlatBufferBuilder &_fbb)
         : fbb_(_fbb) {
     start_ = fbb_.StartTable();
@@ -724,10 +771,16 @@ inline flatbuffers::Offset<SelectionModelOptions> CreateSelectionModelOptions(
     bool strip_unpaired_brackets = true,
     int32_t symmetry_context_size = 0,
     int32_t batch_size = 1024,
-    bool always_classify_suggested_selection = false) {
+    bool always_classify_suggested_selection = false,
+    bool pruned_bounds_sensitive_search = false,
+    float pruning_min_score = 0.0f,
+    int32_t pruning_patience = 2) {
   SelectionModelOptionsBuilder builder_(_fbb);
+  builder_.add_pruning_patience(pruning_patience);
+  builder_.add_pruning_min_score(pruning_min_score);
   builder_.add_batch_size(batch_size);
   builder_.add_symmetry_context_size(symmetry_context_size);
+  builder_.add_pruned_bounds_sensitive_search(pruned_bounds_sensitive_search);
   builder_.add_always_classify_suggested_selection(always_classify_suggested_selection);
   builder_.add_strip_unpaired_brackets(strip_unpaired_brackets);
   return builder_.Finish();
@@ -741,11 +794,13 @@ struct ClassificationModelOptionsT : public flatbuffers::NativeTable {
   int32_t phone_max_num_digits;
   int32_t address_min_num_tokens;
   int32_t max_num_tokens;
+  int32_t batch_size;
   ClassificationModelOptionsT()
       : phone_min_num_digits(7),
         phone_max_num_digits(15),
         address_min_num_tokens(0),
-        max_num_tokens(-1) {
+        max_num_tokens(-1),
+        batch_size(1024) {
   }
 };
 
@@ -755,7 +810,8 @@ struct ClassificationModelOptions FLATBUFFERS_FINAL_CLASS : private flatbuffers:
     VT_PHONE_MIN_NUM_DIGITS = 4,
     VT_PHONE_MAX_NUM_DIGITS = 6,
     VT_ADDRESS_MIN_NUM_TOKENS = 8,
-    VT_MAX_NUM_TOKENS = 10
+    VT_MAX_NUM_TOKENS = 10,
+    VT_BATCH_SIZE = 12
   };
   int32_t phone_min_num_digits() const {
     return GetField<int32_t>(VT_PHONE_MIN_NUM_DIGITS, 7);
@@ -769,12 +825,16 @@ struct ClassificationModelOptions FLATBUFFERS_FINAL_CLASS : private flatbuffers:
   int32_t max_num_tokens() const {
     return GetField<int32_t>(VT_MAX_NUM_TOKENS, -1);
   }
+  int32_t batch_size() const {
+    return GetField<int32_t>(VT_BATCH_SIZE, 1024);
+  }
   bool Verify(flatbuffers::Verifier &verifier) const {
     return VerifyTableStart(verifier) &&
            VerifyField<int32_t>(verifier, VT_PHONE_MIN_NUM_DIGITS) &&
            VerifyField<int32_t>(verifier, VT_PHONE_MAX_NUM_DIGITS) &&
            VerifyField<int32_t>(verifier, VT_ADDRESS_MIN_NUM_TOKENS) &&
            VerifyField<int32_t>(verifier, VT_MAX_NUM_TOKENS) &&
+           VerifyField<int32_t>(verifier, VT_BATCH_SIZE) &&
            verifier.EndTable();
   }
   ClassificationModelOptionsT *UnPack(const flatbuffers::resolver_function_t *_resolver = nullptr) const;
@@ -797,6 +857,9 @@ struct ClassificationModelOptionsBuilder {
   void add_max_num_tokens(int32_t max_num_tokens) {
     fbb_.AddElement<int32_t>(ClassificationModelOptions::VT_MAX_NUM_TOKENS, max_num_tokens, -1);
   }
+  void add_batch_size(int32_t batch_size) {
+    fbb_.AddElement<int32_t>(ClassificationModelOptions::VT_BATCH_SIZE, batch_size, 1024);
+  }
   explicit ClassificationModelOptionsBuilder(flatbuffers::FlatBufferBuilder &_fbb)
         : fbb_(_fbb) {
     start_ = fbb_.StartTable();
@@ -814,8 +877,10 @@ inline flatbuffers::Offset<ClassificationModelOptions> CreateClassificationModel
     int32_t phone_min_num_digits = 7,
     int32_t phone_max_num_digits = 15,
     int32_t address_min_num_tokens = 0,
-    int32_t max_num_tokens = -1) {
+    int32_t max_num_tokens = -1,
+    int32_t batch_size = 1024) {
   ClassificationModelOptionsBuilder builder_(_fbb);
+  builder_.add_batch_size(batch_size);
   builder_.add_max_num_tokens(max_num_tokens);
   builder_.add_address_min_num_tokens(address_min_num_tokens);
   builder_.add_phone_max_num_digits(phone_max_num_digits);
@@ -978,23 +1043,37 @@ flatbuffers::Offset<Pattern> CreatePattern(flatbuffers::FlatBufferBuilder &_fbb,
 struct RegexModelT : public flatbuffers::NativeTable {
   typedef RegexModel TableType;
   std::vector<std::unique_ptr<libtextclassifier2::RegexModel_::PatternT>> patterns;
-  RegexModelT() {
+  int32_t regex_time_limit;
+  int32_t regex_stack_limit;
+  RegexModelT()
+      : regex_time_limit(0),
+        regex_stack_limit(0) {
   }
 };
 
 struct RegexModel FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
   typedef RegexModelT NativeTableType;
   enum {
-    VT_PATTERNS = 4
+    VT_PATTERNS = 4,
+    VT_REGEX_TIME_LIMIT = 6,
+    VT_REGEX_STACK_LIMIT = 8
   };
   const flatbuffers::Vector<flatbuffers::Offset<libtextclassifier2::RegexModel_::Pattern>> *patterns() const {
     return GetPointer<const flatbuffers::Vector<flatbuffers::Offset<libtextclassifier2::RegexModel_::Pattern>> *>(VT_PATTERNS);
   }
+  int32_t regex_time_limit() const {
+    return GetField<int32_t>(VT_REGEX_TIME_LIMIT, 0);
+  }
+  int32_t regex_stack_limit() const {
+    return GetField<int32_t>(VT_REGEX_STACK_LIMIT, 0);
+  }
   bool Verify(flatbuffers::Verifier &verifier) const {
     return VerifyTableStart(verifier) &&
            VerifyOffset(verifier, VT_PATTERNS) &&
            verifier.Verify(patterns()) &&
            verifier.VerifyVectorOfTables(patterns()) &&
+           VerifyField<int32_t>(verifier, VT_REGEX_TIME_LIMIT) &&
+           VerifyField<int32_t>(verifier, VT_REGEX_STACK_LIMIT) &&
            verifier.EndTable();
   }
   RegexModelT *UnPack(const flatbuffers::resolver_function_t *_resolver = nullptr) const;
@@ -1008,6 +1087,12 @@ struct RegexModelBuilder {
   void add_patterns(flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<libtextclassifier2::RegexModel_::Pattern>>> patterns) {
     fbb_.AddOffset(RegexModel::VT_PATTERNS, patterns);
   }
+  void add_regex_time_limit(int32_t regex_time_limit) {
+    fbb_.AddElement<int32_t>(RegexModel::VT_REGEX_TIME_LIMIT, regex_time_limit, 0);
+  }
+  void add_regex_stack_limit(int32_t regex_stack_limit) {
+    fbb_.AddElement<int32_t>(RegexModel::VT_REGEX_STACK_LIMIT, regex_stack_limit, 0);
+  }
   explicit RegexModelBuilder(flatbuffers::FlatBufferBuilder &_fbb)
         : fbb_(_fbb) {
     start_ = fbb_.StartTable();
@@ -1022,18 +1107,26 @@ struct RegexModelBuilder {
 
 inline flatbuffers::Offset<RegexModel> CreateRegexModel(
     flatbuffers::FlatBufferBuilder &_fbb,
-    flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<libtextclassifier2::RegexModel_::Pattern>>> patterns = 0) {
+    flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<libtextclassifier2::RegexModel_::Pattern>>> patterns = 0,
+    int32_t regex_time_limit = 0,
+    int32_t regex_stack_limit = 0) {
   RegexModelBuilder builder_(_fbb);
+  builder_.add_regex_stack_limit(regex_stack_limit);
+  builder_.add_regex_time_limit(regex_time_limit);
   builder_.add_patterns(patterns);
   return builder_.Finish();
 }
 
 inline flatbuffers::Offset<RegexModel> CreateRegexModelDirect(
     flatbuffers::FlatBufferBuilder &_fbb,
-    const std::vector<flatbuffers::Offset<libtextclassifier2::RegexModel_::Pattern>> *patterns = nullptr) {
+    const std::vector<flatbuffers::Offset<libtextclassifier2::RegexModel_::Pattern>> *patterns = nullptr,
+    int32_t regex_time_limit = 0,
+    int32_t regex_stack_limit = 0) {
   return libtextclassifier2::CreateRegexModel(
       _fbb,
-      patterns ? _fbb.CreateVector<flatbuffers::Offset<libtextclassifier2::RegexModel_::Pattern>>(*patterns) : 0);
+      patterns ? _fbb.CreateVector<flatbuffers::Offset<libtextclassifier2::RegexModel_::Pattern>>(*patterns) : 0,
+      regex_time_limit,
+      regex_stack_limit);
 }
 
 flatbuffers::Offset<RegexModel> CreateRegexModel(flatbuffers::FlatBufferBuilder &_fbb, const RegexModelT *_o, const flatbuffers::rehasher_function_t *_rehasher = nullptr);
@@ -1362,8 +1455,14 @@ struct DatetimeModelT : public flatbuffers::NativeTable {
   std::vector<std::unique_ptr<DatetimeModelExtractorT>> extractors;
   bool use_extractors_for_locating;
   std::vector<int32_t> default_locales;
+  bool use_rule_prefilter;
+  int32_t regex_time_limit;
+  int32_t regex_stack_limit;
   DatetimeModelT()
-      : use_extractors_for_locating(true) {
+      : use_extractors_for_locating(true),
+        use_rule_prefilter(false),
+        regex_time_limit(0),
+        regex_stack_limit(0) {
   }
 };
 
@@ -1374,7 +1473,10 @@ struct DatetimeModel FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
     VT_PATTERNS = 6,
     VT_EXTRACTORS = 8,
     VT_USE_EXTRACTORS_FOR_LOCATING = 10,
-    VT_DEFAULT_LOCALES = 12
+    VT_DEFAULT_LOCALES = 12,
+    VT_USE_RULE_PREFILTER = 14,
+    VT_REGEX_TIME_LIMIT = 16,
+    VT_REGEX_STACK_LIMIT = 18
   };
   const flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>> *locales() const {
     return GetPointer<const flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>> *>(VT_LOCALES);
@@ -1391,6 +1493,15 @@ struct DatetimeModel FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
   const flatbuffers::Vector<int32_t> *default_locales() const {
     return GetPointer<const flatbuffers::Vector<int32_t> *>(VT_DEFAULT_LOCALES);
   }
+  bool use_rule_prefilter() const {
+    return GetField<uint8_t>(VT_USE_RULE_PREFILTER, 0) != 0;
+  }
+  int32_t regex_time_limit() const {
+    return GetField<int32_t>(VT_REGEX_TIME_LIMIT, 0);
+  }
+  int32_t regex_stack_limit() const {
+    return GetField<int32_t>(VT_REGEX_STACK_LIMIT, 0);
+  }
   bool Verify(flatbuffers::Verifier &verifier) const {
     return VerifyTableStart(verifier) &&
            VerifyOffset(verifier, VT_LOCALES) &&
@@ -1405,6 +1516,9 @@ struct DatetimeModel FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
            VerifyField<uint8_t>(verifier, VT_USE_EXTRACTORS_FOR_LOCATING) &&
            VerifyOffset(verifier, VT_DEFAULT_LOCALES) &&
            verifier.Verify(default_locales()) &&
+           VerifyField<uint8_t>(verifier, VT_USE_RULE_PREFILTER) &&
+           VerifyField<int32_t>(verifier, VT_REGEX_TIME_LIMIT) &&
+           VerifyField<int32_t>(verifier, VT_REGEX_STACK_LIMIT) &&
            verifier.EndTable();
   }
   DatetimeModelT *UnPack(const flatbuffers::resolver_function_t *_resolver = nullptr) const;
@@ -1430,6 +1544,15 @@ struct DatetimeModelBuilder {
   void add_default_locales(flatbuffers::Offset<flatbuffers::Vector<int32_t>> default_locales) {
     fbb_.AddOffset(DatetimeModel::VT_DEFAULT_LOCALES, default_locales);
   }
+  void add_use_rule_prefilter(bool use_rule_prefilter) {
+    fbb_.AddElement<uint8_t>(DatetimeModel::VT_USE_RULE_PREFILTER, static_cast<uint8_t>(use_rule_prefilter), 0);
+  }
+  void add_regex_time_limit(int32_t regex_time_limit) {
+    fbb_.AddElement<int32_t>(DatetimeModel::VT_REGEX_TIME_LIMIT, regex_time_limit, 0);
+  }
+  void add_regex_stack_limit(int32_t regex_stack_limit) {
+    fbb_.AddElement<int32_t>(DatetimeModel::VT_REGEX_STACK_LIMIT, regex_stack_limit, 0);
+  }
   explicit DatetimeModelBuilder(flatbuffers::FlatBufferBuilder &_fbb)
         : fbb_(_fbb) {
     start_ = fbb_.StartTable();
@@ -1448,12 +1571,18 @@ inline flatbuffers::Offset<DatetimeModel> CreateDatetimeModel(
     flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<DatetimeModelPattern>>> patterns = 0,
     flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<DatetimeModelExtractor>>> extractors = 0,
     bool use_extractors_for_locating = true,
-    flatbuffers::Offset<flatbuffers::Vector<int32_t>> default_locales = 0) {
+    flatbuffers::Offset<flatbuffers::Vector<int32_t>> default_locales = 0,
+    bool use_rule_prefilter = false,
+    int32_t regex_time_limit = 0,
+    int32_t regex_stack_limit = 0) {
   DatetimeModelBuilder builder_(_fbb);
+  builder_.add_regex_stack_limit(regex_stack_limit);
+  builder_.add_regex_time_limit(regex_time_limit);
   builder_.add_default_locales(default_locales);
   builder_.add_extractors(extractors);
   builder_.add_patterns(patterns);
   builder_.add_locales(locales);
+  builder_.add_use_rule_prefilter(use_rule_prefilter);
   builder_.add_use_extractors_for_locating(use_extractors_for_locating);
   return builder_.Finish();
 }
@@ -1464,14 +1593,20 @@ inline flatbuffers::Offset<DatetimeModel> CreateDatetimeModelDirect(
     const std::vector<flatbuffers::Offset<DatetimeModelPattern>> *patterns = nullptr,
     const std::vector<flatbuffers::Offset<DatetimeModelExtractor>> *extractors = nullptr,
     bool use_extractors_for_locating = true,
-    const std::vector<int32_t> *default_locales = nullptr) {
+    const std::vector<int32_t> *default_locales = nullptr,
+    bool use_rule_prefilter = false,
+    int32_t regex_time_limit = 0,
+    int32_t regex_stack_limit = 0) {
   return libtextclassifier2::CreateDatetimeModel(
       _fbb,
       locales ? _fbb.CreateVector<flatbuffers::Offset<flatbuffers::String>>(*locales) : 0,
       patterns ? _fbb.CreateVector<flatbuffers::Offset<DatetimeModelPattern>>(*patterns) : 0,
       extractors ? _fbb.CreateVector<flatbuffers::Offset<DatetimeModelExtractor>>(*extractors) : 0,
       use_extractors_for_locating,
-      default_locales ? _fbb.CreateVector<int32_t>(*default_locales) : 0);
+      default_locales ? _fbb.CreateVector<int32_t>(*default_locales) : 0,
+      use_rule_prefilter,
+      regex_time_limit,
+      regex_stack_limit);
 }
 
 flatbuffers::Offset<DatetimeModel> CreateDatetimeModel(flatbuffers::FlatBufferBuilder &_fbb, const DatetimeModelT *_o, const flatbuffers::rehasher_function_t *_rehasher = nullptr);
@@ -1796,10 +1931,12 @@ struct ModelT : public flatbuffers::NativeTable {
   ModeFlag enabled_modes;
   bool snap_whitespace_selections;
   std::unique_ptr<OutputOptionsT> output_options;
+  bool lazy_regex_compilation;
   ModelT()
       : version(0),
         enabled_modes(ModeFlag_ALL),
-        snap_whitespace_selections(true) {
+        snap_whitespace_selections(true),
+        lazy_regex_compilation(false) {
   }
 };
 
@@ -1821,7 +1958,8 @@ struct Model FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
     VT_TRIGGERING_OPTIONS = 28,
     VT_ENABLED_MODES = 30,
     VT_SNAP_WHITESPACE_SELECTIONS = 32,
-    VT_OUTPUT_OPTIONS = 34
+    VT_OUTPUT_OPTIONS = 34,
+    VT_LAZY_REGEX_COMPILATION = 36
   };
   const flatbuffers::String *locales() const {
     return GetPointer<const flatbuffers::String *>(VT_LOCALES);
@@ -1871,6 +2009,9 @@ struct Model FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
   const OutputOptions *output_options() const {
     return GetPointer<const OutputOptions *>(VT_OUTPUT_OPTIONS);
   }
+  bool lazy_regex_compilation() const {
+    return GetField<uint8_t>(VT_LAZY_REGEX_COMPILATION, 0) != 0;
+  }
   bool Verify(flatbuffers::Verifier &verifier) const {
     return VerifyTableStart(verifier) &&
            VerifyOffset(verifier, VT_LOCALES) &&
@@ -1902,6 +2043,7 @@ struct Model FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
            VerifyField<uint8_t>(verifier, VT_SNAP_WHITESPACE_SELECTIONS) &&
            VerifyOffset(verifier, VT_OUTPUT_OPTIONS) &&
            verifier.VerifyTable(output_options()) &&
+           VerifyField<uint8_t>(verifier, VT_LAZY_REGEX_COMPILATION) &&
            verifier.EndTable();
   }
   ModelT *UnPack(const flatbuffers::resolver_function_t *_resolver = nullptr) const;
@@ -1960,6 +2102,9 @@ struct ModelBuilder {
   void add_output_options(flatbuffers::Offset<OutputOptions> output_options) {
     fbb_.AddOffset(Model::VT_OUTPUT_OPTIONS, output_options);
   }
+  void add_lazy_regex_compilation(bool lazy_regex_compilation) {
+    fbb_.AddElement<uint8_t>(Model::VT_LAZY_REGEX_COMPILATION, static_cast<uint8_t>(lazy_regex_compilation), 0);
+  }
   explicit ModelBuilder(flatbuffers::FlatBufferBuilder &_fbb)
         : fbb_(_fbb) {
     start_ = fbb_.StartTable();
@@ -1989,7 +2134,8 @@ inline flatbuffers::Offset<Model> CreateModel(
     flatbuffers::Offset<ModelTriggeringOptions> triggering_options = 0,
     ModeFlag enabled_modes = ModeFlag_ALL,
     bool snap_whitespace_selections = true,
-    flatbuffers::Offset<OutputOptions> output_options = 0) {
+    flatbuffers::Offset<OutputOptions> output_options = 0,
+    bool lazy_regex_compilation = false) {
   ModelBuilder builder_(_fbb);
   builder_.add_output_options(output_options);
   builder_.add_enabled_modes(enabled_modes);
@@ -2006,6 +2152,7 @@ inline flatbuffers::Offset<Model> CreateModel(
   builder_.add_name(name);
   builder_.add_version(version);
   builder_.add_locales(locales);
+  builder_.add_lazy_regex_compilation(lazy_regex_compilation);
   builder_.add_snap_whitespace_selections(snap_whitespace_selections);
   return builder_.Finish();
 }
@@ -2027,7 +2174,8 @@ inline flatbuffers::Offset<Model> CreateModelDirect(
     flatbuffers::Offset<ModelTriggeringOptions> triggering_options = 0,
     ModeFlag enabled_modes = ModeFlag_ALL,
     bool snap_whitespace_selections = true,
-    flatbuffers::Offset<OutputOptions> output_options = 0) {
+    flatbuffers::Offset<OutputOptions> output_options = 0,
+    bool lazy_regex_compilation = false) {
   return libtextclassifier2::CreateModel(
       _fbb,
       locales ? _fbb.CreateString(locales) : 0,
@@ -2045,7 +2193,8 @@ inline flatbuffers::Offset<Model> CreateModelDirect(
       triggering_options,
       enabled_modes,
       snap_whitespace_selections,
-      output_options);
+      output_options,
+      lazy_regex_compilation);
 }
 
 flatbuffers::Offset<Model> CreateModel(flatbuffers::FlatBufferBuilder &_fbb, const ModelT *_o, const flatbuffers::rehasher_function_t *_rehasher = nullptr);
@@ -2422,6 +2571,83 @@ inline flatbuffers::Offset<AlternativeCollectionMapEntry> CreateAlternativeColle
 
 flatbuffers::Offset<AlternativeCollectionMapEntry> CreateAlternativeCollectionMapEntry(flatbuffers::FlatBufferBuilder &_fbb, const AlternativeCollectionMapEntryT *_o, const flatbuffers::rehasher_function_t *_rehasher = nullptr);
 
+struct PrecomputedEmbeddingsT : public flatbuffers::NativeTable {
+  typedef PrecomputedEmbeddings TableType;
+  std::vector<std::string> tokens;
+  std::vector<float> embeddings;
+  PrecomputedEmbeddingsT() {
+  }
+};
+
+struct PrecomputedEmbeddings FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
+  typedef PrecomputedEmbeddingsT NativeTableType;
+  enum {
+    VT_TOKENS = 4,
+    VT_EMBEDDINGS = 6
+  };
+  const flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>> *tokens() const {
+    return GetPointer<const flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>> *>(VT_TOKENS);
+  }
+  const flatbuffers::Vector<float> *embeddings() const {
+    return GetPointer<const flatbuffers::Vector<float> *>(VT_EMBEDDINGS);
+  }
+  bool Verify(flatbuffers::Verifier &verifier) const {
+    return VerifyTableStart(verifier) &&
+           VerifyOffset(verifier, VT_TOKENS) &&
+           verifier.Verify(tokens()) &&
+           verifier.VerifyVectorOfStrings(tokens()) &&
+           VerifyOffset(verifier, VT_EMBEDDINGS) &&
+           verifier.Verify(embeddings()) &&
+           verifier.EndTable();
+  }
+  PrecomputedEmbeddingsT *UnPack(const flatbuffers::resolver_function_t *_resolver = nullptr) const;
+  void UnPackTo(PrecomputedEmbeddingsT *_o, const flatbuffers::resolver_function_t *_resolver = nullptr) const;
+  static flatbuffers::Offset<PrecomputedEmbeddings> Pack(flatbuffers::FlatBufferBuilder &_fbb, const PrecomputedEmbeddingsT* _o, const flatbuffers::rehasher_function_t *_rehasher = nullptr);
+};
+
+struct PrecomputedEmbeddingsBuilder {
+  flatbuffers::FlatBufferBuilder &fbb_;
+  flatbuffers::uoffset_t start_;
+  void add_tokens(flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>>> tokens) {
+    fbb_.AddOffset(PrecomputedEmbeddings::VT_TOKENS, tokens);
+  }
+  void add_embeddings(flatbuffers::Offset<flatbuffers::Vector<float>> embeddings) {
+    fbb_.AddOffset(PrecomputedEmbeddings::VT_EMBEDDINGS, embeddings);
+  }
+  explicit PrecomputedEmbeddingsBuilder(flatbuffers::FlatBufferBuilder &_fbb)
+        : fbb_(_fbb) {
+    start_ = fbb_.StartTable();
+  }
+  PrecomputedEmbeddingsBuilder &operator=(const PrecomputedEmbeddingsBuilder &);
+  flatbuffers::Offset<PrecomputedEmbeddings> Finish() {
+    const auto end = fbb_.EndTable(start_);
+    auto o = flatbuffers::Offset<PrecomputedEmbeddings>(end);
+    return o;
+  }
+};
+
+inline flatbuffers::Offset<PrecomputedEmbeddings> CreatePrecomputedEmbeddings(
+    flatbuffers::FlatBufferBuilder &_fbb,
+    flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>>> tokens = 0,
+    flatbuffers::Offset<flatbuffers::Vector<float>> embeddings = 0) {
+  PrecomputedEmbeddingsBuilder builder_(_fbb);
+  builder_.add_embeddings(embeddings);
+  builder_.add_tokens(tokens);
+  return builder_.Finish();
+}
+
+inline flatbuffers::Offset<PrecomputedEmbeddings> CreatePrecomputedEmbeddingsDirect(
+    flatbuffers::FlatBufferBuilder &_fbb,
+    const std::vector<flatbuffers::Offset<flatbuffers::String>> *tokens = nullptr,
+    const std::vector<float> *embeddings = nullptr) {
+  return libtextclassifier2::FeatureProcessorOptions_::CreatePrecomputedEmbeddings(
+      _fbb,
+      tokens ? _fbb.CreateVector<flatbuffers::Offset<flatbuffers::String>>(*tokens) : 0,
+      embeddings ? _fbb.CreateVector<float>(*embeddings) : 0);
+}
+
+flatbuffers::Offset<PrecomputedEmbeddings> CreatePrecomputedEmbeddings(flatbuffers::FlatBufferBuilder &_fbb, const PrecomputedEmbeddingsT *_o, const flatbuffers::rehasher_function_t *_rehasher = nullptr);
+
 }  // namespace FeatureProcessorOptions_
 
 struct FeatureProcessorOptionsT : public flatbuffers::NativeTable {
@@ -2457,6 +2683,7 @@ struct FeatureProcessorOptionsT : public flatbuffers::NativeTable {
   std::unique_ptr<libtextclassifier2::FeatureProcessorOptions_::BoundsSensitiveFeaturesT> bounds_sensitive_features;
   std::vector<std::string> allowed_chargrams;
   bool tokenize_on_script_change;
+  std::unique_ptr<libtextclassifier2::FeatureProcessorOptions_::PrecomputedEmbeddingsT> precomputed_embeddings;
   FeatureProcessorOptionsT()
       : num_buckets(-1),
         embedding_size(-1),
@@ -2516,7 +2743,8 @@ struct FeatureProcessorOptions FLATBUFFERS_FINAL_CLASS : private flatbuffers::Ta
     VT_IGNORED_SPAN_BOUNDARY_CODEPOINTS = 58,
     VT_BOUNDS_SENSITIVE_FEATURES = 60,
     VT_ALLOWED_CHARGRAMS = 62,
-    VT_TOKENIZE_ON_SCRIPT_CHANGE = 64
+    VT_TOKENIZE_ON_SCRIPT_CHANGE = 64,
+    VT_PRECOMPUTED_EMBEDDINGS = 66
   };
   int32_t num_buckets() const {
     return GetField<int32_t>(VT_NUM_BUCKETS, -1);
@@ -2611,6 +2839,9 @@ struct FeatureProcessorOptions FLATBUFFERS_FINAL_CLASS : private flatbuffers::Ta
   bool tokenize_on_script_change() const {
     return GetField<uint8_t>(VT_TOKENIZE_ON_SCRIPT_CHANGE, 0) != 0;
   }
+  const libtextclassifier2::FeatureProcessorOptions_::PrecomputedEmbeddings *precomputed_embeddings() const {
+    return GetPointer<const libtextclassifier2::FeatureProcessorOptions_::PrecomputedEmbeddings *>(VT_PRECOMPUTED_EMBEDDINGS);
+  }
   bool Verify(flatbuffers::Verifier &verifier) const {
     return VerifyTableStart(verifier) &&
            VerifyField<int32_t>(verifier, VT_NUM_BUCKETS) &&
@@ -2659,6 +2890,8 @@ struct FeatureProcessorOptions FLATBUFFERS_FINAL_CLASS : private flatbuffers::Ta
            verifier.Verify(allowed_chargrams()) &&
            verifier.VerifyVectorOfStrings(allowed_chargrams()) &&
            VerifyField<uint8_t>(verifier, VT_TOKENIZE_ON_SCRIPT_CHANGE) &&
+           VerifyOffset(verifier, VT_PRECOMPUTED_EMBEDDINGS) &&
+           verifier.VerifyTable(precomputed_embeddings()) &&
            verifier.EndTable();
   }
   FeatureProcessorOptionsT *UnPack(const flatbuffers::resolver_function_t *_resolver = nullptr) const;
@@ -2762,6 +2995,9 @@ struct FeatureProcessorOptionsBuilder {
   void add_tokenize_on_script_change(bool tokenize_on_script_change) {
     fbb_.AddElement<uint8_t>(FeatureProcessorOptions::VT_TOKENIZE_ON_SCRIPT_CHANGE, static_cast<uint8_t>(tokenize_on_script_change), 0);
   }
+  void add_precomputed_embeddings(flatbuffers::Offset<libtextclassifier2::FeatureProcessorOptions_::PrecomputedEmbeddings> precomputed_embeddings) {
+    fbb_.AddOffset(FeatureProcessorOptions::VT_PRECOMPUTED_EMBEDDINGS, precomputed_embeddings);
+  }
   explicit FeatureProcessorOptionsBuilder(flatbuffers::FlatBufferBuilder &_fbb)
         : fbb_(_fbb) {
     start_ = fbb_.StartTable();
@@ -2806,8 +3042,10 @@ inline flatbuffers::Offset<FeatureProcessorOptions> CreateFeatureProcessorOption
     flatbuffers::Offset<flatbuffers::Vector<int32_t>> ignored_span_boundary_codepoints = 0,
     flatbuffers::Offset<libtextclassifier2::FeatureProcessorOptions_::BoundsSensitiveFeatures> bounds_sensitive_features = 0,
     flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>>> allowed_chargrams = 0,
-    bool tokenize_on_script_change = false) {
+    bool tokenize_on_script_change = false,
+    flatbuffers::Offset<libtextclassifier2::FeatureProcessorOptions_::PrecomputedEmbeddings> precomputed_embeddings = 0) {
   FeatureProcessorOptionsBuilder builder_(_fbb);
+  builder_.add_precomputed_embeddings(precomputed_embeddings);
   builder_.add_allowed_chargrams(allowed_chargrams);
   builder_.add_bounds_sensitive_features(bounds_sensitive_features);
   builder_.add_ignored_span_boundary_codepoints(ignored_span_boundary_codepoints);
@@ -2874,7 +3112,8 @@ inline flatbuffers::Offset<FeatureProcessorOptions> CreateFeatureProcessorOption
     const std::vector<int32_t> *ignored_span_boundary_codepoints = nullptr,
     flatbuffers::Offset<libtextclassifier2::FeatureProcessorOptions_::BoundsSensitiveFeatures> bounds_sensitive_features = 0,
     const std::vector<flatbuffers::Offset<flatbuffers::String>> *allowed_chargrams = nullptr,
-    bool tokenize_on_script_change = false) {
+    bool tokenize_on_script_change = false,
+    flatbuffers::Offset<libtextclassifier2::FeatureProcessorOptions_::PrecomputedEmbeddings> precomputed_embeddings = 0) {
   return libtextclassifier2::CreateFeatureProcessorOptions(
       _fbb,
       num_buckets,
@@ -2907,7 +3146,8 @@ inline flatbuffers::Offset<FeatureProcessorOptions> CreateFeatureProcessorOption
       ignored_span_boundary_codepoints ? _fbb.CreateVector<int32_t>(*ignored_span_boundary_codepoints) : 0,
       bounds_sensitive_features,
       allowed_chargrams ? _fbb.CreateVector<flatbuffers::Offset<flatbuffers::String>>(*allowed_chargrams) : 0,
-      tokenize_on_script_change);
+      tokenize_on_script_change,
+      precomputed_embeddings);
 }
 
 flatbuffers::Offset<FeatureProcessorOptions> CreateFeatureProcessorOptions(flatbuffers::FlatBufferBuilder &_fbb, const FeatureProcessorOptionsT *_o, const flatbuffers::rehasher_function_t *_rehasher = nullptr);
@@ -2923,6 +3163,7 @@ inline void CompressedBuffer::UnPackTo(CompressedBufferT *_o, const flatbuffers:
   (void)_resolver;
   { auto _e = buffer(); if (_e) { _o->buffer.resize(_e->size()); for (flatbuffers::uoffset_t _i = 0; _i < _e->size(); _i++) { _o->buffer[_i] = _e->Get(_i); } } };
   { auto _e = uncompressed_size(); _o->uncompressed_size = _e; };
+  { auto _e = self_contained(); _o->self_contained = _e; };
 }
 
 inline flatbuffers::Offset<CompressedBuffer> CompressedBuffer::Pack(flatbuffers::FlatBufferBuilder &_fbb, const CompressedBufferT* _o, const flatbuffers::rehasher_function_t *_rehasher) {
@@ -2935,10 +3176,12 @@ inline flatbuffers::Offset<CompressedBuffer> CreateCompressedBuffer(flatbuffers:
   struct _VectorArgs { flatbuffers::FlatBufferBuilder *__fbb; const CompressedBufferT* __o; const flatbuffers::rehasher_function_t *__rehasher; } _va = { &_fbb, _o, _rehasher}; (void)_va;
   auto _buffer = _o->buffer.size() ? _fbb.CreateVector(_o->buffer) : 0;
   auto _uncompressed_size = _o->uncompressed_size;
+  auto _self_contained = _o->self_contained;
   return libtextclassifier2::CreateCompressedBuffer(
       _fbb,
       _buffer,
-      _uncompressed_size);
+      _uncompressed_size,
+      _self_contained);
 }
 
 inline SelectionModelOptionsT *SelectionModelOptions::UnPack(const flatbuffers::resolver_function_t *_resolver) const {
@@ -2954,6 +3197,9 @@ inline void SelectionModelOptions::UnPackTo(SelectionModelOptionsT *_o, const fl
   { auto _e = symmetry_context_size(); _o->symmetry_context_size = _e; };
   { auto _e = batch_size(); _o->batch_size = _e; };
   { auto _e = always_classify_suggested_selection(); _o->always_classify_suggested_selection = _e; };
+  { auto _e = pruned_bounds_sensitive_search(); _o->pruned_bounds_sensitive_search = _e; };
+  { auto _e = pruning_min_score(); _o->pruning_min_score = _e; };
+  { auto _e = pruning_patience(); _o->pruning_patience = _e; };
 }
 
 inline flatbuffers::Offset<SelectionModelOptions> SelectionModelOptions::Pack(flatbuffers::FlatBufferBuilder &_fbb, const SelectionModelOptionsT* _o, const flatbuffers::rehasher_function_t *_rehasher) {
@@ -2968,12 +3214,18 @@ inline flatbuffers::Offset<SelectionModelOptions> CreateSelectionModelOptions(fl
   auto _symmetry_context_size = _o->symmetry_context_size;
   auto _batch_size = _o->batch_size;
   auto _always_classify_suggested_selection = _o->always_classify_suggested_selection;
+  auto _pruned_bounds_sensitive_search = _o->pruned_bounds_sensitive_search;
+  auto _pruning_min_score = _o->pruning_min_score;
+  auto _pruning_patience = _o->pruning_patience;
   return libtextclassifier2::CreateSelectionModelOptions(
       _fbb,
       _strip_unpaired_brackets,
       _symmetry_context_size,
       _batch_size,
-      _always_classify_suggested_selection);
+      _always_classify_suggested_selection,
+      _pruned_bounds_sensitive_search,
+      _pruning_min_score,
+      _pruning_patience);
 }
 
 inline ClassificationModelOptionsT *ClassificationModelOptions::UnPack(const flatbuffers::resolver_function_t *_resolver) const {
@@ -2989,6 +3241,7 @@ inline void ClassificationModelOptions::UnPackTo(ClassificationModelOptionsT *_o
   { auto _e = phone_max_num_digits(); _o->phone_max_num_digits = _e; };
   { auto _e = address_min_num_tokens(); _o->address_min_num_tokens = _e; };
   { auto _e = max_num_tokens(); _o->max_num_tokens = _e; };
+  { auto _e = batch_size(); _o->batch_size = _e; };
 }
 
 inline flatbuffers::Offset<ClassificationModelOptions> ClassificationModelOptions::Pack(flatbuffers::FlatBufferBuilder &_fbb, const ClassificationModelOptionsT* _o, const flatbuffers::rehasher_function_t *_rehasher) {
@@ -3003,12 +3256,14 @@ inline flatbuffers::Offset<ClassificationModelOptions> CreateClassificationModel
   auto _phone_max_num_digits = _o->phone_max_num_digits;
   auto _address_min_num_tokens = _o->address_min_num_tokens;
   auto _max_num_tokens = _o->max_num_tokens;
+  auto _batch_size = _o->batch_size;
   return libtextclassifier2::CreateClassificationModelOptions(
       _fbb,
       _phone_min_num_digits,
       _phone_max_num_digits,
       _address_min_num_tokens,
-      _max_num_tokens);
+      _max_num_tokens,
+      _batch_size);
 }
 
 namespace RegexModel_ {
@@ -3069,6 +3324,8 @@ inline void RegexModel::UnPackTo(RegexModelT *_o, const flatbuffers::resolver_fu
   (void)_o;
   (void)_resolver;
   { auto _e = patterns(); if (_e) { _o->patterns.resize(_e->size()); for (flatbuffers::uoffset_t _i = 0; _i < _e->size(); _i++) { _o->patterns[_i] = std::unique_ptr<libtextclassifier2::RegexModel_::PatternT>(_e->Get(_i)->UnPack(_resolver)); } } };
+  { auto _e = regex_time_limit(); _o->regex_time_limit = _e; };
+  { auto _e = regex_stack_limit(); _o->regex_stack_limit = _e; };
 }
 
 inline flatbuffers::Offset<RegexModel> RegexModel::Pack(flatbuffers::FlatBufferBuilder &_fbb, const RegexModelT* _o, const flatbuffers::rehasher_function_t *_rehasher) {
@@ -3080,9 +3337,13 @@ inline flatbuffers::Offset<RegexModel> CreateRegexModel(flatbuffers::FlatBufferB
   (void)_o;
   struct _VectorArgs { flatbuffers::FlatBufferBuilder *__fbb; const RegexModelT* __o; const flatbuffers::rehasher_function_t *__rehasher; } _va = { &_fbb, _o, _rehasher}; (void)_va;
   auto _patterns = _o->patterns.size() ? _fbb.CreateVector<flatbuffers::Offset<libtextclassifier2::RegexModel_::Pattern>> (_o->patterns.size(), [](size_t i, _VectorArgs *__va) { return CreatePattern(*__va->__fbb, __va->__o->patterns[i].get(), __va->__rehasher); }, &_va ) : 0;
+  auto _regex_time_limit = _o->regex_time_limit;
+  auto _regex_stack_limit = _o->regex_stack_limit;
   return libtextclassifier2::CreateRegexModel(
       _fbb,
-      _patterns);
+      _patterns,
+      _regex_time_limit,
+      _regex_stack_limit);
 }
 
 namespace DatetimeModelPattern_ {
@@ -3208,6 +3469,9 @@ inline void DatetimeModel::UnPackTo(DatetimeModelT *_o, const flatbuffers::resol
   { auto _e = extractors(); if (_e) { _o->extractors.resize(_e->size()); for (flatbuffers::uoffset_t _i = 0; _i < _e->size(); _i++) { _o->extractors[_i] = std::unique_ptr<DatetimeModelExtractorT>(_e->Get(_i)->UnPack(_resolver)); } } };
   { auto _e = use_extractors_for_locating(); _o->use_extractors_for_locating = _e; };
   { auto _e = default_locales(); if (_e) { _o->default_locales.resize(_e->size()); for (flatbuffers::uoffset_t _i = 0; _i < _e->size(); _i++) { _o->default_locales[_i] = _e->Get(_i); } } };
+  { auto _e = use_rule_prefilter(); _o->use_rule_prefilter = _e; };
+  { auto _e = regex_time_limit(); _o->regex_time_limit = _e; };
+  { auto _e = regex_stack_limit(); _o->regex_stack_limit = _e; };
 }
 
 inline flatbuffers::Offset<DatetimeModel> DatetimeModel::Pack(flatbuffers::FlatBufferBuilder &_fbb, const DatetimeModelT* _o, const flatbuffers::rehasher_function_t *_rehasher) {
@@ -3223,13 +3487,19 @@ inline flatbuffers::Offset<DatetimeModel> CreateDatetimeModel(flatbuffers::FlatB
   auto _extractors = _o->extractors.size() ? _fbb.CreateVector<flatbuffers::Offset<DatetimeModelExtractor>> (_o->extractors.size(), [](size_t i, _VectorArgs *__va) { return CreateDatetimeModelExtractor(*__va->__fbb, __va->__o->extractors[i].get(), __va->__rehasher); }, &_va ) : 0;
   auto _use_extractors_for_locating = _o->use_extractors_for_locating;
   auto _default_locales = _o->default_locales.size() ? _fbb.CreateVector(_o->default_locales) : 0;
+  auto _use_rule_prefilter = _o->use_rule_prefilter;
+  auto _regex_time_limit = _o->regex_time_limit;
+  auto _regex_stack_limit = _o->regex_stack_limit;
   return libtextclassifier2::CreateDatetimeModel(
       _fbb,
       _locales,
       _patterns,
       _extractors,
       _use_extractors_for_locating,
-      _default_locales);
+      _default_locales,
+      _use_rule_prefilter,
+      _regex_time_limit,
+      _regex_stack_limit);
 }
 
 namespace DatetimeModelLibrary_ {
@@ -3377,6 +3647,7 @@ inline void Model::UnPackTo(ModelT *_o, const flatbuffers::resolver_function_t *
   { auto _e = enabled_modes(); _o->enabled_modes = _e; };
   { auto _e = snap_whitespace_selections(); _o->snap_whitespace_selections = _e; };
   { auto _e = output_options(); if (_e) _o->output_options = std::unique_ptr<OutputOptionsT>(_e->UnPack(_resolver)); };
+  { auto _e = lazy_regex_compilation(); _o->lazy_regex_compilation = _e; };
 }
 
 inline flatbuffers::Offset<Model> Model::Pack(flatbuffers::FlatBufferBuilder &_fbb, const ModelT* _o, const flatbuffers::rehasher_function_t *_rehasher) {
@@ -3403,6 +3674,7 @@ inline flatbuffers::Offset<Model> CreateModel(flatbuffers::FlatBufferBuilder &_f
   auto _enabled_modes = _o->enabled_modes;
   auto _snap_whitespace_selections = _o->snap_whitespace_selections;
   auto _output_options = _o->output_options ? CreateOutputOptions(_fbb, _o->output_options.get(), _rehasher) : 0;
+  auto _lazy_regex_compilation = _o->lazy_regex_compilation;
   return libtextclassifier2::CreateModel(
       _fbb,
       _locales,
@@ -3420,7 +3692,8 @@ inline flatbuffers::Offset<Model> CreateModel(flatbuffers::FlatBufferBuilder &_f
       _triggering_options,
       _enabled_modes,
       _snap_whitespace_selections,
-      _output_options);
+      _output_options,
+      _lazy_regex_compilation);
 }
 
 inline TokenizationCodepointRangeT *TokenizationCodepointRange::UnPack(const flatbuffers::resolver_function_t *_resolver) const {
@@ -3565,6 +3838,35 @@ inline flatbuffers::Offset<AlternativeCollectionMapEntry> CreateAlternativeColle
       _value);
 }
 
+inline PrecomputedEmbeddingsT *PrecomputedEmbeddings::UnPack(const flatbuffers::resolver_function_t *_resolver) const {
+  auto _o = new PrecomputedEmbeddingsT();
+  UnPackTo(_o, _resolver);
+  return _o;
+}
+
+inline void PrecomputedEmbeddings::UnPackTo(PrecomputedEmbeddingsT *_o, const flatbuffers::resolver_function_t *_resolver) const {
+  (void)_o;
+  (void)_resolver;
+  { auto _e = tokens(); if (_e) { _o->tokens.resize(_e->size()); for (flatbuffers::uoffset_t _i = 0; _i < _e->size(); _i++) { _o->tokens[_i] = _e->Get(_i)->str(); } } };
+  { auto _e = embeddings(); if (_e) { _o->embeddings.resize(_e->size()); for (flatbuffers::uoffset_t _i = 0; _i < _e->size(); _i++) { _o->embeddings[_i] = _e->Get(_i); } } };
+}
+
+inline flatbuffers::Offset<PrecomputedEmbeddings> PrecomputedEmbeddings::Pack(flatbuffers::FlatBufferBuilder &_fbb, const PrecomputedEmbeddingsT* _o, const flatbuffers::rehasher_function_t *_rehasher) {
+  return CreatePrecomputedEmbeddings(_fbb, _o, _rehasher);
+}
+
+inline flatbuffers::Offset<PrecomputedEmbeddings> CreatePrecomputedEmbeddings(flatbuffers::FlatBufferBuilder &_fbb, const PrecomputedEmbeddingsT *_o, const flatbuffers::rehasher_function_t *_rehasher) {
+  (void)_rehasher;
+  (void)_o;
+  struct _VectorArgs { flatbuffers::FlatBufferBuilder *__fbb; const PrecomputedEmbeddingsT* __o; const flatbuffers::rehasher_function_t *__rehasher; } _va = { &_fbb, _o, _rehasher}; (void)_va;
+  auto _tokens = _o->tokens.size() ? _fbb.CreateVectorOfStrings(_o->tokens) : 0;
+  auto _embeddings = _o->embeddings.size() ? _fbb.CreateVector(_o->embeddings) : 0;
+  return libtextclassifier2::FeatureProcessorOptions_::CreatePrecomputedEmbeddings(
+      _fbb,
+      _tokens,
+      _embeddings);
+}
+
 }  // namespace FeatureProcessorOptions_
 
 inline FeatureProcessorOptionsT *FeatureProcessorOptions::UnPack(const flatbuffers::resolver_function_t *_resolver) const {
@@ -3607,6 +3909,7 @@ inline void FeatureProcessorOptions::UnPackTo(FeatureProcessorOptionsT *_o, cons
   { auto _e = bounds_sensitive_features(); if (_e) _o->bounds_sensitive_features = std::unique_ptr<libtextclassifier2::FeatureProcessorOptions_::BoundsSensitiveFeaturesT>(_e->UnPack(_resolver)); };
   { auto _e = allowed_chargrams(); if (_e) { _o->allowed_chargrams.resize(_e->size()); for (flatbuffers::uoffset_t _i = 0; _i < _e->size(); _i++) { _o->allowed_chargrams[_i] = _e->Get(_i)->str(); } } };
   { auto _e = tokenize_on_script_change(); _o->tokenize_on_script_change = _e; };
+  { auto _e = precomputed_embeddings(); if (_e) _o->precomputed_embeddings = std::unique_ptr<libtextclassifier2::FeatureProcessorOptions_::PrecomputedEmbeddingsT>(_e->UnPack(_resolver)); };
 }
 
 inline flatbuffers::Offset<FeatureProcessorOptions> FeatureProcessorOptions::Pack(flatbuffers::FlatBufferBuilder &_fbb, const FeatureProcessorOptionsT* _o, const flatbuffers::rehasher_function_t *_rehasher) {
@@ -3648,6 +3951,7 @@ inline flatbuffers::Offset<FeatureProcessorOptions> CreateFeatureProcessorOption
   auto _bounds_sensitive_features = _o->bounds_sensitive_features ? CreateBoundsSensitiveFeatures(_fbb, _o->bounds_sensitive_features.get(), _rehasher) : 0;
   auto _allowed_chargrams = _o->allowed_chargrams.size() ? _fbb.CreateVectorOfStrings(_o->allowed_chargrams) : 0;
   auto _tokenize_on_script_change = _o->tokenize_on_script_change;
+  auto _precomputed_embeddings = _o->precomputed_embeddings ? CreatePrecomputedEmbeddings(_fbb, _o->precomputed_embeddings.get(), _rehasher) : 0;
   return libtextclassifier2::CreateFeatureProcessorOptions(
       _fbb,
       _num_buckets,
@@ -3680,7 +3984,8 @@ inline flatbuffers::Offset<FeatureProcessorOptions> CreateFeatureProcessorOption
       _ignored_span_boundary_codepoints,
       _bounds_sensitive_features,
       _allowed_chargrams,
-      _tokenize_on_script_change);
+      _tokenize_on_script_change,
+      _precomputed_embeddings);
 }
 
 inline const libtextclassifier2::Model *GetModel(const void *buf) {
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "precomputed-embeddings.h"
+
+#include <algorithm>
+#include <memory>
+
+#include "feature-processor.h"
+#include "model-executor.h"
+#include "util/base/logging.h"
+#include "util/utf8/unicodetext.h"
+
+namespace libtextclassifier2 {
+
+namespace {
+
+bool ComputeEmbeddings(
+    const std::vector<std::string>& tokens,
+    const flatbuffers::Vector<uint8_t>* embedding_model,
+    const FeatureProcessorOptions* options, const UniLib& unilib,
+    FeatureProcessorOptions_::PrecomputedEmbeddingsT* table) {
+  std::unique_ptr<TFLiteEmbeddingExecutor> embedding_executor =
+      TFLiteEmbeddingExecutor::Instance(embedding_model,
+                                        options->embedding_size(),
+                                        options->embedding_quantization_bits());
+  if (!embedding_executor) {
+    TC_LOG(ERROR) << "Could not load the embedding model.";
+    return false;
+  }
+
+  const FeatureProcessor feature_processor(options, &unilib);
+  const int embedding_size = feature_processor.EmbeddingSize();
+  table->tokens = tokens;
+  table->embeddings.assign(tokens.size() * embedding_size, 0.0f);
+  for (int i = 0; i < tokens.size(); ++i) {
+    const int num_codepoints =
+        UTF8ToUnicodeText(tokens[i], /*do_copy=*/false).size_codepoints();
+    if (!feature_processor.EmbedToken(
+            Token(tokens[i], 0, num_codepoints), embedding_executor.get(),
+            table->embeddings.data() + i * embedding_size)) {
+      TC_LOG(ERROR) << "Could not embed token: " << tokens[i];
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+bool PrecomputeTokenEmbeddings(const std::vector<std::string>& tokens,
+                               const UniLib& unilib, ModelT* model) {
+  if (model->embedding_model.empty()) {
+    TC_LOG(ERROR) << "The model has no embedding model.";
+    return false;
+  }
+
+  // The table is looked up by binary search, so the tokens are stored sorted.
+  std::vector<std::string> sorted_tokens;
+  for (const std::string& token : tokens) {
+    if (!token.empty()) {
+      sorted_tokens.push_back(token);
+    }
+  }
+  std::sort(sorted_tokens.begin(), sorted_tokens.end());
+  sorted_tokens.erase(std::unique(sorted_tokens.begin(), sorted_tokens.end()),
+                      sorted_tokens.end());
+
+  // The feature processor and the embedding executor work on the flatbuffer,
+  // so the embeddings are computed on a packed copy of the model.
+  flatbuffers::FlatBufferBuilder builder;
+  FinishModelBuffer(builder, Model::Pack(builder, model));
+  const Model* packed_model = GetModel(builder.GetBufferPointer());
+
+  std::unique_ptr<FeatureProcessorOptions_::PrecomputedEmbeddingsT>
+      selection_table;
+  if (packed_model->selection_feature_options() != nullptr) {
+    selection_table.reset(new FeatureProcessorOptions_::PrecomputedEmbeddingsT);
+    if (!ComputeEmbeddings(sorted_tokens, packed_model->embedding_model(),
+                           packed_model->selection_feature_options(), unilib,
+                           selection_table.get())) {
+      return false;
+    }
+  }
+  std::unique_ptr<FeatureProcessorOptions_::PrecomputedEmbeddingsT>
+      classification_table;
+  if (packed_model->classification_feature_options() != nullptr) {
+    classification_table.reset(
+        new FeatureProcessorOptions_::PrecomputedEmbeddingsT);
+    if (!ComputeEmbeddings(sorted_tokens, packed_model->embedding_model(),
+                           packed_model->classification_feature_options(),
+                           unilib, classification_table.get())) {
+      return false;
+    }
+  }
+
+  if (selection_table) {
+    model->selection_feature_options->precomputed_embeddings =
+        std::move(selection_table);
+  }
+  if (classification_table) {
+    model->classification_feature_options->precomputed_embeddings =
+        std::move(classification_table);
+  }
+  return true;
+}
+
+std::string PrecomputeTokenEmbeddingsInSerializedModel(
+    const std::string& model, const std::vector<std::string>& tokens,
+    const UniLib& unilib) {
+  std::unique_ptr<ModelT> unpacked_model = UnPackModel(model.c_str());
+  TC_CHECK(unpacked_model != nullptr);
+  TC_CHECK(PrecomputeTokenEmbeddings(tokens, unilib, unpacked_model.get()));
+  flatbuffers::FlatBufferBuilder builder;
+  FinishModelBuffer(builder, Model::Pack(builder, unpacked_model.get()));
+  return std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                     builder.GetSize());
+}
+
+}  // namespace libtextclassifier2
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Model conversion step that stores the embeddings of frequent tokens in the
+// model, see FeatureProcessorOptions.precomputed_embeddings.
+
+#ifndef LIBTEXTCLASSIFIER_PRECOMPUTED_EMBEDDINGS_H_
+#define LIBTEXTCLASSIFIER_PRECOMPUTED_EMBEDDINGS_H_
+
+#include <string>
+#include <vector>
+
+#include "model_generated.h"
+#include "util/utf8/unilib.h"
+
+namespace libtextclassifier2 {
+
+// Computes the embeddings of the given tokens with the embedding model and the
+// selection and classification feature options of the model, and stores them
+// in these options, replacing the embeddings stored there before. The tokens
+// would typically be the few thousand most frequent tokens of a corpus;
+// empty and duplicate ones are skipped.
+bool PrecomputeTokenEmbeddings(const std::vector<std::string>& tokens,
+                               const UniLib& unilib, ModelT* model);
+
+// Same as above, for a serialized model.
+std::string PrecomputeTokenEmbeddingsInSerializedModel(
+    const std::string& model, const std::vector<std::string>& tokens,
+    const UniLib& unilib);
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_PRECOMPUTED_EMBEDDINGS_H_
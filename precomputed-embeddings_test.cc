@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "precomputed-embeddings.h"
+
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "text-classifier.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+std::string ReadFile(const std::string& file_name) {
+  std::ifstream file_stream(file_name);
+  return std::string(std::istreambuf_iterator<char>(file_stream), {});
+}
+
+std::string GetModelPath() { return LIBTEXTCLASSIFIER_TEST_DATA_DIR; }
+
+class PrecomputedEmbeddingsTest
+    : public ::testing::TestWithParam<const char*> {};
+
+INSTANTIATE_TEST_CASE_P(ClickContext, PrecomputedEmbeddingsTest,
+                        testing::Values("test_model_cc.fb"));
+INSTANTIATE_TEST_CASE_P(BoundsSensitive, PrecomputedEmbeddingsTest,
+                        testing::Values("test_model.fb"));
+
+TEST_P(PrecomputedEmbeddingsTest, StoresSortedEmbeddings) {
+  CREATE_UNILIB_FOR_TESTING;
+  const std::string model = ReadFile(GetModelPath() + GetParam());
+  std::unique_ptr<ModelT> unpacked_model = UnPackModel(model.c_str());
+  ASSERT_TRUE(unpacked_model != nullptr);
+
+  ASSERT_TRUE(PrecomputeTokenEmbeddings({"the", "Obama", "", "the", "853"},
+                                        unilib, unpacked_model.get()));
+  const FeatureProcessorOptions_::PrecomputedEmbeddingsT* table =
+      unpacked_model->classification_feature_options->precomputed_embeddings
+          .get();
+  ASSERT_TRUE(table != nullptr);
+  EXPECT_THAT(table->tokens, testing::ElementsAre("853", "Obama", "the"));
+  EXPECT_EQ(table->embeddings.size(),
+            3 * unpacked_model->classification_feature_options->embedding_size);
+}
+
+TEST_P(PrecomputedEmbeddingsTest, AnnotationsAreUnchanged) {
+  CREATE_UNILIB_FOR_TESTING;
+  const std::string model = ReadFile(GetModelPath() + GetParam());
+  const std::string converted_model =
+      PrecomputeTokenEmbeddingsInSerializedModel(
+          model,
+          {"&", "saw", "Barack", "Obama", "today", "..", "350", "Third",
+           "Street", ",", "Cambridge", "and", "my", "phone", "number", "is",
+           "853", "225", "3556", "call", "or", "3557", "bye"},
+          unilib);
+
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromUnownedBuffer(model.data(), model.size(), &unilib);
+  ASSERT_TRUE(classifier);
+  std::unique_ptr<TextClassifier> converted_classifier =
+      TextClassifier::FromUnownedBuffer(converted_model.data(),
+                                        converted_model.size(), &unilib);
+  ASSERT_TRUE(converted_classifier);
+
+  const std::string test_string =
+      "& saw Barack Obama today .. 350 Third Street, Cambridge\nand my phone "
+      "number is 853 225 3556\ncall 853 225 3556 or 853 225 3557\n\nbye";
+  const std::vector<AnnotatedSpan> expected = classifier->Annotate(test_string);
+  const std::vector<AnnotatedSpan> result =
+      converted_classifier->Annotate(test_string);
+  ASSERT_EQ(result.size(), expected.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(result[i].span, expected[i].span);
+    ASSERT_FALSE(result[i].classification.empty());
+    ASSERT_FALSE(expected[i].classification.empty());
+    EXPECT_EQ(result[i].classification[0].collection,
+              expected[i].classification[0].collection);
+    EXPECT_NEAR(result[i].classification[0].score,
+                expected[i].classification[0].score, 1e-5);
+  }
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
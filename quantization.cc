@@ -16,24 +16,141 @@
 
 #include "quantization.h"
 
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "util/base/logging.h"
 
 namespace libtextclassifier2 {
 namespace {
-float DequantizeValue(int num_sparse_features, int quantization_bias,
-                      float multiplier, int value) {
-  return 1.0 / num_sparse_features * (value - quantization_bias) * multiplier;
+// Accumulates (value - quantization_bias) * factor into dest for 'size'
+// unpacked values.
+inline void AccumulateScalar(const uint8* values, int quantization_bias,
+                             float factor, float* dest, int size) {
+  for (int k = 0; k < size; ++k) {
+    dest[k] += (static_cast<int>(values[k]) - quantization_bias) * factor;
+  }
+}
+
+static const int kQuantizationBias8bit = 128;
+
+// Hints the CPU to start loading the embedding row before it is needed.
+inline void PrefetchRow(const uint8* row) {
+#if defined(__GNUC__)
+  __builtin_prefetch(row, /*rw=*/0, /*locality=*/1);
+#endif
+}
+
+// Adds 'dest_size' dequantized 8-bit values from 'row', each multiplied by
+// 'factor', to 'dest'. Inline, so that a constant 'dest_size' unrolls the
+// vector loop and drops the scalar tail.
+inline void AddDequantizedRow8bit(const uint8* row, float factor, float* dest,
+                           int dest_size) {
+  int k = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  const float32x4_t factor_v = vdupq_n_f32(factor);
+  const int16x8_t bias_v = vdupq_n_s16(kQuantizationBias8bit);
+  for (; k + 8 <= dest_size; k += 8) {
+    const int16x8_t centered = vsubq_s16(
+        vreinterpretq_s16_u16(vmovl_u8(vld1_u8(row + k))), bias_v);
+    const float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(centered)));
+    const float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(centered)));
+    vst1q_f32(dest + k, vmlaq_f32(vld1q_f32(dest + k), lo, factor_v));
+    vst1q_f32(dest + k + 4, vmlaq_f32(vld1q_f32(dest + k + 4), hi, factor_v));
+  }
+#elif defined(__SSE2__)
+  const __m128 factor_v = _mm_set1_ps(factor);
+  const __m128i bias_v = _mm_set1_epi16(kQuantizationBias8bit);
+  const __m128i zero = _mm_setzero_si128();
+  for (; k + 8 <= dest_size; k += 8) {
+    const __m128i bytes =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + k));
+    const __m128i centered =
+        _mm_sub_epi16(_mm_unpacklo_epi8(bytes, zero), bias_v);
+    // Sign-extend the 16-bit values to 32 bits.
+    const __m128i lo =
+        _mm_srai_epi32(_mm_unpacklo_epi16(centered, centered), 16);
+    const __m128i hi =
+        _mm_srai_epi32(_mm_unpackhi_epi16(centered, centered), 16);
+    _mm_storeu_ps(dest + k,
+                  _mm_add_ps(_mm_loadu_ps(dest + k),
+                             _mm_mul_ps(_mm_cvtepi32_ps(lo), factor_v)));
+    _mm_storeu_ps(dest + k + 4,
+                  _mm_add_ps(_mm_loadu_ps(dest + k + 4),
+                             _mm_mul_ps(_mm_cvtepi32_ps(hi), factor_v)));
+  }
+#endif
+  AccumulateScalar(row + k, kQuantizationBias8bit, factor, dest + k,
+                   dest_size - k);
 }
 
 void DequantizeAdd8bit(const float* scales, const uint8* embeddings,
                        int bytes_per_embedding, const int num_sparse_features,
                        const int bucket_id, float* dest, int dest_size) {
-  static const int kQuantizationBias8bit = 128;
-  const float multiplier = scales[bucket_id];
-  for (int k = 0; k < dest_size; ++k) {
-    dest[k] +=
-        DequantizeValue(num_sparse_features, kQuantizationBias8bit, multiplier,
-                        embeddings[bucket_id * bytes_per_embedding + k]);
+  // The averaging over the sparse features is folded into the bucket scale, so
+  // that the inner loop is a single multiply-add per element.
+  AddDequantizedRow8bit(embeddings + bucket_id * bytes_per_embedding,
+                        scales[bucket_id] / num_sparse_features, dest,
+                        dest_size);
+}
+
+// Accumulates the rows of all the buckets block by block over the output,
+// so that the destination block stays in L1 while the rows stream through.
+void DequantizeAddMany8bit(const float* scales, const uint8* embeddings,
+                           int bytes_per_embedding, int num_sparse_features,
+                           const int* bucket_ids, int num_bucket_ids,
+                           float* dest, int dest_size) {
+  static const int kBlockSize = 256;
+  for (int block_start = 0; block_start < dest_size;
+       block_start += kBlockSize) {
+    const int block_size = std::min(kBlockSize, dest_size - block_start);
+    for (int i = 0; i < num_bucket_ids; ++i) {
+      if (i + 1 < num_bucket_ids) {
+        PrefetchRow(embeddings + bucket_ids[i + 1] * bytes_per_embedding +
+                    block_start);
+      }
+      const int bucket_id = bucket_ids[i];
+      AddDequantizedRow8bit(
+          embeddings + bucket_id * bytes_per_embedding + block_start,
+          scales[bucket_id] / num_sparse_features, dest + block_start,
+          block_size);
+    }
+  }
+}
+
+// Specialization for bit widths that divide 8 (1, 2 and 4 bits), where no
+// value crosses a byte boundary. Each byte is unpacked into a small buffer
+// of values, which is then accumulated in one tight loop.
+void DequantizeAddSubByte(const float* scales, const uint8* embeddings,
+                          int bytes_per_embedding, int num_sparse_features,
+                          int quantization_bits, int bucket_id, float* dest,
+                          int dest_size) {
+  const int quantization_bias = 1 << (quantization_bits - 1);
+  const float factor = scales[bucket_id] / num_sparse_features;
+  const uint8* row = embeddings + bucket_id * bytes_per_embedding;
+  const int values_per_byte = 8 / quantization_bits;
+  const uint8 mask = (1 << quantization_bits) - 1;
+
+  // Unpack in chunks to keep the buffer on the stack.
+  static const int kChunkBytes = 32;
+  uint8 unpacked[kChunkBytes * 8];
+  for (int i = 0; i < dest_size; i += kChunkBytes * values_per_byte) {
+    const int chunk_size =
+        std::min(dest_size - i, kChunkBytes * values_per_byte);
+    const uint8* chunk_row = row + i / values_per_byte;
+    for (int j = 0; j < chunk_size; ++j) {
+      const int bit_offset = (j % values_per_byte) * quantization_bits;
+      unpacked[j] = (chunk_row[j / values_per_byte] >> bit_offset) & mask;
+    }
+    AccumulateScalar(unpacked, quantization_bias, factor, dest + i,
+                     chunk_size);
   }
 }
 
@@ -42,7 +159,7 @@ void DequantizeAddNBit(const float* scales, const uint8* embeddings,
                        int quantization_bits, int bucket_id, float* dest,
                        int dest_size) {
   const int quantization_bias = 1 << (quantization_bits - 1);
-  const float multiplier = scales[bucket_id];
+  const float factor = scales[bucket_id] / num_sparse_features;
   for (int i = 0; i < dest_size; ++i) {
     const int bit_offset = i * quantization_bits;
     const int read16_offset = bit_offset / 8;
@@ -55,10 +172,68 @@ void DequantizeAddNBit(const float* scales, const uint8* embeddings,
               << 8;
     }
     int value = (data >> (bit_offset % 8)) & ((1 << quantization_bits) - 1);
-    dest[i] += DequantizeValue(num_sparse_features, quantization_bias,
-                               multiplier, value);
+    dest[i] += (value - quantization_bias) * factor;
   }
 }
+
+// Adds the kEmbeddingSize dequantized kBits-bit values from 'row', each
+// multiplied by 'factor', to 'dest'. With all the bounds known at compile
+// time, the unpacking and the loop are fully unrolled. 8-bit rows go to the
+// vector kernel, with the size fixed.
+template <int kBits, int kEmbeddingSize>
+inline void AddDequantizedRowFixed(const uint8* row, float factor,
+                                   float* dest) {
+  static_assert(8 % kBits == 0, "Values must not cross byte boundaries.");
+  if (kBits == 8) {
+    AddDequantizedRow8bit(row, factor, dest, kEmbeddingSize);
+    return;
+  }
+  const int kValuesPerByte = 8 / kBits;
+  const int kMask = (1 << kBits) - 1;
+  const int kBias = 1 << (kBits - 1);
+  for (int k = 0; k < kEmbeddingSize; ++k) {
+    const int value =
+        (row[k / kValuesPerByte] >> ((k % kValuesPerByte) * kBits)) & kMask;
+    dest[k] += (value - kBias) * factor;
+  }
+}
+
+template <int kBits, int kEmbeddingSize>
+bool DequantizeAddManyFixed(const float* scales, const uint8* embeddings,
+                            int bytes_per_embedding, int num_sparse_features,
+                            int quantization_bits, const int* bucket_ids,
+                            int num_bucket_ids, float* dest, int dest_size) {
+  if (quantization_bits != kBits || dest_size != kEmbeddingSize) {
+    return DequantizeAddMany(scales, embeddings, bytes_per_embedding,
+                             num_sparse_features, quantization_bits,
+                             bucket_ids, num_bucket_ids, dest, dest_size);
+  }
+  for (int i = 0; i < num_bucket_ids; ++i) {
+    if (i + 1 < num_bucket_ids) {
+      PrefetchRow(embeddings + bucket_ids[i + 1] * bytes_per_embedding);
+    }
+    const int bucket_id = bucket_ids[i];
+    AddDequantizedRowFixed<kBits, kEmbeddingSize>(
+        embeddings + bucket_id * bytes_per_embedding,
+        scales[bucket_id] / num_sparse_features, dest);
+  }
+  return true;
+}
+
+struct FixedDequantizeAddMany {
+  int quantization_bits;
+  int embedding_size;
+  DequantizeAddManyFunction function;
+};
+
+// The configurations of the shipped models.
+const FixedDequantizeAddMany kFixedDequantizeAddMany[] = {
+    {8, 16, &DequantizeAddManyFixed<8, 16>},
+    {8, 32, &DequantizeAddManyFixed<8, 32>},
+    {8, 64, &DequantizeAddManyFixed<8, 64>},
+    {4, 32, &DequantizeAddManyFixed<4, 32>},
+    {4, 64, &DequantizeAddManyFixed<4, 64>},
+};
 }  // namespace
 
 bool CheckQuantizationParams(int bytes_per_embedding, int quantization_bits,
@@ -77,6 +252,11 @@ bool DequantizeAdd(const float* scales, const uint8* embeddings,
   if (quantization_bits == 8) {
     DequantizeAdd8bit(scales, embeddings, bytes_per_embedding,
                       num_sparse_features, bucket_id, dest, dest_size);
+  } else if (quantization_bits == 1 || quantization_bits == 2 ||
+             quantization_bits == 4) {
+    DequantizeAddSubByte(scales, embeddings, bytes_per_embedding,
+                         num_sparse_features, quantization_bits, bucket_id,
+                         dest, dest_size);
   } else if (quantization_bits != 8) {
     DequantizeAddNBit(scales, embeddings, bytes_per_embedding,
                       num_sparse_features, quantization_bits, bucket_id, dest,
@@ -89,4 +269,60 @@ bool DequantizeAdd(const float* scales, const uint8* embeddings,
   return true;
 }
 
+bool DequantizeAddMany(const float* scales, const uint8* embeddings,
+                       int bytes_per_embedding, int num_sparse_features,
+                       int quantization_bits, const int* bucket_ids,
+                       int num_bucket_ids, float* dest, int dest_size) {
+  if (quantization_bits == 8) {
+    DequantizeAddMany8bit(scales, embeddings, bytes_per_embedding,
+                          num_sparse_features, bucket_ids, num_bucket_ids,
+                          dest, dest_size);
+    return true;
+  }
+
+  for (int i = 0; i < num_bucket_ids; ++i) {
+    if (i + 1 < num_bucket_ids) {
+      PrefetchRow(embeddings + bucket_ids[i + 1] * bytes_per_embedding);
+    }
+    if (!DequantizeAdd(scales, embeddings, bytes_per_embedding,
+                       num_sparse_features, quantization_bits, bucket_ids[i],
+                       dest, dest_size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+DequantizeAddManyFunction SelectDequantizeAddMany(int quantization_bits,
+                                                  int embedding_size) {
+  for (const FixedDequantizeAddMany& fixed : kFixedDequantizeAddMany) {
+    if (fixed.quantization_bits == quantization_bits &&
+        fixed.embedding_size == embedding_size) {
+      return fixed.function;
+    }
+  }
+  return &DequantizeAddMany;
+}
+
+void FloatsToBfloat16(const float* input, int size, uint16* output) {
+  for (int i = 0; i < size; ++i) {
+    uint32 bits;
+    memcpy(&bits, &input[i], sizeof(bits));
+    if ((bits & 0x7FFFFFFF) > 0x7F800000) {
+      // Keep NaNs NaNs, which rounding could turn into infinities.
+      output[i] = static_cast<uint16>((bits >> 16) | 0x40);
+      continue;
+    }
+    bits += 0x7FFF + ((bits >> 16) & 1);
+    output[i] = static_cast<uint16>(bits >> 16);
+  }
+}
+
+void Bfloat16ToFloats(const uint16* input, int size, float* output) {
+  for (int i = 0; i < size; ++i) {
+    const uint32 bits = static_cast<uint32>(input[i]) << 16;
+    memcpy(&output[i], &bits, sizeof(bits));
+  }
+}
+
 }  // namespace libtextclassifier2
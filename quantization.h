@@ -34,6 +34,37 @@ bool DequantizeAdd(const float* scales, const uint8* embeddings,
                    int quantization_bits, int bucket_id, float* dest,
                    int dest_size);
 
+// Same as calling DequantizeAdd for each of the 'num_bucket_ids' buckets in
+// 'bucket_ids', but processes all of them in one pass: the scale of each bucket
+// is read once, the next embedding row is prefetched while the current one is
+// being accumulated, and 8-bit rows are accumulated block-wise over 'dest'.
+// The bucket ids are assumed to be valid.
+bool DequantizeAddMany(const float* scales, const uint8* embeddings,
+                       int bytes_per_embedding, int num_sparse_features,
+                       int quantization_bits, const int* bucket_ids,
+                       int num_bucket_ids, float* dest, int dest_size);
+
+// Signature of DequantizeAddMany().
+typedef bool (*DequantizeAddManyFunction)(
+    const float* scales, const uint8* embeddings, int bytes_per_embedding,
+    int num_sparse_features, int quantization_bits, const int* bucket_ids,
+    int num_bucket_ids, float* dest, int dest_size);
+
+// Returns a version of DequantizeAddMany() compiled for the given quantization
+// bits and embedding size (i.e. dest_size), with fixed-width loops, if there
+// is one for this configuration, and DequantizeAddMany() otherwise. Meant to
+// be called once when the embeddings are loaded.
+DequantizeAddManyFunction SelectDequantizeAddMany(int quantization_bits,
+                                                  int embedding_size);
+
+// Converts floats to bfloat16, i.e. to their upper 16 bits, rounded to the
+// nearest even. That keeps the range of floats and 8 bits of the mantissa, a
+// relative error of up to 2^-9, and makes widening them back a shift.
+void FloatsToBfloat16(const float* input, int size, uint16* output);
+
+// Widens bfloat16 values back to floats.
+void Bfloat16ToFloats(const uint16* input, int size, float* output);
+
 }  // namespace libtextclassifier2
 
 #endif  // LIBTEXTCLASSIFIER_QUANTIZATION_H_
@@ -16,6 +16,8 @@
 
 #include "quantization.h"
 
+#include <cmath>
+#include <limits>
 #include <vector>
 
 #include "gmock/gmock.h"
@@ -159,5 +161,195 @@ TEST(QuantizationTest, DequantizeAdd3bit) {
   EXPECT_THAT(dest, ElementsAreFloat(expected));
 }
 
+TEST(QuantizationTest, DequantizeAdd8bitLongRow) {
+  const int bytes_per_embedding = 21;
+  const int num_buckets = 2;
+  const int num_sparse_features = 3;
+  const int quantization_bits = 8;
+  const int bucket_id = 1;
+
+  std::vector<float> scales{{0.5, -2.0}};
+  std::vector<uint8> embeddings(bytes_per_embedding * num_buckets);
+  for (int i = 0; i < embeddings.size(); ++i) {
+    embeddings[i] = (i * 37) & 0xFF;
+  }
+
+  std::vector<float> dest(bytes_per_embedding, 1.0);
+  DequantizeAdd(scales.data(), embeddings.data(), bytes_per_embedding,
+                num_sparse_features, quantization_bits, bucket_id, dest.data(),
+                dest.size());
+
+  std::vector<float> expected;
+  for (int i = 0; i < bytes_per_embedding; ++i) {
+    expected.push_back(
+        1.0 + 1.0 / num_sparse_features *
+                  (embeddings[bucket_id * bytes_per_embedding + i] - 128) *
+                  scales[bucket_id]);
+  }
+  EXPECT_THAT(dest, ElementsAreFloat(expected));
+}
+
+TEST(QuantizationTest, DequantizeAdd4bit) {
+  const int bytes_per_embedding = 40;
+  const int num_buckets = 2;
+  const int num_sparse_features = 5;
+  const int quantization_bits = 4;
+  const int bucket_id = 1;
+
+  std::vector<float> scales{{1.0, 3.0}};
+  std::vector<uint8> embeddings(bytes_per_embedding * num_buckets);
+  for (int i = 0; i < embeddings.size(); ++i) {
+    embeddings[i] = (i * 29 + 7) & 0xFF;
+  }
+
+  // Use an odd size so that the last byte is only half consumed.
+  std::vector<float> dest(79);
+  DequantizeAdd(scales.data(), embeddings.data(), bytes_per_embedding,
+                num_sparse_features, quantization_bits, bucket_id, dest.data(),
+                dest.size());
+
+  std::vector<float> expected;
+  for (int i = 0; i < dest.size(); ++i) {
+    const uint8 byte = embeddings[bucket_id * bytes_per_embedding + i / 2];
+    const int value = (i % 2 == 0) ? (byte & 0x0F) : (byte >> 4);
+    expected.push_back(1.0 / num_sparse_features * (value - 8) *
+                       scales[bucket_id]);
+  }
+  EXPECT_THAT(dest, ElementsAreFloat(expected));
+}
+
+TEST(QuantizationTest, DequantizeAdd2bit) {
+  const int bytes_per_embedding = 3;
+  const int num_sparse_features = 2;
+  const int quantization_bits = 2;
+  const int bucket_id = 0;
+
+  std::vector<float> scales{{1.0}};
+  std::vector<uint8> embeddings{{0xE4, 0x1B, 0xFF}};
+
+  std::vector<float> dest(10);
+  DequantizeAdd(scales.data(), embeddings.data(), bytes_per_embedding,
+                num_sparse_features, quantization_bits, bucket_id, dest.data(),
+                dest.size());
+
+  // 0xE4 = 0b11100100 unpacks to 0, 1, 2, 3 and 0x1B to 3, 2, 1, 0.
+  const std::vector<int> values = {0, 1, 2, 3, 3, 2, 1, 0, 3, 3};
+  std::vector<float> expected;
+  for (const int value : values) {
+    expected.push_back(1.0 / num_sparse_features * (value - 2));
+  }
+  EXPECT_THAT(dest, ElementsAreFloat(expected));
+}
+
+TEST(QuantizationTest, DequantizeAddManyMatchesDequantizeAdd) {
+  const int bytes_per_embedding = 300;
+  const int num_buckets = 5;
+  const std::vector<int> bucket_ids = {3, 0, 4, 3};
+  const int num_sparse_features = bucket_ids.size();
+
+  std::vector<float> scales{{0.1, 9.0, -7.0, 2.5, 0.3}};
+  std::vector<uint8> embeddings(bytes_per_embedding * num_buckets);
+  for (int i = 0; i < embeddings.size(); ++i) {
+    embeddings[i] = (i * 131 + 17) & 0xFF;
+  }
+
+  for (const int quantization_bits : {8, 4, 3}) {
+    const int dest_size = bytes_per_embedding * 8 / quantization_bits;
+    std::vector<float> expected(dest_size, 0.5);
+    for (const int bucket_id : bucket_ids) {
+      ASSERT_TRUE(DequantizeAdd(scales.data(), embeddings.data(),
+                                bytes_per_embedding, num_sparse_features,
+                                quantization_bits, bucket_id, expected.data(),
+                                expected.size()));
+    }
+
+    std::vector<float> dest(dest_size, 0.5);
+    ASSERT_TRUE(DequantizeAddMany(
+        scales.data(), embeddings.data(), bytes_per_embedding,
+        num_sparse_features, quantization_bits, bucket_ids.data(),
+        bucket_ids.size(), dest.data(), dest.size()));
+    EXPECT_THAT(dest, ElementsAreFloat(expected));
+  }
+}
+
+TEST(QuantizationTest, SelectedDequantizeAddManyMatchesGeneric) {
+  const int num_buckets = 5;
+  const std::vector<int> bucket_ids = {3, 0, 4, 3};
+  const int num_sparse_features = bucket_ids.size();
+  std::vector<float> scales{{0.1, 9.0, -7.0, 2.5, 0.3}};
+
+  for (const int quantization_bits : {8, 4, 3}) {
+    for (const int embedding_size : {16, 32, 64, 100}) {
+      // One spare byte per row, so that the row stride differs from the
+      // packed embedding size.
+      const int bytes_per_embedding =
+          (embedding_size * quantization_bits + 7) / 8 + 1;
+      std::vector<uint8> embeddings(bytes_per_embedding * num_buckets);
+      for (int i = 0; i < embeddings.size(); ++i) {
+        embeddings[i] = (i * 131 + 17) & 0xFF;
+      }
+
+      std::vector<float> expected(embedding_size, 0.5);
+      ASSERT_TRUE(DequantizeAddMany(
+          scales.data(), embeddings.data(), bytes_per_embedding,
+          num_sparse_features, quantization_bits, bucket_ids.data(),
+          bucket_ids.size(), expected.data(), expected.size()));
+
+      const DequantizeAddManyFunction dequantize_add_many =
+          SelectDequantizeAddMany(quantization_bits, embedding_size);
+      std::vector<float> dest(embedding_size, 0.5);
+      ASSERT_TRUE(dequantize_add_many(
+          scales.data(), embeddings.data(), bytes_per_embedding,
+          num_sparse_features, quantization_bits, bucket_ids.data(),
+          bucket_ids.size(), dest.data(), dest.size()));
+      EXPECT_THAT(dest, ElementsAreFloat(expected))
+          << quantization_bits << " bits, " << embedding_size << " values";
+    }
+  }
+
+  EXPECT_EQ(SelectDequantizeAddMany(3, 32), &DequantizeAddMany);
+  EXPECT_NE(SelectDequantizeAddMany(8, 32), &DequantizeAddMany);
+}
+
+TEST(QuantizationTest, Bfloat16RoundTrip) {
+  // Values with at most 8 significant bits survive the round trip exactly.
+  const std::vector<float> exact = {0.0,    -0.0,         1.0,
+                                    -1.0,   0.5,          255.0,
+                                    -384.0, 1073741824.0, 0.1875};
+  std::vector<uint16> half(exact.size());
+  FloatsToBfloat16(exact.data(), exact.size(), half.data());
+  std::vector<float> widened(exact.size());
+  Bfloat16ToFloats(half.data(), half.size(), widened.data());
+  EXPECT_THAT(widened, ElementsAreFloat(exact));
+
+  // Others are rounded to the nearest.
+  const std::vector<float> values = {0.1, -3.14159, 12345.678, 1e-20, 257.0};
+  half.resize(values.size());
+  FloatsToBfloat16(values.data(), values.size(), half.data());
+  widened.resize(values.size());
+  Bfloat16ToFloats(half.data(), half.size(), widened.data());
+  for (int i = 0; i < values.size(); ++i) {
+    EXPECT_NEAR(widened[i], values[i], std::abs(values[i]) / 256) << i;
+  }
+  // Halfway between 256 and 258, rounds to the even mantissa.
+  EXPECT_EQ(widened[4], 256.0);
+}
+
+TEST(QuantizationTest, Bfloat16KeepsInfinitiesAndNans) {
+  const std::vector<float> values = {std::numeric_limits<float>::infinity(),
+                                     -std::numeric_limits<float>::infinity(),
+                                     std::numeric_limits<float>::quiet_NaN(),
+                                     std::numeric_limits<float>::max()};
+  std::vector<uint16> half(values.size());
+  FloatsToBfloat16(values.data(), values.size(), half.data());
+  std::vector<float> widened(values.size());
+  Bfloat16ToFloats(half.data(), half.size(), widened.data());
+  EXPECT_EQ(widened[0], std::numeric_limits<float>::infinity());
+  EXPECT_EQ(widened[1], -std::numeric_limits<float>::infinity());
+  EXPECT_TRUE(std::isnan(widened[2]));
+  // Rounds up past the largest finite bfloat16.
+  EXPECT_TRUE(std::isinf(widened[3]));
+}
+
 }  // namespace
 }  // namespace libtextclassifier2
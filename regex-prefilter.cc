@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "regex-prefilter.h"
+
+#include <algorithm>
+#include <queue>
+
+#include "util/memory/memory-usage.h"
+
+namespace libtextclassifier2 {
+
+namespace {
+
+bool IsAsciiAlnum(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+         (c >= 'A' && c <= 'Z');
+}
+
+// Returns the index after the character class that starts at 'begin', or -1 if
+// it is not terminated.
+int SkipCharacterClass(const std::string& pattern, int begin) {
+  int depth = 0;
+  int i = begin;
+  while (i < pattern.size()) {
+    const char c = pattern[i];
+    if (c == '\\') {
+      i += 2;
+    } else if (c == '[') {
+      ++depth;
+      ++i;
+      // A ']' right after the opening bracket (or its negation) is a literal.
+      if (i < pattern.size() && pattern[i] == '^') {
+        ++i;
+      }
+      if (i < pattern.size() && pattern[i] == ']') {
+        ++i;
+      }
+    } else if (c == ']') {
+      ++i;
+      if (--depth == 0) {
+        return i;
+      }
+    } else {
+      ++i;
+    }
+  }
+  return -1;
+}
+
+// Returns the index after the group that starts at 'begin', or -1 if it is not
+// terminated.
+int SkipGroup(const std::string& pattern, int begin) {
+  int depth = 0;
+  int i = begin;
+  while (i < pattern.size()) {
+    const char c = pattern[i];
+    if (c == '\\') {
+      i += 2;
+    } else if (c == '[') {
+      i = SkipCharacterClass(pattern, i);
+      if (i < 0) {
+        return -1;
+      }
+    } else if (c == '(') {
+      ++depth;
+      ++i;
+    } else if (c == ')') {
+      ++i;
+      if (--depth == 0) {
+        return i;
+      }
+    } else {
+      ++i;
+    }
+  }
+  return -1;
+}
+
+// Returns the index after the escape sequence for something other than a
+// literal character that starts at 'begin', or -1 if it is not supported.
+int SkipSpecialEscape(const std::string& pattern, int begin) {
+  const char c = pattern[begin + 1];
+  switch (c) {
+    case 'Q':
+      // Quoted sequences are not supported.
+      return -1;
+    case 'p':
+    case 'P':
+    case 'N':
+    case 'x':
+      if (begin + 2 < pattern.size() && pattern[begin + 2] == '{') {
+        const size_t end = pattern.find('}', begin + 2);
+        return end == std::string::npos ? -1 : end + 1;
+      }
+      return c == 'x' ? begin + 4 : begin + 3;
+    case 'u':
+      return begin + 6;
+    case 'U':
+      return begin + 10;
+    case 'c':
+      return begin + 3;
+    case '0': {
+      int i = begin + 2;
+      while (i < pattern.size() && i < begin + 5 && pattern[i] >= '0' &&
+             pattern[i] <= '7') {
+        ++i;
+      }
+      return i;
+    }
+    default:
+      return begin + 2;
+  }
+}
+
+}  // namespace
+
+namespace internal {
+
+std::string RequiredLiteral(const std::string& pattern) {
+  std::string best;
+  std::string run;
+  const auto end_run = [&best, &run]() {
+    if (run.size() > best.size()) {
+      best = run;
+    }
+    run.clear();
+  };
+
+  // Whether the last atom was a literal character appended to 'run'.
+  bool last_atom_literal = false;
+  int i = 0;
+  while (i < pattern.size()) {
+    const char c = pattern[i];
+    if (c == '?' || c == '*' || c == '+' || c == '{') {
+      int min_repeats = (c == '+') ? 1 : 0;
+      if (c == '{') {
+        min_repeats = 0;
+        int j = i + 1;
+        while (j < pattern.size() && pattern[j] >= '0' && pattern[j] <= '9') {
+          min_repeats = std::min(10 * min_repeats + pattern[j] - '0', 1000);
+          ++j;
+        }
+        const size_t end = pattern.find('}', i);
+        if (end == std::string::npos) {
+          return "";
+        }
+        i = end + 1;
+      } else {
+        ++i;
+      }
+      // Lazy and possessive quantifiers.
+      if (i < pattern.size() && (pattern[i] == '?' || pattern[i] == '+')) {
+        ++i;
+      }
+
+      // The quantified character can be repeated or left out, so the run ends
+      // before it. If it is required, it also starts the next run.
+      if (last_atom_literal) {
+        const char last = run.back();
+        run.pop_back();
+        end_run();
+        if (min_repeats > 0) {
+          run.push_back(last);
+        }
+      }
+      last_atom_literal = false;
+      continue;
+    }
+
+    last_atom_literal = false;
+    if (c == '|' || c == ')') {
+      // Alternatives of the whole pattern, or an unbalanced parenthesis.
+      return "";
+    } else if (c == '(') {
+      // Flags such as (?i) change the meaning of the rest of the pattern.
+      if (i + 2 < pattern.size() && pattern[i + 1] == '?' &&
+          (IsAsciiAlnum(pattern[i + 2]) || pattern[i + 2] == '-')) {
+        return "";
+      }
+      end_run();
+      i = SkipGroup(pattern, i);
+    } else if (c == '[') {
+      end_run();
+      i = SkipCharacterClass(pattern, i);
+    } else if (c == '\\') {
+      if (i + 1 >= pattern.size()) {
+        return "";
+      }
+      if (IsAsciiAlnum(pattern[i + 1])) {
+        end_run();
+        i = SkipSpecialEscape(pattern, i);
+      } else if (static_cast<unsigned char>(pattern[i + 1]) < 0x80) {
+        run.push_back(pattern[i + 1]);
+        last_atom_literal = true;
+        i += 2;
+      } else {
+        end_run();
+        i += 2;
+      }
+    } else if (c == '.' || c == '^' || c == '$') {
+      end_run();
+      ++i;
+    } else if (static_cast<unsigned char>(c) >= 0x80) {
+      // Only ASCII literals are extracted. Skip the whole codepoint.
+      end_run();
+      ++i;
+    } else {
+      run.push_back(c);
+      last_atom_literal = true;
+      ++i;
+    }
+
+    if (i < 0) {
+      return "";
+    }
+    // Skip the continuation bytes of a non-ASCII codepoint.
+    while (i < pattern.size() &&
+           (static_cast<unsigned char>(pattern[i]) & 0xC0) == 0x80) {
+      ++i;
+    }
+  }
+  end_run();
+  return best;
+}
+
+}  // namespace internal
+
+RegexPrefilter::RegexPrefilter() : nodes_(1) {}
+
+int RegexPrefilter::Child(int node, char c) const {
+  const std::vector<std::pair<char, int>>& children = nodes_[node].children;
+  const auto it =
+      std::lower_bound(children.begin(), children.end(), c,
+                       [](const std::pair<char, int>& child, char value) {
+                         return child.first < value;
+                       });
+  if (it == children.end() || it->first != c) {
+    return -1;
+  }
+  return it->second;
+}
+
+void RegexPrefilter::AddPattern(const std::string& pattern) {
+  const int pattern_id = num_patterns_++;
+  const std::string literal = internal::RequiredLiteral(pattern);
+  if (literal.empty()) {
+    unfiltered_pattern_ids_.push_back(pattern_id);
+    return;
+  }
+
+  int node = 0;
+  for (const char c : literal) {
+    int child = Child(node, c);
+    if (child < 0) {
+      child = nodes_.size();
+      nodes_.emplace_back();
+      std::vector<std::pair<char, int>>& children = nodes_[node].children;
+      children.insert(std::lower_bound(children.begin(), children.end(),
+                                       std::make_pair(c, child)),
+                      std::make_pair(c, child));
+    }
+    node = child;
+  }
+  nodes_[node].pattern_ids.push_back(pattern_id);
+}
+
+void RegexPrefilter::Build() {
+  // Breadth-first, so that the failure links of shallower nodes are known.
+  std::queue<int> queue;
+  for (const auto& child : nodes_[0].children) {
+    nodes_[child.second].failure = 0;
+    queue.push(child.second);
+  }
+  while (!queue.empty()) {
+    const int node = queue.front();
+    queue.pop();
+    for (const auto& child : nodes_[node].children) {
+      int failure = nodes_[node].failure;
+      while (failure != 0 && Child(failure, child.first) < 0) {
+        failure = nodes_[failure].failure;
+      }
+      const int failure_child = Child(failure, child.first);
+      nodes_[child.second].failure = failure_child < 0 ? 0 : failure_child;
+
+      const std::vector<int>& inherited =
+          nodes_[nodes_[child.second].failure].pattern_ids;
+      nodes_[child.second].pattern_ids.insert(
+          nodes_[child.second].pattern_ids.end(), inherited.begin(),
+          inherited.end());
+      queue.push(child.second);
+    }
+  }
+}
+
+void RegexPrefilter::FindCandidates(const char* text, int size,
+                                    std::vector<bool>* candidates) const {
+  candidates->assign(num_patterns_, false);
+  for (const int pattern_id : unfiltered_pattern_ids_) {
+    (*candidates)[pattern_id] = true;
+  }
+
+  int node = 0;
+  for (int i = 0; i < size; ++i) {
+    int next;
+    while ((next = Child(node, text[i])) < 0 && node != 0) {
+      node = nodes_[node].failure;
+    }
+    node = next < 0 ? 0 : next;
+    for (const int pattern_id : nodes_[node].pattern_ids) {
+      (*candidates)[pattern_id] = true;
+    }
+  }
+}
+
+int64 RegexPrefilter::EstimateHeapBytes() const {
+  int64 result =
+      VectorHeapBytes(nodes_) + VectorHeapBytes(unfiltered_pattern_ids_);
+  for (const Node& node : nodes_) {
+    result +=
+        VectorHeapBytes(node.children) + VectorHeapBytes(node.pattern_ids);
+  }
+  return result;
+}
+
+}  // namespace libtextclassifier2
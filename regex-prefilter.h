@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBTEXTCLASSIFIER_REGEX_PREFILTER_H_
+#define LIBTEXTCLASSIFIER_REGEX_PREFILTER_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "util/base/integral_types.h"
+
+namespace libtextclassifier2 {
+
+// Finds out cheaply which regular expressions can possibly match a text.
+// For every pattern, a literal that any match has to contain is extracted, and
+// all the literals are searched for at once with an Aho-Corasick automaton, in
+// one pass over the text. Patterns without such a literal always pass.
+class RegexPrefilter {
+ public:
+  RegexPrefilter();
+
+  // Adds the next pattern (given as the regex source in UTF-8). The patterns
+  // are identified by the order in which they were added, starting from 0.
+  void AddPattern(const std::string& pattern);
+
+  // Computes the automaton. Needs to be called after the last AddPattern() and
+  // before the first FindCandidates().
+  void Build();
+
+  // Sets candidates[i] to true if the pattern i can match somewhere in the
+  // UTF-8 text, or to false if it certainly cannot.
+  void FindCandidates(const char* text, int size,
+                      std::vector<bool>* candidates) const;
+
+  int num_patterns() const { return num_patterns_; }
+
+  // Returns an estimate of the heap memory held by the automaton, in bytes.
+  int64 EstimateHeapBytes() const;
+
+ private:
+  struct Node {
+    // Sorted by the byte.
+    std::vector<std::pair<char, int>> children;
+    int failure = 0;
+
+    // Patterns whose literal ends here, including through failure links.
+    std::vector<int> pattern_ids;
+  };
+
+  // Returns the child of the node for the byte, or -1 if there is none.
+  int Child(int node, char c) const;
+
+  std::vector<Node> nodes_;
+
+  // Patterns without a required literal.
+  std::vector<int> unfiltered_pattern_ids_;
+  int num_patterns_ = 0;
+};
+
+namespace internal {
+
+// Returns the longest ASCII string that every match of the regular expression
+// has to contain, or an empty string if no such string could be found.
+// Conservative: unsupported constructs never lead to a literal that is not
+// actually required.
+std::string RequiredLiteral(const std::string& pattern);
+
+}  // namespace internal
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_REGEX_PREFILTER_H_
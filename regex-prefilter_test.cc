@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "regex-prefilter.h"
+
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+using testing::ElementsAre;
+
+TEST(RegexPrefilterTest, RequiredLiteral) {
+  EXPECT_EQ(internal::RequiredLiteral("hello"), "hello");
+  EXPECT_EQ(internal::RequiredLiteral("[0-9]+ (?:st|nd) street"), " street");
+  EXPECT_EQ(internal::RequiredLiteral("\\d{3}-\\d{4}"), "-");
+  EXPECT_EQ(internal::RequiredLiteral("https?://"), "http");
+  EXPECT_EQ(internal::RequiredLiteral("ab+cd"), "bcd");
+  EXPECT_EQ(internal::RequiredLiteral("abc?d"), "ab");
+  EXPECT_EQ(internal::RequiredLiteral("\\(?\\d+\\)? xyz"), " xyz");
+  EXPECT_EQ(internal::RequiredLiteral("a\\.b{0,2}"), "a.");
+  EXPECT_EQ(internal::RequiredLiteral("[a-z]+@[a-z]+\\.com"), ".com");
+  EXPECT_EQ(internal::RequiredLiteral("abc\xc3\xa4 d"), "abc");
+
+  // No literal can be relied on.
+  EXPECT_EQ(internal::RequiredLiteral("abc|def"), "");
+  EXPECT_EQ(internal::RequiredLiteral("(?i)hello"), "");
+  EXPECT_EQ(internal::RequiredLiteral("\\Qa.b\\E"), "");
+  EXPECT_EQ(internal::RequiredLiteral("[0-9]+"), "");
+  EXPECT_EQ(internal::RequiredLiteral("(abc"), "");
+}
+
+TEST(RegexPrefilterTest, FindCandidates) {
+  RegexPrefilter prefilter;
+  prefilter.AddPattern("[a-z]+@[a-z]+\\.com");
+  prefilter.AddPattern("\\d+");
+  prefilter.AddPattern("abcd");
+  prefilter.AddPattern("bc");
+  prefilter.AddPattern("https?://\\S+");
+  prefilter.Build();
+  ASSERT_EQ(prefilter.num_patterns(), 5);
+
+  const auto find = [&prefilter](const std::string& text) {
+    std::vector<bool> candidates;
+    prefilter.FindCandidates(text.data(), text.size(), &candidates);
+    return candidates;
+  };
+  EXPECT_THAT(find("nothing here"),
+              ElementsAre(false, true, false, false, false));
+  EXPECT_THAT(find("mail me at a@b.com"),
+              ElementsAre(true, true, false, false, false));
+  EXPECT_THAT(find("abcabcd"), ElementsAre(false, true, true, true, false));
+  EXPECT_THAT(find("xbcx"), ElementsAre(false, true, false, true, false));
+  EXPECT_THAT(find("see http://x.com"),
+              ElementsAre(true, true, false, false, true));
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "result-cache.h"
+
+#include <algorithm>
+
+namespace libtextclassifier2 {
+
+void ResultCache::Reset(int max_entries) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_entries_ = std::max(max_entries, 0);
+  selections_.Reset(max_entries_);
+  classifications_.Reset(max_entries_);
+  tokens_.Reset(max_entries_);
+  hits_ = 0;
+  misses_ = 0;
+}
+
+bool ResultCache::IsEnabled() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return max_entries_ > 0;
+}
+
+bool ResultCache::LookupSelection(uint64 key, CodepointSpan* selection) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const CodepointSpan* cached_selection = selections_.Find(key);
+  if (cached_selection == nullptr) {
+    ++misses_;
+    return false;
+  }
+  ++hits_;
+  *selection = *cached_selection;
+  return true;
+}
+
+void ResultCache::InsertSelection(uint64 key, CodepointSpan selection) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  selections_.Insert(key, selection);
+}
+
+bool ResultCache::LookupClassification(
+    uint64 key, std::vector<ClassificationResult>* results) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const std::vector<ClassificationResult>* cached_results =
+      classifications_.Find(key);
+  if (cached_results == nullptr) {
+    ++misses_;
+    return false;
+  }
+  ++hits_;
+  *results = *cached_results;
+  return true;
+}
+
+void ResultCache::InsertClassification(
+    uint64 key, const std::vector<ClassificationResult>& results) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  classifications_.Insert(key, results);
+}
+
+std::shared_ptr<const std::vector<Token>> ResultCache::LookupTokens(
+    uint64 key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const std::shared_ptr<const std::vector<Token>>* tokens = tokens_.Find(key);
+  return tokens == nullptr ? nullptr : *tokens;
+}
+
+void ResultCache::InsertTokens(
+    uint64 key, std::shared_ptr<const std::vector<Token>> tokens) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  tokens_.Insert(key, std::move(tokens));
+}
+
+int64 ResultCache::hits() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return hits_;
+}
+
+int64 ResultCache::misses() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return misses_;
+}
+
+}  // namespace libtextclassifier2
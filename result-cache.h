@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LIBTEXTCLASSIFIER_RESULT_CACHE_H_
+#define LIBTEXTCLASSIFIER_RESULT_CACHE_H_
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "types.h"
+#include "util/base/integral_types.h"
+#include "util/base/macros.h"
+
+namespace libtextclassifier2 {
+
+// A bounded cache of the results of TextClassifier::SuggestSelection() and
+// TextClassifier::ClassifyText() calls, keyed by 64-bit fingerprints of their
+// inputs. It also memoizes the tokens that a SuggestSelection() call computed,
+// so that a following ClassifyText() of the suggested selection can reuse them
+// instead of tokenizing the context again. Each kind of entry is bounded
+// separately; when full, the oldest entries are evicted first.
+// The cache is disabled (has zero capacity) until Reset() is called with a
+// positive number of entries.
+// Thread-safe.
+class ResultCache {
+ public:
+  ResultCache() {}
+
+  // Drops all the entries and sets the maximum number of entries held of each
+  // kind. A non-positive 'max_entries' disables the cache.
+  void Reset(int max_entries);
+
+  // Returns true if the cache has a non-zero capacity.
+  bool IsEnabled() const;
+
+  // If a selection is cached under 'key', sets 'selection' to it and returns
+  // true. Returns false otherwise.
+  bool LookupSelection(uint64 key, CodepointSpan* selection);
+  void InsertSelection(uint64 key, CodepointSpan selection);
+
+  // If classification results are cached under 'key', sets 'results' to them
+  // and returns true. Returns false otherwise.
+  bool LookupClassification(uint64 key,
+                            std::vector<ClassificationResult>* results);
+  void InsertClassification(uint64 key,
+                            const std::vector<ClassificationResult>& results);
+
+  // Returns the tokens memoized under 'key', or nullptr.
+  std::shared_ptr<const std::vector<Token>> LookupTokens(uint64 key);
+  void InsertTokens(uint64 key,
+                    std::shared_ptr<const std::vector<Token>> tokens);
+
+  // Number of successful and unsuccessful result lookups since the last
+  // Reset(). Token lookups are not counted.
+  int64 hits() const;
+  int64 misses() const;
+
+ private:
+  // A map that holds at most 'max_entries' values and evicts the oldest one
+  // when a new one does not fit. Not thread-safe on its own.
+  template <typename Value>
+  class BoundedMap {
+   public:
+    void Reset(int max_entries) {
+      max_entries_ = max_entries;
+      values_.clear();
+      insertion_order_.clear();
+    }
+
+    const Value* Find(uint64 key) const {
+      const auto it = values_.find(key);
+      return it == values_.end() ? nullptr : &it->second;
+    }
+
+    void Insert(uint64 key, Value value) {
+      if (max_entries_ <= 0 || values_.find(key) != values_.end()) {
+        return;
+      }
+      if (values_.size() >= max_entries_) {
+        values_.erase(insertion_order_.front());
+        insertion_order_.pop_front();
+      }
+      values_.emplace(key, std::move(value));
+      insertion_order_.push_back(key);
+    }
+
+   private:
+    int max_entries_ = 0;
+    std::unordered_map<uint64, Value> values_;
+    std::deque<uint64> insertion_order_;
+  };
+
+  mutable std::mutex mutex_;
+  int max_entries_ = 0;
+
+  BoundedMap<CodepointSpan> selections_;
+  BoundedMap<std::vector<ClassificationResult>> classifications_;
+  BoundedMap<std::shared_ptr<const std::vector<Token>>> tokens_;
+
+  int64 hits_ = 0;
+  int64 misses_ = 0;
+
+  TC_DISALLOW_COPY_AND_ASSIGN(ResultCache);
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_RESULT_CACHE_H_
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "result-cache.h"
+
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+TEST(ResultCacheTest, DisabledByDefault) {
+  ResultCache cache;
+  EXPECT_FALSE(cache.IsEnabled());
+
+  cache.InsertSelection(/*key=*/1, {2, 5});
+  CodepointSpan selection;
+  EXPECT_FALSE(cache.LookupSelection(/*key=*/1, &selection));
+}
+
+TEST(ResultCacheTest, KeepsEachKindSeparately) {
+  ResultCache cache;
+  cache.Reset(/*max_entries=*/10);
+  ASSERT_TRUE(cache.IsEnabled());
+
+  cache.InsertSelection(/*key=*/1, {2, 5});
+  cache.InsertClassification(/*key=*/2, {{"phone", 0.9}});
+  cache.InsertTokens(/*key=*/3, std::make_shared<const std::vector<Token>>(
+                                    std::vector<Token>{Token("a", 0, 1)}));
+
+  CodepointSpan selection;
+  EXPECT_TRUE(cache.LookupSelection(/*key=*/1, &selection));
+  EXPECT_EQ(selection, CodepointSpan(2, 5));
+  EXPECT_FALSE(cache.LookupSelection(/*key=*/2, &selection));
+
+  std::vector<ClassificationResult> results;
+  EXPECT_TRUE(cache.LookupClassification(/*key=*/2, &results));
+  ASSERT_EQ(results.size(), 1);
+  EXPECT_EQ(results[0].collection, "phone");
+  EXPECT_FALSE(cache.LookupClassification(/*key=*/1, &results));
+
+  ASSERT_NE(cache.LookupTokens(/*key=*/3), nullptr);
+  EXPECT_EQ(cache.LookupTokens(/*key=*/3)->size(), 1);
+  EXPECT_EQ(cache.LookupTokens(/*key=*/1), nullptr);
+
+  EXPECT_EQ(cache.hits(), 2);
+  EXPECT_EQ(cache.misses(), 2);
+}
+
+TEST(ResultCacheTest, EvictsOldestEntries) {
+  ResultCache cache;
+  cache.Reset(/*max_entries=*/2);
+  cache.InsertSelection(/*key=*/1, {1, 2});
+  cache.InsertSelection(/*key=*/2, {2, 3});
+  cache.InsertSelection(/*key=*/3, {3, 4});
+
+  CodepointSpan selection;
+  EXPECT_FALSE(cache.LookupSelection(/*key=*/1, &selection));
+  EXPECT_TRUE(cache.LookupSelection(/*key=*/2, &selection));
+  EXPECT_TRUE(cache.LookupSelection(/*key=*/3, &selection));
+
+  cache.Reset(/*max_entries=*/2);
+  EXPECT_FALSE(cache.LookupSelection(/*key=*/3, &selection));
+  EXPECT_EQ(cache.hits(), 0);
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
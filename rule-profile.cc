@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rule-profile.h"
+
+#include <algorithm>
+
+#include "util/strings/numbers.h"
+#include "util/strings/utf8.h"
+
+namespace libtextclassifier2 {
+
+constexpr int RuleProfile::kMaxNameLength;
+
+namespace {
+
+// Cuts 'name' after kMaxNameLength codepoints, marking it with "...".
+std::string ShortenName(const std::string& name) {
+  int num_codepoints = 0;
+  for (int i = 0; i < name.size(); ++i) {
+    if (IsTrailByte(name[i])) {
+      continue;
+    }
+    if (num_codepoints == RuleProfile::kMaxNameLength) {
+      return name.substr(0, i) + "...";
+    }
+    ++num_codepoints;
+  }
+  return name;
+}
+
+}  // namespace
+
+void RuleProfile::SetRuleName(RuleType type, int rule_id,
+                              const std::string& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  RuleStats& stats = rules_[{type, rule_id}];
+  stats.type = type;
+  stats.rule_id = rule_id;
+  stats.name = ShortenName(name);
+}
+
+void RuleProfile::Record(RuleType type, int rule_id, int64 duration_us,
+                         int64 num_matches) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  RuleStats& stats = rules_[{type, rule_id}];
+  stats.type = type;
+  stats.rule_id = rule_id;
+  ++stats.attempts;
+  stats.matches += num_matches;
+  stats.total_us += duration_us;
+}
+
+RuleProfile::RuleStats RuleProfile::Get(RuleType type, int rule_id) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = rules_.find({type, rule_id});
+  if (it != rules_.end()) {
+    return it->second;
+  }
+  RuleStats stats;
+  stats.type = type;
+  stats.rule_id = rule_id;
+  return stats;
+}
+
+std::vector<RuleProfile::RuleStats> RuleProfile::RankedRules() const {
+  std::vector<RuleStats> ranked;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& entry : rules_) {
+      if (entry.second.attempts > 0) {
+        ranked.push_back(entry.second);
+      }
+    }
+  }
+  // The stable sort keeps the rules of equal cost in the order of their ids.
+  std::stable_sort(ranked.begin(), ranked.end(),
+                   [](const RuleStats& a, const RuleStats& b) {
+                     if (a.total_us != b.total_us) {
+                       return a.total_us > b.total_us;
+                     }
+                     return a.attempts > b.attempts;
+                   });
+  return ranked;
+}
+
+std::string RuleProfile::ToString(int max_rules) const {
+  const std::vector<RuleStats> ranked = RankedRules();
+  std::string report;
+  for (int i = 0; i < ranked.size(); ++i) {
+    if (max_rules > 0 && i == max_rules) {
+      break;
+    }
+    const RuleStats& stats = ranked[i];
+    report.append(RuleTypeName(stats.type));
+    report.append(" ");
+    report.append(IntToString(stats.rule_id));
+    if (!stats.name.empty()) {
+      report.append(" (");
+      report.append(stats.name);
+      report.append(")");
+    }
+    report.append(": ");
+    report.append(IntToString(stats.total_us));
+    report.append(" us, ");
+    report.append(IntToString(stats.attempts));
+    report.append(" attempts, ");
+    report.append(IntToString(stats.matches));
+    report.append(" matches\n");
+  }
+  return report;
+}
+
+void RuleProfile::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& entry : rules_) {
+    entry.second.attempts = 0;
+    entry.second.matches = 0;
+    entry.second.total_us = 0;
+  }
+}
+
+const char* RuleProfile::RuleTypeName(RuleType type) {
+  switch (type) {
+    case REGEX:
+      return "regex";
+    case DATETIME:
+      return "datetime";
+    case NUM_RULE_TYPES:
+      break;
+  }
+  return "unknown";
+}
+
+}  // namespace libtextclassifier2
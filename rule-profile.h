@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBTEXTCLASSIFIER_RULE_PROFILE_H_
+#define LIBTEXTCLASSIFIER_RULE_PROFILE_H_
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "util/base/integral_types.h"
+
+namespace libtextclassifier2 {
+
+// Collects, for each regular expression and datetime rule, how many times it
+// was run on an input, how many matches it found and the wall time spent in
+// it, matches included. Meant for finding the rules that dominate the cost of
+// the calls: enable it with TextClassifier::SetRuleProfile(), run the
+// workload and print ToString(). Thread-safe.
+class RuleProfile {
+ public:
+  enum RuleType {
+    // Rules of the regex model, by pattern index.
+    REGEX = 0,
+    // Rules of the datetime model, by rule index. Rules that share a pattern
+    // run it once per input, which is recorded for the first of them.
+    DATETIME,
+    NUM_RULE_TYPES
+  };
+
+  struct RuleStats {
+    RuleType type;
+    int rule_id;
+    // Short description of the rule, for the report. May be empty.
+    std::string name;
+    int64 attempts = 0;
+    int64 matches = 0;
+    int64 total_us = 0;
+  };
+
+  // Names longer than this many codepoints are shortened in the report.
+  static constexpr int kMaxNameLength = 48;
+
+  // Sets the description of the rule shown in the report.
+  void SetRuleName(RuleType type, int rule_id, const std::string& name);
+
+  // Adds a run of the rule that took 'duration_us' microseconds and found
+  // 'num_matches' matches.
+  void Record(RuleType type, int rule_id, int64 duration_us, int64 num_matches);
+
+  // Returns the stats of the rule, all zero if it never ran.
+  RuleStats Get(RuleType type, int rule_id) const;
+
+  // Returns the stats of the rules that ran, the most expensive first. Ties
+  // are broken by the number of attempts.
+  std::vector<RuleStats> RankedRules() const;
+
+  // Returns a report of the 'max_rules' most expensive rules, one per line,
+  // or of all the rules that ran if 'max_rules' is not positive.
+  std::string ToString(int max_rules = 0) const;
+
+  // Drops the recorded stats, but keeps the names.
+  void Clear();
+
+  // Returns a name for the rule type, for exporting the stats.
+  static const char* RuleTypeName(RuleType type);
+
+ private:
+  mutable std::mutex mutex_;
+  std::map<std::pair<RuleType, int>, RuleStats> rules_;
+};
+
+// Records the time from its construction to its destruction as a run of the
+// given rule, with the matches added by AddMatch(). Does nothing, not even
+// reading the clock, if 'profile' is null.
+class ScopedRuleTimer {
+ public:
+  ScopedRuleTimer(RuleProfile* profile, RuleProfile::RuleType type,
+                  int rule_id)
+      : profile_(profile), type_(type), rule_id_(rule_id) {
+    if (profile_ != nullptr) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~ScopedRuleTimer() {
+    if (profile_ != nullptr) {
+      profile_->Record(type_, rule_id_,
+                       std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::steady_clock::now() - start_)
+                           .count(),
+                       num_matches_);
+    }
+  }
+
+  void AddMatch() { ++num_matches_; }
+
+ private:
+  RuleProfile* const profile_;
+  const RuleProfile::RuleType type_;
+  const int rule_id_;
+  int64 num_matches_ = 0;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_RULE_PROFILE_H_
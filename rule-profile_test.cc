@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rule-profile.h"
+
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+TEST(RuleProfileTest, RecordsRuns) {
+  RuleProfile profile;
+  profile.Record(RuleProfile::REGEX, 3, /*duration_us=*/10, /*num_matches=*/2);
+  profile.Record(RuleProfile::REGEX, 3, /*duration_us=*/5, /*num_matches=*/0);
+  profile.Record(RuleProfile::DATETIME, 3, /*duration_us=*/7,
+                 /*num_matches=*/1);
+
+  const RuleProfile::RuleStats regex_stats =
+      profile.Get(RuleProfile::REGEX, 3);
+  EXPECT_EQ(regex_stats.attempts, 2);
+  EXPECT_EQ(regex_stats.matches, 2);
+  EXPECT_EQ(regex_stats.total_us, 15);
+  EXPECT_EQ(profile.Get(RuleProfile::DATETIME, 3).total_us, 7);
+  EXPECT_EQ(profile.Get(RuleProfile::DATETIME, 0).attempts, 0);
+}
+
+TEST(RuleProfileTest, RanksRulesByTime) {
+  RuleProfile profile;
+  profile.SetRuleName(RuleProfile::REGEX, 0, "phone");
+  profile.SetRuleName(RuleProfile::REGEX, 2, "never runs");
+  profile.Record(RuleProfile::REGEX, 0, /*duration_us=*/5, /*num_matches=*/1);
+  profile.Record(RuleProfile::DATETIME, 1, /*duration_us=*/20,
+                 /*num_matches=*/0);
+  profile.Record(RuleProfile::REGEX, 1, /*duration_us=*/5, /*num_matches=*/0);
+  profile.Record(RuleProfile::REGEX, 1, /*duration_us=*/0, /*num_matches=*/0);
+
+  const std::vector<RuleProfile::RuleStats> ranked = profile.RankedRules();
+  ASSERT_EQ(ranked.size(), 3);
+  EXPECT_EQ(ranked[0].type, RuleProfile::DATETIME);
+  EXPECT_EQ(ranked[1].rule_id, 1);
+  EXPECT_EQ(ranked[2].name, "phone");
+
+  EXPECT_EQ(profile.ToString(/*max_rules=*/2),
+            "datetime 1: 20 us, 1 attempts, 0 matches\n"
+            "regex 1: 5 us, 2 attempts, 0 matches\n");
+  EXPECT_EQ(profile.ToString().substr(profile.ToString().rfind("regex 0")),
+            "regex 0 (phone): 5 us, 1 attempts, 1 matches\n");
+
+  profile.Clear();
+  EXPECT_TRUE(profile.RankedRules().empty());
+  EXPECT_EQ(profile.Get(RuleProfile::REGEX, 0).name, "phone");
+}
+
+TEST(RuleProfileTest, ShortensLongNames) {
+  RuleProfile profile;
+  const std::string prefix(RuleProfile::kMaxNameLength, 'a');
+  profile.SetRuleName(RuleProfile::DATETIME, 0, prefix + "\xc3\xa9");
+  EXPECT_EQ(profile.Get(RuleProfile::DATETIME, 0).name, prefix + "...");
+  profile.SetRuleName(RuleProfile::DATETIME, 1, prefix);
+  EXPECT_EQ(profile.Get(RuleProfile::DATETIME, 1).name, prefix);
+}
+
+TEST(RuleProfileTest, ScopedTimerRecordsMatches) {
+  RuleProfile profile;
+  {
+    ScopedRuleTimer timer(&profile, RuleProfile::REGEX, 4);
+    timer.AddMatch();
+    timer.AddMatch();
+  }
+  { ScopedRuleTimer timer(/*profile=*/nullptr, RuleProfile::REGEX, 4); }
+  EXPECT_EQ(profile.Get(RuleProfile::REGEX, 4).attempts, 1);
+  EXPECT_EQ(profile.Get(RuleProfile::REGEX, 4).matches, 2);
+}
+
+TEST(RuleProfileTest, RecordsConcurrentRuns) {
+  RuleProfile profile;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&profile]() {
+      for (int j = 0; j < 1000; ++j) {
+        profile.Record(RuleProfile::DATETIME, j % 10, /*duration_us=*/1,
+                       /*num_matches=*/1);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(profile.Get(RuleProfile::DATETIME, 0).attempts, 400);
+  EXPECT_EQ(profile.Get(RuleProfile::DATETIME, 9).total_us, 400);
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "streaming-annotator.h"
+
+#include <algorithm>
+
+#include "util/base/logging.h"
+#include "util/strings/utf8.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+// Returns the byte offset of the codepoint that is 'num_codepoints' after the
+// one at 'begin_byte', or the size of the text if there are not enough.
+int AdvanceCodepoints(const std::string& text, int begin_byte,
+                      int num_codepoints) {
+  int i = begin_byte;
+  for (; i < text.size(); ++i) {
+    if (!IsTrailByte(text[i])) {
+      if (num_codepoints == 0) {
+        break;
+      }
+      --num_codepoints;
+    }
+  }
+  return i;
+}
+
+// Returns the number of bytes of the text without its last codepoint, if that
+// is not complete. Only looks at the bytes from 'begin_byte' on.
+int CompleteCodepointsSize(const std::string& text, int begin_byte) {
+  const int size = text.size();
+  for (int i = size - 1; i >= begin_byte && i >= size - 4; --i) {
+    if (!IsTrailByte(text[i])) {
+      return i + GetNumBytesForNonZeroUTF8Char(&text[i]) > size ? i : size;
+    }
+  }
+  return size;
+}
+
+}  // namespace
+
+StreamingAnnotator::StreamingAnnotator(
+    const TextClassifier* classifier, const AnnotationOptions& options,
+    const StreamingAnnotatorOptions& streaming_options)
+    : classifier_(classifier),
+      options_(options),
+      streaming_options_(streaming_options) {
+  Reset();
+}
+
+void StreamingAnnotator::Reset() {
+  text_.clear();
+  text_start_ = 0;
+  text_num_codepoints_ = 0;
+  incomplete_codepoint_.clear();
+  pending_start_ = 0;
+}
+
+bool StreamingAnnotator::Feed(const std::string& text,
+                              std::vector<AnnotatedSpan>* annotations) {
+  const int previous_size = text_.size();
+  text_.append(incomplete_codepoint_);
+  text_.append(text);
+  const int complete_size = CompleteCodepointsSize(text_, previous_size);
+  incomplete_codepoint_.assign(text_, complete_size, std::string::npos);
+  text_.resize(complete_size);
+  text_num_codepoints_ += CountUTF8Codepoints(text_.data() + previous_size,
+                                              complete_size - previous_size);
+
+  InterpreterManager interpreter_manager(
+      classifier_->selection_executor_.get(),
+      classifier_->classification_executor_.get(), options_.latency_stats,
+      options_.locales);
+  const int window_size = std::max(streaming_options_.window_size, 1);
+  const int overlap = std::max(streaming_options_.overlap, 0);
+  while (num_codepoints() >= pending_start_ + window_size + overlap) {
+    if (!AnnotateWindow(/*end=*/pending_start_ + window_size + overlap,
+                        /*finalize_until=*/pending_start_ + window_size,
+                        &interpreter_manager, annotations)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool StreamingAnnotator::Flush(std::vector<AnnotatedSpan>* annotations) {
+  if (!incomplete_codepoint_.empty()) {
+    TC_LOG(ERROR) << "The stream ends in the middle of a codepoint.";
+    Reset();
+    return false;
+  }
+
+  InterpreterManager interpreter_manager(
+      classifier_->selection_executor_.get(),
+      classifier_->classification_executor_.get(), options_.latency_stats,
+      options_.locales);
+  const bool success =
+      AnnotateWindow(/*end=*/num_codepoints(), /*finalize_until=*/-1,
+                     &interpreter_manager, annotations);
+  Reset();
+  return success;
+}
+
+bool StreamingAnnotator::AnnotateWindow(
+    int end, int finalize_until, InterpreterManager* interpreter_manager,
+    std::vector<AnnotatedSpan>* annotations) {
+  // The buffered text is exactly the leading context of the window plus the
+  // pending text, see below.
+  const int window_size_bytes =
+      AdvanceCodepoints(text_, /*begin_byte=*/0, end - text_start_);
+  std::vector<AnnotatedSpan> window_annotations;
+  if ((classifier_->model_->enabled_modes() & ModeFlag_ANNOTATION) &&
+      !classifier_->AnnotateInternal(text_.substr(0, window_size_bytes),
+                                     options_, interpreter_manager,
+                                     /*session=*/nullptr,
+                                     /*model_annotation=*/nullptr,
+                                     &window_annotations)) {
+    TC_LOG(ERROR) << "Couldn't annotate the window.";
+    return false;
+  }
+
+  int next_pending_start = finalize_until == -1 ? end : finalize_until;
+  for (AnnotatedSpan& annotation : window_annotations) {
+    annotation.span.first += text_start_;
+    annotation.span.second += text_start_;
+
+    // Starts in the leading context, so it either was handed out by the
+    // previous window, or lost to one that was.
+    if (annotation.span.first < pending_start_) {
+      continue;
+    }
+    if (finalize_until != -1 && annotation.span.second > finalize_until) {
+      if (annotation.span.first > pending_start_) {
+        // The next window starts with it, so that it gets its full context.
+        next_pending_start = std::min(annotation.span.first, finalize_until);
+        break;
+      }
+      // Covers all of the finalized part, so it has as much context as it can
+      // get within a window.
+      next_pending_start = annotation.span.second;
+      annotations->push_back(std::move(annotation));
+      break;
+    }
+    annotations->push_back(std::move(annotation));
+  }
+  pending_start_ = next_pending_start;
+
+  // Only keep the text that the next window needs as leading context.
+  const int keep_start = std::max(
+      text_start_, pending_start_ - std::max(streaming_options_.overlap, 0));
+  const int drop_size_bytes =
+      AdvanceCodepoints(text_, /*begin_byte=*/0, keep_start - text_start_);
+  text_.erase(0, drop_size_bytes);
+  text_num_codepoints_ -= keep_start - text_start_;
+  text_start_ = keep_start;
+  return true;
+}
+
+}  // namespace libtextclassifier2
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Annotation of text that arrives in chunks, e.g. logs and transcripts that
+// are too long to be held and annotated at once.
+
+#ifndef LIBTEXTCLASSIFIER_STREAMING_ANNOTATOR_H_
+#define LIBTEXTCLASSIFIER_STREAMING_ANNOTATOR_H_
+
+#include <string>
+#include <vector>
+
+#include "text-classifier.h"
+#include "types.h"
+
+namespace libtextclassifier2 {
+
+struct StreamingAnnotatorOptions {
+  // Number of codepoints that one window finalizes the annotations of.
+  int window_size = 16384;
+
+  // Number of codepoints of the text on either side of the finalized part that
+  // a window is annotated together with. It has to cover the context that the
+  // selection model looks at, and the longest match of the regular expression
+  // and datetime rules, for the annotations to be the same as for the whole
+  // text.
+  int overlap = 1024;
+};
+
+// Annotates a stream of text with a TextClassifier, in windows of bounded
+// size. The annotations of a window that end before its trailing overlap are
+// final, and are handed out as soon as the window has been annotated; an
+// annotation that crosses into the overlap is left for the next window, which
+// starts with it. So the memory use is bounded by the window and the chunk
+// sizes, no matter how long the stream is.
+// NOTE: This class is not thread-safe.
+class StreamingAnnotator {
+ public:
+  // Does not take ownership of 'classifier', which must outlive the annotator.
+  StreamingAnnotator(
+      const TextClassifier* classifier,
+      const AnnotationOptions& options = AnnotationOptions::Default(),
+      const StreamingAnnotatorOptions& streaming_options =
+          StreamingAnnotatorOptions());
+
+  // Appends the UTF-8 text to the stream. A chunk may end in the middle of a
+  // codepoint, which the next chunk then completes. The annotations that became
+  // final are appended to 'annotations', with codepoint spans relative to the
+  // start of the stream. Returns false if the annotation failed.
+  bool Feed(const std::string& text, std::vector<AnnotatedSpan>* annotations);
+
+  // Annotates the rest of the stream, appends its annotations and starts a new
+  // stream. Returns false if the annotation failed, or if the stream ends in
+  // the middle of a codepoint.
+  bool Flush(std::vector<AnnotatedSpan>* annotations);
+
+  // Returns the number of codepoints of the stream so far.
+  int num_codepoints() const { return text_start_ + text_num_codepoints_; }
+
+ private:
+  // Annotates the buffered text up to 'end' (a stream codepoint offset) and
+  // appends the annotations that end at 'finalize_until' at the latest, or
+  // all of them if 'finalize_until' is -1. Advances 'pending_start_' past them
+  // and drops the text that no later window needs.
+  bool AnnotateWindow(int end, int finalize_until,
+                      InterpreterManager* interpreter_manager,
+                      std::vector<AnnotatedSpan>* annotations);
+
+  // Resets to the start of a new stream.
+  void Reset();
+
+  const TextClassifier* const classifier_;
+  const AnnotationOptions options_;
+  const StreamingAnnotatorOptions streaming_options_;
+
+  // The buffered text, which starts at codepoint 'text_start_' of the stream,
+  // and the bytes of its last codepoint if that is not complete yet.
+  std::string text_;
+  int text_start_;
+  int text_num_codepoints_;
+  std::string incomplete_codepoint_;
+
+  // Stream codepoint offset from which on the annotations are not final yet.
+  // The text before it is only kept as context for the next window.
+  int pending_start_;
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_STREAMING_ANNOTATOR_H_
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "streaming-annotator.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+using testing::Values;
+
+std::string GetModelPath() { return LIBTEXTCLASSIFIER_TEST_DATA_DIR; }
+
+class StreamingAnnotatorTest : public ::testing::TestWithParam<const char*> {};
+
+INSTANTIATE_TEST_CASE_P(ClickContext, StreamingAnnotatorTest,
+                        Values("test_model_cc.fb"));
+INSTANTIATE_TEST_CASE_P(BoundsSensitive, StreamingAnnotatorTest,
+                        Values("test_model.fb"));
+
+TEST_P(StreamingAnnotatorTest, SameAsAnnotatingAllAtOnce) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  std::string text;
+  for (int i = 0; i < 20; ++i) {
+    text += "Über uns: my phone number is 853 225 3556\n";
+  }
+  const std::vector<AnnotatedSpan> expected = classifier->Annotate(text);
+  ASSERT_FALSE(expected.empty());
+
+  StreamingAnnotatorOptions streaming_options;
+  streaming_options.window_size = 100;
+  streaming_options.overlap = 100;
+  StreamingAnnotator annotator(classifier.get(), AnnotationOptions::Default(),
+                               streaming_options);
+  std::vector<AnnotatedSpan> result;
+  // The chunks split the two bytes of the 'Ü's.
+  for (int i = 0; i < text.size(); i += 7) {
+    ASSERT_TRUE(annotator.Feed(text.substr(i, 7), &result));
+  }
+  // The windows already handed out most of the annotations.
+  EXPECT_GT(result.size(), expected.size() / 2);
+  ASSERT_TRUE(annotator.Flush(&result));
+
+  ASSERT_EQ(result.size(), expected.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(result[i].span, expected[i].span);
+    EXPECT_EQ(result[i].classification[0].collection,
+              expected[i].classification[0].collection);
+  }
+}
+
+TEST_P(StreamingAnnotatorTest, FlushStartsNewStream) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  StreamingAnnotator annotator(classifier.get());
+  std::vector<AnnotatedSpan> result;
+  ASSERT_TRUE(annotator.Feed("Über 853 225 3556", &result));
+  EXPECT_EQ(annotator.num_codepoints(), 17);
+  ASSERT_TRUE(annotator.Flush(&result));
+  ASSERT_EQ(result.size(), 1);
+  EXPECT_EQ(result[0].span, CodepointSpan(5, 17));
+  EXPECT_EQ(annotator.num_codepoints(), 0);
+
+  // Ends in the middle of the 'Ü'.
+  result.clear();
+  ASSERT_TRUE(annotator.Feed("853 225 3556 \xc3", &result));
+  EXPECT_EQ(annotator.num_codepoints(), 13);
+  EXPECT_FALSE(annotator.Flush(&result));
+  EXPECT_TRUE(result.empty());
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
@@ -26,30 +26,24 @@ namespace {
 
 // Returns true if given codepoint is contained in the given span in context.
 bool IsCodepointInSpan(const char32 codepoint,
-                       const UnicodeText& context_unicode,
+                       const UnicodeTextIndex& context_index,
                        const CodepointSpan span) {
-  auto begin_it = context_unicode.begin();
-  std::advance(begin_it, span.first);
-  auto end_it = context_unicode.begin();
-  std::advance(end_it, span.second);
+  auto begin_it = context_index.IteratorAt(span.first);
+  auto end_it = context_index.IteratorAt(span.second);
 
   return std::find(begin_it, end_it, codepoint) != end_it;
 }
 
 // Returns the first codepoint of the span.
-char32 FirstSpanCodepoint(const UnicodeText& context_unicode,
+char32 FirstSpanCodepoint(const UnicodeTextIndex& context_index,
                           const CodepointSpan span) {
-  auto it = context_unicode.begin();
-  std::advance(it, span.first);
-  return *it;
+  return *context_index.IteratorAt(span.first);
 }
 
 // Returns the last codepoint of the span.
-char32 LastSpanCodepoint(const UnicodeText& context_unicode,
+char32 LastSpanCodepoint(const UnicodeTextIndex& context_index,
                          const CodepointSpan span) {
-  auto it = context_unicode.begin();
-  std::advance(it, span.second - 1);
-  return *it;
+  return *context_index.IteratorAt(span.second - 1);
 }
 
 }  // namespace
@@ -69,12 +63,21 @@ CodepointSpan StripUnpairedBrackets(const UnicodeText& context_unicode,
   if (context_unicode.empty() || !ValidNonEmptySpan(span)) {
     return span;
   }
+  return StripUnpairedBrackets(UnicodeTextIndex(context_unicode), span,
+                               unilib);
+}
+
+CodepointSpan StripUnpairedBrackets(const UnicodeTextIndex& context_index,
+                                    CodepointSpan span, const UniLib& unilib) {
+  if (context_index.text().empty() || !ValidNonEmptySpan(span)) {
+    return span;
+  }
 
-  const char32 begin_char = FirstSpanCodepoint(context_unicode, span);
+  const char32 begin_char = FirstSpanCodepoint(context_index, span);
   const char32 paired_begin_char = unilib.GetPairedBracket(begin_char);
   if (paired_begin_char != begin_char) {
     if (!unilib.IsOpeningBracket(begin_char) ||
-        !IsCodepointInSpan(paired_begin_char, context_unicode, span)) {
+        !IsCodepointInSpan(paired_begin_char, context_index, span)) {
       ++span.first;
     }
   }
@@ -83,11 +86,11 @@ CodepointSpan StripUnpairedBrackets(const UnicodeText& context_unicode,
     return span;
   }
 
-  const char32 end_char = LastSpanCodepoint(context_unicode, span);
+  const char32 end_char = LastSpanCodepoint(context_index, span);
   const char32 paired_end_char = unilib.GetPairedBracket(end_char);
   if (paired_end_char != end_char) {
     if (!unilib.IsClosingBracket(end_char) ||
-        !IsCodepointInSpan(paired_end_char, context_unicode, span)) {
+        !IsCodepointInSpan(paired_end_char, context_index, span)) {
       --span.second;
     }
   }
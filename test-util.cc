@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "test-util.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// Per thread, so that the tests are not affected by the threads of other
+// tests, and counting does not add contention.
+thread_local libtextclassifier2::int64 num_allocations_on_thread = 0;
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+  ++num_allocations_on_thread;
+  void* ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+namespace libtextclassifier2 {
+
+ScopedAllocationCounter::ScopedAllocationCounter()
+    : start_(num_allocations_on_thread) {}
+
+int64 ScopedAllocationCounter::num_allocations() const {
+  return num_allocations_on_thread - start_;
+}
+
+}  // namespace libtextclassifier2
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Utilities for the tests.
+
+#ifndef LIBTEXTCLASSIFIER_TEST_UTIL_H_
+#define LIBTEXTCLASSIFIER_TEST_UTIL_H_
+
+#include "util/base/integral_types.h"
+
+namespace libtextclassifier2 {
+
+// Counts the allocations made with operator new on the calling thread during
+// its lifetime. The test binary replaces the global operator new to count
+// them, so that tests can bound the allocations made by a call.
+class ScopedAllocationCounter {
+ public:
+  ScopedAllocationCounter();
+
+  // The number of allocations since the construction.
+  int64 num_allocations() const;
+
+ private:
+  const int64 start_;
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_TEST_UTIL_H_
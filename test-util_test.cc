@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "test-util.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+// The allocations are stored here, so that the compiler can't elide them.
+void* volatile allocation_sink;
+
+TEST(ScopedAllocationCounterTest, CountsAllocationsOnThread) {
+  // The counts are collected before any assertion, which can allocate itself.
+  int64 counts[5];
+  ScopedAllocationCounter counter;
+  counts[0] = counter.num_allocations();
+
+  std::unique_ptr<int> value(new int(1));
+  allocation_sink = value.get();
+  counts[1] = counter.num_allocations();
+
+  std::vector<int> values;
+  values.reserve(16);
+  allocation_sink = values.data();
+  std::unique_ptr<int[]> array(new int[16]);
+  allocation_sink = array.get();
+  counts[2] = counter.num_allocations();
+
+  // A nested counter only counts from its construction.
+  ScopedAllocationCounter nested_counter;
+  value.reset(new int(2));
+  allocation_sink = value.get();
+  counts[3] = nested_counter.num_allocations();
+  counts[4] = counter.num_allocations();
+
+  EXPECT_EQ(counts[0], 0);
+  EXPECT_EQ(counts[1], 1);
+  EXPECT_EQ(counts[2], 3);
+  EXPECT_EQ(counts[3], 1);
+  EXPECT_EQ(counts[4], 4);
+}
+
+TEST(ScopedAllocationCounterTest, IgnoresOtherThreads) {
+  ScopedAllocationCounter counter;
+  std::thread thread([]() {
+    for (int i = 0; i < 10; ++i) {
+      std::unique_ptr<int> value(new int(i));
+    }
+  });
+  const int64 allocations_before_join = counter.num_allocations();
+  thread.join();
+  // The allocations of the thread are not counted.
+  EXPECT_EQ(counter.num_allocations(), allocations_before_join);
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "text-classifier-handle.h"
+
+#include "util/base/logging.h"
+
+namespace libtextclassifier2 {
+
+bool TextClassifierHandle::LoadFromPath(const std::string& path,
+                                        const UniLib* unilib) {
+  std::shared_ptr<const TextClassifier> classifier(
+      TextClassifier::FromPath(path, unilib).release());
+  if (classifier == nullptr) {
+    TC_LOG(ERROR) << "Could not load the model to publish: " << path;
+    return false;
+  }
+  Publish(std::move(classifier));
+  return true;
+}
+
+bool TextClassifierHandle::LoadFromFileDescriptor(int fd,
+                                                  const UniLib* unilib) {
+  std::shared_ptr<const TextClassifier> classifier(
+      TextClassifier::FromFileDescriptor(fd, unilib).release());
+  if (classifier == nullptr) {
+    TC_LOG(ERROR) << "Could not load the model to publish.";
+    return false;
+  }
+  Publish(std::move(classifier));
+  return true;
+}
+
+}  // namespace libtextclassifier2
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// A handle to the current TextClassifier of a process, through which a new
+// model can be swapped in while calls are running on the old one.
+
+#ifndef LIBTEXTCLASSIFIER_TEXT_CLASSIFIER_HANDLE_H_
+#define LIBTEXTCLASSIFIER_TEXT_CLASSIFIER_HANDLE_H_
+
+#include <memory>
+#include <string>
+
+#include "text-classifier.h"
+#include "util/base/macros.h"
+#include "util/thread/published-ptr.h"
+#include "util/utf8/unilib.h"
+
+namespace libtextclassifier2 {
+
+// Publishes the current classifier RCU-style: Get() takes a reference to it
+// without any lock (see PublishedPtr), and Publish() atomically replaces it.
+// The calls that hold the old classifier finish on it, the ones that start
+// later get the new one, and the old classifier, with its model mmap, is
+// destroyed when the last of its holders lets go of it.
+// Thread-safe.
+class TextClassifierHandle {
+ public:
+  explicit TextClassifierHandle(
+      std::shared_ptr<const TextClassifier> classifier = nullptr)
+      : classifier_(std::move(classifier)) {}
+
+  // Returns the current classifier, or nullptr if there is none. It stays
+  // valid for as long as the caller holds it, even if another one is published
+  // in the meantime, so a call should be made on the same instance throughout.
+  std::shared_ptr<const TextClassifier> Get() const {
+    return classifier_.Get();
+  }
+
+  // Makes 'classifier' the current one and returns the previous one.
+  std::shared_ptr<const TextClassifier> Publish(
+      std::shared_ptr<const TextClassifier> classifier) {
+    return classifier_.Publish(std::move(classifier));
+  }
+
+  // Loads the model from the given file and publishes it. Keeps the current
+  // classifier and returns false if the model can't be loaded. The loading
+  // happens before the swap, so it does not hold up other calls. 'unilib' has
+  // to outlive the classifier.
+  bool LoadFromPath(const std::string& path, const UniLib* unilib = nullptr);
+  bool LoadFromFileDescriptor(int fd, const UniLib* unilib = nullptr);
+
+ private:
+  PublishedPtr<const TextClassifier> classifier_;
+
+  TC_DISALLOW_COPY_AND_ASSIGN(TextClassifierHandle);
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_TEXT_CLASSIFIER_HANDLE_H_
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "text-classifier-handle.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+std::string GetModelPath() {
+  return LIBTEXTCLASSIFIER_TEST_DATA_DIR;
+}
+
+TEST(TextClassifierHandleTest, PublishesNewClassifiers) {
+  CREATE_UNILIB_FOR_TESTING;
+  TextClassifierHandle handle;
+  EXPECT_TRUE(handle.Get() == nullptr);
+
+  ASSERT_TRUE(handle.LoadFromPath(GetModelPath() + "test_model.fb", &unilib));
+  std::shared_ptr<const TextClassifier> old_classifier = handle.Get();
+  ASSERT_TRUE(old_classifier);
+
+  ASSERT_TRUE(
+      handle.LoadFromPath(GetModelPath() + "test_model_cc.fb", &unilib));
+  std::shared_ptr<const TextClassifier> new_classifier = handle.Get();
+  ASSERT_TRUE(new_classifier);
+  EXPECT_NE(new_classifier, old_classifier);
+
+  // The old classifier stays usable for as long as it is held.
+  const std::vector<ClassificationResult> results =
+      old_classifier->ClassifyText("call me at 853 225 3556", {11, 23});
+  ASSERT_FALSE(results.empty());
+  EXPECT_EQ(results[0].collection, "phone");
+
+  // Failing loads keep the current classifier.
+  EXPECT_FALSE(
+      handle.LoadFromPath(GetModelPath() + "no_such_model.fb", &unilib));
+  EXPECT_EQ(handle.Get(), new_classifier);
+}
+
+TEST(TextClassifierHandleTest, ReleasesOldClassifierAfterLastReader) {
+  CREATE_UNILIB_FOR_TESTING;
+  TextClassifierHandle handle;
+  ASSERT_TRUE(handle.LoadFromPath(GetModelPath() + "test_model.fb", &unilib));
+  std::shared_ptr<const TextClassifier> reader = handle.Get();
+  std::weak_ptr<const TextClassifier> old_classifier = reader;
+
+  ASSERT_TRUE(
+      handle.LoadFromPath(GetModelPath() + "test_model_cc.fb", &unilib));
+  EXPECT_FALSE(old_classifier.expired());
+  reader.reset();
+  EXPECT_TRUE(old_classifier.expired());
+}
+
+TEST(TextClassifierHandleTest, SwapsWhileCallsAreRunning) {
+  CREATE_UNILIB_FOR_TESTING;
+  TextClassifierHandle handle;
+  ASSERT_TRUE(handle.LoadFromPath(GetModelPath() + "test_model.fb", &unilib));
+
+  std::atomic<bool> done(false);
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; ++i) {
+    readers.emplace_back([&handle, &done]() {
+      while (!done.load()) {
+        std::shared_ptr<const TextClassifier> classifier = handle.Get();
+        ASSERT_TRUE(classifier);
+        classifier->Annotate("call me at 853 225 3556");
+      }
+    });
+  }
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(handle.LoadFromPath(
+        GetModelPath() + (i % 2 == 0 ? "test_model_cc.fb" : "test_model.fb"),
+        &unilib));
+  }
+  done = true;
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
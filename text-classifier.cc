@@ -19,11 +19,16 @@
 #include <algorithm>
 #include <cctype>
 #include <cmath>
+#include <cstring>
 #include <iterator>
 #include <numeric>
 
+#include "latency-stats.h"
 #include "util/base/logging.h"
+#include "util/hash/farmhash.h"
 #include "util/math/softmax.h"
+#include "util/memory/memory-usage.h"
+#include "util/strings/stringpiece.h"
 #include "util/utf8/unicodetext.h"
 
 namespace libtextclassifier2 {
@@ -37,9 +42,15 @@ const std::string& TextClassifier::kDateCollection =
     *[]() { return new std::string("date"); }();
 
 namespace {
-const Model* LoadAndVerifyModel(const void* addr, int size) {
+const Model* LoadAndVerifyModel(const void* addr, int size,
+                                bool verify_model = true,
+                                InitializationStats* stats = nullptr) {
   const Model* model = GetModel(addr);
+  if (!verify_model) {
+    return model;
+  }
 
+  ScopedInitializationTimer timer(stats, InitializationStats::VERIFICATION);
   flatbuffers::Verifier verifier(reinterpret_cast<const uint8_t*>(addr), size);
   if (model->Verify(verifier)) {
     return model;
@@ -47,12 +58,131 @@ const Model* LoadAndVerifyModel(const void* addr, int size) {
     return nullptr;
   }
 }
+
+// Creates the executor for an embedded TFLite model, verifying the model only
+// if asked to.
+std::unique_ptr<const ModelExecutor> CreateModelExecutor(
+    const flatbuffers::Vector<uint8_t>* model_spec_buffer, bool verify_model,
+    const ModelExecutorOptions& options) {
+  if (verify_model) {
+    return ModelExecutor::Instance(model_spec_buffer, options);
+  }
+  return ModelExecutor::Instance(
+      flatbuffers::GetRoot<tflite::Model>(model_spec_buffer->data()), options);
+}
+
+// Adds the patterns that loading 'model' compiles, defers and decompresses to
+// the counters of 'stats', if any. The regular expression patterns are always
+// decompressed for the prefilter, the datetime ones only if they are compiled.
+void CountPatternWork(const Model* model, InitializationStats* stats) {
+  if (stats == nullptr) {
+    return;
+  }
+  const bool lazy = model->lazy_regex_compilation();
+  auto count = [stats, lazy](const CompressedBuffer* compressed_pattern,
+                             InitializationStats::Counter compiled_counter,
+                             bool decompressed_if_lazy) {
+    stats->Increment(lazy ? InitializationStats::PATTERNS_DEFERRED
+                          : compiled_counter);
+    if (compressed_pattern != nullptr &&
+        compressed_pattern->buffer() != nullptr &&
+        (!lazy || decompressed_if_lazy)) {
+      stats->Increment(InitializationStats::PATTERNS_DECOMPRESSED);
+      stats->Increment(InitializationStats::BYTES_DECOMPRESSED,
+                       compressed_pattern->uncompressed_size());
+    }
+  };
+  // The datetime parser compiles identical patterns only once.
+  std::unordered_set<std::string> datetime_pattern_keys;
+  std::string key;
+  auto count_datetime = [&count, &datetime_pattern_keys, &key](
+                            const flatbuffers::String* pattern,
+                            const CompressedBuffer* compressed_pattern) {
+    if (SharedPatternKey(pattern, compressed_pattern, &key) &&
+        !datetime_pattern_keys.insert(key).second) {
+      return;
+    }
+    count(compressed_pattern, InitializationStats::DATETIME_PATTERNS_COMPILED,
+          /*decompressed_if_lazy=*/false);
+  };
+
+  if (model->regex_model() != nullptr &&
+      model->regex_model()->patterns() != nullptr) {
+    for (const RegexModel_::Pattern* pattern :
+         *model->regex_model()->patterns()) {
+      count(pattern->compressed_pattern(),
+            InitializationStats::REGEX_PATTERNS_COMPILED,
+            /*decompressed_if_lazy=*/true);
+    }
+  }
+
+  const DatetimeModel* datetime_model = model->datetime_model();
+  if (datetime_model == nullptr) {
+    return;
+  }
+  if (datetime_model->patterns() != nullptr) {
+    for (const DatetimeModelPattern* pattern : *datetime_model->patterns()) {
+      if (pattern->regexes() == nullptr) {
+        continue;
+      }
+      for (const DatetimeModelPattern_::Regex* regex : *pattern->regexes()) {
+        count_datetime(regex->pattern(), regex->compressed_pattern());
+      }
+    }
+  }
+  if (datetime_model->extractors() != nullptr) {
+    for (const DatetimeModelExtractor* extractor :
+         *datetime_model->extractors()) {
+      count_datetime(extractor->pattern(), extractor->compressed_pattern());
+    }
+  }
+}
+
+// Forwards to an embedding executor, recording the time spent in it.
+class LatencyRecordingEmbeddingExecutor : public EmbeddingExecutor {
+ public:
+  LatencyRecordingEmbeddingExecutor(const EmbeddingExecutor* executor,
+                                    LatencyStats* latency_stats)
+      : executor_(executor), latency_stats_(latency_stats) {}
+
+  bool AddEmbedding(const TensorView<int>& sparse_features, float* dest,
+                    int dest_size) const override {
+    ScopedLatencyTimer timer(latency_stats_, LatencyStats::EMBEDDING);
+    return executor_->AddEmbedding(sparse_features, dest, dest_size);
+  }
+
+  bool IsReady() const override { return executor_->IsReady(); }
+
+  int64 EstimateHeapBytes() const override {
+    return executor_->EstimateHeapBytes();
+  }
+
+  // Returns the executor to extract the features with: this one if there are
+  // stats to record to, otherwise the wrapped one, to save the indirection.
+  const EmbeddingExecutor* get() const {
+    return latency_stats_ != nullptr ? this : executor_;
+  }
+
+ private:
+  const EmbeddingExecutor* executor_;
+  LatencyStats* latency_stats_;
+};
 }  // namespace
 
+InterpreterManager::~InterpreterManager() {
+  if (selection_interpreter_) {
+    selection_executor_->ReleaseInterpreter(std::move(selection_interpreter_));
+  }
+  if (classification_interpreter_) {
+    classification_executor_->ReleaseInterpreter(
+        std::move(classification_interpreter_));
+  }
+}
+
 tflite::Interpreter* InterpreterManager::SelectionInterpreter() {
   if (!selection_interpreter_) {
     TC_CHECK(selection_executor_);
-    selection_interpreter_ = selection_executor_->CreateInterpreter();
+    selection_interpreter_ = selection_executor_->AcquireInterpreter();
     if (!selection_interpreter_) {
       TC_LOG(ERROR) << "Could not build TFLite interpreter.";
     }
@@ -63,7 +193,8 @@ tflite::Interpreter* InterpreterManager::SelectionInterpreter() {
 tflite::Interpreter* InterpreterManager::ClassificationInterpreter() {
   if (!classification_interpreter_) {
     TC_CHECK(classification_executor_);
-    classification_interpreter_ = classification_executor_->CreateInterpreter();
+    classification_interpreter_ =
+        classification_executor_->AcquireInterpreter();
     if (!classification_interpreter_) {
       TC_LOG(ERROR) << "Could not build TFLite interpreter.";
     }
@@ -72,14 +203,17 @@ tflite::Interpreter* InterpreterManager::ClassificationInterpreter() {
 }
 
 std::unique_ptr<TextClassifier> TextClassifier::FromUnownedBuffer(
-    const char* buffer, int size, const UniLib* unilib) {
-  const Model* model = LoadAndVerifyModel(buffer, size);
+    const char* buffer, int size, const UniLib* unilib, bool verify_model,
+    const ModelExecutionOptions& execution_options) {
+  const Model* model =
+      LoadAndVerifyModel(buffer, size, verify_model,
+                         execution_options.initialization_stats);
   if (model == nullptr) {
     return nullptr;
   }
 
-  auto classifier =
-      std::unique_ptr<TextClassifier>(new TextClassifier(model, unilib));
+  auto classifier = std::unique_ptr<TextClassifier>(
+      new TextClassifier(model, unilib, verify_model, execution_options));
   if (!classifier->IsInitialized()) {
     return nullptr;
   }
@@ -88,21 +222,24 @@ std::unique_ptr<TextClassifier> TextClassifier::FromUnownedBuffer(
 }
 
 std::unique_ptr<TextClassifier> TextClassifier::FromScopedMmap(
-    std::unique_ptr<ScopedMmap>* mmap, const UniLib* unilib) {
+    std::unique_ptr<ScopedMmap>* mmap, const UniLib* unilib, bool verify_model,
+    const ModelExecutionOptions& execution_options) {
   if (!(*mmap)->handle().ok()) {
     TC_VLOG(1) << "Mmap failed.";
     return nullptr;
   }
 
-  const Model* model = LoadAndVerifyModel((*mmap)->handle().start(),
-                                          (*mmap)->handle().num_bytes());
+  const Model* model =
+      LoadAndVerifyModel((*mmap)->handle().start(),
+                         (*mmap)->handle().num_bytes(), verify_model,
+                         execution_options.initialization_stats);
   if (!model) {
     TC_LOG(ERROR) << "Model verification failed.";
     return nullptr;
   }
 
-  auto classifier =
-      std::unique_ptr<TextClassifier>(new TextClassifier(mmap, model, unilib));
+  auto classifier = std::unique_ptr<TextClassifier>(
+      new TextClassifier(mmap, model, unilib, verify_model, execution_options));
   if (!classifier->IsInitialized()) {
     return nullptr;
   }
@@ -111,25 +248,31 @@ std::unique_ptr<TextClassifier> TextClassifier::FromScopedMmap(
 }
 
 std::unique_ptr<TextClassifier> TextClassifier::FromFileDescriptor(
-    int fd, int offset, int size, const UniLib* unilib) {
+    int fd, int offset, int size, const UniLib* unilib, bool verify_model,
+    const ModelExecutionOptions& execution_options) {
   std::unique_ptr<ScopedMmap> mmap(new ScopedMmap(fd, offset, size));
-  return FromScopedMmap(&mmap, unilib);
+  return FromScopedMmap(&mmap, unilib, verify_model, execution_options);
 }
 
 std::unique_ptr<TextClassifier> TextClassifier::FromFileDescriptor(
-    int fd, const UniLib* unilib) {
+    int fd, const UniLib* unilib, bool verify_model,
+    const ModelExecutionOptions& execution_options) {
   std::unique_ptr<ScopedMmap> mmap(new ScopedMmap(fd));
-  return FromScopedMmap(&mmap, unilib);
+  return FromScopedMmap(&mmap, unilib, verify_model, execution_options);
 }
 
 std::unique_ptr<TextClassifier> TextClassifier::FromPath(
-    const std::string& path, const UniLib* unilib) {
+    const std::string& path, const UniLib* unilib, bool verify_model,
+    const ModelExecutionOptions& execution_options) {
   std::unique_ptr<ScopedMmap> mmap(new ScopedMmap(path));
-  return FromScopedMmap(&mmap, unilib);
+  return FromScopedMmap(&mmap, unilib, verify_model, execution_options);
 }
 
 void TextClassifier::ValidateAndInitialize() {
   initialized_ = false;
+  InitializationStats* stats = execution_options_.initialization_stats;
+  ScopedInitializationTimer initialization_timer(
+      stats, InitializationStats::INITIALIZATION);
 
   if (model_ == nullptr) {
     TC_LOG(ERROR) << "No model specified.";
@@ -148,7 +291,9 @@ void TextClassifier::ValidateAndInitialize() {
        (model_->triggering_options()->enabled_modes() & ModeFlag_SELECTION));
 
   // Annotation requires the selection model.
-  if (model_enabled_for_annotation || model_enabled_for_selection) {
+  const bool needs_selection_model =
+      model_enabled_for_annotation || model_enabled_for_selection;
+  if (needs_selection_model) {
     if (!model_->selection_options()) {
       TC_LOG(ERROR) << "No selection options.";
       return;
@@ -165,20 +310,15 @@ void TextClassifier::ValidateAndInitialize() {
       TC_LOG(ERROR) << "No selection model.";
       return;
     }
-    selection_executor_ = ModelExecutor::Instance(model_->selection_model());
-    if (!selection_executor_) {
-      TC_LOG(ERROR) << "Could not initialize selection executor.";
-      return;
-    }
-    selection_feature_processor_.reset(
-        new FeatureProcessor(model_->selection_feature_options(), unilib_));
   }
 
   // Annotation requires the classification model for conflict resolution and
   // scoring.
   // Selection requires the classification model for conflict resolution.
-  if (model_enabled_for_annotation || model_enabled_for_classification ||
-      model_enabled_for_selection) {
+  const bool needs_classification_model = model_enabled_for_annotation ||
+                                          model_enabled_for_classification ||
+                                          model_enabled_for_selection;
+  if (needs_classification_model) {
     if (!model_->classification_options()) {
       TC_LOG(ERROR) << "No classification options.";
       return;
@@ -198,22 +338,11 @@ void TextClassifier::ValidateAndInitialize() {
       TC_LOG(ERROR) << "No clf model.";
       return;
     }
-
-    classification_executor_ =
-        ModelExecutor::Instance(model_->classification_model());
-    if (!classification_executor_) {
-      TC_LOG(ERROR) << "Could not initialize classification executor.";
-      return;
-    }
-
-    classification_feature_processor_.reset(new FeatureProcessor(
-        model_->classification_feature_options(), unilib_));
   }
 
   // The embeddings need to be specified if the model is to be used for
   // classification or selection.
-  if (model_enabled_for_annotation || model_enabled_for_classification ||
-      model_enabled_for_selection) {
+  if (needs_classification_model) {
     if (!model_->embedding_model()) {
       TC_LOG(ERROR) << "No embedding model.";
       return;
@@ -230,35 +359,155 @@ void TextClassifier::ValidateAndInitialize() {
       TC_LOG(ERROR) << "Mismatching embedding size/quantization.";
       return;
     }
-
-    embedding_executor_ = TFLiteEmbeddingExecutor::Instance(
-        model_->embedding_model(),
-        model_->classification_feature_options()->embedding_size(),
-        model_->classification_feature_options()
-            ->embedding_quantization_bits());
-    if (!embedding_executor_) {
-      TC_LOG(ERROR) << "Could not initialize embedding executor.";
-      return;
-    }
   }
 
-  std::unique_ptr<ZlibDecompressor> decompressor = ZlibDecompressor::Instance();
-  if (model_->regex_model()) {
-    if (!InitializeRegexModel(decompressor.get())) {
-      TC_LOG(ERROR) << "Could not initialize regex model.";
-      return;
-    }
-  }
+  // The parts below are built independently of each other, in parallel if
+  // there is an executor. RunInParallel() runs the last task on the calling
+  // thread, so the pattern task, which itself fans out over the patterns, is
+  // last to ensure that no pool thread blocks waiting for other pool tasks.
+  enum {
+    kSelectionTask,
+    kClassificationTask,
+    kEmbeddingTask,
+    kPatternsTask,
+    kNumTasks
+  };
+  Executor* executor = execution_options_.initialization_executor;
+  auto run_task = [this, executor, stats, needs_selection_model,
+                   needs_classification_model](int task) {
+    switch (task) {
+      case kSelectionTask: {
+        if (!needs_selection_model) {
+          return true;
+        }
+        {
+          ScopedInitializationTimer timer(
+              stats, InitializationStats::SELECTION_EXECUTOR);
+          selection_executor_ =
+              CreateModelExecutor(model_->selection_model(), verify_model_,
+                                  execution_options_.selection);
+        }
+        if (!selection_executor_) {
+          TC_LOG(ERROR) << "Could not initialize selection executor.";
+          return false;
+        }
+        ScopedInitializationTimer timer(
+            stats, InitializationStats::FEATURE_PROCESSORS);
+        selection_feature_processor_.reset(
+            new FeatureProcessor(model_->selection_feature_options(), unilib_));
+        return true;
+      }
+      case kClassificationTask: {
+        if (!needs_classification_model) {
+          return true;
+        }
+        {
+          ScopedInitializationTimer timer(
+              stats, InitializationStats::CLASSIFICATION_EXECUTOR);
+          classification_executor_ =
+              CreateModelExecutor(model_->classification_model(),
+                                  verify_model_,
+                                  execution_options_.classification);
+        }
+        if (!classification_executor_) {
+          TC_LOG(ERROR) << "Could not initialize classification executor.";
+          return false;
+        }
+        if (execution_options_.batch_classifications_across_calls) {
+          const ModelExecutor* model_executor = classification_executor_.get();
+          classification_batcher_.reset(new DynamicBatcher(
+              [model_executor](const TensorView<float>& features,
+                               std::vector<float>* logits) {
+                std::unique_ptr<tflite::Interpreter> interpreter =
+                    model_executor->AcquireInterpreter();
+                if (!interpreter) {
+                  return false;
+                }
+                const TensorView<float> batch_logits =
+                    model_executor->ComputeLogits(features, interpreter.get());
+                if (batch_logits.is_valid()) {
+                  logits->assign(batch_logits.data(),
+                                 batch_logits.data() + batch_logits.size());
+                }
+                model_executor->ReleaseInterpreter(std::move(interpreter));
+                return batch_logits.is_valid();
+              },
+              execution_options_.classification_batching));
+        }
+
+        ScopedInitializationTimer timer(
+            stats, InitializationStats::FEATURE_PROCESSORS);
+        classification_feature_processor_.reset(new FeatureProcessor(
+            model_->classification_feature_options(), unilib_));
+        return true;
+      }
+      case kEmbeddingTask: {
+        if (!needs_classification_model) {
+          return true;
+        }
+        ScopedInitializationTimer timer(
+            stats, InitializationStats::EMBEDDING_EXECUTOR);
+        embedding_executor_ = TFLiteEmbeddingExecutor::Instance(
+            model_->embedding_model(),
+            model_->classification_feature_options()->embedding_size(),
+            model_->classification_feature_options()
+                ->embedding_quantization_bits(),
+            verify_model_);
+        if (!embedding_executor_) {
+          TC_LOG(ERROR) << "Could not initialize embedding executor.";
+          return false;
+        }
+        return true;
+      }
+      case kPatternsTask: {
+        // Models with uncompressed rules don't need the inflate state at all.
+        // Legacy compressed rules share it, and are decompressed in order.
+        std::unique_ptr<ZlibDecompressor> decompressor;
+        if (HasCompressedPatterns(model_)) {
+          decompressor = ZlibDecompressor::Instance();
+        }
+        CountPatternWork(model_, stats);
+        if (model_->regex_model()) {
+          ScopedInitializationTimer timer(stats,
+                                          InitializationStats::REGEX_MODEL);
+          if (!InitializeRegexModel(decompressor.get(), executor)) {
+            TC_LOG(ERROR) << "Could not initialize regex model.";
+            return false;
+          }
+        }
 
-  if (model_->datetime_model()) {
-    datetime_parser_ = DatetimeParser::Instance(model_->datetime_model(),
-                                                *unilib_, decompressor.get());
-    if (!datetime_parser_) {
-      TC_LOG(ERROR) << "Could not initialize datetime parser.";
+        if (model_->datetime_model()) {
+          ScopedInitializationTimer timer(stats,
+                                          InitializationStats::DATETIME_PARSER);
+          datetime_parser_ = DatetimeParser::Instance(
+              model_->datetime_model(), *unilib_, decompressor.get(),
+              /*compile_lazily=*/model_->lazy_regex_compilation(), executor);
+          if (!datetime_parser_) {
+            TC_LOG(ERROR) << "Could not initialize datetime parser.";
+            return false;
+          }
+        }
+        return true;
+      }
+    }
+    return false;
+  };
+  std::vector<char> task_succeeded(kNumTasks, true);
+  RunInParallel(executor, kNumTasks, [&run_task, &task_succeeded](int task) {
+    task_succeeded[task] = run_task(task);
+  });
+  for (const bool succeeded : task_succeeded) {
+    if (!succeeded) {
       return;
     }
   }
 
+  share_tokens_between_processors_ =
+      selection_feature_processor_ != nullptr &&
+      classification_feature_processor_ != nullptr &&
+      internal::HaveSameTokenization(model_->selection_feature_options(),
+                                     model_->classification_feature_options());
+
   if (model_->output_options()) {
     if (model_->output_options()->filtered_collections_annotation()) {
       for (const auto collection :
@@ -280,25 +529,186 @@ void TextClassifier::ValidateAndInitialize() {
     }
   }
 
+  InitializeCollections();
   initialized_ = true;
 }
 
-bool TextClassifier::InitializeRegexModel(ZlibDecompressor* decompressor) {
+void TextClassifier::InitializeCollections() {
+  auto add_collection = [this](const std::string& collection) {
+    if (collection_ids_.emplace(collection, collections_.size()).second) {
+      collections_.push_back(collection);
+    }
+  };
+  add_collection(kOtherCollection);
+  if (classification_feature_processor_) {
+    for (int i = 0; i < classification_feature_processor_->NumCollections();
+         ++i) {
+      add_collection(classification_feature_processor_->LabelToCollection(i));
+    }
+  }
+  for (const CompiledRegexPattern& regex_pattern : regex_patterns_) {
+    add_collection(regex_pattern.collection_name);
+  }
+  if (datetime_parser_) {
+    add_collection(kDateCollection);
+  }
+}
+
+int TextClassifier::GetCollectionId(const std::string& collection) const {
+  const auto it = collection_ids_.find(collection);
+  if (it == collection_ids_.end()) {
+    return -1;
+  }
+  return it->second;
+}
+
+bool TextClassifier::WarmUp(int modes, bool lock_in_memory) const {
+  std::vector<const flatbuffers::Vector<uint8_t>*> sections;
+  if (modes & (ModeFlag_ANNOTATION | ModeFlag_SELECTION)) {
+    sections.push_back(model_->selection_model());
+  }
+  // All modes classify, if only to resolve conflicts between candidates.
+  if (modes & ModeFlag_ALL) {
+    sections.push_back(model_->classification_model());
+    sections.push_back(model_->embedding_model());
+  }
+
+  bool success = true;
+  for (const flatbuffers::Vector<uint8_t>* section : sections) {
+    if (section == nullptr) {
+      continue;
+    }
+    if (!PrefetchMemory(section->data(), section->size())) {
+      success = false;
+    }
+    if (lock_in_memory && !LockMemory(section->data(), section->size())) {
+      success = false;
+    }
+  }
+  return success;
+}
+
+bool TextClassifier::Freeze(const std::vector<std::string>& locales) {
+  bool success = true;
+  for (const CompiledRegexPattern& regex_pattern : regex_patterns_) {
+    const UniLib::RegexPattern* pattern = regex_pattern.pattern->Get();
+    if (pattern == nullptr) {
+      TC_LOG(ERROR) << "Could not compile regex pattern for "
+                    << regex_pattern.collection_name;
+      success = false;
+      continue;
+    }
+    pattern->ClearMatcherPool();
+  }
+  if (datetime_parser_ && !datetime_parser_->Freeze(locales)) {
+    TC_LOG(ERROR) << "Could not freeze datetime parser.";
+    success = false;
+  }
+  if (selection_executor_) {
+    selection_executor_->ClearInterpreterPool();
+  }
+  if (classification_executor_) {
+    classification_executor_->ClearInterpreterPool();
+  }
+  return success;
+}
+
+MemoryStats TextClassifier::GetMemoryStats() const {
+  MemoryStats stats;
+  if (mmap_ != nullptr && mmap_->handle().ok()) {
+    stats.model_mapped_bytes = mmap_->handle().num_bytes();
+    stats.model_resident_bytes = std::max<int64>(
+        ResidentMemoryBytes(mmap_->handle().start(),
+                            mmap_->handle().num_bytes()),
+        0);
+  }
+
+  stats.regex_bytes = VectorHeapBytes(regex_patterns_) +
+                      HashTableHeapBytes(regex_approximate_match_pattern_ids_) +
+                      regex_prefilter_.EstimateHeapBytes();
+  for (const CompiledRegexPattern& regex_pattern : regex_patterns_) {
+    stats.regex_bytes += StringHeapBytes(regex_pattern.collection_name) +
+                         sizeof(LazyRegexPattern) +
+                         regex_pattern.pattern->EstimateHeapBytes();
+  }
+
+  if (datetime_parser_ != nullptr) {
+    stats.datetime_bytes = datetime_parser_->EstimateHeapBytes();
+  }
+
+  if (selection_executor_ != nullptr) {
+    stats.interpreter_bytes +=
+        selection_executor_->EstimatePooledInterpreterBytes();
+  }
+  if (classification_executor_ != nullptr) {
+    stats.interpreter_bytes +=
+        classification_executor_->EstimatePooledInterpreterBytes();
+  }
+  if (embedding_executor_ != nullptr) {
+    stats.embedding_bytes = embedding_executor_->EstimateHeapBytes();
+  }
+
+  for (const FeatureProcessor* feature_processor :
+       {selection_feature_processor_.get(),
+        classification_feature_processor_.get()}) {
+    if (feature_processor != nullptr) {
+      stats.feature_processor_bytes += feature_processor->EstimateHeapBytes();
+      stats.tokenizer_bytes += feature_processor->EstimateTokenizerHeapBytes();
+    }
+  }
+  return stats;
+}
+
+bool TextClassifier::InitializeRegexModel(ZlibDecompressor* decompressor,
+                                          Executor* executor) {
   if (!model_->regex_model()->patterns()) {
     return true;
   }
 
+  RegexWorkLimits limits;
+  limits.time_limit = model_->regex_model()->regex_time_limit();
+  limits.stack_limit_bytes = model_->regex_model()->regex_stack_limit();
+
+  std::vector<std::unique_ptr<UniLib::RegexPattern>> compiled_patterns;
+  std::vector<std::string> pattern_texts;
+  if (!model_->lazy_regex_compilation()) {
+    std::vector<std::pair<const flatbuffers::String*, const CompressedBuffer*>>
+        patterns;
+    for (const auto& regex_pattern : *model_->regex_model()->patterns()) {
+      patterns.push_back(
+          {regex_pattern->pattern(), regex_pattern->compressed_pattern()});
+    }
+    if (!UncompressMakeRegexPatterns(*unilib_, patterns, decompressor,
+                                     executor, limits, &compiled_patterns,
+                                     &pattern_texts)) {
+      TC_LOG(INFO) << "Failed to load regex pattern";
+      return false;
+    }
+  }
+
   // Initialize pattern recognizers.
   int regex_pattern_id = 0;
   for (const auto& regex_pattern : *model_->regex_model()->patterns()) {
-    std::unique_ptr<UniLib::RegexPattern> compiled_pattern =
-        UncompressMakeRegexPattern(*unilib_, regex_pattern->pattern(),
-                                   regex_pattern->compressed_pattern(),
-                                   decompressor);
-    if (!compiled_pattern) {
-      TC_LOG(INFO) << "Failed to load regex pattern";
-      return false;
+    std::string pattern_text;
+    std::unique_ptr<LazyRegexPattern> lazy_pattern;
+    if (model_->lazy_regex_compilation()) {
+      // The prefilter needs the pattern text right away, but the compilation
+      // can wait until the pattern is first run.
+      if (!UncompressPatternText(regex_pattern->pattern(),
+                                 regex_pattern->compressed_pattern(),
+                                 decompressor, &pattern_text)) {
+        TC_LOG(INFO) << "Failed to load regex pattern";
+        return false;
+      }
+      lazy_pattern.reset(new LazyRegexPattern(
+          *unilib_, regex_pattern->pattern(),
+          regex_pattern->compressed_pattern(), limits));
+    } else {
+      pattern_text = std::move(pattern_texts[regex_pattern_id]);
+      lazy_pattern.reset(new LazyRegexPattern(
+          *unilib_, std::move(compiled_patterns[regex_pattern_id])));
     }
+    regex_prefilter_.AddPattern(pattern_text);
 
     if (regex_pattern->enabled_modes() & ModeFlag_ANNOTATION) {
       annotation_regex_patterns_.push_back(regex_pattern_id);
@@ -312,25 +722,36 @@ bool TextClassifier::InitializeRegexModel(ZlibDecompressor* decompressor) {
     regex_patterns_.push_back({regex_pattern->collection_name()->str(),
                                regex_pattern->target_classification_score(),
                                regex_pattern->priority_score(),
-                               std::move(compiled_pattern)});
+                               std::move(lazy_pattern)});
     if (regex_pattern->use_approximate_matching()) {
       regex_approximate_match_pattern_ids_.insert(regex_pattern_id);
     }
     ++regex_pattern_id;
   }
+  regex_prefilter_.Build();
 
   return true;
 }
 
 namespace {
 
-int CountDigits(const std::string& str, CodepointSpan selection_indices) {
+// Returns true if the text has a line separator, on which the feature
+// processors split the context into lines.
+bool HasLineSeparator(const UnicodeText& text) {
+  const char* begin = text.data();
+  const char* end = begin + text.size_bytes();
+  return std::find_if(begin, end, [](char c) {
+           return c == '\n' || c == '|';
+         }) != end;
+}
+
+int CountDigits(const UnicodeText& unicode_str,
+                CodepointSpan selection_indices) {
   int count = 0;
   int i = 0;
-  const UnicodeText unicode_str = UTF8ToUnicodeText(str, /*do_copy=*/false);
-  for (auto it = unicode_str.begin(); it != unicode_str.end(); ++it, ++i) {
-    if (i >= selection_indices.first && i < selection_indices.second &&
-        isdigit(*it)) {
+  for (auto it = unicode_str.begin();
+       it != unicode_str.end() && i < selection_indices.second; ++it, ++i) {
+    if (i >= selection_indices.first && isdigit(*it)) {
       ++count;
     }
   }
@@ -343,8 +764,9 @@ std::string ExtractSelection(const std::string& context,
       UTF8ToUnicodeText(context, /*do_copy=*/false);
   auto selection_begin = context_unicode.begin();
   std::advance(selection_begin, selection_indices.first);
-  auto selection_end = context_unicode.begin();
-  std::advance(selection_end, selection_indices.second);
+  auto selection_end = selection_begin;
+  std::advance(selection_end,
+               selection_indices.second - selection_indices.first);
   return UnicodeText::UTF8Substring(selection_begin, selection_end);
 }
 }  // namespace
@@ -358,11 +780,11 @@ CodepointSpan SnapLeftIfWhitespaceSelection(CodepointSpan span,
                                             const UniLib& unilib) {
   TC_CHECK(ValidNonEmptySpan(span));
 
-  UnicodeText::const_iterator it;
+  UnicodeText::const_iterator span_begin = context_unicode.begin();
+  std::advance(span_begin, span.first);
 
   // Check that the current selection is all whitespaces.
-  it = context_unicode.begin();
-  std::advance(it, span.first);
+  UnicodeText::const_iterator it = span_begin;
   for (int i = 0; i < (span.second - span.first); ++i, ++it) {
     if (!unilib.IsWhitespace(*it)) {
       return span;
@@ -373,8 +795,7 @@ CodepointSpan SnapLeftIfWhitespaceSelection(CodepointSpan span,
 
   // Try moving left.
   result = span;
-  it = context_unicode.begin();
-  std::advance(it, span.first);
+  it = span_begin;
   while (it != context_unicode.begin() && unilib.IsWhitespace(*it)) {
     --result.first;
     --it;
@@ -403,6 +824,23 @@ bool TextClassifier::FilteredForClassification(
          filtered_collections_classification_.end();
 }
 
+bool TextClassifier::ModelProducesAnyOf(
+    const std::unordered_set<std::string>& entity_types) const {
+  if (entity_types.empty()) {
+    return true;
+  }
+  for (int i = 0; i < classification_feature_processor_->NumCollections();
+       ++i) {
+    const std::string& collection =
+        classification_feature_processor_->LabelToCollection(i);
+    if (collection != kOtherCollection &&
+        entity_types.find(collection) != entity_types.end()) {
+      return true;
+    }
+  }
+  return false;
+}
+
 bool TextClassifier::FilteredForSelection(const AnnotatedSpan& span) const {
   return !span.classification.empty() &&
          filtered_collections_selection_.find(
@@ -410,9 +848,94 @@ bool TextClassifier::FilteredForSelection(const AnnotatedSpan& span) const {
              filtered_collections_selection_.end();
 }
 
+namespace {
+uint64 CombineFingerprints(uint64 first, uint64 second) {
+  return tc2farmhash::Fingerprint(tc2farmhash::Uint128(first, second));
+}
+
+uint64 SpanFingerprint(const std::string& context, CodepointSpan span) {
+  return CombineFingerprints(
+      tc2farmhash::Fingerprint64(context),
+      CombineFingerprints(span.first, span.second));
+}
+
+// The tokenization depends on the locales, so the tokens are only reused by a
+// call with the same ones.
+uint64 TokensCacheKey(const std::string& context, CodepointSpan span,
+                      const std::string& locales) {
+  return CombineFingerprints(SpanFingerprint(context, span),
+                             tc2farmhash::Fingerprint64(locales));
+}
+
+uint64 SelectionCacheKey(const std::string& context,
+                         CodepointSpan click_indices,
+                         const SelectionOptions& options) {
+  return CombineFingerprints(SpanFingerprint(context, click_indices),
+                             tc2farmhash::Fingerprint64(options.locales));
+}
+
+uint64 ClassificationCacheKey(const std::string& context,
+                              CodepointSpan selection_indices,
+                              const ClassificationOptions& options) {
+  uint64 key = SpanFingerprint(context, selection_indices);
+  key = CombineFingerprints(key, options.reference_time_ms_utc);
+  key = CombineFingerprints(
+      key, tc2farmhash::Fingerprint64(options.reference_timezone));
+  key = CombineFingerprints(key, tc2farmhash::Fingerprint64(options.locales));
+  // The set has no order, so the types are combined in a canonical one.
+  std::vector<std::string> entity_types(options.entity_types.begin(),
+                                        options.entity_types.end());
+  std::sort(entity_types.begin(), entity_types.end());
+  for (const std::string& entity_type : entity_types) {
+    key = CombineFingerprints(key, tc2farmhash::Fingerprint64(entity_type));
+  }
+  return key;
+}
+
+// Returns whether results of the collection are wanted by a call that asked
+// for 'entity_types'.
+bool IsEntityTypeRequested(const std::unordered_set<std::string>& entity_types,
+                           const std::string& collection) {
+  return entity_types.empty() ||
+         entity_types.find(collection) != entity_types.end();
+}
+}  // namespace
+
 CodepointSpan TextClassifier::SuggestSelection(
     const std::string& context, CodepointSpan click_indices,
     const SelectionOptions& options) const {
+  if (!result_cache_.IsEnabled()) {
+    return SuggestSelectionInternal(context, click_indices, options,
+                                    /*context_tokens=*/nullptr);
+  }
+
+  const uint64 key = SelectionCacheKey(context, click_indices, options);
+  CodepointSpan selection;
+  if (result_cache_.LookupSelection(key, &selection)) {
+    return selection;
+  }
+  std::vector<Token> tokens;
+  selection =
+      SuggestSelectionInternal(context, click_indices, options, &tokens);
+  result_cache_.InsertSelection(key, selection);
+
+  // Keep the tokens for a ClassifyText() call on the suggested selection.
+  // They are only valid for the classification if both processors tokenize
+  // the same way. The tokens are the ones of the whole context, from before
+  // the selection restricted them to the line of the click and retokenized
+  // them, so the classification still applies its own options to them.
+  if (!tokens.empty() && share_tokens_between_processors_) {
+    result_cache_.InsertTokens(
+        TokensCacheKey(context, selection, options.locales),
+        std::make_shared<const std::vector<Token>>(std::move(tokens)));
+  }
+  return selection;
+}
+
+CodepointSpan TextClassifier::SuggestSelectionInternal(
+    const std::string& context, CodepointSpan click_indices,
+    const SelectionOptions& options,
+    std::vector<Token>* context_tokens) const {
   CodepointSpan original_click_indices = click_indices;
   if (!initialized_) {
     TC_LOG(ERROR) << "Not initialized";
@@ -429,53 +952,125 @@ CodepointSpan TextClassifier::SuggestSelection(
     return original_click_indices;
   }
 
-  const int context_codepoint_size = context_unicode.size_codepoints();
+  InterpreterManager interpreter_manager(
+      selection_executor_.get(), classification_executor_.get(),
+      options.latency_stats, options.locales);
+  SelectionContext selection_context;
+  selection_context.keep_tokens = context_tokens != nullptr;
+  std::vector<Token> tokens;
+  const CodepointSpan selection = SuggestSelectionInContext(
+      context, context_unicode, click_indices, options, &interpreter_manager,
+      &selection_context, &tokens);
+  if (context_tokens != nullptr) {
+    *context_tokens = std::move(selection_context.tokens);
+  }
+  return selection;
+}
 
-  if (click_indices.first < 0 || click_indices.second < 0 ||
-      click_indices.first >= context_codepoint_size ||
-      click_indices.second > context_codepoint_size ||
-      click_indices.first >= click_indices.second) {
-    TC_VLOG(1) << "Trying to run SuggestSelection with invalid indices: "
-               << click_indices.first << " " << click_indices.second;
-    return original_click_indices;
+std::vector<CodepointSpan> TextClassifier::SuggestSelections(
+    const std::string& context, const std::vector<CodepointSpan>& clicks,
+    const SelectionOptions& options) const {
+  if (!initialized_) {
+    TC_LOG(ERROR) << "Not initialized";
+    return clicks;
+  }
+  if (!(model_->enabled_modes() & ModeFlag_SELECTION)) {
+    return clicks;
   }
 
-  if (model_->snap_whitespace_selections()) {
-    // We want to expand a purely white-space selection to a multi-selection it
-    // would've been part of. But with this feature disabled we would do a no-
-    // op, because no token is found. Therefore, we need to modify the
-    // 'click_indices' a bit to include a part of the token, so that the click-
-    // finding logic finds the clicked token correctly. This modification is
-    // done by the following function. Note, that it's enough to check the left
-    // side of the current selection, because if the white-space is a part of a
-    // multi-selection, neccessarily both tokens - on the left and the right
-    // sides need to be selected. Thus snapping only to the left is sufficient
-    // (there's a check at the bottom that makes sure that if we snap to the
-    // left token but the result does not contain the initial white-space,
-    // returns the original indices).
-    click_indices = internal::SnapLeftIfWhitespaceSelection(
-        click_indices, context_unicode, *unilib_);
+  const UnicodeText context_unicode = UTF8ToUnicodeText(context,
+                                                        /*do_copy=*/false);
+  if (!context_unicode.is_valid()) {
+    return clicks;
   }
 
-  std::vector<AnnotatedSpan> candidates;
-  InterpreterManager interpreter_manager(selection_executor_.get(),
-                                         classification_executor_.get());
+  InterpreterManager interpreter_manager(
+      selection_executor_.get(), classification_executor_.get(),
+      options.latency_stats, options.locales);
+
+  // The selection model runs for all the clicks first, so that they share the
+  // tokens, features and inference batches.
+  std::vector<CodepointSpan> model_clicks;
+  model_clicks.reserve(clicks.size());
+  for (const CodepointSpan& click_indices : clicks) {
+    CodepointSpan model_click_indices;
+    if (!SelectionModelClick(context_unicode, click_indices,
+                             &model_click_indices)) {
+      model_click_indices = {kInvalidIndex, kInvalidIndex};
+    }
+    model_clicks.push_back(model_click_indices);
+  }
+  FeatureProcessor::EmbeddingCache embedding_cache;
+  std::vector<ModelSelection> model_selections;
+  ModelSuggestSelections(context_unicode, model_clicks, &interpreter_manager,
+                         &embedding_cache, &model_selections);
+
+  SelectionContext selection_context;
+  std::vector<CodepointSpan> selections;
+  selections.reserve(clicks.size());
   std::vector<Token> tokens;
-  if (!ModelSuggestSelection(context_unicode, click_indices,
-                             &interpreter_manager, &tokens, &candidates)) {
-    TC_LOG(ERROR) << "Model suggest selection failed.";
-    return original_click_indices;
+  for (int i = 0; i < clicks.size(); ++i) {
+    selection_context.model_selection = &model_selections[i];
+    selections.push_back(SuggestSelectionInContext(
+        context, context_unicode, clicks[i], options, &interpreter_manager,
+        &selection_context, &tokens));
   }
-  if (!RegexChunk(context_unicode, selection_regex_patterns_, &candidates)) {
-    TC_LOG(ERROR) << "Regex suggest selection failed.";
+  return selections;
+}
+
+CodepointSpan TextClassifier::SuggestSelectionInContext(
+    const std::string& context, const UnicodeText& context_unicode,
+    CodepointSpan click_indices, const SelectionOptions& options,
+    InterpreterManager* interpreter_manager,
+    SelectionContext* selection_context, std::vector<Token>* tokens) const {
+  const CodepointSpan original_click_indices = click_indices;
+  if (!SelectionModelClick(context_unicode, original_click_indices,
+                           &click_indices)) {
     return original_click_indices;
   }
-  if (!DatetimeChunk(UTF8ToUnicodeText(context, /*do_copy=*/false),
-                     /*reference_time_ms_utc=*/0, /*reference_timezone=*/"",
-                     options.locales, ModeFlag_SELECTION, &candidates)) {
-    TC_LOG(ERROR) << "Datetime suggest selection failed.";
+
+  std::vector<AnnotatedSpan> candidates;
+  const ModelSelection* model_selection = selection_context->model_selection;
+  if (model_selection != nullptr) {
+    if (model_selection->failed) {
+      TC_LOG(ERROR) << "Model suggest selection failed.";
+      return original_click_indices;
+    }
+    candidates = model_selection->candidates;
+  } else if (!ModelSuggestSelection(context_unicode, click_indices,
+                                    interpreter_manager, selection_context,
+                                    tokens, &candidates)) {
+    TC_LOG(ERROR) << "Model suggest selection failed.";
     return original_click_indices;
   }
+  const std::vector<Token>& click_tokens =
+      model_selection != nullptr && model_selection->tokens != nullptr
+          ? *model_selection->tokens
+          : *tokens;
+  if (!selection_context->has_rule_candidates) {
+    {
+      ScopedLatencyTimer timer(options.latency_stats, LatencyStats::REGEX);
+      if (!RegexChunk(context_unicode, selection_regex_patterns_,
+                      &selection_context->rule_candidates)) {
+        TC_LOG(ERROR) << "Regex suggest selection failed.";
+        return original_click_indices;
+      }
+    }
+    {
+      ScopedLatencyTimer timer(options.latency_stats, LatencyStats::DATETIME);
+      if (!DatetimeChunk(context_unicode, options.locales, ModeFlag_SELECTION,
+                         /*interruption=*/nullptr,
+                         &selection_context->rule_candidates,
+                         /*parsed_datetimes=*/nullptr)) {
+        TC_LOG(ERROR) << "Datetime suggest selection failed.";
+        return original_click_indices;
+      }
+    }
+    selection_context->has_rule_candidates = true;
+  }
+  candidates.insert(candidates.end(),
+                    selection_context->rule_candidates.begin(),
+                    selection_context->rule_candidates.end());
 
   // Sort candidates according to their position in the input, so that the next
   // code can assume that any connected component of overlapping spans forms a
@@ -486,10 +1081,16 @@ CodepointSpan TextClassifier::SuggestSelection(
             });
 
   std::vector<int> candidate_indices;
-  if (!ResolveConflicts(candidates, context, tokens, &interpreter_manager,
-                        &candidate_indices)) {
-    TC_LOG(ERROR) << "Couldn't resolve conflicts.";
-    return original_click_indices;
+  {
+    ScopedLatencyTimer timer(options.latency_stats,
+                             LatencyStats::CONFLICT_RESOLUTION);
+    if (!ResolveConflicts(candidates, context, click_tokens,
+                          interpreter_manager,
+                          &selection_context->classification_embedding_cache,
+                          &candidate_indices)) {
+      TC_LOG(ERROR) << "Couldn't resolve conflicts.";
+      return original_click_indices;
+    }
   }
 
   for (const int i : candidate_indices) {
@@ -500,11 +1101,14 @@ CodepointSpan TextClassifier::SuggestSelection(
       if (candidates[i].classification.empty() &&
           model_->selection_options()->always_classify_suggested_selection() &&
           !filtered_collections_selection_.empty()) {
+        std::vector<ClassificationResult> classification;
         if (!ModelClassifyText(
-                context, candidates[i].span, &interpreter_manager,
-                /*embedding_cache=*/nullptr, &candidates[i].classification)) {
+                context, candidates[i].span, interpreter_manager,
+                &selection_context->classification_embedding_cache,
+                /*max_results=*/1, &classification)) {
           return original_click_indices;
         }
+        candidates[i].classification = std::move(classification);
       }
 
       // Ignore if span classification is filtered.
@@ -519,6 +1123,39 @@ CodepointSpan TextClassifier::SuggestSelection(
   return original_click_indices;
 }
 
+bool TextClassifier::SelectionModelClick(
+    const UnicodeText& context_unicode, CodepointSpan click_indices,
+    CodepointSpan* model_click_indices) const {
+  const int context_codepoint_size = context_unicode.size_codepoints();
+  if (click_indices.first < 0 || click_indices.second < 0 ||
+      click_indices.first >= context_codepoint_size ||
+      click_indices.second > context_codepoint_size ||
+      click_indices.first >= click_indices.second) {
+    TC_VLOG(1) << "Trying to run SuggestSelection with invalid indices: "
+               << click_indices.first << " " << click_indices.second;
+    return false;
+  }
+
+  *model_click_indices = click_indices;
+  if (model_->snap_whitespace_selections()) {
+    // We want to expand a purely white-space selection to a multi-selection it
+    // would've been part of. But with this feature disabled we would do a no-
+    // op, because no token is found. Therefore, we need to modify the
+    // 'click_indices' a bit to include a part of the token, so that the click-
+    // finding logic finds the clicked token correctly. This modification is
+    // done by the following function. Note, that it's enough to check the left
+    // side of the current selection, because if the white-space is a part of a
+    // multi-selection, neccessarily both tokens - on the left and the right
+    // sides need to be selected. Thus snapping only to the left is sufficient
+    // (there's a check at the bottom that makes sure that if we snap to the
+    // left token but the result does not contain the initial white-space,
+    // returns the original indices).
+    *model_click_indices = internal::SnapLeftIfWhitespaceSelection(
+        click_indices, context_unicode, *unilib_);
+  }
+  return true;
+}
+
 namespace {
 // Helper function that returns the index of the first candidate that
 // transitively does not overlap with the candidate on 'start_index'. If the end
@@ -544,7 +1181,9 @@ int FirstNonOverlappingSpanIndex(const std::vector<AnnotatedSpan>& candidates,
 bool TextClassifier::ResolveConflicts(
     const std::vector<AnnotatedSpan>& candidates, const std::string& context,
     const std::vector<Token>& cached_tokens,
-    InterpreterManager* interpreter_manager, std::vector<int>* result) const {
+    InterpreterManager* interpreter_manager,
+    FeatureProcessor::EmbeddingCache* embedding_cache,
+    std::vector<int>* result) const {
   result->clear();
   result->reserve(candidates.size());
   for (int i = 0; i < candidates.size();) {
@@ -556,7 +1195,7 @@ bool TextClassifier::ResolveConflicts(
       std::vector<int> candidate_indices;
       if (!ResolveConflict(context, cached_tokens, candidates, i,
                            first_non_overlapping, interpreter_manager,
-                           &candidate_indices)) {
+                           embedding_cache, &candidate_indices)) {
         return false;
       }
       result->insert(result->end(), candidate_indices.begin(),
@@ -572,14 +1211,16 @@ bool TextClassifier::ResolveConflicts(
 }
 
 namespace {
-inline bool ClassifiedAsOther(
-    const std::vector<ClassificationResult>& classification) {
+// The helpers take both std::vector<ClassificationResult> and
+// ClassificationResults.
+template <typename Results>
+inline bool ClassifiedAsOther(const Results& classification) {
   return !classification.empty() &&
          classification[0].collection == TextClassifier::kOtherCollection;
 }
 
-float GetPriorityScore(
-    const std::vector<ClassificationResult>& classification) {
+template <typename Results>
+float GetPriorityScore(const Results& classification) {
   if (!ClassifiedAsOther(classification)) {
     return classification[0].priority_score;
   } else {
@@ -592,62 +1233,68 @@ bool TextClassifier::ResolveConflict(
     const std::string& context, const std::vector<Token>& cached_tokens,
     const std::vector<AnnotatedSpan>& candidates, int start_index,
     int end_index, InterpreterManager* interpreter_manager,
+    FeatureProcessor::EmbeddingCache* embedding_cache,
     std::vector<int>* chosen_indices) const {
   std::vector<int> conflicting_indices;
-  std::unordered_map<int, float> scores;
+  conflicting_indices.reserve(end_index - start_index);
+  // Scores of the conflicting candidates, by their offset from start_index.
+  std::vector<float> scores(end_index - start_index, 0.0);
+  std::vector<int> unclassified_indices;
+  std::vector<CodepointSpan> unclassified_spans;
   for (int i = start_index; i < end_index; ++i) {
     conflicting_indices.push_back(i);
     if (!candidates[i].classification.empty()) {
-      scores[i] = GetPriorityScore(candidates[i].classification);
-      continue;
-    }
-
-    // OPTIMIZATION: So that we don't have to classify all the ML model
-    // spans apriori, we wait until we get here, when they conflict with
-    // something and we need the actual classification scores. So if the
-    // candidate conflicts and comes from the model, we need to run a
-    // classification to determine its priority:
-    std::vector<ClassificationResult> classification;
-    if (!ModelClassifyText(context, cached_tokens, candidates[i].span,
-                           interpreter_manager,
-                           /*embedding_cache=*/nullptr, &classification)) {
+      scores[i - start_index] = GetPriorityScore(candidates[i].classification);
+    } else {
+      unclassified_indices.push_back(i);
+      unclassified_spans.push_back(candidates[i].span);
+    }
+  }
+
+  // OPTIMIZATION: So that we don't have to classify all the ML model
+  // spans apriori, we wait until we get here, when they conflict with
+  // something and we need the actual classification scores. So if the
+  // candidates conflict and come from the model, we need to run a
+  // classification to determine their priority. All of them go through the
+  // model in one batch, and share the embeddings of their tokens.
+  if (!unclassified_spans.empty()) {
+    std::vector<std::vector<ClassificationResult>> classifications;
+    if (!ModelClassifyTexts(UTF8ToUnicodeText(context, /*do_copy=*/false),
+                            cached_tokens, unclassified_spans,
+                            interpreter_manager, embedding_cache,
+                            /*max_results=*/1, &classifications)) {
       return false;
     }
-
-    if (!classification.empty()) {
-      scores[i] = GetPriorityScore(classification);
+    for (int j = 0; j < unclassified_indices.size(); ++j) {
+      if (!classifications[j].empty()) {
+        scores[unclassified_indices[j] - start_index] =
+            GetPriorityScore(classifications[j]);
+      }
     }
   }
 
   std::sort(conflicting_indices.begin(), conflicting_indices.end(),
-            [&scores](int i, int j) { return scores[i] > scores[j]; });
-
-  // Keeps the candidates sorted by their position in the text (their left span
-  // index) for fast retrieval down.
-  std::set<int, std::function<bool(int, int)>> chosen_indices_set(
-      [&candidates](int a, int b) {
-        return candidates[a].span.first < candidates[b].span.first;
-      });
+            [&scores, start_index](int i, int j) {
+              return scores[i - start_index] > scores[j - start_index];
+            });
 
   // Greedily place the candidates if they don't conflict with the already
   // placed ones.
-  for (int i = 0; i < conflicting_indices.size(); ++i) {
-    const int considered_candidate = conflicting_indices[i];
-    if (!DoesCandidateConflict(considered_candidate, candidates,
-                               chosen_indices_set)) {
-      chosen_indices_set.insert(considered_candidate);
-    }
+  NonOverlappingSpans chosen_spans(
+      /*expected_size=*/conflicting_indices.size());
+  for (const int considered_candidate : conflicting_indices) {
+    chosen_spans.AddIfNoConflict(candidates[considered_candidate].span,
+                                 considered_candidate);
   }
-
-  *chosen_indices =
-      std::vector<int>(chosen_indices_set.begin(), chosen_indices_set.end());
+  *chosen_indices = chosen_spans.IndicesInTextOrder();
 
   return true;
 }
 
 bool TextClassifier::ModelSuggestSelection(
     const UnicodeText& context_unicode, CodepointSpan click_indices,
-    InterpreterManager* interpreter_manager, std::vector<Token>* tokens,
+    InterpreterManager* interpreter_manager,
+    SelectionContext* selection_context, std::vector<Token>* tokens,
     std::vector<AnnotatedSpan>* result) const {
   if (model_->triggering_options() == nullptr ||
       !(model_->triggering_options()->enabled_modes() & ModeFlag_SELECTION)) {
@@ -655,16 +1302,267 @@ bool TextClassifier::ModelSuggestSelection(
   }
 
   int click_pos;
-  *tokens = selection_feature_processor_->Tokenize(context_unicode);
-  selection_feature_processor_->RetokenizeAndFindClick(
-      context_unicode, click_indices,
-      selection_feature_processor_->GetOptions()->only_use_line_with_click(),
-      tokens, &click_pos);
+  {
+    ScopedLatencyTimer timer(interpreter_manager->latency_stats(),
+                             LatencyStats::TOKENIZATION);
+    *tokens = selection_feature_processor_->Tokenize(
+        context_unicode, interpreter_manager->locales());
+    if (selection_context->keep_tokens) {
+      selection_context->tokens = *tokens;
+    }
+    selection_feature_processor_->RetokenizeAndFindClick(
+        context_unicode, click_indices,
+        selection_feature_processor_->GetOptions()->only_use_line_with_click(),
+        tokens, &click_pos);
+  }
   if (click_pos == kInvalidIndex) {
     TC_VLOG(1) << "Could not calculate the click position.";
     return false;
   }
 
+  TokenSpan symmetry_context_span;
+  TokenSpan extraction_span;
+  SelectionModelSpans(click_pos, tokens->size(), &symmetry_context_span,
+                      &extraction_span);
+
+  if (!selection_feature_processor_->HasEnoughSupportedCodepoints(
+          *tokens, extraction_span)) {
+    return true;
+  }
+
+  std::unique_ptr<CachedFeatures> cached_features;
+  {
+    ScopedLatencyTimer timer(interpreter_manager->latency_stats(),
+                             LatencyStats::FEATURE_EXTRACTION);
+    const LatencyRecordingEmbeddingExecutor embedding_executor(
+        embedding_executor_.get(), interpreter_manager->latency_stats());
+    if (!selection_feature_processor_->ExtractFeatures(
+            *tokens, extraction_span,
+            /*selection_span_for_feature=*/{kInvalidIndex, kInvalidIndex},
+            embedding_executor.get(),
+            /*embedding_cache=*/nullptr,
+            selection_feature_processor_->EmbeddingSize() +
+                selection_feature_processor_->DenseFeaturesCount(),
+            &cached_features)) {
+      TC_LOG(ERROR) << "Could not extract features.";
+      return false;
+    }
+  }
+
+  // Produce selection model candidates.
+  std::vector<TokenSpan> chunks;
+  {
+    ScopedLatencyTimer timer(interpreter_manager->latency_stats(),
+                             LatencyStats::SELECTION_INFERENCE);
+    if (!ModelChunk(tokens->size(), /*span_of_interest=*/symmetry_context_span,
+                    interpreter_manager->SelectionInterpreter(),
+                    *cached_features, interpreter_manager->interruption(),
+                    &chunks)) {
+      TC_LOG(ERROR) << "Could not chunk.";
+      return false;
+    }
+  }
+
+  AddSelectionModelCandidates(UnicodeTextIndex(context_unicode), *tokens,
+                              chunks, result);
+  return true;
+}
+
+void TextClassifier::ModelSuggestSelections(
+    const UnicodeText& context_unicode,
+    const std::vector<CodepointSpan>& clicks,
+    InterpreterManager* interpreter_manager,
+    FeatureProcessor::EmbeddingCache* embedding_cache,
+    std::vector<ModelSelection>* selections) const {
+  selections->assign(clicks.size(), ModelSelection());
+  if (model_->triggering_options() == nullptr ||
+      !(model_->triggering_options()->enabled_modes() & ModeFlag_SELECTION)) {
+    return;
+  }
+
+  // The clicks that the retokenization leaves the same tokens, the ones that
+  // are on the same line and split no token, are put in one group. The tokens
+  // of a group are copied from the tokens of the whole context once.
+  struct ClickGroup {
+    // The codepoints of the line that the tokens are restricted to, or
+    // {kInvalidIndex, kInvalidIndex} if the group has a click that splits
+    // tokens and is the only one in it.
+    CodepointSpan line;
+    std::shared_ptr<std::vector<Token>> tokens;
+    std::vector<int> clicks;
+    std::vector<int> click_positions;
+  };
+  std::vector<ClickGroup> groups;
+  {
+    ScopedLatencyTimer timer(interpreter_manager->latency_stats(),
+                             LatencyStats::TOKENIZATION);
+    const FeatureProcessorOptions* options =
+        selection_feature_processor_->GetOptions();
+    const std::vector<Token> context_tokens =
+        selection_feature_processor_->Tokenize(context_unicode,
+                                               interpreter_manager->locales());
+
+    // The codepoint spans of the lines that RetokenizeAndFindClick() would
+    // restrict the tokens to.
+    std::vector<CodepointSpan> lines;
+    if (options->only_use_line_with_click()) {
+      auto line_begin = context_unicode.begin();
+      int line_begin_index = 0;
+      for (const UnicodeTextRange& line :
+           selection_feature_processor_->SplitContext(context_unicode)) {
+        line_begin_index += std::distance(line_begin, line.first);
+        const int line_end_index =
+            line_begin_index + std::distance(line.first, line.second);
+        lines.push_back({line_begin_index, line_end_index});
+        line_begin = line.second;
+        line_begin_index = line_end_index;
+      }
+    }
+
+    for (int i = 0; i < clicks.size(); ++i) {
+      const CodepointSpan& click = clicks[i];
+      if (click.first == kInvalidIndex) {
+        continue;
+      }
+
+      int group_index = kInvalidIndex;
+      if (options->split_tokens_on_selection_boundaries() &&
+          !internal::SpanAlignsWithTokens(context_tokens, click)) {
+        group_index = groups.size();
+        groups.push_back({{kInvalidIndex, kInvalidIndex},
+                          std::make_shared<std::vector<Token>>(context_tokens),
+                          {},
+                          {}});
+        selection_feature_processor_->RetokenizeAndFindClick(
+            context_unicode, click, options->only_use_line_with_click(),
+            groups.back().tokens.get(), /*click_pos=*/nullptr);
+      } else {
+        // Like StripTokensFromOtherLines(), the tokens are restricted to the
+        // last line that contains the click, if any.
+        CodepointSpan line = {0, context_unicode.size_codepoints()};
+        for (const CodepointSpan& other_line : lines) {
+          if (other_line.first <= click.first &&
+              other_line.second >= click.second) {
+            line = other_line;
+          }
+        }
+        for (int j = 0; j < groups.size(); ++j) {
+          if (groups[j].line == line) {
+            group_index = j;
+            break;
+          }
+        }
+        if (group_index == kInvalidIndex) {
+          group_index = groups.size();
+          groups.push_back(
+              {line, std::make_shared<std::vector<Token>>(), {}, {}});
+          std::copy_if(context_tokens.begin(), context_tokens.end(),
+                       std::back_inserter(*groups.back().tokens),
+                       [&line](const Token& token) {
+                         return token.start >= line.first &&
+                                token.end <= line.second;
+                       });
+        }
+      }
+
+      ClickGroup* group = &groups[group_index];
+      (*selections)[i].tokens = group->tokens;
+      const int click_pos =
+          selection_feature_processor_->FindClick(click, *group->tokens);
+      if (click_pos == kInvalidIndex) {
+        TC_VLOG(1) << "Could not calculate the click position.";
+        (*selections)[i].failed = true;
+        continue;
+      }
+      group->clicks.push_back(i);
+      group->click_positions.push_back(click_pos);
+    }
+  }
+
+  const UnicodeTextIndex context_index(context_unicode);
+  std::vector<int> group_clicks;
+  std::vector<ChunkInput> chunk_inputs;
+  std::vector<std::vector<TokenSpan>> chunks;
+  for (const ClickGroup& group : groups) {
+    const std::vector<Token>& tokens = *group.tokens;
+
+    // The features are extracted once for all the clicks, over the tokens
+    // from the first to the last one that any of them needs.
+    group_clicks.clear();
+    chunk_inputs.clear();
+    TokenSpan extraction_span = {kInvalidIndex, kInvalidIndex};
+    for (int j = 0; j < group.clicks.size(); ++j) {
+      TokenSpan symmetry_context_span;
+      TokenSpan click_extraction_span;
+      SelectionModelSpans(group.click_positions[j], tokens.size(),
+                          &symmetry_context_span, &click_extraction_span);
+      if (!selection_feature_processor_->HasEnoughSupportedCodepoints(
+              tokens, click_extraction_span)) {
+        continue;
+      }
+      group_clicks.push_back(group.clicks[j]);
+      chunk_inputs.push_back({static_cast<int>(tokens.size()),
+                              symmetry_context_span,
+                              /*cached_features=*/nullptr});
+      extraction_span =
+          extraction_span.first == kInvalidIndex
+              ? click_extraction_span
+              : TokenSpan{
+                    std::min(extraction_span.first,
+                             click_extraction_span.first),
+                    std::max(extraction_span.second,
+                             click_extraction_span.second)};
+    }
+    if (group_clicks.empty()) {
+      continue;
+    }
+
+    std::unique_ptr<CachedFeatures> cached_features;
+    bool succeeded;
+    {
+      ScopedLatencyTimer timer(interpreter_manager->latency_stats(),
+                               LatencyStats::FEATURE_EXTRACTION);
+      const LatencyRecordingEmbeddingExecutor embedding_executor(
+          embedding_executor_.get(), interpreter_manager->latency_stats());
+      succeeded = selection_feature_processor_->ExtractFeatures(
+          tokens, extraction_span,
+          /*selection_span_for_feature=*/{kInvalidIndex, kInvalidIndex},
+          embedding_executor.get(), embedding_cache,
+          selection_feature_processor_->EmbeddingSize() +
+              selection_feature_processor_->DenseFeaturesCount(),
+          &cached_features);
+    }
+    if (!succeeded) {
+      TC_LOG(ERROR) << "Could not extract features.";
+    } else {
+      ScopedLatencyTimer timer(interpreter_manager->latency_stats(),
+                               LatencyStats::SELECTION_INFERENCE);
+      for (ChunkInput& chunk_input : chunk_inputs) {
+        chunk_input.cached_features = cached_features.get();
+      }
+      succeeded = ModelChunks(chunk_inputs,
+                              interpreter_manager->SelectionInterpreter(),
+                              interpreter_manager->interruption(), &chunks);
+      if (!succeeded) {
+        TC_LOG(ERROR) << "Could not chunk.";
+      }
+    }
+
+    for (int j = 0; j < group_clicks.size(); ++j) {
+      ModelSelection* selection = &(*selections)[group_clicks[j]];
+      if (succeeded) {
+        AddSelectionModelCandidates(context_index, tokens, chunks[j],
+                                    &selection->candidates);
+      } else {
+        selection->failed = true;
+      }
+    }
+  }
+}
+
+void TextClassifier::SelectionModelSpans(int click_pos, int num_tokens,
+                                         TokenSpan* symmetry_context_span,
+                                         TokenSpan* extraction_span) const {
   const int symmetry_context_size =
       model_->selection_options()->symmetry_context_size();
   const FeatureProcessorOptions_::BoundsSensitiveFeatures*
@@ -673,14 +1571,13 @@ bool TextClassifier::ModelSuggestSelection(
 
   // The symmetry context span is the clicked token with symmetry_context_size
   // tokens on either side.
-  const TokenSpan symmetry_context_span = IntersectTokenSpans(
+  *symmetry_context_span = IntersectTokenSpans(
       ExpandTokenSpan(SingleTokenSpan(click_pos),
                       /*num_tokens_left=*/symmetry_context_size,
                       /*num_tokens_right=*/symmetry_context_size),
-      {0, tokens->size()});
+      {0, num_tokens});
 
   // Compute the extraction span based on the model type.
-  TokenSpan extraction_span;
   if (bounds_sensitive_features && bounds_sensitive_features->enabled()) {
     // The extraction span is the symmetry context span expanded to include
     // max_selection_span tokens on either side, which is how far a selection
@@ -688,8 +1585,8 @@ bool TextClassifier::ModelSuggestSelection(
     // the bounds of the selection.
     const int max_selection_span =
         selection_feature_processor_->GetOptions()->max_selection_span();
-    extraction_span =
-        ExpandTokenSpan(symmetry_context_span,
+    *extraction_span =
+        ExpandTokenSpan(*symmetry_context_span,
                         /*num_tokens_left=*/max_selection_span +
                             bounds_sensitive_features->num_tokens_before(),
                         /*num_tokens_right=*/max_selection_span +
@@ -699,46 +1596,24 @@ bool TextClassifier::ModelSuggestSelection(
     // context_size tokens on either side.
     const int context_size =
         selection_feature_processor_->GetOptions()->context_size();
-    extraction_span = ExpandTokenSpan(symmetry_context_span,
-                                      /*num_tokens_left=*/context_size,
-                                      /*num_tokens_right=*/context_size);
-  }
-  extraction_span = IntersectTokenSpans(extraction_span, {0, tokens->size()});
-
-  if (!selection_feature_processor_->HasEnoughSupportedCodepoints(
-          *tokens, extraction_span)) {
-    return true;
-  }
-
-  std::unique_ptr<CachedFeatures> cached_features;
-  if (!selection_feature_processor_->ExtractFeatures(
-          *tokens, extraction_span,
-          /*selection_span_for_feature=*/{kInvalidIndex, kInvalidIndex},
-          embedding_executor_.get(),
-          /*embedding_cache=*/nullptr,
-          selection_feature_processor_->EmbeddingSize() +
-              selection_feature_processor_->DenseFeaturesCount(),
-          &cached_features)) {
-    TC_LOG(ERROR) << "Could not extract features.";
-    return false;
-  }
-
-  // Produce selection model candidates.
-  std::vector<TokenSpan> chunks;
-  if (!ModelChunk(tokens->size(), /*span_of_interest=*/symmetry_context_span,
-                  interpreter_manager->SelectionInterpreter(), *cached_features,
-                  &chunks)) {
-    TC_LOG(ERROR) << "Could not chunk.";
-    return false;
+    *extraction_span = ExpandTokenSpan(*symmetry_context_span,
+                                       /*num_tokens_left=*/context_size,
+                                       /*num_tokens_right=*/context_size);
   }
+  *extraction_span = IntersectTokenSpans(*extraction_span, {0, num_tokens});
+}
 
+void TextClassifier::AddSelectionModelCandidates(
+    const UnicodeTextIndex& context_index, const std::vector<Token>& tokens,
+    const std::vector<TokenSpan>& chunks,
+    std::vector<AnnotatedSpan>* result) const {
   for (const TokenSpan& chunk : chunks) {
     AnnotatedSpan candidate;
     candidate.span = selection_feature_processor_->StripBoundaryCodepoints(
-        context_unicode, TokenSpanToCodepointSpan(*tokens, chunk));
+        context_index, TokenSpanToCodepointSpan(tokens, chunk));
     if (model_->selection_options()->strip_unpaired_brackets()) {
       candidate.span =
-          StripUnpairedBrackets(context_unicode, candidate.span, *unilib_);
+          StripUnpairedBrackets(context_index, candidate.span, *unilib_);
     }
 
     // Only output non-empty spans.
@@ -746,13 +1621,12 @@ bool TextClassifier::ModelSuggestSelection(
       result->push_back(candidate);
     }
   }
-  return true;
 }
 
 bool TextClassifier::ModelClassifyText(
     const std::string& context, CodepointSpan selection_indices,
     InterpreterManager* interpreter_manager,
-    FeatureProcessor::EmbeddingCache* embedding_cache,
+    FeatureProcessor::EmbeddingCache* embedding_cache, int max_results,
     std::vector<ClassificationResult>* classification_results) const {
   if (model_->triggering_options() == nullptr ||
       !(model_->triggering_options()->enabled_modes() &
@@ -760,7 +1634,8 @@ bool TextClassifier::ModelClassifyText(
     return true;
   }
   return ModelClassifyText(context, {}, selection_indices, interpreter_manager,
-                           embedding_cache, classification_results);
+                           embedding_cache, max_results,
+                           classification_results);
 }
 
 namespace internal {
@@ -794,6 +1669,73 @@ std::vector<Token> CopyCachedTokens(const std::vector<Token>& cached_tokens,
   }
   return tokens;
 }
+
+namespace {
+template <typename T>
+bool SameCodepointRanges(const flatbuffers::Vector<flatbuffers::Offset<T>>* a,
+                         const flatbuffers::Vector<flatbuffers::Offset<T>>* b) {
+  const int a_size = a == nullptr ? 0 : a->size();
+  const int b_size = b == nullptr ? 0 : b->size();
+  if (a_size != b_size) {
+    return false;
+  }
+  for (int i = 0; i < a_size; ++i) {
+    if (a->Get(i)->start() != b->Get(i)->start() ||
+        a->Get(i)->end() != b->Get(i)->end()) {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+bool HaveSameTokenization(const FeatureProcessorOptions* a,
+                          const FeatureProcessorOptions* b) {
+  if (a == nullptr || b == nullptr) {
+    return false;
+  }
+  if (a->tokenization_type() != b->tokenization_type() ||
+      a->icu_preserve_whitespace_tokens() !=
+          b->icu_preserve_whitespace_tokens() ||
+      a->tokenize_on_script_change() != b->tokenize_on_script_change() ||
+      !SameCodepointRanges(a->tokenization_codepoint_config(),
+                           b->tokenization_codepoint_config()) ||
+      !SameCodepointRanges(a->internal_tokenizer_codepoint_ranges(),
+                           b->internal_tokenizer_codepoint_ranges())) {
+    return false;
+  }
+
+  // Same ranges, so also the roles and scripts need to match.
+  const int num_ranges = a->tokenization_codepoint_config() == nullptr
+                             ? 0
+                             : a->tokenization_codepoint_config()->size();
+  for (int i = 0; i < num_ranges; ++i) {
+    const TokenizationCodepointRange* a_range =
+        a->tokenization_codepoint_config()->Get(i);
+    const TokenizationCodepointRange* b_range =
+        b->tokenization_codepoint_config()->Get(i);
+    if (a_range->role() != b_range->role() ||
+        a_range->script_id() != b_range->script_id()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SpanAlignsWithTokens(const std::vector<Token>& tokens,
+                          CodepointSpan span) {
+  for (const CodepointIndex boundary : {span.first, span.second}) {
+    // The first token that ends after the boundary is the only one that can
+    // contain it.
+    const auto token = std::upper_bound(
+        tokens.begin(), tokens.end(), boundary,
+        [](int value, const Token& token) { return value < token.end; });
+    if (token != tokens.end() && token->start < boundary) {
+      return false;
+    }
+  }
+  return true;
+}
 }  // namespace internal
 
 TokenSpan TextClassifier::ClassifyTextUpperBoundNeededTokens() const {
@@ -818,24 +1760,194 @@ TokenSpan TextClassifier::ClassifyTextUpperBoundNeededTokens() const {
 bool TextClassifier::ModelClassifyText(
     const std::string& context, const std::vector<Token>& cached_tokens,
     CodepointSpan selection_indices, InterpreterManager* interpreter_manager,
+    FeatureProcessor::EmbeddingCache* embedding_cache, int max_results,
+    std::vector<ClassificationResult>* classification_results) const {
+  std::vector<std::vector<ClassificationResult>> batch_results;
+  if (!ModelClassifyTexts(UTF8ToUnicodeText(context, /*do_copy=*/false),
+                          cached_tokens, {selection_indices},
+                          interpreter_manager, embedding_cache, max_results,
+                          &batch_results)) {
+    return false;
+  }
+  *classification_results = std::move(batch_results[0]);
+  return true;
+}
+
+bool TextClassifier::ModelClassifyTexts(
+    const UnicodeText& context_unicode, const std::vector<Token>& cached_tokens,
+    const std::vector<CodepointSpan>& selections,
+    InterpreterManager* interpreter_manager,
+    FeatureProcessor::EmbeddingCache* embedding_cache, int max_results,
+    std::vector<std::vector<ClassificationResult>>* classification_results)
+    const {
+  std::vector<std::pair<int, CodepointSpan>> context_selections;
+  context_selections.reserve(selections.size());
+  for (const CodepointSpan& selection : selections) {
+    context_selections.push_back({0, selection});
+  }
+  return ModelClassifyTexts(
+      {{&context_unicode, &cached_tokens, embedding_cache}}, context_selections,
+      interpreter_manager, max_results, classification_results);
+}
+
+bool TextClassifier::ModelClassifyTexts(
+    const std::vector<ClassificationContext>& contexts,
+    const std::vector<std::pair<int, CodepointSpan>>& selections,
+    InterpreterManager* interpreter_manager, int max_results,
+    std::vector<std::vector<ClassificationResult>>* classification_results)
+    const {
+  classification_results->clear();
+  classification_results->resize(selections.size());
+
+  const int max_batch_size =
+      std::max(1, model_->classification_options()->batch_size());
+  std::vector<ClassificationInput> inputs;
+  std::vector<int> batch_selections;
+  for (int batch_start = 0; batch_start < selections.size();
+       batch_start += max_batch_size) {
+    const int batch_end =
+        std::min<int>(batch_start + max_batch_size, selections.size());
+
+    // Extract the features of the selections that need the model.
+    inputs.resize(batch_end - batch_start);
+    batch_selections.clear();
+    for (int i = batch_start; i < batch_end; ++i) {
+      const ClassificationContext& context = contexts[selections[i].first];
+      ClassificationInput* input = &inputs[batch_selections.size()];
+      input->cached_features.reset();
+      if (!PrepareClassificationInput(
+              *context.context_unicode, *context.cached_tokens,
+              selections[i].second, context.embedding_cache,
+              interpreter_manager->locales(),
+              interpreter_manager->latency_stats(), input,
+              &(*classification_results)[i])) {
+        return false;
+      }
+      if (input->cached_features != nullptr) {
+        batch_selections.push_back(i);
+      }
+    }
+    if (batch_selections.empty()) {
+      continue;
+    }
+
+    const int batch_size = batch_selections.size();
+    const int features_size = inputs[0].cached_features->OutputFeaturesSize();
+    const int num_collections =
+        classification_feature_processor_->NumCollections();
+    std::vector<float> batched_logits;
+    const float* logits = nullptr;
+    if (classification_batcher_ != nullptr) {
+      // The batch joins the ones of concurrent calls for the inference.
+      std::vector<float> features(batch_size * features_size);
+      for (int j = 0; j < batch_size; ++j) {
+        WriteClassificationFeatures(inputs[j],
+                                    features.data() + j * features_size);
+      }
+      ScopedLatencyTimer timer(interpreter_manager->latency_stats(),
+                               LatencyStats::CLASSIFICATION_INFERENCE);
+      if (!classification_batcher_->ComputeLogits(
+              TensorView<float>(features.data(), {batch_size, features_size}),
+              &batched_logits)) {
+        TC_LOG(ERROR) << "Couldn't compute logits.";
+        return false;
+      }
+      if (batched_logits.size() != batch_size * num_collections) {
+        TC_LOG(ERROR) << "Mismatching output";
+        return false;
+      }
+      logits = batched_logits.data();
+    } else {
+      // Write the features of the whole batch directly into the input tensor,
+      // and run them in one inference.
+      tflite::Interpreter* classification_interpreter =
+          interpreter_manager->ClassificationInterpreter();
+      float* features = classification_executor_->PrepareFeaturesInput(
+          {batch_size, features_size}, classification_interpreter);
+      if (features == nullptr) {
+        TC_LOG(ERROR) << "Couldn't prepare the input tensor.";
+        return false;
+      }
+      for (int j = 0; j < batch_size; ++j) {
+        WriteClassificationFeatures(inputs[j], features + j * features_size);
+      }
+
+      ScopedLatencyTimer timer(interpreter_manager->latency_stats(),
+                               LatencyStats::CLASSIFICATION_INFERENCE);
+      const TensorView<float> interpreter_logits =
+          classification_executor_->ComputeLogitsFromInput(
+              classification_interpreter);
+      if (!interpreter_logits.is_valid()) {
+        TC_LOG(ERROR) << "Couldn't compute logits.";
+        return false;
+      }
+      if (interpreter_logits.dims() != 2 ||
+          interpreter_logits.dim(0) != batch_size ||
+          interpreter_logits.dim(1) != num_collections) {
+        TC_LOG(ERROR) << "Mismatching output";
+        return false;
+      }
+      logits = interpreter_logits.data();
+    }
+
+    for (int j = 0; j < batch_size; ++j) {
+      const int i = batch_selections[j];
+      ClassificationResultsFromLogits(
+          *contexts[selections[i].first].context_unicode, selections[i].second,
+          inputs[j], logits + j * num_collections, max_results,
+          &(*classification_results)[i]);
+    }
+  }
+  return true;
+}
+
+bool TextClassifier::PrepareClassificationInput(
+    const UnicodeText& context_unicode, const std::vector<Token>& cached_tokens,
+    CodepointSpan selection_indices,
     FeatureProcessor::EmbeddingCache* embedding_cache,
+    const std::string& locales, LatencyStats* latency_stats,
+    ClassificationInput* input,
     std::vector<ClassificationResult>* classification_results) const {
-  std::vector<Token> tokens;
-  if (cached_tokens.empty()) {
-    tokens = classification_feature_processor_->Tokenize(context);
+  const FeatureProcessorOptions* classification_options =
+      classification_feature_processor_->GetOptions();
+
+  // The cached tokens can be used as they are if the retokenization would not
+  // change them: no token is split on the selection boundaries, and there are
+  // no other lines to strip.
+  const bool use_cached_tokens_in_place =
+      !cached_tokens.empty() && share_tokens_between_processors_ &&
+      (!classification_options->split_tokens_on_selection_boundaries() ||
+       internal::SpanAlignsWithTokens(cached_tokens, selection_indices)) &&
+      (!classification_options->only_use_line_with_click() ||
+       !HasLineSeparator(context_unicode));
+
+  std::vector<Token> copied_tokens;
+  int click_pos;
+  if (use_cached_tokens_in_place) {
+    click_pos = classification_feature_processor_->FindClick(selection_indices,
+                                                             cached_tokens);
   } else {
-    tokens = internal::CopyCachedTokens(cached_tokens, selection_indices,
-                                        ClassifyTextUpperBoundNeededTokens());
+    ScopedLatencyTimer timer(latency_stats, LatencyStats::TOKENIZATION);
+    if (cached_tokens.empty()) {
+      copied_tokens =
+          classification_feature_processor_->Tokenize(context_unicode, locales);
+    } else {
+      copied_tokens = internal::CopyCachedTokens(
+          cached_tokens, selection_indices,
+          ClassifyTextUpperBoundNeededTokens());
+    }
+    classification_feature_processor_->RetokenizeAndFindClick(
+        context_unicode, selection_indices,
+        classification_options->only_use_line_with_click(), &copied_tokens,
+        &click_pos);
   }
+  const std::vector<Token>& tokens =
+      use_cached_tokens_in_place ? cached_tokens : copied_tokens;
 
-  int click_pos;
-  classification_feature_processor_->RetokenizeAndFindClick(
-      context, selection_indices,
-      classification_feature_processor_->GetOptions()
-          ->only_use_line_with_click(),
-      &tokens, &click_pos);
-  const TokenSpan selection_token_span =
+  input->click_pos = click_pos;
+  input->selection_token_span =
       CodepointSpanToTokenSpan(tokens, selection_indices);
+  const TokenSpan& selection_token_span = input->selection_token_span;
   const int selection_num_tokens = TokenSpanSize(selection_token_span);
   if (model_->classification_options()->max_num_tokens() > 0 &&
       model_->classification_options()->max_num_tokens() <
@@ -884,58 +1996,73 @@ bool TextClassifier::ModelClassifyText(
     return true;
   }
 
-  std::unique_ptr<CachedFeatures> cached_features;
+  ScopedLatencyTimer timer(latency_stats, LatencyStats::FEATURE_EXTRACTION);
+  const LatencyRecordingEmbeddingExecutor embedding_executor(
+      embedding_executor_.get(), latency_stats);
   if (!classification_feature_processor_->ExtractFeatures(
-          tokens, extraction_span, selection_indices, embedding_executor_.get(),
+          tokens, extraction_span, selection_indices, embedding_executor.get(),
           embedding_cache,
           classification_feature_processor_->EmbeddingSize() +
               classification_feature_processor_->DenseFeaturesCount(),
-          &cached_features)) {
+          &input->cached_features)) {
     TC_LOG(ERROR) << "Could not extract features.";
     return false;
   }
 
-  std::vector<float> features;
-  features.reserve(cached_features->OutputFeaturesSize());
+  return true;
+}
+
+void TextClassifier::WriteClassificationFeatures(
+    const ClassificationInput& input, float* output) const {
+  const FeatureProcessorOptions_::BoundsSensitiveFeatures*
+      bounds_sensitive_features =
+          classification_feature_processor_->GetOptions()
+              ->bounds_sensitive_features();
   if (bounds_sensitive_features && bounds_sensitive_features->enabled()) {
-    cached_features->AppendBoundsSensitiveFeaturesForSpan(selection_token_span,
-                                                          &features);
+    input.cached_features->WriteBoundsSensitiveFeaturesForSpan(
+        input.selection_token_span, output);
   } else {
-    cached_features->AppendClickContextFeaturesForClick(click_pos, &features);
-  }
-
-  TensorView<float> logits = classification_executor_->ComputeLogits(
-      TensorView<float>(features.data(),
-                        {1, static_cast<int>(features.size())}),
-      interpreter_manager->ClassificationInterpreter());
-  if (!logits.is_valid()) {
-    TC_LOG(ERROR) << "Couldn't compute logits.";
-    return false;
-  }
-
-  if (logits.dims() != 2 || logits.dim(0) != 1 ||
-      logits.dim(1) != classification_feature_processor_->NumCollections()) {
-    TC_LOG(ERROR) << "Mismatching output";
-    return false;
+    input.cached_features->WriteClickContextFeaturesForClick(input.click_pos,
+                                                             output);
   }
+}
 
-  const std::vector<float> scores =
-      ComputeSoftmax(logits.data(), logits.dim(1));
+void TextClassifier::ClassificationResultsFromLogits(
+    const UnicodeText& context_unicode, CodepointSpan selection_indices,
+    const ClassificationInput& input, const float* logits, int max_results,
+    std::vector<ClassificationResult>* classification_results) const {
+  const int num_collections =
+      classification_feature_processor_->NumCollections();
+  if (max_results > 0 && max_results < num_collections) {
+    std::vector<std::pair<int, float>> top_scores;
+    ComputeSoftmaxTopK(logits, num_collections, max_results, &top_scores);
+    classification_results->clear();
+    classification_results->reserve(top_scores.size());
+    for (const std::pair<int, float>& top_score : top_scores) {
+      classification_results->emplace_back(
+          classification_feature_processor_->LabelToCollection(
+              top_score.first),
+          top_score.second);
+    }
+  } else {
+    std::vector<float> scores(num_collections);
+    ComputeSoftmax(logits, num_collections, scores.data());
 
-  classification_results->resize(scores.size());
-  for (int i = 0; i < scores.size(); i++) {
-    (*classification_results)[i] = {
-        classification_feature_processor_->LabelToCollection(i), scores[i]};
+    classification_results->resize(num_collections);
+    for (int i = 0; i < num_collections; i++) {
+      (*classification_results)[i] = {
+          classification_feature_processor_->LabelToCollection(i), scores[i]};
+    }
+    std::sort(classification_results->begin(), classification_results->end(),
+              [](const ClassificationResult& a, const ClassificationResult& b) {
+                return a.score > b.score;
+              });
   }
-  std::sort(classification_results->begin(), classification_results->end(),
-            [](const ClassificationResult& a, const ClassificationResult& b) {
-              return a.score > b.score;
-            });
 
   // Phone class sanity check.
   if (!classification_results->empty() &&
       classification_results->begin()->collection == kPhoneCollection) {
-    const int digit_count = CountDigits(context, selection_indices);
+    const int digit_count = CountDigits(context_unicode, selection_indices);
     if (digit_count <
             model_->classification_options()->phone_min_num_digits() ||
         digit_count >
@@ -947,28 +2074,49 @@ bool TextClassifier::ModelClassifyText(
   // Address class sanity check.
   if (!classification_results->empty() &&
       classification_results->begin()->collection == kAddressCollection) {
-    if (selection_num_tokens <
+    if (TokenSpanSize(input.selection_token_span) <
         model_->classification_options()->address_min_num_tokens()) {
       *classification_results = {{kOtherCollection, 1.0}};
     }
   }
-
-  return true;
 }
 
 bool TextClassifier::RegexClassifyText(
     const std::string& context, CodepointSpan selection_indices,
+    const std::unordered_set<std::string>& entity_types,
     ClassificationResult* classification_result) const {
   const std::string selection_text =
       ExtractSelection(context, selection_indices);
   const UnicodeText selection_text_unicode(
       UTF8ToUnicodeText(selection_text, /*do_copy=*/false));
 
-  // Check whether any of the regular expressions match.
+  // Only run the patterns that can possibly match the selection.
+  std::vector<bool> candidate_patterns;
+  regex_prefilter_.FindCandidates(selection_text.data(), selection_text.size(),
+                                  &candidate_patterns);
+
+  // Check whether any of the regular expressions match. The selection is
+  // converted for the regex engine once, when the first pattern needs it.
+  std::unique_ptr<UniLib::UTF16Text> selection_text_utf16;
   for (const int pattern_id : classification_regex_patterns_) {
+    if (!candidate_patterns[pattern_id]) {
+      continue;
+    }
     const CompiledRegexPattern& regex_pattern = regex_patterns_[pattern_id];
-    const std::unique_ptr<UniLib::RegexMatcher> matcher =
-        regex_pattern.pattern->Matcher(selection_text_unicode);
+    if (!IsEntityTypeRequested(entity_types, regex_pattern.collection_name)) {
+      continue;
+    }
+    if (selection_text_utf16 == nullptr) {
+      selection_text_utf16 = unilib_->CreateUTF16Text(selection_text_unicode);
+    }
+    ScopedRuleTimer timer(rule_profile_, RuleProfile::REGEX, pattern_id);
+    const UniLib::RegexPattern* compiled_pattern = regex_pattern.pattern->Get();
+    if (compiled_pattern == nullptr) {
+      TC_LOG(ERROR) << "Could not compile regex pattern: " << pattern_id;
+      continue;
+    }
+    const UniLib::RegexPattern::ScopedMatcher matcher =
+        compiled_pattern->AcquireMatcher(*selection_text_utf16);
     int status = UniLib::RegexMatcher::kNoError;
     bool matches;
     if (regex_approximate_match_pattern_ids_.find(pattern_id) !=
@@ -981,6 +2129,7 @@ bool TextClassifier::RegexClassifyText(
       return false;
     }
     if (matches) {
+      timer.AddMatch();
       *classification_result = {regex_pattern.collection_name,
                                 regex_pattern.target_classification_score,
                                 regex_pattern.priority_score};
@@ -1031,6 +2180,40 @@ bool TextClassifier::DatetimeClassifyText(
 std::vector<ClassificationResult> TextClassifier::ClassifyText(
     const std::string& context, CodepointSpan selection_indices,
     const ClassificationOptions& options) const {
+  const CallInterruption interruption(options.timeout_ms,
+                                      options.cancellation_token);
+  std::vector<ClassificationResult> results;
+  if (!result_cache_.IsEnabled()) {
+    results = ClassifyTextInternal(context, selection_indices, options,
+                                   /*cached_tokens=*/nullptr, &interruption);
+  } else {
+    const uint64 key =
+        ClassificationCacheKey(context, selection_indices, options);
+    if (!result_cache_.LookupClassification(key, &results)) {
+      const std::shared_ptr<const std::vector<Token>> cached_tokens =
+          share_tokens_between_processors_
+              ? result_cache_.LookupTokens(TokensCacheKey(
+                    context, selection_indices, options.locales))
+              : nullptr;
+      results = ClassifyTextInternal(context, selection_indices, options,
+                                     cached_tokens.get(), &interruption);
+      // The results of a stopped call are not the ones of the input.
+      if (interruption.status() == CALL_COMPLETED) {
+        result_cache_.InsertClassification(key, results);
+      }
+    }
+  }
+  if (options.status != nullptr) {
+    *options.status = interruption.status();
+  }
+  return results;
+}
+
+std::vector<ClassificationResult> TextClassifier::ClassifyTextInternal(
+    const std::string& context, CodepointSpan selection_indices,
+    const ClassificationOptions& options,
+    const std::vector<Token>* cached_tokens,
+    const CallInterruption* interruption) const {
   if (!initialized_) {
     TC_LOG(ERROR) << "Not initialized";
     return {};
@@ -1051,9 +2234,19 @@ std::vector<ClassificationResult> TextClassifier::ClassifyText(
     return {};
   }
 
+  if (ShouldStop(interruption)) {
+    return {};
+  }
+
   // Try the regular expression models.
   ClassificationResult regex_result;
-  if (RegexClassifyText(context, selection_indices, &regex_result)) {
+  bool regex_matched;
+  {
+    ScopedLatencyTimer timer(options.latency_stats, LatencyStats::REGEX);
+    regex_matched = RegexClassifyText(context, selection_indices,
+                                      options.entity_types, &regex_result);
+  }
+  if (regex_matched) {
     if (!FilteredForClassification(regex_result)) {
       return {regex_result};
     } else {
@@ -1061,10 +2254,19 @@ std::vector<ClassificationResult> TextClassifier::ClassifyText(
     }
   }
 
+  if (ShouldStop(interruption)) {
+    return {};
+  }
+
   // Try the date model.
   ClassificationResult datetime_result;
-  if (DatetimeClassifyText(context, selection_indices, options,
-                           &datetime_result)) {
+  bool datetime_matched = false;
+  if (IsEntityTypeRequested(options.entity_types, kDateCollection)) {
+    ScopedLatencyTimer timer(options.latency_stats, LatencyStats::DATETIME);
+    datetime_matched = DatetimeClassifyText(context, selection_indices,
+                                            options, &datetime_result);
+  }
+  if (datetime_matched) {
     if (!FilteredForClassification(datetime_result)) {
       return {datetime_result};
     } else {
@@ -1073,14 +2275,32 @@ std::vector<ClassificationResult> TextClassifier::ClassifyText(
   }
 
   // Fallback to the model.
+  if (model_->triggering_options() == nullptr ||
+      !(model_->triggering_options()->enabled_modes() &
+        ModeFlag_CLASSIFICATION)) {
+    return {};
+  }
+  if (!ModelProducesAnyOf(options.entity_types)) {
+    return {{kOtherCollection, 1.0}};
+  }
+  if (ShouldStop(interruption)) {
+    return {};
+  }
   std::vector<ClassificationResult> model_result;
 
-  InterpreterManager interpreter_manager(selection_executor_.get(),
-                                         classification_executor_.get());
-  if (ModelClassifyText(context, selection_indices, &interpreter_manager,
-                        /*embedding_cache=*/nullptr, &model_result) &&
+  InterpreterManager interpreter_manager(
+      selection_executor_.get(), classification_executor_.get(),
+      options.latency_stats, options.locales, interruption);
+  if (ModelClassifyText(context,
+                        cached_tokens != nullptr ? *cached_tokens
+                                                 : std::vector<Token>(),
+                        selection_indices, &interpreter_manager,
+                        /*embedding_cache=*/nullptr, /*max_results=*/0,
+                        &model_result) &&
       !model_result.empty()) {
-    if (!FilteredForClassification(model_result[0])) {
+    if (!FilteredForClassification(model_result[0]) &&
+        IsEntityTypeRequested(options.entity_types,
+                              model_result[0].collection)) {
       return model_result;
     } else {
       return {{kOtherCollection, 1.0}};
@@ -1091,102 +2311,372 @@ std::vector<ClassificationResult> TextClassifier::ClassifyText(
   return {};
 }
 
-bool TextClassifier::ModelAnnotate(const std::string& context,
-                                   InterpreterManager* interpreter_manager,
-                                   std::vector<Token>* tokens,
-                                   std::vector<AnnotatedSpan>* result) const {
+bool TextClassifier::ModelAnnotate(
+    const std::vector<StringPiece>& contexts,
+    InterpreterManager* interpreter_manager, AnnotationSession* session,
+    Executor* executor, bool parallel_feature_extraction,
+    std::vector<ModelAnnotation>* results) const {
+  results->clear();
+  results->resize(contexts.size());
   if (model_->triggering_options() == nullptr ||
       !(model_->triggering_options()->enabled_modes() & ModeFlag_ANNOTATION)) {
     return true;
   }
 
-  const UnicodeText context_unicode = UTF8ToUnicodeText(context,
-                                                        /*do_copy=*/false);
+  // The lines of all the contexts, one context after the other. The lines of
+  // context i end at 'context_lines_ends[i]'.
   std::vector<UnicodeTextRange> lines;
-  if (!selection_feature_processor_->GetOptions()->only_use_line_with_click()) {
-    lines.push_back({context_unicode.begin(), context_unicode.end()});
-  } else {
-    lines = selection_feature_processor_->SplitContext(context_unicode);
+  std::vector<int> context_lines_ends;
+  context_lines_ends.reserve(contexts.size());
+  for (const StringPiece& context : contexts) {
+    const UnicodeText context_unicode =
+        UTF8ToUnicodeText(context.data(), context.size(), /*do_copy=*/false);
+    if (!selection_feature_processor_->GetOptions()
+             ->only_use_line_with_click()) {
+      lines.push_back({context_unicode.begin(), context_unicode.end()});
+    } else {
+      const std::vector<UnicodeTextRange> context_lines =
+          selection_feature_processor_->SplitContext(context_unicode);
+      lines.insert(lines.end(), context_lines.begin(), context_lines.end());
+    }
+    context_lines_ends.push_back(lines.size());
+  }
+
+  // Find the results of each line: either the one kept in the session, or one
+  // that needs to be computed. Identical lines, e.g. repeated signatures or log
+  // prefixes, also in different contexts, share their result. They are found
+  // by the fingerprint of their text. The lines point into the contexts, and
+  // are only copied out of them to be kept in the session.
+  struct UniqueLine {
+    StringPiece text;
+    AnnotationSession::LineResult result;
+  };
+  std::vector<UniqueLine> unique_lines;
+  unique_lines.reserve(lines.size());
+  std::unordered_multimap<uint64, int> unique_lines_by_fingerprint;
+  std::vector<int> line_unique_indices;
+  line_unique_indices.reserve(lines.size());
+  std::vector<int> unique_lines_to_compute;
+  if (session != nullptr) {
+    session->num_reused_lines_ = 0;
+    if (session->locales_ != interpreter_manager->locales()) {
+      session->Clear();
+      session->locales_ = interpreter_manager->locales();
+    }
   }
-
-  const float min_annotate_confidence =
-      (model_->triggering_options() != nullptr
-           ? model_->triggering_options()->min_annotate_confidence()
-           : 0.f);
-
-  FeatureProcessor::EmbeddingCache embedding_cache;
   for (const UnicodeTextRange& line : lines) {
-    const std::string line_str =
-        UnicodeText::UTF8Substring(line.first, line.second);
-
-    *tokens = selection_feature_processor_->Tokenize(line_str);
-    selection_feature_processor_->RetokenizeAndFindClick(
-        line_str, {0, std::distance(line.first, line.second)},
-        selection_feature_processor_->GetOptions()->only_use_line_with_click(),
-        tokens,
-        /*click_pos=*/nullptr);
-    const TokenSpan full_line_span = {0, tokens->size()};
-
-    // TODO(zilka): Add support for greater granularity of this check.
-    if (!selection_feature_processor_->HasEnoughSupportedCodepoints(
-            *tokens, full_line_span)) {
+    const char* line_begin = line.first.utf8_data();
+    const int line_size = line.second.utf8_data() - line_begin;
+    const uint64 fingerprint =
+        tc2farmhash::Fingerprint64(line_begin, line_size);
+    int unique_index = -1;
+    const auto same_fingerprint =
+        unique_lines_by_fingerprint.equal_range(fingerprint);
+    for (auto it = same_fingerprint.first; it != same_fingerprint.second;
+         ++it) {
+      const StringPiece& text = unique_lines[it->second].text;
+      if (text.size() == line_size &&
+          memcmp(text.data(), line_begin, line_size) == 0) {
+        unique_index = it->second;
+        break;
+      }
+    }
+    if (unique_index != -1) {
+      line_unique_indices.push_back(unique_index);
+      if (session != nullptr) {
+        ++session->num_reused_lines_;
+      }
       continue;
     }
 
-    std::unique_ptr<CachedFeatures> cached_features;
-    if (!selection_feature_processor_->ExtractFeatures(
-            *tokens, full_line_span,
-            /*selection_span_for_feature=*/{kInvalidIndex, kInvalidIndex},
-            embedding_executor_.get(),
-            /*embedding_cache=*/nullptr,
-            selection_feature_processor_->EmbeddingSize() +
-                selection_feature_processor_->DenseFeaturesCount(),
-            &cached_features)) {
-      TC_LOG(ERROR) << "Could not extract features.";
+    unique_index = unique_lines.size();
+    unique_lines.push_back({StringPiece(line_begin, line_size), {}});
+    unique_lines_by_fingerprint.emplace(fingerprint, unique_index);
+    line_unique_indices.push_back(unique_index);
+    if (session != nullptr) {
+      auto cached_it =
+          session->lines_.find(unique_lines.back().text.ToString());
+      if (cached_it != session->lines_.end()) {
+        unique_lines.back().result = std::move(cached_it->second);
+        session->lines_.erase(cached_it);
+        ++session->num_reused_lines_;
+        continue;
+      }
+    }
+    unique_lines_to_compute.push_back(unique_index);
+  }
+
+  // Run the models on the lines that were not found. Without an executor, all
+  // the lines share the inference batches. With an executor, the lines are
+  // processed in parallel instead, and every task uses its own interpreters,
+  // which are not thread-safe.
+  Executor* line_executor =
+      unique_lines_to_compute.size() > 1 ? executor : nullptr;
+  if (line_executor == nullptr) {
+    // A single line can use the executor for its token features instead.
+    std::vector<StringPiece> line_texts;
+    std::vector<AnnotationSession::LineResult*> line_results;
+    for (const int unique_index : unique_lines_to_compute) {
+      line_texts.push_back(unique_lines[unique_index].text);
+      line_results.push_back(&unique_lines[unique_index].result);
+    }
+    if (!ModelAnnotateLines(line_texts, interpreter_manager,
+                            parallel_feature_extraction ? executor : nullptr,
+                            line_results)) {
       return false;
     }
+  } else {
+    std::vector<char> succeeded(unique_lines_to_compute.size(), true);
+    RunInParallel(line_executor, unique_lines_to_compute.size(), [&](int i) {
+      if (ShouldStop(interpreter_manager->interruption())) {
+        return;
+      }
+      UniqueLine* line = &unique_lines[unique_lines_to_compute[i]];
+      InterpreterManager task_interpreter_manager(
+          selection_executor_.get(), classification_executor_.get(),
+          interpreter_manager->latency_stats(), interpreter_manager->locales(),
+          interpreter_manager->interruption());
+      succeeded[i] = ModelAnnotateLines(
+          {line->text}, &task_interpreter_manager,
+          /*feature_executor=*/nullptr, {&line->result});
+    });
+    for (const char line_succeeded : succeeded) {
+      if (!line_succeeded) {
+        return false;
+      }
+    }
+  }
+  // The results of the lines are incomplete if the call was stopped, so they
+  // are not kept in the session, and the caller drops the candidates anyway.
+  if (ShouldStop(interpreter_manager->interruption())) {
+    if (session != nullptr) {
+      session->Clear();
+    }
+    return true;
+  }
+
+  // Merge the candidates of each context in the order of its lines, shifted by
+  // the codepoint offsets of the lines, which are counted from one line to the
+  // next.
+  int line_index = 0;
+  for (int c = 0; c < contexts.size(); ++c) {
+    ModelAnnotation* result = &(*results)[c];
+    const UnicodeText context_unicode = UTF8ToUnicodeText(
+        contexts[c].data(), contexts[c].size(), /*do_copy=*/false);
+    int offset = 0;
+    UnicodeText::const_iterator offset_it = context_unicode.begin();
+    const int context_lines_begin = line_index;
+    for (; line_index < context_lines_ends[c]; ++line_index) {
+      offset += std::distance(offset_it, lines[line_index].first);
+      offset_it = lines[line_index].first;
+      for (const AnnotatedSpan& candidate :
+           unique_lines[line_unique_indices[line_index]].result.candidates) {
+        AnnotatedSpan result_span = candidate;
+        result_span.span.first += offset;
+        result_span.span.second += offset;
+        result->candidates.push_back(std::move(result_span));
+      }
+    }
+    if (line_index > context_lines_begin) {
+      result->tokens =
+          unique_lines[line_unique_indices[line_index - 1]].result.tokens;
+    }
+  }
 
-    std::vector<TokenSpan> local_chunks;
-    if (!ModelChunk(tokens->size(), /*span_of_interest=*/full_line_span,
-                    interpreter_manager->SelectionInterpreter(),
-                    *cached_features, &local_chunks)) {
+  // Leave the session with the results of these contexts only, so that it
+  // does not grow with lines that are gone.
+  if (session != nullptr) {
+    session->lines_.clear();
+    for (UniqueLine& line : unique_lines) {
+      session->lines_.emplace(line.text.ToString(), std::move(line.result));
+    }
+  }
+  return true;
+}
+
+bool TextClassifier::ModelAnnotateLines(
+    const std::vector<StringPiece>& lines,
+    InterpreterManager* interpreter_manager, Executor* feature_executor,
+    const std::vector<AnnotationSession::LineResult*>& results) const {
+  const float min_annotate_confidence =
+      (model_->triggering_options() != nullptr
+           ? model_->triggering_options()->min_annotate_confidence()
+           : 0.f);
+
+  // Tokenize the lines and extract their features. The token spans are
+  // relative to the line, so every line has its own embedding cache.
+  std::vector<UnicodeText> line_unicodes(lines.size());
+  std::vector<std::unique_ptr<CachedFeatures>> cached_features;
+  std::vector<ChunkInput> chunk_inputs;
+  std::vector<int> chunk_lines;
+  for (int i = 0; i < lines.size(); ++i) {
+    if (ShouldStop(interpreter_manager->interruption())) {
+      return true;
+    }
+    line_unicodes[i] = UTF8ToUnicodeText(lines[i].data(), lines[i].size(),
+                                         /*do_copy=*/false);
+    const UnicodeText& line_unicode = line_unicodes[i];
+    std::vector<Token>* tokens = &results[i]->tokens;
+
+    // Lines mostly in scripts that the model doesn't support would fail the
+    // check below whatever their tokens, so they are not tokenized at all.
+    if (selection_feature_processor_->HasTooFewSupportedCodepoints(
+            line_unicode)) {
+      tokens->clear();
+      continue;
+    }
+
+    {
+      ScopedLatencyTimer timer(interpreter_manager->latency_stats(),
+                               LatencyStats::TOKENIZATION);
+      *tokens = selection_feature_processor_->Tokenize(
+          line_unicode, interpreter_manager->locales());
+      selection_feature_processor_->RetokenizeAndFindClick(
+          line_unicode, {0, line_unicode.size_codepoints()},
+          selection_feature_processor_->GetOptions()
+              ->only_use_line_with_click(),
+          tokens,
+          /*click_pos=*/nullptr);
+    }
+    const TokenSpan full_line_span = {0, tokens->size()};
+
+    // TODO(zilka): Add support for greater granularity of this check.
+    if (!selection_feature_processor_->HasEnoughSupportedCodepoints(
+            *tokens, full_line_span)) {
+      continue;
+    }
+
+    std::unique_ptr<CachedFeatures> line_features;
+    {
+      ScopedLatencyTimer timer(interpreter_manager->latency_stats(),
+                               LatencyStats::FEATURE_EXTRACTION);
+      const LatencyRecordingEmbeddingExecutor embedding_executor(
+          embedding_executor_.get(), interpreter_manager->latency_stats());
+      if (!selection_feature_processor_->ExtractFeatures(
+              *tokens, full_line_span,
+              /*selection_span_for_feature=*/{kInvalidIndex, kInvalidIndex},
+              embedding_executor.get(),
+              /*embedding_cache=*/nullptr,
+              selection_feature_processor_->EmbeddingSize() +
+                  selection_feature_processor_->DenseFeaturesCount(),
+              &line_features,
+              execution_options_.half_precision_annotation_features,
+              feature_executor)) {
+        TC_LOG(ERROR) << "Could not extract features.";
+        return false;
+      }
+    }
+    chunk_inputs.push_back({static_cast<int>(tokens->size()),
+                            /*span_of_interest=*/full_line_span,
+                            line_features.get()});
+    chunk_lines.push_back(i);
+    cached_features.push_back(std::move(line_features));
+  }
+  if (chunk_inputs.empty()) {
+    return true;
+  }
+
+  // Chunk all the lines together.
+  std::vector<std::vector<TokenSpan>> chunks;
+  {
+    ScopedLatencyTimer timer(interpreter_manager->latency_stats(),
+                             LatencyStats::SELECTION_INFERENCE);
+    if (!ModelChunks(chunk_inputs, interpreter_manager->SelectionInterpreter(),
+                     interpreter_manager->interruption(), &chunks)) {
       TC_LOG(ERROR) << "Could not chunk.";
       return false;
     }
+  }
+  cached_features.clear();
+  if (ShouldStop(interpreter_manager->interruption())) {
+    return true;
+  }
 
-    const int offset = std::distance(context_unicode.begin(), line.first);
-    for (const TokenSpan& chunk : local_chunks) {
+  std::vector<FeatureProcessor::EmbeddingCache> embedding_caches(
+      chunk_lines.size());
+  std::vector<ClassificationContext> classification_contexts;
+  classification_contexts.reserve(chunk_lines.size());
+  std::vector<std::pair<int, CodepointSpan>> selections;
+  for (int k = 0; k < chunk_lines.size(); ++k) {
+    const int line = chunk_lines[k];
+    const std::vector<Token>& tokens = results[line]->tokens;
+    classification_contexts.push_back(
+        {&line_unicodes[line], &tokens, &embedding_caches[k]});
+    const UnicodeTextIndex line_index(line_unicodes[line]);
+    for (const TokenSpan& chunk : chunks[k]) {
       const CodepointSpan codepoint_span =
           selection_feature_processor_->StripBoundaryCodepoints(
-              line_str, TokenSpanToCodepointSpan(*tokens, chunk));
+              line_index, TokenSpanToCodepointSpan(tokens, chunk));
 
       // Skip empty spans.
       if (codepoint_span.first != codepoint_span.second) {
-        std::vector<ClassificationResult> classification;
-        if (!ModelClassifyText(line_str, *tokens, codepoint_span,
-                               interpreter_manager, &embedding_cache,
-                               &classification)) {
-          TC_LOG(ERROR) << "Could not classify text: "
-                        << (codepoint_span.first + offset) << " "
-                        << (codepoint_span.second + offset);
-          return false;
-        }
-
-        // Do not include the span if it's classified as "other".
-        if (!classification.empty() && !ClassifiedAsOther(classification) &&
-            classification[0].score >= min_annotate_confidence) {
-          AnnotatedSpan result_span;
-          result_span.span = {codepoint_span.first + offset,
-                              codepoint_span.second + offset};
-          result_span.classification = std::move(classification);
-          result->push_back(std::move(result_span));
-        }
+        selections.push_back({k, codepoint_span});
       }
     }
   }
+
+  // Classify the chunks of all the lines together.
+  std::vector<std::vector<ClassificationResult>> classifications;
+  if (!ModelClassifyTexts(classification_contexts, selections,
+                          interpreter_manager, /*max_results=*/0,
+                          &classifications)) {
+    TC_LOG(ERROR) << "Could not classify the chunks.";
+    return false;
+  }
+
+  for (int i = 0; i < selections.size(); ++i) {
+    std::vector<ClassificationResult>& classification = classifications[i];
+
+    // Do not include the span if it's classified as "other".
+    if (!classification.empty() && !ClassifiedAsOther(classification) &&
+        classification[0].score >= min_annotate_confidence) {
+      AnnotatedSpan result_span;
+      result_span.span = selections[i].second;
+      result_span.classification = std::move(classification);
+      results[chunk_lines[selections[i].first]]->candidates.push_back(
+          std::move(result_span));
+    }
+  }
   return true;
 }
 
+void TextClassifier::SetResultCacheSize(int max_entries) {
+  result_cache_.Reset(max_entries);
+}
+
+void TextClassifier::SetRuleProfile(RuleProfile* profile) {
+  rule_profile_ = profile;
+  if (datetime_parser_) {
+    datetime_parser_->SetRuleProfile(profile);
+  }
+  if (profile == nullptr || regex_patterns_.empty()) {
+    return;
+  }
+  std::unique_ptr<ZlibDecompressor> decompressor = ZlibDecompressor::Instance();
+  std::string pattern;
+  for (int i = 0; i < regex_patterns_.size(); ++i) {
+    const RegexModel_::Pattern* regex_pattern =
+        model_->regex_model()->patterns()->Get(i);
+    std::string name = regex_patterns_[i].collection_name;
+    if (UncompressPatternText(regex_pattern->pattern(),
+                              regex_pattern->compressed_pattern(),
+                              decompressor.get(), &pattern)) {
+      name += ": " + pattern;
+    }
+    profile->SetRuleName(RuleProfile::REGEX, i, name);
+  }
+}
+
+void TextClassifier::SetTokenFeatureCacheSize(int max_entries) {
+  if (selection_feature_processor_) {
+    selection_feature_processor_->GetTokenFeatureCache()->Reset(max_entries);
+  }
+  if (classification_feature_processor_) {
+    classification_feature_processor_->GetTokenFeatureCache()->Reset(
+        max_entries);
+  }
+}
+
 const FeatureProcessor* TextClassifier::SelectionFeatureProcessorForTests()
     const {
   return selection_feature_processor_.get();
@@ -1203,38 +2693,296 @@ const DatetimeParser* TextClassifier::DatetimeParserForTests() const {
 
 std::vector<AnnotatedSpan> TextClassifier::Annotate(
     const std::string& context, const AnnotationOptions& options) const {
-  std::vector<AnnotatedSpan> candidates;
+  if (!(model_->enabled_modes() & ModeFlag_ANNOTATION)) {
+    return {};
+  }
+
+  const CallInterruption interruption(options.timeout_ms,
+                                      options.cancellation_token);
+  InterpreterManager interpreter_manager(
+      selection_executor_.get(), classification_executor_.get(),
+      options.latency_stats, options.locales, &interruption);
+  std::vector<AnnotatedSpan> result;
+  if (!AnnotateInternal(context, options, &interpreter_manager,
+                        /*session=*/nullptr, /*model_annotation=*/nullptr,
+                        &result)) {
+    result.clear();
+  }
+  if (options.status != nullptr) {
+    *options.status = interruption.status();
+  }
+  return result;
+}
 
+std::vector<AnnotatedSpan> TextClassifier::AnnotateIncrementally(
+    const std::string& context, AnnotationSession* session,
+    const AnnotationOptions& options) const {
   if (!(model_->enabled_modes() & ModeFlag_ANNOTATION)) {
     return {};
   }
 
-  if (!UTF8ToUnicodeText(context, /*do_copy=*/false).is_valid()) {
+  const CallInterruption interruption(options.timeout_ms,
+                                      options.cancellation_token);
+  InterpreterManager interpreter_manager(
+      selection_executor_.get(), classification_executor_.get(),
+      options.latency_stats, options.locales, &interruption);
+  std::vector<AnnotatedSpan> result;
+  if (!AnnotateInternal(context, options, &interpreter_manager, session,
+                        /*model_annotation=*/nullptr, &result)) {
+    // The session could be partially updated.
+    session->Clear();
+    result.clear();
+  }
+  if (options.status != nullptr) {
+    *options.status = interruption.status();
+  }
+  return result;
+}
+
+constexpr int TextClassifier::kRegionOfInterestMargin;
+
+std::vector<AnnotatedSpan> TextClassifier::AnnotateRegion(
+    const std::string& context, CodepointSpan region_of_interest,
+    const AnnotationOptions& options) const {
+  if (!(model_->enabled_modes() & ModeFlag_ANNOTATION)) {
+    return {};
+  }
+  const UnicodeText context_unicode =
+      UTF8ToUnicodeText(context, /*do_copy=*/false);
+  if (!context_unicode.is_valid()) {
+    return {};
+  }
+  const UnicodeTextIndex context_index(context_unicode);
+  const int region_start = std::max(region_of_interest.first, 0);
+  const int region_end =
+      std::min(region_of_interest.second, context_index.size_codepoints());
+  if (region_start >= region_end) {
     return {};
   }
 
-  InterpreterManager interpreter_manager(selection_executor_.get(),
-                                         classification_executor_.get());
-  // Annotate with the selection model.
+  // Extend the region by the margin, but not past line breaks, as the
+  // selection model works line by line anyway.
+  int start = region_start;
+  UnicodeText::const_iterator begin = context_index.IteratorAt(start);
+  while (start > 0 && region_start - start < kRegionOfInterestMargin) {
+    UnicodeText::const_iterator previous = begin;
+    --previous;
+    if (*previous == '\n') {
+      break;
+    }
+    begin = previous;
+    --start;
+  }
+  int stop = region_end;
+  UnicodeText::const_iterator end = context_index.IteratorAt(stop);
+  while (stop < context_index.size_codepoints() &&
+         stop - region_end < kRegionOfInterestMargin && *end != '\n') {
+    ++end;
+    ++stop;
+  }
+
+  const CallInterruption interruption(options.timeout_ms,
+                                      options.cancellation_token);
+  InterpreterManager interpreter_manager(
+      selection_executor_.get(), classification_executor_.get(),
+      options.latency_stats, options.locales, &interruption);
+  std::vector<AnnotatedSpan> annotations;
+  if (!AnnotateInternal(UnicodeText::UTF8Substring(begin, end), options,
+                        &interpreter_manager, /*session=*/nullptr,
+                        /*model_annotation=*/nullptr, &annotations)) {
+    annotations.clear();
+  }
+  if (options.status != nullptr) {
+    *options.status = interruption.status();
+  }
+
+  std::vector<AnnotatedSpan> result;
+  for (AnnotatedSpan& annotation : annotations) {
+    annotation.span.first += start;
+    annotation.span.second += start;
+    if (annotation.span.first < region_end &&
+        annotation.span.second > region_start) {
+      result.push_back(std::move(annotation));
+    }
+  }
+  return result;
+}
+
+std::vector<std::vector<AnnotatedSpan>> TextClassifier::AnnotateDocuments(
+    const std::vector<std::string>& contexts,
+    const AnnotationOptions& options) const {
+  std::vector<std::vector<AnnotatedSpan>> results(contexts.size());
+  if (!(model_->enabled_modes() & ModeFlag_ANNOTATION)) {
+    return results;
+  }
+
+  // The timeout and the cancellation apply to the whole call. The contexts
+  // after the one where the call stopped get no annotations.
+  const CallInterruption interruption(options.timeout_ms,
+                                      options.cancellation_token);
+  InterpreterManager interpreter_manager(
+      selection_executor_.get(), classification_executor_.get(),
+      options.latency_stats, options.locales, &interruption);
+
+  // Run the selection model over all the contexts at once, so that their lines
+  // share the inference batches. The invalid contexts get no annotations, as in
+  // AnnotateInternal().
+  std::vector<ModelAnnotation> model_annotations(contexts.size());
+  if (ModelProducesAnyOf(options.entity_types)) {
+    std::vector<StringPiece> valid_contexts;
+    std::vector<int> valid_context_indices;
+    for (int i = 0; i < contexts.size(); ++i) {
+      if (UTF8ToUnicodeText(contexts[i], /*do_copy=*/false).is_valid()) {
+        valid_contexts.push_back(contexts[i]);
+        valid_context_indices.push_back(i);
+      }
+    }
+    std::vector<ModelAnnotation> valid_model_annotations;
+    if (!ModelAnnotate(valid_contexts, &interpreter_manager,
+                       /*session=*/nullptr, options.executor,
+                       options.parallel_feature_extraction,
+                       &valid_model_annotations)) {
+      TC_LOG(ERROR) << "Couldn't run ModelAnnotate.";
+      if (options.status != nullptr) {
+        *options.status = interruption.status();
+      }
+      return results;
+    }
+    for (int i = 0; i < valid_contexts.size(); ++i) {
+      model_annotations[valid_context_indices[i]] =
+          std::move(valid_model_annotations[i]);
+    }
+  }
+
+  for (int i = 0; i < contexts.size() && !interruption.ShouldStop(); ++i) {
+    if (!AnnotateInternal(contexts[i], options, &interpreter_manager,
+                          /*session=*/nullptr, &model_annotations[i],
+                          &results[i])) {
+      results[i].clear();
+    }
+  }
+  if (options.status != nullptr) {
+    *options.status = interruption.status();
+  }
+  return results;
+}
+
+bool TextClassifier::AnnotateInternal(
+    const std::string& context, const AnnotationOptions& options,
+    InterpreterManager* interpreter_manager, AnnotationSession* session,
+    ModelAnnotation* model_annotation,
+    std::vector<AnnotatedSpan>* result) const {
+  result->clear();
+  if (!UTF8ToUnicodeText(context, /*do_copy=*/false).is_valid() ||
+      ShouldStop(interpreter_manager->interruption())) {
+    return true;
+  }
+
+  // Annotate with the selection model, the regular expression models and the
+  // datetime model. With an executor, the three run in parallel, each into its
+  // own candidate list. The lists are concatenated in a fixed order, so that
+  // the result does not depend on the scheduling.
+  enum { kModelTask = 0, kRegexTask, kDatetimeTask, kNumTasks };
+  std::vector<AnnotatedSpan> task_candidates[kNumTasks];
+  bool task_succeeded[kNumTasks] = {true, true, true};
   std::vector<Token> tokens;
-  if (!ModelAnnotate(context, &interpreter_manager, &tokens, &candidates)) {
-    TC_LOG(ERROR) << "Couldn't run ModelAnnotate.";
-    return {};
+  std::vector<ParsedDatetimeSpan> parsed_datetimes;
+
+  // Only the annotators and patterns that can produce the requested entity
+  // types are run.
+  const std::vector<int>* regex_patterns = &annotation_regex_patterns_;
+  std::vector<int> requested_regex_patterns;
+  if (!options.entity_types.empty()) {
+    for (const int pattern_id : annotation_regex_patterns_) {
+      if (IsEntityTypeRequested(options.entity_types,
+                                regex_patterns_[pattern_id].collection_name)) {
+        requested_regex_patterns.push_back(pattern_id);
+      }
+    }
+    regex_patterns = &requested_regex_patterns;
   }
+  const bool run_model = ModelProducesAnyOf(options.entity_types);
+  const bool run_datetime =
+      IsEntityTypeRequested(options.entity_types, kDateCollection);
 
-  // Annotate with the regular expression models.
-  if (!RegexChunk(UTF8ToUnicodeText(context, /*do_copy=*/false),
-                  annotation_regex_patterns_, &candidates)) {
-    TC_LOG(ERROR) << "Couldn't run RegexChunk.";
-    return {};
+  const auto run_task = [&](int task) {
+    switch (task) {
+      case kModelTask:
+        if (!run_model) {
+          break;
+        }
+        if (model_annotation != nullptr) {
+          tokens = std::move(model_annotation->tokens);
+          task_candidates[kModelTask] =
+              std::move(model_annotation->candidates);
+          break;
+        }
+        {
+          std::vector<ModelAnnotation> model_annotations;
+          if (!ModelAnnotate({StringPiece(context)}, interpreter_manager,
+                             session, options.executor,
+                             options.parallel_feature_extraction,
+                             &model_annotations)) {
+            TC_LOG(ERROR) << "Couldn't run ModelAnnotate.";
+            task_succeeded[task] = false;
+            break;
+          }
+          tokens = std::move(model_annotations[0].tokens);
+          task_candidates[kModelTask] =
+              std::move(model_annotations[0].candidates);
+        }
+        break;
+      case kRegexTask: {
+        if (regex_patterns->empty()) {
+          break;
+        }
+        ScopedLatencyTimer timer(options.latency_stats, LatencyStats::REGEX);
+        if (!RegexChunk(UTF8ToUnicodeText(context, /*do_copy=*/false),
+                        *regex_patterns, &task_candidates[kRegexTask])) {
+          TC_LOG(ERROR) << "Couldn't run RegexChunk.";
+          task_succeeded[task] = false;
+        }
+        break;
+      }
+      case kDatetimeTask: {
+        if (!run_datetime) {
+          break;
+        }
+        ScopedLatencyTimer timer(options.latency_stats,
+                                 LatencyStats::DATETIME);
+        if (!DatetimeChunk(
+                UTF8ToUnicodeText(context, /*do_copy=*/false), options.locales,
+                ModeFlag_ANNOTATION, interpreter_manager->interruption(),
+                &task_candidates[kDatetimeTask],
+                options.interpret_datetimes ? &parsed_datetimes : nullptr)) {
+          TC_LOG(ERROR) << "Couldn't run DatetimeChunk.";
+          task_succeeded[task] = false;
+        }
+        break;
+      }
+    }
+  };
+  // RunInParallel() runs the last task on the calling thread. Making that the
+  // model task, which itself can fan out over the lines, ensures that no pool
+  // thread blocks waiting for other pool tasks.
+  RunInParallel(options.executor, kNumTasks, [&run_task](int i) {
+    run_task(kNumTasks - 1 - i);
+  });
+
+  // The candidates of stopped annotators are incomplete, so they are not
+  // resolved into annotations.
+  if (ShouldStop(interpreter_manager->interruption())) {
+    return true;
   }
 
-  // Annotate with the datetime model.
-  if (!DatetimeChunk(UTF8ToUnicodeText(context, /*do_copy=*/false),
-                     options.reference_time_ms_utc, options.reference_timezone,
-                     options.locales, ModeFlag_ANNOTATION, &candidates)) {
-    TC_LOG(ERROR) << "Couldn't run RegexChunk.";
-    return {};
+  std::vector<AnnotatedSpan> candidates;
+  for (int task = 0; task < kNumTasks; ++task) {
+    if (!task_succeeded[task]) {
+      return false;
+    }
+    candidates.insert(candidates.end(),
+                      std::make_move_iterator(task_candidates[task].begin()),
+                      std::make_move_iterator(task_candidates[task].end()));
   }
 
   // Sort candidates according to their position in the input, so that the next
@@ -1246,31 +2994,110 @@ std::vector<AnnotatedSpan> TextClassifier::Annotate(
             });
 
   std::vector<int> candidate_indices;
-  if (!ResolveConflicts(candidates, context, tokens, &interpreter_manager,
-                        &candidate_indices)) {
-    TC_LOG(ERROR) << "Couldn't resolve conflicts.";
-    return {};
+  {
+    ScopedLatencyTimer timer(options.latency_stats,
+                             LatencyStats::CONFLICT_RESOLUTION);
+    // Scoped to the call, as the embeddings are keyed by their codepoint span
+    // in the context.
+    FeatureProcessor::EmbeddingCache embedding_cache;
+    if (!ResolveConflicts(candidates, context, tokens, interpreter_manager,
+                          &embedding_cache, &candidate_indices)) {
+      TC_LOG(ERROR) << "Couldn't resolve conflicts.";
+      return false;
+    }
   }
 
-  std::vector<AnnotatedSpan> result;
-  result.reserve(candidate_indices.size());
+  result->reserve(candidate_indices.size());
   for (const int i : candidate_indices) {
     if (!candidates[i].classification.empty() &&
         !ClassifiedAsOther(candidates[i].classification) &&
-        !FilteredForAnnotation(candidates[i])) {
-      result.push_back(std::move(candidates[i]));
+        !FilteredForAnnotation(candidates[i]) &&
+        IsEntityTypeRequested(options.entity_types,
+                              candidates[i].classification[0].collection)) {
+      result->push_back(std::move(candidates[i]));
     }
   }
 
-  return result;
+  // Only the datetimes that made it to the result are resolved to absolute
+  // time, as most candidates lose in the conflict resolution. A stopped call
+  // returns them with their granularity only.
+  if (options.interpret_datetimes &&
+      !ShouldStop(interpreter_manager->interruption()) &&
+      !InterpretDatetimes(&parsed_datetimes, options, result)) {
+    TC_LOG(ERROR) << "Couldn't interpret the datetimes.";
+    return false;
+  }
+
+  return true;
+}
+
+bool TextClassifier::InterpretDatetimes(
+    std::vector<ParsedDatetimeSpan>* parsed_datetimes,
+    const AnnotationOptions& options,
+    std::vector<AnnotatedSpan>* annotations) const {
+  if (parsed_datetimes->empty()) {
+    return true;
+  }
+
+  // The parsed datetimes do not overlap, so they are found by their start.
+  std::sort(parsed_datetimes->begin(), parsed_datetimes->end(),
+            [](const ParsedDatetimeSpan& a, const ParsedDatetimeSpan& b) {
+              return a.span.first < b.span.first;
+            });
+  for (AnnotatedSpan& annotation : *annotations) {
+    DatetimeParseResult& datetime_parse_result =
+        annotation.classification[0].datetime_parse_result;
+    if (!datetime_parse_result.IsSet()) {
+      continue;
+    }
+    const auto it = std::lower_bound(
+        parsed_datetimes->begin(), parsed_datetimes->end(),
+        annotation.span.first,
+        [](const ParsedDatetimeSpan& parsed_datetime, int start) {
+          return parsed_datetime.span.first < start;
+        });
+    if (it == parsed_datetimes->end() || it->span != annotation.span) {
+      continue;
+    }
+    DatetimeParseResultSpan datetime_span;
+    if (!datetime_parser_->Interpret(*it, options.reference_time_ms_utc,
+                                     options.reference_timezone,
+                                     options.locales, &datetime_span)) {
+      return false;
+    }
+    datetime_parse_result = datetime_span.data;
+  }
+  return true;
 }
 
 bool TextClassifier::RegexChunk(const UnicodeText& context_unicode,
                                 const std::vector<int>& rules,
                                 std::vector<AnnotatedSpan>* result) const {
+  // Only run the patterns that can possibly match somewhere in the context.
+  std::vector<bool> candidate_patterns;
+  regex_prefilter_.FindCandidates(context_unicode.data(),
+                                  context_unicode.size_bytes(),
+                                  &candidate_patterns);
+
+  // The context is converted for the regex engine once, when the first pattern
+  // needs it.
+  std::unique_ptr<UniLib::UTF16Text> context_utf16;
   for (int pattern_id : rules) {
+    if (!candidate_patterns[pattern_id]) {
+      continue;
+    }
+    if (context_utf16 == nullptr) {
+      context_utf16 = unilib_->CreateUTF16Text(context_unicode);
+    }
+    ScopedRuleTimer timer(rule_profile_, RuleProfile::REGEX, pattern_id);
     const CompiledRegexPattern& regex_pattern = regex_patterns_[pattern_id];
-    const auto matcher = regex_pattern.pattern->Matcher(context_unicode);
+    const UniLib::RegexPattern* compiled_pattern = regex_pattern.pattern->Get();
+    if (compiled_pattern == nullptr) {
+      TC_LOG(ERROR) << "Could not compile regex pattern: " << pattern_id;
+      return false;
+    }
+    const UniLib::RegexPattern::ScopedMatcher matcher =
+        compiled_pattern->AcquireMatcher(*context_utf16);
     if (!matcher) {
       TC_LOG(ERROR) << "Could not get regex matcher for pattern: "
                     << pattern_id;
@@ -1279,6 +3106,7 @@ bool TextClassifier::RegexChunk(const UnicodeText& context_unicode,
 
     int status = UniLib::RegexMatcher::kNoError;
     while (matcher->Find(&status) && status == UniLib::RegexMatcher::kNoError) {
+      timer.AddMatch();
       result->emplace_back();
       // Selection/annotation regular expressions need to specify a capturing
       // group specifying the selection.
@@ -1297,163 +3125,250 @@ bool TextClassifier::ModelChunk(int num_tokens,
                                 const TokenSpan& span_of_interest,
                                 tflite::Interpreter* selection_interpreter,
                                 const CachedFeatures& cached_features,
+                                const CallInterruption* interruption,
                                 std::vector<TokenSpan>* chunks) const {
+  std::vector<std::vector<TokenSpan>> input_chunks;
+  if (!ModelChunks({{num_tokens, span_of_interest, &cached_features}},
+                   selection_interpreter, interruption, &input_chunks)) {
+    return false;
+  }
+  *chunks = std::move(input_chunks[0]);
+  return true;
+}
+
+std::vector<int> TextClassifier::ChunkFeatureIds(
+    const std::vector<ChunkInput>& inputs) {
+  std::vector<int> feature_ids;
+  feature_ids.reserve(inputs.size());
+  std::unordered_map<const CachedFeatures*, int> first_inputs;
+  for (int i = 0; i < inputs.size(); ++i) {
+    feature_ids.push_back(
+        first_inputs.emplace(inputs[i].cached_features, i).first->second);
+  }
+  return feature_ids;
+}
+
+bool TextClassifier::ModelChunks(
+    const std::vector<ChunkInput>& inputs,
+    tflite::Interpreter* selection_interpreter,
+    const CallInterruption* interruption,
+    std::vector<std::vector<TokenSpan>>* chunks) const {
   const int max_selection_span =
       selection_feature_processor_->GetOptions()->max_selection_span();
   // The inference span is the span of interest expanded to include
   // max_selection_span tokens on either side, which is how far a selection can
   // stretch from the click.
-  const TokenSpan inference_span = IntersectTokenSpans(
-      ExpandTokenSpan(span_of_interest,
-                      /*num_tokens_left=*/max_selection_span,
-                      /*num_tokens_right=*/max_selection_span),
-      {0, num_tokens});
+  std::vector<TokenSpan> inference_spans;
+  inference_spans.reserve(inputs.size());
+  for (const ChunkInput& input : inputs) {
+    inference_spans.push_back(IntersectTokenSpans(
+        ExpandTokenSpan(input.span_of_interest,
+                        /*num_tokens_left=*/max_selection_span,
+                        /*num_tokens_right=*/max_selection_span),
+        {0, input.num_tokens}));
+  }
 
-  std::vector<ScoredChunk> scored_chunks;
+  std::vector<std::vector<ScoredChunk>> scored_chunks;
   if (selection_feature_processor_->GetOptions()->bounds_sensitive_features() &&
       selection_feature_processor_->GetOptions()
           ->bounds_sensitive_features()
           ->enabled()) {
-    if (!ModelBoundsSensitiveScoreChunks(
-            num_tokens, span_of_interest, inference_span, cached_features,
-            selection_interpreter, &scored_chunks)) {
+    if (!ModelBoundsSensitiveScoreChunks(inputs, inference_spans,
+                                         selection_interpreter, interruption,
+                                         &scored_chunks)) {
       return false;
     }
   } else {
-    if (!ModelClickContextScoreChunks(num_tokens, span_of_interest,
-                                      cached_features, selection_interpreter,
-                                      &scored_chunks)) {
+    if (!ModelClickContextScoreChunks(inputs, selection_interpreter,
+                                      interruption, &scored_chunks)) {
       return false;
     }
   }
-  std::sort(scored_chunks.rbegin(), scored_chunks.rend(),
-            [](const ScoredChunk& lhs, const ScoredChunk& rhs) {
-              return lhs.score < rhs.score;
-            });
 
-  // Traverse the candidate chunks from highest-scoring to lowest-scoring. Pick
-  // them greedily as long as they do not overlap with any previously picked
-  // chunks.
-  std::vector<bool> token_used(TokenSpanSize(inference_span));
   chunks->clear();
-  for (const ScoredChunk& scored_chunk : scored_chunks) {
-    bool feasible = true;
-    for (int i = scored_chunk.token_span.first;
-         i < scored_chunk.token_span.second; ++i) {
-      if (token_used[i - inference_span.first]) {
-        feasible = false;
-        break;
+  chunks->resize(inputs.size());
+  for (int i = 0; i < inputs.size(); ++i) {
+    std::sort(scored_chunks[i].rbegin(), scored_chunks[i].rend(),
+              [](const ScoredChunk& lhs, const ScoredChunk& rhs) {
+                return lhs.score < rhs.score;
+              });
+
+    // Traverse the candidate chunks from highest-scoring to lowest-scoring.
+    // Pick them greedily as long as they do not overlap with any previously
+    // picked chunks.
+    const TokenSpan& inference_span = inference_spans[i];
+    std::vector<bool> token_used(TokenSpanSize(inference_span));
+    std::vector<TokenSpan>* input_chunks = &(*chunks)[i];
+    for (const ScoredChunk& scored_chunk : scored_chunks[i]) {
+      bool feasible = true;
+      for (int token = scored_chunk.token_span.first;
+           token < scored_chunk.token_span.second; ++token) {
+        if (token_used[token - inference_span.first]) {
+          feasible = false;
+          break;
+        }
       }
-    }
 
-    if (!feasible) {
-      continue;
-    }
+      if (!feasible) {
+        continue;
+      }
+
+      for (int token = scored_chunk.token_span.first;
+           token < scored_chunk.token_span.second; ++token) {
+        token_used[token - inference_span.first] = true;
+      }
 
-    for (int i = scored_chunk.token_span.first;
-         i < scored_chunk.token_span.second; ++i) {
-      token_used[i - inference_span.first] = true;
+      input_chunks->push_back(scored_chunk.token_span);
     }
 
-    chunks->push_back(scored_chunk.token_span);
+    std::sort(input_chunks->begin(), input_chunks->end());
   }
 
-  std::sort(chunks->begin(), chunks->end());
-
   return true;
 }
 
-namespace {
-// Updates the value at the given key in the map to maximum of the current value
-// and the given value, or simply inserts the value if the key is not yet there.
-template <typename Map>
-void UpdateMax(Map* map, typename Map::key_type key,
-               typename Map::mapped_type value) {
-  const auto it = map->find(key);
-  if (it != map->end()) {
-    it->second = std::max(it->second, value);
-  } else {
-    (*map)[key] = value;
-  }
-}
-}  // namespace
-
 bool TextClassifier::ModelClickContextScoreChunks(
-    int num_tokens, const TokenSpan& span_of_interest,
-    const CachedFeatures& cached_features,
+    const std::vector<ChunkInput>& inputs,
     tflite::Interpreter* selection_interpreter,
-    std::vector<ScoredChunk>* scored_chunks) const {
+    const CallInterruption* interruption,
+    std::vector<std::vector<ScoredChunk>>* scored_chunks) const {
   const int max_batch_size = model_->selection_options()->batch_size();
 
-  std::vector<float> all_features;
-  std::map<TokenSpan, float> chunk_scores;
-  for (int batch_start = span_of_interest.first;
-       batch_start < span_of_interest.second; batch_start += max_batch_size) {
-    const int batch_end =
-        std::min(batch_start + max_batch_size, span_of_interest.second);
+  // Precompute the relative token span of every label, and the extent of the
+  // candidate chunks they can produce around the span of interest.
+  const int num_labels = selection_feature_processor_->GetSelectionLabelCount();
+  std::vector<TokenSpan> label_spans(num_labels);
+  int max_tokens_left = 0;
+  int max_chunk_length = 1;
+  for (int j = 0; j < num_labels; ++j) {
+    if (!selection_feature_processor_->LabelToTokenSpan(j, &label_spans[j])) {
+      TC_LOG(ERROR) << "Couldn't map the label to a token span.";
+      return false;
+    }
+    max_tokens_left = std::max(max_tokens_left, label_spans[j].first);
+    max_chunk_length = std::max(
+        max_chunk_length, label_spans[j].first + label_spans[j].second + 1);
+  }
 
-    // Prepare features for the whole batch.
-    all_features.clear();
-    all_features.reserve(max_batch_size * cached_features.OutputFeaturesSize());
-    for (int click_pos = batch_start; click_pos < batch_end; ++click_pos) {
-      cached_features.AppendClickContextFeaturesForClick(click_pos,
-                                                         &all_features);
+  // Every token that is in a span of interest is run through the model once,
+  // also if several spans of interest over the same features contain it. The
+  // clicks are the feature ids and the positions of the clicked tokens.
+  const std::vector<int> feature_ids = ChunkFeatureIds(inputs);
+  std::vector<std::pair<int, int>> clicks;
+  for (int i = 0; i < inputs.size(); ++i) {
+    for (int click_pos = inputs[i].span_of_interest.first;
+         click_pos < inputs[i].span_of_interest.second; ++click_pos) {
+      clicks.push_back({feature_ids[i], click_pos});
     }
+  }
+  if (inputs.size() > 1) {
+    std::sort(clicks.begin(), clicks.end());
+    clicks.erase(std::unique(clicks.begin(), clicks.end()), clicks.end());
+  }
 
-    // Run batched inference.
+  // The label scores of the clicks. Only the first 'num_scored_clicks' are
+  // set if the scoring was stopped.
+  std::vector<float> click_scores(clicks.size() * num_labels);
+  int num_scored_clicks = 0;
+  for (int batch_start = 0;
+       batch_start < clicks.size() && !ShouldStop(interruption);
+       batch_start += max_batch_size) {
+    const int batch_end = std::min(batch_start + max_batch_size,
+                                   static_cast<int>(clicks.size()));
+
+    // Write the features for the whole batch directly into the input tensor.
     const int batch_size = batch_end - batch_start;
-    const int features_size = cached_features.OutputFeaturesSize();
-    TensorView<float> logits = selection_executor_->ComputeLogits(
-        TensorView<float>(all_features.data(), {batch_size, features_size}),
-        selection_interpreter);
+    const int features_size =
+        inputs[clicks[batch_start].first].cached_features->OutputFeaturesSize();
+    float* batch_features = selection_executor_->PrepareFeaturesInput(
+        {batch_size, features_size}, selection_interpreter);
+    if (batch_features == nullptr) {
+      TC_LOG(ERROR) << "Couldn't prepare the input tensor.";
+      return false;
+    }
+    for (int i = batch_start; i < batch_end; ++i) {
+      const CachedFeatures* cached_features =
+          inputs[clicks[i].first].cached_features;
+      cached_features->WriteClickContextFeaturesForClick(
+          clicks[i].second, batch_features + (i - batch_start) * features_size);
+    }
+
+    // Run batched inference.
+    TensorView<float> logits =
+        selection_executor_->ComputeLogitsFromInput(selection_interpreter);
     if (!logits.is_valid()) {
       TC_LOG(ERROR) << "Couldn't compute logits.";
       return false;
     }
     if (logits.dims() != 2 || logits.dim(0) != batch_size ||
-        logits.dim(1) !=
-            selection_feature_processor_->GetSelectionLabelCount()) {
+        logits.dim(1) != num_labels) {
       TC_LOG(ERROR) << "Mismatching output.";
       return false;
     }
 
     // Save results.
-    for (int click_pos = batch_start; click_pos < batch_end; ++click_pos) {
-      const std::vector<float> scores = ComputeSoftmax(
-          logits.data() + logits.dim(1) * (click_pos - batch_start),
-          logits.dim(1));
-      for (int j = 0;
-           j < selection_feature_processor_->GetSelectionLabelCount(); ++j) {
-        TokenSpan relative_token_span;
-        if (!selection_feature_processor_->LabelToTokenSpan(
-                j, &relative_token_span)) {
-          TC_LOG(ERROR) << "Couldn't map the label to a token span.";
-          return false;
-        }
-        const TokenSpan candidate_span = ExpandTokenSpan(
-            SingleTokenSpan(click_pos), relative_token_span.first,
-            relative_token_span.second);
-        if (candidate_span.first >= 0 && candidate_span.second <= num_tokens) {
-          UpdateMax(&chunk_scores, candidate_span, scores[j]);
-        }
-      }
+    for (int i = batch_start; i < batch_end; ++i) {
+      ComputeSoftmax(logits.data() + logits.dim(1) * (i - batch_start),
+                     logits.dim(1), &click_scores[i * num_labels]);
     }
+    num_scored_clicks = batch_end;
   }
 
   scored_chunks->clear();
-  scored_chunks->reserve(chunk_scores.size());
-  for (const auto& entry : chunk_scores) {
-    scored_chunks->push_back(ScoredChunk{entry.first, entry.second});
+  scored_chunks->resize(inputs.size());
+  for (int i = 0; i < inputs.size(); ++i) {
+    const int num_tokens = inputs[i].num_tokens;
+    const TokenSpan& span_of_interest = inputs[i].span_of_interest;
+
+    // The chunk scores are kept in a dense (start token, length) table: start
+    // tokens from 'min_start' to the end of the span of interest, and lengths
+    // from 1 to 'max_chunk_length'. Negative scores mark chunks not seen yet.
+    const int min_start = std::max(0, span_of_interest.first - max_tokens_left);
+    const int num_starts = std::max(0, span_of_interest.second - min_start);
+    std::vector<float> chunk_scores(num_starts * max_chunk_length, -1.0f);
+
+    int click_index = std::lower_bound(clicks.begin(), clicks.end(),
+                                       std::make_pair(feature_ids[i],
+                                                      span_of_interest.first)) -
+                      clicks.begin();
+    for (int click_pos = span_of_interest.first;
+         click_pos < span_of_interest.second &&
+         click_index < num_scored_clicks;
+         ++click_pos, ++click_index) {
+      const float* scores = &click_scores[click_index * num_labels];
+      for (int j = 0; j < num_labels; ++j) {
+        const int start = click_pos - label_spans[j].first;
+        const int end = click_pos + 1 + label_spans[j].second;
+        if (start >= 0 && end <= num_tokens) {
+          float* chunk_score =
+              &chunk_scores[(start - min_start) * max_chunk_length +
+                            (end - start - 1)];
+          *chunk_score = std::max(*chunk_score, scores[j]);
+        }
+      }
+    }
+
+    for (int start = min_start; start < span_of_interest.second; ++start) {
+      for (int length = 1; length <= max_chunk_length; ++length) {
+        const float score =
+            chunk_scores[(start - min_start) * max_chunk_length + length - 1];
+        if (score >= 0.0f) {
+          (*scored_chunks)[i].push_back(
+              ScoredChunk{{start, start + length}, score});
+        }
+      }
+    }
   }
 
   return true;
 }
 
 bool TextClassifier::ModelBoundsSensitiveScoreChunks(
-    int num_tokens, const TokenSpan& span_of_interest,
-    const TokenSpan& inference_span, const CachedFeatures& cached_features,
+    const std::vector<ChunkInput>& inputs,
+    const std::vector<TokenSpan>& inference_spans,
     tflite::Interpreter* selection_interpreter,
-    std::vector<ScoredChunk>* scored_chunks) const {
+    const CallInterruption* interruption,
+    std::vector<std::vector<ScoredChunk>>* scored_chunks) const {
   const int max_selection_span =
       selection_feature_processor_->GetOptions()->max_selection_span();
   const int max_chunk_length = selection_feature_processor_->GetOptions()
@@ -1466,57 +3381,226 @@ bool TextClassifier::ModelBoundsSensitiveScoreChunks(
           ->score_single_token_spans_as_zero();
 
   scored_chunks->clear();
+  scored_chunks->resize(inputs.size());
   if (score_single_token_spans_as_zero) {
-    scored_chunks->reserve(TokenSpanSize(span_of_interest));
+    for (int i = 0; i < inputs.size(); ++i) {
+      (*scored_chunks)[i].reserve(TokenSpanSize(inputs[i].span_of_interest));
+    }
+  }
+
+  const std::vector<int> feature_ids = ChunkFeatureIds(inputs);
+  if (model_->selection_options()->pruned_bounds_sensitive_search()) {
+    return ModelBoundsSensitivePrunedScoreChunks(
+        inputs, feature_ids, inference_spans, max_chunk_length,
+        score_single_token_spans_as_zero, selection_interpreter, interruption,
+        scored_chunks);
   }
 
-  // Prepare all chunk candidates into one batch:
+  // Prepare all chunk candidates of each span of interest:
   //   - Are contained in the inference span
   //   - Have a non-empty intersection with the span of interest
   //   - Are at least one token long
   //   - Are not longer than the maximum chunk length
-  std::vector<TokenSpan> candidate_spans;
-  for (int start = inference_span.first; start < span_of_interest.second;
-       ++start) {
-    const int leftmost_end_index = std::max(start, span_of_interest.first) + 1;
-    for (int end = leftmost_end_index;
-         end <= inference_span.second && end - start <= max_chunk_length;
-         ++end) {
-      const TokenSpan candidate_span = {start, end};
-      if (score_single_token_spans_as_zero &&
-          TokenSpanSize(candidate_span) == 1) {
-        // Do not include the single token span in the batch, add a zero score
-        // for it directly to the output.
-        scored_chunks->push_back(ScoredChunk{candidate_span, 0.0f});
-      } else {
-        candidate_spans.push_back(candidate_span);
+  std::vector<std::vector<TokenSpan>> candidate_spans(inputs.size());
+  for (int i = 0; i < inputs.size(); ++i) {
+    const TokenSpan& span_of_interest = inputs[i].span_of_interest;
+    const TokenSpan& inference_span = inference_spans[i];
+    for (int start = inference_span.first; start < span_of_interest.second;
+         ++start) {
+      const int leftmost_end_index =
+          std::max(start, span_of_interest.first) + 1;
+      for (int end = leftmost_end_index;
+           end <= inference_span.second && end - start <= max_chunk_length;
+           ++end) {
+        const TokenSpan candidate_span = {start, end};
+        if (score_single_token_spans_as_zero &&
+            TokenSpanSize(candidate_span) == 1) {
+          // Do not include the single token span in the batch, add a zero
+          // score for it directly to the output.
+          (*scored_chunks)[i].push_back(ScoredChunk{candidate_span, 0.0f});
+        } else {
+          candidate_spans[i].push_back(candidate_span);
+        }
       }
     }
   }
 
+  return ModelBoundsSensitiveScoreSharedSpans(
+      inputs, feature_ids, candidate_spans, selection_interpreter,
+      interruption, scored_chunks);
+}
+
+bool TextClassifier::ModelBoundsSensitivePrunedScoreChunks(
+    const std::vector<ChunkInput>& inputs, const std::vector<int>& feature_ids,
+    const std::vector<TokenSpan>& inference_spans, int max_chunk_length,
+    bool score_single_token_spans_as_zero,
+    tflite::Interpreter* selection_interpreter,
+    const CallInterruption* interruption,
+    std::vector<std::vector<ScoredChunk>>* scored_chunks) const {
+  const int patience =
+      std::max(1, model_->selection_options()->pruning_patience());
+  const float min_score = model_->selection_options()->pruning_min_score();
+  const int num_inputs = inputs.size();
+
+  // The number of misses in a row of every start token, and the start tokens
+  // that are still grown, of each span of interest.
+  std::vector<std::vector<int>> misses(num_inputs);
+  std::vector<std::vector<int>> live_starts(num_inputs);
+  bool any_live_starts = false;
+  for (int i = 0; i < num_inputs; ++i) {
+    const TokenSpan& span_of_interest = inputs[i].span_of_interest;
+    misses[i].resize(span_of_interest.second - inference_spans[i].first, 0);
+    for (int start = inference_spans[i].first; start < span_of_interest.second;
+         ++start) {
+      live_starts[i].push_back(start);
+    }
+    any_live_starts |= !live_starts[i].empty();
+  }
+
+  // Score the candidates of all the live start tokens of all the spans of
+  // interest one length at a time, so that each round is still a single batch.
+  std::vector<std::vector<TokenSpan>> candidate_spans(num_inputs);
+  std::vector<std::vector<ScoredChunk>> round_chunks(num_inputs);
+  for (int length = 1; length <= max_chunk_length && any_live_starts &&
+                       !ShouldStop(interruption);
+       ++length) {
+    for (int i = 0; i < num_inputs; ++i) {
+      candidate_spans[i].clear();
+      round_chunks[i].clear();
+      for (const int start : live_starts[i]) {
+        const TokenSpan candidate_span = {start, start + length};
+        if (candidate_span.second <= inputs[i].span_of_interest.first) {
+          // Not intersecting the span of interest yet.
+          continue;
+        }
+        if (score_single_token_spans_as_zero && length == 1) {
+          (*scored_chunks)[i].push_back(ScoredChunk{candidate_span, 0.0f});
+        } else {
+          candidate_spans[i].push_back(candidate_span);
+        }
+      }
+    }
+
+    if (!ModelBoundsSensitiveScoreSharedSpans(
+            inputs, feature_ids, candidate_spans, selection_interpreter,
+            interruption, &round_chunks)) {
+      return false;
+    }
+
+    any_live_starts = false;
+    for (int i = 0; i < num_inputs; ++i) {
+      const TokenSpan& inference_span = inference_spans[i];
+      std::vector<int>* input_misses = &misses[i];
+      for (const ScoredChunk& scored_chunk : round_chunks[i]) {
+        int* start_misses =
+            &(*input_misses)[scored_chunk.token_span.first -
+                             inference_span.first];
+        *start_misses = scored_chunk.score < min_score ? *start_misses + 1 : 0;
+      }
+      (*scored_chunks)[i].insert((*scored_chunks)[i].end(),
+                                 round_chunks[i].begin(),
+                                 round_chunks[i].end());
+
+      // Abandon the start tokens that missed too often or cannot grow further.
+      live_starts[i].erase(
+          std::remove_if(
+              live_starts[i].begin(), live_starts[i].end(),
+              [input_misses, &inference_span, length, patience](int start) {
+                return start + length >= inference_span.second ||
+                       (*input_misses)[start - inference_span.first] >=
+                           patience;
+              }),
+          live_starts[i].end());
+      any_live_starts |= !live_starts[i].empty();
+    }
+  }
+
+  return true;
+}
+
+bool TextClassifier::ModelBoundsSensitiveScoreSharedSpans(
+    const std::vector<ChunkInput>& inputs, const std::vector<int>& feature_ids,
+    const std::vector<std::vector<TokenSpan>>& candidate_spans,
+    tflite::Interpreter* selection_interpreter,
+    const CallInterruption* interruption,
+    std::vector<std::vector<ScoredChunk>>* scored_chunks) const {
+  // The candidates are the feature ids and the token spans. The ones that
+  // several spans of interest over the same features share are scored once.
+  std::vector<std::pair<int, TokenSpan>> unique_candidates;
+  for (int i = 0; i < inputs.size(); ++i) {
+    for (const TokenSpan& span : candidate_spans[i]) {
+      unique_candidates.push_back({feature_ids[i], span});
+    }
+  }
+  const bool shared = inputs.size() > 1;
+  if (shared) {
+    std::sort(unique_candidates.begin(), unique_candidates.end());
+    unique_candidates.erase(
+        std::unique(unique_candidates.begin(), unique_candidates.end()),
+        unique_candidates.end());
+  }
+
+  // The scores are in the order of 'unique_candidates', and only the first
+  // ones are there if the scoring was stopped.
+  std::vector<float> scores;
+  if (!ModelBoundsSensitiveScoreSpans(inputs, unique_candidates,
+                                      selection_interpreter, interruption,
+                                      &scores)) {
+    return false;
+  }
+  int index = 0;
+  for (int i = 0; i < inputs.size(); ++i) {
+    for (const TokenSpan& span : candidate_spans[i]) {
+      if (shared) {
+        index = std::lower_bound(unique_candidates.begin(),
+                                 unique_candidates.end(),
+                                 std::make_pair(feature_ids[i], span)) -
+                unique_candidates.begin();
+      }
+      if (index < scores.size()) {
+        (*scored_chunks)[i].push_back(ScoredChunk{span, scores[index]});
+      }
+      ++index;
+    }
+  }
+  return true;
+}
+
+bool TextClassifier::ModelBoundsSensitiveScoreSpans(
+    const std::vector<ChunkInput>& inputs,
+    const std::vector<std::pair<int, TokenSpan>>& candidates,
+    tflite::Interpreter* selection_interpreter,
+    const CallInterruption* interruption, std::vector<float>* scores) const {
   const int max_batch_size = model_->selection_options()->batch_size();
 
-  std::vector<float> all_features;
-  scored_chunks->reserve(scored_chunks->size() + candidate_spans.size());
-  for (int batch_start = 0; batch_start < candidate_spans.size();
+  scores->reserve(scores->size() + candidates.size());
+  for (int batch_start = 0;
+       batch_start < candidates.size() && !ShouldStop(interruption);
        batch_start += max_batch_size) {
     const int batch_end = std::min(batch_start + max_batch_size,
-                                   static_cast<int>(candidate_spans.size()));
+                                   static_cast<int>(candidates.size()));
 
-    // Prepare features for the whole batch.
-    all_features.clear();
-    all_features.reserve(max_batch_size * cached_features.OutputFeaturesSize());
+    // Write the features for the whole batch directly into the input tensor.
+    const int batch_size = batch_end - batch_start;
+    const int features_size = inputs[candidates[batch_start].first]
+                                  .cached_features->OutputFeaturesSize();
+    float* batch_features = selection_executor_->PrepareFeaturesInput(
+        {batch_size, features_size}, selection_interpreter);
+    if (batch_features == nullptr) {
+      TC_LOG(ERROR) << "Couldn't prepare the input tensor.";
+      return false;
+    }
     for (int i = batch_start; i < batch_end; ++i) {
-      cached_features.AppendBoundsSensitiveFeaturesForSpan(candidate_spans[i],
-                                                           &all_features);
+      const CachedFeatures* cached_features =
+          inputs[candidates[i].first].cached_features;
+      cached_features->WriteBoundsSensitiveFeaturesForSpan(
+          candidates[i].second,
+          batch_features + (i - batch_start) * features_size);
     }
 
     // Run batched inference.
-    const int batch_size = batch_end - batch_start;
-    const int features_size = cached_features.OutputFeaturesSize();
-    TensorView<float> logits = selection_executor_->ComputeLogits(
-        TensorView<float>(all_features.data(), {batch_size, features_size}),
-        selection_interpreter);
+    TensorView<float> logits =
+        selection_executor_->ComputeLogitsFromInput(selection_interpreter);
     if (!logits.is_valid()) {
       TC_LOG(ERROR) << "Couldn't compute logits.";
       return false;
@@ -1528,40 +3612,42 @@ bool TextClassifier::ModelBoundsSensitiveScoreChunks(
     }
 
     // Save results.
-    for (int i = batch_start; i < batch_end; ++i) {
-      scored_chunks->push_back(
-          ScoredChunk{candidate_spans[i], logits.data()[i - batch_start]});
-    }
+    scores->insert(scores->end(), logits.data(), logits.data() + batch_size);
   }
 
   return true;
 }
 
-bool TextClassifier::DatetimeChunk(const UnicodeText& context_unicode,
-                                   int64 reference_time_ms_utc,
-                                   const std::string& reference_timezone,
-                                   const std::string& locales, ModeFlag mode,
-                                   std::vector<AnnotatedSpan>* result) const {
+bool TextClassifier::DatetimeChunk(
+    const UnicodeText& context_unicode, const std::string& locales,
+    ModeFlag mode, const CallInterruption* interruption,
+    std::vector<AnnotatedSpan>* result,
+    std::vector<ParsedDatetimeSpan>* parsed_datetimes) const {
   if (!datetime_parser_) {
     return true;
   }
 
-  std::vector<DatetimeParseResultSpan> datetime_spans;
-  if (!datetime_parser_->Parse(context_unicode, reference_time_ms_utc,
-                               reference_timezone, locales, mode,
-                               /*anchor_start_end=*/false, &datetime_spans)) {
+  std::vector<ParsedDatetimeSpan> datetime_spans;
+  if (!datetime_parser_->FindDatetimes(context_unicode, locales, mode,
+                                       /*anchor_start_end=*/false,
+                                       &datetime_spans, interruption)) {
     return false;
   }
-  for (const DatetimeParseResultSpan& datetime_span : datetime_spans) {
+  for (const ParsedDatetimeSpan& datetime_span : datetime_spans) {
     AnnotatedSpan annotated_span;
     annotated_span.span = datetime_span.span;
     annotated_span.classification = {{kDateCollection,
                                       datetime_span.target_classification_score,
                                       datetime_span.priority_score}};
-    annotated_span.classification[0].datetime_parse_result = datetime_span.data;
+    annotated_span.classification[0].datetime_parse_result.granularity =
+        datetime_span.granularity;
 
     result->push_back(std::move(annotated_span));
   }
+  if (parsed_datetimes != nullptr) {
+    parsed_datetimes->insert(parsed_datetimes->end(), datetime_spans.begin(),
+                             datetime_spans.end());
+  }
   return true;
 }
 
@@ -1573,4 +3659,31 @@ const Model* ViewModel(const void* buffer, int size) {
   return LoadAndVerifyModel(buffer, size);
 }
 
+const Model* ViewModelMetadata(const void* buffer, int size) {
+  if (!buffer) {
+    return nullptr;
+  }
+
+  // Verifies the root table and the metadata fields just like Model::Verify,
+  // but without going through the rest of the model.
+  flatbuffers::Verifier verifier(reinterpret_cast<const uint8_t*>(buffer),
+                                 size);
+  if (!verifier.Verify<flatbuffers::uoffset_t>(
+          reinterpret_cast<const flatbuffers::uoffset_t*>(buffer))) {
+    return nullptr;
+  }
+  const Model* model = GetModel(buffer);
+  const flatbuffers::Table* table =
+      reinterpret_cast<const flatbuffers::Table*>(model);
+  if (!table->VerifyTableStart(verifier) ||
+      !table->VerifyOffset(verifier, Model::VT_LOCALES) ||
+      !verifier.Verify(model->locales()) ||
+      !table->VerifyField<int32_t>(verifier, Model::VT_VERSION) ||
+      !table->VerifyOffset(verifier, Model::VT_NAME) ||
+      !verifier.Verify(model->name()) || !verifier.EndTable()) {
+    return nullptr;
+  }
+  return model;
+}
+
 }  // namespace libtextclassifier2
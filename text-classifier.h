@@ -22,15 +22,26 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "cancellation.h"
 #include "datetime/parser.h"
+#include "dynamic-batcher.h"
 #include "feature-processor.h"
+#include "initialization-stats.h"
+#include "latency-stats.h"
 #include "model-executor.h"
 #include "model_generated.h"
+#include "regex-prefilter.h"
+#include "result-cache.h"
+#include "rule-profile.h"
 #include "strip-unpaired-brackets.h"
 #include "types.h"
 #include "util/memory/mmap.h"
+#include "util/strings/stringpiece.h"
+#include "util/thread/executor.h"
 #include "util/utf8/unilib.h"
 #include "zlib-utils.h"
 
@@ -41,6 +52,10 @@ struct SelectionOptions {
   // tags).
   std::string locales;
 
+  // If set, the time spent in the stages of the call is added to it. Not
+  // owned.
+  LatencyStats* latency_stats = nullptr;
+
   static SelectionOptions Default() { return SelectionOptions(); }
 };
 
@@ -57,6 +72,25 @@ struct ClassificationOptions {
   // tags).
   std::string locales;
 
+  // If set, the time spent in the stages of the call is added to it. Not
+  // owned.
+  LatencyStats* latency_stats = nullptr;
+
+  // If not empty, the only collections that the result may have. Any other
+  // result is reported as 'other', and the regular expressions, the datetime
+  // parser and the model are only run if they can produce one of these.
+  std::unordered_set<std::string> entity_types;
+
+  // If positive, the call stops after this many milliseconds, and returns no
+  // results.
+  int64 timeout_ms = 0;
+
+  // If set and cancelled, the call stops, and returns no results. Not owned.
+  const CancellationToken* cancellation_token = nullptr;
+
+  // If set, receives whether the call completed or was stopped. Not owned.
+  CallStatus* status = nullptr;
+
   static ClassificationOptions Default() { return ClassificationOptions(); }
 };
 
@@ -73,10 +107,118 @@ struct AnnotationOptions {
   // tags).
   std::string locales;
 
+  // If set, the model, regular expression and datetime annotators run in
+  // parallel on this executor, and the lines of the context are run through
+  // the selection and classification models in parallel, each task with its
+  // own interpreters. Not owned.
+  Executor* executor = nullptr;
+
+  // If set, the time spent in the stages of the call is added to it. Not
+  // owned.
+  LatencyStats* latency_stats = nullptr;
+
+  // Whether to resolve the datetime annotations to absolute time. If false,
+  // their datetime_parse_result only has the granularity, and the calendar
+  // arithmetic is skipped altogether.
+  bool interpret_datetimes = true;
+
+  // If true and 'executor' is set, the features of the tokens of a long line
+  // are also extracted in parallel on the executor, when the line is not run
+  // in parallel with others. Meant for annotating large single-line documents
+  // offline, where there are too few lines to keep the threads busy.
+  bool parallel_feature_extraction = false;
+
+  // If not empty, the only collections to annotate. The regular expressions,
+  // the datetime parser and the model are only run if they can produce one of
+  // these, so the spans that they would have found do not compete with the
+  // requested ones in the conflict resolution.
+  std::unordered_set<std::string> entity_types;
+
+  // If positive, the call stops after this many milliseconds. The stages of
+  // the call are stopped at the next model batch, datetime rule or stage, and
+  // the annotations are only returned if the conflicts among them have been
+  // resolved; the datetimes in them may then lack the absolute time.
+  int64 timeout_ms = 0;
+
+  // If set and cancelled, the call stops as on the timeout. Not owned.
+  const CancellationToken* cancellation_token = nullptr;
+
+  // If set, receives whether the call completed or was stopped. Not owned.
+  CallStatus* status = nullptr;
+
   static AnnotationOptions Default() { return AnnotationOptions(); }
 };
 
+// Options for running the TFLite models of a TextClassifier.
+struct ModelExecutionOptions {
+  // For the selection model, whose passes over long texts run large batches.
+  ModelExecutorOptions selection;
+
+  // For the classification model, which mostly runs one span per call.
+  ModelExecutorOptions classification;
+
+  // If true, the classification model inferences of concurrent calls, e.g.
+  // ClassifyText() from many threads, are run together in batches.
+  bool batch_classifications_across_calls = false;
+  DynamicBatcherOptions classification_batching;
+
+  // If true, the selection model features of the lines that Annotate() runs
+  // on are kept in bfloat16 instead of floats, which halves their memory and
+  // the bandwidth of assembling the batches from them. Meant for documents
+  // with long lines; the scores change slightly.
+  bool half_precision_annotation_features = false;
+
+  // If set, the TFLite models are built, and the regular expression and
+  // datetime patterns decompressed and compiled, in parallel on this executor
+  // while the model is loaded. The result is the same as without it. Not
+  // owned, and not used after the factory returns.
+  Executor* initialization_executor = nullptr;
+
+  // If set, the time spent in the phases of loading the model, and the number
+  // of patterns compiled and decompressed, are added to it. Not owned, and not
+  // used after the factory returns.
+  InitializationStats* initialization_stats = nullptr;
+};
+
+// Estimates of the memory that a TextClassifier holds, by component, from
+// TextClassifier::GetMemoryStats(). The heap numbers count the containers and
+// the compiled patterns, but not every allocation of ICU and TFLite, so they
+// are approximations meant for comparing models and configurations.
+struct MemoryStats {
+  // The size of the mapped model file, and how much of it is resident in
+  // physical memory. Both are 0 if the classifier doesn't own the buffer.
+  int64 model_mapped_bytes = 0;
+  int64 model_resident_bytes = 0;
+
+  // Compiled regular expression patterns and their prefilter.
+  int64 regex_bytes = 0;
+
+  // Compiled datetime rules and extractors, and the memoized rules and words.
+  int64 datetime_bytes = 0;
+
+  // Tensors of the pooled selection and classification interpreters.
+  int64 interpreter_bytes = 0;
+
+  // Tensors of the embedding interpreter outside of the model buffer.
+  int64 embedding_bytes = 0;
+
+  // Codepoint sets, label maps, feature extractors and token feature caches
+  // of the feature processors.
+  int64 feature_processor_bytes = 0;
+
+  // The unpacked codepoint ranges of the tokenizers.
+  int64 tokenizer_bytes = 0;
+
+  int64 TotalHeapBytes() const {
+    return regex_bytes + datetime_bytes + interpreter_bytes + embedding_bytes +
+           feature_processor_bytes + tokenizer_bytes;
+  }
+};
+
 // Holds TFLite interpreters for selection and classification models.
+// The interpreters are checked out of the executors' pools on first use and
+// handed back when the manager is destroyed. Also carries the latency stats and
+// the interruption of the call that the interpreters are used for, if any.
 // NOTE: his class is not thread-safe, thus should NOT be re-used across
 // threads.
 class InterpreterManager {
@@ -85,9 +227,17 @@ class InterpreterManager {
   // a defined behavior, as long as the corresponding *Interpreter() method is
   // not called when the executor is null.
   InterpreterManager(const ModelExecutor* selection_executor,
-                     const ModelExecutor* classification_executor)
+                     const ModelExecutor* classification_executor,
+                     LatencyStats* latency_stats = nullptr,
+                     const std::string& locales = "",
+                     const CallInterruption* interruption = nullptr)
       : selection_executor_(selection_executor),
-        classification_executor_(classification_executor) {}
+        classification_executor_(classification_executor),
+        latency_stats_(latency_stats),
+        locales_(locales),
+        interruption_(interruption) {}
+
+  ~InterpreterManager();
 
   // Gets or creates and caches an interpreter for the selection model.
   tflite::Interpreter* SelectionInterpreter();
@@ -95,34 +245,130 @@ class InterpreterManager {
   // Gets or creates and caches an interpreter for the classification model.
   tflite::Interpreter* ClassificationInterpreter();
 
+  // The stats to record the latencies of the call to, or nullptr.
+  LatencyStats* latency_stats() const { return latency_stats_; }
+
+  // The locales of the input of the call, which the ICU tokenization follows.
+  const std::string& locales() const { return locales_; }
+
+  // The deadline and cancellation of the call, or nullptr.
+  const CallInterruption* interruption() const { return interruption_; }
+
  private:
   const ModelExecutor* selection_executor_;
   const ModelExecutor* classification_executor_;
+  LatencyStats* const latency_stats_;
+  const std::string locales_;
+  const CallInterruption* const interruption_;
 
   std::unique_ptr<tflite::Interpreter> selection_interpreter_;
   std::unique_ptr<tflite::Interpreter> classification_interpreter_;
 };
 
+// Keeps the selection model results of previous TextClassifier::
+// AnnotateIncrementally() calls, so that when the text is edited, only the
+// lines that changed have to be run through the model again.
+// NOTE: This class is not thread-safe.
+class AnnotationSession {
+ public:
+  AnnotationSession() {}
+
+  // Drops all the kept results. They are also dropped when a call comes with
+  // other locales than the previous one.
+  void Clear() { lines_.clear(); }
+
+  // Returns the number of lines whose results are kept.
+  int num_cached_lines() const { return lines_.size(); }
+
+  // Returns how many lines the last AnnotateIncrementally() call took from the
+  // session instead of running the model on them.
+  int num_reused_lines() const { return num_reused_lines_; }
+
+ private:
+  friend class TextClassifier;
+
+  struct LineResult {
+    // Tokens of the line, with offsets relative to the line.
+    std::vector<Token> tokens;
+
+    // Candidates found by the model, with spans relative to the line.
+    std::vector<AnnotatedSpan> candidates;
+  };
+
+  // For given locales, the model results only depend on the line text, so
+  // they are keyed by it. This way the results stay valid when an edit shifts
+  // the lines around. The tokenization depends on the locales, so the results
+  // are dropped when a call comes with other locales than 'locales_'.
+  std::unordered_map<std::string, LineResult> lines_;
+  std::string locales_;
+  int num_reused_lines_ = 0;
+};
+
 // A text processing model that provides text classification, annotation,
 // selection suggestion for various types.
-// NOTE: This class is not thread-safe.
+// The const methods, i.e. the calls on the text and the stats, are thread-safe,
+// so one classifier can serve concurrent calls: each call gets its own
+// interpreters from a pool. The non-const setup methods, Freeze(),
+// SetResultCacheSize(), SetTokenFeatureCacheSize() and SetRuleProfile(), are
+// not, and must not be called concurrently with any other call. An
+// AnnotationSession must only be used by one call at a time.
 class TextClassifier {
  public:
+  // If 'verify_model' is false, the model is trusted to be well-formed (e.g.
+  // because it comes with the system image) and none of the flatbuffers in it,
+  // including the embedded TFLite models, are verified when loading it.
+  // 'execution_options' set up the interpreters of the TFLite models, e.g. to
+  // run the selection model on more threads or through an accelerator.
   static std::unique_ptr<TextClassifier> FromUnownedBuffer(
-      const char* buffer, int size, const UniLib* unilib = nullptr);
+      const char* buffer, int size, const UniLib* unilib = nullptr,
+      bool verify_model = true,
+      const ModelExecutionOptions& execution_options = ModelExecutionOptions());
   // Takes ownership of the mmap.
   static std::unique_ptr<TextClassifier> FromScopedMmap(
-      std::unique_ptr<ScopedMmap>* mmap, const UniLib* unilib = nullptr);
+      std::unique_ptr<ScopedMmap>* mmap, const UniLib* unilib = nullptr,
+      bool verify_model = true,
+      const ModelExecutionOptions& execution_options = ModelExecutionOptions());
   static std::unique_ptr<TextClassifier> FromFileDescriptor(
-      int fd, int offset, int size, const UniLib* unilib = nullptr);
+      int fd, int offset, int size, const UniLib* unilib = nullptr,
+      bool verify_model = true,
+      const ModelExecutionOptions& execution_options = ModelExecutionOptions());
   static std::unique_ptr<TextClassifier> FromFileDescriptor(
-      int fd, const UniLib* unilib = nullptr);
+      int fd, const UniLib* unilib = nullptr, bool verify_model = true,
+      const ModelExecutionOptions& execution_options = ModelExecutionOptions());
   static std::unique_ptr<TextClassifier> FromPath(
-      const std::string& path, const UniLib* unilib = nullptr);
+      const std::string& path, const UniLib* unilib = nullptr,
+      bool verify_model = true,
+      const ModelExecutionOptions& execution_options = ModelExecutionOptions());
 
   // Returns true if the model is ready for use.
   bool IsInitialized() { return initialized_; }
 
+  // Asks the kernel to page in the parts of the model that the given modes
+  // (a ModeFlag bitmask) run on, i.e. the TFLite models and the embeddings, so
+  // that the first calls don't stall on page faults. If 'lock_in_memory' is
+  // true, also locks these parts in memory, which the process has to be
+  // allowed to. Returns false if any of that failed.
+  bool WarmUp(int modes = ModeFlag_ALL, bool lock_in_memory = false) const;
+
+  // Completes the lazy initialization before the process is forked, e.g. by a
+  // zygote, so that the forked processes share the compiled state instead of
+  // each building its own: compiles the lazily compiled patterns, memoizes the
+  // datetime rules of the given locale spec strings, and empties the pools of
+  // interpreters and matchers, which every process then fills for itself.
+  // The freeze is partial: the pools, their mutexes and the caches are still
+  // written by the calls after the fork, so the pages that hold them become
+  // private to each process, and nothing is moved into read-only memory.
+  // The result and token feature caches should only be enabled in the forked
+  // processes. Returns false if a pattern could not be compiled.
+  // NOTE: Must not be called concurrently with other calls.
+  bool Freeze(const std::vector<std::string>& locales = {});
+
+  // Returns estimates of the memory held by the components of the classifier.
+  // Lazily compiled patterns count once they're compiled, and interpreters
+  // only while they're idle in the pools.
+  // Thread-safe, but walks all the patterns, so it's not meant for hot paths.
+  MemoryStats GetMemoryStats() const;
+
   // Runs inference for given a context and current selection (i.e. index
   // of the first and one past last selected characters (utf8 codepoint
   // offsets)). Returns the indices (utf8 codepoint offsets) of the selection
@@ -135,6 +381,16 @@ class TextClassifier {
       const std::string& context, CodepointSpan click_indices,
       const SelectionOptions& options = SelectionOptions::Default()) const;
 
+  // Same as calling SuggestSelection() for each of the clicks in the same
+  // context, but the context is tokenized and run through the regular
+  // expressions and the datetime parser once. The clicks that are left the same
+  // tokens by the retokenization, e.g. whole-word clicks on one line, share the
+  // features of the tokens, and their chunks are scored in the same inference
+  // batches. The results do not go through the result cache.
+  std::vector<CodepointSpan> SuggestSelections(
+      const std::string& context, const std::vector<CodepointSpan>& clicks,
+      const SelectionOptions& options = SelectionOptions::Default()) const;
+
   // Classifies the selected text given the context string.
   // Returns an empty result if an error occurs.
   std::vector<ClassificationResult> ClassifyText(
@@ -148,6 +404,75 @@ class TextClassifier {
       const std::string& context,
       const AnnotationOptions& options = AnnotationOptions::Default()) const;
 
+  // Annotates each of the given input texts. The result on index i is the same
+  // as what Annotate() returns for contexts[i], but the TFLite interpreters are
+  // taken from the pools only once for all the documents, and the timeout and
+  // the cancellation apply to the whole call.
+  // The selection model runs once over the lines of all the documents:
+  // identical lines are processed only once, and without an executor the
+  // chunk candidates and the chunks to classify of all the lines share the
+  // inference batches. The features of all the lines are held at the same
+  // time for that. With an executor, the lines are processed in parallel
+  // instead. The regular expression and datetime annotators still run per
+  // document.
+  std::vector<std::vector<AnnotatedSpan>> AnnotateDocuments(
+      const std::vector<std::string>& contexts,
+      const AnnotationOptions& options = AnnotationOptions::Default()) const;
+
+  // Same as Annotate(), but reuses the selection model results kept in
+  // 'session' for the lines of the context that did not change since the
+  // previous call with the same session and locales, and updates the session
+  // with the results for this context. Meant for re-annotating text while it
+  // is being edited.
+  // The regular expression and datetime annotators always process the whole
+  // context, as their matches can span multiple lines.
+  std::vector<AnnotatedSpan> AnnotateIncrementally(
+      const std::string& context, AnnotationSession* session,
+      const AnnotationOptions& options = AnnotationOptions::Default()) const;
+
+  // Same as Annotate(), but only returns the annotations that intersect
+  // 'region_of_interest' (codepoint offsets into the context), e.g. the part of
+  // a long document that is visible on screen. Only the region and a margin of
+  // context around it, up to the nearest line breaks, are processed.
+  std::vector<AnnotatedSpan> AnnotateRegion(
+      const std::string& context, CodepointSpan region_of_interest,
+      const AnnotationOptions& options = AnnotationOptions::Default()) const;
+
+  // Sets the maximum number of SuggestSelection() and ClassifyText() results
+  // that are cached across calls, keyed by the context, the span and the
+  // options. Zero (the default) disables the cache. A ClassifyText() call on a
+  // selection that SuggestSelection() returned with the same locales also
+  // reuses the tokens of that call, if both feature processors tokenize the
+  // same way. The cache never changes the results. Resizing drops the cached
+  // entries.
+  // NOTE: Must not be called concurrently with other calls.
+  void SetResultCacheSize(int max_entries);
+
+  // Sets the maximum number of tokens whose features are cached across calls,
+  // separately for the selection and the classification model. Zero (the
+  // default) disables the caches. Resizing drops the cached entries.
+  // NOTE: Must not be called concurrently with other calls.
+  void SetTokenFeatureCacheSize(int max_entries);
+
+  // Records in 'profile' how many times each regular expression and datetime
+  // rule runs, how many matches it finds and the time spent in it, for finding
+  // the rules that dominate the cost of the calls. The rules are named there
+  // after their collections and patterns. Null (the default) disables the
+  // profiling. Not owned.
+  // NOTE: Must not be called concurrently with other calls.
+  void SetRuleProfile(RuleProfile* profile);
+
+  // Returns the names of all the collections that the results of the
+  // classifier can have, in a fixed order, so that callers can refer to them by
+  // their index.
+  const std::vector<std::string>& GetCollections() const {
+    return collections_;
+  }
+
+  // Returns the index of the collection in GetCollections(), or -1 if the
+  // classifier has no such collection.
+  int GetCollectionId(const std::string& collection) const;
+
   // Exposes the feature processor for tests and evaluations.
   const FeatureProcessor* SelectionFeatureProcessorForTests() const;
   const FeatureProcessor* ClassificationFeatureProcessorForTests() const;
@@ -162,16 +487,31 @@ class TextClassifier {
   static const std::string& kDateCollection;
 
  protected:
+  friend class StreamingAnnotator;
+
   struct ScoredChunk {
     TokenSpan token_span;
     float score;
   };
 
+  // A span of interest for ModelChunks(), with the features of the tokens
+  // around it.
+  struct ChunkInput {
+    // The number of tokens of the context that the features are of.
+    int num_tokens;
+    TokenSpan span_of_interest;
+    const CachedFeatures* cached_features;
+  };
+
   // Constructs and initializes text classifier from given model.
   // Takes ownership of 'mmap', and thus owns the buffer that backs 'model'.
   TextClassifier(std::unique_ptr<ScopedMmap>* mmap, const Model* model,
-                 const UniLib* unilib)
+                 const UniLib* unilib, bool verify_model = true,
+                 const ModelExecutionOptions& execution_options =
+                     ModelExecutionOptions())
       : model_(model),
+        verify_model_(verify_model),
+        execution_options_(execution_options),
         mmap_(std::move(*mmap)),
         owned_unilib_(nullptr),
         unilib_(internal::MaybeCreateUnilib(unilib, &owned_unilib_)) {
@@ -180,8 +520,13 @@ class TextClassifier {
 
   // Constructs, validates and initializes text classifier from given model.
   // Does not own the buffer that backs 'model'.
-  explicit TextClassifier(const Model* model, const UniLib* unilib)
+  explicit TextClassifier(const Model* model, const UniLib* unilib,
+                          bool verify_model = true,
+                          const ModelExecutionOptions& execution_options =
+                              ModelExecutionOptions())
       : model_(model),
+        verify_model_(verify_model),
+        execution_options_(execution_options),
         owned_unilib_(nullptr),
         unilib_(internal::MaybeCreateUnilib(unilib, &owned_unilib_)) {
     ValidateAndInitialize();
@@ -191,17 +536,108 @@ class TextClassifier {
   // datastructures.
   void ValidateAndInitialize();
 
-  // Initializes regular expressions for the regex model.
-  bool InitializeRegexModel(ZlibDecompressor* decompressor);
+  // The selection model candidates of one click of SuggestSelections(), which
+  // computes them for all of its clicks together.
+  struct ModelSelection {
+    bool failed = false;
+
+    // The tokens of the context after the retokenization for the click. They
+    // are shared by the clicks that the retokenization leaves the same tokens.
+    std::shared_ptr<const std::vector<Token>> tokens;
+
+    std::vector<AnnotatedSpan> candidates;
+  };
+
+  // The parts of the SuggestSelection() work that do not depend on the click.
+  // They are computed on first use, so that SuggestSelections() does them once
+  // for all its clicks.
+  struct SelectionContext {
+    // Tokens of the whole context, before they are restricted to the line of
+    // the click and retokenized around it. Only kept if 'keep_tokens' is set.
+    bool keep_tokens = false;
+    std::vector<Token> tokens;
+
+    // If not null, the selection model candidates of the click, which are then
+    // not computed again.
+    const ModelSelection* model_selection = nullptr;
+
+    // Candidates of the regular expressions and the datetime parser.
+    bool has_rule_candidates = false;
+    std::vector<AnnotatedSpan> rule_candidates;
+
+    // The classification model embeddings of the tokens of the context, for
+    // classifying the candidates.
+    FeatureProcessor::EmbeddingCache classification_embedding_cache;
+  };
+
+  // The implementations of SuggestSelection() and ClassifyText() without the
+  // result cache. SuggestSelectionInternal() returns the tokens of the whole
+  // context, before any retokenization, in 'context_tokens' if not null.
+  // ClassifyTextInternal() reuses 'cached_tokens' if not null, and returns no
+  // results once 'interruption' says to stop.
+  CodepointSpan SuggestSelectionInternal(
+      const std::string& context, CodepointSpan click_indices,
+      const SelectionOptions& options,
+      std::vector<Token>* context_tokens) const;
+
+  // SuggestSelectionInternal() for one click into a context that has already
+  // been checked to be valid, with the click-independent work kept in
+  // 'selection_context'.
+  CodepointSpan SuggestSelectionInContext(
+      const std::string& context, const UnicodeText& context_unicode,
+      CodepointSpan click_indices, const SelectionOptions& options,
+      InterpreterManager* interpreter_manager,
+      SelectionContext* selection_context, std::vector<Token>* tokens) const;
+
+  // Returns whether 'click_indices' are a valid click into the context, and
+  // in 'model_click_indices' the click that the selection model looks at.
+  bool SelectionModelClick(const UnicodeText& context_unicode,
+                           CodepointSpan click_indices,
+                           CodepointSpan* model_click_indices) const;
+  std::vector<ClassificationResult> ClassifyTextInternal(
+      const std::string& context, CodepointSpan selection_indices,
+      const ClassificationOptions& options,
+      const std::vector<Token>* cached_tokens,
+      const CallInterruption* interruption) const;
+
+  // Initializes regular expressions for the regex model. If 'executor' is set,
+  // the patterns are compiled in parallel on it.
+  bool InitializeRegexModel(ZlibDecompressor* decompressor, Executor* executor);
+
+  // Fills collections_ and collection_ids_ from the models.
+  void InitializeCollections();
+
+  // The results of ModelAnnotate() for one context.
+  struct ModelAnnotation {
+    std::vector<Token> tokens;
+    std::vector<AnnotatedSpan> candidates;
+  };
+
+  // Annotates given input text using interpreters from 'interpreter_manager'.
+  // If 'session' is not null, the selection model results kept in it are
+  // reused and updated. If 'model_annotation' is not null, it holds the
+  // results of ModelAnnotate() for the context, which are used instead of
+  // running the selection model again.
+  // Returns false if an error occurred.
+  bool AnnotateInternal(const std::string& context,
+                        const AnnotationOptions& options,
+                        InterpreterManager* interpreter_manager,
+                        AnnotationSession* session,
+                        ModelAnnotation* model_annotation,
+                        std::vector<AnnotatedSpan>* result) const;
 
   // Resolves conflicts in the list of candidates by removing some overlapping
-  // ones. Returns indices of the surviving ones.
+  // ones. Returns indices of the surviving ones. The candidates without a
+  // classification are classified with the classification model as needed,
+  // keeping the token embeddings in 'embedding_cache' if not null, which must
+  // only hold embeddings of the tokens of this context.
   // NOTE: Assumes that the candidates are sorted according to their position in
   // the span.
   bool ResolveConflicts(const std::vector<AnnotatedSpan>& candidates,
                         const std::string& context,
                         const std::vector<Token>& cached_tokens,
                         InterpreterManager* interpreter_manager,
+                        FeatureProcessor::EmbeddingCache* embedding_cache,
                         std::vector<int>* result) const;
 
   // Resolves one conflict between candidates on indices 'start_index'
@@ -212,30 +648,125 @@ class TextClassifier {
                        const std::vector<AnnotatedSpan>& candidates,
                        int start_index, int end_index,
                        InterpreterManager* interpreter_manager,
+                       FeatureProcessor::EmbeddingCache* embedding_cache,
                        std::vector<int>* chosen_indices) const;
 
   // Gets selection candidates from the ML model.
   // Provides the tokens produced during tokenization of the context string for
-  // reuse.
+  // reuse. The tokenization of the whole context is kept in 'selection_context'
+  // if it asks for it.
   bool ModelSuggestSelection(const UnicodeText& context_unicode,
                              CodepointSpan click_indices,
                              InterpreterManager* interpreter_manager,
+                             SelectionContext* selection_context,
                              std::vector<Token>* tokens,
                              std::vector<AnnotatedSpan>* result) const;
 
+  // ModelSuggestSelection() for all the 'clicks' into one context together,
+  // skipping the ones that are {kInvalidIndex, kInvalidIndex}. The context is
+  // tokenized once. The clicks that the retokenization leaves the same tokens
+  // share them and one CachedFeatures over all of their neighborhoods, and
+  // their chunks are scored in the same inference batches.
+  void ModelSuggestSelections(
+      const UnicodeText& context_unicode,
+      const std::vector<CodepointSpan>& clicks,
+      InterpreterManager* interpreter_manager,
+      FeatureProcessor::EmbeddingCache* embedding_cache,
+      std::vector<ModelSelection>* selections) const;
+
+  // Returns the span of the tokens around the token 'click_pos' that the
+  // selection model can select, and the span of the tokens that it needs the
+  // features of for that.
+  void SelectionModelSpans(int click_pos, int num_tokens,
+                           TokenSpan* symmetry_context_span,
+                           TokenSpan* extraction_span) const;
+
+  // Appends the non-empty codepoint spans of the selection model 'chunks' to
+  // 'result'.
+  void AddSelectionModelCandidates(const UnicodeTextIndex& context_index,
+                                   const std::vector<Token>& tokens,
+                                   const std::vector<TokenSpan>& chunks,
+                                   std::vector<AnnotatedSpan>* result) const;
+
   // Classifies the selected text given the context string with the
-  // classification model.
+  // classification model. 'cached_tokens' are the selection feature
+  // processor's tokens of the context; when both processors tokenize the same
+  // way they are used in place, otherwise the needed ones are copied.
+  // If 'max_results' is positive, only that many of the best results are
+  // computed, which is cheaper than scoring and sorting all the collections.
   // Returns true if no error occurred.
   bool ModelClassifyText(
       const std::string& context, const std::vector<Token>& cached_tokens,
       CodepointSpan selection_indices, InterpreterManager* interpreter_manager,
-      FeatureProcessor::EmbeddingCache* embedding_cache,
+      FeatureProcessor::EmbeddingCache* embedding_cache, int max_results,
       std::vector<ClassificationResult>* classification_results) const;
 
   bool ModelClassifyText(
       const std::string& context, CodepointSpan selection_indices,
       InterpreterManager* interpreter_manager,
+      FeatureProcessor::EmbeddingCache* embedding_cache, int max_results,
+      std::vector<ClassificationResult>* classification_results) const;
+
+  // Same as ModelClassifyText, but for many selections of the context, which
+  // are run through the classification model in batches of
+  // ClassificationModelOptions.batch_size.
+  bool ModelClassifyTexts(
+      const UnicodeText& context_unicode,
+      const std::vector<Token>& cached_tokens,
+      const std::vector<CodepointSpan>& selections,
+      InterpreterManager* interpreter_manager,
+      FeatureProcessor::EmbeddingCache* embedding_cache, int max_results,
+      std::vector<std::vector<ClassificationResult>>* classification_results)
+      const;
+
+  // A context to classify selections of with ModelClassifyTexts(), with the
+  // arguments of the single-context version.
+  struct ClassificationContext {
+    const UnicodeText* context_unicode;
+    const std::vector<Token>* cached_tokens;
+    FeatureProcessor::EmbeddingCache* embedding_cache;
+  };
+
+  // Same as above, but for selections of several contexts, given by the index
+  // of their context and their span. The selections of all the contexts share
+  // the batches.
+  bool ModelClassifyTexts(
+      const std::vector<ClassificationContext>& contexts,
+      const std::vector<std::pair<int, CodepointSpan>>& selections,
+      InterpreterManager* interpreter_manager, int max_results,
+      std::vector<std::vector<ClassificationResult>>* classification_results)
+      const;
+
+  // The classification model input for one selection.
+  struct ClassificationInput {
+    std::unique_ptr<CachedFeatures> cached_features;
+    TokenSpan selection_token_span;
+    int click_pos;
+  };
+
+  // Extracts the features of the selection for the classification model. If
+  // the result is known without running the model, sets
+  // 'classification_results' instead and leaves the features unset.
+  // Returns true if no error occurred.
+  bool PrepareClassificationInput(
+      const UnicodeText& context_unicode,
+      const std::vector<Token>& cached_tokens,
+      CodepointSpan selection_indices,
       FeatureProcessor::EmbeddingCache* embedding_cache,
+      const std::string& locales, LatencyStats* latency_stats,
+      ClassificationInput* input,
+      std::vector<ClassificationResult>* classification_results) const;
+
+  // Writes the classification model input features to 'output'.
+  void WriteClassificationFeatures(const ClassificationInput& input,
+                                   float* output) const;
+
+  // Turns the logits of the classification model for a selection into
+  // results sorted by score, and applies the sanity checks. If 'max_results'
+  // is positive, only that many of the best results are kept.
+  void ClassificationResultsFromLogits(
+      const UnicodeText& context_unicode, CodepointSpan selection_indices,
+      const ClassificationInput& input, const float* logits, int max_results,
       std::vector<ClassificationResult>* classification_results) const;
 
   // Returns a relative token span that represents how many tokens on the left
@@ -243,10 +774,12 @@ class TextClassifier {
   // classifier input.
   TokenSpan ClassifyTextUpperBoundNeededTokens() const;
 
-  // Classifies the selected text with the regular expressions models.
+  // Classifies the selected text with the regular expressions models, skipping
+  // the ones whose collection is not in 'entity_types', unless that is empty.
   // Returns true if any regular expression matched and the result was set.
   bool RegexClassifyText(const std::string& context,
                          CodepointSpan selection_indices,
+                         const std::unordered_set<std::string>& entity_types,
                          ClassificationResult* classification_result) const;
 
   // Classifies the selected text with the date time model.
@@ -256,16 +789,32 @@ class TextClassifier {
                             const ClassificationOptions& options,
                             ClassificationResult* classification_result) const;
 
-  // Chunks given input text with the selection model and classifies the spans
-  // with the classification model.
-  // The annotations are sorted by their position in the context string and
-  // exclude spans classified as 'other'.
-  // Provides the tokens produced during tokenization of the context string for
-  // reuse.
-  bool ModelAnnotate(const std::string& context,
+  // Chunks given input texts with the selection model and classifies the
+  // spans with the classification model. The contexts must be valid UTF8.
+  // The candidates of result i are sorted by their position in contexts[i] and
+  // exclude spans classified as 'other'. The result also provides the tokens
+  // produced during tokenization of the context string for reuse.
+  // If 'session' is not null, lines with results in it are not run through the
+  // model again, and the session is left with the results for these contexts.
+  // If 'executor' is not null, the lines are processed in parallel on it. If
+  // there is only one line to process and 'parallel_feature_extraction' is
+  // true, its token features are extracted in parallel on it instead.
+  bool ModelAnnotate(const std::vector<StringPiece>& contexts,
                      InterpreterManager* interpreter_manager,
-                     std::vector<Token>* tokens,
-                     std::vector<AnnotatedSpan>* result) const;
+                     AnnotationSession* session, Executor* executor,
+                     bool parallel_feature_extraction,
+                     std::vector<ModelAnnotation>* results) const;
+
+  // Runs the selection and classification models on the given lines, with the
+  // chunk candidates and the chunks to classify of all of them in the same
+  // inference batches. The lines point into the contexts, without a copy of
+  // their own. The tokens and candidate spans of results[i] are relative to
+  // lines[i]. If 'feature_executor' is not null, the token features are
+  // extracted in parallel on it.
+  bool ModelAnnotateLines(
+      const std::vector<StringPiece>& lines,
+      InterpreterManager* interpreter_manager, Executor* feature_executor,
+      const std::vector<AnnotationSession::LineResult*>& results) const;
 
   // Groups the tokens into chunks. A chunk is a token span that should be the
   // suggested selection when any of its contained tokens is clicked. The chunks
@@ -276,40 +825,103 @@ class TextClassifier {
   // The resulting chunks all have to overlap with it and they cover this span
   // completely. The first and last chunk might extend beyond it.
   // The chunks vector is cleared before filling.
+  // The scoring is stopped between the inference batches if 'interruption' is
+  // not null and says to stop, and the chunks are then incomplete.
   bool ModelChunk(int num_tokens, const TokenSpan& span_of_interest,
                   tflite::Interpreter* selection_interpreter,
                   const CachedFeatures& cached_features,
+                  const CallInterruption* interruption,
                   std::vector<TokenSpan>* chunks) const;
 
-  // A helper method for ModelChunk(). It generates scored chunk candidates for
-  // a click context model.
+  // ModelChunk() for several spans of interest, each with the features of its
+  // own tokens, e.g. the neighborhoods of several clicks or the lines of
+  // several documents. Their candidate chunks are scored in the same inference
+  // batches, and the ones that inputs over the same features share only once.
+  // Returns the chunks of each input in 'chunks'.
+  bool ModelChunks(const std::vector<ChunkInput>& inputs,
+                   tflite::Interpreter* selection_interpreter,
+                   const CallInterruption* interruption,
+                   std::vector<std::vector<TokenSpan>>* chunks) const;
+
+  // Returns for each of the inputs the index of the first input with the same
+  // features, which identifies the features in the candidates of the inputs.
+  static std::vector<int> ChunkFeatureIds(
+      const std::vector<ChunkInput>& inputs);
+
+  // A helper method for ModelChunks(). It generates scored chunk candidates
+  // of every input for a click context model.
   // NOTE: The returned chunks can (and most likely do) overlap.
   bool ModelClickContextScoreChunks(
-      int num_tokens, const TokenSpan& span_of_interest,
-      const CachedFeatures& cached_features,
+      const std::vector<ChunkInput>& inputs,
       tflite::Interpreter* selection_interpreter,
-      std::vector<ScoredChunk>* scored_chunks) const;
+      const CallInterruption* interruption,
+      std::vector<std::vector<ScoredChunk>>* scored_chunks) const;
 
-  // A helper method for ModelChunk(). It generates scored chunk candidates for
-  // a bounds-sensitive model.
+  // A helper method for ModelChunks(). It generates scored chunk candidates
+  // of every input for a bounds-sensitive model.
   // NOTE: The returned chunks can (and most likely do) overlap.
   bool ModelBoundsSensitiveScoreChunks(
-      int num_tokens, const TokenSpan& span_of_interest,
-      const TokenSpan& inference_span, const CachedFeatures& cached_features,
+      const std::vector<ChunkInput>& inputs,
+      const std::vector<TokenSpan>& inference_spans,
+      tflite::Interpreter* selection_interpreter,
+      const CallInterruption* interruption,
+      std::vector<std::vector<ScoredChunk>>* scored_chunks) const;
+
+  // The pruned search of ModelBoundsSensitiveScoreChunks(), enabled by
+  // SelectionModelOptions.pruned_bounds_sensitive_search. The candidates of
+  // each start token are grown one token at a time until they keep scoring
+  // low. Appends to 'scored_chunks'.
+  bool ModelBoundsSensitivePrunedScoreChunks(
+      const std::vector<ChunkInput>& inputs,
+      const std::vector<int>& feature_ids,
+      const std::vector<TokenSpan>& inference_spans, int max_chunk_length,
+      bool score_single_token_spans_as_zero,
+      tflite::Interpreter* selection_interpreter,
+      const CallInterruption* interruption,
+      std::vector<std::vector<ScoredChunk>>* scored_chunks) const;
+
+  // Scores the candidate spans of every input with
+  // ModelBoundsSensitiveScoreSpans(), the ones that inputs over the same
+  // features share only once, and appends them to 'scored_chunks' of their
+  // input.
+  bool ModelBoundsSensitiveScoreSharedSpans(
+      const std::vector<ChunkInput>& inputs,
+      const std::vector<int>& feature_ids,
+      const std::vector<std::vector<TokenSpan>>& candidate_spans,
+      tflite::Interpreter* selection_interpreter,
+      const CallInterruption* interruption,
+      std::vector<std::vector<ScoredChunk>>* scored_chunks) const;
+
+  // Scores the candidates, the feature ids of their inputs and their token
+  // spans, with the bounds-sensitive model in batches and appends the scores
+  // to 'scores'.
+  bool ModelBoundsSensitiveScoreSpans(
+      const std::vector<ChunkInput>& inputs,
+      const std::vector<std::pair<int, TokenSpan>>& candidates,
       tflite::Interpreter* selection_interpreter,
-      std::vector<ScoredChunk>* scored_chunks) const;
+      const CallInterruption* interruption, std::vector<float>* scores) const;
 
   // Produces chunks isolated by a set of regular expressions.
   bool RegexChunk(const UnicodeText& context_unicode,
                   const std::vector<int>& rules,
                   std::vector<AnnotatedSpan>* result) const;
 
-  // Produces chunks from the datetime parser.
+  // Produces chunks from the datetime parser. The datetimes are not resolved
+  // to absolute time, which is left to InterpretDatetimes() for the chunks
+  // that are kept; if 'parsed_datetimes' is not null, the parsed datetimes of
+  // the chunks are appended to it for that. The rules are not run past the
+  // point where 'interruption', if not null, says to stop.
   bool DatetimeChunk(const UnicodeText& context_unicode,
-                     int64 reference_time_ms_utc,
-                     const std::string& reference_timezone,
                      const std::string& locales, ModeFlag mode,
-                     std::vector<AnnotatedSpan>* result) const;
+                     const CallInterruption* interruption,
+                     std::vector<AnnotatedSpan>* result,
+                     std::vector<ParsedDatetimeSpan>* parsed_datetimes) const;
+
+  // Resolves the datetimes of the annotations that come from DatetimeChunk()
+  // to absolute time, using the parsed datetimes it produced.
+  bool InterpretDatetimes(std::vector<ParsedDatetimeSpan>* parsed_datetimes,
+                          const AnnotationOptions& options,
+                          std::vector<AnnotatedSpan>* annotations) const;
 
   // Returns whether a classification should be filtered.
   bool FilteredForAnnotation(const AnnotatedSpan& span) const;
@@ -317,26 +929,45 @@ class TextClassifier {
       const ClassificationResult& classification) const;
   bool FilteredForSelection(const AnnotatedSpan& span) const;
 
+  // Returns whether the classification model has any of the collections in
+  // 'entity_types', or whether that is empty, i.e. does not restrict them.
+  bool ModelProducesAnyOf(
+      const std::unordered_set<std::string>& entity_types) const;
+
   const Model* model_;
 
+  // Whether the flatbuffers in the model still have to be verified.
+  bool verify_model_;
+
+  const ModelExecutionOptions execution_options_;
+
   std::unique_ptr<const ModelExecutor> selection_executor_;
   std::unique_ptr<const ModelExecutor> classification_executor_;
+  // Runs the classification inferences if they are batched across calls, or
+  // nullptr.
+  std::unique_ptr<const DynamicBatcher> classification_batcher_;
   std::unique_ptr<const EmbeddingExecutor> embedding_executor_;
 
   std::unique_ptr<const FeatureProcessor> selection_feature_processor_;
   std::unique_ptr<const FeatureProcessor> classification_feature_processor_;
 
-  std::unique_ptr<const DatetimeParser> datetime_parser_;
+  // Not const, to be frozen by Freeze().
+  std::unique_ptr<DatetimeParser> datetime_parser_;
 
  private:
   struct CompiledRegexPattern {
     std::string collection_name;
     float target_classification_score;
     float priority_score;
-    std::unique_ptr<UniLib::RegexPattern> pattern;
+    std::unique_ptr<LazyRegexPattern> pattern;
   };
 
   std::unique_ptr<ScopedMmap> mmap_;
+  // Number of codepoints of context that AnnotateRegion() processes on either
+  // side of the region. Covers the token context of the selection model and
+  // the longest regular expression and datetime matches of the models.
+  static constexpr int kRegionOfInterestMargin = 256;
+
   bool initialized_ = false;
   bool enabled_for_annotation_ = false;
   bool enabled_for_classification_ = false;
@@ -348,6 +979,24 @@ class TextClassifier {
   std::vector<CompiledRegexPattern> regex_patterns_;
   std::unordered_set<int> regex_approximate_match_pattern_ids_;
 
+  // The collections of GetCollections(), and their indices by name.
+  std::vector<std::string> collections_;
+  std::unordered_map<std::string, int> collection_ids_;
+
+  // Receives the runs of the rules, if enabled with SetRuleProfile().
+  RuleProfile* rule_profile_ = nullptr;
+
+  // Results of previous calls, if enabled with SetResultCacheSize().
+  mutable ResultCache result_cache_;
+
+  // Tells which of regex_patterns_ can match a text, so that the others do not
+  // have to be run.
+  RegexPrefilter regex_prefilter_;
+
+  // Whether the selection and classification feature processors tokenize the
+  // same way, so that the tokens of one can be used by the other in place.
+  bool share_tokens_between_processors_ = false;
+
   // Indices into regex_patterns_ for the different modes.
   std::vector<int> annotation_regex_patterns_, classification_regex_patterns_,
       selection_regex_patterns_;
@@ -371,11 +1020,23 @@ CodepointSpan SnapLeftIfWhitespaceSelection(CodepointSpan span,
 std::vector<Token> CopyCachedTokens(const std::vector<Token>& cached_tokens,
                                     CodepointSpan selection_indices,
                                     TokenSpan tokens_around_selection_to_copy);
+
+// Returns true if the two feature processor options tokenize any text into the
+// same tokens.
+bool HaveSameTokenization(const FeatureProcessorOptions* a,
+                          const FeatureProcessorOptions* b);
+
+// Returns true if no token of 'tokens' straddles a boundary of 'span'.
+bool SpanAlignsWithTokens(const std::vector<Token>& tokens, CodepointSpan span);
 }  // namespace internal
 
 // Interprets the buffer as a Model flatbuffer and returns it for reading.
 const Model* ViewModel(const void* buffer, int size);
 
+// Same as above, but only verifies the model metadata, i.e. the root table and
+// its name, version and locales fields. No other field may be accessed.
+const Model* ViewModelMetadata(const void* buffer, int size);
+
 }  // namespace libtextclassifier2
 
 #endif  // LIBTEXTCLASSIFIER_TEXT_CLASSIFIER_H_
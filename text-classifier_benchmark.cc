@@ -0,0 +1,584 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Microbenchmarks for the stages of the TextClassifier pipeline and for the
+// end-to-end calls. They run on the model given with --model_path, by default
+// the English model of the system image, e.g. with the command line:
+//   libtextclassifier_benchmarks
+//       --model_path=/system/etc/textclassifier/textclassifier.en.model
+//
+// The *Threads benchmarks call one shared classifier from a growing number of
+// threads, on the texts of --corpus_path (one per line) if given. Besides the
+// total throughput (items_per_second), they report the p50 and p99 latencies
+// of the calls and the operator new calls per call, averaged over the threads.
+//
+// The BM_LoadModel benchmarks load each model of --models_dir, by default the
+// directory of the system image models, and then print where the first load
+// of each model spent its time.
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "datetime/parser.h"
+#include "feature-processor.h"
+#include "initialization-stats.h"
+#include "model_generated.h"
+#include "text-classifier-handle.h"
+#include "text-classifier.h"
+#include "token-feature-extractor.h"
+#include "util/base/logging.h"
+#include "util/math/softmax.h"
+#include "util/memory/mmap.h"
+#include "util/utf8/unicodetext.h"
+#include "util/utf8/unilib.h"
+
+namespace {
+
+// Counts the allocations of the calls. It is per thread, so that counting
+// does not add contention between the threads.
+thread_local libtextclassifier2::int64 num_allocations_on_thread = 0;
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+  ++num_allocations_on_thread;
+  void* ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+namespace libtextclassifier2 {
+namespace {
+
+const char kModelPathFlag[] = "--model_path=";
+const char kCorpusPathFlag[] = "--corpus_path=";
+const char kModelsDirFlag[] = "--models_dir=";
+
+std::string* model_path = new std::string(
+    "/system/etc/textclassifier/textclassifier.en.model");
+std::string* corpus_path = new std::string();
+std::string* models_dir = new std::string("/system/etc/textclassifier");
+
+// A short message, and a longer one with a mix of entities, like the texts
+// that the classifier gets from messaging and email apps.
+const char kShortText[] = "Call me at (800) 123-456 today, or at 9pm.";
+const CodepointSpan kShortTextClick = {17, 20};
+
+const char kLongText[] =
+    "Hi Jane,\n"
+    "\n"
+    "thanks for the quick reply! As discussed, let's meet at the office on\n"
+    "Tuesday, March 13th at 10:30am. The address is 350 Third Street,\n"
+    "Cambridge, MA 02142. If anything comes up, give me a call at\n"
+    "+1 (617) 555-0134 or drop me a line at john.doe@example.com.\n"
+    "\n"
+    "The slides from last week are at https://www.example.com/slides and the\n"
+    "notes are attached. My flight is LX 38, landing at 8:15 tomorrow.\n"
+    "\n"
+    "See you next week,\n"
+    "John\n";
+const CodepointSpan kLongTextClick = {215, 218};
+
+class BenchmarkingTextClassifier : public TextClassifier {
+ public:
+  BenchmarkingTextClassifier(std::unique_ptr<ScopedMmap>* mmap,
+                             const UniLib* unilib)
+      : TextClassifier(mmap,
+                       ViewModel((*mmap)->handle().start(),
+                                 (*mmap)->handle().num_bytes()),
+                       unilib) {}
+
+  using TextClassifier::DatetimeChunk;
+  using TextClassifier::RegexChunk;
+
+  const FeatureProcessor* selection_feature_processor() const {
+    return selection_feature_processor_.get();
+  }
+
+  const EmbeddingExecutor* embedding_executor() const {
+    return embedding_executor_.get();
+  }
+
+  const DatetimeParser* datetime_parser() const {
+    return datetime_parser_.get();
+  }
+
+  // The ids of the regex patterns that run for annotation.
+  std::vector<int> AnnotationRegexPatterns() const {
+    std::vector<int> patterns;
+    if (model_->regex_model() == nullptr ||
+        model_->regex_model()->patterns() == nullptr) {
+      return patterns;
+    }
+    for (int i = 0; i < model_->regex_model()->patterns()->size(); ++i) {
+      if (model_->regex_model()->patterns()->Get(i)->enabled_modes() &
+          ModeFlag_ANNOTATION) {
+        patterns.push_back(i);
+      }
+    }
+    return patterns;
+  }
+};
+
+const UniLib& GetUniLib() {
+  static const UniLib* unilib = new UniLib();
+  return *unilib;
+}
+
+// Loaded once and shared by all the benchmarks, so that they only measure
+// the inference.
+BenchmarkingTextClassifier* GetClassifier() {
+  static BenchmarkingTextClassifier* classifier = []() {
+    std::unique_ptr<ScopedMmap> mmap(new ScopedMmap(*model_path));
+    if (!mmap->handle().ok()) {
+      TC_LOG(FATAL) << "Couldn't map the model: " << *model_path;
+    }
+    BenchmarkingTextClassifier* classifier =
+        new BenchmarkingTextClassifier(&mmap, &GetUniLib());
+    if (!classifier->IsInitialized()) {
+      TC_LOG(FATAL) << "Couldn't load the model: " << *model_path;
+    }
+    return classifier;
+  }();
+  return classifier;
+}
+
+std::string TextForArg(int arg) { return arg == 0 ? kShortText : kLongText; }
+
+CodepointSpan ClickForArg(int arg) {
+  return arg == 0 ? kShortTextClick : kLongTextClick;
+}
+
+// The benchmarks run once on kShortText (argument 0) and once on kLongText
+// (argument 1).
+#define TC_TEXT_BENCHMARK(name) BENCHMARK(name)->Arg(0)->Arg(1)
+
+void BM_Tokenize(benchmark::State& state) {
+  const FeatureProcessor* processor =
+      GetClassifier()->selection_feature_processor();
+  const UnicodeText text = UTF8ToUnicodeText(TextForArg(state.range(0)));
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(processor->Tokenize(text));
+  }
+}
+TC_TEXT_BENCHMARK(BM_Tokenize);
+
+void BM_ExtractTokenFeatures(benchmark::State& state) {
+  const FeatureProcessor* processor =
+      GetClassifier()->selection_feature_processor();
+  const TokenFeatureExtractor extractor(
+      internal::BuildTokenFeatureExtractorOptions(processor->GetOptions()),
+      GetUniLib());
+  const std::vector<Token> tokens =
+      processor->Tokenize(TextForArg(state.range(0)));
+  std::vector<int> sparse_features;
+  std::vector<float> dense_features;
+  while (state.KeepRunning()) {
+    for (const Token& token : tokens) {
+      sparse_features.clear();
+      dense_features.clear();
+      extractor.Extract(token, /*is_in_span=*/false, &sparse_features,
+                        &dense_features);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * tokens.size());
+}
+TC_TEXT_BENCHMARK(BM_ExtractTokenFeatures);
+
+void BM_AddEmbedding(benchmark::State& state) {
+  BenchmarkingTextClassifier* classifier = GetClassifier();
+  const FeatureProcessor* processor = classifier->selection_feature_processor();
+  const TokenFeatureExtractor extractor(
+      internal::BuildTokenFeatureExtractorOptions(processor->GetOptions()),
+      GetUniLib());
+  std::vector<std::vector<int>> token_sparse_features;
+  for (const Token& token : processor->Tokenize(TextForArg(state.range(0)))) {
+    token_sparse_features.push_back(
+        extractor.ExtractCharactergramFeatures(token));
+  }
+  std::vector<float> embedding(processor->EmbeddingSize());
+  while (state.KeepRunning()) {
+    for (const std::vector<int>& sparse_features : token_sparse_features) {
+      classifier->embedding_executor()->AddEmbedding(
+          TensorView<int>(sparse_features.data(),
+                          {static_cast<int>(sparse_features.size())}),
+          embedding.data(), embedding.size());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * token_sparse_features.size());
+}
+TC_TEXT_BENCHMARK(BM_AddEmbedding);
+
+void BM_ExtractFeatures(benchmark::State& state) {
+  BenchmarkingTextClassifier* classifier = GetClassifier();
+  const FeatureProcessor* processor = classifier->selection_feature_processor();
+  const std::vector<Token> tokens =
+      processor->Tokenize(TextForArg(state.range(0)));
+  const int feature_vector_size =
+      processor->EmbeddingSize() + processor->DenseFeaturesCount();
+  while (state.KeepRunning()) {
+    std::unique_ptr<CachedFeatures> cached_features;
+    processor->ExtractFeatures(
+        tokens, {0, static_cast<int>(tokens.size())},
+        /*selection_span_for_feature=*/{kInvalidIndex, kInvalidIndex},
+        classifier->embedding_executor(), /*embedding_cache=*/nullptr,
+        feature_vector_size, &cached_features);
+    std::vector<float> features;
+    for (int i = 0; i < tokens.size(); ++i) {
+      features.clear();
+      cached_features->AppendClickContextFeaturesForClick(i, &features);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * tokens.size());
+}
+TC_TEXT_BENCHMARK(BM_ExtractFeatures);
+
+void BM_ComputeSoftmax(benchmark::State& state) {
+  std::vector<float> scores(state.range(0));
+  for (int i = 0; i < scores.size(); ++i) {
+    scores[i] = (i % 17) * 0.25f - 2.0f;
+  }
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(ComputeSoftmax(scores));
+  }
+}
+BENCHMARK(BM_ComputeSoftmax)->Arg(16)->Arg(256);
+
+void BM_ComputeSoftmaxInPlace(benchmark::State& state) {
+  std::vector<float> scores(state.range(0));
+  for (int i = 0; i < scores.size(); ++i) {
+    scores[i] = (i % 17) * 0.25f - 2.0f;
+  }
+  std::vector<float> softmax(scores.size());
+  while (state.KeepRunning()) {
+    ComputeSoftmax(scores.data(), scores.size(), softmax.data());
+    benchmark::DoNotOptimize(softmax.data());
+  }
+}
+BENCHMARK(BM_ComputeSoftmaxInPlace)->Arg(16)->Arg(256);
+
+void BM_ComputeSoftmaxTopK(benchmark::State& state) {
+  std::vector<float> scores(state.range(0));
+  for (int i = 0; i < scores.size(); ++i) {
+    scores[i] = (i % 17) * 0.25f - 2.0f;
+  }
+  std::vector<std::pair<int, float>> top;
+  while (state.KeepRunning()) {
+    ComputeSoftmaxTopK(scores.data(), scores.size(), /*k=*/1, &top);
+    benchmark::DoNotOptimize(top.data());
+  }
+}
+BENCHMARK(BM_ComputeSoftmaxTopK)->Arg(16)->Arg(256);
+
+void BM_RegexChunk(benchmark::State& state) {
+  BenchmarkingTextClassifier* classifier = GetClassifier();
+  const std::vector<int> rules = classifier->AnnotationRegexPatterns();
+  const UnicodeText text = UTF8ToUnicodeText(TextForArg(state.range(0)));
+  std::vector<AnnotatedSpan> result;
+  while (state.KeepRunning()) {
+    result.clear();
+    classifier->RegexChunk(text, rules, &result);
+  }
+}
+TC_TEXT_BENCHMARK(BM_RegexChunk);
+
+void BM_DatetimeParse(benchmark::State& state) {
+  const DatetimeParser* parser = GetClassifier()->datetime_parser();
+  if (parser == nullptr) {
+    state.SkipWithError("The model has no datetime model.");
+    return;
+  }
+  const UnicodeText text = UTF8ToUnicodeText(TextForArg(state.range(0)));
+  std::vector<DatetimeParseResultSpan> results;
+  while (state.KeepRunning()) {
+    results.clear();
+    parser->Parse(text, /*reference_time_ms_utc=*/0,
+                  /*reference_timezone=*/"Europe/Zurich", /*locales=*/"en-US",
+                  ModeFlag_ANNOTATION, /*anchor_start_end=*/false, &results);
+  }
+}
+TC_TEXT_BENCHMARK(BM_DatetimeParse);
+
+void BM_SuggestSelection(benchmark::State& state) {
+  BenchmarkingTextClassifier* classifier = GetClassifier();
+  const std::string text = TextForArg(state.range(0));
+  const CodepointSpan click = ClickForArg(state.range(0));
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(classifier->SuggestSelection(text, click));
+  }
+}
+TC_TEXT_BENCHMARK(BM_SuggestSelection);
+
+void BM_ClassifyText(benchmark::State& state) {
+  BenchmarkingTextClassifier* classifier = GetClassifier();
+  const std::string text = TextForArg(state.range(0));
+  const CodepointSpan selection =
+      classifier->SuggestSelection(text, ClickForArg(state.range(0)));
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(classifier->ClassifyText(text, selection));
+  }
+}
+TC_TEXT_BENCHMARK(BM_ClassifyText);
+
+void BM_Annotate(benchmark::State& state) {
+  BenchmarkingTextClassifier* classifier = GetClassifier();
+  const std::string text = TextForArg(state.range(0));
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(classifier->Annotate(text));
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+TC_TEXT_BENCHMARK(BM_Annotate);
+
+// The texts that the *Threads benchmarks cycle through, with a click into
+// each and the selection that the classifier suggests for it.
+struct Corpus {
+  std::vector<std::string> texts;
+  std::vector<CodepointSpan> clicks;
+  std::vector<CodepointSpan> selections;
+};
+
+const Corpus& GetCorpus() {
+  static const Corpus* corpus = []() {
+    Corpus* corpus = new Corpus();
+    if (corpus_path->empty()) {
+      corpus->texts = {kShortText, kLongText};
+      corpus->clicks = {kShortTextClick, kLongTextClick};
+    } else {
+      std::ifstream corpus_stream(*corpus_path);
+      std::string line;
+      while (std::getline(corpus_stream, line)) {
+        const int num_codepoints =
+            UTF8ToUnicodeText(line, /*do_copy=*/false).size_codepoints();
+        if (num_codepoints == 0) {
+          continue;
+        }
+        // The middle of the line, as the texts come with no clicks.
+        corpus->texts.push_back(line);
+        corpus->clicks.push_back({num_codepoints / 2, num_codepoints / 2 + 1});
+      }
+      if (corpus->texts.empty()) {
+        TC_LOG(FATAL) << "Couldn't read the corpus: " << *corpus_path;
+      }
+    }
+    for (int i = 0; i < corpus->texts.size(); ++i) {
+      corpus->selections.push_back(
+          GetClassifier()->SuggestSelection(corpus->texts[i],
+                                            corpus->clicks[i]));
+    }
+    return corpus;
+  }();
+  return *corpus;
+}
+
+// Runs call(corpus, i) over the corpus, starting at a different text on every
+// thread, and reports the latencies and allocations of the calls.
+template <typename Call>
+void RunOnCorpus(benchmark::State& state, const Call& call) {
+  const Corpus& corpus = GetCorpus();
+  std::vector<int64> latencies_ns;
+  int64 num_allocations = 0;
+  int index = state.thread_index % corpus.texts.size();
+  while (state.KeepRunning()) {
+    const int64 allocations_before = num_allocations_on_thread;
+    const auto start = std::chrono::steady_clock::now();
+    call(corpus, index);
+    const auto end = std::chrono::steady_clock::now();
+    num_allocations += num_allocations_on_thread - allocations_before;
+    latencies_ns.push_back(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+            .count());
+    index = (index + 1) % corpus.texts.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (latencies_ns.empty()) {
+    return;
+  }
+
+  std::sort(latencies_ns.begin(), latencies_ns.end());
+  const int num_calls = latencies_ns.size();
+  state.counters["p50_us"] =
+      benchmark::Counter(latencies_ns[num_calls * 50 / 100] / 1000.0,
+                         benchmark::Counter::kAvgThreads);
+  state.counters["p99_us"] =
+      benchmark::Counter(latencies_ns[num_calls * 99 / 100] / 1000.0,
+                         benchmark::Counter::kAvgThreads);
+  state.counters["allocs_per_call"] =
+      benchmark::Counter(static_cast<double>(num_allocations) / num_calls,
+                         benchmark::Counter::kAvgThreads);
+}
+
+// Real time, so that items_per_second is the throughput of all the threads.
+#define TC_THREADS_BENCHMARK(name) \
+  BENCHMARK(name)->ThreadRange(1, 16)->UseRealTime()
+
+void BM_SuggestSelectionThreads(benchmark::State& state) {
+  const BenchmarkingTextClassifier* classifier = GetClassifier();
+  RunOnCorpus(state, [classifier](const Corpus& corpus, int i) {
+    benchmark::DoNotOptimize(
+        classifier->SuggestSelection(corpus.texts[i], corpus.clicks[i]));
+  });
+}
+TC_THREADS_BENCHMARK(BM_SuggestSelectionThreads);
+
+void BM_ClassifyTextThreads(benchmark::State& state) {
+  const BenchmarkingTextClassifier* classifier = GetClassifier();
+  RunOnCorpus(state, [classifier](const Corpus& corpus, int i) {
+    benchmark::DoNotOptimize(
+        classifier->ClassifyText(corpus.texts[i], corpus.selections[i]));
+  });
+}
+TC_THREADS_BENCHMARK(BM_ClassifyTextThreads);
+
+void BM_AnnotateThreads(benchmark::State& state) {
+  const BenchmarkingTextClassifier* classifier = GetClassifier();
+  RunOnCorpus(state, [classifier](const Corpus& corpus, int i) {
+    benchmark::DoNotOptimize(classifier->Annotate(corpus.texts[i]));
+  });
+}
+TC_THREADS_BENCHMARK(BM_AnnotateThreads);
+
+// The shared classifier, not owned by the shared pointer.
+std::shared_ptr<const TextClassifier> GetSharedClassifier() {
+  return std::shared_ptr<const TextClassifier>(
+      GetClassifier(), [](const TextClassifier* classifier) {});
+}
+
+// Takes the current classifier of a handle from every thread, to compare
+// TextClassifierHandle::Get() with std::atomic_load() of a shared pointer,
+// which the standard libraries implement with a pool of mutexes.
+void BM_HandleGetThreads(benchmark::State& state) {
+  static TextClassifierHandle* handle =
+      new TextClassifierHandle(GetSharedClassifier());
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(handle->Get());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+TC_THREADS_BENCHMARK(BM_HandleGetThreads);
+
+void BM_AtomicLoadSharedPtrThreads(benchmark::State& state) {
+  static std::shared_ptr<const TextClassifier>* classifier =
+      new std::shared_ptr<const TextClassifier>(GetSharedClassifier());
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(std::atomic_load(classifier));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+TC_THREADS_BENCHMARK(BM_AtomicLoadSharedPtrThreads);
+
+// The load reports by model path, of the first load of each model.
+std::map<std::string, InitializationStats>* load_reports =
+    new std::map<std::string, InitializationStats>();
+
+void BM_LoadModel(benchmark::State& state, const std::string& path) {
+  InitializationStats* stats = nullptr;
+  if (load_reports->find(path) == load_reports->end()) {
+    stats = &(*load_reports)[path];
+  }
+  while (state.KeepRunning()) {
+    ModelExecutionOptions execution_options;
+    execution_options.initialization_stats = stats;
+    std::unique_ptr<TextClassifier> classifier = TextClassifier::FromPath(
+        path, &GetUniLib(), /*verify_model=*/true, execution_options);
+    if (!classifier) {
+      state.SkipWithError("Couldn't load the model.");
+      return;
+    }
+    stats = nullptr;
+  }
+}
+
+// Registers BM_LoadModel for each *.model file of --models_dir.
+void RegisterLoadModelBenchmarks() {
+  DIR* dir = opendir(models_dir->c_str());
+  if (dir == nullptr) {
+    TC_LOG(ERROR) << "Couldn't list the models in: " << *models_dir;
+    return;
+  }
+  const std::string kModelSuffix = ".model";
+  std::vector<std::string> model_names;
+  while (const dirent* entry = readdir(dir)) {
+    const std::string name = entry->d_name;
+    if (name.size() > kModelSuffix.size() &&
+        name.compare(name.size() - kModelSuffix.size(), kModelSuffix.size(),
+                     kModelSuffix) == 0) {
+      model_names.push_back(name);
+    }
+  }
+  closedir(dir);
+
+  std::sort(model_names.begin(), model_names.end());
+  for (const std::string& name : model_names) {
+    const std::string path = *models_dir + "/" + name;
+    benchmark::RegisterBenchmark(
+        ("BM_LoadModel/" + name).c_str(),
+        [path](benchmark::State& state) { BM_LoadModel(state, path); })
+        ->Unit(benchmark::kMillisecond);
+  }
+}
+
+void PrintLoadReports() {
+  for (const auto& path_and_stats : *load_reports) {
+    std::printf("\n%s\n%s", path_and_stats.first.c_str(),
+                path_and_stats.second.ToString().c_str());
+  }
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg.compare(0, sizeof(libtextclassifier2::kModelPathFlag) - 1,
+                    libtextclassifier2::kModelPathFlag) == 0) {
+      *libtextclassifier2::model_path =
+          arg.substr(sizeof(libtextclassifier2::kModelPathFlag) - 1);
+    }
+    if (arg.compare(0, sizeof(libtextclassifier2::kCorpusPathFlag) - 1,
+                    libtextclassifier2::kCorpusPathFlag) == 0) {
+      *libtextclassifier2::corpus_path =
+          arg.substr(sizeof(libtextclassifier2::kCorpusPathFlag) - 1);
+    }
+    if (arg.compare(0, sizeof(libtextclassifier2::kModelsDirFlag) - 1,
+                    libtextclassifier2::kModelsDirFlag) == 0) {
+      *libtextclassifier2::models_dir =
+          arg.substr(sizeof(libtextclassifier2::kModelsDirFlag) - 1);
+    }
+  }
+  libtextclassifier2::RegisterLoadModelBenchmarks();
+  benchmark::RunSpecifiedBenchmarks();
+  libtextclassifier2::PrintLoadReports();
+  return 0;
+}
@@ -20,9 +20,12 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <thread>
 
 #include "model_generated.h"
+#include "test-util.h"
 #include "types-test-util.h"
+#include "util/strings/numbers.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -31,10 +34,13 @@ namespace {
 
 using testing::ElementsAreArray;
 using testing::IsEmpty;
+using testing::Not;
 using testing::Pair;
 using testing::Values;
 
-std::string FirstResult(const std::vector<ClassificationResult>& results) {
+// Takes both std::vector<ClassificationResult> and ClassificationResults.
+template <typename Results>
+std::string FirstResult(const Results& results) {
   if (results.empty()) {
     return "<INVALID RESULTS>";
   }
@@ -109,6 +115,149 @@ TEST_P(TextClassifierTest, ClassifyText) {
                                      "\xf0\x9f\x98\x8b\x8b", {0, 0})));
 }
 
+TEST_P(TextClassifierTest, ClassifyTextWithoutVerification) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib,
+                               /*verify_model=*/false);
+  ASSERT_TRUE(classifier);
+
+  EXPECT_EQ("phone", FirstResult(classifier->ClassifyText(
+                         "Call me at (800) 123-456 today", {11, 24})));
+}
+
+TEST_P(TextClassifierTest, ClassifyTextWithoutFeedForwardNetwork) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+  ModelExecutionOptions execution_options;
+  execution_options.selection.use_feed_forward_network = false;
+  execution_options.classification.use_feed_forward_network = false;
+  std::unique_ptr<TextClassifier> interpreter_classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib,
+                               /*verify_model=*/true, execution_options);
+  ASSERT_TRUE(interpreter_classifier);
+
+  const std::string context =
+      "this afternoon Barack Obama gave a speech at|Visit "
+      "www.google.com every today!|Call me at (800) 123-456 today.";
+  for (const CodepointSpan& span :
+       std::vector<CodepointSpan>{{15, 27}, {51, 65}, {90, 103}}) {
+    const std::vector<ClassificationResult> expected =
+        interpreter_classifier->ClassifyText(context, span);
+    const std::vector<ClassificationResult> result =
+        classifier->ClassifyText(context, span);
+    ASSERT_EQ(result.size(), expected.size());
+    for (int i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(result[i].collection, expected[i].collection);
+      EXPECT_NEAR(result[i].score, expected[i].score, 1e-4);
+    }
+    EXPECT_EQ(
+        classifier->SuggestSelection(context, {span.first, span.first + 1}),
+        interpreter_classifier->SuggestSelection(context,
+                                                 {span.first, span.first + 1}));
+  }
+}
+
+TEST_P(TextClassifierTest, ScratchArenaMatchesInterpreterTensors) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+  ModelExecutionOptions execution_options;
+  execution_options.selection.use_scratch_arena = false;
+  execution_options.classification.use_scratch_arena = false;
+  std::unique_ptr<TextClassifier> tensors_classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib,
+                               /*verify_model=*/true, execution_options);
+  ASSERT_TRUE(tensors_classifier);
+
+  const std::string context =
+      "this afternoon Barack Obama gave a speech at|Visit "
+      "www.google.com every today!|Call me at (800) 123-456 today.";
+  for (const CodepointSpan& span :
+       std::vector<CodepointSpan>{{15, 27}, {51, 65}, {90, 103}}) {
+    const std::vector<ClassificationResult> expected =
+        tensors_classifier->ClassifyText(context, span);
+    const std::vector<ClassificationResult> result =
+        classifier->ClassifyText(context, span);
+    ASSERT_EQ(result.size(), expected.size());
+    for (int i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(result[i].collection, expected[i].collection);
+      EXPECT_FLOAT_EQ(result[i].score, expected[i].score);
+    }
+    EXPECT_EQ(
+        classifier->SuggestSelection(context, {span.first, span.first + 1}),
+        tensors_classifier->SuggestSelection(context,
+                                             {span.first, span.first + 1}));
+  }
+  const std::vector<AnnotatedSpan> expected =
+      tensors_classifier->Annotate(context);
+  const std::vector<AnnotatedSpan> result = classifier->Annotate(context);
+  ASSERT_EQ(result.size(), expected.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(result[i].span, expected[i].span);
+  }
+
+  // The pooled interpreters never allocated their tensors.
+  EXPECT_LT(classifier->GetMemoryStats().interpreter_bytes,
+            tensors_classifier->GetMemoryStats().interpreter_bytes);
+}
+
+TEST_P(TextClassifierTest, AnnotateWithHalfPrecisionFeatures) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+  ModelExecutionOptions execution_options;
+  execution_options.half_precision_annotation_features = true;
+  std::unique_ptr<TextClassifier> half_precision_classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib,
+                               /*verify_model=*/true, execution_options);
+  ASSERT_TRUE(half_precision_classifier);
+
+  const std::string test_string =
+      "& saw Barack Obama today .. 350 Third Street, Cambridge\nand my phone "
+      "number is 853 225 3556\nmeet me on 03/14/2018 at 2pm or visit "
+      "www.google.com every today!";
+  const std::vector<AnnotatedSpan> expected =
+      classifier->Annotate(test_string);
+  const std::vector<AnnotatedSpan> result =
+      half_precision_classifier->Annotate(test_string);
+  ASSERT_EQ(result.size(), expected.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(result[i].span, expected[i].span);
+    EXPECT_EQ(FirstResult(result[i].classification),
+              FirstResult(expected[i].classification));
+  }
+}
+
+TEST_P(TextClassifierTest, WarmUp) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  EXPECT_TRUE(classifier->WarmUp(ModeFlag_SELECTION));
+  EXPECT_TRUE(classifier->WarmUp());
+  EXPECT_EQ("phone", FirstResult(classifier->ClassifyText(
+                         "Call me at (800) 123-456 today", {11, 24})));
+}
+
+TEST_P(TextClassifierTest, ViewModelMetadata) {
+  const std::string model = ReadFile(GetModelPath() + GetParam());
+  const Model* full_model = ViewModel(model.data(), model.size());
+  const Model* metadata = ViewModelMetadata(model.data(), model.size());
+  ASSERT_TRUE(full_model);
+  ASSERT_TRUE(metadata);
+  EXPECT_EQ(metadata->version(), full_model->version());
+  EXPECT_EQ(metadata->locales() != nullptr, full_model->locales() != nullptr);
+  EXPECT_EQ(metadata->name() != nullptr, full_model->name() != nullptr);
+
+  EXPECT_FALSE(ViewModelMetadata(model.data(), /*size=*/2));
+}
+
 TEST_P(TextClassifierTest, ClassifyTextDisabledFail) {
   CREATE_UNILIB_FOR_TESTING;
   const std::string test_model = ReadFile(GetModelPath() + GetParam());
@@ -389,6 +538,124 @@ TEST_P(TextClassifierTest, AnnotateRegex) {
                   IsAnnotatedSpan(79, 91, "phone"),
               }));
 }
+
+TEST_P(TextClassifierTest, ProfilesRules) {
+  CREATE_UNILIB_FOR_TESTING;
+  const std::string test_model = ReadFile(GetModelPath() + GetParam());
+  std::unique_ptr<ModelT> unpacked_model = UnPackModel(test_model.c_str());
+
+  const int person_pattern_id = unpacked_model->regex_model->patterns.size();
+  unpacked_model->regex_model->patterns.push_back(MakePattern(
+      "person", " (Barack Obama) ", /*enabled_for_classification=*/false,
+      /*enabled_for_selection=*/false, /*enabled_for_annotation=*/true, 1.0));
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(Model::Pack(builder, unpacked_model.get()));
+
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromUnownedBuffer(
+          reinterpret_cast<const char*>(builder.GetBufferPointer()),
+          builder.GetSize(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  RuleProfile profile;
+  classifier->SetRuleProfile(&profile);
+  const std::string test_string = "& saw Barack Obama today";
+  EXPECT_THAT(classifier->Annotate(test_string),
+              ElementsAreArray({
+                  IsAnnotatedSpan(6, 18, "person"),
+                  IsAnnotatedSpan(19, 24, "date"),
+              }));
+
+  const RuleProfile::RuleStats person_stats =
+      profile.Get(RuleProfile::REGEX, person_pattern_id);
+  EXPECT_EQ(person_stats.name, "person:  (Barack Obama) ");
+  EXPECT_EQ(person_stats.attempts, 1);
+  EXPECT_EQ(person_stats.matches, 1);
+  int64 datetime_matches = 0;
+  for (const RuleProfile::RuleStats& stats : profile.RankedRules()) {
+    if (stats.type == RuleProfile::DATETIME) {
+      EXPECT_FALSE(stats.name.empty());
+      datetime_matches += stats.matches;
+    }
+  }
+  EXPECT_GT(datetime_matches, 0);
+  EXPECT_NE(profile.ToString().find("regex " + IntToString(person_pattern_id) +
+                                    " (person:  (Barack Obama) )"),
+            std::string::npos);
+
+  // Once disabled, nothing more is recorded.
+  classifier->SetRuleProfile(nullptr);
+  classifier->Annotate(test_string);
+  EXPECT_EQ(profile.Get(RuleProfile::REGEX, person_pattern_id).attempts, 1);
+}
+
+TEST_P(TextClassifierTest, GetCollections) {
+  CREATE_UNILIB_FOR_TESTING;
+  const std::string test_model = ReadFile(GetModelPath() + GetParam());
+  std::unique_ptr<ModelT> unpacked_model = UnPackModel(test_model.c_str());
+
+  unpacked_model->regex_model->patterns.push_back(MakePattern(
+      "person", " (Barack Obama) ", /*enabled_for_classification=*/false,
+      /*enabled_for_selection=*/false, /*enabled_for_annotation=*/true, 1.0));
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(Model::Pack(builder, unpacked_model.get()));
+
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromUnownedBuffer(
+          reinterpret_cast<const char*>(builder.GetBufferPointer()),
+          builder.GetSize(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  const std::vector<std::string>& collections = classifier->GetCollections();
+  EXPECT_THAT(collections, testing::Contains("other"));
+  EXPECT_THAT(collections, testing::Contains("phone"));
+  EXPECT_THAT(collections, testing::Contains("date"));
+  EXPECT_THAT(collections, testing::Contains("person"));
+  for (int i = 0; i < collections.size(); ++i) {
+    EXPECT_EQ(classifier->GetCollectionId(collections[i]), i);
+  }
+  EXPECT_EQ(classifier->GetCollectionId("no such collection"), -1);
+
+  // Every result has one of the collections.
+  for (const AnnotatedSpan& annotation : classifier->Annotate(
+           "& saw Barack Obama today .. 350 Third Street, Cambridge\nand my "
+           "phone number is 853 225 3556")) {
+    for (const ClassificationResult& result : annotation.classification) {
+      EXPECT_NE(classifier->GetCollectionId(result.collection), -1)
+          << result.collection;
+    }
+  }
+}
+
+TEST_P(TextClassifierTest, AnnotateWithLazyRegexCompilation) {
+  CREATE_UNILIB_FOR_TESTING;
+  const std::string test_model = ReadFile(GetModelPath() + GetParam());
+  std::unique_ptr<ModelT> unpacked_model = UnPackModel(test_model.c_str());
+
+  unpacked_model->lazy_regex_compilation = true;
+  unpacked_model->regex_model->patterns.push_back(MakePattern(
+      "person", " (Barack Obama) ", /*enabled_for_classification=*/false,
+      /*enabled_for_selection=*/false, /*enabled_for_annotation=*/true, 1.0));
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(Model::Pack(builder, unpacked_model.get()));
+
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromUnownedBuffer(
+          reinterpret_cast<const char*>(builder.GetBufferPointer()),
+          builder.GetSize(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  const std::string test_string =
+      "& saw Barack Obama today .. 350 Third Street, Cambridge\nand my phone "
+      "number is 853 225 3556";
+  EXPECT_THAT(classifier->Annotate(test_string),
+              ElementsAreArray({
+                  IsAnnotatedSpan(6, 18, "person"),
+                  IsAnnotatedSpan(19, 24, "date"),
+                  IsAnnotatedSpan(28, 55, "address"),
+                  IsAnnotatedSpan(79, 91, "phone"),
+              }));
+}
 #endif  // LIBTEXTCLASSIFIER_UNILIB_ICU
 
 TEST_P(TextClassifierTest, PhoneFiltering) {
@@ -451,6 +718,55 @@ TEST_P(TextClassifierTest, SuggestSelection) {
             std::make_pair(11, 12));
 }
 
+TEST_P(TextClassifierTest, SuggestSelections) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  const std::string context =
+      "this afternoon Barack Obama gave a speech at\ncall me at (857) 225 3556 "
+      "today or at 350 Third Street, Cambridge";
+  std::vector<CodepointSpan> clicks;
+  for (int i = 0; i + 1 < context.size(); i += 3) {
+    clicks.push_back({i, i + 1});
+  }
+  // Also invalid ones.
+  clicks.push_back({5, 5});
+  clicks.push_back({-1, 2});
+
+  const std::vector<CodepointSpan> selections =
+      classifier->SuggestSelections(context, clicks);
+  ASSERT_EQ(selections.size(), clicks.size());
+  for (int i = 0; i < clicks.size(); ++i) {
+    EXPECT_EQ(selections[i], classifier->SuggestSelection(context, clicks[i]))
+        << clicks[i].first;
+  }
+}
+
+TEST_P(TextClassifierTest, SuggestSelectionsShareSelectionInference) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  // Whole-word clicks on the same line are left the same tokens, so the
+  // selection model runs for all of them together.
+  const std::string context = "call me at 857 225 3556 today";
+  const std::vector<CodepointSpan> clicks = {
+      {0, 4}, {8, 10}, {11, 14}, {19, 23}, {24, 29}};
+  LatencyStats stats;
+  SelectionOptions options;
+  options.latency_stats = &stats;
+  const std::vector<CodepointSpan> selections =
+      classifier->SuggestSelections(context, clicks, options);
+  EXPECT_EQ(stats.Count(LatencyStats::SELECTION_INFERENCE), 1);
+  ASSERT_EQ(selections.size(), clicks.size());
+  for (int i = 0; i < clicks.size(); ++i) {
+    EXPECT_EQ(selections[i], classifier->SuggestSelection(context, clicks[i]));
+  }
+}
+
 TEST_P(TextClassifierTest, SuggestSelectionDisabledFail) {
   CREATE_UNILIB_FOR_TESTING;
   const std::string test_model = ReadFile(GetModelPath() + GetParam());
@@ -708,6 +1024,52 @@ TEST(TextClassifierTest, SnapLeftIfWhitespaceSelection) {
             std::make_pair(0, 1));
 }
 
+TEST(TextClassifierTest, SpanAlignsWithTokens) {
+  const std::vector<Token> tokens = {Token("hello", 0, 5),
+                                     Token("world", 6, 11)};
+  EXPECT_TRUE(internal::SpanAlignsWithTokens(tokens, {0, 5}));
+  EXPECT_TRUE(internal::SpanAlignsWithTokens(tokens, {0, 11}));
+  EXPECT_TRUE(internal::SpanAlignsWithTokens(tokens, {5, 6}));
+  EXPECT_FALSE(internal::SpanAlignsWithTokens(tokens, {1, 5}));
+  EXPECT_FALSE(internal::SpanAlignsWithTokens(tokens, {6, 10}));
+}
+
+TEST(TextClassifierTest, HaveSameTokenization) {
+  FeatureProcessorOptionsT options;
+  options.tokenization_codepoint_config.emplace_back(
+      new TokenizationCodepointRangeT());
+  options.tokenization_codepoint_config.back()->start = 32;
+  options.tokenization_codepoint_config.back()->end = 33;
+  options.tokenization_codepoint_config.back()->role =
+      TokenizationCodepointRange_::Role_WHITESPACE_SEPARATOR;
+  options.context_size = 2;
+
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(CreateFeatureProcessorOptions(builder, &options));
+  const flatbuffers::DetachedBuffer options_fb = builder.Release();
+
+  // Options not related to tokenization do not matter.
+  options.context_size = 5;
+  builder.Finish(CreateFeatureProcessorOptions(builder, &options));
+  const flatbuffers::DetachedBuffer same_tokenization_fb = builder.Release();
+
+  options.tokenization_codepoint_config.back()->role =
+      TokenizationCodepointRange_::Role_SPLIT_BEFORE;
+  builder.Finish(CreateFeatureProcessorOptions(builder, &options));
+  const flatbuffers::DetachedBuffer other_tokenization_fb = builder.Release();
+
+  const FeatureProcessorOptions* a =
+      flatbuffers::GetRoot<FeatureProcessorOptions>(options_fb.data());
+  EXPECT_TRUE(internal::HaveSameTokenization(a, a));
+  EXPECT_TRUE(internal::HaveSameTokenization(
+      a, flatbuffers::GetRoot<FeatureProcessorOptions>(
+             same_tokenization_fb.data())));
+  EXPECT_FALSE(internal::HaveSameTokenization(
+      a, flatbuffers::GetRoot<FeatureProcessorOptions>(
+             other_tokenization_fb.data())));
+  EXPECT_FALSE(internal::HaveSameTokenization(a, nullptr));
+}
+
 TEST_P(TextClassifierTest, Annotate) {
   CREATE_UNILIB_FOR_TESTING;
   std::unique_ptr<TextClassifier> classifier =
@@ -737,6 +1099,27 @@ TEST_P(TextClassifierTest, Annotate) {
           .empty());
 }
 
+TEST_P(TextClassifierTest, AnnotateRegion) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  const std::string test_string =
+      "& saw Barack Obama today .. 350 Third Street, Cambridge\nand my phone "
+      "number is 853 225 3556";
+  EXPECT_THAT(classifier->AnnotateRegion(test_string, {60, 100}),
+              ElementsAreArray({IsAnnotatedSpan(79, 91, "phone")}));
+  // Spans that only partly overlap the region are returned whole.
+  EXPECT_THAT(classifier->AnnotateRegion(test_string, {50, 80}),
+              ElementsAreArray({
+                  IsAnnotatedSpan(28, 55, "address"),
+                  IsAnnotatedSpan(79, 91, "phone"),
+              }));
+  EXPECT_THAT(classifier->AnnotateRegion(test_string, {56, 70}), IsEmpty());
+  EXPECT_THAT(classifier->AnnotateRegion(test_string, {10, 10}), IsEmpty());
+}
+
 TEST_P(TextClassifierTest, AnnotateSmallBatches) {
   CREATE_UNILIB_FOR_TESTING;
   const std::string test_model = ReadFile(GetModelPath() + GetParam());
@@ -771,6 +1154,543 @@ TEST_P(TextClassifierTest, AnnotateSmallBatches) {
   EXPECT_TRUE(classifier->Annotate("853 225\n3556", options).empty());
 }
 
+TEST_P(TextClassifierTest, AnnotateSmallClassificationBatches) {
+  CREATE_UNILIB_FOR_TESTING;
+  const std::string test_model = ReadFile(GetModelPath() + GetParam());
+  std::unique_ptr<ModelT> unpacked_model = UnPackModel(test_model.c_str());
+
+  // Classify the chunks one by one, and two at a time.
+  for (const int batch_size : {1, 2}) {
+    unpacked_model->classification_options->batch_size = batch_size;
+    flatbuffers::FlatBufferBuilder builder;
+    builder.Finish(Model::Pack(builder, unpacked_model.get()));
+
+    std::unique_ptr<TextClassifier> classifier =
+        TextClassifier::FromUnownedBuffer(
+            reinterpret_cast<const char*>(builder.GetBufferPointer()),
+            builder.GetSize(), &unilib);
+    ASSERT_TRUE(classifier);
+
+    const std::string test_string =
+        "& saw Barack Obama today .. 350 Third Street, Cambridge\nand my phone "
+        "number is 853 225 3556";
+    EXPECT_THAT(classifier->Annotate(test_string),
+                ElementsAreArray({
+#ifdef LIBTEXTCLASSIFIER_UNILIB_ICU
+                    IsAnnotatedSpan(19, 24, "date"),
+#endif
+                    IsAnnotatedSpan(28, 55, "address"),
+                    IsAnnotatedSpan(79, 91, "phone"),
+                }));
+  }
+}
+
+TEST_P(TextClassifierTest, AnnotateDocuments) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  const std::vector<std::string> contexts = {
+      "& saw Barack Obama today .. 350 Third Street, Cambridge\nand my phone "
+      "number is 853 225 3556",
+      "853 225 3556", "853 225\n3556", "853 225 3556\n\xf0\x9f\x98\x8b\x8b",
+      ""};
+  const std::vector<std::vector<AnnotatedSpan>> results =
+      classifier->AnnotateDocuments(contexts);
+  ASSERT_EQ(results.size(), contexts.size());
+  for (int i = 0; i < contexts.size(); ++i) {
+    const std::vector<AnnotatedSpan> expected =
+        classifier->Annotate(contexts[i]);
+    ASSERT_EQ(results[i].size(), expected.size());
+    for (int j = 0; j < expected.size(); ++j) {
+      EXPECT_EQ(results[i][j].span, expected[j].span);
+      EXPECT_EQ(FirstResult(results[i][j].classification),
+                FirstResult(expected[j].classification));
+    }
+  }
+  EXPECT_THAT(results[1], ElementsAreArray({IsAnnotatedSpan(0, 12, "phone")}));
+  EXPECT_TRUE(results[2].empty());
+  EXPECT_TRUE(results[3].empty());
+  EXPECT_TRUE(results[4].empty());
+
+  // The lines of all the documents are chunked together.
+  LatencyStats stats;
+  AnnotationOptions options;
+  options.latency_stats = &stats;
+  classifier->AnnotateDocuments(contexts, options);
+  EXPECT_EQ(stats.Count(LatencyStats::SELECTION_INFERENCE), 1);
+}
+
+// Runs every task on a new thread.
+class ThreadPerTaskExecutor : public Executor {
+ public:
+  ~ThreadPerTaskExecutor() override {
+    for (std::thread& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  void Schedule(std::function<void()> task) override {
+    threads_.emplace_back(std::move(task));
+  }
+
+ private:
+  std::vector<std::thread> threads_;
+};
+
+TEST_P(TextClassifierTest, AnnotateWithExecutor) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  const std::string test_string =
+      "& saw Barack Obama today .. 350 Third Street, Cambridge\nand my phone "
+      "number is 853 225 3556\ncall 853 225 3556 or 853 225 3557\n\nbye";
+  const std::vector<AnnotatedSpan> expected = classifier->Annotate(test_string);
+
+  ThreadPerTaskExecutor executor;
+  AnnotationOptions options;
+  options.executor = &executor;
+  const std::vector<AnnotatedSpan> result =
+      classifier->Annotate(test_string, options);
+  ASSERT_EQ(result.size(), expected.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(result[i].span, expected[i].span);
+    EXPECT_EQ(FirstResult(result[i].classification),
+              FirstResult(expected[i].classification));
+  }
+}
+
+TEST_P(TextClassifierTest, AnnotateWithParallelFeatureExtraction) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  // A single line long enough to have its tokens split across tasks.
+  std::string test_string;
+  for (int i = 0; i < 30; ++i) {
+    test_string +=
+        "saw Barack Obama today at 350 Third Street, Cambridge and call 853 "
+        "225 3556 . ";
+  }
+  const std::vector<AnnotatedSpan> expected = classifier->Annotate(test_string);
+  ASSERT_FALSE(expected.empty());
+
+  ThreadPerTaskExecutor executor;
+  AnnotationOptions options;
+  options.executor = &executor;
+  options.parallel_feature_extraction = true;
+  const std::vector<AnnotatedSpan> result =
+      classifier->Annotate(test_string, options);
+  ASSERT_EQ(result.size(), expected.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(result[i].span, expected[i].span);
+    EXPECT_EQ(FirstResult(result[i].classification),
+              FirstResult(expected[i].classification));
+  }
+}
+
+TEST_P(TextClassifierTest, InitializeWithExecutor) {
+  CREATE_UNILIB_FOR_TESTING;
+  // Compressing the model makes the patterns self-contained buffers, which
+  // are decompressed on the executor too.
+  for (const std::string& test_model :
+       {ReadFile(GetModelPath() + GetParam()),
+        CompressSerializedModel(ReadFile(GetModelPath() + GetParam()))}) {
+    std::unique_ptr<TextClassifier> expected_classifier =
+        TextClassifier::FromUnownedBuffer(test_model.c_str(), test_model.size(),
+                                          &unilib);
+    ASSERT_TRUE(expected_classifier);
+
+    ThreadPerTaskExecutor executor;
+    ModelExecutionOptions execution_options;
+    execution_options.initialization_executor = &executor;
+    std::unique_ptr<TextClassifier> classifier =
+        TextClassifier::FromUnownedBuffer(test_model.c_str(), test_model.size(),
+                                          &unilib, /*verify_model=*/true,
+                                          execution_options);
+    ASSERT_TRUE(classifier);
+
+    const std::string test_string =
+        "& saw Barack Obama today .. 350 Third Street, Cambridge\nand my "
+        "phone number is 853 225 3556\nmeet me on 03/14/2018 at 2pm";
+    const std::vector<AnnotatedSpan> expected =
+        expected_classifier->Annotate(test_string);
+    const std::vector<AnnotatedSpan> result = classifier->Annotate(test_string);
+    ASSERT_EQ(result.size(), expected.size());
+    for (int i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(result[i].span, expected[i].span);
+      EXPECT_EQ(FirstResult(result[i].classification),
+                FirstResult(expected[i].classification));
+    }
+    EXPECT_EQ(FirstResult(classifier->ClassifyText(test_string, {79, 91})),
+              FirstResult(
+                  expected_classifier->ClassifyText(test_string, {79, 91})));
+  }
+}
+
+TEST_P(TextClassifierTest, ReportsInitializationStats) {
+  CREATE_UNILIB_FOR_TESTING;
+  const std::string test_model =
+      CompressSerializedModel(ReadFile(GetModelPath() + GetParam()));
+  InitializationStats stats;
+  ModelExecutionOptions execution_options;
+  execution_options.initialization_stats = &stats;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromUnownedBuffer(test_model.c_str(), test_model.size(),
+                                        &unilib, /*verify_model=*/true,
+                                        execution_options);
+  ASSERT_TRUE(classifier);
+
+  EXPECT_EQ(stats.Count(InitializationStats::VERIFICATION), 1);
+  EXPECT_EQ(stats.Count(InitializationStats::INITIALIZATION), 1);
+  EXPECT_EQ(stats.Count(InitializationStats::SELECTION_EXECUTOR), 1);
+  EXPECT_EQ(stats.Count(InitializationStats::CLASSIFICATION_EXECUTOR), 1);
+  EXPECT_EQ(stats.Count(InitializationStats::EMBEDDING_EXECUTOR), 1);
+  EXPECT_EQ(stats.Count(InitializationStats::FEATURE_PROCESSORS), 2);
+  EXPECT_EQ(stats.Count(InitializationStats::REGEX_MODEL), 1);
+  EXPECT_EQ(stats.Count(InitializationStats::DATETIME_PARSER), 1);
+  EXPECT_GT(stats.Value(InitializationStats::REGEX_PATTERNS_COMPILED), 0);
+  EXPECT_GT(stats.Value(InitializationStats::DATETIME_PATTERNS_COMPILED), 0);
+  EXPECT_GT(stats.Value(InitializationStats::PATTERNS_DECOMPRESSED), 0);
+  EXPECT_GT(stats.Value(InitializationStats::BYTES_DECOMPRESSED), 0);
+  EXPECT_EQ(stats.Value(InitializationStats::PATTERNS_DEFERRED), 0);
+
+  // Without stats, nothing is recorded.
+  stats.Clear();
+  ASSERT_TRUE(TextClassifier::FromUnownedBuffer(
+      test_model.c_str(), test_model.size(), &unilib));
+  EXPECT_EQ(stats.Count(InitializationStats::INITIALIZATION), 0);
+}
+
+TEST_P(TextClassifierTest, Freeze) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  const std::string test_string =
+      "& saw Barack Obama today .. 350 Third Street, Cambridge\nand my phone "
+      "number is 853 225 3556\nmeet me on 03/14/2018 at 2pm";
+  AnnotationOptions en_options;
+  en_options.locales = "en";
+  AnnotationOptions de_options;
+  de_options.locales = "de";
+  const std::vector<AnnotatedSpan> expected_en =
+      classifier->Annotate(test_string, en_options);
+  const std::vector<AnnotatedSpan> expected_de =
+      classifier->Annotate(test_string, de_options);
+
+  EXPECT_TRUE(classifier->Freeze({"en"}));
+
+  // The results stay the same, both for the memoized locales and the others.
+  const std::vector<AnnotatedSpan> result_en =
+      classifier->Annotate(test_string, en_options);
+  const std::vector<AnnotatedSpan> result_de =
+      classifier->Annotate(test_string, de_options);
+  ASSERT_EQ(result_en.size(), expected_en.size());
+  for (int i = 0; i < expected_en.size(); ++i) {
+    EXPECT_EQ(result_en[i].span, expected_en[i].span);
+    EXPECT_EQ(FirstResult(result_en[i].classification),
+              FirstResult(expected_en[i].classification));
+  }
+  ASSERT_EQ(result_de.size(), expected_de.size());
+  for (int i = 0; i < expected_de.size(); ++i) {
+    EXPECT_EQ(result_de[i].span, expected_de[i].span);
+  }
+  EXPECT_EQ("phone",
+            FirstResult(classifier->ClassifyText(test_string, {79, 91})));
+}
+
+TEST_P(TextClassifierTest, GetMemoryStats) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  const MemoryStats stats = classifier->GetMemoryStats();
+  EXPECT_GT(stats.model_mapped_bytes, 0);
+  EXPECT_GE(stats.model_resident_bytes, 0);
+  EXPECT_GT(stats.feature_processor_bytes, 0);
+  EXPECT_GT(stats.tokenizer_bytes, 0);
+  EXPECT_GT(stats.TotalHeapBytes(), 0);
+
+  // Running the models fills the interpreter pools, and compiling the lazy
+  // patterns adds them.
+  classifier->Annotate("call me at 853 225 3556 on 03/14/2018 at 2pm");
+  ASSERT_TRUE(classifier->Freeze({"en"}));
+  const MemoryStats frozen_stats = classifier->GetMemoryStats();
+  EXPECT_GE(frozen_stats.regex_bytes, stats.regex_bytes);
+  EXPECT_GE(frozen_stats.datetime_bytes, stats.datetime_bytes);
+  EXPECT_EQ(frozen_stats.model_mapped_bytes, stats.model_mapped_bytes);
+  EXPECT_LE(frozen_stats.model_resident_bytes,
+            frozen_stats.model_mapped_bytes);
+}
+
+// The allocations of a call are bounded by the ones of the same call before,
+// and grow at most linearly with the input, so that per-call heap churn does
+// not creep back in.
+TEST_P(TextClassifierTest, ClassifyTextAllocations) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  const std::string context = "call me at (800) 123-456 today";
+  const CodepointSpan selection = {11, 24};
+  // The first call creates the interpreters and compiles the lazy state.
+  classifier->ClassifyText(context, selection);
+
+  int64 first_allocations;
+  {
+    ScopedAllocationCounter counter;
+    classifier->ClassifyText(context, selection);
+    first_allocations = counter.num_allocations();
+  }
+  EXPECT_GT(first_allocations, 0);
+  for (int i = 0; i < 3; ++i) {
+    ScopedAllocationCounter counter;
+    classifier->ClassifyText(context, selection);
+    EXPECT_LE(counter.num_allocations(), first_allocations);
+  }
+}
+
+TEST_P(TextClassifierTest, AnnotateAllocations) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  // Distinct lines, so that none of them is reused from another.
+  const std::vector<std::string> lines = {
+      "call me at (800) 123-456 today", "my number is 853 225 3556",
+      "meet me at 350 Third Street, Cambridge", "or at 853 225 3557 tonight"};
+  std::string long_context;
+  for (const std::string& line : lines) {
+    long_context += line + "\n";
+  }
+  classifier->Annotate(long_context);
+
+  int64 short_allocations;
+  {
+    ScopedAllocationCounter counter;
+    classifier->Annotate(lines[0]);
+    short_allocations = counter.num_allocations();
+  }
+  int64 long_allocations;
+  {
+    ScopedAllocationCounter counter;
+    classifier->Annotate(long_context);
+    long_allocations = counter.num_allocations();
+  }
+  EXPECT_GT(short_allocations, 0);
+  EXPECT_LE(long_allocations, lines.size() * short_allocations);
+
+  ScopedAllocationCounter counter;
+  classifier->Annotate(long_context);
+  EXPECT_LE(counter.num_allocations(), long_allocations);
+}
+
+TEST_P(TextClassifierTest, AnnotateRepeatedLines) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  // The results of the repeated line are shifted to each of its copies, by
+  // codepoints.
+  EXPECT_THAT(classifier->Annotate("\u00e9\n853 225 3556\ncall 853 225 3556\n"
+                                   "853 225 3556"),
+              ElementsAreArray({
+                  IsAnnotatedSpan(2, 14, "phone"),
+                  IsAnnotatedSpan(20, 32, "phone"),
+                  IsAnnotatedSpan(33, 45, "phone"),
+              }));
+}
+
+TEST_P(TextClassifierTest, AnnotateWithExecutionOptions) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+  ModelExecutionOptions execution_options;
+  execution_options.selection.num_threads = 2;
+  execution_options.selection.max_pooled_interpreters = 1;
+  std::unique_ptr<TextClassifier> threaded_classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib,
+                               /*verify_model=*/true, execution_options);
+  ASSERT_TRUE(threaded_classifier);
+
+  const std::string test_string =
+      "& saw Barack Obama today .. 350 Third Street, Cambridge\nand my phone "
+      "number is 853 225 3556\ncall 853 225 3556 or 853 225 3557\n\nbye";
+  const std::vector<AnnotatedSpan> expected = classifier->Annotate(test_string);
+  const std::vector<AnnotatedSpan> result =
+      threaded_classifier->Annotate(test_string);
+  ASSERT_EQ(result.size(), expected.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(result[i].span, expected[i].span);
+    EXPECT_EQ(FirstResult(result[i].classification),
+              FirstResult(expected[i].classification));
+  }
+}
+
+TEST_P(TextClassifierTest, AnnotateWithLatencyStats) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  const std::string test_string =
+      "& saw Barack Obama today .. 350 Third Street, Cambridge\nand my phone "
+      "number is 853 225 3556\nbye";
+  LatencyStats stats;
+  AnnotationOptions options;
+  options.latency_stats = &stats;
+  const std::vector<AnnotatedSpan> expected = classifier->Annotate(test_string);
+  const std::vector<AnnotatedSpan> result =
+      classifier->Annotate(test_string, options);
+
+  // The stats do not change the results.
+  ASSERT_EQ(result.size(), expected.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(result[i].span, expected[i].span);
+  }
+
+  EXPECT_GT(stats.Count(LatencyStats::TOKENIZATION), 0);
+  EXPECT_GT(stats.Count(LatencyStats::FEATURE_EXTRACTION), 0);
+  EXPECT_GT(stats.Count(LatencyStats::EMBEDDING), 0);
+  EXPECT_GT(stats.Count(LatencyStats::SELECTION_INFERENCE), 0);
+  EXPECT_GT(stats.Count(LatencyStats::CLASSIFICATION_INFERENCE), 0);
+  EXPECT_EQ(stats.Count(LatencyStats::REGEX), 1);
+  EXPECT_EQ(stats.Count(LatencyStats::DATETIME), 1);
+  EXPECT_EQ(stats.Count(LatencyStats::CONFLICT_RESOLUTION), 1);
+
+  stats.Clear();
+  ClassificationOptions classification_options;
+  classification_options.latency_stats = &stats;
+  classifier->ClassifyText("call me at (800) 123-456 today", {11, 24},
+                           classification_options);
+  EXPECT_EQ(stats.Count(LatencyStats::REGEX), 1);
+  EXPECT_EQ(stats.Count(LatencyStats::CONFLICT_RESOLUTION), 0);
+}
+
+TEST_P(TextClassifierTest, ResultCache) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  const std::string context = "Call me at (800) 123-456 today";
+  const CodepointSpan expected_selection =
+      classifier->SuggestSelection(context, {11, 16});
+  const std::vector<ClassificationResult> expected_classification =
+      classifier->ClassifyText(context, expected_selection);
+
+  classifier->SetResultCacheSize(10);
+  LatencyStats stats;
+  SelectionOptions selection_options;
+  selection_options.latency_stats = &stats;
+  ClassificationOptions classification_options;
+  classification_options.latency_stats = &stats;
+  for (int i = 0; i < 2; ++i) {
+    stats.Clear();
+    EXPECT_EQ(classifier->SuggestSelection(context, {11, 16},
+                                           selection_options),
+              expected_selection);
+    EXPECT_EQ(stats.Count(LatencyStats::CONFLICT_RESOLUTION), i == 0 ? 1 : 0);
+
+    stats.Clear();
+    const std::vector<ClassificationResult> classification =
+        classifier->ClassifyText(context, expected_selection,
+                                 classification_options);
+    EXPECT_EQ(FirstResult(classification),
+              FirstResult(expected_classification));
+    EXPECT_EQ(stats.Count(LatencyStats::REGEX), i == 0 ? 1 : 0);
+  }
+
+  // Different options are cached separately.
+  stats.Clear();
+  selection_options.locales = "de";
+  classifier->SuggestSelection(context, {11, 16}, selection_options);
+  EXPECT_EQ(stats.Count(LatencyStats::CONFLICT_RESOLUTION), 1);
+}
+
+TEST_P(TextClassifierTest, ResultCacheKeepsClassificationOfMultiLineContext) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  // The selection model only looks at the line of the click, the
+  // classification model at the whole context.
+  const std::string context =
+      "I saw Barack Obama today\ncall me at (800) 123-456 today\nor at 350 "
+      "Third Street, Cambridge";
+  const CodepointSpan click = {36, 41};
+  const CodepointSpan expected_selection =
+      classifier->SuggestSelection(context, click);
+  const std::vector<ClassificationResult> expected_classification =
+      classifier->ClassifyText(context, expected_selection);
+
+  classifier->SetResultCacheSize(10);
+  EXPECT_EQ(classifier->SuggestSelection(context, click), expected_selection);
+  const std::vector<ClassificationResult> classification =
+      classifier->ClassifyText(context, expected_selection);
+  ASSERT_EQ(classification.size(), expected_classification.size());
+  for (int i = 0; i < expected_classification.size(); ++i) {
+    EXPECT_EQ(classification[i].collection,
+              expected_classification[i].collection);
+    EXPECT_FLOAT_EQ(classification[i].score,
+                    expected_classification[i].score);
+  }
+}
+
+TEST_P(TextClassifierTest, AnnotateIncrementally) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  AnnotationSession session;
+  const std::vector<std::string> edits = {
+      "& saw Barack Obama today .. 350 Third Street, Cambridge\nand my phone "
+      "number is 853 225 3556",
+      "& saw Barack Obama today .. 350 Third Street, Cambridge\nand my phone "
+      "number is 853 225 355",
+      "I typed a new line\n& saw Barack Obama today .. 350 Third Street, "
+      "Cambridge\nand my phone number is 853 225 3556"};
+  for (const std::string& context : edits) {
+    const std::vector<AnnotatedSpan> expected = classifier->Annotate(context);
+    const std::vector<AnnotatedSpan> result =
+        classifier->AnnotateIncrementally(context, &session);
+    ASSERT_EQ(result.size(), expected.size());
+    for (int i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(result[i].span, expected[i].span);
+      EXPECT_EQ(FirstResult(result[i].classification),
+                FirstResult(expected[i].classification));
+    }
+  }
+
+  // Only the prepended line had to go through the model in the last call.
+  if (classifier->SelectionFeatureProcessorForTests()
+          ->GetOptions()
+          ->only_use_line_with_click()) {
+    EXPECT_EQ(session.num_cached_lines(), 3);
+    EXPECT_EQ(session.num_reused_lines(), 1);
+  }
+
+  // The tokenization depends on the locales, so a call with other locales
+  // does not reuse the lines.
+  AnnotationOptions options;
+  options.locales = "de";
+  classifier->AnnotateIncrementally(edits.back(), &session, options);
+  EXPECT_EQ(session.num_reused_lines(), 0);
+}
+
 #ifdef LIBTEXTCLASSIFIER_UNILIB_ICU
 TEST_P(TextClassifierTest, AnnotateFilteringDiscardAll) {
   CREATE_UNILIB_FOR_TESTING;
@@ -895,6 +1815,83 @@ TEST_P(TextClassifierTest, AnnotateFilteredCollections) {
               }));
 }
 
+TEST_P(TextClassifierTest, AnnotateRequestedEntityTypes) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  const std::string test_string =
+      "& saw Barack Obama today .. 350 Third Street, Cambridge\nand my phone "
+      "number is 853 225 3556";
+  AnnotationOptions options;
+  options.entity_types = {"phone"};
+  EXPECT_THAT(classifier->Annotate(test_string, options),
+              ElementsAreArray({IsAnnotatedSpan(79, 91, "phone")}));
+
+  options.entity_types = {"address", "phone"};
+  EXPECT_THAT(classifier->Annotate(test_string, options),
+              ElementsAreArray({
+                  IsAnnotatedSpan(28, 55, "address"),
+                  IsAnnotatedSpan(79, 91, "phone"),
+              }));
+
+  options.entity_types = {"no-such-collection"};
+  EXPECT_THAT(classifier->Annotate(test_string, options), IsEmpty());
+}
+
+TEST_P(TextClassifierTest, ClassifyTextRequestedEntityTypes) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  const std::string test_string = "Call me at (800) 123-456 today";
+  ClassificationOptions options;
+  options.entity_types = {"phone"};
+  EXPECT_EQ("phone",
+            FirstResult(classifier->ClassifyText(test_string, {11, 24},
+                                                 options)));
+
+  options.entity_types = {"address"};
+  EXPECT_EQ("other",
+            FirstResult(classifier->ClassifyText(test_string, {11, 24},
+                                                 options)));
+}
+
+TEST_P(TextClassifierTest, CancelledCallsReturnNoResults) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam(), &unilib);
+  ASSERT_TRUE(classifier);
+
+  const std::string test_string =
+      "& saw Barack Obama today .. 350 Third Street, Cambridge\nand my phone "
+      "number is 853 225 3556";
+  CancellationToken token;
+  CallStatus status = CALL_CANCELLED;
+  AnnotationOptions annotation_options;
+  annotation_options.cancellation_token = &token;
+  annotation_options.status = &status;
+  EXPECT_THAT(classifier->Annotate(test_string, annotation_options),
+              Not(IsEmpty()));
+  EXPECT_EQ(status, CALL_COMPLETED);
+
+  token.Cancel();
+  EXPECT_THAT(classifier->Annotate(test_string, annotation_options),
+              IsEmpty());
+  EXPECT_EQ(status, CALL_CANCELLED);
+
+  ClassificationOptions classification_options;
+  classification_options.cancellation_token = &token;
+  classification_options.status = &status;
+  status = CALL_COMPLETED;
+  EXPECT_THAT(classifier->ClassifyText("Call me at (800) 123-456 today",
+                                       {11, 24}, classification_options),
+              IsEmpty());
+  EXPECT_EQ(status, CALL_CANCELLED);
+}
+
 #ifdef LIBTEXTCLASSIFIER_UNILIB_ICU
 TEST_P(TextClassifierTest, AnnotateFilteredCollectionsSuppress) {
   CREATE_UNILIB_FOR_TESTING;
@@ -998,6 +1995,35 @@ TEST_P(TextClassifierTest, ClassifyTextDate) {
 }
 #endif  // LIBTEXTCLASSIFIER_UNILIB_ICU
 
+#ifdef LIBTEXTCLASSIFIER_CALENDAR_ICU
+TEST_P(TextClassifierTest, AnnotateDate) {
+  std::unique_ptr<TextClassifier> classifier =
+      TextClassifier::FromPath(GetModelPath() + GetParam());
+  EXPECT_TRUE(classifier);
+
+  AnnotationOptions options;
+  options.reference_timezone = "Europe/Zurich";
+  const std::string test_string = "let's meet on january 1, 2017 then";
+  std::vector<AnnotatedSpan> result =
+      classifier->Annotate(test_string, options);
+  ASSERT_EQ(result.size(), 1);
+  EXPECT_THAT(result[0], IsAnnotatedSpan(14, 29, "date"));
+  EXPECT_EQ(result[0].classification[0].datetime_parse_result.time_ms_utc,
+            1483225200000);
+  EXPECT_EQ(result[0].classification[0].datetime_parse_result.granularity,
+            DatetimeGranularity::GRANULARITY_DAY);
+
+  // Without interpretation, the same span is found without the time.
+  options.interpret_datetimes = false;
+  result = classifier->Annotate(test_string, options);
+  ASSERT_EQ(result.size(), 1);
+  EXPECT_THAT(result[0], IsAnnotatedSpan(14, 29, "date"));
+  EXPECT_EQ(result[0].classification[0].datetime_parse_result.time_ms_utc, 0);
+  EXPECT_EQ(result[0].classification[0].datetime_parse_result.granularity,
+            DatetimeGranularity::GRANULARITY_DAY);
+}
+#endif  // LIBTEXTCLASSIFIER_CALENDAR_ICU
+
 #ifdef LIBTEXTCLASSIFIER_CALENDAR_ICU
 TEST_P(TextClassifierTest, ClassifyTextDatePriorities) {
   std::unique_ptr<TextClassifier> classifier =
@@ -1085,7 +2111,8 @@ TEST(TextClassifierTest, ResolveConflictsTrivial) {
 
   std::vector<int> chosen;
   classifier.ResolveConflicts(candidates, /*context=*/"", /*cached_tokens=*/{},
-                              /*interpreter_manager=*/nullptr, &chosen);
+                              /*interpreter_manager=*/nullptr,
+                              /*embedding_cache=*/nullptr, &chosen);
   EXPECT_THAT(chosen, ElementsAreArray({0}));
 }
 
@@ -1103,7 +2130,8 @@ TEST(TextClassifierTest, ResolveConflictsSequence) {
 
   std::vector<int> chosen;
   classifier.ResolveConflicts(candidates, /*context=*/"", /*cached_tokens=*/{},
-                              /*interpreter_manager=*/nullptr, &chosen);
+                              /*interpreter_manager=*/nullptr,
+                              /*embedding_cache=*/nullptr, &chosen);
   EXPECT_THAT(chosen, ElementsAreArray({0, 1, 2, 3, 4}));
 }
 
@@ -1119,7 +2147,8 @@ TEST(TextClassifierTest, ResolveConflictsThreeSpans) {
 
   std::vector<int> chosen;
   classifier.ResolveConflicts(candidates, /*context=*/"", /*cached_tokens=*/{},
-                              /*interpreter_manager=*/nullptr, &chosen);
+                              /*interpreter_manager=*/nullptr,
+                              /*embedding_cache=*/nullptr, &chosen);
   EXPECT_THAT(chosen, ElementsAreArray({0, 2}));
 }
 
@@ -1135,7 +2164,8 @@ TEST(TextClassifierTest, ResolveConflictsThreeSpansReversed) {
 
   std::vector<int> chosen;
   classifier.ResolveConflicts(candidates, /*context=*/"", /*cached_tokens=*/{},
-                              /*interpreter_manager=*/nullptr, &chosen);
+                              /*interpreter_manager=*/nullptr,
+                              /*embedding_cache=*/nullptr, &chosen);
   EXPECT_THAT(chosen, ElementsAreArray({1}));
 }
 
@@ -1153,7 +2183,8 @@ TEST(TextClassifierTest, ResolveConflictsFiveSpans) {
 
   std::vector<int> chosen;
   classifier.ResolveConflicts(candidates, /*context=*/"", /*cached_tokens=*/{},
-                              /*interpreter_manager=*/nullptr, &chosen);
+                              /*interpreter_manager=*/nullptr,
+                              /*embedding_cache=*/nullptr, &chosen);
   EXPECT_THAT(chosen, ElementsAreArray({0, 2, 4}));
 }
 
@@ -19,11 +19,17 @@
 #include "textclassifier_jni.h"
 
 #include <jni.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <type_traits>
 #include <vector>
 
+#include "classifier-registry.h"
 #include "text-classifier.h"
 #include "util/base/integral_types.h"
+#include "util/java/scoped_global_ref.h"
 #include "util/java/scoped_local_ref.h"
 #include "util/java/string_utils.h"
 #include "util/memory/mmap.h"
@@ -55,232 +61,431 @@ std::string ToStlString(JNIEnv* env, const jstring& str) {
   return result;
 }
 
-jobjectArray ClassificationResultsToJObjectArray(
-    JNIEnv* env,
-    const std::vector<ClassificationResult>& classification_result) {
-  const ScopedLocalRef<jclass> result_class(
-      env->FindClass(TC_PACKAGE_PATH TC_CLASS_NAME_STR "$ClassificationResult"),
-      env);
-  if (!result_class) {
-    TC_LOG(ERROR) << "Couldn't find ClassificationResult class.";
-    return nullptr;
+// A Java class together with the global reference that keeps it loaded.
+ScopedGlobalRef<jclass> FindGlobalClass(JNIEnv* env, JavaVM* jvm,
+                                        const char* name) {
+  const ScopedLocalRef<jclass> clazz(env->FindClass(name), env);
+  if (!clazz) {
+    TC_LOG(ERROR) << "Couldn't find class " << name;
+    env->ExceptionClear();
+    return ScopedGlobalRef<jclass>(nullptr, jvm);
   }
-  const ScopedLocalRef<jclass> datetime_parse_class(
-      env->FindClass(TC_PACKAGE_PATH TC_CLASS_NAME_STR "$DatetimeResult"), env);
-  if (!datetime_parse_class) {
-    TC_LOG(ERROR) << "Couldn't find DatetimeResult class.";
-    return nullptr;
+  return MakeGlobalRef(clazz.get(), env, jvm);
+}
+
+// The getters of one of the Java options classes.
+struct JniOptionsClass {
+  JniOptionsClass(JNIEnv* env, JavaVM* jvm, const char* name)
+      : clazz(FindGlobalClass(env, jvm, name)) {
+    if (!clazz) {
+      return;
+    }
+    get_locale =
+        env->GetMethodID(clazz.get(), "getLocale", "()Ljava/lang/String;");
+    get_reference_timezone = env->GetMethodID(
+        clazz.get(), "getReferenceTimezone", "()Ljava/lang/String;");
+    get_reference_time_ms_utc =
+        env->GetMethodID(clazz.get(), "getReferenceTimeMsUtc", "()J");
   }
 
-  const jmethodID result_class_constructor =
-      env->GetMethodID(result_class.get(), "<init>",
-                       "(Ljava/lang/String;FL" TC_PACKAGE_PATH TC_CLASS_NAME_STR
-                       "$DatetimeResult;)V");
-  const jmethodID datetime_parse_class_constructor =
-      env->GetMethodID(datetime_parse_class.get(), "<init>", "(JI)V");
+  bool ok() const {
+    return get_locale != nullptr && get_reference_timezone != nullptr &&
+           get_reference_time_ms_utc != nullptr;
+  }
 
-  const jobjectArray results = env->NewObjectArray(classification_result.size(),
-                                                   result_class.get(), nullptr);
-  for (int i = 0; i < classification_result.size(); i++) {
+  const ScopedGlobalRef<jclass> clazz;
+  jmethodID get_locale = nullptr;
+  jmethodID get_reference_timezone = nullptr;
+  jmethodID get_reference_time_ms_utc = nullptr;
+};
+
+// The Java classes, methods and fields used by the wrapper. FindClass and
+// GetMethodID are expensive, so they are looked up once, when the library is
+// loaded, instead of on every call.
+struct JniCache {
+  static std::unique_ptr<JniCache> Create(JNIEnv* env) {
+    JavaVM* jvm = nullptr;
+    if (env->GetJavaVM(&jvm) != JNI_OK) {
+      TC_LOG(ERROR) << "Couldn't get the Java VM.";
+      return nullptr;
+    }
+    std::unique_ptr<JniCache> cache(new JniCache(env, jvm));
+    if (!cache->ok()) {
+      TC_LOG(ERROR) << "Couldn't look up the Java classes.";
+      env->ExceptionClear();
+      return nullptr;
+    }
+    return cache;
+  }
+
+  const ScopedGlobalRef<jclass> classification_result;
+  const ScopedGlobalRef<jclass> classification_result_array;
+  const ScopedGlobalRef<jclass> datetime_result;
+  const ScopedGlobalRef<jclass> annotated_span;
+  const ScopedGlobalRef<jclass> annotated_span_array;
+  const ScopedGlobalRef<jclass> selection_options;
+  const JniOptionsClass classification_options;
+  const JniOptionsClass annotation_options;
+  const ScopedGlobalRef<jclass> asset_file_descriptor;
+  const ScopedGlobalRef<jclass> file_descriptor;
+  const ScopedGlobalRef<jclass> object;
+  const ScopedGlobalRef<jclass> string;
+
+  jmethodID classification_result_constructor = nullptr;
+  jmethodID datetime_result_constructor = nullptr;
+  jmethodID annotated_span_constructor = nullptr;
+  jmethodID selection_options_get_locales = nullptr;
+  jmethodID asset_file_descriptor_get_file_descriptor = nullptr;
+  jfieldID file_descriptor_descriptor = nullptr;
+
+ private:
+  JniCache(JNIEnv* env, JavaVM* jvm)
+      : classification_result(FindGlobalClass(
+            env, jvm,
+            TC_PACKAGE_PATH TC_CLASS_NAME_STR "$ClassificationResult")),
+        classification_result_array(FindGlobalClass(
+            env, jvm,
+            "[L" TC_PACKAGE_PATH TC_CLASS_NAME_STR "$ClassificationResult;")),
+        datetime_result(FindGlobalClass(
+            env, jvm, TC_PACKAGE_PATH TC_CLASS_NAME_STR "$DatetimeResult")),
+        annotated_span(FindGlobalClass(
+            env, jvm, TC_PACKAGE_PATH TC_CLASS_NAME_STR "$AnnotatedSpan")),
+        annotated_span_array(FindGlobalClass(
+            env, jvm,
+            "[L" TC_PACKAGE_PATH TC_CLASS_NAME_STR "$AnnotatedSpan;")),
+        selection_options(FindGlobalClass(
+            env, jvm, TC_PACKAGE_PATH TC_CLASS_NAME_STR "$SelectionOptions")),
+        classification_options(
+            env, jvm,
+            TC_PACKAGE_PATH TC_CLASS_NAME_STR "$ClassificationOptions"),
+        annotation_options(
+            env, jvm, TC_PACKAGE_PATH TC_CLASS_NAME_STR "$AnnotationOptions"),
+        asset_file_descriptor(FindGlobalClass(
+            env, jvm, "android/content/res/AssetFileDescriptor")),
+        file_descriptor(FindGlobalClass(env, jvm, "java/io/FileDescriptor")),
+        object(FindGlobalClass(env, jvm, "java/lang/Object")),
+        string(FindGlobalClass(env, jvm, "java/lang/String")) {
+    if (!classification_result || !classification_result_array ||
+        !datetime_result || !annotated_span || !annotated_span_array ||
+        !selection_options || !asset_file_descriptor || !file_descriptor ||
+        !object || !string) {
+      return;
+    }
+    classification_result_constructor = env->GetMethodID(
+        classification_result.get(), "<init>",
+        "(Ljava/lang/String;FL" TC_PACKAGE_PATH TC_CLASS_NAME_STR
+        "$DatetimeResult;)V");
+    datetime_result_constructor =
+        env->GetMethodID(datetime_result.get(), "<init>", "(JI)V");
+    annotated_span_constructor = env->GetMethodID(
+        annotated_span.get(), "<init>",
+        "(II[L" TC_PACKAGE_PATH TC_CLASS_NAME_STR "$ClassificationResult;)V");
+    selection_options_get_locales = env->GetMethodID(
+        selection_options.get(), "getLocales", "()Ljava/lang/String;");
+    asset_file_descriptor_get_file_descriptor =
+        env->GetMethodID(asset_file_descriptor.get(), "getFileDescriptor",
+                         "()Ljava/io/FileDescriptor;");
+    file_descriptor_descriptor =
+        env->GetFieldID(file_descriptor.get(), "descriptor", "I");
+  }
+
+  bool ok() const {
+    return classification_result_constructor != nullptr &&
+           datetime_result_constructor != nullptr &&
+           annotated_span_constructor != nullptr &&
+           selection_options_get_locales != nullptr &&
+           asset_file_descriptor_get_file_descriptor != nullptr &&
+           file_descriptor_descriptor != nullptr &&
+           classification_options.ok() && annotation_options.ok();
+  }
+};
+
+// Filled in by JNI_OnLoad, or by the first call that needs it if the library
+// was loaded without JNI_OnLoad being called. Once it is set, the calls read it
+// without taking the mutex, which only serializes creating and releasing it.
+std::mutex jni_cache_mutex;
+std::atomic<JniCache*> jni_cache_instance(nullptr);
+
+// Takes the results as an array, so that both std::vector and
+// ClassificationResults convert without a copy.
+jobjectArray ClassificationResultsToJObjectArray(
+    JNIEnv* env, const JniCache& jni_cache,
+    const ClassificationResult* classification_result, int num_results) {
+  const jobjectArray results = env->NewObjectArray(
+      num_results, jni_cache.classification_result.get(), nullptr);
+  for (int i = 0; i < num_results; i++) {
     jstring row_string =
         env->NewStringUTF(classification_result[i].collection.c_str());
     jobject row_datetime_parse = nullptr;
-    if (classification_result[i].datetime_parse_result.IsSet()) {
+    const DatetimeParseResult& datetime_parse_result =
+        classification_result[i].datetime_parse_result;
+    if (datetime_parse_result.IsSet()) {
       row_datetime_parse = env->NewObject(
-          datetime_parse_class.get(), datetime_parse_class_constructor,
-          classification_result[i].datetime_parse_result.time_ms_utc,
-          classification_result[i].datetime_parse_result.granularity);
+          jni_cache.datetime_result.get(),
+          jni_cache.datetime_result_constructor,
+          datetime_parse_result.time_ms_utc, datetime_parse_result.granularity);
     }
-    jobject result =
-        env->NewObject(result_class.get(), result_class_constructor, row_string,
-                       static_cast<jfloat>(classification_result[i].score),
-                       row_datetime_parse);
+    jobject result = env->NewObject(
+        jni_cache.classification_result.get(),
+        jni_cache.classification_result_constructor, row_string,
+        static_cast<jfloat>(classification_result[i].score),
+        row_datetime_parse);
     env->SetObjectArrayElement(results, i, result);
     env->DeleteLocalRef(result);
+    env->DeleteLocalRef(row_string);
+    if (row_datetime_parse != nullptr) {
+      env->DeleteLocalRef(row_datetime_parse);
+    }
   }
   return results;
 }
 
-template <typename T, typename F>
-std::pair<bool, T> CallJniMethod0(JNIEnv* env, jobject object,
-                                  jclass class_object, F function,
-                                  const std::string& method_name,
-                                  const std::string& return_java_type) {
-  const jmethodID method = env->GetMethodID(class_object, method_name.c_str(),
-                                            ("()" + return_java_type).c_str());
-  if (!method) {
-    return std::make_pair(false, T());
+jobjectArray AnnotatedSpansToJObjectArray(
+    JNIEnv* env, const JniCache& jni_cache,
+    const std::string& context_utf8,
+    const std::vector<AnnotatedSpan>& annotations) {
+  // Walks the context once, instead of once per annotation.
+  const BMPIndexConverter index_converter(context_utf8);
+  jobjectArray results = env->NewObjectArray(
+      annotations.size(), jni_cache.annotated_span.get(), nullptr);
+  for (int i = 0; i < annotations.size(); ++i) {
+    const CodepointSpan span_bmp =
+        index_converter.UTF8ToBMP(annotations[i].span);
+    jobjectArray classification = ClassificationResultsToJObjectArray(
+        env, jni_cache, annotations[i].classification.data(),
+        annotations[i].classification.size());
+    jobject result = env->NewObject(
+        jni_cache.annotated_span.get(), jni_cache.annotated_span_constructor,
+        static_cast<jint>(span_bmp.first), static_cast<jint>(span_bmp.second),
+        classification);
+    env->SetObjectArrayElement(results, i, result);
+    env->DeleteLocalRef(result);
+    env->DeleteLocalRef(classification);
   }
-  return std::make_pair(true, (env->*function)(object, method));
+  return results;
 }
 
-SelectionOptions FromJavaSelectionOptions(JNIEnv* env, jobject joptions) {
+SelectionOptions FromJavaSelectionOptions(JNIEnv* env,
+                                          const JniCache& jni_cache,
+                                          jobject joptions) {
   if (!joptions) {
     return {};
   }
 
-  const ScopedLocalRef<jclass> options_class(
-      env->FindClass(TC_PACKAGE_PATH TC_CLASS_NAME_STR "$SelectionOptions"),
+  const ScopedLocalRef<jstring> locales(
+      reinterpret_cast<jstring>(env->CallObjectMethod(
+          joptions, jni_cache.selection_options_get_locales)),
       env);
-  const std::pair<bool, jobject> status_or_locales = CallJniMethod0<jobject>(
-      env, joptions, options_class.get(), &JNIEnv::CallObjectMethod,
-      "getLocales", "Ljava/lang/String;");
-  if (!status_or_locales.first) {
-    return {};
-  }
 
   SelectionOptions options;
-  options.locales =
-      ToStlString(env, reinterpret_cast<jstring>(status_or_locales.second));
+  options.locales = ToStlString(env, locales.get());
 
   return options;
 }
 
 template <typename T>
-T FromJavaOptionsInternal(JNIEnv* env, jobject joptions,
-                          const std::string& class_name) {
+T FromJavaOptionsInternal(JNIEnv* env, const JniOptionsClass& options_class,
+                          jobject joptions) {
   if (!joptions) {
     return {};
   }
 
-  const ScopedLocalRef<jclass> options_class(env->FindClass(class_name.c_str()),
-                                             env);
-  if (!options_class) {
-    return {};
-  }
-
-  const std::pair<bool, jobject> status_or_locales = CallJniMethod0<jobject>(
-      env, joptions, options_class.get(), &JNIEnv::CallObjectMethod,
-      "getLocale", "Ljava/lang/String;");
-  const std::pair<bool, jobject> status_or_reference_timezone =
-      CallJniMethod0<jobject>(env, joptions, options_class.get(),
-                              &JNIEnv::CallObjectMethod, "getReferenceTimezone",
-                              "Ljava/lang/String;");
-  const std::pair<bool, int64> status_or_reference_time_ms_utc =
-      CallJniMethod0<int64>(env, joptions, options_class.get(),
-                            &JNIEnv::CallLongMethod, "getReferenceTimeMsUtc",
-                            "J");
-
-  if (!status_or_locales.first || !status_or_reference_timezone.first ||
-      !status_or_reference_time_ms_utc.first) {
-    return {};
-  }
+  const ScopedLocalRef<jstring> locales(
+      reinterpret_cast<jstring>(
+          env->CallObjectMethod(joptions, options_class.get_locale)),
+      env);
+  const ScopedLocalRef<jstring> reference_timezone(
+      reinterpret_cast<jstring>(env->CallObjectMethod(
+          joptions, options_class.get_reference_timezone)),
+      env);
+  const int64 reference_time_ms_utc =
+      env->CallLongMethod(joptions, options_class.get_reference_time_ms_utc);
 
   T options;
-  options.locales =
-      ToStlString(env, reinterpret_cast<jstring>(status_or_locales.second));
-  options.reference_timezone = ToStlString(
-      env, reinterpret_cast<jstring>(status_or_reference_timezone.second));
-  options.reference_time_ms_utc = status_or_reference_time_ms_utc.second;
+  options.locales = ToStlString(env, locales.get());
+  options.reference_timezone = ToStlString(env, reference_timezone.get());
+  options.reference_time_ms_utc = reference_time_ms_utc;
   return options;
 }
 
 ClassificationOptions FromJavaClassificationOptions(JNIEnv* env,
+                                                    const JniCache& jni_cache,
                                                     jobject joptions) {
   return FromJavaOptionsInternal<ClassificationOptions>(
-      env, joptions,
-      TC_PACKAGE_PATH TC_CLASS_NAME_STR "$ClassificationOptions");
+      env, jni_cache.classification_options, joptions);
 }
 
-AnnotationOptions FromJavaAnnotationOptions(JNIEnv* env, jobject joptions) {
+AnnotationOptions FromJavaAnnotationOptions(JNIEnv* env,
+                                            const JniCache& jni_cache,
+                                            jobject joptions) {
   return FromJavaOptionsInternal<AnnotationOptions>(
-      env, joptions, TC_PACKAGE_PATH TC_CLASS_NAME_STR "$AnnotationOptions");
+      env, jni_cache.annotation_options, joptions);
 }
 
-CodepointSpan ConvertIndicesBMPUTF8(const std::string& utf8_str,
-                                    CodepointSpan orig_indices,
-                                    bool from_utf8) {
-  const libtextclassifier2::UnicodeText unicode_str =
-      libtextclassifier2::UTF8ToUnicodeText(utf8_str, /*do_copy=*/false);
+}  // namespace
 
-  int unicode_index = 0;
-  int bmp_index = 0;
+// Returns a handle for Java that holds on to the classifier until it is passed
+// to nativeClose, or 0 if the classifier is null.
+jlong ToJavaHandle(std::shared_ptr<const TextClassifier> classifier) {
+  if (classifier == nullptr) {
+    return 0;
+  }
+  return reinterpret_cast<jlong>(
+      new std::shared_ptr<const TextClassifier>(std::move(classifier)));
+}
 
-  const int* source_index;
-  const int* target_index;
-  if (from_utf8) {
-    source_index = &unicode_index;
-    target_index = &bmp_index;
-  } else {
-    source_index = &bmp_index;
-    target_index = &unicode_index;
-  }
-
-  CodepointSpan result{-1, -1};
-  std::function<void()> assign_indices_fn = [&result, &orig_indices,
-                                             &source_index, &target_index]() {
-    if (orig_indices.first == *source_index) {
-      result.first = *target_index;
-    }
+const TextClassifier* FromJavaHandle(jlong handle) {
+  return reinterpret_cast<std::shared_ptr<const TextClassifier>*>(handle)
+      ->get();
+}
 
-    if (orig_indices.second == *source_index) {
-      result.second = *target_index;
-    }
-  };
+BMPIndexConverter::BMPIndexConverter(const std::string& utf8_str) {
+  const UnicodeText unicode_str =
+      UTF8ToUnicodeText(utf8_str, /*do_copy=*/false);
 
+  int unicode_index = 0;
+  int bmp_index = 0;
   for (auto it = unicode_str.begin(); it != unicode_str.end();
        ++it, ++unicode_index, ++bmp_index) {
-    assign_indices_fn();
+    if (!bmp_offsets_.empty()) {
+      bmp_offsets_.push_back(bmp_index);
+    }
 
     // There is 1 extra character in the input for each UTF8 character > 0xFFFF.
     if (*it > 0xFFFF) {
+      if (bmp_offsets_.empty()) {
+        // Up to here the indices were the same in both encodings.
+        for (int i = 0; i <= unicode_index; ++i) {
+          bmp_offsets_.push_back(i);
+        }
+      }
       ++bmp_index;
     }
   }
-  assign_indices_fn();
+  if (!bmp_offsets_.empty()) {
+    bmp_offsets_.push_back(bmp_index);
+  }
+  num_codepoints_ = unicode_index;
+}
 
-  return result;
+CodepointSpan BMPIndexConverter::UTF8ToBMP(CodepointSpan utf8_indices) const {
+  return {UTF8ToBMP(utf8_indices.first), UTF8ToBMP(utf8_indices.second)};
 }
 
-}  // namespace
+CodepointSpan BMPIndexConverter::BMPToUTF8(CodepointSpan bmp_indices) const {
+  return {BMPToUTF8(bmp_indices.first), BMPToUTF8(bmp_indices.second)};
+}
+
+int BMPIndexConverter::UTF8ToBMP(int utf8_index) const {
+  if (utf8_index < 0 || utf8_index > num_codepoints_) {
+    return -1;
+  }
+  if (bmp_offsets_.empty()) {
+    return utf8_index;
+  }
+  return bmp_offsets_[utf8_index];
+}
+
+int BMPIndexConverter::BMPToUTF8(int bmp_index) const {
+  if (bmp_offsets_.empty()) {
+    return bmp_index >= 0 && bmp_index <= num_codepoints_ ? bmp_index : -1;
+  }
+  const auto it =
+      std::lower_bound(bmp_offsets_.begin(), bmp_offsets_.end(), bmp_index);
+  if (it == bmp_offsets_.end() || *it != bmp_index) {
+    // Either out of range, or points into the middle of a surrogate pair.
+    return -1;
+  }
+  return it - bmp_offsets_.begin();
+}
 
 CodepointSpan ConvertIndicesBMPToUTF8(const std::string& utf8_str,
                                       CodepointSpan bmp_indices) {
-  return ConvertIndicesBMPUTF8(utf8_str, bmp_indices, /*from_utf8=*/false);
+  return BMPIndexConverter(utf8_str).BMPToUTF8(bmp_indices);
 }
 
 CodepointSpan ConvertIndicesUTF8ToBMP(const std::string& utf8_str,
                                       CodepointSpan utf8_indices) {
-  return ConvertIndicesBMPUTF8(utf8_str, utf8_indices, /*from_utf8=*/true);
+  return BMPIndexConverter(utf8_str).UTF8ToBMP(utf8_indices);
 }
 
-jint GetFdFromAssetFileDescriptor(JNIEnv* env, jobject afd) {
-  // Get system-level file descriptor from AssetFileDescriptor.
-  ScopedLocalRef<jclass> afd_class(
-      env->FindClass("android/content/res/AssetFileDescriptor"), env);
-  if (afd_class == nullptr) {
-    TC_LOG(ERROR) << "Couldn't find AssetFileDescriptor.";
-    return reinterpret_cast<jlong>(nullptr);
+void PackAnnotations(
+    const std::string& context_utf8,
+    const std::vector<AnnotatedSpan>& annotations,
+    const std::function<int(const std::string&)>& collection_id,
+    PackedAnnotations* packed) {
+  const BMPIndexConverter index_converter(context_utf8);
+  int num_results = 0;
+  for (const AnnotatedSpan& annotation : annotations) {
+    num_results += annotation.classification.size();
   }
-  jmethodID afd_class_getFileDescriptor = env->GetMethodID(
-      afd_class.get(), "getFileDescriptor", "()Ljava/io/FileDescriptor;");
-  if (afd_class_getFileDescriptor == nullptr) {
-    TC_LOG(ERROR) << "Couldn't find getFileDescriptor.";
-    return reinterpret_cast<jlong>(nullptr);
+  packed->spans.clear();
+  packed->spans.reserve(3 * annotations.size());
+  packed->scores.clear();
+  packed->scores.reserve(num_results);
+  packed->collection_ids.clear();
+  packed->collection_ids.reserve(num_results);
+  packed->datetimes.clear();
+  packed->datetimes.reserve(2 * num_results);
+  for (const AnnotatedSpan& annotation : annotations) {
+    const CodepointSpan span_bmp = index_converter.UTF8ToBMP(annotation.span);
+    for (const ClassificationResult& result : annotation.classification) {
+      packed->scores.push_back(result.score);
+      packed->collection_ids.push_back(collection_id(result.collection));
+      if (result.datetime_parse_result.IsSet()) {
+        packed->datetimes.push_back(result.datetime_parse_result.time_ms_utc);
+        packed->datetimes.push_back(result.datetime_parse_result.granularity);
+      } else {
+        packed->datetimes.push_back(-1);
+        packed->datetimes.push_back(-1);
+      }
+    }
+    packed->spans.push_back(span_bmp.first);
+    packed->spans.push_back(span_bmp.second);
+    packed->spans.push_back(packed->scores.size());
   }
+}
 
-  ScopedLocalRef<jclass> fd_class(env->FindClass("java/io/FileDescriptor"),
-                                  env);
-  if (fd_class == nullptr) {
-    TC_LOG(ERROR) << "Couldn't find FileDescriptor.";
-    return reinterpret_cast<jlong>(nullptr);
+// Returns the JNI cache, or nullptr if the Java classes couldn't be found.
+const JniCache* GetJniCache(JNIEnv* env) {
+  JniCache* jni_cache = jni_cache_instance.load(std::memory_order_acquire);
+  if (jni_cache != nullptr) {
+    return jni_cache;
   }
-  jfieldID fd_class_descriptor =
-      env->GetFieldID(fd_class.get(), "descriptor", "I");
-  if (fd_class_descriptor == nullptr) {
-    TC_LOG(ERROR) << "Couldn't find descriptor.";
-    return reinterpret_cast<jlong>(nullptr);
+  std::lock_guard<std::mutex> lock(jni_cache_mutex);
+  jni_cache = jni_cache_instance.load(std::memory_order_relaxed);
+  if (jni_cache == nullptr) {
+    jni_cache = JniCache::Create(env).release();
+    jni_cache_instance.store(jni_cache, std::memory_order_release);
   }
+  return jni_cache;
+}
+
+void ReleaseJniCache() {
+  // Only called from JNI_OnUnload, when no other call can be running.
+  std::lock_guard<std::mutex> lock(jni_cache_mutex);
+  delete jni_cache_instance.exchange(nullptr, std::memory_order_acq_rel);
+}
 
-  jobject bundle_jfd = env->CallObjectMethod(afd, afd_class_getFileDescriptor);
-  return env->GetIntField(bundle_jfd, fd_class_descriptor);
+jint GetFdFromAssetFileDescriptor(JNIEnv* env, jobject afd) {
+  const JniCache* jni_cache = GetJniCache(env);
+  if (jni_cache == nullptr) {
+    return reinterpret_cast<jlong>(nullptr);
+  }
+  // Get system-level file descriptor from AssetFileDescriptor.
+  const ScopedLocalRef<jobject> bundle_jfd(
+      env->CallObjectMethod(
+          afd, jni_cache->asset_file_descriptor_get_file_descriptor),
+      env);
+  return env->GetIntField(bundle_jfd.get(),
+                          jni_cache->file_descriptor_descriptor);
 }
 
 jstring GetLocalesFromMmap(JNIEnv* env, libtextclassifier2::ScopedMmap* mmap) {
   if (!mmap->handle().ok()) {
     return env->NewStringUTF("");
   }
-  const Model* model = libtextclassifier2::ViewModel(
+  const Model* model = libtextclassifier2::ViewModelMetadata(
       mmap->handle().start(), mmap->handle().num_bytes());
   if (!model || !model->locales()) {
     return env->NewStringUTF("");
@@ -292,7 +497,7 @@ jint GetVersionFromMmap(JNIEnv* env, libtextclassifier2::ScopedMmap* mmap) {
   if (!mmap->handle().ok()) {
     return 0;
   }
-  const Model* model = libtextclassifier2::ViewModel(
+  const Model* model = libtextclassifier2::ViewModelMetadata(
       mmap->handle().start(), mmap->handle().num_bytes());
   if (!model) {
     return 0;
@@ -304,7 +509,7 @@ jstring GetNameFromMmap(JNIEnv* env, libtextclassifier2::ScopedMmap* mmap) {
   if (!mmap->handle().ok()) {
     return env->NewStringUTF("");
   }
-  const Model* model = libtextclassifier2::ViewModel(
+  const Model* model = libtextclassifier2::ViewModelMetadata(
       mmap->handle().start(), mmap->handle().num_bytes());
   if (!model || !model->name()) {
     return env->NewStringUTF("");
@@ -314,22 +519,32 @@ jstring GetNameFromMmap(JNIEnv* env, libtextclassifier2::ScopedMmap* mmap) {
 
 }  // namespace libtextclassifier2
 
+using libtextclassifier2::AnnotatedSpansToJObjectArray;
 using libtextclassifier2::ClassificationResultsToJObjectArray;
+using libtextclassifier2::BMPIndexConverter;
 using libtextclassifier2::ConvertIndicesBMPToUTF8;
-using libtextclassifier2::ConvertIndicesUTF8ToBMP;
 using libtextclassifier2::FromJavaAnnotationOptions;
 using libtextclassifier2::FromJavaClassificationOptions;
+using libtextclassifier2::FromJavaHandle;
 using libtextclassifier2::FromJavaSelectionOptions;
+using libtextclassifier2::GetJniCache;
+using libtextclassifier2::PackAnnotations;
+using libtextclassifier2::PackedAnnotations;
+using libtextclassifier2::ToJavaHandle;
 using libtextclassifier2::ToStlString;
 
+// The handles are shared pointers to the classifiers, so that the handles for
+// the same model can share one classifier. With the Java ICU UniLib, which is
+// bound to the JNIEnv, every handle gets a classifier of its own.
 JNI_METHOD(jlong, TC_CLASS_NAME, nativeNew)
 (JNIEnv* env, jobject thiz, jint fd) {
 #ifdef LIBTEXTCLASSIFIER_UNILIB_JAVAICU
-  return reinterpret_cast<jlong>(
-      TextClassifier::FromFileDescriptor(fd).release(), new UniLib(env));
+  return ToJavaHandle(std::shared_ptr<const TextClassifier>(
+      TextClassifier::FromFileDescriptor(fd, new UniLib(env)).release()));
 #else
-  return reinterpret_cast<jlong>(
-      TextClassifier::FromFileDescriptor(fd).release());
+  return ToJavaHandle(
+      libtextclassifier2::ClassifierRegistry::Instance()->FromFileDescriptor(
+          fd));
 #endif
 }
 
@@ -337,10 +552,11 @@ JNI_METHOD(jlong, TC_CLASS_NAME, nativeNewFromPath)
 (JNIEnv* env, jobject thiz, jstring path) {
   const std::string path_str = ToStlString(env, path);
 #ifdef LIBTEXTCLASSIFIER_UNILIB_JAVAICU
-  return reinterpret_cast<jlong>(
-      TextClassifier::FromPath(path_str, new UniLib(env)).release());
+  return ToJavaHandle(std::shared_ptr<const TextClassifier>(
+      TextClassifier::FromPath(path_str, new UniLib(env)).release()));
 #else
-  return reinterpret_cast<jlong>(TextClassifier::FromPath(path_str).release());
+  return ToJavaHandle(
+      libtextclassifier2::ClassifierRegistry::Instance()->FromPath(path_str));
 #endif
 }
 
@@ -348,12 +564,13 @@ JNI_METHOD(jlong, TC_CLASS_NAME, nativeNewFromAssetFileDescriptor)
 (JNIEnv* env, jobject thiz, jobject afd, jlong offset, jlong size) {
   const jint fd = libtextclassifier2::GetFdFromAssetFileDescriptor(env, afd);
 #ifdef LIBTEXTCLASSIFIER_UNILIB_JAVAICU
-  return reinterpret_cast<jlong>(
+  return ToJavaHandle(std::shared_ptr<const TextClassifier>(
       TextClassifier::FromFileDescriptor(fd, offset, size, new UniLib(env))
-          .release());
+          .release()));
 #else
-  return reinterpret_cast<jlong>(
-      TextClassifier::FromFileDescriptor(fd, offset, size).release());
+  return ToJavaHandle(
+      libtextclassifier2::ClassifierRegistry::Instance()->FromFileDescriptor(
+          fd, offset, size));
 #endif
 }
 
@@ -364,14 +581,20 @@ JNI_METHOD(jintArray, TC_CLASS_NAME, nativeSuggestSelection)
     return nullptr;
   }
 
-  TextClassifier* model = reinterpret_cast<TextClassifier*>(ptr);
+  const libtextclassifier2::JniCache* jni_cache = GetJniCache(env);
+  if (jni_cache == nullptr) {
+    return nullptr;
+  }
+  const TextClassifier* model = FromJavaHandle(ptr);
 
   const std::string context_utf8 = ToStlString(env, context);
+  const BMPIndexConverter index_converter(context_utf8);
   CodepointSpan input_indices =
-      ConvertIndicesBMPToUTF8(context_utf8, {selection_begin, selection_end});
+      index_converter.BMPToUTF8({selection_begin, selection_end});
   CodepointSpan selection = model->SuggestSelection(
-      context_utf8, input_indices, FromJavaSelectionOptions(env, options));
-  selection = ConvertIndicesUTF8ToBMP(context_utf8, selection);
+      context_utf8, input_indices,
+      FromJavaSelectionOptions(env, *jni_cache, options));
+  selection = index_converter.UTF8ToBMP(selection);
 
   jintArray result = env->NewIntArray(2);
   env->SetIntArrayRegion(result, 0, 1, &(std::get<0>(selection)));
@@ -385,16 +608,23 @@ JNI_METHOD(jobjectArray, TC_CLASS_NAME, nativeClassifyText)
   if (!ptr) {
     return nullptr;
   }
-  TextClassifier* ff_model = reinterpret_cast<TextClassifier*>(ptr);
+  const libtextclassifier2::JniCache* jni_cache = GetJniCache(env);
+  if (jni_cache == nullptr) {
+    return nullptr;
+  }
+  const TextClassifier* ff_model = FromJavaHandle(ptr);
 
   const std::string context_utf8 = ToStlString(env, context);
   const CodepointSpan input_indices =
       ConvertIndicesBMPToUTF8(context_utf8, {selection_begin, selection_end});
   const std::vector<ClassificationResult> classification_result =
-      ff_model->ClassifyText(context_utf8, input_indices,
-                             FromJavaClassificationOptions(env, options));
+      ff_model->ClassifyText(
+          context_utf8, input_indices,
+          FromJavaClassificationOptions(env, *jni_cache, options));
 
-  return ClassificationResultsToJObjectArray(env, classification_result);
+  return ClassificationResultsToJObjectArray(env, *jni_cache,
+                                             classification_result.data(),
+                                             classification_result.size());
 }
 
 JNI_METHOD(jobjectArray, TC_CLASS_NAME, nativeAnnotate)
@@ -402,46 +632,217 @@ JNI_METHOD(jobjectArray, TC_CLASS_NAME, nativeAnnotate)
   if (!ptr) {
     return nullptr;
   }
-  TextClassifier* model = reinterpret_cast<TextClassifier*>(ptr);
-  std::string context_utf8 = ToStlString(env, context);
-  std::vector<AnnotatedSpan> annotations =
-      model->Annotate(context_utf8, FromJavaAnnotationOptions(env, options));
-
-  jclass result_class =
-      env->FindClass(TC_PACKAGE_PATH TC_CLASS_NAME_STR "$AnnotatedSpan");
-  if (!result_class) {
-    TC_LOG(ERROR) << "Couldn't find result class: "
-                  << TC_PACKAGE_PATH TC_CLASS_NAME_STR "$AnnotatedSpan";
+  const libtextclassifier2::JniCache* jni_cache = GetJniCache(env);
+  if (jni_cache == nullptr) {
     return nullptr;
   }
+  const TextClassifier* model = FromJavaHandle(ptr);
+  std::string context_utf8 = ToStlString(env, context);
+  std::vector<AnnotatedSpan> annotations = model->Annotate(
+      context_utf8, FromJavaAnnotationOptions(env, *jni_cache, options));
 
-  jmethodID result_class_constructor = env->GetMethodID(
-      result_class, "<init>",
-      "(II[L" TC_PACKAGE_PATH TC_CLASS_NAME_STR "$ClassificationResult;)V");
+  return AnnotatedSpansToJObjectArray(env, *jni_cache, context_utf8,
+                                      annotations);
+}
 
-  jobjectArray results =
-      env->NewObjectArray(annotations.size(), result_class, nullptr);
+JNI_METHOD(jintArray, TC_CLASS_NAME, nativeSuggestSelectionBatch)
+(JNIEnv* env, jobject thiz, jlong ptr, jobjectArray contexts,
+ jintArray selection_begins, jintArray selection_ends, jobject options) {
+  if (!ptr) {
+    return nullptr;
+  }
+  const libtextclassifier2::JniCache* jni_cache = GetJniCache(env);
+  if (jni_cache == nullptr) {
+    return nullptr;
+  }
+  const TextClassifier* model = FromJavaHandle(ptr);
+  const int num_inputs = env->GetArrayLength(contexts);
+  if (env->GetArrayLength(selection_begins) != num_inputs ||
+      env->GetArrayLength(selection_ends) != num_inputs) {
+    TC_LOG(ERROR) << "Mismatching batch sizes.";
+    return nullptr;
+  }
+  std::vector<jint> begins(num_inputs);
+  std::vector<jint> ends(num_inputs);
+  env->GetIntArrayRegion(selection_begins, 0, num_inputs, begins.data());
+  env->GetIntArrayRegion(selection_ends, 0, num_inputs, ends.data());
+  const SelectionOptions selection_options =
+      FromJavaSelectionOptions(env, *jni_cache, options);
+
+  // The selections are returned as consecutive (begin, end) pairs.
+  std::vector<jint> selections(2 * num_inputs);
+  for (int i = 0; i < num_inputs; ++i) {
+    const ScopedLocalRef<jstring> context(
+        reinterpret_cast<jstring>(env->GetObjectArrayElement(contexts, i)),
+        env);
+    const std::string context_utf8 = ToStlString(env, context.get());
+    const BMPIndexConverter index_converter(context_utf8);
+    CodepointSpan selection = model->SuggestSelection(
+        context_utf8, index_converter.BMPToUTF8({begins[i], ends[i]}),
+        selection_options);
+    selection = index_converter.UTF8ToBMP(selection);
+    selections[2 * i] = selection.first;
+    selections[2 * i + 1] = selection.second;
+  }
 
-  for (int i = 0; i < annotations.size(); ++i) {
-    CodepointSpan span_bmp =
-        ConvertIndicesUTF8ToBMP(context_utf8, annotations[i].span);
-    jobject result = env->NewObject(
-        result_class, result_class_constructor,
-        static_cast<jint>(span_bmp.first), static_cast<jint>(span_bmp.second),
-        ClassificationResultsToJObjectArray(env,
+  jintArray result = env->NewIntArray(selections.size());
+  env->SetIntArrayRegion(result, 0, selections.size(), selections.data());
+  return result;
+}
+
+JNI_METHOD(jobjectArray, TC_CLASS_NAME, nativeClassifyTextBatch)
+(JNIEnv* env, jobject thiz, jlong ptr, jobjectArray contexts,
+ jintArray selection_begins, jintArray selection_ends, jobject options) {
+  if (!ptr) {
+    return nullptr;
+  }
+  const libtextclassifier2::JniCache* jni_cache = GetJniCache(env);
+  if (jni_cache == nullptr) {
+    return nullptr;
+  }
+  const TextClassifier* model = FromJavaHandle(ptr);
+  const int num_inputs = env->GetArrayLength(contexts);
+  if (env->GetArrayLength(selection_begins) != num_inputs ||
+      env->GetArrayLength(selection_ends) != num_inputs) {
+    TC_LOG(ERROR) << "Mismatching batch sizes.";
+    return nullptr;
+  }
+  std::vector<jint> begins(num_inputs);
+  std::vector<jint> ends(num_inputs);
+  env->GetIntArrayRegion(selection_begins, 0, num_inputs, begins.data());
+  env->GetIntArrayRegion(selection_ends, 0, num_inputs, ends.data());
+  const ClassificationOptions classification_options =
+      FromJavaClassificationOptions(env, *jni_cache, options);
+
+  jobjectArray results = env->NewObjectArray(
+      num_inputs, jni_cache->classification_result_array.get(), nullptr);
+  for (int i = 0; i < num_inputs; ++i) {
+    const ScopedLocalRef<jstring> context(
+        reinterpret_cast<jstring>(env->GetObjectArrayElement(contexts, i)),
+        env);
+    const std::string context_utf8 = ToStlString(env, context.get());
+    const std::vector<ClassificationResult> classification_result =
+        model->ClassifyText(
+            context_utf8,
+            ConvertIndicesBMPToUTF8(context_utf8, {begins[i], ends[i]}),
+            classification_options);
+    jobjectArray result = ClassificationResultsToJObjectArray(
+        env, *jni_cache, classification_result.data(),
+        classification_result.size());
+    env->SetObjectArrayElement(results, i, result);
+    env->DeleteLocalRef(result);
+  }
+  return results;
+}
 
-                                            annotations[i].classification));
+JNI_METHOD(jobjectArray, TC_CLASS_NAME, nativeAnnotateBatch)
+(JNIEnv* env, jobject thiz, jlong ptr, jobjectArray contexts,
+ jobject options) {
+  if (!ptr) {
+    return nullptr;
+  }
+  const libtextclassifier2::JniCache* jni_cache = GetJniCache(env);
+  if (jni_cache == nullptr) {
+    return nullptr;
+  }
+  const TextClassifier* model = FromJavaHandle(ptr);
+  const AnnotationOptions annotation_options =
+      FromJavaAnnotationOptions(env, *jni_cache, options);
+
+  const int num_inputs = env->GetArrayLength(contexts);
+  std::vector<std::string> contexts_utf8(num_inputs);
+  for (int i = 0; i < num_inputs; ++i) {
+    const ScopedLocalRef<jstring> context(
+        reinterpret_cast<jstring>(env->GetObjectArrayElement(contexts, i)),
+        env);
+    contexts_utf8[i] = ToStlString(env, context.get());
+  }
+  const std::vector<std::vector<AnnotatedSpan>> annotations =
+      model->AnnotateDocuments(contexts_utf8, annotation_options);
+
+  jobjectArray results = env->NewObjectArray(
+      num_inputs, jni_cache->annotated_span_array.get(), nullptr);
+  for (int i = 0; i < num_inputs; ++i) {
+    jobjectArray result = AnnotatedSpansToJObjectArray(
+        env, *jni_cache, contexts_utf8[i], annotations[i]);
     env->SetObjectArrayElement(results, i, result);
     env->DeleteLocalRef(result);
   }
-  env->DeleteLocalRef(result_class);
   return results;
 }
 
+JNI_METHOD(jobjectArray, TC_CLASS_NAME, nativeAnnotatePacked)
+(JNIEnv* env, jobject thiz, jlong ptr, jstring context, jobject options) {
+  if (!ptr) {
+    return nullptr;
+  }
+  const libtextclassifier2::JniCache* jni_cache = GetJniCache(env);
+  if (jni_cache == nullptr) {
+    return nullptr;
+  }
+  const TextClassifier* model = FromJavaHandle(ptr);
+  const std::string context_utf8 = ToStlString(env, context);
+  const std::vector<AnnotatedSpan> annotations = model->Annotate(
+      context_utf8, FromJavaAnnotationOptions(env, *jni_cache, options));
+
+  PackedAnnotations packed;
+  PackAnnotations(context_utf8, annotations,
+                  [model](const std::string& collection) {
+                    return model->GetCollectionId(collection);
+                  },
+                  &packed);
+
+  const ScopedLocalRef<jintArray> spans(env->NewIntArray(packed.spans.size()),
+                                        env);
+  env->SetIntArrayRegion(spans.get(), 0, packed.spans.size(),
+                         packed.spans.data());
+  const ScopedLocalRef<jfloatArray> scores(
+      env->NewFloatArray(packed.scores.size()), env);
+  env->SetFloatArrayRegion(scores.get(), 0, packed.scores.size(),
+                           packed.scores.data());
+  const ScopedLocalRef<jintArray> collection_ids(
+      env->NewIntArray(packed.collection_ids.size()), env);
+  env->SetIntArrayRegion(collection_ids.get(), 0,
+                         packed.collection_ids.size(),
+                         packed.collection_ids.data());
+  const ScopedLocalRef<jlongArray> datetimes(
+      env->NewLongArray(packed.datetimes.size()), env);
+  env->SetLongArrayRegion(datetimes.get(), 0, packed.datetimes.size(),
+                          packed.datetimes.data());
+
+  jobjectArray result =
+      env->NewObjectArray(4, jni_cache->object.get(), nullptr);
+  env->SetObjectArrayElement(result, 0, spans.get());
+  env->SetObjectArrayElement(result, 1, scores.get());
+  env->SetObjectArrayElement(result, 2, collection_ids.get());
+  env->SetObjectArrayElement(result, 3, datetimes.get());
+  return result;
+}
+
+JNI_METHOD(jobjectArray, TC_CLASS_NAME, nativeGetCollections)
+(JNIEnv* env, jobject thiz, jlong ptr) {
+  if (!ptr) {
+    return nullptr;
+  }
+  const libtextclassifier2::JniCache* jni_cache = GetJniCache(env);
+  if (jni_cache == nullptr) {
+    return nullptr;
+  }
+  const std::vector<std::string>& collections =
+      FromJavaHandle(ptr)->GetCollections();
+  jobjectArray result = env->NewObjectArray(collections.size(),
+                                            jni_cache->string.get(), nullptr);
+  for (int i = 0; i < collections.size(); ++i) {
+    const ScopedLocalRef<jstring> collection(
+        env->NewStringUTF(collections[i].c_str()), env);
+    env->SetObjectArrayElement(result, i, collection.get());
+  }
+  return result;
+}
+
 JNI_METHOD(void, TC_CLASS_NAME, nativeClose)
 (JNIEnv* env, jobject thiz, jlong ptr) {
-  TextClassifier* model = reinterpret_cast<TextClassifier*>(ptr);
-  delete model;
+  delete reinterpret_cast<std::shared_ptr<const TextClassifier>*>(ptr);
 }
 
 JNI_METHOD(jstring, TC_CLASS_NAME, nativeGetLanguage)
@@ -494,3 +895,17 @@ JNI_METHOD(jstring, TC_CLASS_NAME, nativeGetNameFromAssetFileDescriptor)
       new libtextclassifier2::ScopedMmap(fd, offset, size));
   return GetNameFromMmap(env, mmap.get());
 }
+
+JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM* jvm, void* reserved) {
+  JNIEnv* env;
+  if (jvm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_4) != JNI_OK) {
+    return JNI_ERR;
+  }
+  // Failures are logged, and retried on the first call that needs the cache.
+  GetJniCache(env);
+  return JNI_VERSION_1_4;
+}
+
+JNIEXPORT void JNICALL JNI_OnUnload(JavaVM* jvm, void* reserved) {
+  libtextclassifier2::ReleaseJniCache();
+}
@@ -18,7 +18,9 @@
 #define LIBTEXTCLASSIFIER_TEXTCLASSIFIER_JNI_H_
 
 #include <jni.h>
+#include <functional>
 #include <string>
+#include <vector>
 
 #include "types.h"
 
@@ -87,6 +89,33 @@ JNI_METHOD(jobjectArray, TC_CLASS_NAME, nativeClassifyText)
 JNI_METHOD(jobjectArray, TC_CLASS_NAME, nativeAnnotate)
 (JNIEnv* env, jobject thiz, jlong ptr, jstring context, jobject options);
 
+// Batch versions of the methods above. They process the inputs with the same
+// options, and pay the cost of crossing the JNI boundary once per batch.
+// The selections are returned as consecutive (begin, end) pairs.
+JNI_METHOD(jintArray, TC_CLASS_NAME, nativeSuggestSelectionBatch)
+(JNIEnv* env, jobject thiz, jlong ptr, jobjectArray contexts,
+ jintArray selection_begins, jintArray selection_ends, jobject options);
+
+JNI_METHOD(jobjectArray, TC_CLASS_NAME, nativeClassifyTextBatch)
+(JNIEnv* env, jobject thiz, jlong ptr, jobjectArray contexts,
+ jintArray selection_begins, jintArray selection_ends, jobject options);
+
+JNI_METHOD(jobjectArray, TC_CLASS_NAME, nativeAnnotateBatch)
+(JNIEnv* env, jobject thiz, jlong ptr, jobjectArray contexts,
+ jobject options);
+
+// Same as nativeAnnotate, but returns the annotations packed into primitive
+// arrays, see PackedAnnotations, as an Object[] of the spans, the scores, the
+// collection ids and the datetimes, in that order. The collection ids index
+// into the result of nativeGetCollections.
+JNI_METHOD(jobjectArray, TC_CLASS_NAME, nativeAnnotatePacked)
+(JNIEnv* env, jobject thiz, jlong ptr, jstring context, jobject options);
+
+// Returns the names of the collections that the results of the classifier can
+// have. The list is fixed for a classifier, so it is fetched once.
+JNI_METHOD(jobjectArray, TC_CLASS_NAME, nativeGetCollections)
+(JNIEnv* env, jobject thiz, jlong ptr);
+
 JNI_METHOD(void, TC_CLASS_NAME, nativeClose)
 (JNIEnv* env, jobject thiz, jlong ptr);
 
@@ -118,6 +147,30 @@ JNI_METHOD(jstring, TC_CLASS_NAME, nativeGetNameFromAssetFileDescriptor)
 
 namespace libtextclassifier2 {
 
+// Converts the indices of a utf8 string between utf8 codepoints and Java BMP
+// (basic multilingual plane) codepoints. The string is walked once, when the
+// converter is created, so that converting many spans of the same string
+// takes linear time overall. Indices that don't correspond to a codepoint
+// boundary in the other encoding are converted to -1.
+class BMPIndexConverter {
+ public:
+  // Does not keep a reference to 'utf8_str'.
+  explicit BMPIndexConverter(const std::string& utf8_str);
+
+  CodepointSpan UTF8ToBMP(CodepointSpan utf8_indices) const;
+  CodepointSpan BMPToUTF8(CodepointSpan bmp_indices) const;
+
+  int UTF8ToBMP(int utf8_index) const;
+  int BMPToUTF8(int bmp_index) const;
+
+ private:
+  int num_codepoints_;
+
+  // The BMP index of every utf8 codepoint index, up to and including the end
+  // of the string. Empty if the indices are the same in both encodings.
+  std::vector<int> bmp_offsets_;
+};
+
 // Given a utf8 string and a span expressed in Java BMP (basic multilingual
 // plane) codepoints, converts it to a span expressed in utf8 codepoints.
 libtextclassifier2::CodepointSpan ConvertIndicesBMPToUTF8(
@@ -129,6 +182,32 @@ libtextclassifier2::CodepointSpan ConvertIndicesUTF8ToBMP(
     const std::string& utf8_str,
     libtextclassifier2::CodepointSpan utf8_indices);
 
+// Annotations laid out in primitive arrays, which cross the JNI boundary
+// without creating a Java object per annotation and result.
+struct PackedAnnotations {
+  // For each annotation, its begin and end (BMP indices) and the index one
+  // past its last classification result. The results of annotation i are
+  // thus the ones from spans[3 * i - 1] (0 for the first one) to
+  // spans[3 * i + 2].
+  std::vector<jint> spans;
+
+  // For each classification result.
+  std::vector<jfloat> scores;
+  std::vector<jint> collection_ids;
+
+  // For each classification result, time_ms_utc and granularity of its
+  // datetime, or -1 for both if it has none.
+  std::vector<jlong> datetimes;
+};
+
+// Packs the annotations of the context. 'collection_id' maps the collection
+// names to their ids.
+void PackAnnotations(
+    const std::string& context_utf8,
+    const std::vector<AnnotatedSpan>& annotations,
+    const std::function<int(const std::string&)>& collection_id,
+    PackedAnnotations* packed);
+
 }  // namespace libtextclassifier2
 
 #endif  // LIBTEXTCLASSIFIER_TEXTCLASSIFIER_JNI_H_
@@ -75,5 +75,57 @@ TEST(TextClassifier, ConvertIndicesBMPUTF8) {
             std::make_pair(3, 9));
 }
 
+TEST(TextClassifier, BMPIndexConverter) {
+  const BMPIndexConverter ascii_converter("hello world");
+  EXPECT_EQ(ascii_converter.UTF8ToBMP({6, 11}), std::make_pair(6, 11));
+  EXPECT_EQ(ascii_converter.BMPToUTF8({6, 11}), std::make_pair(6, 11));
+  EXPECT_EQ(ascii_converter.UTF8ToBMP({6, 12}), std::make_pair(6, -1));
+  EXPECT_EQ(ascii_converter.BMPToUTF8({-1, 11}), std::make_pair(-1, 11));
+
+  //  character 😁 is 0x1f601
+  const BMPIndexConverter converter("😁 Hell😁😁World.");
+  EXPECT_EQ(converter.UTF8ToBMP({0, 1}), std::make_pair(0, 2));
+  EXPECT_EQ(converter.UTF8ToBMP({2, 7}), std::make_pair(3, 9));
+  EXPECT_EQ(converter.UTF8ToBMP({8, 14}), std::make_pair(11, 17));
+  EXPECT_EQ(converter.BMPToUTF8({3, 9}), std::make_pair(2, 7));
+  EXPECT_EQ(converter.BMPToUTF8({11, 17}), std::make_pair(8, 14));
+
+  // Out of range, or in the middle of a surrogate pair.
+  EXPECT_EQ(converter.UTF8ToBMP({0, 15}), std::make_pair(0, -1));
+  EXPECT_EQ(converter.BMPToUTF8({1, 18}), std::make_pair(-1, -1));
+
+  const BMPIndexConverter empty_converter("");
+  EXPECT_EQ(empty_converter.UTF8ToBMP({0, 0}), std::make_pair(0, 0));
+  EXPECT_EQ(empty_converter.BMPToUTF8({0, 1}), std::make_pair(0, -1));
+}
+
+TEST(TextClassifier, PackAnnotations) {
+  std::vector<AnnotatedSpan> annotations(2);
+  annotations[0].span = {2, 5};
+  annotations[0].classification = {{"phone", 0.5}, {"other", 0.25}};
+  annotations[1].span = {6, 10};
+  annotations[1].classification = {{"date", 1.0}};
+  annotations[1].classification[0].datetime_parse_result.time_ms_utc = 1234;
+  annotations[1].classification[0].datetime_parse_result.granularity =
+      GRANULARITY_DAY;
+
+  PackedAnnotations packed;
+  //  character 😁 is 0x1f601
+  PackAnnotations("😁 555 today", annotations,
+                  [](const std::string& collection) {
+                    return collection == "other"
+                               ? 0
+                               : collection == "phone" ? 1 : 2;
+                  },
+                  &packed);
+  EXPECT_THAT(packed.spans, testing::ElementsAreArray({3, 6, 2, 7, 11, 3}));
+  EXPECT_THAT(packed.scores, testing::ElementsAreArray({0.5, 0.25, 1.0}));
+  EXPECT_THAT(packed.collection_ids, testing::ElementsAreArray({1, 0, 2}));
+  EXPECT_THAT(packed.datetimes,
+              testing::ElementsAreArray(
+                  {-1ll, -1ll, -1ll, -1ll, 1234ll,
+                   static_cast<long long>(GRANULARITY_DAY)}));
+}
+
 }  // namespace
 }  // namespace libtextclassifier2
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "token-feature-cache.h"
+
+#include <algorithm>
+
+#include "util/hash/farmhash.h"
+#include "util/memory/memory-usage.h"
+
+namespace libtextclassifier2 {
+
+void TokenFeatureCache::Reset(int max_entries) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const int clamped_max_entries = std::max(max_entries, 0);
+  max_entries_.store(clamped_max_entries, std::memory_order_relaxed);
+  slab_.clear();
+  slab_.shrink_to_fit();
+  keys_.clear();
+  referenced_.clear();
+  fingerprint_to_entry_.clear();
+  clock_hand_ = 0;
+  hits_ = 0;
+  misses_ = 0;
+  if (clamped_max_entries > 0) {
+    slab_.reserve(clamped_max_entries * features_size_);
+    keys_.reserve(clamped_max_entries);
+    referenced_.reserve(clamped_max_entries);
+    fingerprint_to_entry_.reserve(clamped_max_entries);
+  }
+}
+
+char TokenFeatureCache::KeyFlags(const Token& token, bool is_in_span) {
+  return static_cast<char>((token.is_padding ? 1 : 0) | (is_in_span ? 2 : 0));
+}
+
+uint64 TokenFeatureCache::KeyFingerprint(const char* value, int value_size,
+                                         char flags) {
+  return tc2farmhash::Fingerprint(tc2farmhash::Uint128(
+      tc2farmhash::Fingerprint64Inlined(value, value_size), flags));
+}
+
+int TokenFeatureCache::FindEntry(const std::string& value, char flags,
+                                 uint64 fingerprint) const {
+  const auto range = fingerprint_to_entry_.equal_range(fingerprint);
+  for (auto it = range.first; it != range.second; ++it) {
+    const std::string& key = keys_[it->second];
+    if (key.size() == value.size() + 1 && key.back() == flags &&
+        key.compare(0, value.size(), value) == 0) {
+      return it->second;
+    }
+  }
+  return -1;
+}
+
+bool TokenFeatureCache::Lookup(const Token& token, bool is_in_span,
+                               std::vector<float>* output_features) {
+  const char flags = KeyFlags(token, is_in_span);
+  const uint64 fingerprint =
+      KeyFingerprint(token.value.data(), token.value.size(), flags);
+  std::lock_guard<std::mutex> lock(mutex_);
+  const int entry = FindEntry(token.value, flags, fingerprint);
+  if (entry < 0) {
+    ++misses_;
+    return false;
+  }
+  ++hits_;
+  referenced_[entry] = true;
+  const float* features = slab_.data() + entry * features_size_;
+  output_features->insert(output_features->end(), features,
+                          features + features_size_);
+  return true;
+}
+
+void TokenFeatureCache::Insert(const Token& token, bool is_in_span,
+                               const float* features) {
+  const char flags = KeyFlags(token, is_in_span);
+  const uint64 fingerprint =
+      KeyFingerprint(token.value.data(), token.value.size(), flags);
+  std::lock_guard<std::mutex> lock(mutex_);
+  const int max_entries = max_entries_.load(std::memory_order_relaxed);
+  if (max_entries <= 0 || FindEntry(token.value, flags, fingerprint) >= 0) {
+    return;
+  }
+
+  int entry;
+  if (keys_.size() < max_entries) {
+    entry = keys_.size();
+    keys_.emplace_back();
+    referenced_.push_back(false);
+    slab_.resize(slab_.size() + features_size_);
+  } else {
+    // Advance the clock hand, giving a second chance to recently used
+    // entries, until an unreferenced entry is found.
+    while (referenced_[clock_hand_]) {
+      referenced_[clock_hand_] = false;
+      clock_hand_ = (clock_hand_ + 1) % max_entries;
+    }
+    entry = clock_hand_;
+    clock_hand_ = (clock_hand_ + 1) % max_entries;
+    const std::string& evicted_key = keys_[entry];
+    const auto range = fingerprint_to_entry_.equal_range(
+        KeyFingerprint(evicted_key.data(), evicted_key.size() - 1,
+                       evicted_key.back()));
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second == entry) {
+        fingerprint_to_entry_.erase(it);
+        break;
+      }
+    }
+  }
+
+  std::copy(features, features + features_size_,
+            slab_.begin() + entry * features_size_);
+  referenced_[entry] = false;
+  std::string& key = keys_[entry];
+  key.assign(token.value);
+  key.push_back(flags);
+  fingerprint_to_entry_.emplace(fingerprint, entry);
+}
+
+int64 TokenFeatureCache::hits() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return hits_;
+}
+
+int64 TokenFeatureCache::misses() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return misses_;
+}
+
+int64 TokenFeatureCache::EstimateHeapBytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return VectorHeapBytes(slab_) + StringsHeapBytes(keys_) +
+         referenced_.capacity() / 8 + HashTableHeapBytes(fingerprint_to_entry_);
+}
+
+}  // namespace libtextclassifier2
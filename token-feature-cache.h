@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBTEXTCLASSIFIER_TOKEN_FEATURE_CACHE_H_
+#define LIBTEXTCLASSIFIER_TOKEN_FEATURE_CACHE_H_
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "types.h"
+#include "util/base/integral_types.h"
+#include "util/base/macros.h"
+
+namespace libtextclassifier2 {
+
+// A bounded cache of the complete per-token feature vectors (embedded sparse
+// features followed by the dense features), which persists across calls.
+// Unlike FeatureProcessor::EmbeddingCache, entries are keyed by the token value
+// and its flags instead of its position, so they can be reused between
+// different contexts. When full, entries are evicted with the CLOCK
+// (second-chance) approximation of LRU.
+// The cache is disabled (has zero capacity) until Reset() is called with a
+// positive number of entries.
+// Thread-safe.
+class TokenFeatureCache {
+ public:
+  // 'features_size' is the number of floats stored for each token.
+  explicit TokenFeatureCache(int features_size)
+      : features_size_(features_size) {}
+
+  // Drops all the entries and sets the maximum number of entries held.
+  // A non-positive 'max_entries' disables the cache.
+  void Reset(int max_entries);
+
+  // Returns true if the cache has a non-zero capacity. Doesn't lock, so it is
+  // cheap to call for every token.
+  bool IsEnabled() const {
+    return max_entries_.load(std::memory_order_relaxed) > 0;
+  }
+
+  // If the features for the token are in the cache, appends them to
+  // 'output_features' and returns true. Returns false otherwise. Doesn't
+  // allocate, besides growing 'output_features'.
+  bool Lookup(const Token& token, bool is_in_span,
+              std::vector<float>* output_features);
+
+  // Stores 'features_size' floats from 'features' as the features of the
+  // token, evicting another entry if the cache is full.
+  void Insert(const Token& token, bool is_in_span, const float* features);
+
+  // Number of successful and unsuccessful lookups since the last Reset().
+  int64 hits() const;
+  int64 misses() const;
+
+  int features_size() const { return features_size_; }
+
+  // Returns an estimate of the heap memory held, in bytes.
+  // Thread-safe.
+  int64 EstimateHeapBytes() const;
+
+ private:
+  // The key of an entry is the token value followed by one byte of flags.
+  static char KeyFlags(const Token& token, bool is_in_span);
+  static uint64 KeyFingerprint(const char* value, int value_size, char flags);
+
+  // Returns the entry of the token, or -1 if there is none.
+  int FindEntry(const std::string& value, char flags, uint64 fingerprint) const;
+
+  const int features_size_;
+
+  mutable std::mutex mutex_;
+
+  // Only written with mutex_ held, but read without it by IsEnabled().
+  std::atomic<int> max_entries_{0};
+
+  // Contiguous storage of the features; entry i occupies
+  // [i * features_size_, (i + 1) * features_size_).
+  std::vector<float> slab_;
+
+  // Per-entry key and CLOCK reference bit.
+  std::vector<std::string> keys_;
+  std::vector<bool> referenced_;
+
+  // The entries by the fingerprints of their keys. Fingerprints can collide,
+  // so the keys are compared too.
+  std::unordered_multimap<uint64, int> fingerprint_to_entry_;
+  int clock_hand_ = 0;
+
+  int64 hits_ = 0;
+  int64 misses_ = 0;
+
+  TC_DISALLOW_COPY_AND_ASSIGN(TokenFeatureCache);
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_TOKEN_FEATURE_CACHE_H_
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "token-feature-cache.h"
+
+#include <vector>
+
+#include "test-util.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+using testing::ElementsAreArray;
+
+TEST(TokenFeatureCacheTest, DisabledByDefault) {
+  TokenFeatureCache cache(/*features_size=*/2);
+  EXPECT_FALSE(cache.IsEnabled());
+
+  const std::vector<float> features = {1.0, 2.0};
+  cache.Insert(Token("hello", 0, 5), /*is_in_span=*/false, features.data());
+
+  std::vector<float> output;
+  EXPECT_FALSE(cache.Lookup(Token("hello", 0, 5), false, &output));
+  EXPECT_TRUE(output.empty());
+}
+
+TEST(TokenFeatureCacheTest, LookupIgnoresPositionButNotFlags) {
+  TokenFeatureCache cache(/*features_size=*/2);
+  cache.Reset(/*max_entries=*/10);
+  ASSERT_TRUE(cache.IsEnabled());
+
+  const std::vector<float> features = {1.0, 2.0};
+  cache.Insert(Token("hello", 0, 5), /*is_in_span=*/false, features.data());
+
+  std::vector<float> output = {7.0};
+  EXPECT_TRUE(cache.Lookup(Token("hello", 10, 15), false, &output));
+  EXPECT_THAT(output, ElementsAreArray({7.0, 1.0, 2.0}));
+
+  output.clear();
+  EXPECT_FALSE(cache.Lookup(Token("hello", 0, 5), /*is_in_span=*/true,
+                            &output));
+  EXPECT_FALSE(cache.Lookup(Token("hell", 0, 4), false, &output));
+  EXPECT_FALSE(cache.Lookup(Token(), false, &output));
+  EXPECT_TRUE(output.empty());
+
+  EXPECT_EQ(cache.hits(), 1);
+  EXPECT_EQ(cache.misses(), 3);
+}
+
+TEST(TokenFeatureCacheTest, EvictsUnreferencedEntries) {
+  TokenFeatureCache cache(/*features_size=*/1);
+  cache.Reset(/*max_entries=*/2);
+
+  const float a = 1.0, b = 2.0, c = 3.0;
+  cache.Insert(Token("a", 0, 1), false, &a);
+  cache.Insert(Token("b", 0, 1), false, &b);
+
+  // Touch "a", so that "b" is the one evicted.
+  std::vector<float> output;
+  EXPECT_TRUE(cache.Lookup(Token("a", 0, 1), false, &output));
+  cache.Insert(Token("c", 0, 1), false, &c);
+
+  output.clear();
+  EXPECT_TRUE(cache.Lookup(Token("a", 0, 1), false, &output));
+  EXPECT_FALSE(cache.Lookup(Token("b", 0, 1), false, &output));
+  EXPECT_TRUE(cache.Lookup(Token("c", 0, 1), false, &output));
+  EXPECT_THAT(output, ElementsAreArray({1.0, 3.0}));
+}
+
+TEST(TokenFeatureCacheTest, LookupDoesNotAllocate) {
+  TokenFeatureCache cache(/*features_size=*/2);
+  cache.Reset(/*max_entries=*/4);
+  const std::vector<float> features = {1.0, 2.0};
+  const Token token("a long token that is not stored inline", 0, 38);
+  cache.Insert(token, /*is_in_span=*/true, features.data());
+
+  std::vector<float> output;
+  output.reserve(2);
+  int64 num_allocations;
+  bool found;
+  {
+    ScopedAllocationCounter counter;
+    found = cache.Lookup(token, /*is_in_span=*/true, &output) &&
+            !cache.Lookup(token, /*is_in_span=*/false, &output);
+    num_allocations = counter.num_allocations();
+  }
+  EXPECT_TRUE(found);
+  EXPECT_EQ(num_allocations, 0);
+  EXPECT_THAT(output, ElementsAreArray({1.0, 2.0}));
+}
+
+TEST(TokenFeatureCacheTest, ResetClearsEntriesAndCounters) {
+  TokenFeatureCache cache(/*features_size=*/1);
+  cache.Reset(/*max_entries=*/4);
+
+  const float a = 1.0;
+  cache.Insert(Token("a", 0, 1), false, &a);
+  std::vector<float> output;
+  EXPECT_TRUE(cache.Lookup(Token("a", 0, 1), false, &output));
+
+  cache.Reset(/*max_entries=*/4);
+  EXPECT_EQ(cache.hits(), 0);
+  EXPECT_EQ(cache.misses(), 0);
+  EXPECT_FALSE(cache.Lookup(Token("a", 0, 1), false, &output));
+
+  cache.Reset(/*max_entries=*/0);
+  EXPECT_FALSE(cache.IsEnabled());
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
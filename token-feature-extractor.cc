@@ -16,66 +16,84 @@
 
 #include "token-feature-extractor.h"
 
+#include <string.h>
+
+#include <algorithm>
 #include <cctype>
 #include <string>
 
 #include "util/base/logging.h"
 #include "util/hash/farmhash.h"
+#include "util/memory/memory-usage.h"
 #include "util/strings/stringpiece.h"
+#include "util/strings/utf8.h"
 #include "util/utf8/unicodetext.h"
 
 namespace libtextclassifier2 {
 
 namespace {
 
-std::string RemapTokenAscii(const std::string& token,
-                            const TokenFeatureExtractorOptions& options) {
-  if (!options.remap_digits && !options.lowercase_tokens) {
-    return token;
-  }
+// Padding and out-of-vocabulary tokens have extra buckets reserved because
+// they are special and important tokens, and we don't want them to share
+// embedding with other charactergrams.
+// TODO(zilka): Experimentally verify.
+const int kNumExtraBuckets = 2;
 
-  std::string copy = token;
-  for (int i = 0; i < token.size(); ++i) {
-    if (options.remap_digits && isdigit(copy[i])) {
-      copy[i] = '0';
-    }
-    if (options.lowercase_tokens) {
-      copy[i] = tolower(copy[i]);
-    }
+char RemapCharAscii(char c, const TokenFeatureExtractorOptions& options) {
+  if (options.remap_digits && isdigit(c)) {
+    c = '0';
   }
-  return copy;
-}
-
-void RemapTokenUnicode(const std::string& token,
-                       const TokenFeatureExtractorOptions& options,
-                       const UniLib& unilib, UnicodeText* remapped) {
-  if (!options.remap_digits && !options.lowercase_tokens) {
-    // Leave remapped untouched.
-    return;
+  if (options.lowercase_tokens) {
+    c = tolower(c);
   }
+  return c;
+}
 
-  UnicodeText word = UTF8ToUnicodeText(token, /*do_copy=*/false);
-  remapped->clear();
-  for (auto it = word.begin(); it != word.end(); ++it) {
-    if (options.remap_digits && unilib.IsDigit(*it)) {
-      remapped->AppendCodepoint('0');
-    } else if (options.lowercase_tokens) {
-      remapped->AppendCodepoint(unilib.ToLower(*it));
-    } else {
-      remapped->AppendCodepoint(*it);
+// A buffer of 'size' elements, on the stack unless it is larger than the
+// typical word.
+template <typename T>
+class SmallBuffer {
+ public:
+  explicit SmallBuffer(int size) {
+    if (size > kStackSize) {
+      heap_.resize(size);
     }
   }
-}
+
+  T* data() { return heap_.empty() ? stack_ : heap_.data(); }
+
+ private:
+  static const int kStackSize = 128;
+  T stack_[kStackSize];
+  std::vector<T> heap_;
+};
+
+typedef SmallBuffer<char> WordBuffer;
+typedef SmallBuffer<int> OffsetBuffer;
 
 }  // namespace
 
 TokenFeatureExtractor::TokenFeatureExtractor(
     const TokenFeatureExtractorOptions& options, const UniLib& unilib)
-    : options_(options), unilib_(unilib) {
+    : options_(options),
+      bucket_modulo_(std::max(1, options.num_buckets)),
+      vocabulary_bucket_modulo_(
+          std::max(1, options.num_buckets - kNumExtraBuckets)),
+      unilib_(unilib),
+      shape_matcher_(unilib) {
+  allowed_chargram_fingerprints_.reserve(options.allowed_chargrams.size());
+  for (const std::string& chargram : options.allowed_chargrams) {
+    allowed_chargram_fingerprints_.push_back(
+        tc2farmhash::Fingerprint64(chargram));
+  }
+  std::sort(allowed_chargram_fingerprints_.begin(),
+            allowed_chargram_fingerprints_.end());
   for (const std::string& pattern : options.regexp_features) {
     regex_patterns_.push_back(std::unique_ptr<UniLib::RegexPattern>(
         unilib_.CreateRegexPattern(UTF8ToUnicodeText(
             pattern.c_str(), pattern.size(), /*do_copy=*/false))));
+    shape_pattern_index_.push_back(
+        regex_patterns_.back() ? shape_matcher_.AddPattern(pattern) : -1);
   }
 }
 
@@ -94,44 +112,69 @@ bool TokenFeatureExtractor::Extract(const Token& token, bool is_in_span,
 
 std::vector<int> TokenFeatureExtractor::ExtractCharactergramFeatures(
     const Token& token) const {
+  std::vector<int> result(MaxCharactergramFeatures(token));
+  result.resize(
+      ExtractCharactergramFeatures(token, result.data(), result.size()));
+  return result;
+}
+
+int TokenFeatureExtractor::ExtractCharactergramFeatures(const Token& token,
+                                                        int* output,
+                                                        int capacity) const {
   if (options_.unicode_aware_features) {
-    return ExtractCharactergramFeaturesUnicode(token);
+    return ExtractCharactergramFeaturesUnicode(token, output, capacity);
   } else {
-    return ExtractCharactergramFeaturesAscii(token);
+    return ExtractCharactergramFeaturesAscii(token, output, capacity);
+  }
+}
+
+char32 TokenFeatureExtractor::RemapCodepoint(char32 codepoint) const {
+  if (options_.remap_digits && unilib_.IsDigit(codepoint)) {
+    return '0';
+  } else if (options_.lowercase_tokens) {
+    return unilib_.ToLower(codepoint);
+  } else {
+    return codepoint;
   }
 }
 
 std::vector<float> TokenFeatureExtractor::ExtractDenseFeatures(
     const Token& token, bool is_in_span) const {
-  std::vector<float> dense_features;
+  std::vector<float> dense_features(DenseFeaturesCount());
+  ExtractDenseFeatures(token, is_in_span, dense_features.data());
+  return dense_features;
+}
 
+void TokenFeatureExtractor::ExtractDenseFeatures(const Token& token,
+                                                 bool is_in_span,
+                                                 float* output) const {
   if (options_.extract_case_feature) {
     if (options_.unicode_aware_features) {
       UnicodeText token_unicode =
           UTF8ToUnicodeText(token.value, /*do_copy=*/false);
       const bool is_upper = unilib_.IsUpper(*token_unicode.begin());
       if (!token.value.empty() && is_upper) {
-        dense_features.push_back(1.0);
+        *output++ = 1.0;
       } else {
-        dense_features.push_back(-1.0);
+        *output++ = -1.0;
       }
     } else {
       if (!token.value.empty() && isupper(*token.value.begin())) {
-        dense_features.push_back(1.0);
+        *output++ = 1.0;
       } else {
-        dense_features.push_back(-1.0);
+        *output++ = -1.0;
       }
     }
   }
 
   if (options_.extract_selection_mask_feature) {
     if (is_in_span) {
-      dense_features.push_back(1.0);
+      *output++ = 1.0;
     } else {
       if (options_.unicode_aware_features) {
-        dense_features.push_back(-1.0);
+        *output++ = -1.0;
       } else {
-        dense_features.push_back(0.0);
+        *output++ = 0.0;
       }
     }
   }
@@ -140,169 +183,209 @@ std::vector<float> TokenFeatureExtractor::ExtractDenseFeatures(
   if (!regex_patterns_.empty()) {
     UnicodeText token_unicode =
         UTF8ToUnicodeText(token.value, /*do_copy=*/false);
+    const uint64 shape_matches = shape_matcher_.Match(token_unicode);
     for (int i = 0; i < regex_patterns_.size(); ++i) {
       if (!regex_patterns_[i].get()) {
-        dense_features.push_back(-1.0);
+        *output++ = -1.0;
+        continue;
+      }
+      if (shape_pattern_index_[i] >= 0) {
+        if ((shape_matches >> shape_pattern_index_[i]) & 1) {
+          *output++ = 1.0;
+        } else {
+          *output++ = -1.0;
+        }
         continue;
       }
       auto matcher = regex_patterns_[i]->Matcher(token_unicode);
       int status;
       if (matcher->Matches(&status)) {
-        dense_features.push_back(1.0);
+        *output++ = 1.0;
       } else {
-        dense_features.push_back(-1.0);
+        *output++ = -1.0;
       }
     }
   }
-
-  return dense_features;
 }
 
 int TokenFeatureExtractor::HashToken(StringPiece token) const {
+  // The charactergrams are mostly short enough for the inlined fingerprint.
+  const uint64 fingerprint =
+      tc2farmhash::Fingerprint64Inlined(token.data(), token.size());
   if (options_.allowed_chargrams.empty()) {
-    return tc2farmhash::Fingerprint64(token) % options_.num_buckets;
+    return bucket_modulo_.Reduce(fingerprint);
   } else {
-    // Padding and out-of-vocabulary tokens have extra buckets reserved because
-    // they are special and important tokens, and we don't want them to share
-    // embedding with other charactergrams.
-    // TODO(zilka): Experimentally verify.
-    const int kNumExtraBuckets = 2;
-    const std::string token_string = token.ToString();
-    if (token_string == "<PAD>") {
+    static const char kPadding[] = "<PAD>";
+    if (token.size() == sizeof(kPadding) - 1 &&
+        memcmp(token.data(), kPadding, token.size()) == 0) {
       return 1;
-    } else if (options_.allowed_chargrams.find(token_string) ==
-               options_.allowed_chargrams.end()) {
+    } else if (!std::binary_search(allowed_chargram_fingerprints_.begin(),
+                                   allowed_chargram_fingerprints_.end(),
+                                   fingerprint)) {
       return 0;  // Out-of-vocabulary.
     } else {
-      return (tc2farmhash::Fingerprint64(token) %
-              (options_.num_buckets - kNumExtraBuckets)) +
-             kNumExtraBuckets;
+      return vocabulary_bucket_modulo_.Reduce(fingerprint) + kNumExtraBuckets;
     }
   }
 }
 
-std::vector<int> TokenFeatureExtractor::ExtractCharactergramFeaturesAscii(
-    const Token& token) const {
-  std::vector<int> result;
+int TokenFeatureExtractor::MaxCharactergramFeatures(const Token& token) const {
+  if (token.is_padding || token.value.empty() ||
+      options_.chargram_orders.empty()) {
+    return 1;
+  }
+  // The framed word has at most max_word_length + 3 characters, and never
+  // more than the bytes of the token + 2. Each order yields at most one
+  // charactergram per character.
+  const int num_characters =
+      std::min<int>(token.value.size() + 2, options_.max_word_length + 3);
+  return options_.chargram_orders.size() * num_characters;
+}
+
+int TokenFeatureExtractor::ExtractCharactergramFeaturesAscii(
+    const Token& token, int* output, int capacity) const {
+  if (capacity <= 0) {
+    return 0;
+  }
   if (token.is_padding || token.value.empty()) {
-    result.push_back(HashToken("<PAD>"));
+    output[0] = HashToken("<PAD>");
+    return 1;
+  }
+
+  // Frame the word as "^word$", or "^head\1tail$" if it is over
+  // max_word_length characters, remapping the characters on the way.
+  const std::string& word = token.value;
+  const int half_length = options_.max_word_length / 2;
+  const bool trim = word.size() > options_.max_word_length;
+  const int feature_word_size = trim ? 2 * half_length + 3 : word.size() + 2;
+  WordBuffer buffer(feature_word_size);
+  char* feature_word = buffer.data();
+  int size = 0;
+  feature_word[size++] = '^';
+  if (trim) {
+    for (int i = 0; i < half_length; ++i) {
+      feature_word[size++] = RemapCharAscii(word[i], options_);
+    }
+    feature_word[size++] = '\1';
+    for (int i = word.size() - half_length; i < word.size(); ++i) {
+      feature_word[size++] = RemapCharAscii(word[i], options_);
+    }
   } else {
-    const std::string word = RemapTokenAscii(token.value, options_);
-
-    // Trim words that are over max_word_length characters.
-    const int max_word_length = options_.max_word_length;
-    std::string feature_word;
-    if (word.size() > max_word_length) {
-      feature_word =
-          "^" + word.substr(0, max_word_length / 2) + "\1" +
-          word.substr(word.size() - max_word_length / 2, max_word_length / 2) +
-          "$";
-    } else {
-      // Add a prefix and suffix to the word.
-      feature_word = "^" + word + "$";
+    for (const char c : word) {
+      feature_word[size++] = RemapCharAscii(c, options_);
     }
+  }
+  feature_word[size++] = '$';
 
-    // Upper-bound the number of charactergram extracted to avoid resizing.
-    result.reserve(options_.chargram_orders.size() * feature_word.size());
+  if (options_.chargram_orders.empty()) {
+    output[0] = HashToken(StringPiece(feature_word, size));
+    return 1;
+  }
 
-    if (options_.chargram_orders.empty()) {
-      result.push_back(HashToken(feature_word));
-    } else {
-      // Generate the character-grams.
-      for (int chargram_order : options_.chargram_orders) {
-        if (chargram_order == 1) {
-          for (int i = 1; i < feature_word.size() - 1; ++i) {
-            result.push_back(
-                HashToken(StringPiece(feature_word, /*offset=*/i, /*len=*/1)));
-          }
-        } else {
-          for (int i = 0;
-               i < static_cast<int>(feature_word.size()) - chargram_order + 1;
-               ++i) {
-            result.push_back(HashToken(StringPiece(feature_word, /*offset=*/i,
-                                                   /*len=*/chargram_order)));
-          }
-        }
+  // Generate the character-grams.
+  int num_features = 0;
+  for (int chargram_order : options_.chargram_orders) {
+    // Unigrams leave out the "^" and "$" markers.
+    const int first = chargram_order == 1 ? 1 : 0;
+    const int last = chargram_order == 1 ? size - 1 : size;
+    for (int i = first; i + chargram_order <= last; ++i) {
+      if (num_features == capacity) {
+        return num_features;
       }
+      output[num_features++] =
+          HashToken(StringPiece(feature_word + i, chargram_order));
     }
   }
-  return result;
+  return num_features;
 }
 
-std::vector<int> TokenFeatureExtractor::ExtractCharactergramFeaturesUnicode(
-    const Token& token) const {
-  std::vector<int> result;
+int TokenFeatureExtractor::ExtractCharactergramFeaturesUnicode(
+    const Token& token, int* output, int capacity) const {
+  if (capacity <= 0) {
+    return 0;
+  }
   if (token.is_padding || token.value.empty()) {
-    result.push_back(HashToken("<PAD>"));
-  } else {
-    UnicodeText word = UTF8ToUnicodeText(token.value, /*do_copy=*/false);
-    RemapTokenUnicode(token.value, options_, unilib_, &word);
-
-    // Trim the word if needed by finding a left-cut point and right-cut point.
-    auto left_cut = word.begin();
-    auto right_cut = word.end();
-    for (int i = 0; i < options_.max_word_length / 2; i++) {
-      if (left_cut < right_cut) {
-        ++left_cut;
-      }
-      if (left_cut < right_cut) {
-        --right_cut;
+    output[0] = HashToken("<PAD>");
+    return 1;
+  }
+
+  // Frame the word as "^word$", or "^head\1tail$" if it is over
+  // max_word_length codepoints, remapping the codepoints on the way. The byte
+  // offsets of the codepoints of the framed word are kept for cutting it
+  // into charactergrams; the extra one is its end.
+  const UnicodeText word = UTF8ToUnicodeText(token.value, /*do_copy=*/false);
+  const int num_codepoints = word.size_codepoints();
+  const int half_length = options_.max_word_length / 2;
+  const bool trim = num_codepoints > 2 * half_length;
+  const bool remap = options_.remap_digits || options_.lowercase_tokens;
+  const int feature_word_codepoints =
+      trim ? 2 * half_length + 3 : num_codepoints + 2;
+  OffsetBuffer offsets(feature_word_codepoints + 1);
+  WordBuffer buffer(feature_word_codepoints * 4);
+  char* feature_word = buffer.data();
+  int size = 0;
+  int num_offsets = 0;
+  offsets.data()[num_offsets++] = size;
+  feature_word[size++] = '^';
+  int i = 0;
+  for (auto it = word.begin(); it != word.end(); ++it, ++i) {
+    if (trim && i >= half_length && i < num_codepoints - half_length) {
+      if (i == half_length) {
+        offsets.data()[num_offsets++] = size;
+        feature_word[size++] = '\1';
       }
+      continue;
     }
-
-    std::string feature_word;
-    if (left_cut == right_cut) {
-      feature_word = "^" + word.UTF8Substring(word.begin(), word.end()) + "$";
+    offsets.data()[num_offsets++] = size;
+    if (remap) {
+      size += EncodeAsUTF8Char(RemapCodepoint(*it), feature_word + size);
     } else {
-      // clang-format off
-      feature_word = "^" +
-                     word.UTF8Substring(word.begin(), left_cut) +
-                     "\1" +
-                     word.UTF8Substring(right_cut, word.end()) +
-                     "$";
-      // clang-format on
+      const int length = it.utf8_length();
+      memcpy(feature_word + size, it.utf8_data(), length);
+      size += length;
     }
+  }
+  offsets.data()[num_offsets++] = size;
+  feature_word[size++] = '$';
+  offsets.data()[num_offsets] = size;
 
-    const UnicodeText feature_word_unicode =
-        UTF8ToUnicodeText(feature_word, /*do_copy=*/false);
-
-    // Upper-bound the number of charactergram extracted to avoid resizing.
-    result.reserve(options_.chargram_orders.size() * feature_word.size());
-
-    if (options_.chargram_orders.empty()) {
-      result.push_back(HashToken(feature_word));
-    } else {
-      // Generate the character-grams.
-      for (int chargram_order : options_.chargram_orders) {
-        UnicodeText::const_iterator it_start = feature_word_unicode.begin();
-        UnicodeText::const_iterator it_end = feature_word_unicode.end();
-        if (chargram_order == 1) {
-          ++it_start;
-          --it_end;
-        }
-
-        UnicodeText::const_iterator it_chargram_start = it_start;
-        UnicodeText::const_iterator it_chargram_end = it_start;
-        bool chargram_is_complete = true;
-        for (int i = 0; i < chargram_order; ++i) {
-          if (it_chargram_end == it_end) {
-            chargram_is_complete = false;
-            break;
-          }
-          ++it_chargram_end;
-        }
-        if (!chargram_is_complete) {
-          continue;
-        }
+  if (options_.chargram_orders.empty()) {
+    output[0] = HashToken(StringPiece(feature_word, size));
+    return 1;
+  }
 
-        for (; it_chargram_end <= it_end;
-             ++it_chargram_start, ++it_chargram_end) {
-          const int length_bytes =
-              it_chargram_end.utf8_data() - it_chargram_start.utf8_data();
-          result.push_back(HashToken(
-              StringPiece(it_chargram_start.utf8_data(), length_bytes)));
-        }
+  // Generate the character-grams.
+  int num_features = 0;
+  for (int chargram_order : options_.chargram_orders) {
+    // Unigrams leave out the "^" and "$" markers.
+    const int first = chargram_order == 1 ? 1 : 0;
+    const int last = chargram_order == 1 ? num_offsets - 1 : num_offsets;
+    for (int j = first; j + chargram_order <= last; ++j) {
+      if (num_features == capacity) {
+        return num_features;
       }
+      const int start = offsets.data()[j];
+      output[num_features++] = HashToken(StringPiece(
+          feature_word + start, offsets.data()[j + chargram_order] - start));
+    }
+  }
+  return num_features;
+}
+
+int64 TokenFeatureExtractor::EstimateHeapBytes() const {
+  int64 result = VectorHeapBytes(options_.chargram_orders) +
+                 StringsHeapBytes(options_.regexp_features) +
+                 HashTableHeapBytes(options_.allowed_chargrams) +
+                 VectorHeapBytes(allowed_chargram_fingerprints_) +
+                 VectorHeapBytes(regex_patterns_) +
+                 shape_matcher_.EstimateHeapBytes() +
+                 VectorHeapBytes(shape_pattern_index_);
+  for (const std::string& chargram : options_.allowed_chargrams) {
+    result += StringHeapBytes(chargram);
+  }
+  for (const std::unique_ptr<UniLib::RegexPattern>& pattern : regex_patterns_) {
+    if (pattern != nullptr) {
+      result += sizeof(UniLib::RegexPattern) + pattern->EstimateHeapBytes();
     }
   }
   return result;
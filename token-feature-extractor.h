@@ -21,7 +21,10 @@
 #include <unordered_set>
 #include <vector>
 
+#include "token-shape-matcher.h"
 #include "types.h"
+#include "util/base/integral_types.h"
+#include "util/math/fast-modulo.h"
 #include "util/strings/stringpiece.h"
 #include "util/utf8/unilib.h"
 
@@ -80,11 +83,26 @@ class TokenFeatureExtractor {
   // Extracts the sparse (charactergram) features from the token.
   std::vector<int> ExtractCharactergramFeatures(const Token& token) const;
 
+  // Same as above, but writes the features to the caller's 'output', which
+  // has room for 'capacity' of them, instead of allocating. Returns the number
+  // of features written; the ones beyond 'capacity' are dropped. A capacity of
+  // MaxCharactergramFeatures(token) always suffices.
+  int ExtractCharactergramFeatures(const Token& token, int* output,
+                                   int capacity) const;
+
+  // Returns an upper bound of the number of sparse features of the token.
+  int MaxCharactergramFeatures(const Token& token) const;
+
   // Extracts the dense features from the token. is_in_span is a bool indicator
   // whether the token is a part of the selection span (true) or not (false).
   std::vector<float> ExtractDenseFeatures(const Token& token,
                                           bool is_in_span) const;
 
+  // Same as above, but writes the DenseFeaturesCount() features to 'output',
+  // e.g. straight into a row of the feature matrix, instead of allocating.
+  void ExtractDenseFeatures(const Token& token, bool is_in_span,
+                            float* output) const;
+
   int DenseFeaturesCount() const {
     int feature_count =
         options_.extract_case_feature + options_.extract_selection_mask_feature;
@@ -97,17 +115,42 @@ class TokenFeatureExtractor {
   int HashToken(StringPiece token) const;
 
   // Extracts the charactergram features from the token in a non-unicode-aware
-  // way.
-  std::vector<int> ExtractCharactergramFeaturesAscii(const Token& token) const;
+  // way, into 'output' of size 'capacity'. Returns the number of features.
+  int ExtractCharactergramFeaturesAscii(const Token& token, int* output,
+                                        int capacity) const;
+
+  // Extracts the charactergram features from the token in a unicode-aware way,
+  // into 'output' of size 'capacity'. Returns the number of features.
+  int ExtractCharactergramFeaturesUnicode(const Token& token, int* output,
+                                          int capacity) const;
+
+  // Remaps the digits and the case of a codepoint as the options ask for.
+  char32 RemapCodepoint(char32 codepoint) const;
 
-  // Extracts the charactergram features from the token in a unicode-aware way.
-  std::vector<int> ExtractCharactergramFeaturesUnicode(
-      const Token& token) const;
+  // Returns an estimate of the heap memory held, in bytes.
+  int64 EstimateHeapBytes() const;
 
  private:
   TokenFeatureExtractorOptions options_;
+
+  // Sorted fingerprints of options_.allowed_chargrams, so that checking a
+  // charactergram against the vocabulary reuses the fingerprint it is hashed
+  // with anyway, instead of allocating a string to look up.
+  std::vector<uint64> allowed_chargram_fingerprints_;
+
+  // The reductions of the fingerprints to the buckets, of all the buckets or,
+  // with a vocabulary, of the ones not reserved for the special tokens.
+  const FastModulo bucket_modulo_;
+  const FastModulo vocabulary_bucket_modulo_;
+
   std::vector<std::unique_ptr<UniLib::RegexPattern>> regex_patterns_;
   const UniLib& unilib_;
+
+  // The regexp features that the shape matcher supports are matched with it
+  // in one pass over the token; shape_pattern_index_[i] is the index of
+  // regexp feature i in shape_matcher_, or -1 if it is matched with ICU.
+  TokenShapeMatcher shape_matcher_;
+  std::vector<int> shape_pattern_index_;
 };
 
 }  // namespace libtextclassifier2
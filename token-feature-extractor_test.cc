@@ -560,5 +560,55 @@ TEST(TokenFeatureExtractorTest, ExtractFiltered) {
   EXPECT_EQ(extractor.HashToken("<PAD>"), 1);
 }
 
+TEST(TokenFeatureExtractorTest, ExtractIntoBuffer) {
+  TokenFeatureExtractorOptions options;
+  options.num_buckets = 1000;
+  options.chargram_orders = std::vector<int>{1, 2, 3};
+  options.unicode_aware_features = true;
+  options.lowercase_tokens = true;
+  CREATE_UNILIB_FOR_TESTING
+  TestingTokenFeatureExtractor extractor(options, unilib);
+
+  const Token token("Hělló", 0, 5);
+  const int max_features = extractor.MaxCharactergramFeatures(token);
+  std::vector<int> features(max_features);
+  const int num_features =
+      extractor.ExtractCharactergramFeatures(token, features.data(),
+                                             max_features);
+  features.resize(num_features);
+  EXPECT_THAT(features,
+              testing::ElementsAreArray(
+                  extractor.ExtractCharactergramFeatures(token)));
+  EXPECT_EQ(features[0], extractor.HashToken("h"));
+
+  // The features beyond the capacity are dropped.
+  std::vector<int> truncated_features(2);
+  EXPECT_EQ(extractor.ExtractCharactergramFeatures(
+                token, truncated_features.data(), truncated_features.size()),
+            2);
+  EXPECT_THAT(truncated_features,
+              testing::ElementsAre(features[0], features[1]));
+}
+
+TEST(TokenFeatureExtractorTest, ExtractDenseFeaturesInPlace) {
+  TokenFeatureExtractorOptions options;
+  options.num_buckets = 1000;
+  options.extract_case_feature = true;
+  options.extract_selection_mask_feature = true;
+  options.regexp_features = {"^[A-Z][a-z]+$", "\\w+"};
+  CREATE_UNILIB_FOR_TESTING
+  TestingTokenFeatureExtractor extractor(options, unilib);
+  ASSERT_EQ(extractor.DenseFeaturesCount(), 4);
+
+  // The features are written between the neighbouring values of the row.
+  std::vector<float> row(6, 7.0);
+  extractor.ExtractDenseFeatures(Token{"Hello", 0, 5}, /*is_in_span=*/false,
+                                 row.data() + 1);
+  EXPECT_THAT(row, testing::ElementsAre(7.0, 1.0, 0.0, 1.0, 1.0, 7.0));
+  EXPECT_THAT(
+      extractor.ExtractDenseFeatures(Token{"hello", 0, 5}, /*is_in_span=*/true),
+      testing::ElementsAre(-1.0, 1.0, -1.0, 1.0));
+}
+
 }  // namespace
 }  // namespace libtextclassifier2
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "token-sequence.h"
+
+namespace libtextclassifier2 {
+
+TokenSequence::TokenSequence(const std::vector<Token>& tokens)
+    : TokenSequence() {
+  int num_value_bytes = 0;
+  for (const Token& token : tokens) {
+    num_value_bytes += token.value.size();
+  }
+  Reserve(tokens.size(), num_value_bytes);
+  for (const Token& token : tokens) {
+    if (token.is_padding) {
+      AddPadding();
+    } else {
+      Add(token.value, token.start, token.end);
+    }
+  }
+}
+
+void TokenSequence::Add(StringPiece value, CodepointIndex start,
+                        CodepointIndex end) {
+  values_.append(value.data(), value.size());
+  value_offsets_.push_back(values_.size());
+  spans_.push_back({start, end});
+  is_padding_.push_back(false);
+}
+
+void TokenSequence::AddPadding() {
+  value_offsets_.push_back(values_.size());
+  spans_.push_back({kInvalidIndex, kInvalidIndex});
+  is_padding_.push_back(true);
+}
+
+void TokenSequence::Reserve(int num_tokens, int num_value_bytes) {
+  values_.reserve(num_value_bytes);
+  value_offsets_.reserve(num_tokens + 1);
+  spans_.reserve(num_tokens);
+  is_padding_.reserve(num_tokens);
+}
+
+void TokenSequence::Clear() {
+  values_.clear();
+  value_offsets_.resize(1);
+  spans_.clear();
+  is_padding_.clear();
+}
+
+void TokenSequence::GetToken(int i, Token* token) const {
+  const StringPiece token_value = value(i);
+  token->value.assign(token_value.data(), token_value.size());
+  token->start = start(i);
+  token->end = end(i);
+  token->is_padding = is_padding(i);
+}
+
+std::vector<Token> TokenSequence::ToTokens() const {
+  std::vector<Token> tokens(size());
+  for (int i = 0; i < size(); ++i) {
+    GetToken(i, &tokens[i]);
+  }
+  return tokens;
+}
+
+void TokenSequenceView::GetToken(int i, Token* token) const {
+  if (InSequence(i)) {
+    sequence_->GetToken(begin_ + i, token);
+  } else {
+    *token = Token();
+  }
+}
+
+TokenSequenceView TokenSequenceView::Subview(TokenSpan span) const {
+  return Reframe(begin_ + span.first, begin_ + span.second);
+}
+
+TokenSequenceView TokenSequenceView::StripOrPad(TokenSpan relative_click_span,
+                                                int context_size,
+                                                int* click_pos) const {
+  int begin = begin_;
+  int end = end_;
+
+  const int right_context_needed = relative_click_span.second + context_size;
+  if (*click_pos + right_context_needed + 1 >= size()) {
+    // Pad max the context size.
+    end += std::min(context_size,
+                    *click_pos + right_context_needed + 1 - size());
+  } else if (*click_pos + right_context_needed + 1 < size() - 1) {
+    // Strip unused tokens.
+    end = begin_ + *click_pos + right_context_needed + 1;
+  }
+
+  const int left_context_needed = relative_click_span.first + context_size;
+  if (*click_pos < left_context_needed) {
+    // Pad max the context size.
+    const int num_pad_tokens =
+        std::min(context_size, left_context_needed - *click_pos);
+    begin -= num_pad_tokens;
+    *click_pos += num_pad_tokens;
+  } else if (*click_pos > left_context_needed) {
+    // Strip unused tokens.
+    const int num_stripped_tokens = *click_pos - left_context_needed;
+    begin += num_stripped_tokens;
+    *click_pos -= num_stripped_tokens;
+  }
+
+  return Reframe(begin, end);
+}
+
+}  // namespace libtextclassifier2
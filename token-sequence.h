@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LIBTEXTCLASSIFIER_TOKEN_SEQUENCE_H_
+#define LIBTEXTCLASSIFIER_TOKEN_SEQUENCE_H_
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "util/strings/stringpiece.h"
+
+namespace libtextclassifier2 {
+
+// A sequence of tokens stored as a structure of arrays: the values of all the
+// tokens are concatenated in one buffer, next to arrays of their offsets and
+// codepoint spans. Adding a token does not allocate once the arrays have grown
+// to the number of tokens, unlike a std::vector<Token>, where every token with
+// a value longer than the small-string buffer holds its own allocation.
+class TokenSequence {
+ public:
+  TokenSequence() : value_offsets_({0}) {}
+
+  explicit TokenSequence(const std::vector<Token>& tokens);
+
+  // Appends a token with the given value and codepoint span.
+  void Add(StringPiece value, CodepointIndex start, CodepointIndex end);
+
+  // Appends a padding token.
+  void AddPadding();
+
+  // Reserves room for the given number of tokens and bytes of their values.
+  void Reserve(int num_tokens, int num_value_bytes);
+
+  // Removes all the tokens without releasing the memory.
+  void Clear();
+
+  int size() const { return spans_.size(); }
+  bool empty() const { return spans_.empty(); }
+
+  // Returns the total size of the token values in bytes.
+  int value_bytes() const { return values_.size(); }
+
+  // Returns the value of the i-th token. Valid until the sequence is modified.
+  StringPiece value(int i) const {
+    return StringPiece(values_.data() + value_offsets_[i],
+                       value_offsets_[i + 1] - value_offsets_[i]);
+  }
+
+  CodepointSpan span(int i) const { return spans_[i]; }
+  CodepointIndex start(int i) const { return spans_[i].first; }
+  CodepointIndex end(int i) const { return spans_[i].second; }
+  bool is_padding(int i) const { return is_padding_[i]; }
+
+  // Copies the i-th token to 'token', reusing the memory of its value.
+  void GetToken(int i, Token* token) const;
+
+  // Returns a copy of the tokens as Token structs.
+  std::vector<Token> ToTokens() const;
+
+ private:
+  std::string values_;
+
+  // The value of the i-th token is values_[value_offsets_[i],
+  // value_offsets_[i + 1]).
+  std::vector<int> value_offsets_;
+
+  std::vector<CodepointSpan> spans_;
+  std::vector<bool> is_padding_;
+};
+
+// A range of tokens of a TokenSequence, which can stretch beyond the ends of
+// the sequence, or be padded beyond the ends of the range it was taken from:
+// the tokens there are padding tokens. Taking a sub-view, stripping and
+// padding are index computations that do not copy any tokens.
+// The view does not own the sequence, which must outlive it.
+class TokenSequenceView {
+ public:
+  explicit TokenSequenceView(const TokenSequence* sequence)
+      : TokenSequenceView(sequence, 0, sequence->size()) {}
+
+  // The view of the tokens [begin, end) of the sequence. 'begin' can be
+  // negative and 'end' greater than the size of the sequence.
+  TokenSequenceView(const TokenSequence* sequence, int begin, int end)
+      : TokenSequenceView(sequence, begin, end, /*tokens_begin=*/0,
+                          /*tokens_end=*/sequence->size()) {}
+
+  int size() const { return end_ - begin_; }
+  bool empty() const { return end_ == begin_; }
+
+  // The accessors are indexed relative to the beginning of the view.
+  bool is_padding(int i) const {
+    return !InSequence(i) || sequence_->is_padding(begin_ + i);
+  }
+  StringPiece value(int i) const {
+    return InSequence(i) ? sequence_->value(begin_ + i) : StringPiece();
+  }
+  CodepointSpan span(int i) const {
+    return InSequence(i) ? sequence_->span(begin_ + i)
+                         : CodepointSpan{kInvalidIndex, kInvalidIndex};
+  }
+
+  // Copies the i-th token of the view to 'token', reusing the memory of its
+  // value.
+  void GetToken(int i, Token* token) const;
+
+  // Returns the view of the tokens in 'span', relative to this view.
+  TokenSequenceView Subview(TokenSpan span) const;
+
+  // Returns the view stripped or padded around the click position the same
+  // way as internal::StripOrPadTokens() strips or pads a vector of tokens,
+  // and updates 'click_pos' to be relative to the returned view.
+  TokenSequenceView StripOrPad(TokenSpan relative_click_span, int context_size,
+                               int* click_pos) const;
+
+ private:
+  TokenSequenceView(const TokenSequence* sequence, int begin, int end,
+                    int tokens_begin, int tokens_end)
+      : sequence_(sequence),
+        begin_(begin),
+        end_(end),
+        tokens_begin_(tokens_begin),
+        tokens_end_(tokens_end) {}
+
+  bool InSequence(int i) const {
+    return begin_ + i >= tokens_begin_ && begin_ + i < tokens_end_;
+  }
+
+  // Returns a view of [begin, end) where only the tokens that are in this view
+  // are not padding tokens.
+  TokenSequenceView Reframe(int begin, int end) const {
+    return TokenSequenceView(sequence_, begin, end,
+                             std::max(begin_, tokens_begin_),
+                             std::min(end_, tokens_end_));
+  }
+
+  const TokenSequence* sequence_;  // Not owned.
+
+  // The range of the sequence in the view.
+  int begin_;
+  int end_;
+
+  // The range of the sequence whose tokens are shown as they are, the ones
+  // outside of it are shown as padding tokens.
+  int tokens_begin_;
+  int tokens_end_;
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_TOKEN_SEQUENCE_H_
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "token-sequence.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+std::vector<Token> ViewTokens(const TokenSequenceView& view) {
+  std::vector<Token> tokens(view.size());
+  for (int i = 0; i < view.size(); ++i) {
+    view.GetToken(i, &tokens[i]);
+  }
+  return tokens;
+}
+
+TokenSequence NumberedTokens(int num_tokens) {
+  TokenSequence sequence;
+  for (int i = 0; i < num_tokens; ++i) {
+    sequence.Add(std::to_string(i), 0, 0);
+  }
+  return sequence;
+}
+
+TEST(TokenSequenceTest, StoresTokens) {
+  const std::vector<Token> tokens = {Token("Hello", 0, 5), Token(),
+                                     Token("", 6, 6),
+                                     Token("a much longer token value", 7, 32)};
+  const TokenSequence sequence(tokens);
+
+  ASSERT_EQ(sequence.size(), 4);
+  EXPECT_EQ(sequence.value(0).ToString(), "Hello");
+  EXPECT_EQ(sequence.span(0), CodepointSpan(0, 5));
+  EXPECT_FALSE(sequence.is_padding(0));
+  EXPECT_TRUE(sequence.is_padding(1));
+  EXPECT_TRUE(sequence.value(2).empty());
+  EXPECT_FALSE(sequence.is_padding(2));
+  EXPECT_EQ(sequence.start(3), 7);
+  EXPECT_EQ(sequence.end(3), 32);
+  EXPECT_EQ(sequence.value_bytes(), 30);
+  EXPECT_EQ(sequence.ToTokens(), tokens);
+}
+
+TEST(TokenSequenceTest, ClearKeepsNoTokens) {
+  TokenSequence sequence = NumberedTokens(3);
+  sequence.Clear();
+  EXPECT_TRUE(sequence.empty());
+  EXPECT_EQ(sequence.value_bytes(), 0);
+
+  sequence.Add("x", 1, 2);
+  EXPECT_EQ(sequence.ToTokens(), std::vector<Token>({Token("x", 1, 2)}));
+}
+
+TEST(TokenSequenceTest, ViewPadsOutsideOfSequence) {
+  const TokenSequence sequence = NumberedTokens(2);
+  const TokenSequenceView view(&sequence, -1, 3);
+
+  EXPECT_EQ(view.size(), 4);
+  EXPECT_TRUE(view.is_padding(0));
+  EXPECT_TRUE(view.value(0).empty());
+  EXPECT_EQ(view.span(0), CodepointSpan(kInvalidIndex, kInvalidIndex));
+  EXPECT_EQ(ViewTokens(view),
+            std::vector<Token>(
+                {Token(), Token("0", 0, 0), Token("1", 0, 0), Token()}));
+}
+
+TEST(TokenSequenceTest, SubviewIsRelativeAndPadded) {
+  const TokenSequence sequence = NumberedTokens(5);
+  const TokenSequenceView view =
+      TokenSequenceView(&sequence).Subview({1, 4}).Subview({-1, 4});
+
+  EXPECT_EQ(ViewTokens(view),
+            std::vector<Token>({Token(), Token("1", 0, 0), Token("2", 0, 0),
+                                Token("3", 0, 0), Token()}));
+}
+
+TEST(TokenSequenceTest, StripOrPad) {
+  const TokenSequence sequence = NumberedTokens(13);
+  const TokenSequenceView view(&sequence);
+  int click_index;
+
+  // Clicking the first token pads from the left.
+  click_index = 0;
+  EXPECT_EQ(ViewTokens(view.StripOrPad({0, 0}, 2, &click_index)),
+            std::vector<Token>({Token(), Token(), Token("0", 0, 0),
+                                Token("1", 0, 0), Token("2", 0, 0)}));
+  EXPECT_EQ(click_index, 2);
+
+  // Clicking with enough context strips on both sides.
+  click_index = 6;
+  EXPECT_EQ(ViewTokens(view.StripOrPad({3, 1}, 2, &click_index)),
+            std::vector<Token>({Token("1", 0, 0), Token("2", 0, 0),
+                                Token("3", 0, 0), Token("4", 0, 0),
+                                Token("5", 0, 0), Token("6", 0, 0),
+                                Token("7", 0, 0), Token("8", 0, 0),
+                                Token("9", 0, 0)}));
+  EXPECT_EQ(click_index, 5);
+
+  // Clicking the last token pads from the right.
+  click_index = 12;
+  EXPECT_EQ(ViewTokens(view.StripOrPad({0, 0}, 2, &click_index)),
+            std::vector<Token>({Token("10", 0, 0), Token("11", 0, 0),
+                                Token("12", 0, 0), Token(), Token()}));
+  EXPECT_EQ(click_index, 2);
+}
+
+TEST(TokenSequenceTest, StripOrPadPadsWithinSequence) {
+  // Padding a view that ends before the end of the sequence must not reveal
+  // the tokens after it.
+  const TokenSequence sequence = NumberedTokens(10);
+  int click_index = 2;
+  const TokenSequenceView view = TokenSequenceView(&sequence).Subview({0, 3});
+
+  EXPECT_EQ(ViewTokens(view.StripOrPad({0, 0}, 1, &click_index)),
+            std::vector<Token>(
+                {Token("1", 0, 0), Token("2", 0, 0), Token()}));
+  EXPECT_EQ(click_index, 1);
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
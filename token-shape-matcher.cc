@@ -0,0 +1,598 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "token-shape-matcher.h"
+
+#include "util/base/logging.h"
+#include "util/memory/memory-usage.h"
+
+namespace libtextclassifier2 {
+
+namespace {
+
+// Upper bound of the NFA size, which bounds the cost of matching a token.
+const int kMaxStates = 4096;
+
+// Upper bound of the counts in the {n,m} quantifiers.
+const int kMaxRepeatCount = 1000;
+
+// Returns whether the codepoint is a line terminator, which '.' does not match.
+bool IsLineTerminator(char32 codepoint) {
+  return codepoint == '\n' || codepoint == '\v' || codepoint == '\f' ||
+         codepoint == '\r' || codepoint == 0x85 || codepoint == 0x2028 ||
+         codepoint == 0x2029;
+}
+
+// Returns whether the codepoint can be escaped to stand for itself.
+bool IsEscapableLiteral(char32 codepoint) {
+  return (codepoint >= '!' && codepoint <= '/') ||
+         (codepoint >= ':' && codepoint <= '@') ||
+         (codepoint >= '[' && codepoint <= '`') ||
+         (codepoint >= '{' && codepoint <= '~');
+}
+
+bool IsAsciiDigit(char32 codepoint) {
+  return codepoint >= '0' && codepoint <= '9';
+}
+
+}  // namespace
+
+struct TokenShapeMatcher::Node {
+  enum Type { EMPTY, CLASS, CONCAT, ALTERNATION, REPEAT };
+  Type type;
+
+  // For CLASS nodes.
+  CodepointClass codepoint_class;
+
+  // The concatenated or alternative nodes, or the single repeated node.
+  std::vector<std::unique_ptr<Node>> children;
+
+  // Bounds of the repetition of REPEAT nodes; max_count is -1 if unbounded.
+  int min_count = 0;
+  int max_count = 0;
+
+  explicit Node(Type type) : type(type) {}
+};
+
+// Recursive descent parser of the supported subset of the regex syntax.
+// Returns nullptr from the Parse* methods on anything outside of it.
+class TokenShapeMatcher::Parser {
+ public:
+  explicit Parser(const UnicodeText& pattern)
+      : codepoints_(pattern.begin(), pattern.end()),
+        pos_(0),
+        end_(codepoints_.size()) {
+    // Matches are full matches, so the anchors at the edges don't constrain
+    // anything.
+    if (pos_ < end_ && codepoints_[pos_] == '^') {
+      ++pos_;
+    }
+    if (end_ > pos_ && codepoints_[end_ - 1] == '$') {
+      int num_backslashes = 0;
+      while (end_ - 2 - num_backslashes >= pos_ &&
+             codepoints_[end_ - 2 - num_backslashes] == '\\') {
+        ++num_backslashes;
+      }
+      if (num_backslashes % 2 == 0) {
+        --end_;
+      }
+    }
+  }
+
+  std::unique_ptr<Node> Parse() {
+    std::unique_ptr<Node> node = ParseAlternation();
+    if (pos_ != end_) {
+      return nullptr;
+    }
+    return node;
+  }
+
+ private:
+  bool AtEnd() const { return pos_ >= end_; }
+  char32 Peek() const { return codepoints_[pos_]; }
+
+  std::unique_ptr<Node> ParseAlternation() {
+    std::unique_ptr<Node> node = ParseConcatenation();
+    if (node == nullptr || AtEnd() || Peek() != '|') {
+      return node;
+    }
+    std::unique_ptr<Node> alternation(new Node(Node::ALTERNATION));
+    alternation->children.push_back(std::move(node));
+    while (!AtEnd() && Peek() == '|') {
+      ++pos_;
+      node = ParseConcatenation();
+      if (node == nullptr) {
+        return nullptr;
+      }
+      alternation->children.push_back(std::move(node));
+    }
+    return alternation;
+  }
+
+  std::unique_ptr<Node> ParseConcatenation() {
+    std::unique_ptr<Node> concatenation(new Node(Node::CONCAT));
+    while (!AtEnd() && Peek() != '|' && Peek() != ')') {
+      std::unique_ptr<Node> node = ParseRepetition();
+      if (node == nullptr) {
+        return nullptr;
+      }
+      concatenation->children.push_back(std::move(node));
+    }
+    if (concatenation->children.empty()) {
+      return std::unique_ptr<Node>(new Node(Node::EMPTY));
+    }
+    if (concatenation->children.size() == 1) {
+      return std::move(concatenation->children[0]);
+    }
+    return concatenation;
+  }
+
+  std::unique_ptr<Node> ParseRepetition() {
+    std::unique_ptr<Node> node = ParseAtom();
+    if (node == nullptr || AtEnd()) {
+      return node;
+    }
+    int min_count;
+    int max_count;
+    switch (Peek()) {
+      case '*':
+        ++pos_;
+        min_count = 0;
+        max_count = -1;
+        break;
+      case '+':
+        ++pos_;
+        min_count = 1;
+        max_count = -1;
+        break;
+      case '?':
+        ++pos_;
+        min_count = 0;
+        max_count = 1;
+        break;
+      case '{':
+        ++pos_;
+        if (!ParseCounts(&min_count, &max_count)) {
+          return nullptr;
+        }
+        break;
+      default:
+        return node;
+    }
+    // Lazy quantifiers find the same full matches as the greedy ones.
+    if (!AtEnd() && Peek() == '?') {
+      ++pos_;
+    }
+    // Possessive quantifiers and stacked quantifiers are not supported.
+    if (!AtEnd() &&
+        (Peek() == '*' || Peek() == '+' || Peek() == '?' || Peek() == '{')) {
+      return nullptr;
+    }
+    std::unique_ptr<Node> repetition(new Node(Node::REPEAT));
+    repetition->min_count = min_count;
+    repetition->max_count = max_count;
+    repetition->children.push_back(std::move(node));
+    return repetition;
+  }
+
+  // Parses the "n}", "n,}" or "n,m}" after a '{'.
+  bool ParseCounts(int* min_count, int* max_count) {
+    if (!ParseCount(min_count)) {
+      return false;
+    }
+    if (AtEnd()) {
+      return false;
+    }
+    if (Peek() == '}') {
+      ++pos_;
+      *max_count = *min_count;
+      return true;
+    }
+    if (Peek() != ',') {
+      return false;
+    }
+    ++pos_;
+    if (AtEnd()) {
+      return false;
+    }
+    if (Peek() == '}') {
+      ++pos_;
+      *max_count = -1;
+      return true;
+    }
+    if (!ParseCount(max_count) || *max_count < *min_count || AtEnd() ||
+        Peek() != '}') {
+      return false;
+    }
+    ++pos_;
+    return true;
+  }
+
+  bool ParseCount(int* count) {
+    if (AtEnd() || !IsAsciiDigit(Peek())) {
+      return false;
+    }
+    *count = 0;
+    while (!AtEnd() && IsAsciiDigit(Peek())) {
+      *count = *count * 10 + (Peek() - '0');
+      if (*count > kMaxRepeatCount) {
+        return false;
+      }
+      ++pos_;
+    }
+    return true;
+  }
+
+  std::unique_ptr<Node> ParseAtom() {
+    const char32 codepoint = Peek();
+    ++pos_;
+    switch (codepoint) {
+      case '(': {
+        if (!AtEnd() && Peek() == '?') {
+          // Only non-capturing groups are supported out of the "(?" forms.
+          ++pos_;
+          if (AtEnd() || Peek() != ':') {
+            return nullptr;
+          }
+          ++pos_;
+        }
+        std::unique_ptr<Node> node = ParseAlternation();
+        if (node == nullptr || AtEnd() || Peek() != ')') {
+          return nullptr;
+        }
+        ++pos_;
+        return node;
+      }
+      case '.': {
+        std::unique_ptr<Node> node(new Node(Node::CLASS));
+        node->codepoint_class.any = true;
+        return node;
+      }
+      case '[':
+        return ParseClass();
+      case '\\':
+        return ParseEscape();
+      case '*':
+      case '+':
+      case '?':
+      case '{':
+      case '}':
+      case ']':
+      case '^':
+      case '$':
+        return nullptr;
+      default:
+        return LiteralNode(codepoint);
+    }
+  }
+
+  std::unique_ptr<Node> ParseEscape() {
+    if (AtEnd()) {
+      return nullptr;
+    }
+    const char32 codepoint = Peek();
+    ++pos_;
+    if (codepoint == 'd' || codepoint == 'D') {
+      std::unique_ptr<Node> node(new Node(Node::CLASS));
+      node->codepoint_class.digits = (codepoint == 'd');
+      node->codepoint_class.non_digits = (codepoint == 'D');
+      return node;
+    }
+    if (IsEscapableLiteral(codepoint)) {
+      return LiteralNode(codepoint);
+    }
+    return nullptr;
+  }
+
+  // Parses a class after its '['.
+  std::unique_ptr<Node> ParseClass() {
+    std::unique_ptr<Node> node(new Node(Node::CLASS));
+    CodepointClass* codepoint_class = &node->codepoint_class;
+    if (!AtEnd() && Peek() == '^') {
+      ++pos_;
+      codepoint_class->negated = true;
+    }
+    // ICU reads a ']' right after the '[' differently than other engines.
+    if (AtEnd() || Peek() == ']') {
+      return nullptr;
+    }
+    while (!AtEnd() && Peek() != ']') {
+      if (Peek() == '\\' && pos_ + 1 < end_ && codepoints_[pos_ + 1] == 'd') {
+        pos_ += 2;
+        codepoint_class->digits = true;
+        continue;
+      }
+      char32 first;
+      if (!ParseClassLiteral(&first)) {
+        return nullptr;
+      }
+      char32 last = first;
+      if (!AtEnd() && Peek() == '-') {
+        ++pos_;
+        if (!ParseClassLiteral(&last) || last < first) {
+          return nullptr;
+        }
+      }
+      codepoint_class->ranges.push_back({first, last});
+    }
+    if (AtEnd()) {
+      return nullptr;
+    }
+    ++pos_;
+    return node;
+  }
+
+  // Parses a codepoint standing for itself in a class. The characters that
+  // UnicodeSet syntax gives a meaning to, and whitespace, which it ignores in
+  // some modes, are rejected.
+  bool ParseClassLiteral(char32* codepoint) {
+    if (AtEnd()) {
+      return false;
+    }
+    *codepoint = Peek();
+    ++pos_;
+    if (*codepoint == '\\') {
+      if (AtEnd() || !IsEscapableLiteral(Peek())) {
+        return false;
+      }
+      *codepoint = Peek();
+      ++pos_;
+      return true;
+    }
+    return !(*codepoint == '[' || *codepoint == ']' || *codepoint == '-' ||
+             *codepoint == '&' || *codepoint == '$' || *codepoint == '^' ||
+             *codepoint == '{' || *codepoint == '}' || *codepoint == ' ' ||
+             *codepoint == '\t' || IsLineTerminator(*codepoint));
+  }
+
+  std::unique_ptr<Node> LiteralNode(char32 codepoint) {
+    std::unique_ptr<Node> node(new Node(Node::CLASS));
+    node->codepoint_class.ranges.push_back({codepoint, codepoint});
+    return node;
+  }
+
+  const std::vector<char32> codepoints_;
+  int pos_;
+  int end_;
+};
+
+int TokenShapeMatcher::AddPattern(const std::string& pattern) {
+  if (start_states_.size() >= kMaxPatterns) {
+    return -1;
+  }
+  std::unique_ptr<Node> root =
+      Parser(UTF8ToUnicodeText(pattern, /*do_copy=*/false)).Parse();
+  if (root == nullptr) {
+    return -1;
+  }
+
+  const int num_states = states_.size();
+  const int num_classes = classes_.size();
+  Fragment fragment;
+  if (!Compile(*root, &fragment) || states_.size() >= kMaxStates) {
+    states_.resize(num_states);
+    classes_.resize(num_classes);
+    return -1;
+  }
+  const int pattern_index = start_states_.size();
+  Patch(fragment.outs,
+        AddState(State::MATCH, /*out=*/-1, /*out1=*/-1, pattern_index));
+  start_states_.push_back(fragment.start);
+  return pattern_index;
+}
+
+int TokenShapeMatcher::AddState(State::Type type, int out, int out1,
+                                int arg) {
+  State state;
+  state.type = type;
+  state.out = out;
+  state.out1 = out1;
+  state.arg = arg;
+  states_.push_back(state);
+  return states_.size() - 1;
+}
+
+void TokenShapeMatcher::Patch(const std::vector<std::pair<int, int>>& outs,
+                              int target) {
+  for (const std::pair<int, int>& out : outs) {
+    if (out.second == 0) {
+      states_[out.first].out = target;
+    } else {
+      states_[out.first].out1 = target;
+    }
+  }
+}
+
+bool TokenShapeMatcher::Compile(const Node& node, Fragment* fragment) {
+  if (states_.size() >= kMaxStates) {
+    return false;
+  }
+  switch (node.type) {
+    case Node::EMPTY: {
+      // A SPLIT state with a single transition doesn't consume anything.
+      const int state = AddState(State::SPLIT, /*out=*/-1, /*out1=*/-1,
+                                 /*arg=*/-1);
+      fragment->start = state;
+      fragment->outs = {{state, 0}};
+      return true;
+    }
+    case Node::CLASS: {
+      classes_.push_back(node.codepoint_class);
+      const int state = AddState(State::CLASS, /*out=*/-1, /*out1=*/-1,
+                                 /*arg=*/classes_.size() - 1);
+      fragment->start = state;
+      fragment->outs = {{state, 0}};
+      return true;
+    }
+    case Node::CONCAT: {
+      if (!Compile(*node.children[0], fragment)) {
+        return false;
+      }
+      for (int i = 1; i < node.children.size(); ++i) {
+        Fragment next;
+        if (!Compile(*node.children[i], &next)) {
+          return false;
+        }
+        Patch(fragment->outs, next.start);
+        fragment->outs = std::move(next.outs);
+      }
+      return true;
+    }
+    case Node::ALTERNATION: {
+      // Chains the alternatives with SPLIT states, built from the last one.
+      if (!Compile(*node.children.back(), fragment)) {
+        return false;
+      }
+      for (int i = node.children.size() - 2; i >= 0; --i) {
+        Fragment alternative;
+        if (!Compile(*node.children[i], &alternative)) {
+          return false;
+        }
+        fragment->start = AddState(State::SPLIT, alternative.start,
+                                   fragment->start, /*arg=*/-1);
+        fragment->outs.insert(fragment->outs.end(), alternative.outs.begin(),
+                              alternative.outs.end());
+      }
+      return true;
+    }
+    case Node::REPEAT: {
+      // Expands the repetition into 'min_count' copies of the node, followed
+      // by a loop if unbounded, or by optional copies up to 'max_count'.
+      const Node& child = *node.children[0];
+      const int state = AddState(State::SPLIT, /*out=*/-1, /*out1=*/-1,
+                                 /*arg=*/-1);
+      fragment->start = state;
+      fragment->outs = {{state, 0}};
+      for (int i = 0; i < node.min_count; ++i) {
+        Fragment copy;
+        if (!Compile(child, &copy)) {
+          return false;
+        }
+        Patch(fragment->outs, copy.start);
+        fragment->outs = std::move(copy.outs);
+      }
+      if (node.max_count < 0) {
+        Fragment loop;
+        if (!Compile(child, &loop)) {
+          return false;
+        }
+        const int split =
+            AddState(State::SPLIT, loop.start, /*out1=*/-1, /*arg=*/-1);
+        Patch(loop.outs, split);
+        Patch(fragment->outs, split);
+        fragment->outs = {{split, 1}};
+        return true;
+      }
+      for (int i = node.min_count; i < node.max_count; ++i) {
+        Fragment copy;
+        if (!Compile(child, &copy)) {
+          return false;
+        }
+        const int split =
+            AddState(State::SPLIT, copy.start, /*out1=*/-1, /*arg=*/-1);
+        Patch(fragment->outs, split);
+        fragment->outs = std::move(copy.outs);
+        fragment->outs.push_back({split, 1});
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+bool TokenShapeMatcher::ClassMatches(const CodepointClass& codepoint_class,
+                                     char32 codepoint) const {
+  if (codepoint_class.any) {
+    return !IsLineTerminator(codepoint);
+  }
+  bool matches = false;
+  for (const std::pair<char32, char32>& range : codepoint_class.ranges) {
+    if (codepoint >= range.first && codepoint <= range.second) {
+      matches = true;
+      break;
+    }
+  }
+  if (!matches && (codepoint_class.digits || codepoint_class.non_digits)) {
+    const bool is_digit = unilib_.IsDigit(codepoint);
+    matches = (codepoint_class.digits && is_digit) ||
+              (codepoint_class.non_digits && !is_digit);
+  }
+  return matches != codepoint_class.negated;
+}
+
+void TokenShapeMatcher::AddToList(int state, int generation,
+                                  std::vector<int>* marks,
+                                  std::vector<int>* list) const {
+  while (state >= 0 && (*marks)[state] != generation) {
+    (*marks)[state] = generation;
+    if (states_[state].type != State::SPLIT) {
+      list->push_back(state);
+      return;
+    }
+    AddToList(states_[state].out1, generation, marks, list);
+    state = states_[state].out;
+  }
+}
+
+uint64 TokenShapeMatcher::Match(const UnicodeText& token) const {
+  if (start_states_.empty()) {
+    return 0;
+  }
+
+  // Simulates the NFA of all the patterns at once, keeping the set of states
+  // reached by the codepoints consumed so far.
+  std::vector<int> marks(states_.size(), -1);
+  std::vector<int> current;
+  std::vector<int> next;
+  current.reserve(states_.size());
+  next.reserve(states_.size());
+  int generation = 0;
+  for (const int start_state : start_states_) {
+    AddToList(start_state, generation, &marks, &current);
+  }
+  for (auto it = token.begin(); it != token.end() && !current.empty(); ++it) {
+    const char32 codepoint = *it;
+    ++generation;
+    next.clear();
+    for (const int state : current) {
+      if (states_[state].type == State::CLASS &&
+          ClassMatches(classes_[states_[state].arg], codepoint)) {
+        AddToList(states_[state].out, generation, &marks, &next);
+      }
+    }
+    current.swap(next);
+  }
+
+  uint64 result = 0;
+  for (const int state : current) {
+    if (states_[state].type == State::MATCH) {
+      result |= static_cast<uint64>(1) << states_[state].arg;
+    }
+  }
+  return result;
+}
+
+int64 TokenShapeMatcher::EstimateHeapBytes() const {
+  int64 result = VectorHeapBytes(states_) + VectorHeapBytes(classes_) +
+                 VectorHeapBytes(start_states_);
+  for (const CodepointClass& codepoint_class : classes_) {
+    result += VectorHeapBytes(codepoint_class.ranges);
+  }
+  return result;
+}
+
+}  // namespace libtextclassifier2
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LIBTEXTCLASSIFIER_TOKEN_SHAPE_MATCHER_H_
+#define LIBTEXTCLASSIFIER_TOKEN_SHAPE_MATCHER_H_
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "util/base/integral_types.h"
+#include "util/utf8/unicodetext.h"
+#include "util/utf8/unilib.h"
+
+namespace libtextclassifier2 {
+
+// Matches whole tokens against a set of simple regular expressions, like the
+// token shape patterns of the regexp features (e.g. "^[A-Z][a-z]+$"), in one
+// pass over the codepoints of the token. All the patterns are compiled into a
+// single NFA, which is simulated without converting the token to UTF-16 or
+// allocating a matcher per pattern.
+// Only a subset of the ICU syntax is supported, for which the results are the
+// same as those of UniLib::RegexMatcher::Matches(): literals, ".", classes of
+// literals and ranges, \d and \D, groups, alternation, the greedy and lazy
+// quantifiers, and a "^" at the start or a "$" at the end of the pattern.
+// Patterns using anything else are rejected and have to be run with ICU.
+class TokenShapeMatcher {
+ public:
+  // The maximum number of patterns, one bit each in the result of Match().
+  static const int kMaxPatterns = 64;
+
+  explicit TokenShapeMatcher(const UniLib& unilib) : unilib_(unilib) {}
+
+  // Compiles the regex (in UTF-8) and adds it as the next pattern. Returns the
+  // index of the pattern for Match(), or -1 if the pattern is not supported or
+  // there are already kMaxPatterns patterns.
+  int AddPattern(const std::string& pattern);
+
+  int num_patterns() const { return start_states_.size(); }
+
+  // Returns a bit mask with bit i set if pattern i matches the whole token.
+  uint64 Match(const UnicodeText& token) const;
+
+  // Returns an estimate of the heap memory held, in bytes.
+  int64 EstimateHeapBytes() const;
+
+ private:
+  // The syntax tree of a pattern, and the parser building it.
+  struct Node;
+  class Parser;
+
+  // A set of codepoints that a transition of the NFA consumes.
+  struct CodepointClass {
+    // Matches any codepoint except the line terminators, like '.' does.
+    bool any = false;
+    bool negated = false;
+    bool digits = false;
+    bool non_digits = false;
+    std::vector<std::pair<char32, char32>> ranges;
+  };
+
+  struct State {
+    enum Type { CLASS, SPLIT, MATCH };
+    Type type;
+
+    // The next states; -1 for none. Only SPLIT states use 'out1'.
+    int out = -1;
+    int out1 = -1;
+
+    // The index of the codepoint class of a CLASS state, or the pattern index
+    // of a MATCH state.
+    int arg = -1;
+  };
+
+  // A partially built NFA: its start state and the dangling transitions,
+  // given as (state, 0 for out or 1 for out1).
+  struct Fragment {
+    int start;
+    std::vector<std::pair<int, int>> outs;
+  };
+
+  bool Compile(const Node& node, Fragment* fragment);
+  int AddState(State::Type type, int out, int out1, int arg);
+  void Patch(const std::vector<std::pair<int, int>>& outs, int target);
+
+  bool ClassMatches(const CodepointClass& codepoint_class,
+                    char32 codepoint) const;
+
+  // Adds the state and the states reachable from it without consuming a
+  // codepoint to 'list', unless they are marked with 'generation' already.
+  void AddToList(int state, int generation, std::vector<int>* marks,
+                 std::vector<int>* list) const;
+
+  const UniLib& unilib_;
+  std::vector<State> states_;
+  std::vector<CodepointClass> classes_;
+  std::vector<int> start_states_;
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_TOKEN_SHAPE_MATCHER_H_
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "token-shape-matcher.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+TEST(TokenShapeMatcherTest, Match) {
+  CREATE_UNILIB_FOR_TESTING
+  TokenShapeMatcher matcher(unilib);
+  ASSERT_EQ(matcher.AddPattern("^[A-Z][a-z]+$"), 0);
+  ASSERT_EQ(matcher.AddPattern("^\\d+$"), 1);
+  ASSERT_EQ(matcher.AddPattern("(?:ab|c)*d?"), 2);
+  ASSERT_EQ(matcher.num_patterns(), 3);
+
+  const auto match = [&matcher](const std::string& token) {
+    return matcher.Match(UTF8ToUnicodeText(token, /*do_copy=*/false));
+  };
+  EXPECT_EQ(match("Hello"), 1);
+  EXPECT_EQ(match("hello"), 0);
+  EXPECT_EQ(match("123"), 2);
+  EXPECT_EQ(match("\xd9\xa3"), 2);
+  EXPECT_EQ(match("ababcd"), 4);
+  EXPECT_EQ(match(""), 4);
+}
+
+TEST(TokenShapeMatcherTest, RejectsUnsupportedPatterns) {
+  CREATE_UNILIB_FOR_TESTING
+  TokenShapeMatcher matcher(unilib);
+  EXPECT_EQ(matcher.AddPattern("(?i)abc"), -1);
+  EXPECT_EQ(matcher.AddPattern("\\w+"), -1);
+  EXPECT_EQ(matcher.AddPattern("\\p{Lu}"), -1);
+  EXPECT_EQ(matcher.AddPattern("a++"), -1);
+  EXPECT_EQ(matcher.AddPattern("[[a-z]&&[^b]]"), -1);
+  EXPECT_EQ(matcher.AddPattern("a^b"), -1);
+  EXPECT_EQ(matcher.AddPattern("(abc"), -1);
+  EXPECT_EQ(matcher.num_patterns(), 0);
+
+  // The matcher stays usable after a rejected pattern.
+  ASSERT_EQ(matcher.AddPattern("x{2,3}"), 0);
+  EXPECT_EQ(matcher.Match(UTF8ToUnicodeText("xxx", /*do_copy=*/false)), 1);
+}
+
+TEST(TokenShapeMatcherTest, AgreesWithIcu) {
+  CREATE_UNILIB_FOR_TESTING
+  const std::vector<std::string> patterns = {
+      "^[A-Z][a-z]+$",   "^[a-z]+$",       "^[A-Z]+$",
+      "^\\d+$",          "^\\D+$",         "^[0-9]{1,2}$",
+      "^\\d{4}$",        "^[^a-z]*$",      "^.*\\d.*$",
+      "^\\d+(?:st|nd|rd|th)$",            "a|b|",
+      "(a|ab)(c|bcd)",   "x{2,}",          "(?:xy)?z+?",
+      "[\\d.,]+",        "\\.\\$\\(\\)",   "[a-c\xc3\xa4-\xc3\xb6]+$",
+      ".",               "(a*)*b",         "\\\\$",
+  };
+  const std::vector<std::string> tokens = {
+      "",        "a",     "b",       "Hello",  "HELLO",          "hello",
+      "123",     "1234",  "1st",     "22nd",   "abcd",           "abc",
+      "xx",      "xxxxx", "z",       "xyzzz",  "1,234.5",        ".$()",
+      "\xc3\xa4\xc3\xb6", "\xd9\xa3\xd9\xa4",  "\n",             "b\n",
+      "aaab",    "\\",    "\xe2\x80\xa8",     "ab1cd",           "-",
+  };
+
+  TokenShapeMatcher matcher(unilib);
+  std::vector<std::unique_ptr<UniLib::RegexPattern>> icu_patterns;
+  for (const std::string& pattern : patterns) {
+    ASSERT_EQ(matcher.AddPattern(pattern), icu_patterns.size()) << pattern;
+    icu_patterns.emplace_back(unilib.CreateRegexPattern(
+        UTF8ToUnicodeText(pattern, /*do_copy=*/false)));
+    ASSERT_NE(icu_patterns.back(), nullptr) << pattern;
+  }
+
+  for (const std::string& token : tokens) {
+    const UnicodeText token_unicode =
+        UTF8ToUnicodeText(token, /*do_copy=*/false);
+    const uint64 result = matcher.Match(token_unicode);
+    for (int i = 0; i < patterns.size(); ++i) {
+      int status;
+      const bool icu_matches =
+          icu_patterns[i]->Matcher(token_unicode)->Matches(&status);
+      EXPECT_EQ((result >> i) & 1, icu_matches)
+          << "pattern: " << patterns[i] << ", token: " << token;
+    }
+  }
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
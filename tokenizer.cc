@@ -19,6 +19,7 @@
 #include <algorithm>
 
 #include "util/base/logging.h"
+#include "util/memory/memory-usage.h"
 #include "util/strings/utf8.h"
 
 namespace libtextclassifier2 {
@@ -36,6 +37,30 @@ Tokenizer::Tokenizer(
                const std::unique_ptr<const TokenizationCodepointRangeT>& b) {
               return a->start < b->start;
             });
+
+  BuildLookupTable();
+}
+
+const int Tokenizer::kNumLookupCodepoints;
+const int Tokenizer::kRoleBits;
+const int Tokenizer::kUnknownScriptCode;
+const int Tokenizer::kUnpackedScriptCode;
+
+void Tokenizer::BuildLookupTable() {
+  lookup_table_.assign(kNumLookupCodepoints,
+                       TokenizationCodepointRange_::Role_DEFAULT_ROLE |
+                           (kUnknownScriptCode << kRoleBits));
+  for (const auto& range : codepoint_ranges_) {
+    const int script_code =
+        (range->script_id >= 0 && range->script_id + 1 < kUnpackedScriptCode)
+            ? range->script_id + 1
+            : kUnpackedScriptCode;
+    const int begin = std::max(range->start, 0);
+    const int end = std::min<int>(range->end, kNumLookupCodepoints);
+    for (int codepoint = begin; codepoint < end; ++codepoint) {
+      lookup_table_[codepoint] = range->role | (script_code << kRoleBits);
+    }
+  }
 }
 
 const TokenizationCodepointRangeT* Tokenizer::FindTokenizationRange(
@@ -66,6 +91,18 @@ const TokenizationCodepointRangeT* Tokenizer::FindTokenizationRange(
 void Tokenizer::GetScriptAndRole(char32 codepoint,
                                  TokenizationCodepointRange_::Role* role,
                                  int* script) const {
+  if (codepoint >= 0 && codepoint < kNumLookupCodepoints) {
+    const int packed = lookup_table_[codepoint];
+    const int script_code = packed >> kRoleBits;
+    if (script_code != kUnpackedScriptCode) {
+      *role = static_cast<TokenizationCodepointRange_::Role>(
+          packed & ((1 << kRoleBits) - 1));
+      *script =
+          script_code == kUnknownScriptCode ? kUnknownScript : script_code - 1;
+      return;
+    }
+  }
+
   const TokenizationCodepointRangeT* range = FindTokenizationRange(codepoint);
   if (range) {
     *role = range->role;
@@ -82,8 +119,43 @@ std::vector<Token> Tokenizer::Tokenize(const std::string& text) const {
 }
 
 std::vector<Token> Tokenizer::Tokenize(const UnicodeText& text_unicode) const {
+  std::vector<TokenView> views;
+  TokenizeToViews(text_unicode, &views);
+
   std::vector<Token> result;
-  Token new_token("", 0, 0);
+  result.reserve(views.size());
+  for (const TokenView& view : views) {
+    result.emplace_back(TokenValue(text_unicode, view), view.start, view.end);
+  }
+  return result;
+}
+
+void Tokenizer::Tokenize(const UnicodeText& text_unicode,
+                         TokenSequence* result) const {
+  std::vector<TokenView> views;
+  TokenizeToViews(text_unicode, &views);
+
+  result->Reserve(result->size() + views.size(),
+                  result->value_bytes() + text_unicode.size_bytes());
+  for (const TokenView& view : views) {
+    if (view.has_discarded_codepoints) {
+      result->Add(TokenValue(text_unicode, view), view.start, view.end);
+    } else {
+      result->Add(StringPiece(text_unicode.data() + view.byte_start,
+                              view.byte_end - view.byte_start),
+                  view.start, view.end);
+    }
+  }
+}
+
+void Tokenizer::TokenizeToViews(const UnicodeText& text_unicode,
+                                std::vector<TokenView>* result) const {
+  result->clear();
+  const char* text_data = text_unicode.data();
+  TokenView new_token = {0, 0, 0, 0, false};
+  // Whether a codepoint was discarded after the last retained one of the
+  // current token.
+  bool discarded_in_token = false;
   int codepoint_index = 0;
 
   int last_script = kInvalidScript;
@@ -96,31 +168,69 @@ std::vector<Token> Tokenizer::Tokenize(const UnicodeText& text_unicode) const {
     if (role & TokenizationCodepointRange_::Role_SPLIT_BEFORE ||
         (split_on_script_change_ && last_script != kInvalidScript &&
          last_script != script)) {
-      if (!new_token.value.empty()) {
-        result.push_back(new_token);
+      if (new_token.byte_end != new_token.byte_start) {
+        result->push_back(new_token);
       }
-      new_token = Token("", codepoint_index, codepoint_index);
+      new_token = {codepoint_index, codepoint_index, 0, 0, false};
+      discarded_in_token = false;
     }
     if (!(role & TokenizationCodepointRange_::Role_DISCARD_CODEPOINT)) {
-      new_token.value += std::string(
-          it.utf8_data(),
-          it.utf8_data() + GetNumBytesForNonZeroUTF8Char(it.utf8_data()));
+      const int byte_offset = it.utf8_data() - text_data;
+      if (new_token.byte_end == new_token.byte_start) {
+        new_token.byte_start = byte_offset;
+      } else if (discarded_in_token) {
+        new_token.has_discarded_codepoints = true;
+      }
+      new_token.byte_end =
+          byte_offset + GetNumBytesForNonZeroUTF8Char(it.utf8_data());
       ++new_token.end;
+      discarded_in_token = false;
+    } else {
+      discarded_in_token = true;
     }
     if (role & TokenizationCodepointRange_::Role_SPLIT_AFTER) {
-      if (!new_token.value.empty()) {
-        result.push_back(new_token);
+      if (new_token.byte_end != new_token.byte_start) {
+        result->push_back(new_token);
       }
-      new_token = Token("", codepoint_index + 1, codepoint_index + 1);
+      new_token = {codepoint_index + 1, codepoint_index + 1, 0, 0, false};
+      discarded_in_token = false;
     }
 
     last_script = script;
   }
-  if (!new_token.value.empty()) {
-    result.push_back(new_token);
+  if (new_token.byte_end != new_token.byte_start) {
+    result->push_back(new_token);
   }
+}
 
-  return result;
+std::string Tokenizer::TokenValue(const UnicodeText& text_unicode,
+                                  const TokenView& token) const {
+  const char* begin = text_unicode.data() + token.byte_start;
+  const char* end = text_unicode.data() + token.byte_end;
+  if (!token.has_discarded_codepoints) {
+    return std::string(begin, end);
+  }
+
+  std::string value;
+  value.reserve(end - begin);
+  const UnicodeText token_text =
+      UTF8ToUnicodeText(begin, end - begin, /*do_copy=*/false);
+  for (auto it = token_text.begin(); it != token_text.end(); ++it) {
+    TokenizationCodepointRange_::Role role;
+    int script;
+    GetScriptAndRole(*it, &role, &script);
+    if (!(role & TokenizationCodepointRange_::Role_DISCARD_CODEPOINT)) {
+      value.append(it.utf8_data(),
+                   GetNumBytesForNonZeroUTF8Char(it.utf8_data()));
+    }
+  }
+  return value;
+}
+
+int64 Tokenizer::EstimateHeapBytes() const {
+  return VectorHeapBytes(codepoint_ranges_) +
+         codepoint_ranges_.size() * sizeof(TokenizationCodepointRangeT) +
+         VectorHeapBytes(lookup_table_);
 }
 
 }  // namespace libtextclassifier2
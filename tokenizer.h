@@ -21,6 +21,7 @@
 #include <vector>
 
 #include "model_generated.h"
+#include "token-sequence.h"
 #include "types.h"
 #include "util/base/integral_types.h"
 #include "util/utf8/unicodetext.h"
@@ -30,6 +31,22 @@ namespace libtextclassifier2 {
 const int kInvalidScript = -1;
 const int kUnknownScript = -2;
 
+// A token as a range of the tokenized UTF-8 text, without a copy of its value.
+struct TokenView {
+  // Codepoint span of the token, as in Token.
+  CodepointIndex start;
+  CodepointIndex end;
+
+  // Byte range of the token in the text, from its first to its last retained
+  // codepoint.
+  int byte_start;
+  int byte_end;
+
+  // Whether there are discarded codepoints within the byte range, in which
+  // case the value is not just the bytes in the range.
+  bool has_discarded_codepoints;
+};
+
 // Tokenizer splits the input string into a sequence of tokens, according to the
 // configuration.
 class Tokenizer {
@@ -44,6 +61,24 @@ class Tokenizer {
   // Same as above but takes UnicodeText.
   std::vector<Token> Tokenize(const UnicodeText& text_unicode) const;
 
+  // Same as above, but appends the tokens to a TokenSequence, which stores
+  // their values without allocating per token.
+  void Tokenize(const UnicodeText& text_unicode, TokenSequence* result) const;
+
+  // Tokenizes the text like Tokenize(), but produces views into the text
+  // instead of copying the token values. Does not allocate once 'result' has
+  // grown to the number of tokens.
+  void TokenizeToViews(const UnicodeText& text_unicode,
+                       std::vector<TokenView>* result) const;
+
+  // Returns the value of a token produced by TokenizeToViews() on the text.
+  std::string TokenValue(const UnicodeText& text_unicode,
+                         const TokenView& token) const;
+
+  // Returns an estimate of the heap memory held, in bytes, which is mostly
+  // the unpacked copies of the codepoint ranges.
+  int64 EstimateHeapBytes() const;
+
  protected:
   // Finds the tokenization codepoint range config for given codepoint.
   // Internally uses binary search so should be O(log(# of codepoint_ranges)).
@@ -51,16 +86,35 @@ class Tokenizer {
 
   // Finds the role and script for given codepoint. If not found, DEFAULT_ROLE
   // and kUnknownScript are assigned.
+  // Codepoints below kNumLookupCodepoints are looked up in a table, the rest
+  // with FindTokenizationRange().
   void GetScriptAndRole(char32 codepoint,
                         TokenizationCodepointRange_::Role* role,
                         int* script) const;
 
  private:
+  // Covers all the codepoints with 1- and 2-byte UTF-8 encodings: ASCII,
+  // Latin-1, and the Latin, Greek, Cyrillic, Hebrew and Arabic blocks.
+  static const int kNumLookupCodepoints = 0x800;
+
+  // Each entry of lookup_table_ packs the role in the low bits and the script
+  // code in the others. The script code is kUnknownScriptCode for codepoints
+  // not covered by any range, script_id + 1 for small script ids, and
+  // kUnpackedScriptCode if the script id does not fit.
+  static const int kRoleBits = 3;
+  static const int kUnknownScriptCode = 0;
+  static const int kUnpackedScriptCode = (1 << (8 - kRoleBits)) - 1;
+
+  // Fills lookup_table_ from codepoint_ranges_.
+  void BuildLookupTable();
+
   // Codepoint ranges that determine how different codepoints are tokenized.
   // The ranges must not overlap.
   std::vector<std::unique_ptr<const TokenizationCodepointRangeT>>
       codepoint_ranges_;
 
+  std::vector<uint8> lookup_table_;
+
   // If true, tokens will be additionally split when the codepoint's script_id
   // changes.
   bool split_on_script_change_;
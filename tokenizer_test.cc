@@ -35,6 +35,7 @@ class TestingTokenizer : public Tokenizer {
       : Tokenizer(codepoint_range_configs, split_on_script_change) {}
 
   using Tokenizer::FindTokenizationRange;
+  using Tokenizer::GetScriptAndRole;
 };
 
 class TestingTokenizerProxy {
@@ -67,10 +68,36 @@ class TestingTokenizerProxy {
     }
   }
 
+  std::pair<TokenizationCodepointRange_::Role, int> TestGetScriptAndRole(
+      int c) const {
+    TokenizationCodepointRange_::Role role;
+    int script;
+    tokenizer_->GetScriptAndRole(c, &role, &script);
+    return {role, script};
+  }
+
   std::vector<Token> Tokenize(const std::string& utf8_text) const {
     return tokenizer_->Tokenize(utf8_text);
   }
 
+  std::vector<TokenView> TokenizeToViews(const UnicodeText& text) const {
+    std::vector<TokenView> views;
+    tokenizer_->TokenizeToViews(text, &views);
+    return views;
+  }
+
+  std::string TokenValue(const UnicodeText& text,
+                         const TokenView& view) const {
+    return tokenizer_->TokenValue(text, view);
+  }
+
+  std::vector<Token> TokenizeToSequence(const std::string& utf8_text) const {
+    TokenSequence sequence;
+    tokenizer_->Tokenize(UTF8ToUnicodeText(utf8_text, /*do_copy=*/false),
+                         &sequence);
+    return sequence.ToTokens();
+  }
+
  private:
   std::vector<flatbuffers::DetachedBuffer> buffers_;
   std::unique_ptr<TestingTokenizer> tokenizer_;
@@ -131,6 +158,55 @@ TEST(TokenizerTest, FindTokenizationRange) {
             TokenizationCodepointRange_::Role_DEFAULT_ROLE);
 }
 
+TEST(TokenizerTest, GetScriptAndRole) {
+  std::vector<TokenizationCodepointRangeT> configs;
+  TokenizationCodepointRangeT* config;
+
+  configs.emplace_back();
+  config = &configs.back();
+  config->start = 32;
+  config->end = 33;
+  config->role = TokenizationCodepointRange_::Role_WHITESPACE_SEPARATOR;
+  config->script_id = 0;
+
+  // Crosses the end of the lookup table.
+  configs.emplace_back();
+  config = &configs.back();
+  config->start = 0x7F0;
+  config->end = 0x810;
+  config->role = TokenizationCodepointRange_::Role_SPLIT_BEFORE;
+  config->script_id = 3;
+
+  // The script id is too large to be packed in the lookup table.
+  configs.emplace_back();
+  config = &configs.back();
+  config->start = 100;
+  config->end = 110;
+  config->role = TokenizationCodepointRange_::Role_DISCARD_CODEPOINT;
+  config->script_id = 1000;
+
+  TestingTokenizerProxy tokenizer(configs, /*split_on_script_change=*/false);
+  EXPECT_EQ(tokenizer.TestGetScriptAndRole(32),
+            std::make_pair(
+                TokenizationCodepointRange_::Role_WHITESPACE_SEPARATOR, 0));
+  EXPECT_EQ(tokenizer.TestGetScriptAndRole(33),
+            std::make_pair(TokenizationCodepointRange_::Role_DEFAULT_ROLE,
+                           kUnknownScript));
+  EXPECT_EQ(
+      tokenizer.TestGetScriptAndRole(0x7FF),
+      std::make_pair(TokenizationCodepointRange_::Role_SPLIT_BEFORE, 3));
+  EXPECT_EQ(
+      tokenizer.TestGetScriptAndRole(0x800),
+      std::make_pair(TokenizationCodepointRange_::Role_SPLIT_BEFORE, 3));
+  EXPECT_EQ(tokenizer.TestGetScriptAndRole(0x810),
+            std::make_pair(TokenizationCodepointRange_::Role_DEFAULT_ROLE,
+                           kUnknownScript));
+  EXPECT_EQ(
+      tokenizer.TestGetScriptAndRole(105),
+      std::make_pair(TokenizationCodepointRange_::Role_DISCARD_CODEPOINT,
+                     1000));
+}
+
 TEST(TokenizerTest, TokenizeOnSpace) {
   std::vector<TokenizationCodepointRangeT> configs;
   TokenizationCodepointRangeT* config;
@@ -149,6 +225,53 @@ TEST(TokenizerTest, TokenizeOnSpace) {
               ElementsAreArray({Token("Hello", 0, 5), Token("world!", 6, 12)}));
 }
 
+TEST(TokenizerTest, TokenizeToViews) {
+  std::vector<TokenizationCodepointRangeT> configs;
+  TokenizationCodepointRangeT* config;
+
+  configs.emplace_back();
+  config = &configs.back();
+  // Space character.
+  config->start = 32;
+  config->end = 33;
+  config->role = TokenizationCodepointRange_::Role_WHITESPACE_SEPARATOR;
+  configs.emplace_back();
+  config = &configs.back();
+  // Hyphen.
+  config->start = 45;
+  config->end = 46;
+  config->role = TokenizationCodepointRange_::Role_DISCARD_CODEPOINT;
+
+  TestingTokenizerProxy tokenizer(configs, /*split_on_script_change=*/false);
+  const UnicodeText text =
+      UTF8ToUnicodeText("-Hé-llo wörld-!-", /*do_copy=*/false);
+  const std::vector<TokenView> views = tokenizer.TokenizeToViews(text);
+
+  ASSERT_EQ(views.size(), 2);
+  EXPECT_EQ(views[0].start, 0);
+  EXPECT_EQ(views[0].end, 5);
+  EXPECT_EQ(views[0].byte_start, 1);
+  EXPECT_EQ(views[0].byte_end, 8);
+  EXPECT_TRUE(views[0].has_discarded_codepoints);
+  EXPECT_EQ(tokenizer.TokenValue(text, views[0]), "Héllo");
+
+  EXPECT_EQ(views[1].start, 8);
+  EXPECT_EQ(views[1].end, 14);
+  EXPECT_EQ(views[1].byte_start, 9);
+  EXPECT_EQ(views[1].byte_end, 17);
+  EXPECT_TRUE(views[1].has_discarded_codepoints);
+  EXPECT_EQ(tokenizer.TokenValue(text, views[1]), "wörld!");
+
+  EXPECT_THAT(tokenizer.Tokenize("-Hé-llo wörld-!-"),
+              ElementsAreArray({Token("Héllo", 0, 5), Token("wörld!", 8, 14)}));
+  EXPECT_THAT(tokenizer.Tokenize("Hello world"),
+              ElementsAreArray({Token("Hello", 0, 5), Token("world", 6, 11)}));
+  EXPECT_EQ(tokenizer.TokenizeToSequence("-Hé-llo wörld-!-"),
+            tokenizer.Tokenize("-Hé-llo wörld-!-"));
+  EXPECT_EQ(tokenizer.TokenizeToSequence("Hello world"),
+            tokenizer.Tokenize("Hello world"));
+}
+
 TEST(TokenizerTest, TokenizeOnSpaceAndScriptChange) {
   std::vector<TokenizationCodepointRangeT> configs;
   TokenizationCodepointRangeT* config;
@@ -20,13 +20,14 @@
 #include <algorithm>
 #include <cmath>
 #include <functional>
-#include <set>
+#include <iterator>
 #include <string>
 #include <utility>
 #include <vector>
 #include "util/base/integral_types.h"
 
 #include "util/base/logging.h"
+#include "util/memory/small-vector.h"
 
 namespace libtextclassifier2 {
 
@@ -52,37 +53,52 @@ inline bool ValidNonEmptySpan(const CodepointSpan& span) {
   return span.first < span.second && span.first >= 0 && span.second >= 0;
 }
 
-template <typename T>
-bool DoesCandidateConflict(
-    const int considered_candidate, const std::vector<T>& candidates,
-    const std::set<int, std::function<bool(int, int)>>& chosen_indices_set) {
-  if (chosen_indices_set.empty()) {
-    return false;
+// Greedily collects non-overlapping spans: a span is only added if it doesn't
+// overlap any of the spans added before it. So offering the candidates in the
+// order of their priority resolves the conflicts between them.
+// The spans are kept sorted by their start in a flat vector, which is cheaper
+// to search and to grow than a node-based set.
+class NonOverlappingSpans {
+ public:
+  explicit NonOverlappingSpans(int expected_size = 0) {
+    spans_.reserve(expected_size);
   }
 
-  auto conflicting_it = chosen_indices_set.lower_bound(considered_candidate);
-  // Check conflict on the right.
-  if (conflicting_it != chosen_indices_set.end() &&
-      SpansOverlap(candidates[considered_candidate].span,
-                   candidates[*conflicting_it].span)) {
+  // Adds 'span' with the caller-defined 'index', if it doesn't overlap any
+  // of the already added spans. Returns whether it was added.
+  bool AddIfNoConflict(const CodepointSpan& span, int index) {
+    auto it = std::lower_bound(
+        spans_.begin(), spans_.end(), span.first,
+        [](const std::pair<CodepointSpan, int>& added, CodepointIndex start) {
+          return added.first.first < start;
+        });
+
+    // As the added spans don't overlap each other, only the neighbors on the
+    // right and on the left can overlap the new span.
+    if (it != spans_.end() && SpansOverlap(span, it->first)) {
+      return false;
+    }
+    if (it != spans_.begin() && SpansOverlap(span, std::prev(it)->first)) {
+      return false;
+    }
+    spans_.insert(it, {span, index});
     return true;
   }
 
-  // Check conflict on the left.
-  // If we can't go more left, there can't be a conflict:
-  if (conflicting_it == chosen_indices_set.begin()) {
-    return false;
-  }
-  // Otherwise move one span left and insert if it doesn't overlap with the
-  // candidate.
-  --conflicting_it;
-  if (!SpansOverlap(candidates[considered_candidate].span,
-                    candidates[*conflicting_it].span)) {
-    return false;
+  // Returns the indices of the added spans, in the order of their position in
+  // the text.
+  std::vector<int> IndicesInTextOrder() const {
+    std::vector<int> indices;
+    indices.reserve(spans_.size());
+    for (const std::pair<CodepointSpan, int>& span_and_index : spans_) {
+      indices.push_back(span_and_index.second);
+    }
+    return indices;
   }
 
-  return true;
-}
+ private:
+  std::vector<std::pair<CodepointSpan, int>> spans_;
+};
 
 // Marks a span in a sequence of tokens. The first element is the index of the
 // first token in the span, and the second element is the index of the token one
@@ -130,9 +146,12 @@ struct Token {
   Token()
       : value(""), start(kInvalidIndex), end(kInvalidIndex), is_padding(true) {}
 
-  Token(const std::string& arg_value, CodepointIndex arg_start,
+  Token(std::string arg_value, CodepointIndex arg_start,
         CodepointIndex arg_end)
-      : value(arg_value), start(arg_start), end(arg_end), is_padding(false) {}
+      : value(std::move(arg_value)),
+        start(arg_start),
+        end(arg_end),
+        is_padding(false) {}
 
   bool operator==(const Token& other) const {
     return value == other.value && start == other.start && end == other.end &&
@@ -246,6 +265,10 @@ inline logging::LoggingStringStream& operator<<(
                 << result.score << ")";
 }
 
+// The classification results of a span. Most spans have one to three results,
+// which are stored without allocating.
+typedef SmallVector<ClassificationResult, 3> ClassificationResults;
+
 // Pretty-printing function for std::vector<ClassificationResult>.
 inline logging::LoggingStringStream& operator<<(
     logging::LoggingStringStream& stream,
@@ -264,7 +287,7 @@ struct AnnotatedSpan {
   CodepointSpan span = {kInvalidIndex, kInvalidIndex};
 
   // Classification result for the span.
-  std::vector<ClassificationResult> classification;
+  ClassificationResults classification;
 };
 
 // Pretty-printing function for AnnotatedSpan.
@@ -16,9 +16,11 @@
 
 #include "util/calendar/calendar-icu.h"
 
+#include <cstring>
 #include <memory>
 
 #include "util/base/macros.h"
+#include "util/calendar/civil-time.h"
 #include "unicode/gregocal.h"
 #include "unicode/timezone.h"
 #include "unicode/ucal.h"
@@ -285,23 +287,178 @@ bool RoundToGranularity(DatetimeGranularity granularity,
 
 }  // namespace
 
+constexpr int CalendarLib::kMaxCachedCalendars;
+
+std::shared_ptr<const icu::Calendar> CalendarLib::GetPrototype(
+    const std::string& reference_locale,
+    const std::string& reference_timezone) const {
+  // Looking up the locale data and the timezone rules is much more expensive
+  // than cloning an existing calendar, so do it once per pair.
+  const std::string key = reference_locale + '\0' + reference_timezone;
+  std::lock_guard<std::mutex> lock(calendars_mutex_);
+  auto it = calendars_.find(key);
+  if (it == calendars_.end()) {
+    UErrorCode status = U_ZERO_ERROR;
+    std::unique_ptr<icu::Calendar> prototype(icu::Calendar::createInstance(
+        icu::Locale::createFromName(reference_locale.c_str()), status));
+    if (U_FAILURE(status)) {
+      TC_LOG(ERROR) << "error getting calendar instance";
+      return nullptr;
+    }
+    prototype->adoptTimeZone(icu::TimeZone::createTimeZone(
+        icu::UnicodeString::fromUTF8(reference_timezone)));
+
+    // Evicted prototypes stay alive for as long as a caller still uses them.
+    if (calendars_.size() >= kMaxCachedCalendars) {
+      calendars_.clear();
+    }
+    it = calendars_.emplace(key, std::move(prototype)).first;
+  }
+  return it->second;
+}
+
+bool CalendarLib::InterpretAbsoluteGregorianDate(
+    const DateParseData& parse_data, int64 reference_time_ms_utc,
+    const icu::Calendar& prototype, DatetimeGranularity granularity,
+    int64* interpreted_time_ms_utc) const {
+  const int mask = parse_data.field_set_mask;
+  if (mask & (DateParseData::Fields::RELATION_FIELD |
+              DateParseData::Fields::RELATION_TYPE_FIELD |
+              DateParseData::Fields::RELATION_DISTANCE_FIELD |
+              DateParseData::Fields::ZONE_OFFSET_FIELD |
+              DateParseData::Fields::DST_OFFSET_FIELD)) {
+    return false;
+  }
+  // Weeks depend on the locale's first day of week.
+  if (granularity == GRANULARITY_WEEK) {
+    return false;
+  }
+  // Subclasses of the Gregorian calendar, e.g. the Buddhist one, number the
+  // years differently, so check the type rather than the class.
+  if (strcmp(prototype.getType(), "gregorian") != 0) {
+    return false;
+  }
+
+  const icu::TimeZone& timezone = prototype.getTimeZone();
+  UErrorCode status = U_ZERO_ERROR;
+  int32_t raw_offset, dst_offset;
+  timezone.getOffset(static_cast<UDate>(reference_time_ms_utc),
+                     /*local=*/false, raw_offset, dst_offset, status);
+  if (U_FAILURE(status)) {
+    return false;
+  }
+  int year, month, day;
+  CivilFromDays(FloorDivide(reference_time_ms_utc + raw_offset + dst_offset,
+                            kMillisInDay),
+                &year, &month, &day);
+
+  // The fields that are not set are taken from the reference day. The
+  // calendar would silently roll invalid values over to the following days
+  // and months, so leave those to it.
+  if (mask & DateParseData::Fields::YEAR_FIELD) {
+    year = parse_data.year;
+  }
+  if (mask & DateParseData::Fields::MONTH_FIELD) {
+    month = parse_data.month;
+  }
+  if (mask & DateParseData::Fields::DAY_FIELD) {
+    day = parse_data.day_of_month;
+  }
+  int hour = 0, minute = 0, second = 0;
+  if (mask & DateParseData::Fields::HOUR_FIELD) {
+    hour = parse_data.hour;
+    if (mask & DateParseData::Fields::AMPM_FIELD && parse_data.ampm == 1 &&
+        hour < 12) {
+      hour += 12;
+    }
+  }
+  if (mask & DateParseData::Fields::MINUTE_FIELD) {
+    minute = parse_data.minute;
+  }
+  if (mask & DateParseData::Fields::SECOND_FIELD) {
+    second = parse_data.second;
+  }
+  // Stay clear of the Julian calendar cutover and the era boundary.
+  if (year < 1600 || year > 9999 || month < 1 || month > 12 || day < 1 ||
+      day > DaysInMonth(year, month) || hour < 0 || hour > 23 || minute < 0 ||
+      minute > 59 || second < 0 || second > 59) {
+    return false;
+  }
+
+  switch (granularity) {
+    case GRANULARITY_YEAR:
+      month = 1;
+      TC_FALLTHROUGH_INTENDED;
+    case GRANULARITY_MONTH:
+      day = 1;
+      TC_FALLTHROUGH_INTENDED;
+    case GRANULARITY_DAY:
+      // RoundToGranularity clears UCAL_HOUR, which keeps the afternoons in
+      // the afternoon.
+      if (hour >= 12) {
+        return false;
+      }
+      hour = 0;
+      TC_FALLTHROUGH_INTENDED;
+    case GRANULARITY_HOUR:
+      minute = 0;
+      TC_FALLTHROUGH_INTENDED;
+    case GRANULARITY_MINUTE:
+      second = 0;
+      break;
+    case GRANULARITY_WEEK:
+    case GRANULARITY_UNKNOWN:
+    case GRANULARITY_SECOND:
+      break;
+  }
+
+  const int64 local_time_ms = DaysFromCivil(year, month, day) * kMillisInDay +
+                              hour * kMillisInHour + minute * kMillisInMinute +
+                              second * kMillisInSecond;
+
+  // Guess the offset from the raw offset at the reference time, and only
+  // accept it if it holds for a while around the result; the calendar has its
+  // own rules for the times that are skipped or repeated by a transition.
+  timezone.getOffset(static_cast<UDate>(local_time_ms - raw_offset),
+                     /*local=*/false, raw_offset, dst_offset, status);
+  if (U_FAILURE(status)) {
+    return false;
+  }
+  const int64 offset = raw_offset + dst_offset;
+  const int64 time_ms_utc = local_time_ms - offset;
+  for (const int64 probe_ms_utc :
+       {time_ms_utc, time_ms_utc - 6 * kMillisInHour,
+        time_ms_utc + 6 * kMillisInHour}) {
+    timezone.getOffset(static_cast<UDate>(probe_ms_utc), /*local=*/false,
+                       raw_offset, dst_offset, status);
+    if (U_FAILURE(status) || raw_offset + dst_offset != offset) {
+      return false;
+    }
+  }
+
+  *interpreted_time_ms_utc = time_ms_utc;
+  return true;
+}
+
 bool CalendarLib::InterpretParseData(const DateParseData& parse_data,
                                      int64 reference_time_ms_utc,
                                      const std::string& reference_timezone,
                                      const std::string& reference_locale,
                                      DatetimeGranularity granularity,
                                      int64* interpreted_time_ms_utc) const {
-  UErrorCode status = U_ZERO_ERROR;
-
-  std::unique_ptr<icu::Calendar> date(icu::Calendar::createInstance(
-      icu::Locale::createFromName(reference_locale.c_str()), status));
-  if (U_FAILURE(status)) {
-    TC_LOG(ERROR) << "error getting calendar instance";
+  const std::shared_ptr<const icu::Calendar> prototype =
+      GetPrototype(reference_locale, reference_timezone);
+  if (prototype == nullptr) {
     return false;
   }
+  if (InterpretAbsoluteGregorianDate(parse_data, reference_time_ms_utc,
+                                     *prototype, granularity,
+                                     interpreted_time_ms_utc)) {
+    return true;
+  }
 
-  date->adoptTimeZone(icu::TimeZone::createTimeZone(
-      icu::UnicodeString::fromUTF8(reference_timezone)));
+  UErrorCode status = U_ZERO_ERROR;
+  std::unique_ptr<icu::Calendar> date(prototype->clone());
   date->setTime(reference_time_ms_utc, status);
 
   // By default, the parsed time is interpreted to be on the reference day. But
@@ -311,7 +468,6 @@ bool CalendarLib::InterpretParseData(const DateParseData& parse_data,
   date->set(UCalendarDateFields::UCAL_SECOND, 0);
   date->set(UCalendarDateFields::UCAL_MILLISECOND, 0);
 
-  static const int64 kMillisInHour = 1000 * 60 * 60;
   if (parse_data.field_set_mask & DateParseData::Fields::ZONE_OFFSET_FIELD) {
     date->set(UCalendarDateFields::UCAL_ZONE_OFFSET,
               parse_data.zone_offset * kMillisInHour);
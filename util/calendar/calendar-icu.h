@@ -17,11 +17,15 @@
 #ifndef LIBTEXTCLASSIFIER_UTIL_CALENDAR_CALENDAR_ICU_H_
 #define LIBTEXTCLASSIFIER_UTIL_CALENDAR_CALENDAR_ICU_H_
 
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 
 #include "types.h"
 #include "util/base/integral_types.h"
 #include "util/base/logging.h"
+#include "unicode/calendar.h"
 
 namespace libtextclassifier2 {
 
@@ -36,6 +40,34 @@ class CalendarLib {
                           const std::string& reference_locale,
                           DatetimeGranularity granularity,
                           int64* interpreted_time_ms_utc) const;
+
+ private:
+  // Returns the cached calendar for the given locale and timezone, creating it
+  // if needed. It is only ever used as a prototype to clone and for timezone
+  // lookups. Returns nullptr on failure.
+  std::shared_ptr<const icu::Calendar> GetPrototype(
+      const std::string& reference_locale,
+      const std::string& reference_timezone) const;
+
+  // Interprets absolute dates and times in the Gregorian calendar with plain
+  // arithmetic and timezone offset lookups, without setting calendar fields.
+  // Returns false if the parse data is not handled, in which case the caller
+  // has to fall back to the full calendar computation, which gives the same
+  // results for all the handled cases.
+  bool InterpretAbsoluteGregorianDate(const DateParseData& parse_data,
+                                      int64 reference_time_ms_utc,
+                                      const icu::Calendar& prototype,
+                                      DatetimeGranularity granularity,
+                                      int64* interpreted_time_ms_utc) const;
+
+  // The maximum number of locale and timezone pairs to keep prototypes for.
+  static constexpr int kMaxCachedCalendars = 16;
+
+  // Calendars by locale and timezone, only ever used as prototypes to clone.
+  mutable std::mutex calendars_mutex_;
+  mutable std::unordered_map<std::string,
+                             std::shared_ptr<const icu::Calendar>>
+      calendars_;
 };
 }  // namespace libtextclassifier2
 #endif  // LIBTEXTCLASSIFIER_UTIL_CALENDAR_CALENDAR_ICU_H_
@@ -123,6 +123,72 @@ TEST(CalendarTest, RoundingToGranularity) {
       /*granularity=*/GRANULARITY_SECOND, &time));
   EXPECT_EQ(time, 1524641639000 /* Apr 25 2018 09:33:59 */);
 }
+
+TEST(CalendarTest, ReusesCalendarsPerLocaleAndTimezone) {
+  CalendarLib calendar;
+  int64 time;
+  DateParseData data;
+  data.year = 2018;
+  data.month = 4;
+  data.day_of_month = 25;
+  data.field_set_mask = DateParseData::YEAR_FIELD | DateParseData::MONTH_FIELD |
+                        DateParseData::DAY_FIELD;
+
+  // Interleave the timezones, so that a calendar mistakenly shared between
+  // them would show up in the results.
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_TRUE(calendar.InterpretParseData(
+        data,
+        /*reference_time_ms_utc=*/0L, /*reference_timezone=*/"Europe/Zurich",
+        /*reference_locale=*/"en-CH",
+        /*granularity=*/GRANULARITY_DAY, &time));
+    EXPECT_EQ(time, 1524607200000L /* Apr 25 2018 00:00:00 CEST */);
+
+    ASSERT_TRUE(calendar.InterpretParseData(
+        data,
+        /*reference_time_ms_utc=*/0L, /*reference_timezone=*/"Etc/UTC",
+        /*reference_locale=*/"en-CH",
+        /*granularity=*/GRANULARITY_DAY, &time));
+    EXPECT_EQ(time, 1524614400000L /* Apr 25 2018 00:00:00 UTC */);
+  }
+}
+
+TEST(CalendarTest, InterpretsTimesOnReferenceDay) {
+  CalendarLib calendar;
+  int64 time;
+  DateParseData data;
+  data.hour = 3;
+  data.minute = 30;
+  data.ampm = 1;
+  data.field_set_mask = DateParseData::HOUR_FIELD |
+                        DateParseData::MINUTE_FIELD | DateParseData::AMPM_FIELD;
+  ASSERT_TRUE(calendar.InterpretParseData(
+      data,
+      /*reference_time_ms_utc=*/1524641639000L, /*reference_timezone=*/
+      "Europe/Zurich", /*reference_locale=*/"en-CH",
+      /*granularity=*/GRANULARITY_MINUTE, &time));
+  EXPECT_EQ(time, 1524663000000L /* Apr 25 2018 15:30:00 CEST */);
+}
+
+TEST(CalendarTest, InterpretsTimesSkippedByTransition) {
+  CalendarLib calendar;
+  int64 time;
+  DateParseData data;
+  data.year = 2018;
+  data.month = 3;
+  data.day_of_month = 25;
+  data.hour = 2;
+  data.minute = 30;
+  data.field_set_mask = DateParseData::YEAR_FIELD | DateParseData::MONTH_FIELD |
+                        DateParseData::DAY_FIELD | DateParseData::HOUR_FIELD |
+                        DateParseData::MINUTE_FIELD;
+  ASSERT_TRUE(calendar.InterpretParseData(
+      data,
+      /*reference_time_ms_utc=*/0L, /*reference_timezone=*/"Europe/Zurich",
+      /*reference_locale=*/"en-CH",
+      /*granularity=*/GRANULARITY_MINUTE, &time));
+  EXPECT_EQ(time, 1521941400000L /* Mar 25 2018 03:30:00 CEST */);
+}
 #endif  // LIBTEXTCLASSIFIER_UNILIB_DUMMY
 
 }  // namespace
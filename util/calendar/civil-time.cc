@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "util/calendar/civil-time.h"
+
+namespace libtextclassifier2 {
+
+// The conversions count the years from March, so that the leap day is the
+// last day of the year, in eras of 400 years, which have 146097 days each.
+
+int64 DaysFromCivil(int year, int month, int day) {
+  const int64 march_year = month <= 2 ? year - 1 : year;
+  const int64 era = FloorDivide(march_year, 400);
+  const int64 year_of_era = march_year - era * 400;
+  const int64 day_of_year =
+      (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  const int64 day_of_era = year_of_era * 365 + year_of_era / 4 -
+                           year_of_era / 100 + day_of_year;
+  // 719468 is the number of days from 0000-03-01 to 1970-01-01.
+  return era * 146097 + day_of_era - 719468;
+}
+
+void CivilFromDays(int64 days, int* year, int* month, int* day) {
+  days += 719468;
+  const int64 era = FloorDivide(days, 146097);
+  const int64 day_of_era = days - era * 146097;
+  const int64 year_of_era = (day_of_era - day_of_era / 1460 +
+                             day_of_era / 36524 - day_of_era / 146096) /
+                            365;
+  const int64 day_of_year =
+      day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+  const int64 march_month = (5 * day_of_year + 2) / 153;
+  *day = day_of_year - (153 * march_month + 2) / 5 + 1;
+  *month = march_month < 10 ? march_month + 3 : march_month - 9;
+  *year = year_of_era + era * 400 + (*month <= 2 ? 1 : 0);
+}
+
+int DaysInMonth(int year, int month) {
+  static const int kDaysInMonth[] = {31, 28, 31, 30, 31, 30,
+                                     31, 31, 30, 31, 30, 31};
+  if (month == 2 && year % 4 == 0 && (year % 100 != 0 || year % 400 == 0)) {
+    return 29;
+  }
+  return kDaysInMonth[month - 1];
+}
+
+}  // namespace libtextclassifier2
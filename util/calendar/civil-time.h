@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Date arithmetic in the proleptic Gregorian calendar, without ICU.
+
+#ifndef LIBTEXTCLASSIFIER_UTIL_CALENDAR_CIVIL_TIME_H_
+#define LIBTEXTCLASSIFIER_UTIL_CALENDAR_CIVIL_TIME_H_
+
+#include "util/base/integral_types.h"
+
+namespace libtextclassifier2 {
+
+constexpr int64 kMillisInSecond = 1000;
+constexpr int64 kMillisInMinute = 60 * kMillisInSecond;
+constexpr int64 kMillisInHour = 60 * kMillisInMinute;
+constexpr int64 kMillisInDay = 24 * kMillisInHour;
+
+// Returns the number of days from 1970-01-01 to the given date. The month is
+// in 1..12, the day in 1..DaysInMonth().
+int64 DaysFromCivil(int year, int month, int day);
+
+// The inverse of DaysFromCivil().
+void CivilFromDays(int64 days, int* year, int* month, int* day);
+
+// Returns the number of days in the month (1..12) of the year.
+int DaysInMonth(int year, int month);
+
+// Returns a / b rounded towards negative infinity, for b > 0.
+inline int64 FloorDivide(int64 a, int64 b) {
+  return a / b - (a % b < 0 ? 1 : 0);
+}
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_UTIL_CALENDAR_CIVIL_TIME_H_
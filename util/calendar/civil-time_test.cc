@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "util/calendar/civil-time.h"
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+TEST(CivilTimeTest, DaysFromCivil) {
+  EXPECT_EQ(DaysFromCivil(1970, 1, 1), 0);
+  EXPECT_EQ(DaysFromCivil(1969, 12, 31), -1);
+  EXPECT_EQ(DaysFromCivil(2000, 2, 29), 11016);
+  EXPECT_EQ(DaysFromCivil(2000, 3, 1), 11017);
+  EXPECT_EQ(DaysFromCivil(2018, 4, 25) * kMillisInDay, 1524614400000L);
+  EXPECT_EQ(DaysFromCivil(1600, 1, 1), -135140);
+}
+
+TEST(CivilTimeTest, CivilFromDaysInvertsDaysFromCivil) {
+  int64 days = DaysFromCivil(1600, 1, 1);
+  for (int year = 1600; year < 2400; ++year) {
+    for (int month = 1; month <= 12; ++month) {
+      for (int day = 1; day <= DaysInMonth(year, month); ++day) {
+        ASSERT_EQ(DaysFromCivil(year, month, day), days);
+        int civil_year, civil_month, civil_day;
+        CivilFromDays(days, &civil_year, &civil_month, &civil_day);
+        ASSERT_EQ(civil_year, year);
+        ASSERT_EQ(civil_month, month);
+        ASSERT_EQ(civil_day, day);
+        ++days;
+      }
+    }
+  }
+}
+
+TEST(CivilTimeTest, DaysInMonth) {
+  EXPECT_EQ(DaysInMonth(2018, 1), 31);
+  EXPECT_EQ(DaysInMonth(2018, 2), 28);
+  EXPECT_EQ(DaysInMonth(2016, 2), 29);
+  EXPECT_EQ(DaysInMonth(1900, 2), 28);
+  EXPECT_EQ(DaysInMonth(2000, 2), 29);
+  EXPECT_EQ(DaysInMonth(2018, 4), 30);
+}
+
+TEST(CivilTimeTest, FloorDivide) {
+  EXPECT_EQ(FloorDivide(7, 2), 3);
+  EXPECT_EQ(FloorDivide(-7, 2), -4);
+  EXPECT_EQ(FloorDivide(-8, 2), -4);
+  EXPECT_EQ(FloorDivide(-1, kMillisInDay), -1);
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
@@ -377,6 +377,7 @@ STATIC_INLINE uint64_t HashLen16(uint64_t u, uint64_t v, uint64_t mul) {
   return b;
 }
 
+// Inlined as Fingerprint64Len0to16 in farmhash.h, which has to stay in sync.
 STATIC_INLINE uint64_t HashLen0to16(const char *s, size_t len) {
   if (len >= 8) {
     uint64_t mul = k2 + len * 2;
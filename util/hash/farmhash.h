@@ -119,6 +119,80 @@ uint32_t Fingerprint32(const char* s, size_t len);
 // Fingerprint function for a byte array.
 uint64_t Fingerprint64(const char* s, size_t len);
 
+namespace short_fingerprint {
+
+// The parts of farmhashna::HashLen0to16 in farmhash.cc, so that the short
+// fingerprints can be inlined. They have to be kept in sync.
+inline uint64_t Fetch64(const char* p) {
+  uint64_t result;
+  memcpy(&result, p, sizeof(result));
+#if defined(FARMHASH_BIG_ENDIAN) || defined(WORDS_BIGENDIAN)
+  result = __builtin_bswap64(result);
+#endif
+  return result;
+}
+
+inline uint32_t Fetch32(const char* p) {
+  uint32_t result;
+  memcpy(&result, p, sizeof(result));
+#if defined(FARMHASH_BIG_ENDIAN) || defined(WORDS_BIGENDIAN)
+  result = __builtin_bswap32(result);
+#endif
+  return result;
+}
+
+inline uint64_t Rotate(uint64_t val, int shift) {
+  return (val >> shift) | (val << (64 - shift));
+}
+
+inline uint64_t HashLen16(uint64_t u, uint64_t v, uint64_t mul) {
+  uint64_t a = (u ^ v) * mul;
+  a ^= (a >> 47);
+  uint64_t b = (v ^ a) * mul;
+  b ^= (b >> 47);
+  b *= mul;
+  return b;
+}
+
+}  // namespace short_fingerprint
+
+// Same as Fingerprint64(s, len) for len <= 16, but inlined. Most of the
+// strings fingerprinted as token features are that short.
+inline uint64_t Fingerprint64Len0to16(const char* s, size_t len) {
+  const uint64_t k0 = 0xc3a5c85c97cb3127ULL;
+  const uint64_t k2 = 0x9ae16a3b2f90404fULL;
+  if (len >= 8) {
+    const uint64_t mul = k2 + len * 2;
+    const uint64_t a = short_fingerprint::Fetch64(s) + k2;
+    const uint64_t b = short_fingerprint::Fetch64(s + len - 8);
+    const uint64_t c = short_fingerprint::Rotate(b, 37) * mul + a;
+    const uint64_t d = (short_fingerprint::Rotate(a, 25) + b) * mul;
+    return short_fingerprint::HashLen16(c, d, mul);
+  }
+  if (len >= 4) {
+    const uint64_t mul = k2 + len * 2;
+    const uint64_t a = short_fingerprint::Fetch32(s);
+    return short_fingerprint::HashLen16(
+        len + (a << 3), short_fingerprint::Fetch32(s + len - 4), mul);
+  }
+  if (len > 0) {
+    const uint8_t a = s[0];
+    const uint8_t b = s[len >> 1];
+    const uint8_t c = s[len - 1];
+    const uint32_t y =
+        static_cast<uint32_t>(a) + (static_cast<uint32_t>(b) << 8);
+    const uint32_t z = len + (static_cast<uint32_t>(c) << 2);
+    const uint64_t mixed = y * k2 ^ z * k0;
+    return (mixed ^ (mixed >> 47)) * k2;
+  }
+  return k2;
+}
+
+// Fingerprint64(s, len), with the short strings fingerprinted inline.
+inline uint64_t Fingerprint64Inlined(const char* s, size_t len) {
+  return len <= 16 ? Fingerprint64Len0to16(s, len) : Fingerprint64(s, len);
+}
+
 // Fingerprint function for a byte array.
 uint128_t Fingerprint128(const char* s, size_t len);
 
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "util/hash/farmhash.h"
+
+#include <random>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+TEST(FarmhashTest, InlinedFingerprintsAreTheSame) {
+  std::mt19937 random(/*seed=*/42);
+  std::string buffer(64, '\0');
+  for (int i = 0; i < 1000; ++i) {
+    for (char& c : buffer) {
+      c = static_cast<char>(random());
+    }
+    for (int len = 0; len <= 32; ++len) {
+      // At the unaligned offsets too.
+      const char* s = buffer.data() + i % 8;
+      EXPECT_EQ(tc2farmhash::Fingerprint64Inlined(s, len),
+                tc2farmhash::Fingerprint64(s, len))
+          << len;
+    }
+  }
+  EXPECT_EQ(tc2farmhash::Fingerprint64Len0to16("", 0),
+            tc2farmhash::Fingerprint64("", 0));
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
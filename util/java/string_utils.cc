@@ -16,6 +16,7 @@
 
 #include "util/java/string_utils.h"
 
+#include "util/base/integral_types.h"
 #include "util/base/logging.h"
 
 namespace libtextclassifier2 {
@@ -27,31 +28,53 @@ bool JStringToUtf8String(JNIEnv* env, const jstring& jstr,
     return false;
   }
 
-  jclass string_class = env->FindClass("java/lang/String");
-  if (!string_class) {
-    TC_LOG(ERROR) << "Can't find String class";
+  const int length = env->GetStringLength(jstr);
+  result->clear();
+  // Most texts are mostly ASCII, so this usually is the final size.
+  result->reserve(length);
+
+  const jchar* const utf16 = env->GetStringCritical(jstr, nullptr);
+  if (utf16 == nullptr) {
+    TC_LOG(ERROR) << "Can't get the string chars.";
     return false;
   }
-
-  jmethodID get_bytes_id =
-      env->GetMethodID(string_class, "getBytes", "(Ljava/lang/String;)[B");
-
-  jstring encoding = env->NewStringUTF("UTF-8");
-  jbyteArray array = reinterpret_cast<jbyteArray>(
-      env->CallObjectMethod(jstr, get_bytes_id, encoding));
-
-  jbyte* const array_bytes = env->GetByteArrayElements(array, JNI_FALSE);
-  int length = env->GetArrayLength(array);
-
-  *result = std::string(reinterpret_cast<char*>(array_bytes), length);
-
-  // Release the array.
-  env->ReleaseByteArrayElements(array, array_bytes, JNI_ABORT);
-  env->DeleteLocalRef(array);
-  env->DeleteLocalRef(string_class);
-  env->DeleteLocalRef(encoding);
+  AppendUtf16AsUtf8(utf16, length, result);
+  env->ReleaseStringCritical(jstr, utf16);
 
   return true;
 }
 
+void AppendUtf16AsUtf8(const jchar* utf16, int length, std::string* result) {
+  for (int i = 0; i < length; ++i) {
+    uint32 codepoint = utf16[i];
+    if (codepoint < 0x80) {
+      result->push_back(static_cast<char>(codepoint));
+      continue;
+    }
+    if (codepoint >= 0xD800 && codepoint <= 0xDFFF) {
+      if (codepoint <= 0xDBFF && i + 1 < length && utf16[i + 1] >= 0xDC00 &&
+          utf16[i + 1] <= 0xDFFF) {
+        codepoint =
+            0x10000 + ((codepoint - 0xD800) << 10) + (utf16[i + 1] - 0xDC00);
+        ++i;
+      } else {
+        // Unpaired surrogate.
+        result->push_back('?');
+        continue;
+      }
+    }
+    if (codepoint < 0x800) {
+      result->push_back(static_cast<char>(0xC0 | (codepoint >> 6)));
+    } else if (codepoint < 0x10000) {
+      result->push_back(static_cast<char>(0xE0 | (codepoint >> 12)));
+      result->push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+    } else {
+      result->push_back(static_cast<char>(0xF0 | (codepoint >> 18)));
+      result->push_back(static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F)));
+      result->push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+    }
+    result->push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+  }
+}
+
 }  // namespace libtextclassifier2
@@ -22,8 +22,14 @@
 
 namespace libtextclassifier2 {
 
+// Converts the Java string to UTF-8. The UTF-16 chars of the string are
+// transcoded directly, without going through String.getBytes(), and unpaired
+// surrogates are replaced with '?', as String.getBytes() does.
 bool JStringToUtf8String(JNIEnv* env, const jstring& jstr, std::string* result);
 
+// Appends the UTF-8 encoding of the given UTF-16 chars to 'result'.
+void AppendUtf16AsUtf8(const jchar* utf16, int length, std::string* result);
+
 }  // namespace libtextclassifier2
 
 #endif  // LIBTEXTCLASSIFIER_UTIL_JAVA_STRING_UTILS_H_
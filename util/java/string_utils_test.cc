@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "util/java/string_utils.h"
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+std::string Utf16ToUtf8(const std::u16string& utf16) {
+  std::string result;
+  AppendUtf16AsUtf8(reinterpret_cast<const jchar*>(utf16.data()),
+                    utf16.size(), &result);
+  return result;
+}
+
+TEST(StringUtilsTest, AppendUtf16AsUtf8) {
+  EXPECT_EQ(Utf16ToUtf8(u""), "");
+  EXPECT_EQ(Utf16ToUtf8(u"hello"), "hello");
+  EXPECT_EQ(Utf16ToUtf8(u"Grüße, 世界"), "Grüße, 世界");
+  EXPECT_EQ(Utf16ToUtf8(u"😁 Hello World."), "😁 Hello World.");
+}
+
+TEST(StringUtilsTest, AppendUtf16AsUtf8ReplacesUnpairedSurrogates) {
+  EXPECT_EQ(Utf16ToUtf8(std::u16string{0xD83D, 'a'}), "?a");
+  EXPECT_EQ(Utf16ToUtf8(std::u16string{'a', 0xDE01}), "a?");
+  EXPECT_EQ(Utf16ToUtf8(std::u16string{0xD83D}), "?");
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
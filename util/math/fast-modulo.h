@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Remainders by a fixed divisor, without a division.
+
+#ifndef LIBTEXTCLASSIFIER_UTIL_MATH_FAST_MODULO_H_
+#define LIBTEXTCLASSIFIER_UTIL_MATH_FAST_MODULO_H_
+
+#include "util/base/integral_types.h"
+#include "util/base/logging.h"
+
+namespace libtextclassifier2 {
+
+// Computes value % divisor for 64-bit values with two multiplications by a
+// constant precomputed from the divisor (Lemire et al., "Faster Remainder by
+// Direct Computation"), for all values and all 32-bit divisors. Falls back to
+// the % operator where there are no 128-bit integers.
+class FastModulo {
+ public:
+  explicit FastModulo(uint32 divisor) : divisor_(divisor) {
+    TC_DCHECK_GT(divisor, 0);
+#ifdef __SIZEOF_INT128__
+    // ceil(2^128 / divisor), which wraps around to 0 for 1.
+    multiplier_ = ~static_cast<unsigned __int128>(0) / divisor + 1;
+#endif
+  }
+
+  uint32 divisor() const { return divisor_; }
+
+  uint32 Reduce(uint64 value) const {
+#ifdef __SIZEOF_INT128__
+    // The fractional part of value / divisor, in 128-bit fixed point, times
+    // the divisor.
+    const unsigned __int128 fraction = multiplier_ * value;
+    const uint64 low = static_cast<uint64>(fraction);
+    const uint64 high = static_cast<uint64>(fraction >> 64);
+    const unsigned __int128 low_product =
+        static_cast<unsigned __int128>(low) * divisor_;
+    const unsigned __int128 high_product =
+        static_cast<unsigned __int128>(high) * divisor_;
+    return static_cast<uint32>((high_product + (low_product >> 64)) >> 64);
+#else
+    return value % divisor_;
+#endif
+  }
+
+ private:
+  uint32 divisor_;
+#ifdef __SIZEOF_INT128__
+  unsigned __int128 multiplier_;
+#endif
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_UTIL_MATH_FAST_MODULO_H_
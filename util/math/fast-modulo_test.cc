@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "util/math/fast-modulo.h"
+
+#include <random>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+TEST(FastModuloTest, MatchesTheOperator) {
+  std::mt19937_64 random(/*seed=*/42);
+  for (const uint32 divisor :
+       {1u, 2u, 3u, 7u, 1000u, 1u << 16, 1000003u, 0x7FFFFFFFu, 0xFFFFFFFFu}) {
+    const FastModulo modulo(divisor);
+    for (const uint64 value : {uint64{0}, uint64{1}, uint64{divisor - 1},
+                               uint64{divisor}, ~uint64{0}}) {
+      EXPECT_EQ(modulo.Reduce(value), value % divisor) << value;
+    }
+    for (int i = 0; i < 10000; ++i) {
+      const uint64 value = random();
+      EXPECT_EQ(modulo.Reduce(value), value % divisor) << value;
+    }
+  }
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
@@ -16,7 +16,7 @@
 
 #include "util/math/softmax.h"
 
-#include <limits>
+#include <cmath>
 
 #include "util/base/logging.h"
 #include "util/math/fastexp.h"
@@ -74,31 +74,89 @@ std::vector<float> ComputeSoftmax(const std::vector<float> &scores) {
 }
 
 std::vector<float> ComputeSoftmax(const float *scores, int scores_size) {
-  std::vector<float> softmax;
-  std::vector<float> exp_scores;
-  exp_scores.reserve(scores_size);
-  softmax.reserve(scores_size);
+  std::vector<float> softmax(scores_size);
+  ComputeSoftmax(scores, scores_size, softmax.data());
+  return softmax;
+}
 
-  // Find max value in "scores" vector and rescale to avoid overflows.
-  float max = std::numeric_limits<float>::min();
+namespace {
+
+// Returns the largest of the "scores_size" > 0 scores.
+float MaxScore(const float *scores, int scores_size) {
+  float max = scores[0];
+  for (int i = 1; i < scores_size; ++i) {
+    max = scores[i] > max ? scores[i] : max;
+  }
+  return max;
+}
+
+// Returns exp(score - max) for score <= max.  See comments above in
+// ComputeSoftmaxProbability for the reasoning behind the approximation with 0.
+// The clamped argument keeps the function branch-free, so that the loops
+// calling it can be vectorized.
+inline float ShiftedExp(float score, float max) {
+  const float delta = score - max;
+  const float exp_score = VeryFastExp(delta < -16.0f ? -16.0f : delta);
+  return delta < -16.0f ? 0.0f : exp_score;
+}
+
+}  // namespace
+
+void ComputeSoftmax(const float *scores, int scores_size, float *softmax) {
+  if (scores_size <= 0) {
+    return;
+  }
+
+  // Rescale by the max value in "scores" to avoid overflows.
+  const float max = MaxScore(scores, scores_size);
+  float denominator = 0;
   for (int i = 0; i < scores_size; ++i) {
-    const float score = scores[i];
-    if (score > max) max = score;
+    softmax[i] = ShiftedExp(scores[i], max);
+    denominator += softmax[i];
   }
+
+  const float inverse_denominator = 1.0f / denominator;
+  for (int i = 0; i < scores_size; ++i) {
+    softmax[i] *= inverse_denominator;
+  }
+}
+
+void ComputeSoftmaxTopK(const float *scores, int scores_size, int k,
+                        std::vector<std::pair<int, float>> *top) {
+  top->clear();
+  if (scores_size <= 0 || k <= 0) {
+    return;
+  }
+  if (k > scores_size) {
+    k = scores_size;
+  }
+
+  // Keep the "k" best (label, score) pairs sorted by decreasing score, with
+  // the lower label first on ties.  The softmax is monotonic, so these are
+  // also the labels with the highest probabilities.
+  const float max = MaxScore(scores, scores_size);
   float denominator = 0;
+  top->reserve(k);
   for (int i = 0; i < scores_size; ++i) {
     const float score = scores[i];
-    // See comments above in ComputeSoftmaxProbability for the reasoning behind
-    // this approximation.
-    const float exp_score = score - max < -16.0f ? 0 : VeryFastExp(score - max);
-    exp_scores.push_back(exp_score);
-    denominator += exp_score;
+    denominator += ShiftedExp(score, max);
+    if (top->size() == k && score <= top->back().second) {
+      continue;
+    }
+    if (top->size() < k) {
+      top->emplace_back(i, score);
+    } else {
+      top->back() = {i, score};
+    }
+    for (int j = top->size() - 1;
+         j > 0 && (*top)[j - 1].second < (*top)[j].second; --j) {
+      std::swap((*top)[j - 1], (*top)[j]);
+    }
   }
 
-  for (int i = 0; i < scores_size; ++i) {
-    softmax.push_back(exp_scores[i] / denominator);
+  for (std::pair<int, float> &entry : *top) {
+    entry.second = ShiftedExp(entry.second, max) / denominator;
   }
-  return softmax;
 }
 
 }  // namespace libtextclassifier2
@@ -17,6 +17,7 @@
 #ifndef LIBTEXTCLASSIFIER_UTIL_MATH_SOFTMAX_H_
 #define LIBTEXTCLASSIFIER_UTIL_MATH_SOFTMAX_H_
 
+#include <utility>
 #include <vector>
 
 namespace libtextclassifier2 {
@@ -33,6 +34,17 @@ std::vector<float> ComputeSoftmax(const std::vector<float> &scores);
 // Same as above but operates on an array of floats.
 std::vector<float> ComputeSoftmax(const float *scores, int scores_size);
 
+// Same as above but writes the softmax into the caller's buffer "softmax",
+// which must hold "scores_size" floats.  The buffer may be "scores" itself.
+void ComputeSoftmax(const float *scores, int scores_size, float *softmax);
+
+// Computes the softmax probabilities of only the "k" highest scoring labels,
+// without materializing the whole distribution.  Fills "top" with (label,
+// probability) pairs sorted by decreasing probability; it holds fewer than "k"
+// entries if there are fewer labels.
+void ComputeSoftmaxTopK(const float *scores, int scores_size, int k,
+                        std::vector<std::pair<int, float>> *top);
+
 }  // namespace libtextclassifier2
 
 #endif  // LIBTEXTCLASSIFIER_UTIL_MATH_SOFTMAX_H_
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "util/math/softmax.h"
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+using testing::ElementsAre;
+using testing::FloatNear;
+using testing::Pair;
+
+TEST(SoftmaxTest, ComputeSoftmaxInPlace) {
+  std::vector<float> scores = {1.0f, 3.0f, -2.0f, 3.0f};
+  const std::vector<float> expected = ComputeSoftmax(scores);
+  ComputeSoftmax(scores.data(), scores.size(), scores.data());
+  EXPECT_THAT(scores, ElementsAre(FloatNear(expected[0], 1e-6),
+                                  FloatNear(expected[1], 1e-6),
+                                  FloatNear(expected[2], 1e-6),
+                                  FloatNear(expected[3], 1e-6)));
+  EXPECT_NEAR(scores[0] + scores[1] + scores[2] + scores[3], 1.0f, 1e-5);
+}
+
+TEST(SoftmaxTest, ComputeSoftmaxNegativeScores) {
+  const std::vector<float> softmax = ComputeSoftmax({-100.0f, -100.0f});
+  EXPECT_THAT(softmax, ElementsAre(FloatNear(0.5f, 1e-3),
+                                   FloatNear(0.5f, 1e-3)));
+}
+
+TEST(SoftmaxTest, ComputeSoftmaxTopK) {
+  const std::vector<float> scores = {1.0f, 3.0f, -2.0f, 3.0f, 2.0f};
+  const std::vector<float> softmax = ComputeSoftmax(scores);
+
+  std::vector<std::pair<int, float>> top;
+  ComputeSoftmaxTopK(scores.data(), scores.size(), /*k=*/3, &top);
+  EXPECT_THAT(top, ElementsAre(Pair(1, FloatNear(softmax[1], 1e-6)),
+                               Pair(3, FloatNear(softmax[3], 1e-6)),
+                               Pair(4, FloatNear(softmax[4], 1e-6))));
+
+  ComputeSoftmaxTopK(scores.data(), scores.size(), /*k=*/10, &top);
+  EXPECT_EQ(top.size(), 5);
+  EXPECT_EQ(top.back().first, 2);
+
+  ComputeSoftmaxTopK(scores.data(), /*scores_size=*/0, /*k=*/1, &top);
+  EXPECT_TRUE(top.empty());
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
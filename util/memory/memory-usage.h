@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Helpers for estimating the heap memory held by standard containers. They
+// count the storage the containers allocate, but not what their elements own
+// in turn, and assume typical node layouts, so the results are approximations.
+
+#ifndef LIBTEXTCLASSIFIER_UTIL_MEMORY_MEMORY_USAGE_H_
+#define LIBTEXTCLASSIFIER_UTIL_MEMORY_MEMORY_USAGE_H_
+
+#include <string>
+#include <vector>
+
+#include "util/base/integral_types.h"
+
+namespace libtextclassifier2 {
+
+template <typename T>
+int64 VectorHeapBytes(const std::vector<T>& values) {
+  return values.capacity() * sizeof(T);
+}
+
+// Strings short enough to be stored inline don't allocate.
+inline int64 StringHeapBytes(const std::string& value) {
+  static const size_t kInlineCapacity = std::string().capacity();
+  return value.capacity() > kInlineCapacity ? value.capacity() + 1 : 0;
+}
+
+inline int64 StringsHeapBytes(const std::vector<std::string>& values) {
+  int64 result = VectorHeapBytes(values);
+  for (const std::string& value : values) {
+    result += StringHeapBytes(value);
+  }
+  return result;
+}
+
+// For std::unordered_map and std::unordered_set: the bucket array plus one
+// node per element, holding the value, the link and the cached hash.
+template <typename HashTable>
+int64 HashTableHeapBytes(const HashTable& table) {
+  return table.bucket_count() * sizeof(void*) +
+         table.size() *
+             (sizeof(typename HashTable::value_type) + 2 * sizeof(void*));
+}
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_UTIL_MEMORY_MEMORY_USAGE_H_
@@ -24,6 +24,8 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <vector>
+
 #include "util/base/logging.h"
 #include "util/base/macros.h"
 
@@ -34,6 +36,16 @@ inline std::string GetLastSystemError() { return std::string(strerror(errno)); }
 
 inline MmapHandle GetErrorMmapHandle() { return MmapHandle(nullptr, 0); }
 
+// Extends the range [*start, *start + *num_bytes) to page boundaries, as
+// required by madvise and friends.
+void AlignToPages(void **start, size_t *num_bytes) {
+  static const uintptr_t kPageSize = sysconf(_SC_PAGE_SIZE);
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(*start);
+  const uintptr_t aligned_begin = (begin / kPageSize) * kPageSize;
+  *num_bytes += begin - aligned_begin;
+  *start = reinterpret_cast<void *>(aligned_begin);
+}
+
 class FileCloser {
  public:
   explicit FileCloser(int fd) : fd_(fd) {}
@@ -132,4 +144,55 @@ bool Unmap(MmapHandle mmap_handle) {
   return true;
 }
 
+bool PrefetchMemory(const void *start, size_t num_bytes) {
+  if (start == nullptr || num_bytes == 0) {
+    return true;
+  }
+  void *aligned_start = const_cast<void *>(start);
+  AlignToPages(&aligned_start, &num_bytes);
+  if (madvise(aligned_start, num_bytes, MADV_WILLNEED) != 0) {
+    const std::string last_error = GetLastSystemError();
+    TC_LOG(ERROR) << "Error during madvise: " << last_error;
+    return false;
+  }
+  return true;
+}
+
+bool LockMemory(const void *start, size_t num_bytes) {
+  if (start == nullptr || num_bytes == 0) {
+    return true;
+  }
+  void *aligned_start = const_cast<void *>(start);
+  AlignToPages(&aligned_start, &num_bytes);
+  if (mlock(aligned_start, num_bytes) != 0) {
+    const std::string last_error = GetLastSystemError();
+    TC_LOG(ERROR) << "Error during mlock: " << last_error;
+    return false;
+  }
+  return true;
+}
+
+int64 ResidentMemoryBytes(const void *start, size_t num_bytes) {
+  if (start == nullptr || num_bytes == 0) {
+    return 0;
+  }
+  static const size_t kPageSize = sysconf(_SC_PAGE_SIZE);
+  void *aligned_start = const_cast<void *>(start);
+  AlignToPages(&aligned_start, &num_bytes);
+  std::vector<unsigned char> page_status((num_bytes + kPageSize - 1) /
+                                         kPageSize);
+  if (mincore(aligned_start, num_bytes, page_status.data()) != 0) {
+    const std::string last_error = GetLastSystemError();
+    TC_LOG(ERROR) << "Error during mincore: " << last_error;
+    return -1;
+  }
+  int64 num_resident_pages = 0;
+  for (const unsigned char status : page_status) {
+    if (status & 1) {
+      ++num_resident_pages;
+    }
+  }
+  return num_resident_pages * kPageSize;
+}
+
 }  // namespace libtextclassifier2
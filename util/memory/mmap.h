@@ -112,6 +112,22 @@ MmapHandle MmapFile(int fd, int64 segment_offset, int64 segment_size);
 // otherwise.
 bool Unmap(MmapHandle mmap_handle);
 
+// Asks the kernel to read the pages of the given memory range ahead of their
+// first use (madvise(MADV_WILLNEED)), so that touching them later doesn't
+// fault.  The range doesn't have to be page-aligned.  Returns true on success,
+// false otherwise.
+bool PrefetchMemory(const void *start, size_t num_bytes);
+
+// Locks the pages of the given memory range in memory (mlock), so that they're
+// never paged out.  Fails, e.g., if the process is over RLIMIT_MEMLOCK.  The
+// range doesn't have to be page-aligned.  Returns true on success, false
+// otherwise.
+bool LockMemory(const void *start, size_t num_bytes);
+
+// Returns how many bytes of the given memory range are currently resident in
+// physical memory (mincore), counting whole pages.  Returns -1 on error.
+int64 ResidentMemoryBytes(const void *start, size_t num_bytes);
+
 // Scoped mmapping of a file.  Mmaps a file on construction, unmaps it on
 // destruction.
 class ScopedMmap {
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LIBTEXTCLASSIFIER_UTIL_MEMORY_SMALL_VECTOR_H_
+#define LIBTEXTCLASSIFIER_UTIL_MEMORY_SMALL_VECTOR_H_
+
+#include <initializer_list>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace libtextclassifier2 {
+
+// A vector that stores up to N elements inline, and only allocates when it
+// grows beyond them, in which case all the elements move to a std::vector.
+// Supports the subset of the std::vector interface that the code uses.
+template <typename T, int N>
+class SmallVector {
+ public:
+  typedef T value_type;
+  typedef T* iterator;
+  typedef const T* const_iterator;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef int size_type;
+
+  SmallVector() {}
+
+  SmallVector(std::initializer_list<T> values) {
+    assign(values.begin(), values.end());
+  }
+
+  // Intentionally not explicit, so that results computed as std::vectors can
+  // be assigned.
+  SmallVector(const std::vector<T>& values) {  // NOLINT(runtime/explicit)
+    assign(values.begin(), values.end());
+  }
+  SmallVector(std::vector<T>&& values) {  // NOLINT(runtime/explicit)
+    if (values.size() > N) {
+      heap_ = std::move(values);
+      on_heap_ = true;
+    } else {
+      for (T& value : values) {
+        push_back(std::move(value));
+      }
+    }
+  }
+
+  SmallVector(const SmallVector& other) {
+    assign(other.begin(), other.end());
+  }
+  SmallVector(SmallVector&& other) { MoveFrom(&other); }
+
+  ~SmallVector() { DestroyInline(); }
+
+  SmallVector& operator=(const SmallVector& other) {
+    if (this != &other) {
+      assign(other.begin(), other.end());
+    }
+    return *this;
+  }
+  SmallVector& operator=(SmallVector&& other) {
+    if (this != &other) {
+      clear();
+      MoveFrom(&other);
+    }
+    return *this;
+  }
+  SmallVector& operator=(std::initializer_list<T> values) {
+    assign(values.begin(), values.end());
+    return *this;
+  }
+
+  template <typename Iterator>
+  void assign(Iterator begin, Iterator end) {
+    clear();
+    for (Iterator it = begin; it != end; ++it) {
+      push_back(*it);
+    }
+  }
+
+  int size() const { return on_heap_ ? heap_.size() : inline_size_; }
+  bool empty() const { return size() == 0; }
+
+  T* data() {
+    return on_heap_ ? heap_.data() : reinterpret_cast<T*>(inline_);
+  }
+  const T* data() const {
+    return on_heap_ ? heap_.data() : reinterpret_cast<const T*>(inline_);
+  }
+
+  iterator begin() { return data(); }
+  iterator end() { return data() + size(); }
+  const_iterator begin() const { return data(); }
+  const_iterator end() const { return data() + size(); }
+
+  T& operator[](int i) { return data()[i]; }
+  const T& operator[](int i) const { return data()[i]; }
+  T& front() { return data()[0]; }
+  const T& front() const { return data()[0]; }
+  T& back() { return data()[size() - 1]; }
+  const T& back() const { return data()[size() - 1]; }
+
+  void push_back(const T& value) { emplace_back(value); }
+  void push_back(T&& value) { emplace_back(std::move(value)); }
+
+  template <typename... Args>
+  void emplace_back(Args&&... args) {
+    if (on_heap_) {
+      heap_.emplace_back(std::forward<Args>(args)...);
+    } else if (inline_size_ < N) {
+      new (reinterpret_cast<T*>(inline_) + inline_size_)
+          T(std::forward<Args>(args)...);
+      ++inline_size_;
+    } else {
+      // The arguments can refer to an element, so the new one is constructed
+      // before the elements move.
+      T value(std::forward<Args>(args)...);
+      MoveToHeap();
+      heap_.push_back(std::move(value));
+    }
+  }
+
+  void pop_back() {
+    if (on_heap_) {
+      heap_.pop_back();
+    } else {
+      --inline_size_;
+      reinterpret_cast<T*>(inline_)[inline_size_].~T();
+    }
+  }
+
+  // Removes all the elements. Once on the heap, the elements stay there, so
+  // that the allocated memory is reused.
+  void clear() {
+    if (on_heap_) {
+      heap_.clear();
+    } else {
+      DestroyInline();
+    }
+  }
+
+  // Returns a copy of the elements as a std::vector.
+  std::vector<T> ToVector() const { return std::vector<T>(begin(), end()); }
+
+ private:
+  void MoveToHeap() {
+    heap_.reserve(2 * N);
+    for (T& value : *this) {
+      heap_.push_back(std::move(value));
+    }
+    DestroyInline();
+    on_heap_ = true;
+  }
+
+  void MoveFrom(SmallVector* other) {
+    if (other->on_heap_) {
+      heap_ = std::move(other->heap_);
+      on_heap_ = true;
+      other->heap_.clear();
+    } else {
+      for (T& value : *other) {
+        emplace_back(std::move(value));
+      }
+      other->DestroyInline();
+    }
+  }
+
+  void DestroyInline() {
+    T* values = reinterpret_cast<T*>(inline_);
+    for (int i = 0; i < inline_size_; ++i) {
+      values[i].~T();
+    }
+    inline_size_ = 0;
+  }
+
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type inline_[N];
+  int inline_size_ = 0;
+  bool on_heap_ = false;
+  std::vector<T> heap_;
+};
+
+template <typename T, int N>
+bool operator==(const SmallVector<T, N>& a, const SmallVector<T, N>& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (int i = 0; i < a.size(); ++i) {
+    if (!(a[i] == b[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_UTIL_MEMORY_SMALL_VECTOR_H_
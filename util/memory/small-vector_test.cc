@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "util/memory/small-vector.h"
+
+#include <memory>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+TEST(SmallVectorTest, StoresInlineElements) {
+  SmallVector<std::string, 2> vector;
+  EXPECT_TRUE(vector.empty());
+  vector.push_back("a");
+  vector.emplace_back(3, 'b');
+  EXPECT_EQ(vector.size(), 2);
+  EXPECT_EQ(vector.front(), "a");
+  EXPECT_EQ(vector.back(), "bbb");
+  EXPECT_THAT(vector, ElementsAre("a", "bbb"));
+
+  vector.pop_back();
+  EXPECT_THAT(vector, ElementsAre("a"));
+  vector.clear();
+  EXPECT_THAT(vector, IsEmpty());
+}
+
+TEST(SmallVectorTest, GrowsBeyondInlineElements) {
+  SmallVector<std::string, 2> vector = {"a", "b"};
+  vector.push_back(vector[0]);
+  vector.push_back("d");
+  EXPECT_THAT(vector, ElementsAre("a", "b", "a", "d"));
+
+  vector.clear();
+  vector.push_back("e");
+  EXPECT_THAT(vector, ElementsAre("e"));
+}
+
+TEST(SmallVectorTest, CopiesAndMoves) {
+  const SmallVector<std::string, 2> inline_vector = {"a"};
+  const SmallVector<std::string, 2> heap_vector = {"a", "b", "c"};
+
+  SmallVector<std::string, 2> copy = inline_vector;
+  EXPECT_TRUE(copy == inline_vector);
+  copy = heap_vector;
+  EXPECT_TRUE(copy == heap_vector);
+
+  SmallVector<std::string, 2> moved = std::move(copy);
+  EXPECT_THAT(moved, ElementsAre("a", "b", "c"));
+  SmallVector<std::string, 2> moved_inline = inline_vector;
+  moved = std::move(moved_inline);
+  EXPECT_THAT(moved, ElementsAre("a"));
+  EXPECT_FALSE(moved == heap_vector);
+}
+
+TEST(SmallVectorTest, ConvertsFromAndToVector) {
+  SmallVector<std::string, 2> vector = std::vector<std::string>{"a", "b", "c"};
+  EXPECT_THAT(vector, ElementsAre("a", "b", "c"));
+  vector = std::vector<std::string>{"d"};
+  EXPECT_THAT(vector, ElementsAre("d"));
+  EXPECT_EQ(vector.ToVector(), std::vector<std::string>{"d"});
+}
+
+TEST(SmallVectorTest, DestroysElements) {
+  std::shared_ptr<int> value(new int(1));
+  {
+    SmallVector<std::shared_ptr<int>, 2> vector;
+    vector.push_back(value);
+    EXPECT_EQ(value.use_count(), 2);
+    vector.push_back(value);
+    vector.push_back(value);
+    EXPECT_EQ(value.use_count(), 4);
+  }
+  EXPECT_EQ(value.use_count(), 1);
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
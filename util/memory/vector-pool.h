@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBTEXTCLASSIFIER_UTIL_MEMORY_VECTOR_POOL_H_
+#define LIBTEXTCLASSIFIER_UTIL_MEMORY_VECTOR_POOL_H_
+
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "util/base/macros.h"
+
+namespace libtextclassifier2 {
+
+// A bounded pool of reusable vectors. Released vectors are cleared but keep
+// their capacity, so once the pool is warmed up, acquiring a buffer and
+// filling it to a previously seen size does not allocate.
+// Thread-safe.
+template <typename T>
+class VectorPool {
+ public:
+  // RAII handle that returns the vector to the pool when destroyed.
+  class ScopedVector {
+   public:
+    ScopedVector(VectorPool* pool, std::unique_ptr<std::vector<T>> vector)
+        : pool_(pool), vector_(std::move(vector)) {}
+    ScopedVector(ScopedVector&& other)
+        : pool_(other.pool_), vector_(std::move(other.vector_)) {}
+    ~ScopedVector() {
+      if (pool_ != nullptr && vector_ != nullptr) {
+        pool_->Release(std::move(vector_));
+      }
+    }
+
+    std::vector<T>* get() const { return vector_.get(); }
+    std::vector<T>* operator->() const { return vector_.get(); }
+    std::vector<T>& operator*() const { return *vector_; }
+
+   private:
+    VectorPool* pool_;
+    std::unique_ptr<std::vector<T>> vector_;
+
+    TC_DISALLOW_COPY_AND_ASSIGN(ScopedVector);
+  };
+
+  // At most 'max_pooled_vectors' idle vectors are kept; the rest are freed.
+  explicit VectorPool(int max_pooled_vectors)
+      : max_pooled_vectors_(max_pooled_vectors) {}
+
+  // Returns an empty vector, reusing a pooled one when available.
+  std::unique_ptr<std::vector<T>> Acquire() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!pool_.empty()) {
+        std::unique_ptr<std::vector<T>> vector = std::move(pool_.back());
+        pool_.pop_back();
+        return vector;
+      }
+    }
+    return std::unique_ptr<std::vector<T>>(new std::vector<T>());
+  }
+
+  // Same as Acquire(), but the vector is released automatically.
+  ScopedVector AcquireScoped() { return ScopedVector(this, Acquire()); }
+
+  // Hands a vector back to the pool.
+  void Release(std::unique_ptr<std::vector<T>> vector) {
+    if (vector == nullptr) {
+      return;
+    }
+    vector->clear();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pool_.size() < max_pooled_vectors_) {
+      pool_.push_back(std::move(vector));
+    }
+  }
+
+ private:
+  const int max_pooled_vectors_;
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<std::vector<T>>> pool_;
+
+  TC_DISALLOW_COPY_AND_ASSIGN(VectorPool);
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_UTIL_MEMORY_VECTOR_POOL_H_
@@ -16,9 +16,47 @@
 
 #include "util/strings/utf8.h"
 
+#include <string.h>
+
 namespace libtextclassifier2 {
+namespace {
+// The strings are scanned a word of 8 bytes at a time where possible, using
+// bit tricks on the word instead of a branch per byte.
+const uint64 kHighBits = 0x8080808080808080ULL;
+const uint64 kLowBits = 0x0101010101010101ULL;
+
+inline uint64 LoadWord(const char *src) {
+  uint64 word;
+  memcpy(&word, src, sizeof(word));
+  return word;
+}
+
+// Returns a word with the high bit of each byte of 'word' set iff the byte is
+// zero. Can have false positives above a true one, which are harmless here.
+inline uint64 ZeroBytes(uint64 word) {
+  return (word - kLowBits) & ~word & kHighBits;
+}
+
+// Returns a word with the high bit of each byte of 'word' set iff the byte is
+// a UTF-8 trail byte, i.e. 10xx xxxx.
+inline uint64 TrailBytes(uint64 word) {
+  return word & ~(word << 1) & kHighBits;
+}
+
+inline int CountHighBits(uint64 word) { return __builtin_popcountll(word); }
+}  // namespace
+
 bool IsValidUTF8(const char *src, int size) {
   for (int i = 0; i < size;) {
+    // Skip over words of ASCII characters other than '\0'.
+    if (i + 8 <= size) {
+      const uint64 word = LoadWord(&src[i]);
+      if ((word & kHighBits) == 0 && ZeroBytes(word) == 0) {
+        i += 8;
+        continue;
+      }
+    }
+
     // Unexpected trail byte.
     if (IsTrailByte(src[i])) {
       return false;
@@ -39,4 +77,80 @@ bool IsValidUTF8(const char *src, int size) {
   }
   return true;
 }
+
+bool IsAsciiUTF8(const char *src, int size) {
+  int i = 0;
+  uint64 high_bits = 0;
+  for (; i + 8 <= size; i += 8) {
+    high_bits |= LoadWord(&src[i]);
+  }
+  if ((high_bits & kHighBits) != 0) {
+    return false;
+  }
+  for (; i < size; ++i) {
+    if (static_cast<unsigned char>(src[i]) >= 0x80) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int CountUTF8Codepoints(const char *src, int size) {
+  // Every byte that is not a trail byte starts a codepoint.
+  int num_trail_bytes = 0;
+  int i = 0;
+  for (; i + 8 <= size; i += 8) {
+    num_trail_bytes += CountHighBits(TrailBytes(LoadWord(&src[i])));
+  }
+  for (; i < size; ++i) {
+    num_trail_bytes += IsTrailByte(src[i]);
+  }
+  return size - num_trail_bytes;
+}
+
+namespace {
+enum {
+  RuneError = 0xFFFD,  // Decoding error in UTF.
+  RuneMax = 0x10FFFF,  // Maximum rune value.
+};
+}  // namespace
+
+int EncodeAsUTF8Char(char32 rune, char *dest) {
+  // Convert to unsigned for range check.
+  uint32 c;
+
+  // 1 char 00-7F
+  c = rune;
+  if (c <= 0x7F) {
+    dest[0] = static_cast<char>(c);
+    return 1;
+  }
+
+  // 2 char 0080-07FF
+  if (c <= 0x07FF) {
+    dest[0] = 0xC0 | static_cast<char>(c >> 1 * 6);
+    dest[1] = 0x80 | (c & 0x3F);
+    return 2;
+  }
+
+  // Range check
+  if (c > RuneMax) {
+    c = RuneError;
+  }
+
+  // 3 char 0800-FFFF
+  if (c <= 0xFFFF) {
+    dest[0] = 0xE0 | static_cast<char>(c >> 2 * 6);
+    dest[1] = 0x80 | ((c >> 1 * 6) & 0x3F);
+    dest[2] = 0x80 | (c & 0x3F);
+    return 3;
+  }
+
+  // 4 char 10000-1FFFFF
+  dest[0] = 0xF0 | static_cast<char>(c >> 3 * 6);
+  dest[1] = 0x80 | ((c >> 2 * 6) & 0x3F);
+  dest[2] = 0x80 | ((c >> 1 * 6) & 0x3F);
+  dest[3] = 0x80 | (c & 0x3F);
+  return 4;
+}
 }  // namespace libtextclassifier2
@@ -17,6 +17,8 @@
 #ifndef LIBTEXTCLASSIFIER_UTIL_STRINGS_UTF8_H_
 #define LIBTEXTCLASSIFIER_UTIL_STRINGS_UTF8_H_
 
+#include "util/base/integral_types.h"
+
 namespace libtextclassifier2 {
 
 // Returns the length (number of bytes) of the Unicode code point starting at
@@ -47,6 +49,18 @@ static inline bool IsTrailByte(char x) {
 // Returns true iff src points to a well-formed UTF-8 string.
 bool IsValidUTF8(const char *src, int size);
 
+// Returns true iff all the bytes of src are ASCII, in which case the codepoint
+// offsets into it are the byte offsets.
+bool IsAsciiUTF8(const char *src, int size);
+
+// Returns the number of codepoints of the well-formed UTF-8 string src.
+int CountUTF8Codepoints(const char *src, int size);
+
+// Writes the UTF-8 encoding of the codepoint to 'dest', which must have room
+// for 4 bytes, and returns the number of bytes written. Codepoints beyond the
+// Unicode range are encoded as U+FFFD.
+int EncodeAsUTF8Char(char32 rune, char *dest);
+
 }  // namespace libtextclassifier2
 
 #endif  // LIBTEXTCLASSIFIER_UTIL_STRINGS_UTF8_H_
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "util/thread/executor.h"
+
+#include <condition_variable>
+#include <mutex>
+
+namespace libtextclassifier2 {
+
+void RunInParallel(Executor* executor, int num_tasks,
+                   const std::function<void(int)>& task) {
+  if (executor == nullptr || num_tasks <= 1) {
+    for (int i = 0; i < num_tasks; ++i) {
+      task(i);
+    }
+    return;
+  }
+
+  std::mutex mutex;
+  std::condition_variable done;
+  int num_pending = num_tasks - 1;
+  for (int i = 0; i < num_tasks - 1; ++i) {
+    executor->Schedule([&, i]() {
+      task(i);
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--num_pending == 0) {
+        done.notify_one();
+      }
+    });
+  }
+  task(num_tasks - 1);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [&num_pending]() { return num_pending == 0; });
+}
+
+}  // namespace libtextclassifier2
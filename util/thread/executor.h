@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBTEXTCLASSIFIER_UTIL_THREAD_EXECUTOR_H_
+#define LIBTEXTCLASSIFIER_UTIL_THREAD_EXECUTOR_H_
+
+#include <functional>
+
+namespace libtextclassifier2 {
+
+// Interface to a thread pool supplied by the caller, which the library uses to
+// run independent pieces of work concurrently.
+class Executor {
+ public:
+  virtual ~Executor() {}
+
+  // Runs the task, possibly on another thread. Every scheduled task has to be
+  // run eventually, as the library blocks until its tasks finish.
+  virtual void Schedule(std::function<void()> task) = 0;
+};
+
+// Runs task(i) for i in [0, num_tasks) and returns when all of them are done.
+// All but the last task are scheduled on the executor; the last one runs on the
+// calling thread. Runs everything on the calling thread if 'executor' is null.
+void RunInParallel(Executor* executor, int num_tasks,
+                   const std::function<void(int)>& task);
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_UTIL_THREAD_EXECUTOR_H_
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "util/thread/executor.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+// Runs every task on a new thread.
+class ThreadPerTaskExecutor : public Executor {
+ public:
+  ~ThreadPerTaskExecutor() override {
+    for (std::thread& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  void Schedule(std::function<void()> task) override {
+    threads_.emplace_back(std::move(task));
+  }
+
+ private:
+  std::vector<std::thread> threads_;
+};
+
+TEST(ExecutorTest, RunInParallelRunsEveryTaskOnce) {
+  ThreadPerTaskExecutor executor;
+  std::vector<std::atomic<int>> counts(10);
+  for (std::atomic<int>& count : counts) {
+    count = 0;
+  }
+  RunInParallel(&executor, counts.size(), [&counts](int i) { ++counts[i]; });
+  for (const std::atomic<int>& count : counts) {
+    EXPECT_EQ(count, 1);
+  }
+}
+
+TEST(ExecutorTest, RunInParallelWithoutExecutor) {
+  std::vector<int> order;
+  RunInParallel(/*executor=*/nullptr, /*num_tasks=*/3,
+                [&order](int i) { order.push_back(i); });
+  EXPECT_THAT(order, testing::ElementsAre(0, 1, 2));
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
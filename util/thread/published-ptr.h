@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBTEXTCLASSIFIER_UTIL_THREAD_PUBLISHED_PTR_H_
+#define LIBTEXTCLASSIFIER_UTIL_THREAD_PUBLISHED_PTR_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "util/base/macros.h"
+
+namespace libtextclassifier2 {
+
+// A shared pointer that is read by many threads and replaced by few, like the
+// current model of a process. Get() takes no lock: it never blocks on other
+// readers or on Publish(). It costs two atomic increments and decrements, of
+// the slot and of the shared pointer.
+//
+// The pointer is kept in one of two slots, each with a count of the readers
+// that are copying it. A reader announces itself on the current slot and then
+// checks that the slot is still current before copying from it. Publish()
+// fills the other slot, makes it current, and waits until the readers of the
+// old slot are done before releasing its pointer. The slots are never freed
+// while the object lives, so a reader that loads a slot just before it is
+// retired still touches valid memory.
+// Thread-safe.
+template <typename T>
+class PublishedPtr {
+ public:
+  explicit PublishedPtr(std::shared_ptr<T> value = nullptr)
+      : current_(&slots_[0]) {
+    slots_[0].value = std::move(value);
+  }
+
+  // Returns the current pointer. It stays valid for as long as the caller holds
+  // it, even if another one is published in the meantime.
+  std::shared_ptr<T> Get() const {
+    while (true) {
+      Slot* slot = current_.load();
+      slot->num_readers.fetch_add(1);
+      // Publish() only waits for the readers that announced themselves before
+      // it switched the slots, so the others must not touch the value.
+      if (current_.load() == slot) {
+        std::shared_ptr<T> result = slot->value;
+        slot->num_readers.fetch_sub(1);
+        return result;
+      }
+      slot->num_readers.fetch_sub(1);
+    }
+  }
+
+  // Makes 'value' the current pointer and returns the previous one. Waits for
+  // the Get() calls that are copying the previous pointer, which only takes as
+  // long as copying a shared pointer.
+  std::shared_ptr<T> Publish(std::shared_ptr<T> value) {
+    std::lock_guard<std::mutex> lock(publish_mutex_);
+    Slot* old_slot = current_.load();
+    Slot* new_slot = old_slot == &slots_[0] ? &slots_[1] : &slots_[0];
+    new_slot->value = std::move(value);
+    current_.store(new_slot);
+    while (old_slot->num_readers.load() != 0) {
+      std::this_thread::yield();
+    }
+    return std::move(old_slot->value);
+  }
+
+ private:
+  struct Slot {
+    std::shared_ptr<T> value;
+    std::atomic<int> num_readers{0};
+  };
+
+  // The sequentially consistent default ordering is needed: a reader's count
+  // and check of the current slot must not be reordered with a publisher's
+  // switch and wait.
+  mutable Slot slots_[2];
+  std::atomic<Slot*> current_;
+
+  // Serializes the Publish() calls.
+  std::mutex publish_mutex_;
+
+  TC_DISALLOW_COPY_AND_ASSIGN(PublishedPtr);
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_UTIL_THREAD_PUBLISHED_PTR_H_
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "util/thread/published-ptr.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+TEST(PublishedPtrTest, PublishesNewValues) {
+  PublishedPtr<const int> ptr;
+  EXPECT_TRUE(ptr.Get() == nullptr);
+
+  std::shared_ptr<const int> first(new int(1));
+  EXPECT_TRUE(ptr.Publish(first) == nullptr);
+  EXPECT_EQ(ptr.Get(), first);
+
+  std::shared_ptr<const int> previous = ptr.Publish(std::make_shared<int>(2));
+  EXPECT_EQ(previous, first);
+  EXPECT_EQ(*ptr.Get(), 2);
+}
+
+TEST(PublishedPtrTest, ReleasesOldValueAfterLastReader) {
+  PublishedPtr<const int> ptr(std::make_shared<int>(1));
+  std::shared_ptr<const int> reader = ptr.Get();
+  std::weak_ptr<const int> old_value = reader;
+
+  ptr.Publish(std::make_shared<int>(2));
+  EXPECT_FALSE(old_value.expired());
+  reader.reset();
+  EXPECT_TRUE(old_value.expired());
+}
+
+TEST(PublishedPtrTest, PublishesWhileReading) {
+  PublishedPtr<const int> ptr(std::make_shared<int>(0));
+  std::atomic<bool> done(false);
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; ++i) {
+    readers.emplace_back([&ptr, &done]() {
+      int last_value = 0;
+      while (!done.load()) {
+        const std::shared_ptr<const int> value = ptr.Get();
+        ASSERT_TRUE(value);
+        // The values are published in increasing order.
+        ASSERT_GE(*value, last_value);
+        last_value = *value;
+      }
+    });
+  }
+  for (int i = 1; i <= 1000; ++i) {
+    ptr.Publish(std::make_shared<int>(i));
+  }
+  done = true;
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+  EXPECT_EQ(*ptr.Get(), 1000);
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "util/thread/thread-pool.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+// The pool that the current thread belongs to, if any, and its index in it.
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local int current_index = -1;
+
+}  // namespace
+
+ThreadPool::ThreadPool(int num_threads) {
+  if (num_threads < 1) {
+    num_threads = 1;
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    queues_.emplace_back(new Queue());
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.emplace_back([this, i]() { RunThread(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+void ThreadPool::Schedule(std::function<void()> task) {
+  const int index = current_pool == this
+                        ? current_index
+                        : next_queue_.fetch_add(1, std::memory_order_relaxed) %
+                              queues_.size();
+  {
+    std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+    queues_[index]->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++num_unclaimed_;
+  }
+  wake_.notify_one();
+}
+
+bool ThreadPool::TakeTask(int index, std::function<void()>* task) {
+  {
+    Queue* queue = queues_[index].get();
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    if (!queue->tasks.empty()) {
+      *task = std::move(queue->tasks.back());
+      queue->tasks.pop_back();
+      return true;
+    }
+  }
+  for (int i = 1; i < queues_.size(); ++i) {
+    Queue* queue = queues_[(index + i) % queues_.size()].get();
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    if (!queue->tasks.empty()) {
+      *task = std::move(queue->tasks.front());
+      queue->tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::RunThread(int index) {
+  current_pool = this;
+  current_index = index;
+  std::function<void()> task;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this]() { return num_unclaimed_ > 0 || stopping_; });
+      if (num_unclaimed_ == 0) {
+        // Stopping, and all the tasks have been run or claimed.
+        return;
+      }
+      --num_unclaimed_;
+    }
+
+    // Every claim matches a task that was queued before it was counted, so
+    // one is there to take, even if others claimed and took the ones that
+    // this thread passed over while looking.
+    while (!TakeTask(index, &task)) {
+      std::this_thread::yield();
+    }
+    task();
+    task = nullptr;
+  }
+}
+
+}  // namespace libtextclassifier2
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBTEXTCLASSIFIER_UTIL_THREAD_THREAD_POOL_H_
+#define LIBTEXTCLASSIFIER_UTIL_THREAD_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "util/base/macros.h"
+#include "util/thread/executor.h"
+
+namespace libtextclassifier2 {
+
+// A fixed number of threads that run the scheduled tasks. Each thread has its
+// own queue: the tasks that a pool thread schedules go to its own queue and
+// are run last-in first-out, the ones scheduled from outside are spread over
+// the queues, and a thread whose queue is empty steals the oldest task of
+// another one. So related tasks tend to stay on one thread, without any
+// thread idling while there is work.
+class ThreadPool : public Executor {
+ public:
+  // Starts 'num_threads' threads, at least one.
+  explicit ThreadPool(int num_threads);
+
+  // Runs the tasks that are still pending, then stops the threads.
+  ~ThreadPool() override;
+
+  void Schedule(std::function<void()> task) override;
+
+  int num_threads() const { return threads_.size(); }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  // Takes the newest task of the queue of thread 'index', or else the oldest
+  // task of another queue. Returns false if all the queues are empty.
+  bool TakeTask(int index, std::function<void()>* task);
+
+  void RunThread(int index);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+
+  // Queue for the next task scheduled from outside of the pool.
+  std::atomic<unsigned int> next_queue_{0};
+
+  // Guards the counts below, that the idle threads wait on.
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  // Scheduled tasks that no thread has set out to take yet.
+  int num_unclaimed_ = 0;
+  bool stopping_ = false;
+
+  TC_DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_UTIL_THREAD_THREAD_POOL_H_
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "util/thread/thread-pool.h"
+
+#include <atomic>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+TEST(ThreadPoolTest, RunsEveryTaskOnce) {
+  std::vector<std::atomic<int>> counts(100);
+  for (std::atomic<int>& count : counts) {
+    count = 0;
+  }
+  {
+    ThreadPool pool(/*num_threads=*/4);
+    EXPECT_EQ(pool.num_threads(), 4);
+    for (int i = 0; i < counts.size(); ++i) {
+      pool.Schedule([&counts, i]() { ++counts[i]; });
+    }
+    // The destructor runs the pending tasks.
+  }
+  for (const std::atomic<int>& count : counts) {
+    EXPECT_EQ(count, 1);
+  }
+}
+
+TEST(ThreadPoolTest, RunsTasksScheduledByTasks) {
+  std::atomic<int> num_runs(0);
+  {
+    ThreadPool pool(/*num_threads=*/3);
+    for (int i = 0; i < 10; ++i) {
+      pool.Schedule([&pool, &num_runs]() {
+        ++num_runs;
+        for (int j = 0; j < 10; ++j) {
+          pool.Schedule([&num_runs]() { ++num_runs; });
+        }
+      });
+    }
+  }
+  EXPECT_EQ(num_runs, 110);
+}
+
+TEST(ThreadPoolTest, IdleThreadsStealWork) {
+  std::mutex mutex;
+  std::set<std::thread::id> thread_ids;
+  std::thread::id busy_thread_id;
+  {
+    ThreadPool pool(/*num_threads=*/2);
+    // All the tasks are queued on the thread of the first one, which stays
+    // busy until the other thread has run them.
+    std::atomic<int> num_stolen(0);
+    pool.Schedule([&]() {
+      busy_thread_id = std::this_thread::get_id();
+      for (int i = 0; i < 10; ++i) {
+        pool.Schedule([&]() {
+          {
+            std::lock_guard<std::mutex> lock(mutex);
+            thread_ids.insert(std::this_thread::get_id());
+          }
+          ++num_stolen;
+        });
+      }
+      while (num_stolen < 10) {
+        std::this_thread::yield();
+      }
+    });
+  }
+  ASSERT_EQ(thread_ids.size(), 1);
+  EXPECT_NE(*thread_ids.begin(), busy_thread_id);
+}
+
+TEST(ThreadPoolTest, RunInParallel) {
+  ThreadPool pool(/*num_threads=*/2);
+  std::vector<std::atomic<int>> counts(10);
+  for (std::atomic<int>& count : counts) {
+    count = 0;
+  }
+  RunInParallel(&pool, counts.size(), [&counts](int i) { ++counts[i]; });
+  for (const std::atomic<int>& count : counts) {
+    EXPECT_EQ(count, 1);
+  }
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
@@ -0,0 +1,1012 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "util/utf8/linear-regex.h"
+
+#include <algorithm>
+#include <set>
+#include <string>
+
+#include "util/memory/memory-usage.h"
+#include "util/strings/utf8.h"
+#include "unicode/uchar.h"
+#include "unicode/uniset.h"
+#include "unicode/unistr.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+// Bounds the size of the program, which the work per codepoint of a search is
+// proportional to, and of the counted repeats that it gets expanded from.
+constexpr int kMaxProgramSize = 10000;
+constexpr int kMaxRepeat = 1000;
+
+enum Assertion {
+  kLineStart,
+  kLineEnd,
+  kTextStart,
+  kTextEnd,
+  kWordBoundary,
+  kNotWordBoundary,
+};
+
+// The line terminators of ICU, which '.', '^' and '$' treat specially.
+bool IsLineTerminator(char32 codepoint) {
+  return (codepoint >= 0x0A && codepoint <= 0x0D) || codepoint == 0x85 ||
+         codepoint == 0x2028 || codepoint == 0x2029;
+}
+
+const icu::UnicodeSet* NewSet(const char* pattern) {
+  UErrorCode status = U_ZERO_ERROR;
+  icu::UnicodeSet* set = new icu::UnicodeSet(
+      icu::UnicodeString(pattern, -1, US_INV), status);
+  set->freeze();
+  return set;
+}
+
+// The sets of \d, \s and \w, as the ICU regex engine defines them.
+const icu::UnicodeSet& DigitSet() {
+  static const icu::UnicodeSet* set = NewSet("[\\p{Nd}]");
+  return *set;
+}
+
+const icu::UnicodeSet& SpaceSet() {
+  static const icu::UnicodeSet* set = NewSet("[\\p{WhiteSpace}]");
+  return *set;
+}
+
+const icu::UnicodeSet& WordSet() {
+  static const icu::UnicodeSet* set =
+      NewSet("[\\p{Alphabetic}\\p{M}\\p{Nd}\\p{Pc}\\u200c\\u200d]");
+  return *set;
+}
+
+bool IsWordChar(char32 codepoint) {
+  if (codepoint < 0x80) {
+    return (codepoint >= 'a' && codepoint <= 'z') ||
+           (codepoint >= 'A' && codepoint <= 'Z') ||
+           (codepoint >= '0' && codepoint <= '9') || codepoint == '_';
+  }
+  return WordSet().contains(codepoint);
+}
+
+// The codepoints that \b looks through, as if they were not there.
+bool IsExtendOrFormat(char32 codepoint) {
+  if (codepoint < 0x80) {
+    return false;
+  }
+  return u_hasBinaryProperty(codepoint, UCHAR_GRAPHEME_EXTEND) ||
+         u_charType(codepoint) == U_FORMAT_CHAR;
+}
+
+bool IsAsciiAlphanumeric(char32 codepoint) {
+  return (codepoint >= 'a' && codepoint <= 'z') ||
+         (codepoint >= 'A' && codepoint <= 'Z') ||
+         (codepoint >= '0' && codepoint <= '9');
+}
+
+int HexValue(char32 codepoint) {
+  if (codepoint >= '0' && codepoint <= '9') {
+    return codepoint - '0';
+  }
+  if (codepoint >= 'a' && codepoint <= 'f') {
+    return codepoint - 'a' + 10;
+  }
+  if (codepoint >= 'A' && codepoint <= 'F') {
+    return codepoint - 'A' + 10;
+  }
+  return -1;
+}
+
+// Decodes the codepoint at 'data', of which 'size' bytes are left, and returns
+// its length. Malformed bytes are decoded one by one as U+FFFD.
+int DecodeUTF8(const char* data, int size, char32* codepoint) {
+  const unsigned char first = static_cast<unsigned char>(data[0]);
+  if (first < 0x80) {
+    *codepoint = first;
+    return 1;
+  }
+  const int length = GetNumBytesForNonZeroUTF8Char(data);
+  if (length == 1 || length > size) {
+    *codepoint = 0xFFFD;
+    return 1;
+  }
+  char32 result = first & (0x7F >> length);
+  for (int i = 1; i < length; ++i) {
+    if (!IsTrailByte(data[i])) {
+      *codepoint = 0xFFFD;
+      return 1;
+    }
+    result = (result << 6) | (static_cast<unsigned char>(data[i]) & 0x3F);
+  }
+  *codepoint = result;
+  return length;
+}
+
+// Decodes the codepoint that ends at 'offset' and returns its start.
+int DecodePreviousUTF8(const char* input, int offset, char32* codepoint) {
+  int start = offset - 1;
+  while (start > 0 && offset - start < 4 && IsTrailByte(input[start])) {
+    --start;
+  }
+  if (DecodeUTF8(input + start, offset - start, codepoint) != offset - start) {
+    *codepoint = 0xFFFD;
+    return offset - 1;
+  }
+  return start;
+}
+
+// Whether \b holds at 'offset', with the definition of ICU.
+bool IsWordBoundary(const char* input, int input_size, int offset) {
+  bool is_word = false;
+  if (offset < input_size) {
+    char32 codepoint;
+    DecodeUTF8(input + offset, input_size - offset, &codepoint);
+    if (IsExtendOrFormat(codepoint)) {
+      return false;
+    }
+    is_word = IsWordChar(codepoint);
+  }
+  bool previous_is_word = false;
+  while (offset > 0) {
+    char32 previous;
+    offset = DecodePreviousUTF8(input, offset, &previous);
+    if (!IsExtendOrFormat(previous)) {
+      previous_is_word = IsWordChar(previous);
+      break;
+    }
+  }
+  return is_word != previous_is_word;
+}
+
+bool HoldsAt(int assertion, const char* input, int input_size, int offset) {
+  switch (assertion) {
+    case kLineStart: {
+      if (offset == 0) {
+        return true;
+      }
+      char32 previous;
+      DecodePreviousUTF8(input, offset, &previous);
+      return offset < input_size && IsLineTerminator(previous);
+    }
+    case kLineEnd: {
+      if (offset >= input_size) {
+        return true;
+      }
+      char32 next;
+      DecodeUTF8(input + offset, input_size - offset, &next);
+      // Not in between the CR and the LF of a CRLF.
+      return IsLineTerminator(next) &&
+             !(next == 0x0A && offset > 0 && input[offset - 1] == 0x0D);
+    }
+    case kTextStart:
+      return offset == 0;
+    case kTextEnd:
+      return offset >= input_size;
+    case kWordBoundary:
+      return IsWordBoundary(input, input_size, offset);
+    case kNotWordBoundary:
+      return !IsWordBoundary(input, input_size, offset);
+  }
+  return false;
+}
+
+}  // namespace
+
+struct LinearRegex::Node {
+  enum Type {
+    kEmpty,
+    kChar,
+    kClass,
+    kAnyChar,
+    kAssertion,
+    kConcatenation,
+    kAlternation,
+    kRepetition,
+    kCapture,
+  };
+
+  explicit Node(Type type) : type(type) {}
+
+  // Whether the node can match the empty string.
+  bool IsNullable() const {
+    switch (type) {
+      case kChar:
+      case kClass:
+      case kAnyChar:
+        return false;
+      case kConcatenation:
+        for (const std::unique_ptr<Node>& child : children) {
+          if (!child->IsNullable()) {
+            return false;
+          }
+        }
+        return true;
+      case kAlternation:
+        for (const std::unique_ptr<Node>& child : children) {
+          if (child->IsNullable()) {
+            return true;
+          }
+        }
+        return false;
+      case kRepetition:
+        return min == 0 || children[0]->IsNullable();
+      case kCapture:
+        return children[0]->IsNullable();
+      default:
+        return true;
+    }
+  }
+
+  Type type;
+
+  // The codepoint of kChar, the class of kClass, the assertion of kAssertion
+  // or the group of kCapture.
+  int arg = 0;
+
+  // The bounds of kRepetition; 'max' is -1 if unbounded.
+  int min = 0;
+  int max = 0;
+  bool greedy = true;
+
+  std::vector<std::unique_ptr<Node>> children;
+};
+
+// Recursive descent parser of the supported syntax. Anything else fails the
+// parse, so that the pattern is left to ICU.
+class LinearRegex::Parser {
+ public:
+  explicit Parser(const UnicodeText& pattern)
+      : pattern_(pattern.begin(), pattern.end()) {}
+
+  std::unique_ptr<Node> Parse() {
+    std::unique_ptr<Node> node = ParseAlternation();
+    if (node == nullptr || pos_ != pattern_.size()) {
+      return nullptr;
+    }
+    return node;
+  }
+
+  int num_groups() const { return num_groups_; }
+  const std::vector<icu::UnicodeSet>& sets() const { return sets_; }
+
+ private:
+  // Returns the codepoint 'ahead' positions ahead, or -1 past the end.
+  char32 Peek(int ahead = 0) const {
+    return pos_ + ahead < pattern_.size() ? pattern_[pos_ + ahead] : -1;
+  }
+
+  std::unique_ptr<Node> NewNode(Node::Type type, int arg) {
+    std::unique_ptr<Node> node(new Node(type));
+    node->arg = arg;
+    return node;
+  }
+
+  std::unique_ptr<Node> NewClass(const icu::UnicodeSet& set) {
+    sets_.push_back(set);
+    return NewNode(Node::kClass, sets_.size() - 1);
+  }
+
+  std::unique_ptr<Node> ParseAlternation() {
+    std::unique_ptr<Node> first = ParseConcatenation();
+    if (first == nullptr || Peek() != '|') {
+      return first;
+    }
+    std::unique_ptr<Node> node(new Node(Node::kAlternation));
+    node->children.push_back(std::move(first));
+    while (Peek() == '|') {
+      ++pos_;
+      std::unique_ptr<Node> child = ParseConcatenation();
+      if (child == nullptr) {
+        return nullptr;
+      }
+      node->children.push_back(std::move(child));
+    }
+    return node;
+  }
+
+  std::unique_ptr<Node> ParseConcatenation() {
+    std::unique_ptr<Node> node(new Node(Node::kConcatenation));
+    while (Peek() != -1 && Peek() != '|' && Peek() != ')') {
+      std::unique_ptr<Node> child = ParseRepetition();
+      if (child == nullptr) {
+        return nullptr;
+      }
+      node->children.push_back(std::move(child));
+    }
+    return node;
+  }
+
+  static bool IsQuantifier(char32 codepoint) {
+    return codepoint == '*' || codepoint == '+' || codepoint == '?' ||
+           codepoint == '{';
+  }
+
+  std::unique_ptr<Node> ParseRepetition() {
+    std::unique_ptr<Node> atom = ParseAtom();
+    if (atom == nullptr || !IsQuantifier(Peek())) {
+      return atom;
+    }
+    int min = 0;
+    int max = -1;
+    const char32 quantifier = pattern_[pos_++];
+    if (quantifier == '+') {
+      min = 1;
+    } else if (quantifier == '?') {
+      max = 1;
+    } else if (quantifier == '{' && !ParseInterval(&min, &max)) {
+      return nullptr;
+    }
+    bool greedy = true;
+    if (Peek() == '?') {
+      greedy = false;
+      ++pos_;
+    }
+    // Possessive and stacked quantifiers, and quantified assertions.
+    if (IsQuantifier(Peek()) || atom->type == Node::kAssertion) {
+      return nullptr;
+    }
+    // The iterations that match the empty string are cut short by the
+    // backtracking engine in ways the automaton doesn't reproduce.
+    if ((max == -1 || max > 1) && atom->IsNullable()) {
+      return nullptr;
+    }
+    std::unique_ptr<Node> node(new Node(Node::kRepetition));
+    node->min = min;
+    node->max = max;
+    node->greedy = greedy;
+    node->children.push_back(std::move(atom));
+    return node;
+  }
+
+  // Parses "n}", "n,}" or "n,m}".
+  bool ParseInterval(int* min, int* max) {
+    if (!ParseNumber(min)) {
+      return false;
+    }
+    *max = *min;
+    if (Peek() == ',') {
+      ++pos_;
+      *max = -1;
+      if (Peek() != '}' && !ParseNumber(max)) {
+        return false;
+      }
+    }
+    if (Peek() != '}') {
+      return false;
+    }
+    ++pos_;
+    return *max == -1 || *max >= *min;
+  }
+
+  bool ParseNumber(int* value) {
+    *value = 0;
+    const int start = pos_;
+    while (Peek() >= '0' && Peek() <= '9') {
+      *value = *value * 10 + (pattern_[pos_++] - '0');
+      if (*value > kMaxRepeat) {
+        return false;
+      }
+    }
+    return pos_ > start;
+  }
+
+  std::unique_ptr<Node> ParseAtom() {
+    const char32 codepoint = pattern_[pos_++];
+    switch (codepoint) {
+      case '(':
+        return ParseGroup();
+      case '[':
+        return ParseClass();
+      case '.':
+        return NewNode(Node::kAnyChar, 0);
+      case '^':
+        return NewNode(Node::kAssertion, kLineStart);
+      case '$':
+        return NewNode(Node::kAssertion, kLineEnd);
+      case '\\':
+        return ParseEscape();
+      case '*':
+      case '+':
+      case '?':
+      case '{':
+      case '}':
+      case ']':
+        return nullptr;
+      default:
+        return NewNode(Node::kChar, codepoint);
+    }
+  }
+
+  std::unique_ptr<Node> ParseGroup() {
+    bool capturing = true;
+    if (Peek() == '?') {
+      if (Peek(1) == ':') {
+        capturing = false;
+        pos_ += 2;
+      } else if (Peek(1) == '<' && IsAsciiAlphanumeric(Peek(2)) &&
+                 !(Peek(2) >= '0' && Peek(2) <= '9')) {
+        // A named group, which is numbered like the others.
+        pos_ += 2;
+        std::string name;
+        while (IsAsciiAlphanumeric(Peek())) {
+          name.push_back(pattern_[pos_++]);
+        }
+        if (Peek() != '>' || !group_names_.insert(name).second) {
+          return nullptr;
+        }
+        ++pos_;
+      } else {
+        // Lookarounds, flags, atomic groups and comments.
+        return nullptr;
+      }
+    }
+    const int group = capturing ? ++num_groups_ : 0;
+    std::unique_ptr<Node> body = ParseAlternation();
+    if (body == nullptr || Peek() != ')') {
+      return nullptr;
+    }
+    ++pos_;
+    if (!capturing) {
+      return body;
+    }
+    std::unique_ptr<Node> node = NewNode(Node::kCapture, group);
+    node->children.push_back(std::move(body));
+    return node;
+  }
+
+  std::unique_ptr<Node> ParseEscape() {
+    switch (Peek()) {
+      case 'b':
+        ++pos_;
+        return NewNode(Node::kAssertion, kWordBoundary);
+      case 'B':
+        ++pos_;
+        return NewNode(Node::kAssertion, kNotWordBoundary);
+      case 'A':
+        ++pos_;
+        return NewNode(Node::kAssertion, kTextStart);
+      case 'z':
+        ++pos_;
+        return NewNode(Node::kAssertion, kTextEnd);
+    }
+    if (IsSetEscape(Peek())) {
+      icu::UnicodeSet set;
+      if (!ParseSetEscape(&set)) {
+        return nullptr;
+      }
+      return NewClass(set);
+    }
+    char32 codepoint;
+    if (!ParseEscapedCodepoint(&codepoint)) {
+      return nullptr;
+    }
+    return NewNode(Node::kChar, codepoint);
+  }
+
+  static bool IsSetEscape(char32 codepoint) {
+    return codepoint == 'd' || codepoint == 'D' || codepoint == 's' ||
+           codepoint == 'S' || codepoint == 'w' || codepoint == 'W' ||
+           codepoint == 'p' || codepoint == 'P';
+  }
+
+  // Parses the escape after a backslash that stands for a set.
+  bool ParseSetEscape(icu::UnicodeSet* set) {
+    const char32 escape = pattern_[pos_++];
+    switch (escape) {
+      case 'd':
+      case 'D':
+        set->addAll(DigitSet());
+        break;
+      case 's':
+      case 'S':
+        set->addAll(SpaceSet());
+        break;
+      case 'w':
+      case 'W':
+        set->addAll(WordSet());
+        break;
+      default: {
+        // \p{...} or \P{...}, which the ICU sets parse the same way.
+        if (Peek() != '{') {
+          return false;
+        }
+        icu::UnicodeString property("[\\p", -1, US_INV);
+        while (Peek() != -1 && Peek() != '}') {
+          property.append(static_cast<UChar32>(pattern_[pos_++]));
+        }
+        if (Peek() != '}') {
+          return false;
+        }
+        ++pos_;
+        property.append(static_cast<UChar32>('}'));
+        property.append(static_cast<UChar32>(']'));
+        UErrorCode status = U_ZERO_ERROR;
+        icu::UnicodeSet property_set(property, status);
+        if (U_FAILURE(status)) {
+          return false;
+        }
+        set->addAll(property_set);
+      }
+    }
+    if (escape == 'D' || escape == 'S' || escape == 'W' || escape == 'P') {
+      set->complement();
+    }
+    return true;
+  }
+
+  // Parses the escape after a backslash that stands for a codepoint.
+  bool ParseEscapedCodepoint(char32* codepoint) {
+    if (Peek() == -1) {
+      return false;
+    }
+    const char32 escape = pattern_[pos_++];
+    switch (escape) {
+      case 't':
+        *codepoint = '\t';
+        return true;
+      case 'n':
+        *codepoint = '\n';
+        return true;
+      case 'r':
+        *codepoint = '\r';
+        return true;
+      case 'f':
+        *codepoint = '\f';
+        return true;
+      case 'a':
+        *codepoint = 0x07;
+        return true;
+      case 'e':
+        *codepoint = 0x1B;
+        return true;
+      case 'u':
+        return ParseHex(/*num_digits=*/4, codepoint);
+      case 'U':
+        return ParseHex(/*num_digits=*/8, codepoint);
+      case 'x':
+        if (Peek() != '{') {
+          return ParseHex(/*num_digits=*/2, codepoint);
+        }
+        ++pos_;
+        *codepoint = 0;
+        for (int num_digits = 0; Peek() != '}'; ++num_digits) {
+          const int digit = HexValue(Peek());
+          if (digit < 0 || num_digits == 6) {
+            return false;
+          }
+          *codepoint = *codepoint * 16 + digit;
+          ++pos_;
+        }
+        ++pos_;
+        return *codepoint <= 0x10FFFF;
+    }
+    // The other escaped ASCII punctuation and spaces stand for themselves.
+    *codepoint = escape;
+    return escape < 0x80 && !IsAsciiAlphanumeric(escape);
+  }
+
+  bool ParseHex(int num_digits, char32* codepoint) {
+    *codepoint = 0;
+    for (int i = 0; i < num_digits; ++i) {
+      const int digit = HexValue(Peek());
+      if (digit < 0) {
+        return false;
+      }
+      *codepoint = *codepoint * 16 + digit;
+      ++pos_;
+    }
+    return *codepoint <= 0x10FFFF;
+  }
+
+  // Parses a codepoint of a character class.
+  bool ParseClassCodepoint(char32* codepoint) {
+    const char32 next = pattern_[pos_++];
+    if (next == '\\') {
+      return ParseEscapedCodepoint(codepoint);
+    }
+    // Nested sets, POSIX classes, set operations, strings and variables.
+    if (next == '[' || next == '&' || next == '{' || next == '$') {
+      return false;
+    }
+    *codepoint = next;
+    return true;
+  }
+
+  // Parses a flat character class, after its '['.
+  std::unique_ptr<Node> ParseClass() {
+    icu::UnicodeSet set;
+    bool negated = false;
+    if (Peek() == '^') {
+      negated = true;
+      ++pos_;
+    }
+    if (Peek() == ']') {
+      return nullptr;
+    }
+    while (Peek() != ']') {
+      if (Peek() == -1 || (Peek() == '-' && Peek(1) == '-')) {
+        return nullptr;
+      }
+      if (Peek() == '\\' && IsSetEscape(Peek(1))) {
+        ++pos_;
+        icu::UnicodeSet item;
+        if (!ParseSetEscape(&item) || (Peek() == '-' && Peek(1) != ']')) {
+          return nullptr;
+        }
+        set.addAll(item);
+        continue;
+      }
+      char32 first;
+      if (!ParseClassCodepoint(&first)) {
+        return nullptr;
+      }
+      if (Peek() != '-' || Peek(1) == ']') {
+        set.add(first);
+        continue;
+      }
+      ++pos_;
+      char32 last;
+      if (Peek() == -1 || (Peek() == '\\' && IsSetEscape(Peek(1))) ||
+          !ParseClassCodepoint(&last) || last < first ||
+          (Peek() == '-' && Peek(1) != ']')) {
+        return nullptr;
+      }
+      set.add(first, last);
+    }
+    ++pos_;
+    if (negated) {
+      set.complement();
+    }
+    return NewClass(set);
+  }
+
+  const std::vector<char32> pattern_;
+  int pos_ = 0;
+  int num_groups_ = 0;
+  std::set<std::string> group_names_;
+  std::vector<icu::UnicodeSet> sets_;
+};
+
+bool LinearRegex::CharClass::Contains(char32 codepoint) const {
+  if (codepoint < 0x80) {
+    return (ascii[codepoint >> 6] >> (codepoint & 63)) & 1;
+  }
+  // The first range that starts after the codepoint.
+  const auto it = std::upper_bound(
+      ranges.begin(), ranges.end(), codepoint,
+      [](char32 value, const std::pair<char32, char32>& range) {
+        return value < range.first;
+      });
+  return it != ranges.begin() && codepoint <= (it - 1)->second;
+}
+
+std::unique_ptr<const LinearRegex> LinearRegex::Compile(
+    const UnicodeText& pattern) {
+  Parser parser(pattern);
+  const std::unique_ptr<Node> root = parser.Parse();
+  if (root == nullptr) {
+    return nullptr;
+  }
+  std::unique_ptr<LinearRegex> regex(new LinearRegex());
+  regex->num_groups_ = parser.num_groups();
+  for (const icu::UnicodeSet& set : parser.sets()) {
+    CharClass char_class;
+    char_class.ascii[0] = 0;
+    char_class.ascii[1] = 0;
+    for (int i = 0; i < set.getRangeCount(); ++i) {
+      char32 first = set.getRangeStart(i);
+      const char32 last = set.getRangeEnd(i);
+      for (; first <= last && first < 0x80; ++first) {
+        char_class.ascii[first >> 6] |= uint64{1} << (first & 63);
+      }
+      if (first <= last) {
+        char_class.ranges.push_back({first, last});
+      }
+    }
+    regex->classes_.push_back(std::move(char_class));
+  }
+  regex->Push(kSave, 0);
+  if (!regex->Emit(*root)) {
+    return nullptr;
+  }
+  regex->Push(kSave, 1);
+  regex->Push(kMatch, 0);
+  int pc = 0;
+  while (regex->program_[pc].opcode == kSave) {
+    ++pc;
+  }
+  regex->starts_with_line_start_ = regex->program_[pc].opcode == kAssert &&
+                                   regex->program_[pc].arg == kLineStart;
+  return std::move(regex);
+}
+
+int LinearRegex::Push(Opcode opcode, int arg) {
+  program_.push_back({opcode, arg, /*target=*/0, /*alternative=*/0});
+  return program_.size() - 1;
+}
+
+void LinearRegex::SetSplit(int pc, int preferred, int other, bool greedy) {
+  program_[pc].target = greedy ? preferred : other;
+  program_[pc].alternative = greedy ? other : preferred;
+}
+
+bool LinearRegex::Emit(const Node& node) {
+  switch (node.type) {
+    case Node::kEmpty:
+      break;
+    case Node::kChar:
+      Push(kChar, node.arg);
+      break;
+    case Node::kClass:
+      Push(kClass, node.arg);
+      break;
+    case Node::kAnyChar:
+      Push(kAnyChar, 0);
+      break;
+    case Node::kAssertion:
+      Push(kAssert, node.arg);
+      break;
+    case Node::kConcatenation:
+      for (const std::unique_ptr<Node>& child : node.children) {
+        if (!Emit(*child)) {
+          return false;
+        }
+      }
+      break;
+    case Node::kAlternation: {
+      std::vector<int> jumps;
+      for (int i = 0; i < node.children.size(); ++i) {
+        const bool last = i + 1 == node.children.size();
+        const int split = last ? -1 : Push(kSplit, 0);
+        if (!Emit(*node.children[i])) {
+          return false;
+        }
+        if (!last) {
+          jumps.push_back(Push(kJump, 0));
+          SetSplit(split, split + 1, program_.size(), /*greedy=*/true);
+        }
+      }
+      for (const int jump : jumps) {
+        program_[jump].target = program_.size();
+      }
+      break;
+    }
+    case Node::kCapture:
+      Push(kSave, 2 * node.arg);
+      if (!Emit(*node.children[0])) {
+        return false;
+      }
+      Push(kSave, 2 * node.arg + 1);
+      break;
+    case Node::kRepetition: {
+      const Node& body = *node.children[0];
+      // The unbounded repeats loop over their last mandatory iteration, or
+      // over an optional one.
+      const int num_copies =
+          node.max == -1 && node.min > 0 ? node.min - 1 : node.min;
+      for (int i = 0; i < num_copies; ++i) {
+        if (!Emit(body)) {
+          return false;
+        }
+      }
+      if (node.max == -1 && node.min > 0) {
+        const int loop = program_.size();
+        if (!Emit(body)) {
+          return false;
+        }
+        const int split = Push(kSplit, 0);
+        SetSplit(split, loop, split + 1, node.greedy);
+      } else if (node.max == -1) {
+        const int split = Push(kSplit, 0);
+        if (!Emit(body)) {
+          return false;
+        }
+        Push(kJump, 0);
+        program_.back().target = split;
+        SetSplit(split, split + 1, program_.size(), node.greedy);
+      } else {
+        std::vector<int> splits;
+        for (int i = node.min; i < node.max; ++i) {
+          splits.push_back(Push(kSplit, 0));
+          if (!Emit(body)) {
+            return false;
+          }
+        }
+        for (const int split : splits) {
+          SetSplit(split, split + 1, program_.size(), node.greedy);
+        }
+      }
+      break;
+    }
+  }
+  return program_.size() <= kMaxProgramSize;
+}
+
+void LinearRegex::AddThread(const char* input, int input_size, int pc,
+                            int offset, int codepoint_offset, int* captures,
+                            Workspace::ThreadList* list,
+                            Workspace* workspace) const {
+  const int num_captures = 4 * (num_groups_ + 1);
+  std::vector<Workspace::Job>& jobs = workspace->jobs_;
+  jobs.clear();
+  jobs.push_back({pc, 0, 0});
+  while (!jobs.empty()) {
+    const Workspace::Job job = jobs.back();
+    jobs.pop_back();
+    if (job.pc < 0) {
+      captures[job.capture_index] = job.capture_value;
+      continue;
+    }
+    // Follows the instructions that don't consume input. The alternatives of
+    // the splits are taken after everything the preferred branch leads to.
+    for (pc = job.pc;;) {
+      const int visited = list->sparse[pc];
+      if (visited < list->num_visited && list->dense[visited] == pc) {
+        break;
+      }
+      list->sparse[pc] = list->num_visited;
+      list->dense[list->num_visited++] = pc;
+      const Inst& inst = program_[pc];
+      if (inst.opcode == kJump) {
+        pc = inst.target;
+      } else if (inst.opcode == kSplit) {
+        jobs.push_back({inst.alternative, 0, 0});
+        pc = inst.target;
+      } else if (inst.opcode == kSave) {
+        const int index = 2 * inst.arg;
+        jobs.push_back({-1, index, captures[index]});
+        jobs.push_back({-1, index + 1, captures[index + 1]});
+        captures[index] = offset;
+        captures[index + 1] = codepoint_offset;
+        ++pc;
+      } else if (inst.opcode == kAssert) {
+        if (!HoldsAt(inst.arg, input, input_size, offset)) {
+          break;
+        }
+        ++pc;
+      } else {
+        list->threads[list->num_threads] = pc;
+        std::copy(captures, captures + num_captures,
+                  list->captures.begin() + list->num_threads * num_captures);
+        ++list->num_threads;
+        break;
+      }
+    }
+  }
+}
+
+bool LinearRegex::Search(const char* input, int input_size, int start,
+                         int start_codepoint, bool full_match,
+                         Workspace* workspace,
+                         std::vector<GroupSpan>* groups) const {
+  // A byte and a codepoint offset per start and end of group.
+  const int num_captures = 4 * (num_groups_ + 1);
+  for (Workspace::ThreadList& list : workspace->lists_) {
+    list.sparse.resize(program_.size());
+    list.dense.resize(program_.size());
+    list.threads.resize(program_.size());
+    list.captures.resize(program_.size() * num_captures);
+    list.num_visited = 0;
+    list.num_threads = 0;
+  }
+  workspace->captures_.resize(num_captures);
+  workspace->match_captures_.resize(num_captures);
+  Workspace::ThreadList* current = &workspace->lists_[0];
+  Workspace::ThreadList* next = &workspace->lists_[1];
+
+  bool matched = false;
+  int offset = start;
+  int codepoint_offset = start_codepoint;
+  while (true) {
+    // A thread starting here has a lower priority than the ones that started
+    // earlier, and none is needed once there is a match. Like ICU, the
+    // searches for a pattern that starts with '^' skip the middle of CRLFs.
+    const bool in_crlf = offset > 0 && offset < input_size &&
+                         input[offset - 1] == '\r' && input[offset] == '\n';
+    if (!matched && (!full_match || offset == start) &&
+        !(!full_match && starts_with_line_start_ && in_crlf)) {
+      std::fill(workspace->captures_.begin(), workspace->captures_.end(), -1);
+      AddThread(input, input_size, /*pc=*/0, offset, codepoint_offset,
+                workspace->captures_.data(), current, workspace);
+    }
+    if (current->num_threads == 0 && (matched || full_match)) {
+      break;
+    }
+    char32 codepoint = -1;
+    int codepoint_size = 0;
+    if (offset < input_size) {
+      codepoint_size =
+          DecodeUTF8(input + offset, input_size - offset, &codepoint);
+    }
+    next->num_visited = 0;
+    next->num_threads = 0;
+    for (int i = 0; i < current->num_threads; ++i) {
+      const Inst& inst = program_[current->threads[i]];
+      int* thread_captures = current->captures.data() + i * num_captures;
+      bool consumes = false;
+      switch (inst.opcode) {
+        case kMatch:
+          if (full_match && offset < input_size) {
+            break;
+          }
+          matched = true;
+          std::copy(thread_captures, thread_captures + num_captures,
+                    workspace->match_captures_.begin());
+          // Drops the threads of a lower priority than the match.
+          i = current->num_threads;
+          break;
+        case kChar:
+          consumes = codepoint == inst.arg;
+          break;
+        case kClass:
+          consumes = codepoint >= 0 && classes_[inst.arg].Contains(codepoint);
+          break;
+        case kAnyChar:
+          consumes = codepoint >= 0 && !IsLineTerminator(codepoint);
+          break;
+        default:
+          break;
+      }
+      if (consumes) {
+        AddThread(input, input_size, current->threads[i] + 1,
+                  offset + codepoint_size, codepoint_offset + 1,
+                  thread_captures, next, workspace);
+      }
+    }
+    if (offset >= input_size) {
+      break;
+    }
+    std::swap(current, next);
+    offset += codepoint_size;
+    ++codepoint_offset;
+  }
+  if (!matched) {
+    return false;
+  }
+
+  groups->resize(num_groups_ + 1);
+  const std::vector<int>& captures = workspace->match_captures_;
+  for (int i = 0; i <= num_groups_; ++i) {
+    GroupSpan& span = (*groups)[i];
+    span.start = captures[4 * i];
+    span.start_codepoint = captures[4 * i + 1];
+    span.end = captures[4 * i + 2];
+    span.end_codepoint = captures[4 * i + 3];
+  }
+  return true;
+}
+
+int64 LinearRegex::Workspace::EstimateHeapBytes() const {
+  int64 result = VectorHeapBytes(jobs_) + VectorHeapBytes(captures_) +
+                 VectorHeapBytes(match_captures_);
+  for (const ThreadList& list : lists_) {
+    result += VectorHeapBytes(list.sparse) + VectorHeapBytes(list.dense) +
+              VectorHeapBytes(list.threads) + VectorHeapBytes(list.captures);
+  }
+  return result;
+}
+
+int64 LinearRegex::EstimateHeapBytes() const {
+  int64 result = VectorHeapBytes(program_) + VectorHeapBytes(classes_);
+  for (const CharClass& char_class : classes_) {
+    result += VectorHeapBytes(char_class.ranges);
+  }
+  return result;
+}
+
+}  // namespace libtextclassifier2
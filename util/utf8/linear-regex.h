@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// A regex engine that runs in time linear in the size of the input, for the
+// patterns of the ICU regex syntax it supports.
+
+#ifndef LIBTEXTCLASSIFIER_UTIL_UTF8_LINEAR_REGEX_H_
+#define LIBTEXTCLASSIFIER_UTIL_UTF8_LINEAR_REGEX_H_
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "util/base/integral_types.h"
+#include "util/utf8/unicodetext.h"
+
+namespace libtextclassifier2 {
+
+// A regex pattern compiled to an automaton that is simulated on the UTF-8 of
+// the input, like RE2 does, instead of backtracking over its UTF-16 like ICU.
+// The work of a search is bounded by the size of the input times the size of
+// the pattern, whatever the pattern and the input.
+//
+// Supports the part of the ICU syntax whose matches it finds exactly as ICU
+// does with UREGEX_MULTILINE: literals and escaped codepoints, '.', character
+// classes with ranges, properties and the \d, \s and \w escapes, capturing,
+// named and non-capturing groups, alternations, greedy and lazy quantifiers,
+// and the ^, $, \A, \z, \b and \B assertions. Of the matches at a position,
+// the one a backtracking engine finds first is chosen.
+//
+// Thread-safe, except for the workspace passed to the searches.
+class LinearRegex {
+ public:
+  // The offsets of a group of a match, in bytes and in codepoints. All are -1
+  // if the group did not participate in the match.
+  struct GroupSpan {
+    int start = -1;
+    int end = -1;
+    int start_codepoint = -1;
+    int end_codepoint = -1;
+  };
+
+  // The scratch memory of the searches. Keeping one across searches saves the
+  // allocations. Not thread-safe.
+  class Workspace {
+   public:
+    // Returns an estimate of the heap memory held, in bytes.
+    int64 EstimateHeapBytes() const;
+
+   private:
+    friend class LinearRegex;
+
+    // The threads at a position of the input, in priority order.
+    struct ThreadList {
+      // Sparse set of the instructions visited at the position.
+      std::vector<int> sparse;
+      std::vector<int> dense;
+      int num_visited = 0;
+
+      // The instructions of the threads that wait for the next codepoint, and
+      // their captures.
+      std::vector<int> threads;
+      std::vector<int> captures;
+      int num_threads = 0;
+    };
+
+    // A pending instruction to follow when adding a thread, or, if 'pc' is
+    // negative, a capture to restore.
+    struct Job {
+      int pc;
+      int capture_index;
+      int capture_value;
+    };
+
+    ThreadList lists_[2];
+    std::vector<Job> jobs_;
+    std::vector<int> captures_;
+    std::vector<int> match_captures_;
+  };
+
+  // Returns nullptr if the pattern is invalid or uses syntax that is not
+  // supported, e.g. backreferences, lookarounds, flags, possessive quantifiers
+  // or repeats of subpatterns that can match the empty string.
+  static std::unique_ptr<const LinearRegex> Compile(const UnicodeText& pattern);
+
+  // The number of capturing groups.
+  int num_groups() const { return num_groups_; }
+
+  // Finds the first match in the 'input_size' bytes of UTF-8 at 'input' that
+  // starts at or after the byte offset 'start', whose codepoint offset is
+  // 'start_codepoint'. With 'full_match', only a match that spans from 'start'
+  // to the end of the input is found. On success, fills 'groups' with the
+  // spans of the whole match and of the num_groups() groups.
+  bool Search(const char* input, int input_size, int start,
+              int start_codepoint, bool full_match, Workspace* workspace,
+              std::vector<GroupSpan>* groups) const;
+
+  // Returns an estimate of the heap memory held by the program, in bytes.
+  int64 EstimateHeapBytes() const;
+
+ private:
+  struct Node;
+  class Parser;
+
+  // A set of codepoints.
+  struct CharClass {
+    bool Contains(char32 codepoint) const;
+
+    // Bit i % 64 of ascii[i / 64] is set if the ASCII codepoint i is in.
+    uint64 ascii[2];
+
+    // The sorted, disjoint ranges [first, second] of the other codepoints.
+    std::vector<std::pair<char32, char32>> ranges;
+  };
+
+  enum Opcode {
+    // Consumes the codepoint 'arg'.
+    kChar,
+    // Consumes a codepoint of classes_[arg].
+    kClass,
+    // Consumes a codepoint that is not a line terminator.
+    kAnyChar,
+    // Continues at 'target', then, with a lower priority, at 'alternative'.
+    kSplit,
+    // Continues at 'target'.
+    kJump,
+    // Records the current offsets in the capture slot 'arg'.
+    kSave,
+    // Continues only if the assertion 'arg' holds at the current offset.
+    kAssert,
+    kMatch,
+  };
+
+  struct Inst {
+    Opcode opcode;
+    int arg;
+    int target;
+    int alternative;
+  };
+
+  LinearRegex() {}
+
+  // Appends the instructions of 'node' to the program. Returns false if the
+  // program gets too large.
+  bool Emit(const Node& node);
+  int Push(Opcode opcode, int arg);
+  void SetSplit(int pc, int preferred, int other, bool greedy);
+
+  // Adds the threads at 'pc' and the instructions it leads to without
+  // consuming input to 'list', in priority order.
+  void AddThread(const char* input, int input_size, int pc, int offset,
+                 int codepoint_offset, int* captures,
+                 Workspace::ThreadList* list, Workspace* workspace) const;
+
+  std::vector<Inst> program_;
+  std::vector<CharClass> classes_;
+  int num_groups_ = 0;
+
+  // Whether the pattern starts with '^', outside of any alternation.
+  bool starts_with_line_start_ = false;
+};
+
+}  // namespace libtextclassifier2
+
+#endif  // LIBTEXTCLASSIFIER_UTIL_UTF8_LINEAR_REGEX_H_
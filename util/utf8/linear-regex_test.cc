@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "util/utf8/linear-regex.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "unicode/regex.h"
+#include "unicode/unistr.h"
+
+namespace libtextclassifier2 {
+namespace {
+
+// The codepoint spans of the groups of each match, in order.
+using Matches = std::vector<std::vector<std::pair<int, int>>>;
+
+std::unique_ptr<const LinearRegex> Compile(const std::string& pattern) {
+  return LinearRegex::Compile(UTF8ToUnicodeText(pattern, /*do_copy=*/false));
+}
+
+Matches FindAllLinear(const LinearRegex& regex, const std::string& input) {
+  Matches result;
+  LinearRegex::Workspace workspace;
+  std::vector<LinearRegex::GroupSpan> groups;
+  int start = 0;
+  int start_codepoint = 0;
+  while (start <= input.size() &&
+         regex.Search(input.data(), input.size(), start, start_codepoint,
+                      /*full_match=*/false, &workspace, &groups)) {
+    result.emplace_back();
+    for (const LinearRegex::GroupSpan& group : groups) {
+      result.back().push_back({group.start_codepoint, group.end_codepoint});
+    }
+    start = groups[0].end;
+    start_codepoint = groups[0].end_codepoint;
+    if (groups[0].start == groups[0].end) {
+      // Steps over the codepoint after an empty match.
+      if (start == input.size()) {
+        break;
+      }
+      start += UTF8ToUnicodeText(input.data() + start, input.size() - start,
+                                 /*do_copy=*/false)
+                   .begin()
+                   .utf8_length();
+      ++start_codepoint;
+    }
+  }
+  return result;
+}
+
+Matches FindAllIcu(const std::string& pattern, const std::string& input) {
+  UErrorCode status = U_ZERO_ERROR;
+  const icu::UnicodeString text = icu::UnicodeString::fromUTF8(input);
+  std::unique_ptr<icu::RegexMatcher> matcher(
+      new icu::RegexMatcher(icu::UnicodeString::fromUTF8(pattern), text,
+                            UREGEX_MULTILINE, status));
+  EXPECT_TRUE(U_SUCCESS(status)) << pattern;
+  Matches result;
+  while (U_SUCCESS(status) && matcher->find(status)) {
+    result.emplace_back();
+    for (int i = 0; i <= matcher->groupCount(); ++i) {
+      const int start = matcher->start(i, status);
+      const int end = matcher->end(i, status);
+      if (start < 0) {
+        result.back().push_back({-1, -1});
+      } else {
+        result.back().push_back(
+            {text.countChar32(0, start), text.countChar32(0, end)});
+      }
+    }
+  }
+  return result;
+}
+
+// The codepoint spans of the groups of the full match, if any.
+std::vector<std::pair<int, int>> FullMatchIcu(const std::string& pattern,
+                                              const std::string& input) {
+  UErrorCode status = U_ZERO_ERROR;
+  const icu::UnicodeString text = icu::UnicodeString::fromUTF8(input);
+  icu::RegexMatcher matcher(icu::UnicodeString::fromUTF8(pattern), text,
+                            UREGEX_MULTILINE, status);
+  std::vector<std::pair<int, int>> result;
+  if (matcher.matches(status)) {
+    for (int i = 0; i <= matcher.groupCount(); ++i) {
+      const int start = matcher.start(i, status);
+      const int end = matcher.end(i, status);
+      if (start < 0) {
+        result.push_back({-1, -1});
+      } else {
+        result.push_back(
+            {text.countChar32(0, start), text.countChar32(0, end)});
+      }
+    }
+  }
+  return result;
+}
+
+std::vector<std::pair<int, int>> FullMatchLinear(const LinearRegex& regex,
+                                                 const std::string& input) {
+  LinearRegex::Workspace workspace;
+  std::vector<LinearRegex::GroupSpan> groups;
+  std::vector<std::pair<int, int>> result;
+  if (regex.Search(input.data(), input.size(), /*start=*/0,
+                   /*start_codepoint=*/0, /*full_match=*/true, &workspace,
+                   &groups)) {
+    for (const LinearRegex::GroupSpan& group : groups) {
+      result.push_back({group.start_codepoint, group.end_codepoint});
+    }
+  }
+  return result;
+}
+
+TEST(LinearRegexTest, RejectsUnsupportedSyntax) {
+  for (const char* pattern :
+       {"(a)\\1", "a(?=b)", "a(?!b)", "(?<=a)b", "(?i)a", "a*+", "a++",
+        "(a*)*", "(a?)+", "(|a)+", "(\\b)*", "\\Qa\\E", "\\Z", "\\X", "\\R",
+        "[[a]]", "[a&&b]", "[a--b]", "[[:alpha:]]", "a**", "*a", "a{2,1}",
+        "a{", "(a", "a)", "[a", "\\p{NotAProperty}", "(?<n>a)(?<n>b)",
+        "a{1001}", "\\k<n>"}) {
+    EXPECT_EQ(Compile(pattern), nullptr) << pattern;
+  }
+}
+
+TEST(LinearRegexTest, CapturesCodepointOffsets) {
+  const std::unique_ptr<const LinearRegex> regex =
+      Compile("(?<day>\\d+)\\.(\\d+)(?:\\.(\\d{4}))?");
+  ASSERT_NE(regex, nullptr);
+  EXPECT_EQ(regex->num_groups(), 3);
+  const std::string input = "Dne 6.12.2018 a dne 7.1.";
+  EXPECT_EQ(FindAllLinear(*regex, input),
+            FindAllIcu("(?<day>\\d+)\\.(\\d+)(?:\\.(\\d{4}))?", input));
+
+  LinearRegex::Workspace workspace;
+  std::vector<LinearRegex::GroupSpan> groups;
+  const std::string date = "Čas 12.10.2018";
+  ASSERT_TRUE(regex->Search(date.data(), date.size(), /*start=*/0,
+                            /*start_codepoint=*/0, /*full_match=*/false,
+                            &workspace, &groups));
+  ASSERT_EQ(groups.size(), 4);
+  EXPECT_EQ(groups[0].start, 5);
+  EXPECT_EQ(groups[0].start_codepoint, 4);
+  EXPECT_EQ(groups[3].end, date.size());
+  EXPECT_EQ(groups[3].end_codepoint, 14);
+}
+
+TEST(LinearRegexTest, FullMatch) {
+  const std::unique_ptr<const LinearRegex> regex = Compile("a+|a+b");
+  ASSERT_NE(regex, nullptr);
+  LinearRegex::Workspace workspace;
+  std::vector<LinearRegex::GroupSpan> groups;
+  const std::string input = "aab";
+  EXPECT_TRUE(regex->Search(input.data(), input.size(), /*start=*/0,
+                            /*start_codepoint=*/0, /*full_match=*/true,
+                            &workspace, &groups));
+  EXPECT_EQ(groups[0].end, 3);
+  EXPECT_TRUE(regex->Search(input.data(), input.size(), /*start=*/0,
+                            /*start_codepoint=*/0, /*full_match=*/false,
+                            &workspace, &groups));
+  EXPECT_EQ(groups[0].end, 2);
+  EXPECT_TRUE(regex->Search(input.data(), input.size(), /*start=*/1,
+                            /*start_codepoint=*/1, /*full_match=*/true,
+                            &workspace, &groups));
+  EXPECT_EQ(groups[0].start, 1);
+  const std::string longer_input = "aabc";
+  EXPECT_FALSE(regex->Search(longer_input.data(), longer_input.size(),
+                             /*start=*/0, /*start_codepoint=*/0,
+                             /*full_match=*/true, &workspace, &groups));
+}
+
+TEST(LinearRegexTest, LinearInThePathologicalCases) {
+  const std::unique_ptr<const LinearRegex> regex = Compile("(a+)+$");
+  // Nested unbounded repeats of a non-nullable body are supported.
+  ASSERT_NE(regex, nullptr);
+  const std::string input = std::string(100000, 'a') + "b";
+  LinearRegex::Workspace workspace;
+  std::vector<LinearRegex::GroupSpan> groups;
+  EXPECT_FALSE(regex->Search(input.data(), input.size(), /*start=*/0,
+                             /*start_codepoint=*/0, /*full_match=*/false,
+                             &workspace, &groups));
+}
+
+TEST(LinearRegexTest, FindsWhatIcuFinds) {
+  const std::vector<std::string> patterns = {
+      "a",
+      "abc",
+      "a|ab|abc",
+      "ab|a",
+      "a*",
+      "a*?",
+      "a+?b",
+      "(a|b)*c",
+      "(?:(a)|b)+",
+      "(a)|(b)",
+      "x?y??",
+      "a{2}",
+      "a{2,}",
+      "a{1,3}",
+      "a{1,3}?",
+      "(a{0,2})",
+      "(ab){1,2}",
+      ".",
+      ".+",
+      "^",
+      "$",
+      "^a",
+      "(?:x|^)l",
+      "(^l)",
+      "a|^",
+      "(?:^)",
+      "^|a",
+      "\\b^",
+      "^\\b",
+      "(?:^f|l)",
+      "^\\s",
+      "(?:x|^)\\n",
+      "(^\\n)",
+      "(?:^|x)\\n",
+      "a$",
+      "^.*$",
+      "^$",
+      "\\Aa",
+      "a\\z",
+      "\\b",
+      "\\B",
+      "\\bfoo\\b",
+      "\\w+",
+      "\\W+",
+      "\\d+",
+      "\\D",
+      "\\s+",
+      "\\S+",
+      "[a-c]+",
+      "[^a-c]+",
+      "[-a]",
+      "[a-]",
+      "[\\d.]+",
+      "[^\\s]+",
+      "[\\p{L}\\-]+",
+      "\\p{Lu}\\p{Ll}*",
+      "\\P{L}+",
+      "[\\u00e0-\\u00ff]",
+      "\\x{1F600}",
+      "\\x41",
+      "\\.",
+      "\\t|\\n|\\r",
+      "(\\d{1,2})[./](\\d{1,2})[./](\\d{2,4})",
+      "(?<hour>\\d{1,2}):(?<minute>\\d{2})(?:\\s*(am|pm))?",
+      "(?:[A-Za-z0-9._%+-]+)@(?:[A-Za-z0-9.-]+)\\.[A-Za-z]{2,}",
+      "\\+?\\d[\\d\\s()-]{6,}\\d",
+      "(a|ab)(c|bcd)(d*)",
+      "((a)|b)*?c",
+      "(a*)b",
+      " ",
+      "é+",
+      "[a-z ]+",
+      "(a|b)+",
+      "(\\w+)\\s(\\w+)",
+      "((a|b)(c)?)+",
+      "[\\$]",
+      "कि",
+  };
+  const std::vector<std::string> inputs = {
+      "",
+      "a",
+      "aa",
+      "abc",
+      "aaab abcd bcd",
+      "abcabcbb cab",
+      "xyy xy y",
+      "foo bar,foo_bar foo-bar",
+      "line\nline\r\nfoo\r\rbar\n",
+      "\n\n",
+      "Call +41 44 668 18 00 or mail a.b@c.com at 10:30 pm",
+      "Přijedu 12.10.2018 nebo 1/2/19 éé café",
+      "Àbç x́y किक \U0001F600 ​ a­b",
+      "aaaa",
+      "abab",
+      "ab ac",
+      "a$b",
+      "A B C\u0085D",
+      "\t1 2 3　٤",
+  };
+  for (const std::string& pattern : patterns) {
+    const std::unique_ptr<const LinearRegex> regex = Compile(pattern);
+    ASSERT_NE(regex, nullptr) << pattern;
+    for (const std::string& input : inputs) {
+      EXPECT_EQ(FindAllLinear(*regex, input), FindAllIcu(pattern, input))
+          << "pattern: " << pattern << ", input: " << input;
+      EXPECT_EQ(FullMatchLinear(*regex, input), FullMatchIcu(pattern, input))
+          << "pattern: " << pattern << ", input: " << input;
+    }
+  }
+}
+
+}  // namespace
+}  // namespace libtextclassifier2
@@ -128,57 +128,9 @@ const char* UnicodeText::data() const { return repr_.data_; }
 
 int UnicodeText::size_bytes() const { return repr_.size_; }
 
-namespace {
-
-enum {
-  RuneError = 0xFFFD,  // Decoding error in UTF.
-  RuneMax = 0x10FFFF,  // Maximum rune value.
-};
-
-int runetochar(const char32 rune, char* dest) {
-  // Convert to unsigned for range check.
-  uint32 c;
-
-  // 1 char 00-7F
-  c = rune;
-  if (c <= 0x7F) {
-    dest[0] = static_cast<char>(c);
-    return 1;
-  }
-
-  // 2 char 0080-07FF
-  if (c <= 0x07FF) {
-    dest[0] = 0xC0 | static_cast<char>(c >> 1 * 6);
-    dest[1] = 0x80 | (c & 0x3F);
-    return 2;
-  }
-
-  // Range check
-  if (c > RuneMax) {
-    c = RuneError;
-  }
-
-  // 3 char 0800-FFFF
-  if (c <= 0xFFFF) {
-    dest[0] = 0xE0 | static_cast<char>(c >> 2 * 6);
-    dest[1] = 0x80 | ((c >> 1 * 6) & 0x3F);
-    dest[2] = 0x80 | (c & 0x3F);
-    return 3;
-  }
-
-  // 4 char 10000-1FFFFF
-  dest[0] = 0xF0 | static_cast<char>(c >> 3 * 6);
-  dest[1] = 0x80 | ((c >> 2 * 6) & 0x3F);
-  dest[2] = 0x80 | ((c >> 1 * 6) & 0x3F);
-  dest[3] = 0x80 | (c & 0x3F);
-  return 4;
-}
-
-}  // namespace
-
 UnicodeText& UnicodeText::AppendCodepoint(char32 ch) {
   char str[4];
-  int char_len = runetochar(ch, str);
+  int char_len = EncodeAsUTF8Char(ch, str);
   repr_.append(str, char_len);
   return *this;
 }
@@ -186,7 +138,11 @@ UnicodeText& UnicodeText::AppendCodepoint(char32 ch) {
 void UnicodeText::clear() { repr_.clear(); }
 
 int UnicodeText::size_codepoints() const {
-  return std::distance(begin(), end());
+  return CountUTF8Codepoints(repr_.data_, repr_.size_);
+}
+
+bool UnicodeText::is_ascii() const {
+  return IsAsciiUTF8(repr_.data_, repr_.size_);
 }
 
 bool UnicodeText::empty() const { return size_bytes() == 0; }
@@ -274,6 +230,39 @@ UnicodeText::const_iterator& UnicodeText::const_iterator::operator--() {
   return *this;
 }
 
+UnicodeTextIndex::UnicodeTextIndex(const UnicodeText& text)
+    : text_(text), size_codepoints_(0), is_ascii_(text.is_ascii()) {
+  if (is_ascii_) {
+    size_codepoints_ = text.size_bytes();
+    return;
+  }
+  sampled_byte_offsets_.reserve(text.size_bytes() / kSampleRate + 1);
+  for (auto it = text.begin(); it != text.end(); ++it, ++size_codepoints_) {
+    if (size_codepoints_ % kSampleRate == 0) {
+      sampled_byte_offsets_.push_back(it.utf8_data() - text.data());
+    }
+  }
+}
+
+UnicodeText::const_iterator UnicodeTextIndex::IteratorAt(
+    int codepoint_index) const {
+  if (codepoint_index <= 0) {
+    return text_.begin();
+  }
+  if (codepoint_index >= size_codepoints_) {
+    return text_.end();
+  }
+  if (is_ascii_) {
+    return UnicodeText::const_iterator(text_.data() + codepoint_index);
+  }
+  UnicodeText::const_iterator it(
+      text_.data() + sampled_byte_offsets_[codepoint_index / kSampleRate]);
+  for (int i = codepoint_index % kSampleRate; i > 0; --i) {
+    ++it;
+  }
+  return it;
+}
+
 UnicodeText UTF8ToUnicodeText(const char* utf8_buf, int len, bool do_copy) {
   UnicodeText t;
   if (do_copy) {
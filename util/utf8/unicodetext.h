@@ -20,6 +20,7 @@
 #include <iterator>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "util/base/integral_types.h"
 
@@ -119,11 +120,12 @@ class UnicodeText {
     }
 
     int utf8_length() const {
-      if (it_[0] < 0x80) {
+      const unsigned char lead = static_cast<unsigned char>(it_[0]);
+      if (lead < 0x80) {
         return 1;
-      } else if (it_[0] < 0xE0) {
+      } else if (lead < 0xE0) {
         return 2;
-      } else if (it_[0] < 0xF0) {
+      } else if (lead < 0xF0) {
         return 3;
       } else {
         return 4;
@@ -133,6 +135,7 @@ class UnicodeText {
 
    private:
     friend class UnicodeText;
+    friend class UnicodeTextIndex;
     explicit const_iterator(const char* it) : it_(it) {}
 
     const char* it_;
@@ -152,6 +155,11 @@ class UnicodeText {
   // NOTE: Complexity O(n).
   int size_codepoints() const;
 
+  // Checks whether the text is all ASCII, i.e. its codepoint offsets are its
+  // byte offsets.
+  // NOTE: Complexity O(n).
+  bool is_ascii() const;
+
   bool empty() const;
 
   // Checks whether the underlying data is valid utf8 data.
@@ -210,6 +218,36 @@ class UnicodeText {
 typedef std::pair<UnicodeText::const_iterator, UnicodeText::const_iterator>
     UnicodeTextRange;
 
+// Random access to the codepoints of a UnicodeText by their codepoint index.
+// The byte offset of every kSampleRate-th codepoint is recorded in one pass
+// over the text, so that getting the iterator of an index takes fewer than
+// kSampleRate steps, instead of a scan from the beginning of the text. ASCII
+// texts need no offsets, as the codepoint indices are the byte offsets.
+// The index must not outlive the text, and is invalidated by changes to it.
+class UnicodeTextIndex {
+ public:
+  explicit UnicodeTextIndex(const UnicodeText& text);
+
+  const UnicodeText& text() const { return text_; }
+
+  // Number of codepoints of the text. NOTE: Complexity O(1).
+  int size_codepoints() const { return size_codepoints_; }
+
+  // Returns the iterator pointing to the codepoint with the given index. The
+  // indices are clamped to [0, size_codepoints()], the latter giving end().
+  UnicodeText::const_iterator IteratorAt(int codepoint_index) const;
+
+ private:
+  static const int kSampleRate = 16;
+
+  const UnicodeText& text_;
+  int size_codepoints_;
+  bool is_ascii_;
+
+  // Byte offsets of the codepoints 0, kSampleRate, 2 * kSampleRate, ...
+  std::vector<int> sampled_byte_offsets_;
+};
+
 // NOTE: The following are needed to avoid implicit conversion from char* to
 // std::string, or from ::string to std::string, because if this happens it
 // often results in invalid memory access to a temporary object created during
@@ -85,6 +85,28 @@ TEST(UnicodeTextTest, Validation) {
   EXPECT_FALSE(
       UTF8ToUnicodeText("hello \xf0\x9f\x98\x61\x61 world1", /*do_copy=*/false)
           .is_valid());
+  // Invalid after a long ASCII prefix, and '\0' within one.
+  EXPECT_FALSE(UTF8ToUnicodeText("a long ascii prefix \xf0\x9f",
+                                 /*do_copy=*/false)
+                   .is_valid());
+  EXPECT_FALSE(UTF8ToUnicodeText(std::string("0123\0 56789", 11),
+                                 /*do_copy=*/false)
+                   .is_valid());
+}
+
+TEST(UnicodeTextTest, CountsCodepoints) {
+  for (const std::string& text :
+       {std::string(""), std::string("abc"), std::string("this is a test"),
+        std::string("this is a test😋😋😋"),
+        std::string("\u304A\u00B0\u106B"),
+        std::string("1234😋hello, and some more text to count 😋")}) {
+    const UnicodeText unicode = UTF8ToUnicodeText(text, /*do_copy=*/false);
+    EXPECT_EQ(unicode.size_codepoints(),
+              std::distance(unicode.begin(), unicode.end()))
+        << text;
+    EXPECT_EQ(unicode.is_ascii(), unicode.size_codepoints() == text.size())
+        << text;
+  }
 }
 
 class IteratorTest : public UnicodeTextTest {};
@@ -169,6 +191,37 @@ TEST_F(IteratorTest, Distance) {
   EXPECT_EQ(0, std::distance(iter, text_.end()));
 }
 
+TEST_F(IteratorTest, Index) {
+  const UnicodeTextIndex index(text_);
+  EXPECT_EQ(5, index.size_codepoints());
+  EXPECT_TRUE(index.IteratorAt(0) == text_.begin());
+  EXPECT_EQ(0x1D11E, *index.IteratorAt(4));
+  EXPECT_TRUE(index.IteratorAt(5) == text_.end());
+  EXPECT_TRUE(index.IteratorAt(-1) == text_.begin());
+  EXPECT_TRUE(index.IteratorAt(6) == text_.end());
+
+  // Indices between and beyond the sampled codepoints.
+  UnicodeText long_text;
+  for (int i = 0; i < 100; ++i) {
+    long_text.AppendCodepoint(i % 3 == 0 ? 0x1C0 + i : 'a' + i % 26);
+  }
+  const UnicodeTextIndex long_index(long_text);
+  EXPECT_EQ(100, long_index.size_codepoints());
+  UnicodeText::const_iterator it = long_text.begin();
+  for (int i = 0; i < 100; ++i, ++it) {
+    EXPECT_TRUE(long_index.IteratorAt(i) == it) << i;
+  }
+  EXPECT_TRUE(long_index.IteratorAt(100) == long_text.end());
+
+  // ASCII texts are indexed by their bytes.
+  const UnicodeText ascii_text =
+      UTF8ToUnicodeText("an ascii text", /*do_copy=*/false);
+  const UnicodeTextIndex ascii_index(ascii_text);
+  EXPECT_EQ(13, ascii_index.size_codepoints());
+  EXPECT_EQ('t', *ascii_index.IteratorAt(9));
+  EXPECT_TRUE(ascii_index.IteratorAt(13) == ascii_text.end());
+}
+
 class OperatorTest : public UnicodeTextTest {};
 
 TEST_F(OperatorTest, Clear) {
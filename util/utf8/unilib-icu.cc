@@ -16,8 +16,11 @@
 
 #include "util/utf8/unilib-icu.h"
 
+#include <algorithm>
 #include <utility>
 
+#include "util/strings/utf8.h"
+
 namespace libtextclassifier2 {
 
 bool UniLib::ParseInt32(const UnicodeText& text, int* result) const {
@@ -40,54 +43,273 @@ bool UniLib::ParseInt32(const UnicodeText& text, int* result) const {
   return true;
 }
 
-bool UniLib::IsOpeningBracket(char32 codepoint) const {
+// Generated from u_isWhitespace, u_isdigit, u_isupper and the bidi paired
+// bracket type of ICU.
+const uint8 UniLib::kLatin1Properties[256] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 0x00
+    0x00, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00,  // 0x08
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 0x10
+    0x00, 0x00, 0x00, 0x00, 0x01, 0x01, 0x01, 0x01,  // 0x18
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 0x20
+    0x08, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 0x28
+    0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,  // 0x30
+    0x02, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 0x38
+    0x00, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,  // 0x40
+    0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,  // 0x48
+    0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,  // 0x50
+    0x04, 0x04, 0x04, 0x08, 0x00, 0x10, 0x00, 0x00,  // 0x58
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 0x60
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 0x68
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 0x70
+    0x00, 0x00, 0x00, 0x08, 0x00, 0x10, 0x00, 0x00,  // 0x78
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 0x80
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 0x88
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 0x90
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 0x98
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 0xA0
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 0xA8
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 0xB0
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 0xB8
+    0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,  // 0xC0
+    0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,  // 0xC8
+    0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00,  // 0xD0
+    0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00,  // 0xD8
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 0xE0
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 0xE8
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 0xF0
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 0xF8
+};
+
+bool UniLib::IsOpeningBracketIcu(char32 codepoint) const {
   return u_getIntPropertyValue(codepoint, UCHAR_BIDI_PAIRED_BRACKET_TYPE) ==
          U_BPT_OPEN;
 }
 
-bool UniLib::IsClosingBracket(char32 codepoint) const {
+bool UniLib::IsClosingBracketIcu(char32 codepoint) const {
   return u_getIntPropertyValue(codepoint, UCHAR_BIDI_PAIRED_BRACKET_TYPE) ==
          U_BPT_CLOSE;
 }
 
-bool UniLib::IsWhitespace(char32 codepoint) const {
+bool UniLib::IsWhitespaceIcu(char32 codepoint) const {
   return u_isWhitespace(codepoint);
 }
 
-bool UniLib::IsDigit(char32 codepoint) const { return u_isdigit(codepoint); }
+bool UniLib::IsDigitIcu(char32 codepoint) const { return u_isdigit(codepoint); }
 
-bool UniLib::IsUpper(char32 codepoint) const { return u_isupper(codepoint); }
+bool UniLib::IsUpperIcu(char32 codepoint) const { return u_isupper(codepoint); }
 
-char32 UniLib::ToLower(char32 codepoint) const { return u_tolower(codepoint); }
+char32 UniLib::ToLowerIcu(char32 codepoint) const {
+  return u_tolower(codepoint);
+}
 
-char32 UniLib::GetPairedBracket(char32 codepoint) const {
+char32 UniLib::GetPairedBracketIcu(char32 codepoint) const {
   return u_getBidiPairedBracket(codepoint);
 }
 
-UniLib::RegexMatcher::RegexMatcher(icu::RegexPattern* pattern,
-                                   icu::UnicodeString text)
-    : text_(std::move(text)),
+UniLib::UTF16Text::UTF16Text(const UnicodeText& text)
+    : utf8_(text.data(), text.size_bytes()),
+      size_codepoints_(CountUTF8Codepoints(text.data(), text.size_bytes())) {}
+
+const UniLib::UTF16Text::Converted& UniLib::UTF16Text::utf16_text() const {
+  std::call_once(conversion_once_, [this]() {
+    converted_.text = icu::UnicodeString::fromUTF8(utf8_);
+    const int length = converted_.text.length();
+    const UChar* buffer = converted_.text.getBuffer();
+    converted_.codepoint_offsets.resize(length + 1);
+    converted_.utf8_offsets.resize(length + 1);
+    int num_codepoints = 0;
+    int num_bytes = 0;
+    for (int i = 0; i < length; ++i) {
+      converted_.codepoint_offsets[i] = num_codepoints;
+      converted_.utf8_offsets[i] = num_bytes;
+      // The second half of a surrogate pair does not start a codepoint.
+      if (!(U16_IS_TRAIL(buffer[i]) && i > 0 && U16_IS_LEAD(buffer[i - 1]))) {
+        ++num_codepoints;
+      }
+      // A surrogate pair is 4 bytes in UTF-8, counted 2 for each half.
+      if (buffer[i] < 0x80) {
+        num_bytes += 1;
+      } else if (buffer[i] < 0x800 || U16_IS_SURROGATE(buffer[i])) {
+        num_bytes += 2;
+      } else {
+        num_bytes += 3;
+      }
+    }
+    converted_.codepoint_offsets[length] = num_codepoints;
+    converted_.utf8_offsets[length] = num_bytes;
+
+    // Each replacement character takes at least as many bytes as the invalid
+    // UTF-8 that it replaced, so the sizes only match if all offsets do.
+    if (num_bytes != utf8_.size()) {
+      converted_.utf8_offsets.clear();
+      converted_.utf8_offsets.shrink_to_fit();
+    }
+  });
+  return converted_;
+}
+
+UniLib::RegexMatcher::RegexMatcher(const RegexPattern* pattern,
+                                   const UnicodeText& text)
+    : num_limit_hits_(pattern->num_limit_hits_),
+      text_(&owned_text_),
+      input_(nullptr),
       last_find_offset_(0),
       last_find_offset_codepoints_(0),
-      last_find_offset_dirty_(true) {
+      last_find_offset_dirty_(true),
+      linear_regex_(pattern->linear_regex_.get()),
+      utf8_(&owned_utf8_),
+      linear_search_failed_(false) {
+  if (linear_regex_ != nullptr) {
+    owned_utf8_.assign(text.data(), text.size_bytes());
+    return;
+  }
+  owned_text_ = icu::UnicodeString::fromUTF8(
+      icu::StringPiece(text.data(), text.size_bytes()));
+  CreateMatcher(pattern);
+}
+
+UniLib::RegexMatcher::RegexMatcher(const RegexPattern* pattern,
+                                   const UTF16Text& input)
+    : num_limit_hits_(pattern->num_limit_hits_),
+      text_(nullptr),
+      input_(&input),
+      last_find_offset_(0),
+      last_find_offset_codepoints_(0),
+      last_find_offset_dirty_(true),
+      linear_regex_(pattern->linear_regex_.get()),
+      utf8_(&input.utf8_),
+      linear_search_failed_(false) {
+  if (linear_regex_ != nullptr) {
+    return;
+  }
+  text_ = &input.utf16_text().text;
+  CreateMatcher(pattern);
+}
+
+void UniLib::RegexMatcher::CreateMatcher(const RegexPattern* pattern) {
   UErrorCode status = U_ZERO_ERROR;
-  matcher_.reset(pattern->matcher(text_, status));
+  matcher_.reset(pattern->pattern_->matcher(*text_, status));
+  // The limits are kept by the ICU matcher when it is reset to another text.
+  if (U_SUCCESS(status) && pattern->limits_.time_limit > 0) {
+    matcher_->setTimeLimit(pattern->limits_.time_limit, status);
+  }
+  if (U_SUCCESS(status) && pattern->limits_.stack_limit_bytes > 0) {
+    matcher_->setStackLimit(pattern->limits_.stack_limit_bytes, status);
+  }
   if (U_FAILURE(status)) {
     matcher_.reset(nullptr);
   }
 }
 
+void UniLib::RegexMatcher::RecordFailure(UErrorCode icu_status) const {
+  if (num_limit_hits_ != nullptr && (icu_status == U_REGEX_TIME_OUT ||
+                                    icu_status == U_REGEX_STACK_OVERFLOW)) {
+    num_limit_hits_->fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
 std::unique_ptr<UniLib::RegexMatcher> UniLib::RegexPattern::Matcher(
     const UnicodeText& input) const {
-  return std::unique_ptr<UniLib::RegexMatcher>(new UniLib::RegexMatcher(
-      pattern_.get(), icu::UnicodeString::fromUTF8(
-                          icu::StringPiece(input.data(), input.size_bytes()))));
+  return std::unique_ptr<UniLib::RegexMatcher>(
+      new UniLib::RegexMatcher(this, input));
+}
+
+std::unique_ptr<UniLib::RegexMatcher> UniLib::RegexPattern::Matcher(
+    const UTF16Text& input) const {
+  return std::unique_ptr<UniLib::RegexMatcher>(
+      new UniLib::RegexMatcher(this, input));
+}
+
+constexpr int UniLib::RegexPattern::kMaxPooledMatchers;
+
+UniLib::RegexPattern::ScopedMatcher UniLib::RegexPattern::AcquireMatcher(
+    const UTF16Text& input) const {
+  std::unique_ptr<RegexMatcher> matcher;
+  {
+    std::lock_guard<std::mutex> lock(matcher_pool_mutex_);
+    if (!matcher_pool_.empty()) {
+      matcher = std::move(matcher_pool_.back());
+      matcher_pool_.pop_back();
+    }
+  }
+  if (matcher) {
+    matcher->Reset(&input);
+  } else {
+    matcher = Matcher(input);
+  }
+  return ScopedMatcher(this, std::move(matcher));
+}
+
+void UniLib::RegexPattern::ReleaseMatcher(
+    std::unique_ptr<RegexMatcher> matcher) const {
+  if (!matcher || (!matcher->matcher_ && matcher->linear_regex_ == nullptr)) {
+    return;
+  }
+  // Do not keep a reference to the input, which can go away.
+  matcher->Reset(/*input=*/nullptr);
+  std::lock_guard<std::mutex> lock(matcher_pool_mutex_);
+  if (matcher_pool_.size() < kMaxPooledMatchers) {
+    matcher_pool_.push_back(std::move(matcher));
+  }
+}
+
+void UniLib::RegexPattern::ClearMatcherPool() const {
+  std::lock_guard<std::mutex> lock(matcher_pool_mutex_);
+  matcher_pool_.clear();
+}
+
+int64 UniLib::RegexPattern::EstimateHeapBytes() const {
+  // ICU compiles a pattern to a few 32-bit ops per UTF-16 unit, and keeps the
+  // pattern text and sets for the character classes besides.
+  static const int kIcuBytesPerPatternUnit = 32;
+  int64 result = 0;
+  if (linear_regex_ != nullptr) {
+    result += sizeof(LinearRegex) + linear_regex_->EstimateHeapBytes();
+  } else {
+    result += sizeof(icu::RegexPattern) +
+              kIcuBytesPerPatternUnit * pattern_->pattern().length();
+  }
+  std::lock_guard<std::mutex> lock(matcher_pool_mutex_);
+  for (const std::unique_ptr<RegexMatcher>& matcher : matcher_pool_) {
+    result += sizeof(RegexMatcher) + matcher->EstimateHeapBytes();
+  }
+  return result;
+}
+
+int64 UniLib::RegexMatcher::EstimateHeapBytes() const {
+  int64 result = linear_groups_.capacity() * sizeof(LinearRegex::GroupSpan) +
+                 linear_workspace_.EstimateHeapBytes();
+  if (matcher_ != nullptr) {
+    // Without the backtracking stack, which ICU grows on demand.
+    result += sizeof(icu::RegexMatcher);
+  }
+  return result;
+}
+
+void UniLib::RegexMatcher::Reset(const UTF16Text* input) {
+  input_ = input;
+  last_find_offset_ = 0;
+  last_find_offset_codepoints_ = 0;
+  last_find_offset_dirty_ = true;
+  owned_utf8_.clear();
+  utf8_ = input != nullptr ? &input->utf8_ : &owned_utf8_;
+  if (linear_regex_ != nullptr) {
+    linear_groups_.clear();
+    linear_search_failed_ = false;
+    return;
+  }
+  owned_text_.remove();
+  text_ = input != nullptr ? &input->utf16_text().text : &owned_text_;
+  matcher_->reset(*text_);
 }
 
 constexpr int UniLib::RegexMatcher::kError;
 constexpr int UniLib::RegexMatcher::kNoError;
 
 bool UniLib::RegexMatcher::Matches(int* status) const {
+  if (linear_regex_ != nullptr) {
+    return LinearMatches(status);
+  }
   if (!matcher_) {
     *status = kError;
     return false;
@@ -96,6 +318,7 @@ bool UniLib::RegexMatcher::Matches(int* status) const {
   UErrorCode icu_status = U_ZERO_ERROR;
   const bool result = matcher_->matches(/*startIndex=*/0, icu_status);
   if (U_FAILURE(icu_status)) {
+    RecordFailure(icu_status);
     *status = kError;
     return false;
   }
@@ -104,12 +327,15 @@ bool UniLib::RegexMatcher::Matches(int* status) const {
 }
 
 bool UniLib::RegexMatcher::ApproximatelyMatches(int* status) {
-  if (!matcher_) {
+  if (linear_regex_ != nullptr) {
+    linear_groups_.clear();
+    linear_search_failed_ = false;
+  } else if (!matcher_) {
     *status = kError;
     return false;
+  } else {
+    matcher_->reset();
   }
-
-  matcher_->reset();
   *status = kNoError;
   if (!Find(status) || *status != kNoError) {
     return false;
@@ -122,7 +348,15 @@ bool UniLib::RegexMatcher::ApproximatelyMatches(int* status) {
   if (*status != kNoError) {
     return false;
   }
-  if (found_start != 0 || found_end != text_.countChar32()) {
+  int num_codepoints;
+  if (input_ != nullptr) {
+    num_codepoints = input_->size_codepoints();
+  } else if (linear_regex_ != nullptr) {
+    num_codepoints = CountUTF8Codepoints(utf8_->data(), utf8_->size());
+  } else {
+    num_codepoints = text_->countChar32();
+  }
+  if (found_start != 0 || found_end != num_codepoints) {
     return false;
   }
   return true;
@@ -139,8 +373,11 @@ bool UniLib::RegexMatcher::UpdateLastFindOffset() const {
   if (U_FAILURE(icu_status)) {
     return false;
   }
-  last_find_offset_codepoints_ +=
-      text_.countChar32(last_find_offset_, find_offset - last_find_offset_);
+  // With a shared input the offsets are looked up instead.
+  if (input_ == nullptr) {
+    last_find_offset_codepoints_ +=
+        text_->countChar32(last_find_offset_, find_offset - last_find_offset_);
+  }
   last_find_offset_ = find_offset;
   last_find_offset_dirty_ = false;
 
@@ -148,6 +385,9 @@ bool UniLib::RegexMatcher::UpdateLastFindOffset() const {
 }
 
 bool UniLib::RegexMatcher::Find(int* status) {
+  if (linear_regex_ != nullptr) {
+    return LinearFind(status);
+  }
   if (!matcher_) {
     *status = kError;
     return false;
@@ -155,6 +395,7 @@ bool UniLib::RegexMatcher::Find(int* status) {
   UErrorCode icu_status = U_ZERO_ERROR;
   const bool result = matcher_->find(icu_status);
   if (U_FAILURE(icu_status)) {
+    RecordFailure(icu_status);
     *status = kError;
     return false;
   }
@@ -169,6 +410,10 @@ int UniLib::RegexMatcher::Start(int* status) const {
 }
 
 int UniLib::RegexMatcher::Start(int group_idx, int* status) const {
+  if (linear_regex_ != nullptr) {
+    const LinearRegex::GroupSpan* group = LinearGroup(group_idx, status);
+    return group != nullptr ? group->start_codepoint : kError;
+  }
   if (!matcher_ || !UpdateLastFindOffset()) {
     *status = kError;
     return kError;
@@ -188,9 +433,12 @@ int UniLib::RegexMatcher::Start(int group_idx, int* status) const {
     return -1;
   }
 
+  if (input_ != nullptr) {
+    return input_->CodepointOffset(result);
+  }
   return last_find_offset_codepoints_ +
-         text_.countChar32(/*start=*/last_find_offset_,
-                           /*length=*/result - last_find_offset_);
+         text_->countChar32(/*start=*/last_find_offset_,
+                            /*length=*/result - last_find_offset_);
 }
 
 int UniLib::RegexMatcher::End(int* status) const {
@@ -198,6 +446,10 @@ int UniLib::RegexMatcher::End(int* status) const {
 }
 
 int UniLib::RegexMatcher::End(int group_idx, int* status) const {
+  if (linear_regex_ != nullptr) {
+    const LinearRegex::GroupSpan* group = LinearGroup(group_idx, status);
+    return group != nullptr ? group->end_codepoint : kError;
+  }
   if (!matcher_ || !UpdateLastFindOffset()) {
     *status = kError;
     return kError;
@@ -216,9 +468,12 @@ int UniLib::RegexMatcher::End(int group_idx, int* status) const {
     return -1;
   }
 
+  if (input_ != nullptr) {
+    return input_->CodepointOffset(result);
+  }
   return last_find_offset_codepoints_ +
-         text_.countChar32(/*start=*/last_find_offset_,
-                           /*length=*/result - last_find_offset_);
+         text_->countChar32(/*start=*/last_find_offset_,
+                            /*length=*/result - last_find_offset_);
 }
 
 UnicodeText UniLib::RegexMatcher::Group(int* status) const {
@@ -226,6 +481,14 @@ UnicodeText UniLib::RegexMatcher::Group(int* status) const {
 }
 
 UnicodeText UniLib::RegexMatcher::Group(int group_idx, int* status) const {
+  if (linear_regex_ != nullptr) {
+    const LinearRegex::GroupSpan* group = LinearGroup(group_idx, status);
+    if (group == nullptr || group->start < 0) {
+      return UTF8ToUnicodeText("", /*do_copy=*/false);
+    }
+    return UTF8ToUnicodeText(utf8_->data() + group->start,
+                             group->end - group->start, /*do_copy=*/true);
+  }
   if (!matcher_) {
     *status = kError;
     return UTF8ToUnicodeText("", /*do_copy=*/false);
@@ -242,36 +505,173 @@ UnicodeText UniLib::RegexMatcher::Group(int group_idx, int* status) const {
   return UTF8ToUnicodeText(result, /*do_copy=*/true);
 }
 
-constexpr int UniLib::BreakIterator::kDone;
+int UniLib::RegexMatcher::StartUTF8(int group_idx, int* status) const {
+  if (linear_regex_ != nullptr) {
+    const LinearRegex::GroupSpan* group = LinearGroup(group_idx, status);
+    return group != nullptr ? group->start : kError;
+  }
+  if (!matcher_ || input_ == nullptr ||
+      input_->utf16_text().utf8_offsets.empty()) {
+    *status = kError;
+    return kError;
+  }
+  UErrorCode icu_status = U_ZERO_ERROR;
+  const int result = matcher_->start(group_idx, icu_status);
+  if (U_FAILURE(icu_status)) {
+    *status = kError;
+    return kError;
+  }
+  *status = kNoError;
+  return result == -1 ? -1 : input_->utf16_text().utf8_offsets[result];
+}
+
+int UniLib::RegexMatcher::EndUTF8(int group_idx, int* status) const {
+  if (linear_regex_ != nullptr) {
+    const LinearRegex::GroupSpan* group = LinearGroup(group_idx, status);
+    return group != nullptr ? group->end : kError;
+  }
+  if (!matcher_ || input_ == nullptr ||
+      input_->utf16_text().utf8_offsets.empty()) {
+    *status = kError;
+    return kError;
+  }
+  UErrorCode icu_status = U_ZERO_ERROR;
+  const int result = matcher_->end(group_idx, icu_status);
+  if (U_FAILURE(icu_status)) {
+    *status = kError;
+    return kError;
+  }
+  *status = kNoError;
+  return result == -1 ? -1 : input_->utf16_text().utf8_offsets[result];
+}
+
+UnicodeText UniLib::RegexMatcher::GroupView(int group_idx, int* status) const {
+  const int start = StartUTF8(group_idx, status);
+  if (*status != kNoError) {
+    return Group(group_idx, status);
+  }
+  const int end = EndUTF8(group_idx, status);
+  if (*status != kNoError) {
+    return Group(group_idx, status);
+  }
+  if (start < 0) {
+    return UTF8ToUnicodeText("", /*do_copy=*/false);
+  }
+  return UTF8ToUnicodeText(utf8_->data() + start, end - start,
+                           /*do_copy=*/false);
+}
 
-UniLib::BreakIterator::BreakIterator(const UnicodeText& text)
-    : text_(icu::UnicodeString::fromUTF8(
-          icu::StringPiece(text.data(), text.size_bytes()))),
+bool UniLib::RegexMatcher::LinearMatches(int* status) const {
+  *status = kNoError;
+  linear_search_failed_ = false;
+  if (!linear_regex_->Search(utf8_->data(), utf8_->size(), /*start=*/0,
+                             /*start_codepoint=*/0, /*full_match=*/true,
+                             &linear_workspace_, &linear_groups_)) {
+    linear_groups_.clear();
+    return false;
+  }
+  return true;
+}
+
+bool UniLib::RegexMatcher::LinearFind(int* status) {
+  *status = kNoError;
+  int start = 0;
+  int start_codepoint = 0;
+  if (!linear_groups_.empty()) {
+    // Like ICU, continues at the end of the last match, or after the codepoint
+    // there if the match was empty.
+    const LinearRegex::GroupSpan& last_match = linear_groups_[0];
+    start = last_match.end;
+    start_codepoint = last_match.end_codepoint;
+    if (last_match.start == last_match.end) {
+      if (start >= utf8_->size()) {
+        linear_groups_.clear();
+        linear_search_failed_ = true;
+        return false;
+      }
+      start = std::min<int>(
+          start + GetNumBytesForNonZeroUTF8Char(utf8_->data() + start),
+          utf8_->size());
+      ++start_codepoint;
+    }
+  } else if (linear_search_failed_) {
+    return false;
+  }
+  if (!linear_regex_->Search(utf8_->data(), utf8_->size(), start,
+                             start_codepoint, /*full_match=*/false,
+                             &linear_workspace_, &linear_groups_)) {
+    linear_groups_.clear();
+    linear_search_failed_ = true;
+    return false;
+  }
+  return true;
+}
+
+const LinearRegex::GroupSpan* UniLib::RegexMatcher::LinearGroup(
+    int group_idx, int* status) const {
+  if (linear_groups_.empty() || group_idx < 0 ||
+      group_idx >= linear_groups_.size()) {
+    *status = kError;
+    return nullptr;
+  }
+  *status = kNoError;
+  return &linear_groups_[group_idx];
+}
+
+constexpr int UniLib::BreakIterator::kDone;
+constexpr int UniLib::kMaxBreakIteratorPrototypes;
+
+UniLib::BreakIterator::BreakIterator(
+    const UnicodeText& text,
+    std::unique_ptr<icu::BreakIterator> break_iterator)
+    : break_iterator_(std::move(break_iterator)),
+      text_data_(text.data()),
+      utext_(nullptr),
       last_break_index_(0),
       last_unicode_index_(0) {
-  icu::ErrorCode status;
-  break_iterator_.reset(
-      icu::BreakIterator::createWordInstance(icu::Locale("en"), status));
-  if (!status.isSuccess()) {
+  UErrorCode status = U_ZERO_ERROR;
+  utext_ = utext_openUTF8(nullptr, text.data(), text.size_bytes(), &status);
+  if (U_FAILURE(status)) {
+    utext_close(utext_);
+    utext_ = nullptr;
     break_iterator_.reset();
     return;
   }
-  break_iterator_->setText(text_);
+  break_iterator_->setText(utext_, status);
+  if (U_FAILURE(status)) {
+    break_iterator_.reset();
+  }
+}
+
+UniLib::BreakIterator::~BreakIterator() {
+  // The ICU iterator refers to the UText, so it has to go first.
+  break_iterator_.reset();
+  if (utext_ != nullptr) {
+    utext_close(utext_);
+  }
 }
 
 int UniLib::BreakIterator::Next() {
+  // The break indices are offsets into the UTF-8 text.
   const int break_index = break_iterator_->next();
   if (break_index == icu::BreakIterator::DONE) {
     return BreakIterator::kDone;
   }
   last_unicode_index_ +=
-      text_.countChar32(last_break_index_, break_index - last_break_index_);
+      CountUTF8Codepoints(text_data_ + last_break_index_,
+                          break_index - last_break_index_);
   last_break_index_ = break_index;
   return last_unicode_index_;
 }
 
 std::unique_ptr<UniLib::RegexPattern> UniLib::CreateRegexPattern(
-    const UnicodeText& regex) const {
+    const UnicodeText& regex, const RegexWorkLimits& limits) const {
+  std::unique_ptr<const LinearRegex> linear_regex = LinearRegex::Compile(regex);
+  if (linear_regex != nullptr) {
+    return std::unique_ptr<UniLib::RegexPattern>(
+        new UniLib::RegexPattern(/*pattern=*/nullptr, std::move(linear_regex),
+                                 limits, &num_regex_limit_hits_));
+  }
   UErrorCode status = U_ZERO_ERROR;
   std::unique_ptr<icu::RegexPattern> pattern(
       icu::RegexPattern::compile(icu::UnicodeString::fromUTF8(icu::StringPiece(
@@ -281,13 +681,50 @@ std::unique_ptr<UniLib::RegexPattern> UniLib::CreateRegexPattern(
     return nullptr;
   }
   return std::unique_ptr<UniLib::RegexPattern>(
-      new UniLib::RegexPattern(std::move(pattern)));
+      new UniLib::RegexPattern(std::move(pattern), /*linear_regex=*/nullptr,
+                               limits, &num_regex_limit_hits_));
+}
+
+std::unique_ptr<UniLib::UTF16Text> UniLib::CreateUTF16Text(
+    const UnicodeText& text) const {
+  return std::unique_ptr<UniLib::UTF16Text>(new UniLib::UTF16Text(text));
+}
+
+std::unique_ptr<UniLib::BreakIterator> UniLib::CreateBreakIterator(
+    const UnicodeText& text, const std::string& locale) const {
+  std::unique_ptr<icu::BreakIterator> break_iterator;
+  {
+    std::lock_guard<std::mutex> lock(break_iterator_prototypes_mutex_);
+    const auto it = break_iterator_prototypes_.find(locale);
+    if (it != break_iterator_prototypes_.end()) {
+      break_iterator.reset(it->second->clone());
+    }
+  }
+  if (!break_iterator) {
+    icu::ErrorCode status;
+    break_iterator.reset(icu::BreakIterator::createWordInstance(
+        icu::Locale::forLanguageTag(locale, status), status));
+    if (!status.isSuccess() || !break_iterator) {
+      return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(break_iterator_prototypes_mutex_);
+    if (break_iterator_prototypes_.size() < kMaxBreakIteratorPrototypes &&
+        break_iterator_prototypes_.find(locale) ==
+            break_iterator_prototypes_.end()) {
+      break_iterator_prototypes_[locale].reset(break_iterator->clone());
+    }
+  }
+  std::unique_ptr<UniLib::BreakIterator> result(
+      new UniLib::BreakIterator(text, std::move(break_iterator)));
+  if (!result->break_iterator_) {
+    return nullptr;
+  }
+  return result;
 }
 
 std::unique_ptr<UniLib::BreakIterator> UniLib::CreateBreakIterator(
     const UnicodeText& text) const {
-  return std::unique_ptr<UniLib::BreakIterator>(
-      new UniLib::BreakIterator(text));
+  return CreateBreakIterator(text, /*locale=*/"en");
 }
 
 }  // namespace libtextclassifier2
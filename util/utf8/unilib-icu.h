@@ -20,33 +20,135 @@
 #ifndef LIBTEXTCLASSIFIER_UTIL_UTF8_UNILIB_ICU_H_
 #define LIBTEXTCLASSIFIER_UTIL_UTF8_UNILIB_ICU_H_
 
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "util/base/integral_types.h"
+#include "util/utf8/linear-regex.h"
 #include "util/utf8/unicodetext.h"
 #include "unicode/brkiter.h"
 #include "unicode/errorcode.h"
 #include "unicode/regex.h"
 #include "unicode/uchar.h"
+#include "unicode/utext.h"
 #include "unicode/unum.h"
 
 namespace libtextclassifier2 {
 
+// Bounds on the work of the matches of a regex pattern, so that a pattern that
+// backtracks catastrophically on some input fails its match with
+// UniLib::RegexMatcher::kError instead of stalling the caller.
+struct RegexWorkLimits {
+  // In steps of the ICU match engine, which take on the order of a millisecond
+  // each. Zero means no limit.
+  int time_limit = 0;
+
+  // The maximum size of the backtracking stack, in bytes. Zero keeps the ICU
+  // default, 8MB.
+  int stack_limit_bytes = 0;
+};
+
 class UniLib {
  public:
   bool ParseInt32(const UnicodeText& text, int* result) const;
-  bool IsOpeningBracket(char32 codepoint) const;
-  bool IsClosingBracket(char32 codepoint) const;
-  bool IsWhitespace(char32 codepoint) const;
-  bool IsDigit(char32 codepoint) const;
-  bool IsUpper(char32 codepoint) const;
 
-  char32 ToLower(char32 codepoint) const;
-  char32 GetPairedBracket(char32 codepoint) const;
+  // The character predicates look the Latin-1 codepoints up in a table, and
+  // only call into ICU for the others.
+  bool IsOpeningBracket(char32 codepoint) const {
+    return IsLatin1(codepoint)
+               ? HasLatin1Property(codepoint, kLatin1OpeningBracket)
+               : IsOpeningBracketIcu(codepoint);
+  }
+  bool IsClosingBracket(char32 codepoint) const {
+    return IsLatin1(codepoint)
+               ? HasLatin1Property(codepoint, kLatin1ClosingBracket)
+               : IsClosingBracketIcu(codepoint);
+  }
+  bool IsWhitespace(char32 codepoint) const {
+    return IsLatin1(codepoint)
+               ? HasLatin1Property(codepoint, kLatin1Whitespace)
+               : IsWhitespaceIcu(codepoint);
+  }
+  bool IsDigit(char32 codepoint) const {
+    return IsLatin1(codepoint) ? HasLatin1Property(codepoint, kLatin1Digit)
+                               : IsDigitIcu(codepoint);
+  }
+  bool IsUpper(char32 codepoint) const {
+    return IsLatin1(codepoint) ? HasLatin1Property(codepoint, kLatin1Upper)
+                               : IsUpperIcu(codepoint);
+  }
+
+  char32 ToLower(char32 codepoint) const {
+    // The Latin-1 uppercase letters all have their lowercase 0x20 above.
+    if (IsLatin1(codepoint)) {
+      return HasLatin1Property(codepoint, kLatin1Upper) ? codepoint + 0x20
+                                                        : codepoint;
+    }
+    return ToLowerIcu(codepoint);
+  }
+  char32 GetPairedBracket(char32 codepoint) const {
+    // The Latin-1 brackets are "()", "[]" and "{}".
+    if (IsLatin1(codepoint)) {
+      if (HasLatin1Property(codepoint, kLatin1OpeningBracket)) {
+        return codepoint + (codepoint == '(' ? 1 : 2);
+      }
+      if (HasLatin1Property(codepoint, kLatin1ClosingBracket)) {
+        return codepoint - (codepoint == ')' ? 1 : 2);
+      }
+      return codepoint;
+    }
+    return GetPairedBracketIcu(codepoint);
+  }
 
   // Forward declaration for friend.
   class RegexPattern;
 
+  // Text shared by the matchers created on it. The ICU regex engine works on
+  // UTF-16, so the text is converted once, when the first matcher that runs on
+  // ICU needs it, instead of once per matcher. The UTF-16 offsets are indexed
+  // too, so that matchers can map them to codepoint offsets in constant time.
+  class UTF16Text {
+   public:
+    // Returns the length of the text in codepoints.
+    int size_codepoints() const { return size_codepoints_; }
+
+    // Returns the codepoint offset for the given UTF-16 offset in [0, length].
+    int CodepointOffset(int utf16_offset) const {
+      return utf16_text().codepoint_offsets[utf16_offset];
+    }
+
+   protected:
+    friend class UniLib;
+    explicit UTF16Text(const UnicodeText& text);
+
+   private:
+    friend class RegexPattern;
+    friend class RegexMatcher;
+
+    struct Converted {
+      icu::UnicodeString text;
+
+      // Number of codepoints starting before each UTF-16 offset.
+      std::vector<int> codepoint_offsets;
+
+      // The UTF-8 offset of each UTF-16 offset, or empty if the conversion
+      // replaced invalid UTF-8, after which the two don't line up.
+      std::vector<int> utf8_offsets;
+    };
+
+    // Converts the text on the first call. Thread-safe.
+    const Converted& utf16_text() const;
+
+    const std::string utf8_;
+    const int size_codepoints_;
+    mutable std::once_flag conversion_once_;
+    mutable Converted converted_;
+  };
+
   class RegexMatcher {
    public:
     static constexpr int kError = -1;
@@ -100,54 +202,242 @@ class UniLib {
     // was not called previously.
     UnicodeText Group(int group_idx, int* status) const;
 
+    // Gets the start and end offsets of the specified group of the last match
+    // (from 'Find') in the UTF-8 of the input text, in bytes. The offsets are
+    // -1 if the group didn't participate in the match.
+    // Sets status to 'kError' if an invalid group was specified, if 'Find' was
+    // not called previously, or if the matcher runs on ICU and was not created
+    // on a UTF16Text, which doesn't keep the UTF-8.
+    int StartUTF8(int group_idx, int* status) const;
+    int EndUTF8(int group_idx, int* status) const;
+
+    // Same as Group(), but points into the UTF-8 of the input text instead of
+    // copying the group out of it, so it is only valid as long as the input
+    // and until the matcher is reset or destroyed. Falls back to a copy if the
+    // UTF-8 offsets are not known.
+    UnicodeText GroupView(int group_idx, int* status) const;
+
    protected:
     friend class RegexPattern;
-    explicit RegexMatcher(icu::RegexPattern* pattern, icu::UnicodeString text);
+    explicit RegexMatcher(const RegexPattern* pattern, const UnicodeText& text);
+
+    // Matches on the text of 'input', which has to outlive the matcher.
+    explicit RegexMatcher(const RegexPattern* pattern, const UTF16Text& input);
 
    private:
+    // The counterparts of the public methods for the patterns that run on the
+    // linear engine, on utf8_.
+    bool LinearMatches(int* status) const;
+    bool LinearFind(int* status);
+    const LinearRegex::GroupSpan* LinearGroup(int group_idx,
+                                              int* status) const;
+
+    // Creates the ICU matcher on text_, with the work limits of 'pattern'.
+    void CreateMatcher(const RegexPattern* pattern);
+
+    // Counts the failures of matches that hit the work limits.
+    void RecordFailure(UErrorCode icu_status) const;
+
     bool UpdateLastFindOffset() const;
 
+    // Starts matching from the beginning of 'input', or of an empty text if
+    // 'input' is null. Keeps the allocated ICU matcher.
+    void Reset(const UTF16Text* input);
+
+    // Returns an estimate of the heap memory held, in bytes.
+    int64 EstimateHeapBytes() const;
+
     std::unique_ptr<icu::RegexMatcher> matcher_;
-    icu::UnicodeString text_;
+
+    // The counter of the UniLib that created the pattern.
+    std::atomic<int64>* num_limit_hits_;
+
+    // Points either to owned_text_ or to the text of input_.
+    icu::UnicodeString owned_text_;
+    const icu::UnicodeString* text_;
+
+    // The shared input, if any. Used to look codepoint offsets up instead of
+    // counting them.
+    const UTF16Text* input_;
     mutable int last_find_offset_;
     mutable int last_find_offset_codepoints_;
     mutable bool last_find_offset_dirty_;
+
+    // Set instead of matcher_ if the pattern runs on the linear engine, which
+    // works on the UTF-8 of the text.
+    const LinearRegex* linear_regex_;
+    std::string owned_utf8_;
+    const std::string* utf8_;
+
+    // The groups of the current match, or empty if there is none, and whether
+    // the last search failed, after which Find() finds nothing more.
+    mutable std::vector<LinearRegex::GroupSpan> linear_groups_;
+    mutable bool linear_search_failed_;
+    mutable LinearRegex::Workspace linear_workspace_;
   };
 
   class RegexPattern {
    public:
+    // A matcher borrowed from the pattern, which is handed back to it for
+    // reuse when the object is destroyed.
+    class ScopedMatcher {
+     public:
+      ScopedMatcher(const RegexPattern* pattern,
+                    std::unique_ptr<RegexMatcher> matcher)
+          : pattern_(pattern), matcher_(std::move(matcher)) {}
+      ScopedMatcher(ScopedMatcher&& other)
+          : pattern_(other.pattern_), matcher_(std::move(other.matcher_)) {}
+      ~ScopedMatcher() { pattern_->ReleaseMatcher(std::move(matcher_)); }
+
+      RegexMatcher* get() const { return matcher_.get(); }
+      RegexMatcher* operator->() const { return matcher_.get(); }
+      RegexMatcher& operator*() const { return *matcher_; }
+      explicit operator bool() const { return matcher_ != nullptr; }
+
+     private:
+      const RegexPattern* pattern_;
+      std::unique_ptr<RegexMatcher> matcher_;
+    };
+
     std::unique_ptr<RegexMatcher> Matcher(const UnicodeText& input) const;
 
+    // Same as above, but without converting the input again. The input has to
+    // outlive the matcher.
+    std::unique_ptr<RegexMatcher> Matcher(const UTF16Text& input) const;
+
+    // Same as above, but reuses a matcher that an earlier ScopedMatcher handed
+    // back instead of allocating a new one, if there is any.
+    // Thread-safe; concurrent callers get different matchers.
+    ScopedMatcher AcquireMatcher(const UTF16Text& input) const;
+
+    // Destroys the matchers kept for reuse.
+    // Thread-safe.
+    void ClearMatcherPool() const;
+
+    // Returns an estimate of the heap memory held by the compiled pattern and
+    // the matchers kept for reuse, in bytes. ICU doesn't expose the size of
+    // its compiled patterns, so for those it is extrapolated from the length
+    // of the pattern.
+    // Thread-safe.
+    int64 EstimateHeapBytes() const;
+
    protected:
     friend class UniLib;
-    explicit RegexPattern(std::unique_ptr<icu::RegexPattern> pattern)
-        : pattern_(std::move(pattern)) {}
+    RegexPattern(std::unique_ptr<icu::RegexPattern> pattern,
+                 std::unique_ptr<const LinearRegex> linear_regex,
+                 const RegexWorkLimits& limits,
+                 std::atomic<int64>* num_limit_hits)
+        : pattern_(std::move(pattern)),
+          linear_regex_(std::move(linear_regex)),
+          limits_(limits),
+          num_limit_hits_(num_limit_hits) {}
 
    private:
+    friend class RegexMatcher;
+
+    // The number of idle matchers kept for reuse.
+    static constexpr int kMaxPooledMatchers = 4;
+
+    void ReleaseMatcher(std::unique_ptr<RegexMatcher> matcher) const;
+
+    // Exactly one of them is set.
     std::unique_ptr<icu::RegexPattern> pattern_;
+    std::unique_ptr<const LinearRegex> linear_regex_;
+
+    const RegexWorkLimits limits_;
+    std::atomic<int64>* const num_limit_hits_;
+
+    mutable std::mutex matcher_pool_mutex_;
+    mutable std::vector<std::unique_ptr<RegexMatcher>> matcher_pool_;
   };
 
   class BreakIterator {
    public:
+    ~BreakIterator();
+
     int Next();
 
     static constexpr int kDone = -1;
 
    protected:
     friend class UniLib;
-    explicit BreakIterator(const UnicodeText& text);
+
+    // Iterates over the UTF-8 of 'text' directly, which has to outlive the
+    // iterator.
+    BreakIterator(const UnicodeText& text,
+                  std::unique_ptr<icu::BreakIterator> break_iterator);
 
    private:
     std::unique_ptr<icu::BreakIterator> break_iterator_;
-    icu::UnicodeString text_;
+    const char* text_data_;
+    UText* utext_;
     int last_break_index_;
     int last_unicode_index_;
   };
 
+  // The patterns that the linear engine supports run on it, in time linear in
+  // the input, and the others on ICU. The matchers of the latter stop with
+  // 'kError' when they hit 'limits'.
   std::unique_ptr<RegexPattern> CreateRegexPattern(
-      const UnicodeText& regex) const;
+      const UnicodeText& regex,
+      const RegexWorkLimits& limits = RegexWorkLimits()) const;
+
+  // Returns how many matches failed on the work limits, over all the patterns
+  // created by this object.
+  int64 NumRegexLimitHits() const {
+    return num_regex_limit_hits_.load(std::memory_order_relaxed);
+  }
+  std::unique_ptr<UTF16Text> CreateUTF16Text(const UnicodeText& text) const;
+
+  // Creates a word break iterator over 'text', which has to outlive it, with
+  // the rules of the given ICU locale, e.g. "th" or "ja". The rules of a
+  // locale are loaded by the first call for it only; the iterators of the
+  // later calls are clones. Returns nullptr on error.
+  std::unique_ptr<BreakIterator> CreateBreakIterator(
+      const UnicodeText& text, const std::string& locale) const;
+
+  // Same as above, with the rules of the "en" locale.
   std::unique_ptr<BreakIterator> CreateBreakIterator(
       const UnicodeText& text) const;
+
+ private:
+  // Bits of kLatin1Properties.
+  enum Latin1Property {
+    kLatin1Whitespace = 1,
+    kLatin1Digit = 2,
+    kLatin1Upper = 4,
+    kLatin1OpeningBracket = 8,
+    kLatin1ClosingBracket = 16,
+  };
+
+  // The properties of the codepoints 0 to 0xFF, as ICU defines them.
+  static const uint8 kLatin1Properties[256];
+
+  static bool IsLatin1(char32 codepoint) {
+    return codepoint >= 0 && codepoint <= 0xFF;
+  }
+  static bool HasLatin1Property(char32 codepoint, Latin1Property property) {
+    return kLatin1Properties[codepoint] & property;
+  }
+
+  mutable std::atomic<int64> num_regex_limit_hits_{0};
+
+  // The number of locales whose break iterator prototypes are kept.
+  static constexpr int kMaxBreakIteratorPrototypes = 8;
+
+  // The break iterators of the locales asked for so far, to clone, keyed by
+  // the locale.
+  mutable std::mutex break_iterator_prototypes_mutex_;
+  mutable std::unordered_map<std::string, std::unique_ptr<icu::BreakIterator>>
+      break_iterator_prototypes_;
+
+  bool IsOpeningBracketIcu(char32 codepoint) const;
+  bool IsClosingBracketIcu(char32 codepoint) const;
+  bool IsWhitespaceIcu(char32 codepoint) const;
+  bool IsDigitIcu(char32 codepoint) const;
+  bool IsUpperIcu(char32 codepoint) const;
+  char32 ToLowerIcu(char32 codepoint) const;
+  char32 GetPairedBracketIcu(char32 codepoint) const;
 };
 
 }  // namespace libtextclassifier2
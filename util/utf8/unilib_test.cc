@@ -70,6 +70,37 @@ TEST(UniLibTest, CharacterClassesUnicode) {
 }
 #endif  // ndef LIBTEXTCLASSIFIER_UNILIB_DUMMY
 
+#ifdef LIBTEXTCLASSIFIER_UNILIB_ICU
+TEST(UniLibTest, CharacterClassesLatin1AgreeWithIcu) {
+  CREATE_UNILIB_FOR_TESTING;
+  for (char32 codepoint = 0; codepoint <= 0x100; ++codepoint) {
+    EXPECT_EQ(unilib.IsOpeningBracket(codepoint),
+              u_getIntPropertyValue(codepoint,
+                                    UCHAR_BIDI_PAIRED_BRACKET_TYPE) ==
+                  U_BPT_OPEN)
+        << codepoint;
+    EXPECT_EQ(unilib.IsClosingBracket(codepoint),
+              u_getIntPropertyValue(codepoint,
+                                    UCHAR_BIDI_PAIRED_BRACKET_TYPE) ==
+                  U_BPT_CLOSE)
+        << codepoint;
+    EXPECT_EQ(unilib.IsWhitespace(codepoint),
+              static_cast<bool>(u_isWhitespace(codepoint)))
+        << codepoint;
+    EXPECT_EQ(unilib.IsDigit(codepoint),
+              static_cast<bool>(u_isdigit(codepoint)))
+        << codepoint;
+    EXPECT_EQ(unilib.IsUpper(codepoint),
+              static_cast<bool>(u_isupper(codepoint)))
+        << codepoint;
+    EXPECT_EQ(unilib.ToLower(codepoint), u_tolower(codepoint)) << codepoint;
+    EXPECT_EQ(unilib.GetPairedBracket(codepoint),
+              u_getBidiPairedBracket(codepoint))
+        << codepoint;
+  }
+}
+#endif  // LIBTEXTCLASSIFIER_UNILIB_ICU
+
 TEST(UniLibTest, RegexInterface) {
   CREATE_UNILIB_FOR_TESTING;
   const UnicodeText regex_pattern =
@@ -125,6 +156,183 @@ TEST(UniLibTest, Regex) {
   EXPECT_EQ(matcher->Group(0, &status).ToUTF8String(), "0123😋");
   EXPECT_EQ(status, UniLib::RegexMatcher::kNoError);
 }
+
+TEST(UniLibTest, RegexWorkLimits) {
+  CREATE_UNILIB_FOR_TESTING;
+  RegexWorkLimits limits;
+  limits.time_limit = 1;
+  // \Z is not supported by the linear engine, so the pattern runs on ICU.
+  std::unique_ptr<UniLib::RegexPattern> pattern = unilib.CreateRegexPattern(
+      UTF8ToUnicodeText("(a+)+\\Z", /*do_copy=*/false), limits);
+  ASSERT_TRUE(pattern);
+  const std::unique_ptr<UniLib::UTF16Text> input = unilib.CreateUTF16Text(
+      UTF8ToUnicodeText(std::string(64, 'a') + "b", /*do_copy=*/false));
+
+  // The backtracking takes exponential time, so the match fails on the limit.
+  int status = UniLib::RegexMatcher::kNoError;
+  {
+    const UniLib::RegexPattern::ScopedMatcher matcher =
+        pattern->AcquireMatcher(*input);
+    EXPECT_FALSE(matcher->Find(&status));
+    EXPECT_EQ(status, UniLib::RegexMatcher::kError);
+  }
+  EXPECT_EQ(unilib.NumRegexLimitHits(), 1);
+
+  // Matches within the limit succeed, and the pooled matcher keeps the limit.
+  const std::unique_ptr<UniLib::UTF16Text> short_input =
+      unilib.CreateUTF16Text(UTF8ToUnicodeText("aaa", /*do_copy=*/false));
+  {
+    const UniLib::RegexPattern::ScopedMatcher matcher =
+        pattern->AcquireMatcher(*short_input);
+    EXPECT_TRUE(matcher->Find(&status));
+    EXPECT_EQ(status, UniLib::RegexMatcher::kNoError);
+  }
+  const UniLib::RegexPattern::ScopedMatcher matcher =
+      pattern->AcquireMatcher(*input);
+  EXPECT_FALSE(matcher->Find(&status));
+  EXPECT_EQ(status, UniLib::RegexMatcher::kError);
+  EXPECT_EQ(unilib.NumRegexLimitHits(), 2);
+}
+#endif  // LIBTEXTCLASSIFIER_UNILIB_ICU
+
+#ifdef LIBTEXTCLASSIFIER_UNILIB_ICU
+TEST(UniLibTest, RegexOnLinearEngine) {
+  CREATE_UNILIB_FOR_TESTING;
+  // Runs in linear time, without any limits.
+  std::unique_ptr<UniLib::RegexPattern> pattern = unilib.CreateRegexPattern(
+      UTF8ToUnicodeText("(a+)+$", /*do_copy=*/false));
+  ASSERT_TRUE(pattern);
+  const std::unique_ptr<UniLib::UTF16Text> input = unilib.CreateUTF16Text(
+      UTF8ToUnicodeText(std::string(10000, 'a') + "b", /*do_copy=*/false));
+  int status = UniLib::RegexMatcher::kNoError;
+  EXPECT_FALSE(pattern->Matcher(*input)->Find(&status));
+  EXPECT_EQ(status, UniLib::RegexMatcher::kNoError);
+
+  // The offsets are in codepoints, and the groups that did not participate
+  // are empty.
+  pattern = unilib.CreateRegexPattern(UTF8ToUnicodeText(
+      "(\\d+)[.]\\s?(\\d+)(?:[.](\\d{4}))?", /*do_copy=*/false));
+  ASSERT_TRUE(pattern);
+  std::unique_ptr<UniLib::RegexMatcher> matcher = pattern->Matcher(
+      UTF8ToUnicodeText("Přijď 6. 12. nebo 7.1.2019", /*do_copy=*/false));
+  ASSERT_TRUE(matcher->Find(&status));
+  EXPECT_EQ(matcher->Start(&status), 6);
+  EXPECT_EQ(matcher->End(&status), 11);
+  EXPECT_EQ(matcher->Group(2, &status).ToUTF8String(), "12");
+  EXPECT_EQ(matcher->Start(3, &status), -1);
+  EXPECT_EQ(status, UniLib::RegexMatcher::kNoError);
+  EXPECT_EQ(matcher->Group(3, &status).ToUTF8String(), "");
+  EXPECT_EQ(status, UniLib::RegexMatcher::kNoError);
+  matcher->Group(4, &status);
+  EXPECT_EQ(status, UniLib::RegexMatcher::kError);
+  ASSERT_TRUE(matcher->Find(&status));
+  EXPECT_EQ(matcher->Start(&status), 18);
+  EXPECT_EQ(matcher->Group(3, &status).ToUTF8String(), "2019");
+  EXPECT_FALSE(matcher->Find(&status));
+  EXPECT_EQ(status, UniLib::RegexMatcher::kNoError);
+  EXPECT_FALSE(matcher->Find(&status));
+  matcher->Start(&status);
+  EXPECT_EQ(status, UniLib::RegexMatcher::kError);
+}
+
+TEST(UniLibTest, RegexOnSharedUTF16Text) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<UniLib::RegexPattern> digits =
+      unilib.CreateRegexPattern(UTF8ToUnicodeText("[0-9]+", /*do_copy=*/false));
+  std::unique_ptr<UniLib::RegexPattern> smileys =
+      unilib.CreateRegexPattern(UTF8ToUnicodeText("😋+", /*do_copy=*/false));
+  const std::unique_ptr<UniLib::UTF16Text> input = unilib.CreateUTF16Text(
+      UTF8ToUnicodeText("hello😋😋 0123😋 world", /*do_copy=*/false));
+  EXPECT_EQ(input->size_codepoints(), 19);
+  EXPECT_EQ(input->CodepointOffset(0), 0);
+  EXPECT_EQ(input->CodepointOffset(5), 5);
+  EXPECT_EQ(input->CodepointOffset(7), 6);
+  EXPECT_EQ(input->CodepointOffset(9), 7);
+  EXPECT_EQ(input->CodepointOffset(22), 19);
+
+  int status;
+  std::unique_ptr<UniLib::RegexMatcher> digits_matcher =
+      digits->Matcher(*input);
+  std::unique_ptr<UniLib::RegexMatcher> smileys_matcher =
+      smileys->Matcher(*input);
+  EXPECT_TRUE(digits_matcher->Find(&status));
+  EXPECT_EQ(digits_matcher->Start(&status), 8);
+  EXPECT_EQ(digits_matcher->End(&status), 12);
+  EXPECT_TRUE(smileys_matcher->Find(&status));
+  EXPECT_EQ(smileys_matcher->Start(&status), 5);
+  EXPECT_EQ(smileys_matcher->End(&status), 7);
+  EXPECT_TRUE(smileys_matcher->Find(&status));
+  EXPECT_EQ(smileys_matcher->Group(&status).ToUTF8String(), "😋");
+  EXPECT_FALSE(digits_matcher->Find(&status));
+  EXPECT_EQ(status, UniLib::RegexMatcher::kNoError);
+}
+
+TEST(UniLibTest, RegexGroupViewsOfUTF8) {
+  CREATE_UNILIB_FOR_TESTING;
+  const std::string text = "Přijď 6. 12. nebo 7.1.2019😋";
+  const std::unique_ptr<UniLib::UTF16Text> input =
+      unilib.CreateUTF16Text(UTF8ToUnicodeText(text, /*do_copy=*/false));
+
+  // \Z is not supported by the linear engine, so the first pattern runs on
+  // ICU and the second one on the linear engine.
+  for (const std::string& pattern_text :
+       {"(\\d+)[.](\\d+)(?:[.](\\d{4}))?(😋)?\\Z",
+        "(\\d+)[.](\\d+)(?:[.](\\d{4}))?(😋)?$"}) {
+    std::unique_ptr<UniLib::RegexPattern> pattern = unilib.CreateRegexPattern(
+        UTF8ToUnicodeText(pattern_text, /*do_copy=*/false));
+    ASSERT_TRUE(pattern);
+    std::unique_ptr<UniLib::RegexMatcher> matcher = pattern->Matcher(*input);
+    int status;
+    ASSERT_TRUE(matcher->Find(&status));
+    EXPECT_EQ(matcher->StartUTF8(0, &status), 20);
+    EXPECT_EQ(status, UniLib::RegexMatcher::kNoError);
+    EXPECT_EQ(matcher->EndUTF8(0, &status), text.size());
+    EXPECT_EQ(matcher->StartUTF8(4, &status), text.size() - 4);
+    EXPECT_EQ(matcher->GroupView(3, &status).ToUTF8String(), "2019");
+    EXPECT_EQ(matcher->GroupView(4, &status).ToUTF8String(), "😋");
+    EXPECT_EQ(status, UniLib::RegexMatcher::kNoError);
+    matcher->GroupView(5, &status);
+    EXPECT_EQ(status, UniLib::RegexMatcher::kError);
+  }
+}
+#endif  // LIBTEXTCLASSIFIER_UNILIB_ICU
+
+#ifdef LIBTEXTCLASSIFIER_UNILIB_ICU
+TEST(UniLibTest, RegexReusesMatchers) {
+  CREATE_UNILIB_FOR_TESTING;
+  std::unique_ptr<UniLib::RegexPattern> pattern =
+      unilib.CreateRegexPattern(UTF8ToUnicodeText("[0-9]+", /*do_copy=*/false));
+
+  UniLib::RegexMatcher* first_matcher;
+  {
+    const std::unique_ptr<UniLib::UTF16Text> input = unilib.CreateUTF16Text(
+        UTF8ToUnicodeText("😋 12 34", /*do_copy=*/false));
+    UniLib::RegexPattern::ScopedMatcher matcher =
+        pattern->AcquireMatcher(*input);
+    ASSERT_TRUE(matcher);
+    first_matcher = matcher.get();
+    int status;
+    EXPECT_TRUE(matcher->Find(&status));
+    EXPECT_EQ(matcher->Start(&status), 2);
+    EXPECT_TRUE(matcher->Find(&status));
+  }
+
+  // The matcher is reused, and starts from the beginning of the new input.
+  const std::unique_ptr<UniLib::UTF16Text> input =
+      unilib.CreateUTF16Text(UTF8ToUnicodeText("x 567", /*do_copy=*/false));
+  UniLib::RegexPattern::ScopedMatcher matcher = pattern->AcquireMatcher(*input);
+  EXPECT_EQ(matcher.get(), first_matcher);
+  int status;
+  EXPECT_TRUE(matcher->Find(&status));
+  EXPECT_EQ(matcher->Start(&status), 2);
+  EXPECT_EQ(matcher->End(&status), 5);
+  EXPECT_FALSE(matcher->Find(&status));
+
+  // Concurrently held matchers are distinct.
+  UniLib::RegexPattern::ScopedMatcher other_matcher =
+      pattern->AcquireMatcher(*input);
+  EXPECT_NE(other_matcher.get(), matcher.get());
+}
 #endif  // LIBTEXTCLASSIFIER_UNILIB_ICU
 
 #ifdef LIBTEXTCLASSIFIER_UNILIB_ICU
@@ -197,6 +405,31 @@ TEST(UniLibTest, BreakIterator4ByteUTF8) {
 }
 #endif  // LIBTEXTCLASSIFIER_UNILIB_ICU
 
+#ifdef LIBTEXTCLASSIFIER_UNILIB_ICU
+TEST(UniLibTest, BreakIteratorLocales) {
+  CREATE_UNILIB_FOR_TESTING;
+  const UnicodeText text =
+      UTF8ToUnicodeText("ผมชอบกินข้าว 😋 ok", /*do_copy=*/false);
+  const auto break_indices = [&unilib, &text](const std::string& locale) {
+    std::unique_ptr<UniLib::BreakIterator> iterator =
+        unilib.CreateBreakIterator(text, locale);
+    std::vector<int> result;
+    int break_index = 0;
+    while ((break_index = iterator->Next()) != UniLib::BreakIterator::kDone) {
+      result.push_back(break_index);
+    }
+    return result;
+  };
+
+  // The iterators created from the kept rules break the same way.
+  const std::vector<int> thai_breaks = break_indices("th");
+  EXPECT_EQ(thai_breaks, break_indices("th"));
+  EXPECT_EQ(thai_breaks, break_indices("en"));
+  EXPECT_GT(thai_breaks.size(), 4);
+  EXPECT_EQ(thai_breaks.back(), 17);
+}
+#endif  // LIBTEXTCLASSIFIER_UNILIB_ICU
+
 #ifndef LIBTEXTCLASSIFIER_UNILIB_JAVAICU
 TEST(UniLibTest, IntegerParse) {
   CREATE_UNILIB_FOR_TESTING;
@@ -16,6 +16,7 @@
 
 #include "zlib-utils.h"
 
+#include <algorithm>
 #include <memory>
 
 #include "util/base/logging.h"
@@ -45,14 +46,41 @@ ZlibDecompressor::~ZlibDecompressor() {
 }
 
 bool ZlibDecompressor::Decompress(const CompressedBuffer* compressed_buffer,
-                                  std::string* out) {
-  out->resize(compressed_buffer->uncompressed_size());
+                                  char* out, int out_size) {
+  const int uncompressed_size = compressed_buffer->uncompressed_size();
+  if (compressed_buffer->buffer() == nullptr || uncompressed_size < 0 ||
+      uncompressed_size > out_size) {
+    return false;
+  }
+  if (compressed_buffer->self_contained() && inflateReset(&stream_) != Z_OK) {
+    return false;
+  }
   stream_.next_in =
       reinterpret_cast<const Bytef*>(compressed_buffer->buffer()->Data());
   stream_.avail_in = compressed_buffer->buffer()->Length();
-  stream_.next_out = reinterpret_cast<Bytef*>(const_cast<char*>(out->c_str()));
-  stream_.avail_out = compressed_buffer->uncompressed_size();
-  return (inflate(&stream_, Z_SYNC_FLUSH) == Z_OK);
+  stream_.next_out = reinterpret_cast<Bytef*>(out);
+  stream_.avail_out = uncompressed_size;
+  return (inflate(&stream_, Z_SYNC_FLUSH) == Z_OK && stream_.avail_out == 0);
+}
+
+bool ZlibDecompressor::Decompress(const CompressedBuffer* compressed_buffer,
+                                  std::string* out) {
+  out->resize(compressed_buffer->uncompressed_size());
+  return Decompress(compressed_buffer, &(*out)[0], out->size());
+}
+
+bool ZlibDecompressor::Decompress(const CompressedBuffer* compressed_buffer,
+                                  StringPiece* out) {
+  const int uncompressed_size = compressed_buffer->uncompressed_size();
+  if (uncompressed_size > output_buffer_.size()) {
+    output_buffer_.resize(uncompressed_size);
+  }
+  if (!Decompress(compressed_buffer, output_buffer_.data(),
+                  output_buffer_.size())) {
+    return false;
+  }
+  *out = StringPiece(output_buffer_.data(), uncompressed_size);
+  return true;
 }
 
 std::unique_ptr<ZlibCompressor> ZlibCompressor::Instance() {
@@ -76,7 +104,11 @@ ZlibCompressor::~ZlibCompressor() { deflateEnd(&stream_); }
 
 void ZlibCompressor::Compress(const std::string& uncompressed_content,
                               CompressedBufferT* out) {
+  // Each buffer starts a stream of its own, so that it can be decompressed
+  // independently of the others.
+  deflateReset(&stream_);
   out->uncompressed_size = uncompressed_content.size();
+  out->self_contained = true;
   out->buffer.clear();
   stream_.next_in =
       reinterpret_cast<const Bytef*>(uncompressed_content.c_str());
@@ -156,6 +188,10 @@ namespace {
 bool DecompressBuffer(const CompressedBufferT* compressed_pattern,
                       ZlibDecompressor* zlib_decompressor,
                       std::string* uncompressed_pattern) {
+  // Patterns that are stored uncompressed already are kept as they are.
+  if (compressed_pattern == nullptr) {
+    return true;
+  }
   std::string packed_pattern =
       PackFlatbuffer<CompressedBuffer>(compressed_pattern);
   if (!zlib_decompressor->Decompress(
@@ -227,12 +263,90 @@ std::string CompressSerializedModel(const std::string& model) {
                      builder.GetSize());
 }
 
+std::string DecompressSerializedModel(const std::string& model) {
+  std::unique_ptr<ModelT> unpacked_model = UnPackModel(model.c_str());
+  TC_CHECK(unpacked_model != nullptr);
+  TC_CHECK(DecompressModel(unpacked_model.get()));
+  flatbuffers::FlatBufferBuilder builder;
+  FinishModelBuffer(builder, Model::Pack(builder, unpacked_model.get()));
+  return std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                     builder.GetSize());
+}
+
+namespace {
+bool IsCompressed(const CompressedBuffer* compressed_pattern) {
+  return compressed_pattern != nullptr &&
+         compressed_pattern->buffer() != nullptr;
+}
+}  // namespace
+
+bool HasCompressedPatterns(const Model* model) {
+  if (model->regex_model() != nullptr &&
+      model->regex_model()->patterns() != nullptr) {
+    for (const RegexModel_::Pattern* pattern :
+         *model->regex_model()->patterns()) {
+      if (IsCompressed(pattern->compressed_pattern())) {
+        return true;
+      }
+    }
+  }
+
+  const DatetimeModel* datetime_model = model->datetime_model();
+  if (datetime_model == nullptr) {
+    return false;
+  }
+  if (datetime_model->patterns() != nullptr) {
+    for (const DatetimeModelPattern* pattern : *datetime_model->patterns()) {
+      if (pattern->regexes() == nullptr) {
+        continue;
+      }
+      for (const DatetimeModelPattern_::Regex* regex : *pattern->regexes()) {
+        if (IsCompressed(regex->compressed_pattern())) {
+          return true;
+        }
+      }
+    }
+  }
+  if (datetime_model->extractors() != nullptr) {
+    for (const DatetimeModelExtractor* extractor :
+         *datetime_model->extractors()) {
+      if (IsCompressed(extractor->compressed_pattern())) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool SharedPatternKey(const flatbuffers::String* uncompressed_pattern,
+                      const CompressedBuffer* compressed_pattern,
+                      std::string* key) {
+  if (IsCompressed(compressed_pattern)) {
+    if (!compressed_pattern->self_contained()) {
+      return false;
+    }
+    key->assign("c");
+    key->append(
+        reinterpret_cast<const char*>(compressed_pattern->buffer()->data()),
+        compressed_pattern->buffer()->size());
+    return true;
+  }
+  if (uncompressed_pattern == nullptr) {
+    return false;
+  }
+  key->assign("u");
+  key->append(uncompressed_pattern->c_str(), uncompressed_pattern->Length());
+  return true;
+}
+
 std::unique_ptr<UniLib::RegexPattern> UncompressMakeRegexPattern(
     const UniLib& unilib, const flatbuffers::String* uncompressed_pattern,
     const CompressedBuffer* compressed_pattern, ZlibDecompressor* decompressor,
-    std::string* result_pattern_text) {
+    std::string* result_pattern_text, const RegexWorkLimits& limits) {
   UnicodeText unicode_regex_pattern;
-  std::string decompressed_pattern;
+  // Points into the output buffer of the decompressor, so that the text is not
+  // copied before being compiled.
+  StringPiece decompressed_pattern;
   if (compressed_pattern != nullptr &&
       compressed_pattern->buffer() != nullptr) {
     if (decompressor == nullptr ||
@@ -258,7 +372,7 @@ std::unique_ptr<UniLib::RegexPattern> UncompressMakeRegexPattern(
   }
 
   std::unique_ptr<UniLib::RegexPattern> regex_pattern =
-      unilib.CreateRegexPattern(unicode_regex_pattern);
+      unilib.CreateRegexPattern(unicode_regex_pattern, limits);
   if (!regex_pattern) {
     TC_LOG(ERROR) << "Could not create pattern: "
                   << unicode_regex_pattern.ToUTF8String();
@@ -266,4 +380,119 @@ std::unique_ptr<UniLib::RegexPattern> UncompressMakeRegexPattern(
   return regex_pattern;
 }
 
+bool UncompressMakeRegexPatterns(
+    const UniLib& unilib,
+    const std::vector<std::pair<const flatbuffers::String*,
+                                const CompressedBuffer*>>& patterns,
+    ZlibDecompressor* decompressor, Executor* executor,
+    const RegexWorkLimits& limits,
+    std::vector<std::unique_ptr<UniLib::RegexPattern>>* result,
+    std::vector<std::string>* result_pattern_texts) {
+  // The patterns are split into chunks, so that a task amortizes its
+  // decompressor over several of them.
+  const int kPatternsPerTask = 16;
+
+  result->clear();
+  result->resize(patterns.size());
+  if (result_pattern_texts != nullptr) {
+    result_pattern_texts->clear();
+    result_pattern_texts->resize(patterns.size());
+  }
+
+  // Buffers that continue the stream of the previous one can only be
+  // decompressed in order.
+  bool self_contained = true;
+  for (const auto& pattern : patterns) {
+    if (pattern.second != nullptr && pattern.second->buffer() != nullptr &&
+        !pattern.second->self_contained()) {
+      self_contained = false;
+      break;
+    }
+  }
+
+  const int num_tasks =
+      (executor != nullptr && self_contained)
+          ? (patterns.size() + kPatternsPerTask - 1) / kPatternsPerTask
+          : 1;
+  const int patterns_per_task =
+      num_tasks > 1 ? kPatternsPerTask : patterns.size();
+  std::vector<char> succeeded(num_tasks, true);
+  RunInParallel(executor, num_tasks, [&](int task) {
+    std::unique_ptr<ZlibDecompressor> task_decompressor;
+    ZlibDecompressor* pattern_decompressor = decompressor;
+    if (num_tasks > 1) {
+      task_decompressor = ZlibDecompressor::Instance();
+      pattern_decompressor = task_decompressor.get();
+    }
+    const int begin = task * patterns_per_task;
+    const int end =
+        std::min<int>(begin + patterns_per_task, patterns.size());
+    for (int i = begin; i < end; ++i) {
+      (*result)[i] = UncompressMakeRegexPattern(
+          unilib, patterns[i].first, patterns[i].second, pattern_decompressor,
+          result_pattern_texts != nullptr ? &(*result_pattern_texts)[i]
+                                          : nullptr,
+          limits);
+      if ((*result)[i] == nullptr) {
+        succeeded[task] = false;
+        return;
+      }
+    }
+  });
+
+  for (const bool task_succeeded : succeeded) {
+    if (!task_succeeded) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool UncompressPatternText(const flatbuffers::String* uncompressed_pattern,
+                           const CompressedBuffer* compressed_pattern,
+                           ZlibDecompressor* decompressor,
+                           std::string* pattern_text) {
+  if (compressed_pattern != nullptr &&
+      compressed_pattern->buffer() != nullptr) {
+    if (decompressor == nullptr ||
+        !decompressor->Decompress(compressed_pattern, pattern_text)) {
+      TC_LOG(ERROR) << "Cannot decompress pattern.";
+      return false;
+    }
+    return true;
+  }
+  if (uncompressed_pattern == nullptr) {
+    TC_LOG(ERROR) << "Cannot load uncompressed pattern.";
+    return false;
+  }
+  pattern_text->assign(uncompressed_pattern->c_str(),
+                       uncompressed_pattern->Length());
+  return true;
+}
+
+const UniLib::RegexPattern* LazyRegexPattern::Get() const {
+  std::call_once(compile_once_, [this]() {
+    if (pattern_ != nullptr) {
+      return;
+    }
+    std::unique_ptr<ZlibDecompressor> decompressor;
+    if (compressed_pattern_ != nullptr &&
+        compressed_pattern_->buffer() != nullptr) {
+      decompressor = ZlibDecompressor::Instance();
+    }
+    pattern_ = UncompressMakeRegexPattern(
+        unilib_, uncompressed_pattern_, compressed_pattern_, decompressor.get(),
+        /*result_pattern_text=*/nullptr, limits_);
+    compiled_.store(true, std::memory_order_release);
+  });
+  return pattern_.get();
+}
+
+int64 LazyRegexPattern::EstimateHeapBytes() const {
+  if (!compiled_.load(std::memory_order_acquire) || pattern_ == nullptr) {
+    return 0;
+  }
+  return sizeof(UniLib::RegexPattern) + pattern_->EstimateHeapBytes();
+}
+
 }  // namespace libtextclassifier2
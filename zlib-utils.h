@@ -19,9 +19,17 @@
 #ifndef LIBTEXTCLASSIFIER_ZLIB_UTILS_H_
 #define LIBTEXTCLASSIFIER_ZLIB_UTILS_H_
 
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "model_generated.h"
+#include "util/base/macros.h"
+#include "util/strings/stringpiece.h"
+#include "util/thread/executor.h"
 #include "util/utf8/unilib.h"
 #include "zlib.h"
 
@@ -32,12 +40,25 @@ class ZlibDecompressor {
   static std::unique_ptr<ZlibDecompressor> Instance();
   ~ZlibDecompressor();
 
+  // Decompresses into 'out', which has to hold 'out_size' bytes, at least
+  // compressed_buffer->uncompressed_size(). Self-contained buffers reset the
+  // stream first, so one decompressor can be reused across any of them; the
+  // others have to be decompressed in the order they were compressed.
+  bool Decompress(const CompressedBuffer* compressed_buffer, char* out,
+                  int out_size);
+
   bool Decompress(const CompressedBuffer* compressed_buffer, std::string* out);
 
+  // Decompresses into an output buffer owned by the decompressor, which is
+  // reused across calls, and points 'out' to it. The result is valid until the
+  // next call.
+  bool Decompress(const CompressedBuffer* compressed_buffer, StringPiece* out);
+
  private:
   ZlibDecompressor();
   z_stream stream_;
   bool initialized_;
+  std::vector<char> output_buffer_;
 };
 
 class ZlibCompressor {
@@ -68,11 +89,99 @@ bool DecompressModel(ModelT* model);
 // Compresses regex and datetime rules in the model.
 std::string CompressSerializedModel(const std::string& model);
 
-// Create and compile a regex pattern from optionally compressed pattern.
+// Decompresses regex and datetime rules in the model, so that they can be
+// used straight from the model buffer when loading it.
+std::string DecompressSerializedModel(const std::string& model);
+
+// Returns true if any regex or datetime rule in the model is compressed.
+bool HasCompressedPatterns(const Model* model);
+
+// Sets 'key' to a string that is the same for two patterns iff they have the
+// same text, as far as that can be told without decompressing them, so that
+// identical patterns can share one compilation. Returns false for patterns
+// that continue a legacy compressed stream, which can't be told apart by their
+// bytes.
+bool SharedPatternKey(const flatbuffers::String* uncompressed_pattern,
+                      const CompressedBuffer* compressed_pattern,
+                      std::string* key);
+
+// Create and compile a regex pattern from optionally compressed pattern. The
+// matches of the pattern are bounded by 'limits'.
 std::unique_ptr<UniLib::RegexPattern> UncompressMakeRegexPattern(
     const UniLib& unilib, const flatbuffers::String* uncompressed_pattern,
     const CompressedBuffer* compressed_pattern, ZlibDecompressor* decompressor,
-    std::string* result_pattern_text = nullptr);
+    std::string* result_pattern_text = nullptr,
+    const RegexWorkLimits& limits = RegexWorkLimits());
+
+// Creates and compiles the regex patterns of a list of optionally compressed
+// patterns, given as pairs of their uncompressed and compressed field, into
+// 'result' in the same order. If 'executor' is set and all the compressed
+// patterns are self-contained, they are decompressed and compiled in parallel
+// on it, each task with its own decompressor. Otherwise they are processed in
+// order with 'decompressor'. If 'result_pattern_texts' is set, it receives the
+// texts of the patterns. Returns false if any of the patterns failed.
+bool UncompressMakeRegexPatterns(
+    const UniLib& unilib,
+    const std::vector<std::pair<const flatbuffers::String*,
+                                const CompressedBuffer*>>& patterns,
+    ZlibDecompressor* decompressor, Executor* executor,
+    const RegexWorkLimits& limits,
+    std::vector<std::unique_ptr<UniLib::RegexPattern>>* result,
+    std::vector<std::string>* result_pattern_texts = nullptr);
+
+// Gets the text of an optionally compressed pattern.
+bool UncompressPatternText(const flatbuffers::String* uncompressed_pattern,
+                           const CompressedBuffer* compressed_pattern,
+                           ZlibDecompressor* decompressor,
+                           std::string* pattern_text);
+
+// A regex pattern from the model that is decompressed and compiled only when
+// it is first used, so that patterns that are never run cost nothing at load
+// time. The model buffer has to outlive the object.
+// Thread-safe.
+class LazyRegexPattern {
+ public:
+  LazyRegexPattern(const UniLib& unilib,
+                   const flatbuffers::String* uncompressed_pattern,
+                   const CompressedBuffer* compressed_pattern,
+                   const RegexWorkLimits& limits = RegexWorkLimits())
+      : unilib_(unilib),
+        uncompressed_pattern_(uncompressed_pattern),
+        compressed_pattern_(compressed_pattern),
+        limits_(limits) {}
+
+  // Wraps an already compiled pattern.
+  LazyRegexPattern(const UniLib& unilib,
+                   std::unique_ptr<UniLib::RegexPattern> pattern)
+      : unilib_(unilib),
+        uncompressed_pattern_(nullptr),
+        compressed_pattern_(nullptr),
+        limits_(),
+        pattern_(std::move(pattern)),
+        compiled_(true) {}
+
+  // Returns the compiled pattern, compiling it on the first call, or nullptr
+  // if it could not be compiled.
+  const UniLib::RegexPattern* Get() const;
+
+  // Returns an estimate of the heap memory held by the compiled pattern, in
+  // bytes, or 0 if it hasn't been compiled.
+  int64 EstimateHeapBytes() const;
+
+ private:
+  const UniLib& unilib_;
+  const flatbuffers::String* uncompressed_pattern_;
+  const CompressedBuffer* compressed_pattern_;
+  const RegexWorkLimits limits_;
+
+  mutable std::once_flag compile_once_;
+  mutable std::unique_ptr<UniLib::RegexPattern> pattern_;
+
+  // Set once pattern_ is final, so that it can be read without compiling it.
+  mutable std::atomic<bool> compiled_{false};
+
+  TC_DISALLOW_COPY_AND_ASSIGN(LazyRegexPattern);
+};
 
 }  // namespace libtextclassifier2
 
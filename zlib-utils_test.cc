@@ -95,4 +95,121 @@ TEST(ZlibUtilsTest, CompressModel) {
             "an example datetime extractor");
 }
 
+TEST(ZlibUtilsTest, DecompressSerializedModel) {
+  ModelT model;
+  model.regex_model.reset(new RegexModelT);
+  model.regex_model->patterns.emplace_back(new RegexModel_::PatternT);
+  model.regex_model->patterns.back()->pattern = "this is a test pattern";
+  model.datetime_model.reset(new DatetimeModelT);
+  model.datetime_model->extractors.emplace_back(new DatetimeModelExtractorT);
+  model.datetime_model->extractors.back()->pattern =
+      "an example datetime extractor";
+  EXPECT_TRUE(CompressModel(&model));
+
+  flatbuffers::FlatBufferBuilder builder;
+  FinishModelBuffer(builder, Model::Pack(builder, &model));
+  const std::string compressed_buffer(
+      reinterpret_cast<const char*>(builder.GetBufferPointer()),
+      builder.GetSize());
+  EXPECT_TRUE(HasCompressedPatterns(GetModel(compressed_buffer.data())));
+
+  const std::string uncompressed_buffer =
+      DecompressSerializedModel(compressed_buffer);
+  const Model* uncompressed_model = GetModel(uncompressed_buffer.data());
+  EXPECT_FALSE(HasCompressedPatterns(uncompressed_model));
+  EXPECT_EQ(
+      uncompressed_model->regex_model()->patterns()->Get(0)->pattern()->str(),
+      "this is a test pattern");
+  EXPECT_EQ(uncompressed_model->datetime_model()
+                ->extractors()
+                ->Get(0)
+                ->pattern()
+                ->str(),
+            "an example datetime extractor");
+
+  // Decompressing again leaves the patterns as they are.
+  EXPECT_EQ(DecompressSerializedModel(uncompressed_buffer),
+            uncompressed_buffer);
+}
+
+TEST(ZlibUtilsTest, DecompressSelfContainedBuffersInAnyOrder) {
+  ModelT model;
+  model.regex_model.reset(new RegexModelT);
+  model.regex_model->patterns.emplace_back(new RegexModel_::PatternT);
+  model.regex_model->patterns.back()->pattern = "this is a test pattern";
+  model.regex_model->patterns.emplace_back(new RegexModel_::PatternT);
+  model.regex_model->patterns.back()->pattern = "this is a second test pattern";
+  EXPECT_TRUE(CompressModel(&model));
+  EXPECT_TRUE(
+      model.regex_model->patterns[0]->compressed_pattern->self_contained);
+
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(Model::Pack(builder, &model));
+  const Model* compressed_model =
+      GetModel(reinterpret_cast<const char*>(builder.GetBufferPointer()));
+  ASSERT_TRUE(compressed_model != nullptr);
+  const CompressedBuffer* first =
+      compressed_model->regex_model()->patterns()->Get(0)->compressed_pattern();
+  const CompressedBuffer* second =
+      compressed_model->regex_model()->patterns()->Get(1)->compressed_pattern();
+
+  std::unique_ptr<ZlibDecompressor> decompressor = ZlibDecompressor::Instance();
+  ASSERT_TRUE(decompressor != nullptr);
+  StringPiece uncompressed_pattern;
+  EXPECT_TRUE(decompressor->Decompress(second, &uncompressed_pattern));
+  EXPECT_EQ(uncompressed_pattern.ToString(), "this is a second test pattern");
+  EXPECT_TRUE(decompressor->Decompress(first, &uncompressed_pattern));
+  EXPECT_EQ(uncompressed_pattern.ToString(), "this is a test pattern");
+
+  // Into a buffer of the caller, which has to be large enough.
+  char buffer[64];
+  EXPECT_TRUE(decompressor->Decompress(second, buffer, sizeof(buffer)));
+  EXPECT_EQ(std::string(buffer, second->uncompressed_size()),
+            "this is a second test pattern");
+  EXPECT_FALSE(decompressor->Decompress(first, buffer, /*out_size=*/4));
+}
+
+TEST(ZlibUtilsTest, LazyRegexPattern) {
+  CREATE_UNILIB_FOR_TESTING;
+  ModelT model;
+  model.regex_model.reset(new RegexModelT);
+  model.regex_model->patterns.emplace_back(new RegexModel_::PatternT);
+  model.regex_model->patterns.back()->pattern = "a+b";
+  model.regex_model->patterns.emplace_back(new RegexModel_::PatternT);
+  model.regex_model->patterns.back()->pattern = "(unbalanced";
+  EXPECT_TRUE(CompressModel(&model));
+
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(Model::Pack(builder, &model));
+  const Model* compressed_model =
+      GetModel(reinterpret_cast<const char*>(builder.GetBufferPointer()));
+  ASSERT_TRUE(compressed_model != nullptr);
+
+  const RegexModel_::Pattern* pattern =
+      compressed_model->regex_model()->patterns()->Get(0);
+  const LazyRegexPattern lazy_pattern(unilib, pattern->pattern(),
+                                      pattern->compressed_pattern());
+  const UniLib::RegexPattern* compiled_pattern = lazy_pattern.Get();
+  ASSERT_TRUE(compiled_pattern != nullptr);
+  EXPECT_EQ(lazy_pattern.Get(), compiled_pattern);
+  int status;
+  EXPECT_TRUE(compiled_pattern
+                  ->Matcher(UTF8ToUnicodeText("aaab", /*do_copy=*/false))
+                  ->Matches(&status));
+
+  std::unique_ptr<ZlibDecompressor> decompressor = ZlibDecompressor::Instance();
+  std::string pattern_text;
+  EXPECT_TRUE(UncompressPatternText(pattern->pattern(),
+                                    pattern->compressed_pattern(),
+                                    decompressor.get(), &pattern_text));
+  EXPECT_EQ(pattern_text, "a+b");
+
+  // A broken pattern only fails when it is used.
+  const RegexModel_::Pattern* broken_pattern =
+      compressed_model->regex_model()->patterns()->Get(1);
+  const LazyRegexPattern lazy_broken_pattern(
+      unilib, broken_pattern->pattern(), broken_pattern->compressed_pattern());
+  EXPECT_TRUE(lazy_broken_pattern.Get() == nullptr);
+}
+
 }  // namespace libtextclassifier2